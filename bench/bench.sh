@@ -0,0 +1,172 @@
+#!/bin/sh
+#
+# bench.sh - Benchmark picobox commands against the system's coreutils
+#
+# Usage: bench.sh PICOBOX BENCH_RUN BENCH_GEN [MICRO]...
+#
+# Generates the datasets (bench_gen; only when they are missing or their
+# size changed), then times every case below twice through bench_run:
+# once as picobox (a symlink named after the command, since picobox
+# dispatches on argv[0]) and once as the command found on PATH. Then it
+# runs each MICRO, a shell microbenchmark (bench/micro_*.c) printing one
+# JSON object per case. Everything goes to one JSON document, which is
+# also printed: "results" holds the commands, "shell" the microbenchmarks.
+#
+# Environment:
+#   BENCH_SIZE=MB     size of log.txt; wide.tsv and words.txt scale with it (64)
+#   BENCH_FILES=N     files in the directory tree (20000)
+#   BENCH_REPS=N      timed runs per command (10)
+#   BENCH_WARMUP=N    untimed runs first (2)
+#   BENCH_DATA=DIR    where the datasets live (build/bench-data)
+#   BENCH_ONLY=REGEX  run only the cases (and MICRO programs) whose name matches
+#   BENCH_RESULTS=F   where the results go (build/bench/COMMIT.json)
+#
+# Datasets depend only on BENCH_SIZE and BENCH_FILES, so results taken on
+# the same machine with the same settings are comparable across commits.
+
+set -e
+
+if [ $# -lt 3 ]; then
+    echo "Usage: bench.sh PICOBOX BENCH_RUN BENCH_GEN [MICRO]..." >&2
+    exit 2
+fi
+
+abspath() {
+    case "$1" in
+        /*) echo "$1" ;;
+        *) echo "$(pwd)/$1" ;;
+    esac
+}
+
+PICOBOX=$(abspath "$1")
+BENCH_RUN=$(abspath "$2")
+BENCH_GEN=$(abspath "$3")
+shift 3
+SIZE=${BENCH_SIZE:-64}
+FILES=${BENCH_FILES:-20000}
+REPS=${BENCH_REPS:-10}
+WARMUP=${BENCH_WARMUP:-2}
+DATA=$(abspath "${BENCH_DATA:-build/bench-data}")
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+if [ -n "$(git status --porcelain --untracked-files=no 2>/dev/null)" ]; then
+    COMMIT="$COMMIT-dirty"
+fi
+RESULTS=${BENCH_RESULTS:-build/bench/$COMMIT.json}
+TAB=$(printf '\t')
+
+# Datasets, and a sorted copy of the word list for uniq
+if [ "$(cat "$DATA/.params" 2>/dev/null)" != "$SIZE $FILES" ]; then
+    echo "Generating ${SIZE}MB of data and $FILES files in $DATA..." >&2
+    rm -rf "$DATA"
+    "$BENCH_GEN" -s "$SIZE" -t "$FILES" "$DATA"
+    LC_ALL=C sort "$DATA/words.txt" > "$DATA/words.sorted"
+    echo "$SIZE $FILES" > "$DATA/.params"
+fi
+
+# picobox under each command's name
+BIN=$(mktemp -d "${TMPDIR:-/tmp}/picobox-bench.XXXXXX")
+trap 'rm -rf "$BIN" "$RESULTS.tmp"' EXIT
+
+mkdir -p "$(dirname "$RESULTS")"
+{
+    echo "{"
+    echo "  \"commit\": \"$COMMIT\","
+    echo "  \"date\": \"$(date -u +%Y-%m-%dT%H:%M:%SZ)\","
+    echo "  \"host\": \"$(uname -srm)\","
+    echo "  \"cpus\": $(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 0),"
+    echo "  \"size_mb\": $SIZE, \"files\": $FILES, \"reps\": $REPS, \"warmup\": $WARMUP,"
+    echo "  \"results\": ["
+} > "$RESULTS.tmp"
+FIRST=1
+
+# bench_impl NAME INPUT IMPL COMMAND [ARG]...
+# Time COMMAND as picobox or as the system's (IMPL picobox or system).
+# INPUT is the file whose size gives the throughput ("-" for none);
+# the command runs in $DATA
+bench_impl() {
+    name=$1
+    input=$2
+    impl=$3
+    cmd=$4
+    shift 4
+
+    if [ -n "$BENCH_ONLY" ] && ! echo "$name" | grep -Eq "$BENCH_ONLY"; then
+        return
+    fi
+    if [ "$impl" = picobox ]; then
+        ln -sf "$PICOBOX" "$BIN/$cmd"
+        path="$BIN/$cmd"
+    else
+        path=$(command -v "$cmd" || true)
+        [ -n "$path" ] || return 0
+    fi
+    bytes=0
+    if [ "$input" != "-" ]; then
+        bytes=$(wc -c < "$DATA/$input" | tr -d ' ')
+    fi
+
+    echo "  $name ($impl)" >&2
+    [ $FIRST = 1 ] || echo "," >> "$RESULTS.tmp"
+    FIRST=0
+    (cd "$DATA" && "$BENCH_RUN" -w "$WARMUP" -n "$REPS" -b "$bytes" \
+        -N "$name" -I "$impl" -- "$path" "$@") >> "$RESULTS.tmp"
+}
+
+# bench NAME INPUT COMMAND [ARG]...
+# Both, where picobox takes the same arguments as the system command
+bench() {
+    case_name=$1
+    case_input=$2
+    shift 2
+    bench_impl "$case_name" "$case_input" picobox "$@"
+    bench_impl "$case_name" "$case_input" system "$@"
+}
+
+echo "Benchmarking $PICOBOX ($COMMIT)..." >&2
+
+# Startup latency
+bench "true"            -               true
+bench "echo"            -               echo hello
+
+# Streaming text
+bench "cat"             log.txt         cat log.txt
+bench "wc"              log.txt         wc log.txt
+bench "wc -l"           log.txt         wc -l log.txt
+bench "grep literal"    log.txt         grep ERROR log.txt
+bench "grep -c"         log.txt         grep -c worker-3 log.txt
+bench "grep -i"         log.txt         grep -i error log.txt
+bench "grep -E"         log.txt         grep -E " 5[0-9][0-9] 1[0-9]{3}ms" log.txt
+bench "head -n 1000"    -               head -n 1000 log.txt
+bench "tail -n 1000"    -               tail -n 1000 log.txt
+bench "cut -f"          wide.tsv        cut -f 1,5,9 wide.tsv
+bench "sha256sum"       log.txt         sha256sum log.txt
+
+# Sorting
+bench "sort"            words.txt       sort words.txt
+bench "sort -n -k"      wide.tsv        sort -n -t "$TAB" -k 2 wide.tsv
+bench "uniq -c"         words.sorted    uniq -c words.sorted
+
+# Directory trees
+bench_impl "find -name" -  picobox        find tree --name "*.c"
+bench_impl "find -name" -  system         find tree -name "*.c"
+bench "du -s"           -               du -s tree
+bench "ls -lR"          -               ls -lR tree
+
+# Shell microbenchmarks, one JSON object per line
+echo "" >> "$RESULTS.tmp"
+echo "  ]," >> "$RESULTS.tmp"
+echo "  \"shell\": [" >> "$RESULTS.tmp"
+for micro in "$@"; do
+    if [ -n "$BENCH_ONLY" ] && ! basename "$micro" | grep -Eq "$BENCH_ONLY"; then
+        continue
+    fi
+    echo "  $(basename "$micro")" >&2
+    "$micro" -r "$REPS"
+done | sed -e 's/^/    /' -e '$!s/$/,/' >> "$RESULTS.tmp"
+{
+    echo "  ]"
+    echo "}"
+} >> "$RESULTS.tmp"
+mv "$RESULTS.tmp" "$RESULTS"
+cat "$RESULTS"
+echo "Results written to $RESULTS" >&2
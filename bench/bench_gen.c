@@ -0,0 +1,252 @@
+/*
+ * bench_gen.c - Deterministic datasets for the benchmark suite
+ *
+ * Usage: bench_gen [-s MB] [-t FILES] DIR
+ *
+ * Writes into DIR:
+ *   log.txt    application log lines (timestamps, levels, request paths,
+ *              latencies, hex ids), about MB megabytes
+ *   wide.tsv   a 24-column tab-separated table, about MB/2 megabytes
+ *   words.txt  one word per line from a 5000-word vocabulary with a
+ *              skewed (roughly Zipf) distribution, about MB/4 megabytes
+ *   tree/      a directory tree six levels deep, narrow at the top and
+ *              wide at the bottom, holding about FILES small files
+ *
+ * Every byte comes from a fixed-seed xorshift generator, so the same
+ * arguments give the same files on every machine and every commit, and
+ * results from different commits measure the same work.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* mkdir() under -std=c11 */
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define VOCABULARY 5000
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+/* The next number from the generator (xorshift64*) */
+static uint64_t rng(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/* A number in [0, n) */
+static unsigned int rng_below(unsigned int n)
+{
+    return (unsigned int)((rng() >> 32) % n);
+}
+
+static char vocabulary[VOCABULARY][12];
+
+/* Pronounceable made-up words, 3 to 10 letters */
+static void build_vocabulary(void)
+{
+    static const char consonants[] = "bcdfghklmnprstvz";
+    static const char vowels[] = "aeiou";
+
+    for (int i = 0; i < VOCABULARY; i++) {
+        int len = 3 + (int)rng_below(8);
+
+        for (int j = 0; j < len; j++) {
+            vocabulary[i][j] = j % 2 ? vowels[rng_below(5)] : consonants[rng_below(16)];
+        }
+        vocabulary[i][len] = '\0';
+    }
+}
+
+/* A word, low indexes far more often than high ones */
+static const char *skewed_word(void)
+{
+    uint64_t r = rng_below(VOCABULARY);
+
+    return vocabulary[(r * r) / VOCABULARY];
+}
+
+static FILE *open_output(const char *dir, const char *name)
+{
+    char path[4096];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        exit(1);
+    }
+    return fp;
+}
+
+static void close_output(FILE *fp, const char *name)
+{
+    if (fclose(fp) != 0) {
+        perror(name);
+        exit(1);
+    }
+}
+
+static void write_log(const char *dir, long bytes)
+{
+    static const char *const levels[] = { "INFO", "INFO", "INFO", "INFO", "DEBUG", "DEBUG", "WARN", "ERROR" };
+    static const char *const methods[] = { "GET", "GET", "GET", "POST", "PUT", "DELETE" };
+    static const char *const resources[] = { "users", "orders", "items", "sessions", "search", "health" };
+    static const int statuses[] = { 200, 200, 200, 200, 201, 204, 304, 400, 404, 500 };
+    FILE *fp = open_output(dir, "log.txt");
+    long written = 0;
+    unsigned long ms = 0;
+
+    while (written < bytes) {
+        unsigned long t;
+        int n;
+
+        ms += rng_below(40);
+        t = ms / 1000;
+        n = fprintf(fp, "2024-03-%02lu %02lu:%02lu:%02lu.%03lu %-5s [worker-%u] %s /api/v1/%s/%u %d %ums req=%016llx %s %s\n",
+                    1 + (t / 86400) % 28, (t / 3600) % 24, (t / 60) % 60, t % 60, ms % 1000,
+                    levels[rng_below(8)], rng_below(16), methods[rng_below(6)],
+                    resources[rng_below(6)], rng_below(100000), statuses[rng_below(10)],
+                    rng_below(2000), (unsigned long long)rng(), skewed_word(), skewed_word());
+        if (n < 0) {
+            perror("log.txt");
+            exit(1);
+        }
+        written += n;
+    }
+    close_output(fp, "log.txt");
+}
+
+static void write_tsv(const char *dir, long bytes)
+{
+    FILE *fp = open_output(dir, "wide.tsv");
+    long written = 0;
+    unsigned int id = 0;
+
+    while (written < bytes) {
+        int n = fprintf(fp, "%u", id++);
+
+        for (int col = 1; col < 24; col++) {
+            n += fprintf(fp, "\t");
+            switch (col % 4) {
+            case 0:
+                n += fprintf(fp, "%s", skewed_word());
+                break;
+            case 1:
+                n += fprintf(fp, "%u", rng_below(1000000));
+                break;
+            case 2:
+                n += fprintf(fp, "%u.%02u", rng_below(10000), rng_below(100));
+                break;
+            default:
+                n += fprintf(fp, "%c%u", 'A' + rng_below(26), rng_below(1000));
+                break;
+            }
+        }
+        n += fprintf(fp, "\n");
+        written += n;
+    }
+    close_output(fp, "wide.tsv");
+}
+
+static void write_words(const char *dir, long bytes)
+{
+    FILE *fp = open_output(dir, "words.txt");
+    long written = 0;
+
+    while (written < bytes) {
+        const char *w = skewed_word();
+
+        fputs(w, fp);
+        fputc('\n', fp);
+        written += (long)strlen(w) + 1;
+    }
+    close_output(fp, "words.txt");
+}
+
+/*
+ * One directory of the tree and everything under it
+ * fanout[depth]: subdirectories per directory at that depth
+ */
+static void write_tree(const char *path, int depth, int files_per_dir)
+{
+    static const int fanout[] = { 4, 4, 4, 5, 5, 0 };
+    static const char *const suffixes[] = { ".c", ".h", ".txt", ".log", ".md", ".o" };
+    char child[4096];
+    char data[4096];
+
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        perror(path);
+        exit(1);
+    }
+    for (int i = 0; i < files_per_dir; i++) {
+        size_t size = rng_below(sizeof(data));
+        FILE *fp;
+
+        snprintf(child, sizeof(child), "%s/%s%d%s", path, skewed_word(), i, suffixes[rng_below(6)]);
+        for (size_t j = 0; j < size; j++) {
+            data[j] = (char)(j % 64 == 63 ? '\n' : 'a' + rng_below(26));
+        }
+        fp = fopen(child, "w");
+        if (!fp || fwrite(data, 1, size, fp) != size || fclose(fp) != 0) {
+            perror(child);
+            exit(1);
+        }
+    }
+    for (int i = 0; i < fanout[depth]; i++) {
+        snprintf(child, sizeof(child), "%s/d%d_%s", path, i, vocabulary[rng_below(VOCABULARY)]);
+        write_tree(child, depth + 1, files_per_dir);
+    }
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: bench_gen [-s MB] [-t FILES] DIR\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    long mb = 64;
+    long files = 20000;
+    const char *dir;
+    char path[4096];
+    int i;
+
+    for (i = 1; i < argc - 1 && argv[i][0] == '-'; i += 2) {
+        if (strcmp(argv[i], "-s") == 0) {
+            mb = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            files = atol(argv[i + 1]);
+        } else {
+            usage();
+        }
+    }
+    if (i != argc - 1 || mb <= 0 || files <= 0) {
+        usage();
+    }
+    dir = argv[i];
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        perror(dir);
+        return 1;
+    }
+
+    build_vocabulary();
+    write_log(dir, mb << 20);
+    write_tsv(dir, (mb << 20) / 2);
+    write_words(dir, (mb << 20) / 4);
+
+    /* 1 + 4 + 16 + 64 + 320 + 1600 = 2005 directories */
+    snprintf(path, sizeof(path), "%s/tree", dir);
+    write_tree(path, 0, (int)((files + 2004) / 2005));
+    return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * bench_run.c - Time one command for the benchmark suite
+ *
+ * Usage: bench_run [-w WARMUP] [-n REPS] [-i FILE] [-b BYTES]
+ *                  [-N NAME] [-I IMPL] -- COMMAND [ARG]...
+ *
+ * Runs COMMAND WARMUP times untimed, then REPS times timed, and prints
+ * one JSON object: wall-clock latency (min, p50, p90, p99, max, mean in
+ * milliseconds), throughput over BYTES of input at the median, the
+ * largest max RSS of any timed run (from wait4()), and the size of the
+ * output. FILE, if given, is the command's stdin (else /dev/null).
+ *
+ * The output is read through a pipe and thrown away here rather than
+ * sent to /dev/null, because some tools (GNU grep) notice /dev/null and
+ * stop at the first match. Percentiles are nearest-rank: with the
+ * default 10 runs, p90 is the second slowest run and p99 the slowest.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* wait4() and struct rusage under -std=c11 */
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* What one run of the command gave */
+typedef struct run_result {
+    double ms;                  /* Wall clock */
+    long max_rss_kb;
+    long long output_bytes;
+    int status;                 /* Exit status, 128+N for a signal */
+} run_result_t;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* Run argv once with input as its stdin, draining its stdout */
+static int run_once(char **argv, const char *input, run_result_t *r)
+{
+    static char buf[1 << 16];
+    struct rusage ru;
+    int out[2];
+    double start;
+    pid_t pid;
+    ssize_t n;
+    int status;
+
+    if (pipe(out) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    start = now_ms();
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        int in = open(input ? input : "/dev/null", O_RDONLY);
+
+        if (in < 0) {
+            perror(input ? input : "/dev/null");
+            _exit(127);
+        }
+        dup2(in, STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in);
+        close(out[0]);
+        close(out[1]);
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+
+    close(out[1]);
+    r->output_bytes = 0;
+    while ((n = read(out[0], buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            break;
+        }
+        r->output_bytes += n;
+    }
+    close(out[0]);
+    while (wait4(pid, &status, 0, &ru) < 0) {
+        if (errno != EINTR) {
+            perror("wait4");
+            return -1;
+        }
+    }
+    r->ms = now_ms() - start;
+    r->max_rss_kb = ru.ru_maxrss;
+#ifdef __APPLE__
+    r->max_rss_kb /= 1024;      /* Bytes there */
+#endif
+    r->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    return 0;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile p of sorted[0..n) */
+static double percentile(const double *sorted, int n, int p)
+{
+    int rank = (p * n + 99) / 100;
+
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/* s as a JSON string body */
+static void json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            printf("\\%c", *s);
+        } else if ((unsigned char)*s < 0x20) {
+            printf("\\u%04x", *s);
+        } else {
+            putchar(*s);
+        }
+    }
+    putchar('"');
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: bench_run [-w WARMUP] [-n REPS] [-i FILE] [-b BYTES] "
+                    "[-N NAME] [-I IMPL] -- COMMAND [ARG]...\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int warmup = 2;
+    int reps = 10;
+    const char *input = NULL;
+    long long bytes = 0;
+    const char *name = "";
+    const char *impl = "";
+    double *ms;
+    double sum = 0;
+    long max_rss = 0;
+    run_result_t r = { 0 };
+    int i;
+
+    for (i = 1; i < argc && strcmp(argv[i], "--") != 0; i += 2) {
+        if (i + 1 >= argc) {
+            usage();
+        }
+        if (strcmp(argv[i], "-w") == 0) {
+            warmup = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            reps = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-i") == 0) {
+            input = argv[i + 1];
+        } else if (strcmp(argv[i], "-b") == 0) {
+            bytes = atoll(argv[i + 1]);
+        } else if (strcmp(argv[i], "-N") == 0) {
+            name = argv[i + 1];
+        } else if (strcmp(argv[i], "-I") == 0) {
+            impl = argv[i + 1];
+        } else {
+            usage();
+        }
+    }
+    if (i + 1 >= argc || reps < 1 || warmup < 0) {
+        usage();
+    }
+    argv += i + 1;
+
+    ms = malloc((size_t)reps * sizeof(double));
+    if (!ms) {
+        perror("malloc");
+        return 1;
+    }
+    for (i = 0; i < warmup; i++) {
+        if (run_once(argv, input, &r) != 0) {
+            return 1;
+        }
+    }
+    for (i = 0; i < reps; i++) {
+        if (run_once(argv, input, &r) != 0) {
+            return 1;
+        }
+        ms[i] = r.ms;
+        sum += r.ms;
+        if (r.max_rss_kb > max_rss) {
+            max_rss = r.max_rss_kb;
+        }
+    }
+    qsort(ms, (size_t)reps, sizeof(double), compare_double);
+
+    printf("{\"name\": ");
+    json_string(name);
+    printf(", \"impl\": ");
+    json_string(impl);
+    printf(", \"command\": [");
+    for (i = 0; argv[i]; i++) {
+        if (i > 0) {
+            printf(", ");
+        }
+        json_string(argv[i]);
+    }
+    printf("],\n  \"reps\": %d, \"warmup\": %d, \"status\": %d, \"input_bytes\": %lld, "
+           "\"output_bytes\": %lld,\n", reps, warmup, r.status, bytes, r.output_bytes);
+    printf("  \"ms\": {\"min\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, "
+           "\"max\": %.3f, \"mean\": %.3f},\n",
+           ms[0], percentile(ms, reps, 50), percentile(ms, reps, 90),
+           percentile(ms, reps, 99), ms[reps - 1], sum / reps);
+    printf("  \"mb_per_s\": %.1f, \"max_rss_kb\": %ld}\n",
+           bytes > 0 ? bytes / 1048576.0 / (percentile(ms, reps, 50) / 1000.0) : 0.0, max_rss);
+    free(ms);
+    return 0;
+}
@@ -0,0 +1,113 @@
+#ifndef MICRO_H
+#define MICRO_H
+
+/*
+ * micro.h - Timing loop shared by the shell microbenchmarks
+ *
+ * Each bench/micro_*.c is its own program, linked with the objects
+ * picobox is built from (everything but main.o), so it times the same
+ * code the shell runs. A case is a function doing an operation iters
+ * times; micro_case() calibrates iters so one round takes about
+ * MICRO_ROUND_MS, runs MICRO_ROUNDS rounds, and prints a JSON object on
+ * one line:
+ *
+ *   {"bench": "parse", "name": "pipeline", "iters": 40960, "rounds": 7,
+ *    "ns_per_op": {"min": ..., "p50": ..., "max": ...}, "ops_per_s": ...,
+ *    "mb_per_s": ...}
+ *
+ * mb_per_s appears only for cases that move bytes. Rounds and round
+ * length come from -r ROUNDS and -t MS (micro_init()).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MICRO_ROUNDS 7
+#define MICRO_ROUND_MS 200
+
+/* Run an operation iters times */
+typedef void (*micro_fn)(void *arg, long iters);
+
+static int micro_rounds = MICRO_ROUNDS;
+static double micro_round_ms = MICRO_ROUND_MS;
+
+static inline double micro_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Read -r ROUNDS and -t MS */
+static inline void micro_init(int argc, char **argv)
+{
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-r") == 0 && atoi(argv[i + 1]) > 0) {
+            micro_rounds = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-t") == 0 && atof(argv[i + 1]) > 0) {
+            micro_round_ms = atof(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Usage: %s [-r ROUNDS] [-t MS]\n", argv[0]);
+            exit(2);
+        }
+    }
+}
+
+static inline int micro_compare(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Time fn(arg, iters) and print the result
+ * bytes_per_op: data one operation moves, for mb_per_s (0: none)
+ */
+static inline void micro_case(const char *bench, const char *name, micro_fn fn, void *arg,
+                              double bytes_per_op)
+{
+    double ns[64];
+    double start;
+    double elapsed;
+    long iters = 1;
+    int rounds = micro_rounds < 64 ? micro_rounds : 64;
+
+    /* Calibrate: double iters until a run takes a tenth of a round */
+    for (;;) {
+        start = micro_now_ns();
+        fn(arg, iters);
+        elapsed = micro_now_ns() - start;
+        if (elapsed * 10 >= micro_round_ms * 1e6 || iters >= (1L << 40)) {
+            break;
+        }
+        iters *= 2;
+    }
+    iters = (long)(iters * (micro_round_ms * 1e6 / (elapsed > 1 ? elapsed : 1)));
+    if (iters < 1) {
+        iters = 1;
+    }
+
+    for (int r = 0; r < rounds; r++) {
+        start = micro_now_ns();
+        fn(arg, iters);
+        ns[r] = (micro_now_ns() - start) / iters;
+    }
+    qsort(ns, (size_t)rounds, sizeof(double), micro_compare);
+
+    printf("{\"bench\": \"%s\", \"name\": \"%s\", \"iters\": %ld, \"rounds\": %d, "
+           "\"ns_per_op\": {\"min\": %.1f, \"p50\": %.1f, \"max\": %.1f}, \"ops_per_s\": %.0f",
+           bench, name, iters, rounds, ns[0], ns[rounds / 2], ns[rounds - 1],
+           1e9 / ns[rounds / 2]);
+    if (bytes_per_op > 0) {
+        printf(", \"mb_per_s\": %.1f", bytes_per_op / ns[rounds / 2] * 1e9 / 1048576.0);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+#endif /* MICRO_H */
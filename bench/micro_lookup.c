@@ -0,0 +1,77 @@
+/*
+ * micro_lookup.c - Command registry lookups
+ *
+ * Times find_command() over the built-in command table, as the shell
+ * calls it for every command word: names at the start, middle and end
+ * of the sorted table, a mix of all of them, and names that are not
+ * commands (every external command costs one such miss).
+ */
+
+#include "cmd_spec.h"
+#include "micro.h"
+
+/* Every built-in name, filled in from the table */
+static const char *all_names[256];
+static size_t name_count;
+
+static void run_lookup(void *arg, long iters)
+{
+    const char *name = arg;
+
+    for (long i = 0; i < iters; i++) {
+        if (!find_command(name)) {
+            fprintf(stderr, "micro_lookup: no %s\n", name);
+            exit(1);
+        }
+    }
+}
+
+static void run_lookup_all(void *arg, long iters)
+{
+    (void)arg;
+    for (long i = 0; i < iters; i++) {
+        if (!find_command(all_names[(size_t)i % name_count])) {
+            fprintf(stderr, "micro_lookup: lost %s\n", all_names[(size_t)i % name_count]);
+            exit(1);
+        }
+    }
+}
+
+static void run_miss(void *arg, long iters)
+{
+    static const char *const missing[] = { "gcc", "make", "python3", "zzz", "a" };
+
+    (void)arg;
+    for (long i = 0; i < iters; i++) {
+        if (find_command(missing[i % 5])) {
+            fprintf(stderr, "micro_lookup: found %s\n", missing[i % 5]);
+            exit(1);
+        }
+    }
+}
+
+static void collect_name(const cmd_spec_t *spec, void *userdata)
+{
+    (void)userdata;
+    if (name_count < sizeof(all_names) / sizeof(all_names[0])) {
+        all_names[name_count++] = spec->name;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    micro_init(argc, argv);
+    register_command_table(builtin_commands, builtin_command_count);
+    for_each_command(collect_name, NULL);
+    if (name_count == 0) {
+        fprintf(stderr, "micro_lookup: no built-in commands\n");
+        return 1;
+    }
+
+    micro_case("lookup", "first", run_lookup, (void *)all_names[0], 0);
+    micro_case("lookup", "middle", run_lookup, (void *)all_names[name_count / 2], 0);
+    micro_case("lookup", "last", run_lookup, (void *)all_names[name_count - 1], 0);
+    micro_case("lookup", "all_names", run_lookup_all, NULL, 0);
+    micro_case("lookup", "miss", run_miss, NULL, 0);
+    return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * micro_parse.c - Parse time per line
+ *
+ * Times the BNFC parser (psInput(), the string form of pInput()) on
+ * lines that exercise each part of the grammar, and the fast path
+ * (fast_parse_line()) on the simple ones it takes. Every parse is
+ * followed by ast_reset(), as the shell does after running a line.
+ */
+
+#include "fast_parse.h"
+#include "../bnfc_shell/Parser.h"
+#include "micro.h"
+
+typedef struct parse_case {
+    const char *name;
+    const char *line;
+} parse_case_t;
+
+static const parse_case_t cases[] = {
+    { "simple",       "ls -la /usr/local/bin" },
+    { "assignment",   "PATH=/usr/bin:/bin" },
+    { "pipeline",     "cat access.log | grep -v DEBUG | cut -f 2 | sort | uniq -c" },
+    { "redirections", "sort -n < input.txt > sorted.txt" },
+    { "sequence",     "cd /tmp ; mkdir -p work ; ls work ; pwd" },
+    { "and_or",       "make && echo built || echo failed" },
+    { "for_loop",     "for f in *.c ; do wc -l $f ; done" },
+    { "if_while",     "while test -f lock ; do if true ; then sleep 1 ; fi ; done" },
+    { "substitution", "x=$(basename $f) ; echo $(ls | wc -l)" },
+};
+
+static void run_parser(void *arg, long iters)
+{
+    const char *line = arg;
+
+    for (long i = 0; i < iters; i++) {
+        if (!psInput(line)) {
+            fprintf(stderr, "micro_parse: cannot parse: %s\n", line);
+            exit(1);
+        }
+        ast_reset();
+    }
+}
+
+static void run_fast_path(void *arg, long iters)
+{
+    const char *line = arg;
+
+    for (long i = 0; i < iters; i++) {
+        if (!fast_parse_line(line)) {
+            fprintf(stderr, "micro_parse: cannot parse: %s\n", line);
+            exit(1);
+        }
+        ast_reset();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    micro_init(argc, argv);
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        micro_case("parse", cases[i].name, run_parser, (void *)cases[i].line,
+                   (double)strlen(cases[i].line));
+    }
+
+    /* The fast path, on the lines it takes */
+    micro_case("parse", "simple_fast_path", run_fast_path, (void *)cases[0].line,
+               (double)strlen(cases[0].line));
+    micro_case("parse", "assignment_fast_path", run_fast_path, (void *)cases[1].line,
+               (double)strlen(cases[1].line));
+    return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * micro_pipeline.c - Pipeline throughput through exec_pipeline()
+ *
+ * Pushes a DATA_MB file through cat FILE | cat | ... | wc -c with 2, 4
+ * and 8 stages and reports bytes per second end to end, so the cost of
+ * each extra stage (a process and a pipe) shows as the drop between
+ * them. exec_pipeline() runs its stages as external programs, so these
+ * are the system's cat and wc; wc's count goes to /dev/null.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* mkstemp() under -std=c11 */
+#endif
+
+#include "pipe_helpers.h"
+#include "micro.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#define DATA_MB 16
+#define MAX_STAGES 8
+
+typedef struct pipeline_case {
+    char ***argv_list;
+    int count;
+} pipeline_case_t;
+
+static void run_pipeline_case(void *arg, long iters)
+{
+    pipeline_case_t *c = arg;
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+
+    if (saved < 0 || null_fd < 0) {
+        perror("micro_pipeline");
+        exit(1);
+    }
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+    for (long i = 0; i < iters; i++) {
+        if (exec_pipeline(c->argv_list, c->count) != 0) {
+            dup2(saved, STDOUT_FILENO);
+            fprintf(stderr, "micro_pipeline: pipeline failed\n");
+            exit(1);
+        }
+    }
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+int main(int argc, char **argv)
+{
+    static const int stage_counts[] = { 2, 4, 8 };
+    char data_file[] = "/tmp/micro_pipeline.XXXXXX";
+    char *first[] = { "cat", data_file, NULL };
+    char *middle[] = { "cat", NULL };
+    char *last[] = { "wc", "-c", NULL };
+    char **argv_list[MAX_STAGES];
+    char block[65536];
+    int fd;
+
+    micro_init(argc, argv);
+    fd = mkstemp(data_file);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(block); i++) {
+        block[i] = i % 80 == 79 ? '\n' : (char)('a' + i % 26);
+    }
+    for (int i = 0; i < DATA_MB * 16; i++) {
+        if (write(fd, block, sizeof(block)) != (ssize_t)sizeof(block)) {
+            perror(data_file);
+            unlink(data_file);
+            return 1;
+        }
+    }
+    close(fd);
+
+    for (size_t n = 0; n < sizeof(stage_counts) / sizeof(stage_counts[0]); n++) {
+        pipeline_case_t c = { argv_list, stage_counts[n] };
+        char name[32];
+
+        argv_list[0] = first;
+        for (int i = 1; i < c.count - 1; i++) {
+            argv_list[i] = middle;
+        }
+        argv_list[c.count - 1] = last;
+        snprintf(name, sizeof(name), "stages_%d", c.count);
+        micro_case("pipeline", name, run_pipeline_case, &c, (double)DATA_MB * 1048576);
+    }
+
+    unlink(data_file);
+    return 0;
+}
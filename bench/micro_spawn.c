@@ -0,0 +1,129 @@
+/*
+ * micro_spawn.c - Command round trips through exec_command_with_redirects()
+ *
+ * Times one command from call to exit status: a registry command run in
+ * the shell process, the same with its output redirected to a file, and
+ * an external program (the system's true and echo, by absolute path so
+ * the registry does not take them) with each spawn backend. The zygote
+ * is started first, while the process is small, as the shell does.
+ * The external true then runs again with HEAP_MB of extra heap dirtied,
+ * where fork() slows down with the process's size and posix_spawn()
+ * and the zygote should not.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* mkstemp() under -std=c11 */
+#endif
+
+#include "exec_helpers.h"
+#include "zygote.h"
+#include "micro.h"
+
+#include <unistd.h>
+
+#define HEAP_MB 128                 /* Ballast for the *_heap cases */
+
+typedef struct spawn_case {
+    char **argv;
+    struct redirection *redirs;
+    int redir_count;
+} spawn_case_t;
+
+static void run_command(void *arg, long iters)
+{
+    spawn_case_t *c = arg;
+
+    for (long i = 0; i < iters; i++) {
+        if (exec_command_with_redirects(c->argv, c->redirs, c->redir_count) != 0) {
+            fprintf(stderr, "micro_spawn: %s failed\n", c->argv[0]);
+            exit(1);
+        }
+    }
+}
+
+/* The first of /bin/NAME and /usr/bin/NAME that can be run, into path */
+static void system_program(char *path, size_t size, const char *name)
+{
+    snprintf(path, size, "/bin/%s", name);
+    if (access(path, X_OK) != 0) {
+        snprintf(path, size, "/usr/bin/%s", name);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        int backend;
+    } backends[] = {
+        { "fork", SPAWN_BACKEND_FORK },
+        { "spawn", SPAWN_BACKEND_SPAWN },
+        { "zygote", SPAWN_BACKEND_ZYGOTE },
+    };
+    char out_file[] = "/tmp/micro_spawn.XXXXXX";
+    char true_path[64];
+    char echo_path[64];
+    char *registry_true[] = { "true", NULL };
+    char *registry_echo[] = { "echo", "hello", NULL };
+    char *external_true[] = { true_path, NULL };
+    char *external_echo[] = { echo_path, "hello", NULL };
+    struct redirection to_file = { REDIR_OUTPUT, out_file };
+    spawn_case_t c;
+    int have_zygote = zygote_start() == 0;
+    size_t ballast_size = (size_t)HEAP_MB << 20;
+    char *ballast;
+    int fd;
+
+    micro_init(argc, argv);
+    system_program(true_path, sizeof(true_path), "true");
+    system_program(echo_path, sizeof(echo_path), "echo");
+    register_command_table(builtin_commands, builtin_command_count);
+    fd = mkstemp(out_file);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    c = (spawn_case_t){ registry_true, NULL, 0 };
+    micro_case("spawn", "registry_inprocess", run_command, &c, 0);
+    c = (spawn_case_t){ registry_echo, &to_file, 1 };
+    micro_case("spawn", "registry_redirect", run_command, &c, 0);
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        char name[64];
+
+        if (backends[b].backend == SPAWN_BACKEND_ZYGOTE && !have_zygote) {
+            continue;
+        }
+        set_spawn_backend(backends[b].backend);
+        c = (spawn_case_t){ external_true, NULL, 0 };
+        snprintf(name, sizeof(name), "external_%s", backends[b].name);
+        micro_case("spawn", name, run_command, &c, 0);
+        c = (spawn_case_t){ external_echo, &to_file, 1 };
+        snprintf(name, sizeof(name), "external_redirect_%s", backends[b].name);
+        micro_case("spawn", name, run_command, &c, 0);
+    }
+
+    ballast = malloc(ballast_size);
+    if (!ballast) {
+        perror("malloc");
+        return 1;
+    }
+    memset(ballast, 1, ballast_size);   /* make the pages resident */
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        char name[64];
+
+        if (backends[b].backend == SPAWN_BACKEND_ZYGOTE && !have_zygote) {
+            continue;
+        }
+        set_spawn_backend(backends[b].backend);
+        c = (spawn_case_t){ external_true, NULL, 0 };
+        snprintf(name, sizeof(name), "external_%s_heap", backends[b].name);
+        micro_case("spawn", name, run_command, &c, 0);
+    }
+    free(ballast);
+
+    unlink(out_file);
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * micro_vars.c - Shell variable table operations
+ *
+ * Times var_table_set(), var_table_get() and var_table_unset() on a
+ * table holding VARS variables, the way a script's loop uses them:
+ * reading and overwriting the same few names, looking up names that are
+ * not set, and filling a fresh table. The *_large cases fill and read
+ * VARS_LARGE variables; they should stay close to the small ones, as
+ * the table grows a few buckets at a time.
+ */
+
+#include "var_table.h"
+#include "micro.h"
+
+#define VARS 1024
+#define VARS_LARGE 100000
+
+static char names[VARS_LARGE][16];
+static char values[VARS_LARGE][16];
+
+/* A table and how many of the names it holds */
+typedef struct vars_case {
+    var_table_t *table;
+    long count;
+} vars_case_t;
+
+/* Insert new names, starting a fresh table every count of them */
+static void run_fill(void *arg, long iters)
+{
+    vars_case_t *c = arg;
+    long i = 0;
+
+    while (i < iters) {
+        var_table_t *t = var_table_create(0);
+
+        for (long j = 0; j < c->count && i < iters; j++, i++) {
+            var_table_set(t, names[j], values[j]);
+        }
+        var_table_destroy(t);
+    }
+}
+
+static void run_get(void *arg, long iters)
+{
+    vars_case_t *c = arg;
+    long found = 0;
+
+    for (long i = 0; i < iters; i++) {
+        found += var_table_get(c->table, names[i % c->count]) != NULL;
+    }
+    if (found != iters) {
+        fprintf(stderr, "micro_vars: lost a variable\n");
+        exit(1);
+    }
+}
+
+static void run_get_missing(void *arg, long iters)
+{
+    static const char *const missing[] = { "HOME2", "undefined", "x_y_z", "PATHX" };
+    var_table_t *t = arg;
+
+    for (long i = 0; i < iters; i++) {
+        if (var_table_get(t, missing[i % 4]) != NULL) {
+            fprintf(stderr, "micro_vars: found an unset variable\n");
+            exit(1);
+        }
+    }
+}
+
+static void run_overwrite(void *arg, long iters)
+{
+    var_table_t *t = arg;
+
+    for (long i = 0; i < iters; i++) {
+        var_table_set(t, names[i % 8], values[i % VARS]);
+    }
+}
+
+/* Unset and set again, so the table keeps its size */
+static void run_unset(void *arg, long iters)
+{
+    var_table_t *t = arg;
+
+    for (long i = 0; i < iters; i++) {
+        var_table_unset(t, names[i % VARS]);
+        var_table_set(t, names[i % VARS], values[i % VARS]);
+    }
+}
+
+/* A table holding the first count names, or NULL */
+static var_table_t *filled_table(long count)
+{
+    var_table_t *t = var_table_create(0);
+
+    if (!t) {
+        perror("var_table_create");
+        return NULL;
+    }
+    for (long i = 0; i < count; i++) {
+        var_table_set(t, names[i], values[i]);
+    }
+    return t;
+}
+
+int main(int argc, char **argv)
+{
+    vars_case_t small = { NULL, VARS };
+    vars_case_t large = { NULL, VARS_LARGE };
+    var_table_t *t;
+
+    micro_init(argc, argv);
+    for (int i = 0; i < VARS_LARGE; i++) {
+        snprintf(names[i], sizeof(names[i]), "VAR_%d", i);
+        snprintf(values[i], sizeof(values[i]), "value%d", i * 7);
+    }
+    t = filled_table(VARS);
+    large.table = filled_table(VARS_LARGE);
+    if (!t || !large.table) {
+        return 1;
+    }
+    small.table = t;
+
+    micro_case("vars", "set_new", run_fill, &small, 0);
+    micro_case("vars", "get", run_get, &small, 0);
+    micro_case("vars", "get_missing", run_get_missing, t, 0);
+    micro_case("vars", "set_existing", run_overwrite, t, 0);
+    micro_case("vars", "unset_and_set", run_unset, t, 0);
+    micro_case("vars", "set_new_large", run_fill, &large, 0);
+    micro_case("vars", "get_large", run_get, &large, 0);
+
+    var_table_destroy(large.table);
+    var_table_destroy(t);
+    return 0;
+}
@@ -5,12 +5,62 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "Absyn.h"
+#include "../include/arena.h"
+
+/********************   AST Arena    ********************/
+
+/* Every node and Word string of a tree is bump-allocated from here
+ * and released all at once by ast_reset(). */
+
+static arena_t *ast_arena = NULL;
+
+/* Arena the parser is building into (the per-line one by default) */
+static arena_t *current_arena(void)
+{
+    if (!ast_arena) {
+        ast_arena = arena_create(0);
+    }
+    return ast_arena;
+}
+
+void *ast_alloc(size_t size)
+{
+    arena_t *arena = current_arena();
+    void *p = arena ? arena_alloc(arena, size) : NULL;
+
+    if (!p)
+    {
+        fprintf(stderr, "Error: out of memory when allocating AST!\n");
+        exit(1);
+    }
+    return p;
+}
+
+char *ast_strdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    return memcpy(ast_alloc(len), s, len);
+}
+
+void ast_reset(void)
+{
+    if (ast_arena) {
+        arena_reset(ast_arena);
+    }
+}
+
+struct arena *ast_arena_swap(struct arena *arena)
+{
+    arena_t *prev = current_arena();
+    ast_arena = arena;
+    return prev;
+}
 
 /********************   StartInput    ********************/
 
 Input make_StartInput(ListCommand p1)
 {
-    Input tmp = (Input) malloc(sizeof(*tmp));
+    Input tmp = (Input) ast_alloc(sizeof(*tmp));
     if (!tmp)
     {
         fprintf(stderr, "Error: out of memory when allocating StartInput!\n");
@@ -25,7 +75,7 @@ Input make_StartInput(ListCommand p1)
 
 Command make_SimpleCmd(SimpleCommand p1)
 {
-    Command tmp = (Command) malloc(sizeof(*tmp));
+    Command tmp = (Command) ast_alloc(sizeof(*tmp));
     if (!tmp)
     {
         fprintf(stderr, "Error: out of memory when allocating SimpleCmd!\n");
@@ -40,7 +90,7 @@ Command make_SimpleCmd(SimpleCommand p1)
 
 Command make_PipeCmd(Pipeline p1)
 {
-    Command tmp = (Command) malloc(sizeof(*tmp));
+    Command tmp = (Command) ast_alloc(sizeof(*tmp));
     if (!tmp)
     {
         fprintf(stderr, "Error: out of memory when allocating PipeCmd!\n");
@@ -55,7 +105,7 @@ Command make_PipeCmd(Pipeline p1)
 
 Command make_AICmd(ListWord p1)
 {
-    Command tmp = (Command) malloc(sizeof(*tmp));
+    Command tmp = (Command) ast_alloc(sizeof(*tmp));
     if (!tmp)
     {
         fprintf(stderr, "Error: out of memory when allocating AICmd!\n");
@@ -66,11 +116,108 @@ Command make_AICmd(ListWord p1)
     return tmp;
 }
 
+/********************   BgCmd    ********************/
+
+Command make_BgCmd(Command p1)
+{
+    Command tmp = (Command) ast_alloc(sizeof(*tmp));
+    if (!tmp)
+    {
+        fprintf(stderr, "Error: out of memory when allocating BgCmd!\n");
+        exit(1);
+    }
+    tmp->kind = is_BgCmd;
+    tmp->u.bgCmd_.command_ = p1;
+    return tmp;
+}
+
+/********************   AndCmd    ********************/
+
+Command make_AndCmd(Command p1, Command p2)
+{
+    Command tmp = (Command) ast_alloc(sizeof(*tmp));
+    if (!tmp)
+    {
+        fprintf(stderr, "Error: out of memory when allocating AndCmd!\n");
+        exit(1);
+    }
+    tmp->kind = is_AndCmd;
+    tmp->u.andCmd_.command_1 = p1;
+    tmp->u.andCmd_.command_2 = p2;
+    return tmp;
+}
+
+/********************   OrCmd    ********************/
+
+Command make_OrCmd(Command p1, Command p2)
+{
+    Command tmp = (Command) ast_alloc(sizeof(*tmp));
+    if (!tmp)
+    {
+        fprintf(stderr, "Error: out of memory when allocating OrCmd!\n");
+        exit(1);
+    }
+    tmp->kind = is_OrCmd;
+    tmp->u.orCmd_.command_1 = p1;
+    tmp->u.orCmd_.command_2 = p2;
+    return tmp;
+}
+
+/********************   IfCmd    ********************/
+
+Command make_IfCmd(ListCommand p1, ListCommand p2, ListCommand p3)
+{
+    Command tmp = (Command) ast_alloc(sizeof(*tmp));
+    if (!tmp)
+    {
+        fprintf(stderr, "Error: out of memory when allocating IfCmd!\n");
+        exit(1);
+    }
+    tmp->kind = is_IfCmd;
+    tmp->u.ifCmd_.listcommand_1 = p1;
+    tmp->u.ifCmd_.listcommand_2 = p2;
+    tmp->u.ifCmd_.listcommand_3 = p3;
+    return tmp;
+}
+
+/********************   WhileCmd    ********************/
+
+Command make_WhileCmd(ListCommand p1, ListCommand p2)
+{
+    Command tmp = (Command) ast_alloc(sizeof(*tmp));
+    if (!tmp)
+    {
+        fprintf(stderr, "Error: out of memory when allocating WhileCmd!\n");
+        exit(1);
+    }
+    tmp->kind = is_WhileCmd;
+    tmp->u.whileCmd_.listcommand_1 = p1;
+    tmp->u.whileCmd_.listcommand_2 = p2;
+    return tmp;
+}
+
+/********************   ForCmd    ********************/
+
+Command make_ForCmd(Word p1, ListWord p2, ListCommand p3)
+{
+    Command tmp = (Command) ast_alloc(sizeof(*tmp));
+    if (!tmp)
+    {
+        fprintf(stderr, "Error: out of memory when allocating ForCmd!\n");
+        exit(1);
+    }
+    tmp->kind = is_ForCmd;
+    tmp->u.forCmd_.word_ = p1;
+    tmp->u.forCmd_.listword_ = p2;
+    tmp->u.forCmd_.listcommand_ = p3;
+    return tmp;
+}
+
 /********************   PipeLine    ********************/
 
 Pipeline make_PipeLine(ListSimpleCommand p1)
 {
-    Pipeline tmp = (Pipeline) malloc(sizeof(*tmp));
+    Pipeline tmp = (Pipeline) ast_alloc(sizeof(*tmp));
     if (!tmp)
     {
         fprintf(stderr, "Error: out of memory when allocating PipeLine!\n");
@@ -85,7 +232,7 @@ Pipeline make_PipeLine(ListSimpleCommand p1)
 
 SimpleCommand make_Cmd(Word p1, ListWord p2, ListRedirection p3)
 {
-    SimpleCommand tmp = (SimpleCommand) malloc(sizeof(*tmp));
+    SimpleCommand tmp = (SimpleCommand) ast_alloc(sizeof(*tmp));
     if (!tmp)
     {
         fprintf(stderr, "Error: out of memory when allocating Cmd!\n");
@@ -102,7 +249,7 @@ SimpleCommand make_Cmd(Word p1, ListWord p2, ListRedirection p3)
 
 Redirection make_RedirIn(Word p1)
 {
-    Redirection tmp = (Redirection) malloc(sizeof(*tmp));
+    Redirection tmp = (Redirection) ast_alloc(sizeof(*tmp));
     if (!tmp)
     {
         fprintf(stderr, "Error: out of memory when allocating RedirIn!\n");
@@ -117,7 +264,7 @@ Redirection make_RedirIn(Word p1)
 
 Redirection make_RedirOut(Word p1)
 {
-    Redirection tmp = (Redirection) malloc(sizeof(*tmp));
+    Redirection tmp = (Redirection) ast_alloc(sizeof(*tmp));
     if (!tmp)
     {
         fprintf(stderr, "Error: out of memory when allocating RedirOut!\n");
@@ -132,7 +279,7 @@ Redirection make_RedirOut(Word p1)
 
 Redirection make_RedirAppend(Word p1)
 {
-    Redirection tmp = (Redirection) malloc(sizeof(*tmp));
+    Redirection tmp = (Redirection) ast_alloc(sizeof(*tmp));
     if (!tmp)
     {
         fprintf(stderr, "Error: out of memory when allocating RedirAppend!\n");
@@ -143,11 +290,41 @@ Redirection make_RedirAppend(Word p1)
     return tmp;
 }
 
+/********************   RedirHereDoc    ********************/
+
+Redirection make_RedirHereDoc(Word p1)
+{
+    Redirection tmp = (Redirection) ast_alloc(sizeof(*tmp));
+    if (!tmp)
+    {
+        fprintf(stderr, "Error: out of memory when allocating RedirHereDoc!\n");
+        exit(1);
+    }
+    tmp->kind = is_RedirHereDoc;
+    tmp->u.redirHereDoc_.word_ = p1;
+    return tmp;
+}
+
+/********************   RedirHereStr    ********************/
+
+Redirection make_RedirHereStr(Word p1)
+{
+    Redirection tmp = (Redirection) ast_alloc(sizeof(*tmp));
+    if (!tmp)
+    {
+        fprintf(stderr, "Error: out of memory when allocating RedirHereStr!\n");
+        exit(1);
+    }
+    tmp->kind = is_RedirHereStr;
+    tmp->u.redirHereStr_.word_ = p1;
+    return tmp;
+}
+
 /********************   ListCommand    ********************/
 
 ListCommand make_ListCommand(Command p1, ListCommand p2)
 {
-    ListCommand tmp = (ListCommand) malloc(sizeof(*tmp));
+    ListCommand tmp = (ListCommand) ast_alloc(sizeof(*tmp));
     if (!tmp)
     {
         fprintf(stderr, "Error: out of memory when allocating ListCommand!\n");
@@ -162,7 +339,7 @@ ListCommand make_ListCommand(Command p1, ListCommand p2)
 
 ListSimpleCommand make_ListSimpleCommand(SimpleCommand p1, ListSimpleCommand p2)
 {
-    ListSimpleCommand tmp = (ListSimpleCommand) malloc(sizeof(*tmp));
+    ListSimpleCommand tmp = (ListSimpleCommand) ast_alloc(sizeof(*tmp));
     if (!tmp)
     {
         fprintf(stderr, "Error: out of memory when allocating ListSimpleCommand!\n");
@@ -177,7 +354,7 @@ ListSimpleCommand make_ListSimpleCommand(SimpleCommand p1, ListSimpleCommand p2)
 
 ListWord make_ListWord(Word p1, ListWord p2)
 {
-    ListWord tmp = (ListWord) malloc(sizeof(*tmp));
+    ListWord tmp = (ListWord) ast_alloc(sizeof(*tmp));
     if (!tmp)
     {
         fprintf(stderr, "Error: out of memory when allocating ListWord!\n");
@@ -192,7 +369,7 @@ ListWord make_ListWord(Word p1, ListWord p2)
 
 ListRedirection make_ListRedirection(Redirection p1, ListRedirection p2)
 {
-    ListRedirection tmp = (ListRedirection) malloc(sizeof(*tmp));
+    ListRedirection tmp = (ListRedirection) ast_alloc(sizeof(*tmp));
     if (!tmp)
     {
         fprintf(stderr, "Error: out of memory when allocating ListRedirection!\n");
@@ -231,6 +408,41 @@ Command clone_Command(Command p)
   case is_AICmd:
     return make_AICmd (clone_ListWord(p->u.aICmd_.listword_));
 
+  case is_BgCmd:
+    return make_BgCmd (clone_Command(p->u.bgCmd_.command_));
+
+  case is_AndCmd:
+    return make_AndCmd
+      ( clone_Command(p->u.andCmd_.command_1)
+      , clone_Command(p->u.andCmd_.command_2)
+      );
+
+  case is_OrCmd:
+    return make_OrCmd
+      ( clone_Command(p->u.orCmd_.command_1)
+      , clone_Command(p->u.orCmd_.command_2)
+      );
+
+  case is_IfCmd:
+    return make_IfCmd
+      ( clone_ListCommand(p->u.ifCmd_.listcommand_1)
+      , clone_ListCommand(p->u.ifCmd_.listcommand_2)
+      , clone_ListCommand(p->u.ifCmd_.listcommand_3)
+      );
+
+  case is_WhileCmd:
+    return make_WhileCmd
+      ( clone_ListCommand(p->u.whileCmd_.listcommand_1)
+      , clone_ListCommand(p->u.whileCmd_.listcommand_2)
+      );
+
+  case is_ForCmd:
+    return make_ForCmd
+      ( ast_strdup(p->u.forCmd_.word_)
+      , clone_ListWord(p->u.forCmd_.listword_)
+      , clone_ListCommand(p->u.forCmd_.listcommand_)
+      );
+
   default:
     fprintf(stderr, "Error: bad kind field when cloning Command!\n");
     exit(1);
@@ -256,7 +468,7 @@ SimpleCommand clone_SimpleCommand(SimpleCommand p)
   {
   case is_Cmd:
     return make_Cmd
-      ( strdup(p->u.cmd_.word_)
+      ( ast_strdup(p->u.cmd_.word_)
       , clone_ListWord(p->u.cmd_.listword_)
       , clone_ListRedirection(p->u.cmd_.listredirection_)
       );
@@ -272,13 +484,19 @@ Redirection clone_Redirection(Redirection p)
   switch(p->kind)
   {
   case is_RedirIn:
-    return make_RedirIn (strdup(p->u.redirIn_.word_));
+    return make_RedirIn (ast_strdup(p->u.redirIn_.word_));
 
   case is_RedirOut:
-    return make_RedirOut (strdup(p->u.redirOut_.word_));
+    return make_RedirOut (ast_strdup(p->u.redirOut_.word_));
 
   case is_RedirAppend:
-    return make_RedirAppend (strdup(p->u.redirAppend_.word_));
+    return make_RedirAppend (ast_strdup(p->u.redirAppend_.word_));
+
+  case is_RedirHereDoc:
+    return make_RedirHereDoc (ast_strdup(p->u.redirHereDoc_.word_));
+
+  case is_RedirHereStr:
+    return make_RedirHereStr (ast_strdup(p->u.redirHereStr_.word_));
 
   default:
     fprintf(stderr, "Error: bad kind field when cloning Redirection!\n");
@@ -318,7 +536,7 @@ ListWord clone_ListWord(ListWord listword)
   {
     /* clone of non-empty list */
     return make_ListWord
-      ( strdup(listword->word_)
+      ( ast_strdup(listword->word_)
       , clone_ListWord(listword->listword_)
       );
   }
@@ -340,144 +558,16 @@ ListRedirection clone_ListRedirection(ListRedirection listredirection)
 
 /********************   Recursive Destructors    **********************/
 
-/* These free an entire abstract syntax tree
- * including all subtrees and strings.
- *
- * Will not work properly if there is sharing in the tree,
- * i.e., when some pointers are aliased.  In this case
- * it will attempt to free the same memory twice.
- */
-
-void free_Input(Input p)
-{
-  switch(p->kind)
-  {
-  case is_StartInput:
-    free_ListCommand(p->u.startInput_.listcommand_);
-    break;
-
-  default:
-    fprintf(stderr, "Error: bad kind field when freeing Input!\n");
-    exit(1);
-  }
-  free(p);
-}
-
-void free_Command(Command p)
-{
-  switch(p->kind)
-  {
-  case is_SimpleCmd:
-    free_SimpleCommand(p->u.simpleCmd_.simplecommand_);
-    break;
-
-  case is_PipeCmd:
-    free_Pipeline(p->u.pipeCmd_.pipeline_);
-    break;
-
-  case is_AICmd:
-    free_ListWord(p->u.aICmd_.listword_);
-    break;
-
-  default:
-    fprintf(stderr, "Error: bad kind field when freeing Command!\n");
-    exit(1);
-  }
-  free(p);
-}
-
-void free_Pipeline(Pipeline p)
-{
-  switch(p->kind)
-  {
-  case is_PipeLine:
-    free_ListSimpleCommand(p->u.pipeLine_.listsimplecommand_);
-    break;
-
-  default:
-    fprintf(stderr, "Error: bad kind field when freeing Pipeline!\n");
-    exit(1);
-  }
-  free(p);
-}
-
-void free_SimpleCommand(SimpleCommand p)
-{
-  switch(p->kind)
-  {
-  case is_Cmd:
-    free(p->u.cmd_.word_);
-    free_ListWord(p->u.cmd_.listword_);
-    free_ListRedirection(p->u.cmd_.listredirection_);
-    break;
-
-  default:
-    fprintf(stderr, "Error: bad kind field when freeing SimpleCommand!\n");
-    exit(1);
-  }
-  free(p);
-}
-
-void free_Redirection(Redirection p)
-{
-  switch(p->kind)
-  {
-  case is_RedirIn:
-    free(p->u.redirIn_.word_);
-    break;
-
-  case is_RedirOut:
-    free(p->u.redirOut_.word_);
-    break;
-
-  case is_RedirAppend:
-    free(p->u.redirAppend_.word_);
-    break;
-
-  default:
-    fprintf(stderr, "Error: bad kind field when freeing Redirection!\n");
-    exit(1);
-  }
-  free(p);
-}
-
-void free_ListCommand(ListCommand listcommand)
-{
-  if (listcommand)
-  {
-    free_Command(listcommand->command_);
-    free_ListCommand(listcommand->listcommand_);
-    free(listcommand);
-  }
-}
-
-void free_ListSimpleCommand(ListSimpleCommand listsimplecommand)
-{
-  if (listsimplecommand)
-  {
-    free_SimpleCommand(listsimplecommand->simplecommand_);
-    free_ListSimpleCommand(listsimplecommand->listsimplecommand_);
-    free(listsimplecommand);
-  }
-}
-
-void free_ListWord(ListWord listword)
-{
-  if (listword)
-  {
-    free(listword->word_);
-    free_ListWord(listword->listword_);
-    free(listword);
-  }
-}
-
-void free_ListRedirection(ListRedirection listredirection)
-{
-  if (listredirection)
-  {
-    free_Redirection(listredirection->redirection_);
-    free_ListRedirection(listredirection->listredirection_);
-    free(listredirection);
-  }
-}
-
+/* Trees live in the AST arena, so there is nothing to free node by
+ * node: ast_reset() releases every tree at once. These are kept so
+ * code written against the BNFC interface still links. */
+
+void free_Input(Input p) { (void)p; }
+void free_Command(Command p) { (void)p; }
+void free_Pipeline(Pipeline p) { (void)p; }
+void free_SimpleCommand(SimpleCommand p) { (void)p; }
+void free_Redirection(Redirection p) { (void)p; }
+void free_ListCommand(ListCommand p) { (void)p; }
+void free_ListSimpleCommand(ListSimpleCommand p) { (void)p; }
+void free_ListWord(ListWord p) { (void)p; }
+void free_ListRedirection(ListRedirection p) { (void)p; }
@@ -14,6 +14,18 @@
 
 /* C++ Abstract Syntax Interface.*/
 
+/********************   AST Memory    ********************/
+
+/* Nodes and Word strings come from one arena (src/arena.c).
+ * ast_reset() frees every tree built since the last reset.
+ * ast_arena_swap() makes the parser build into another arena (e.g. one
+ * owned by the AST cache) and returns the previous one. */
+struct arena;
+void *ast_alloc(size_t size);
+char *ast_strdup(const char *s);
+void ast_reset(void);
+struct arena *ast_arena_swap(struct arena *arena);
+
 /********************   TypeDef Section    ********************/
 
 typedef int Integer;
@@ -66,18 +78,30 @@ Input make_StartInput(ListCommand p0);
 
 struct Command_
 {
-  enum { is_SimpleCmd, is_PipeCmd, is_AICmd } kind;
+  enum { is_SimpleCmd, is_PipeCmd, is_AICmd, is_BgCmd, is_AndCmd, is_OrCmd, is_IfCmd, is_WhileCmd, is_ForCmd } kind;
   union
   {
     struct { SimpleCommand simplecommand_; } simpleCmd_;
     struct { Pipeline pipeline_; } pipeCmd_;
     struct { ListWord listword_; } aICmd_;
+    struct { Command command_; } bgCmd_;
+    struct { Command command_1, command_2; } andCmd_;
+    struct { Command command_1, command_2; } orCmd_;
+    struct { ListCommand listcommand_1, listcommand_2, listcommand_3; } ifCmd_;
+    struct { ListCommand listcommand_1, listcommand_2; } whileCmd_;
+    struct { Word word_; ListWord listword_; ListCommand listcommand_; } forCmd_;
   } u;
 };
 
 Command make_SimpleCmd(SimpleCommand p0);
 Command make_PipeCmd(Pipeline p0);
 Command make_AICmd(ListWord p0);
+Command make_BgCmd(Command p0);
+Command make_AndCmd(Command p0, Command p1);
+Command make_OrCmd(Command p0, Command p1);
+Command make_IfCmd(ListCommand p0, ListCommand p1, ListCommand p2);
+Command make_WhileCmd(ListCommand p0, ListCommand p1);
+Command make_ForCmd(Word p0, ListWord p1, ListCommand p2);
 
 struct Pipeline_
 {
@@ -103,18 +127,22 @@ SimpleCommand make_Cmd(Word p0, ListWord p1, ListRedirection p2);
 
 struct Redirection_
 {
-  enum { is_RedirIn, is_RedirOut, is_RedirAppend } kind;
+  enum { is_RedirIn, is_RedirOut, is_RedirAppend, is_RedirHereDoc, is_RedirHereStr } kind;
   union
   {
     struct { Word word_; } redirIn_;
     struct { Word word_; } redirOut_;
     struct { Word word_; } redirAppend_;
+    struct { Word word_; } redirHereDoc_;   /* The document's text */
+    struct { Word word_; } redirHereStr_;
   } u;
 };
 
 Redirection make_RedirIn(Word p0);
 Redirection make_RedirOut(Word p0);
 Redirection make_RedirAppend(Word p0);
+Redirection make_RedirHereDoc(Word p0);
+Redirection make_RedirHereStr(Word p0);
 
 struct ListCommand_
 {
@@ -162,13 +190,7 @@ ListRedirection clone_ListRedirection(ListRedirection p);
 
 /********************   Recursive Destructors    **********************/
 
-/* These free an entire abstract syntax tree
- * including all subtrees and strings.
- *
- * Will not work properly if there is sharing in the tree,
- * i.e., when some pointers are aliased.  In this case
- * it will attempt to free the same memory twice.
- */
+/* No-ops: trees are released with ast_reset() (see AST Memory above). */
 
 void free_Input(Input p);
 void free_Command(Command p);
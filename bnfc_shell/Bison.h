@@ -59,9 +59,25 @@ extern int yydebug;
     _LT = 260,                     /* _LT  */
     _GT = 261,                     /* _GT  */
     _DGT = 262,                    /* _DGT  */
-    _KW_AI = 263,                  /* _KW_AI  */
-    _BAR = 264,                    /* _BAR  */
-    T_Word = 265                   /* T_Word  */
+    _DLT = 263,                    /* _DLT  */
+    _TLT = 264,                    /* _TLT  */
+    _KW_AI = 265,                  /* _KW_AI  */
+    _BAR = 266,                    /* _BAR  */
+    _AMP = 267,                    /* _AMP  */
+    _NL = 268,                     /* _NL  */
+    _DAMP = 269,                   /* _DAMP  */
+    _DBAR = 270,                   /* _DBAR  */
+    _KW_if = 271,                  /* _KW_if  */
+    _KW_then = 272,                /* _KW_then  */
+    _KW_else = 273,                /* _KW_else  */
+    _KW_elif = 274,                /* _KW_elif  */
+    _KW_fi = 275,                  /* _KW_fi  */
+    _KW_while = 276,               /* _KW_while  */
+    _KW_for = 277,                 /* _KW_for  */
+    _KW_in = 278,                  /* _KW_in  */
+    _KW_do = 279,                  /* _KW_do  */
+    _KW_done = 280,                /* _KW_done  */
+    T_Word = 281                   /* T_Word  */
   };
   typedef enum yytokentype yytoken_kind_t;
 #endif
@@ -86,7 +102,7 @@ union YYSTYPE
   ListWord listword_;
   ListRedirection listredirection_;
 
-#line 90 "Bison.h"
+#line 106 "Bison.h"
 
 };
 typedef union YYSTYPE YYSTYPE;
@@ -7,6 +7,7 @@
 #include <stdio.h>   /* fprintf */
 #include <string.h>  /* size_t, strncpy */
 #include "Buffer.h"
+#include "Absyn.h"   /* ast_strdup */
 
 /* Internal functions. */
 /************************************************************************/
@@ -44,11 +45,12 @@ void freeBuffer (Buffer buffer) {
   free(buffer);
 }
 
-/* Deallocate the buffer, but return its content as string. */
+/* Deallocate the buffer, but return its content as string.
+ * The string goes into the AST, so it is copied into the AST arena. */
 
 char* releaseBuffer (Buffer buffer) {
-  char* content = (char*) realloc (buffer->chars, buffer->current + 1);
-  free(buffer);
+  char* content = ast_strdup(buffer->chars);
+  freeBuffer(buffer);
   return content;
 }
 
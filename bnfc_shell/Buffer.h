@@ -20,7 +20,7 @@ Buffer newBuffer (const unsigned int size);
 /* Deallocate the buffer. */
 void freeBuffer (Buffer buffer);
 
-/* Deallocate the buffer, but return its content as string. */
+/* Deallocate the buffer, but return its content as string (in the AST arena). */
 char* releaseBuffer (Buffer buffer);
 
 /* Clear contents of buffer. */
@@ -125,6 +125,13 @@ char *printInput(Input p)
   ppInput(p, 0);
   return buf_;
 }
+char *printCommand(Command p)
+{
+  _n_ = 0;
+  bufReset();
+  ppCommand(p, 0);
+  return buf_;
+}
 char *showInput(Input p)
 {
   _n_ = 0;
@@ -171,6 +178,66 @@ void ppCommand(Command p, int _i_)
     if (_i_ > 0) renderC(_R_PAREN);
     break;
 
+  case is_BgCmd:
+    if (_i_ > 0) renderC(_L_PAREN);
+    ppCommand(p->u.bgCmd_.command_, 0);
+    renderC('&');
+    if (_i_ > 0) renderC(_R_PAREN);
+    break;
+
+  case is_AndCmd:
+    if (_i_ > 0) renderC(_L_PAREN);
+    ppCommand(p->u.andCmd_.command_1, 0);
+    renderS("&&");
+    ppCommand(p->u.andCmd_.command_2, 0);
+    if (_i_ > 0) renderC(_R_PAREN);
+    break;
+
+  case is_OrCmd:
+    if (_i_ > 0) renderC(_L_PAREN);
+    ppCommand(p->u.orCmd_.command_1, 0);
+    renderS("||");
+    ppCommand(p->u.orCmd_.command_2, 0);
+    if (_i_ > 0) renderC(_R_PAREN);
+    break;
+
+  case is_IfCmd:
+    if (_i_ > 0) renderC(_L_PAREN);
+    renderS("if");
+    ppBody(p->u.ifCmd_.listcommand_1);
+    renderS("then");
+    ppBody(p->u.ifCmd_.listcommand_2);
+    if (p->u.ifCmd_.listcommand_3) {
+      renderS("else");
+      ppBody(p->u.ifCmd_.listcommand_3);
+    }
+    renderS("fi");
+    if (_i_ > 0) renderC(_R_PAREN);
+    break;
+
+  case is_WhileCmd:
+    if (_i_ > 0) renderC(_L_PAREN);
+    renderS("while");
+    ppBody(p->u.whileCmd_.listcommand_1);
+    renderS("do");
+    ppBody(p->u.whileCmd_.listcommand_2);
+    renderS("done");
+    if (_i_ > 0) renderC(_R_PAREN);
+    break;
+
+  case is_ForCmd:
+    if (_i_ > 0) renderC(_L_PAREN);
+    renderS("for");
+    ppIdent(p->u.forCmd_.word_, 0);
+    renderS("in");
+    ppListWord(p->u.forCmd_.listword_, 0);
+    renderS(";");
+    renderS("do");
+    ppBody(p->u.forCmd_.listcommand_);
+    renderS("done");
+    if (_i_ > 0) renderC(_R_PAREN);
+    break;
+
   default:
     fprintf(stderr, "Error: bad kind field when printing Command!\n");
     exit(1);
@@ -236,6 +303,20 @@ void ppRedirection(Redirection p, int _i_)
     if (_i_ > 0) renderC(_R_PAREN);
     break;
 
+  case is_RedirHereDoc:
+    if (_i_ > 0) renderC(_L_PAREN);
+    renderS("<<");
+    ppIdent(p->u.redirHereDoc_.word_, 0);
+    if (_i_ > 0) renderC(_R_PAREN);
+    break;
+
+  case is_RedirHereStr:
+    if (_i_ > 0) renderC(_L_PAREN);
+    renderS("<<<");
+    ppIdent(p->u.redirHereStr_.word_, 0);
+    if (_i_ > 0) renderC(_R_PAREN);
+    break;
+
   default:
     fprintf(stderr, "Error: bad kind field when printing Redirection!\n");
     exit(1);
@@ -254,11 +335,21 @@ void ppListCommand(ListCommand listcommand, int i)
   else
   { /* cons */
     ppCommand(listcommand->command_, 0);
-    renderC(';');
+    if (listcommand->command_->kind != is_BgCmd) renderC(';'); /* "&" separates */
     ppListCommand(listcommand->listcommand_, 0);
   }
 }
 
+/* The commands of an if/while/for part, each ended by ";" (or its "&"), on one line */
+void ppBody(ListCommand listcommand)
+{
+  for (; listcommand; listcommand = listcommand->listcommand_)
+  {
+    ppCommand(listcommand->command_, 0);
+    if (listcommand->command_->kind != is_BgCmd) renderS(";");
+  }
+}
+
 void ppListSimpleCommand(ListSimpleCommand listsimplecommand, int i)
 {
   if (listsimplecommand == 0)
@@ -398,6 +489,92 @@ void shCommand(Command p)
 
     bufAppendC(')');
 
+    break;
+  case is_BgCmd:
+    bufAppendC('(');
+
+    bufAppendS("BgCmd");
+
+    bufAppendC(' ');
+
+    shCommand(p->u.bgCmd_.command_);
+
+    bufAppendC(')');
+
+    break;
+  case is_AndCmd:
+    bufAppendC('(');
+
+    bufAppendS("AndCmd");
+
+    bufAppendC(' ');
+
+    shCommand(p->u.andCmd_.command_1);
+  bufAppendC(' ');
+    shCommand(p->u.andCmd_.command_2);
+
+    bufAppendC(')');
+
+    break;
+  case is_OrCmd:
+    bufAppendC('(');
+
+    bufAppendS("OrCmd");
+
+    bufAppendC(' ');
+
+    shCommand(p->u.orCmd_.command_1);
+  bufAppendC(' ');
+    shCommand(p->u.orCmd_.command_2);
+
+    bufAppendC(')');
+
+    break;
+  case is_IfCmd:
+    bufAppendC('(');
+
+    bufAppendS("IfCmd");
+
+    bufAppendC(' ');
+
+    shListCommand(p->u.ifCmd_.listcommand_1);
+  bufAppendC(' ');
+    shListCommand(p->u.ifCmd_.listcommand_2);
+  bufAppendC(' ');
+    shListCommand(p->u.ifCmd_.listcommand_3);
+
+    bufAppendC(')');
+
+    break;
+  case is_WhileCmd:
+    bufAppendC('(');
+
+    bufAppendS("WhileCmd");
+
+    bufAppendC(' ');
+
+    shListCommand(p->u.whileCmd_.listcommand_1);
+  bufAppendC(' ');
+    shListCommand(p->u.whileCmd_.listcommand_2);
+
+    bufAppendC(')');
+
+    break;
+  case is_ForCmd:
+    bufAppendC('(');
+
+    bufAppendS("ForCmd");
+
+    bufAppendC(' ');
+
+    shIdent(p->u.forCmd_.word_);
+  bufAppendC(' ');
+    shListWord(p->u.forCmd_.listword_);
+  bufAppendC(' ');
+    shListCommand(p->u.forCmd_.listcommand_);
+
+    bufAppendC(')');
+
     break;
 
   default:
@@ -495,6 +672,30 @@ void shRedirection(Redirection p)
 
     bufAppendC(')');
 
+    break;
+  case is_RedirHereDoc:
+    bufAppendC('(');
+
+    bufAppendS("RedirHereDoc");
+
+    bufAppendC(' ');
+
+    shIdent(p->u.redirHereDoc_.word_);
+
+    bufAppendC(')');
+
+    break;
+  case is_RedirHereStr:
+    bufAppendC('(');
+
+    bufAppendS("RedirHereStr");
+
+    bufAppendC(' ');
+
+    shIdent(p->u.redirHereStr_.word_);
+
+    bufAppendC(')');
+
     break;
 
   default:
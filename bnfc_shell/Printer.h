@@ -23,6 +23,7 @@ void removeTrailingWhitespace(void);
 
 
 char *printInput(Input p);
+char *printCommand(Command p);
 
 void ppInput(Input p, int i);
 void ppCommand(Command p, int i);
@@ -30,6 +31,7 @@ void ppPipeline(Pipeline p, int i);
 void ppSimpleCommand(SimpleCommand p, int i);
 void ppRedirection(Redirection p, int i);
 void ppListCommand(ListCommand p, int i);
+void ppBody(ListCommand p);
 void ppListSimpleCommand(ListSimpleCommand p, int i);
 void ppListWord(ListWord p, int i);
 void ppListRedirection(ListRedirection p, int i);
@@ -185,19 +185,40 @@ enum yysymbol_kind_t
   YYSYMBOL__LT = 5,                        /* _LT  */
   YYSYMBOL__GT = 6,                        /* _GT  */
   YYSYMBOL__DGT = 7,                       /* _DGT  */
-  YYSYMBOL__KW_AI = 8,                     /* _KW_AI  */
-  YYSYMBOL__BAR = 9,                       /* _BAR  */
-  YYSYMBOL_T_Word = 10,                    /* T_Word  */
-  YYSYMBOL_YYACCEPT = 11,                  /* $accept  */
-  YYSYMBOL_Input = 12,                     /* Input  */
-  YYSYMBOL_Command = 13,                   /* Command  */
-  YYSYMBOL_Pipeline = 14,                  /* Pipeline  */
-  YYSYMBOL_SimpleCommand = 15,             /* SimpleCommand  */
-  YYSYMBOL_Redirection = 16,               /* Redirection  */
-  YYSYMBOL_ListCommand = 17,               /* ListCommand  */
-  YYSYMBOL_ListSimpleCommand = 18,         /* ListSimpleCommand  */
-  YYSYMBOL_ListWord = 19,                  /* ListWord  */
-  YYSYMBOL_ListRedirection = 20            /* ListRedirection  */
+  YYSYMBOL__DLT = 8,                       /* _DLT  */
+  YYSYMBOL__TLT = 9,                       /* _TLT  */
+  YYSYMBOL__KW_AI = 10,                    /* _KW_AI  */
+  YYSYMBOL__BAR = 11,                      /* _BAR  */
+  YYSYMBOL__AMP = 12,                      /* _AMP  */
+  YYSYMBOL__NL = 13,                       /* _NL  */
+  YYSYMBOL__DAMP = 14,                     /* _DAMP  */
+  YYSYMBOL__DBAR = 15,                     /* _DBAR  */
+  YYSYMBOL__KW_if = 16,                    /* _KW_if  */
+  YYSYMBOL__KW_then = 17,                  /* _KW_then  */
+  YYSYMBOL__KW_else = 18,                  /* _KW_else  */
+  YYSYMBOL__KW_elif = 19,                  /* _KW_elif  */
+  YYSYMBOL__KW_fi = 20,                    /* _KW_fi  */
+  YYSYMBOL__KW_while = 21,                 /* _KW_while  */
+  YYSYMBOL__KW_for = 22,                   /* _KW_for  */
+  YYSYMBOL__KW_in = 23,                    /* _KW_in  */
+  YYSYMBOL__KW_do = 24,                    /* _KW_do  */
+  YYSYMBOL__KW_done = 25,                  /* _KW_done  */
+  YYSYMBOL_T_Word = 26,                    /* T_Word  */
+  YYSYMBOL_YYACCEPT = 27,                  /* $accept  */
+  YYSYMBOL_Input = 28,                     /* Input  */
+  YYSYMBOL_Command = 29,                   /* Command  */
+  YYSYMBOL_Command1 = 30,                  /* Command1  */
+  YYSYMBOL_Command2 = 31,                  /* Command2  */
+  YYSYMBOL_ElsePart = 32,                  /* ElsePart  */
+  YYSYMBOL_ForSeparator = 33,              /* ForSeparator  */
+  YYSYMBOL_Newlines = 34,                  /* Newlines  */
+  YYSYMBOL_Pipeline = 35,                  /* Pipeline  */
+  YYSYMBOL_SimpleCommand = 36,             /* SimpleCommand  */
+  YYSYMBOL_Redirection = 37,               /* Redirection  */
+  YYSYMBOL_ListCommand = 38,               /* ListCommand  */
+  YYSYMBOL_ListSimpleCommand = 39,         /* ListSimpleCommand  */
+  YYSYMBOL_ListWord = 40,                  /* ListWord  */
+  YYSYMBOL_ListRedirection = 41            /* ListRedirection  */
 };
 typedef enum yysymbol_kind_t yysymbol_kind_t;
 
@@ -215,7 +236,11 @@ int yyparse(yyscan_t scanner, YYSTYPE *result);
 
 extern int yylex(YYSTYPE *lvalp, YYLTYPE *llocp, yyscan_t scanner);
 
-#line 219 "Shell.tab.c"
+/* The parser reads tokens through keyword_lex() (see below) */
+static int keyword_lex(YYSTYPE *lvalp, YYLTYPE *llocp, yyscan_t scanner);
+#define yylex keyword_lex
+
+#line 244 "Shell.tab.c"
 
 
 #ifdef short
@@ -540,21 +565,21 @@ union yyalloc
 #endif /* !YYCOPY_NEEDED */
 
 /* YYFINAL -- State number of the termination state.  */
-#define YYFINAL  12
+#define YYFINAL  22
 /* YYLAST -- Last index in YYTABLE.  */
-#define YYLAST   23
+#define YYLAST   116
 
 /* YYNTOKENS -- Number of terminals.  */
-#define YYNTOKENS  11
+#define YYNTOKENS  27
 /* YYNNTS -- Number of nonterminals.  */
-#define YYNNTS  10
+#define YYNNTS  15
 /* YYNRULES -- Number of rules.  */
-#define YYNRULES  20
+#define YYNRULES  39
 /* YYNSTATES -- Number of states.  */
-#define YYNSTATES  27
+#define YYNSTATES  77
 
 /* YYMAXUTOK -- Last valid token kind.  */
-#define YYMAXUTOK   265
+#define YYMAXUTOK   281
 
 
 /* YYTRANSLATE(TOKEN-NUM) -- Symbol number corresponding to TOKEN-NUM
@@ -594,16 +619,19 @@ static const yytype_int8 yytranslate[] =
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     1,     2,     3,     4,
-       5,     6,     7,     8,     9,    10
+       5,     6,     7,     8,     9,    10,    11,    12,    13,    14,
+      15,    16,    17,    18,    19,    20,    21,    22,    23,    24,
+      25,    26
 };
 
 #if YYDEBUG
 /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
 static const yytype_uint8 yyrline[] =
 {
-       0,   154,   154,   156,   157,   158,   160,   162,   164,   165,
-     166,   168,   169,   170,   172,   173,   174,   176,   177,   179,
-     180
+       0,   177,   177,   179,   181,   182,   183,   185,   186,   187,
+     188,   189,   190,   192,   193,   194,   196,   197,   199,   200,
+     202,   204,   206,   207,   208,   209,   210,   212,   213,   214,
+     215,   216,   217,   219,   220,   221,   223,   224,   226,   227
 };
 #endif
 
@@ -620,9 +648,12 @@ static const char *yysymbol_name (yysymbol_kind_t yysymbol) YY_ATTRIBUTE_UNUSED;
 static const char *const yytname[] =
 {
   "\"end of file\"", "error", "\"invalid token\"", "_ERROR_", "_SEMI",
-  "_LT", "_GT", "_DGT", "_KW_AI", "_BAR", "T_Word", "$accept", "Input",
-  "Command", "Pipeline", "SimpleCommand", "Redirection", "ListCommand",
-  "ListSimpleCommand", "ListWord", "ListRedirection", YY_NULLPTR
+  "_LT", "_GT", "_DGT", "_DLT", "_TLT", "_KW_AI", "_BAR", "_AMP", "_NL",
+  "_DAMP", "_DBAR", "_KW_if", "_KW_then", "_KW_else", "_KW_elif", "_KW_fi",
+  "_KW_while", "_KW_for", "_KW_in", "_KW_do", "_KW_done", "T_Word",
+  "$accept", "Input", "Command", "Command1", "Command2", "ElsePart",
+  "ForSeparator", "Newlines", "Pipeline", "SimpleCommand", "Redirection",
+  "ListCommand", "ListSimpleCommand", "ListWord", "ListRedirection", YY_NULLPTR
 };
 
 static const char *
@@ -632,12 +663,12 @@ yysymbol_name (yysymbol_kind_t yysymbol)
 }
 #endif
 
-#define YYPACT_NINF (-6)
+#define YYPACT_NINF (-26)
 
 #define yypact_value_is_default(Yyn) \
   ((Yyn) == YYPACT_NINF)
 
-#define YYTABLE_NINF (-15)
+#define YYTABLE_NINF (-34)
 
 #define yytable_value_is_error(Yyn) \
   0
@@ -646,9 +677,14 @@ yysymbol_name (yysymbol_kind_t yysymbol)
    STATE-NUM.  */
 static const yytype_int8 yypact[] =
 {
-       0,    -5,    -5,     6,     5,    -6,     2,    -6,    -6,    -5,
-      -6,    -6,    -6,     0,     3,    -6,    -4,    -6,     2,    -6,
-       4,     7,     8,    -6,    -6,    -6,    -6
+      15,   -22,    34,    41,    -3,   -17,   -22,    11,    34,    95,
+     -26,   -26,     5,   -26,   -26,   -22,   -26,   -26,     3,    18,
+      12,   -26,   -26,   -26,    34,   -26,    34,    30,    30,    19,
+     -26,    55,    69,   -22,   106,   -26,   -26,    30,    62,    62,
+       5,   -26,     8,    36,     4,    33,    38,    40,    54,    61,
+     -26,   -26,   -26,   -26,    76,    41,    73,   -26,    30,    30,
+      77,   -26,   -26,   -26,   -26,   -26,   -26,    83,   -26,   -26,
+     -26,    69,    55,    78,     8,   -26,   -26
 };
 
 /* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
@@ -656,21 +692,28 @@ static const yytype_int8 yypact[] =
    means the default is an error.  */
 static const yytype_int8 yydefact[] =
 {
-      11,    17,    17,     0,    12,     4,     3,     2,     6,    17,
-       5,    19,     1,    11,    14,    18,     7,    13,    15,    16,
-       0,     0,     0,    20,     8,     9,    10
+      33,    36,    27,    33,    33,     0,    36,     0,    27,    28,
+       4,     8,     7,     2,    20,    36,     9,    32,     0,     0,
+       0,    38,     1,    31,    27,     3,    27,    18,    18,    33,
+      37,    33,    33,    36,    21,    29,    30,    18,    33,    33,
+      34,    35,    13,     0,     0,     0,     0,     0,     0,     0,
+      39,    19,     5,     6,    33,    33,     0,    11,    18,    18,
+       0,    22,    23,    24,    25,    26,    14,     0,    10,    16,
+      17,    33,    33,     0,    13,    12,    15
 };
 
 /* YYPGOTO[NTERM-NUM].  */
 static const yytype_int8 yypgoto[] =
 {
-      -6,    -6,    -6,    -6,     1,    -6,    -1,     9,    -2,    -6
+     -26,   -26,   -26,   -26,     1,    31,   -26,   -25,   -26,    75,
+     -26,    -2,    87,    -1,   -26
 };
 
 /* YYDEFGOTO[NTERM-NUM].  */
 static const yytype_int8 yydefgoto[] =
 {
-       0,     3,     4,     5,     6,    23,     7,     8,    10,    16
+       0,     7,     8,     9,    10,    56,    60,    38,    11,    12,
+      50,    13,    14,    16,    34
 };
 
 /* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
@@ -678,41 +721,66 @@ static const yytype_int8 yydefgoto[] =
    number is the opposite.  If YYTABLE_NINF, syntax error.  */
 static const yytype_int8 yytable[] =
 {
-      11,    20,    21,    22,   -14,     9,    12,    15,     1,    13,
-       2,    14,    17,     2,    24,    18,     0,    25,    26,     0,
-       0,     0,     0,    19
+      17,    18,    19,    39,    15,    21,    23,     1,    58,    20,
+       2,    22,    51,     3,    30,   -27,    29,    59,     4,     5,
+      31,   -27,    35,     6,    36,     1,    54,    55,     2,    42,
+      43,     3,    44,    69,    70,    33,     4,     5,   -33,    52,
+      53,     6,    32,    37,     1,     6,   -33,     2,   -33,   -33,
+       3,     1,    66,    67,     2,     4,     5,     3,   -27,    61,
+       6,    57,     4,     5,    62,     1,    63,     6,     2,    73,
+      74,     3,     1,   -27,   -27,   -27,     4,     5,     3,     1,
+      64,     6,     2,     4,     5,     3,     1,    65,     6,     2,
+       4,     5,     3,    68,   -27,     6,   -27,     4,     5,    24,
+      72,    71,     6,    75,    40,    76,     0,    25,    26,    27,
+      28,    45,    46,    47,    48,    49,    41
 };
 
 static const yytype_int8 yycheck[] =
 {
-       2,     5,     6,     7,     4,    10,     0,     9,     8,     4,
-      10,     9,    13,    10,    10,    14,    -1,    10,    10,    -1,
-      -1,    -1,    -1,    14
+       2,     3,     4,    28,    26,     6,     8,    10,     4,    26,
+      13,     0,    37,    16,    15,     0,    11,    13,    21,    22,
+      17,    24,    24,    26,    26,    10,    18,    19,    13,    31,
+      32,    16,    33,    58,    59,    23,    21,    22,     4,    38,
+      39,    26,    24,    13,    10,    26,    12,    13,    14,    15,
+      16,    10,    54,    55,    13,    21,    22,    16,    17,    26,
+      26,    25,    21,    22,    26,    10,    26,    26,    13,    71,
+      72,    16,    10,    18,    19,    20,    21,    22,    16,    10,
+      26,    26,    13,    21,    22,    16,    10,    26,    26,    13,
+      21,    22,    16,    20,    25,    26,    20,    21,    22,     4,
+      17,    24,    26,    25,    29,    74,    -1,    12,    13,    14,
+      15,     5,     6,     7,     8,     9,    29
 };
 
 /* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
    state STATE-NUM.  */
 static const yytype_int8 yystos[] =
 {
-       0,     8,    10,    12,    13,    14,    15,    17,    18,    10,
-      19,    19,     0,     4,     9,    19,    20,    17,    15,    18,
-       5,     6,     7,    16,    10,    10,    10
+       0,    10,    13,    16,    21,    22,    26,    28,    29,    30,
+      31,    35,    36,    38,    39,    26,    40,    38,    38,    38,
+      26,    40,     0,    38,     4,    12,    13,    14,    15,    11,
+      40,    17,    24,    23,    41,    38,    38,    13,    34,    34,
+      36,    39,    38,    38,    40,     5,     6,     7,     8,     9,
+      37,    34,    31,    31,    18,    19,    32,    25,     4,    13,
+      33,    26,    26,    26,    26,    26,    38,    38,    20,    34,
+      34,    24,    17,    38,    38,    25,    32
 };
 
 /* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr1[] =
 {
-       0,    11,    12,    13,    13,    13,    14,    15,    16,    16,
-      16,    17,    17,    17,    18,    18,    18,    19,    19,    20,
-      20
+       0,    27,    28,    29,    30,    30,    30,    31,    31,    31,
+      31,    31,    31,    32,    32,    32,    33,    33,    34,    34,
+      35,    36,    37,    37,    37,    37,    37,    38,    38,    38,
+      38,    38,    38,    39,    39,    39,    40,    40,    41,    41
 };
 
 /* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr2[] =
 {
-       0,     2,     1,     1,     1,     2,     1,     3,     2,     2,
-       2,     0,     1,     3,     0,     1,     3,     0,     2,     0,
-       2
+       0,     2,     1,     2,     1,     4,     4,     1,     1,     2,
+       6,     5,     8,     0,     2,     5,     2,     2,     0,     2,
+       1,     3,     2,     2,     2,     2,     2,     0,     1,     3,
+       3,     2,     2,     0,     1,     3,     0,     2,     0,     2
 };
 
 
@@ -1301,121 +1369,211 @@ yyreduce:
   switch (yyn)
     {
   case 2: /* Input: ListCommand  */
-#line 154 "Shell.y"
+#line 177 "Shell.y"
                     { (yyval.input_) = make_StartInput((yyvsp[0].listcommand_)); result->input_ = (yyval.input_); }
-#line 1307 "Shell.tab.c"
+#line 1375 "Shell.tab.c"
+    break;
+
+  case 3: /* Command: Command1 _AMP  */
+#line 179 "Shell.y"
+                        { (yyval.command_) = make_BgCmd((yyvsp[-1].command_)); }
+#line 1381 "Shell.tab.c"
+    break;
+
+  case 4: /* Command1: Command2  */
+#line 181 "Shell.y"
+                    { (yyval.command_) = (yyvsp[0].command_); }
+#line 1387 "Shell.tab.c"
+    break;
+
+  case 5: /* Command1: Command1 _DAMP Newlines Command2  */
+#line 182 "Shell.y"
+                                     { (yyval.command_) = make_AndCmd((yyvsp[-3].command_), (yyvsp[0].command_)); }
+#line 1393 "Shell.tab.c"
+    break;
+
+  case 6: /* Command1: Command1 _DBAR Newlines Command2  */
+#line 183 "Shell.y"
+                                     { (yyval.command_) = make_OrCmd((yyvsp[-3].command_), (yyvsp[0].command_)); }
+#line 1399 "Shell.tab.c"
     break;
 
-  case 3: /* Command: SimpleCommand  */
-#line 156 "Shell.y"
-                        { (yyval.command_) = make_SimpleCmd((yyvsp[0].simplecommand_)); }
-#line 1313 "Shell.tab.c"
+  case 7: /* Command2: SimpleCommand  */
+#line 185 "Shell.y"
+                         { (yyval.command_) = make_SimpleCmd((yyvsp[0].simplecommand_)); }
+#line 1405 "Shell.tab.c"
     break;
 
-  case 4: /* Command: Pipeline  */
-#line 157 "Shell.y"
+  case 8: /* Command2: Pipeline  */
+#line 186 "Shell.y"
              { (yyval.command_) = make_PipeCmd((yyvsp[0].pipeline_)); }
-#line 1319 "Shell.tab.c"
+#line 1411 "Shell.tab.c"
     break;
 
-  case 5: /* Command: _KW_AI ListWord  */
-#line 158 "Shell.y"
+  case 9: /* Command2: _KW_AI ListWord  */
+#line 187 "Shell.y"
                     { (yyval.command_) = make_AICmd((yyvsp[0].listword_)); }
-#line 1325 "Shell.tab.c"
+#line 1417 "Shell.tab.c"
+    break;
+
+  case 10: /* Command2: _KW_if ListCommand _KW_then ListCommand ElsePart _KW_fi  */
+#line 188 "Shell.y"
+                                                            { (yyval.command_) = make_IfCmd((yyvsp[-4].listcommand_), (yyvsp[-2].listcommand_), (yyvsp[-1].listcommand_)); }
+#line 1423 "Shell.tab.c"
+    break;
+
+  case 11: /* Command2: _KW_while ListCommand _KW_do ListCommand _KW_done  */
+#line 189 "Shell.y"
+                                                      { (yyval.command_) = make_WhileCmd((yyvsp[-3].listcommand_), (yyvsp[-1].listcommand_)); }
+#line 1429 "Shell.tab.c"
+    break;
+
+  case 12: /* Command2: _KW_for T_Word _KW_in ListWord ForSeparator _KW_do ListCommand _KW_done  */
+#line 190 "Shell.y"
+                                                                            { (yyval.command_) = make_ForCmd((yyvsp[-6]._string), (yyvsp[-4].listword_), (yyvsp[-1].listcommand_)); }
+#line 1435 "Shell.tab.c"
+    break;
+
+  case 13: /* ElsePart: %empty  */
+#line 192 "Shell.y"
+                       { (yyval.listcommand_) = 0; }
+#line 1441 "Shell.tab.c"
+    break;
+
+  case 14: /* ElsePart: _KW_else ListCommand  */
+#line 193 "Shell.y"
+                         { (yyval.listcommand_) = (yyvsp[0].listcommand_); }
+#line 1447 "Shell.tab.c"
+    break;
+
+  case 15: /* ElsePart: _KW_elif ListCommand _KW_then ListCommand ElsePart  */
+#line 194 "Shell.y"
+                                                       { (yyval.listcommand_) = make_ListCommand(make_IfCmd((yyvsp[-3].listcommand_), (yyvsp[-1].listcommand_), (yyvsp[0].listcommand_)), 0); }
+#line 1453 "Shell.tab.c"
     break;
 
-  case 6: /* Pipeline: ListSimpleCommand  */
-#line 160 "Shell.y"
+  case 20: /* Pipeline: ListSimpleCommand  */
+#line 202 "Shell.y"
                              { (yyval.pipeline_) = make_PipeLine((yyvsp[0].listsimplecommand_)); }
-#line 1331 "Shell.tab.c"
+#line 1459 "Shell.tab.c"
     break;
 
-  case 7: /* SimpleCommand: T_Word ListWord ListRedirection  */
-#line 162 "Shell.y"
+  case 21: /* SimpleCommand: T_Word ListWord ListRedirection  */
+#line 204 "Shell.y"
                                                 { (yyval.simplecommand_) = make_Cmd((yyvsp[-2]._string), (yyvsp[-1].listword_), reverseListRedirection((yyvsp[0].listredirection_))); }
-#line 1337 "Shell.tab.c"
+#line 1465 "Shell.tab.c"
     break;
 
-  case 8: /* Redirection: _LT T_Word  */
-#line 164 "Shell.y"
+  case 22: /* Redirection: _LT T_Word  */
+#line 206 "Shell.y"
                          { (yyval.redirection_) = make_RedirIn((yyvsp[0]._string)); }
-#line 1343 "Shell.tab.c"
+#line 1471 "Shell.tab.c"
     break;
 
-  case 9: /* Redirection: _GT T_Word  */
-#line 165 "Shell.y"
+  case 23: /* Redirection: _GT T_Word  */
+#line 207 "Shell.y"
                { (yyval.redirection_) = make_RedirOut((yyvsp[0]._string)); }
-#line 1349 "Shell.tab.c"
+#line 1477 "Shell.tab.c"
     break;
 
-  case 10: /* Redirection: _DGT T_Word  */
-#line 166 "Shell.y"
+  case 24: /* Redirection: _DGT T_Word  */
+#line 208 "Shell.y"
                 { (yyval.redirection_) = make_RedirAppend((yyvsp[0]._string)); }
-#line 1355 "Shell.tab.c"
+#line 1483 "Shell.tab.c"
+    break;
+
+  case 25: /* Redirection: _DLT T_Word  */
+#line 209 "Shell.y"
+                { (yyval.redirection_) = make_RedirHereDoc((yyvsp[0]._string)); }
+#line 1489 "Shell.tab.c"
     break;
 
-  case 11: /* ListCommand: %empty  */
-#line 168 "Shell.y"
+  case 26: /* Redirection: _TLT T_Word  */
+#line 210 "Shell.y"
+                { (yyval.redirection_) = make_RedirHereStr((yyvsp[0]._string)); }
+#line 1495 "Shell.tab.c"
+    break;
+
+  case 27: /* ListCommand: %empty  */
+#line 212 "Shell.y"
                           { (yyval.listcommand_) = 0; }
-#line 1361 "Shell.tab.c"
+#line 1501 "Shell.tab.c"
+    break;
+
+  case 28: /* ListCommand: Command1  */
+#line 213 "Shell.y"
+             { (yyval.listcommand_) = make_ListCommand((yyvsp[0].command_), 0); }
+#line 1507 "Shell.tab.c"
+    break;
+
+  case 29: /* ListCommand: Command1 _SEMI ListCommand  */
+#line 214 "Shell.y"
+                               { (yyval.listcommand_) = make_ListCommand((yyvsp[-2].command_), (yyvsp[0].listcommand_)); }
+#line 1513 "Shell.tab.c"
     break;
 
-  case 12: /* ListCommand: Command  */
-#line 169 "Shell.y"
-            { (yyval.listcommand_) = make_ListCommand((yyvsp[0].command_), 0); }
-#line 1367 "Shell.tab.c"
+  case 30: /* ListCommand: Command1 _NL ListCommand  */
+#line 215 "Shell.y"
+                             { (yyval.listcommand_) = make_ListCommand((yyvsp[-2].command_), (yyvsp[0].listcommand_)); }
+#line 1519 "Shell.tab.c"
     break;
 
-  case 13: /* ListCommand: Command _SEMI ListCommand  */
-#line 170 "Shell.y"
-                              { (yyval.listcommand_) = make_ListCommand((yyvsp[-2].command_), (yyvsp[0].listcommand_)); }
-#line 1373 "Shell.tab.c"
+  case 31: /* ListCommand: Command ListCommand  */
+#line 216 "Shell.y"
+                        { (yyval.listcommand_) = make_ListCommand((yyvsp[-1].command_), (yyvsp[0].listcommand_)); }
+#line 1525 "Shell.tab.c"
     break;
 
-  case 14: /* ListSimpleCommand: %empty  */
-#line 172 "Shell.y"
+  case 32: /* ListCommand: _NL ListCommand  */
+#line 217 "Shell.y"
+                    { (yyval.listcommand_) = (yyvsp[0].listcommand_); }
+#line 1531 "Shell.tab.c"
+    break;
+
+  case 33: /* ListSimpleCommand: %empty  */
+#line 219 "Shell.y"
                                 { (yyval.listsimplecommand_) = 0; }
-#line 1379 "Shell.tab.c"
+#line 1537 "Shell.tab.c"
     break;
 
-  case 15: /* ListSimpleCommand: SimpleCommand  */
-#line 173 "Shell.y"
+  case 34: /* ListSimpleCommand: SimpleCommand  */
+#line 220 "Shell.y"
                   { (yyval.listsimplecommand_) = make_ListSimpleCommand((yyvsp[0].simplecommand_), 0); }
-#line 1385 "Shell.tab.c"
+#line 1543 "Shell.tab.c"
     break;
 
-  case 16: /* ListSimpleCommand: SimpleCommand _BAR ListSimpleCommand  */
-#line 174 "Shell.y"
+  case 35: /* ListSimpleCommand: SimpleCommand _BAR ListSimpleCommand  */
+#line 221 "Shell.y"
                                          { (yyval.listsimplecommand_) = make_ListSimpleCommand((yyvsp[-2].simplecommand_), (yyvsp[0].listsimplecommand_)); }
-#line 1391 "Shell.tab.c"
+#line 1549 "Shell.tab.c"
     break;
 
-  case 17: /* ListWord: %empty  */
-#line 176 "Shell.y"
+  case 36: /* ListWord: %empty  */
+#line 223 "Shell.y"
                        { (yyval.listword_) = 0; }
-#line 1397 "Shell.tab.c"
+#line 1555 "Shell.tab.c"
     break;
 
-  case 18: /* ListWord: T_Word ListWord  */
-#line 177 "Shell.y"
+  case 37: /* ListWord: T_Word ListWord  */
+#line 224 "Shell.y"
                     { (yyval.listword_) = make_ListWord((yyvsp[-1]._string), (yyvsp[0].listword_)); }
-#line 1403 "Shell.tab.c"
+#line 1561 "Shell.tab.c"
     break;
 
-  case 19: /* ListRedirection: %empty  */
-#line 179 "Shell.y"
+  case 38: /* ListRedirection: %empty  */
+#line 226 "Shell.y"
                               { (yyval.listredirection_) = 0; }
-#line 1409 "Shell.tab.c"
+#line 1567 "Shell.tab.c"
     break;
 
-  case 20: /* ListRedirection: ListRedirection Redirection  */
-#line 180 "Shell.y"
+  case 39: /* ListRedirection: ListRedirection Redirection  */
+#line 227 "Shell.y"
                                 { (yyval.listredirection_) = make_ListRedirection((yyvsp[0].redirection_), (yyvsp[-1].listredirection_)); }
-#line 1415 "Shell.tab.c"
+#line 1573 "Shell.tab.c"
     break;
 
 
-#line 1419 "Shell.tab.c"
+#line 1577 "Shell.tab.c"
 
       default: break;
     }
@@ -1613,9 +1771,53 @@ yyreturnlab:
   return yyresult;
 }
 
-#line 183 "Shell.y"
+#line 230 "Shell.y"
+
 
 
+/*
+ * Keywords (if, then, else, elif, fi, while, for, do, done) are Words
+ * to the lexer. They are keywords only where a command can start: at
+ * the beginning, after ; & && || or a newline, and after a keyword
+ * that is followed by a command. "in" is one only as the third word of
+ * a for. So "echo done" prints "done". One parse runs at a time, so the
+ * tokens seen so far can be kept here (pInput()/psInput() reset them).
+ */
+static int last_token = 0;
+static int token_before_last = 0;
+
+static int keyword_lex(YYSTYPE *lvalp, YYLTYPE *llocp, yyscan_t scanner)
+{
+#undef yylex
+  static const struct { const char *word; int token; } keywords[] = {
+    { "if", _KW_if }, { "then", _KW_then }, { "else", _KW_else },
+    { "elif", _KW_elif }, { "fi", _KW_fi }, { "while", _KW_while },
+    { "for", _KW_for }, { "do", _KW_do }, { "done", _KW_done },
+  };
+  int token = yylex(lvalp, llocp, scanner);
+
+  if (token == T_Word) {
+    switch (last_token) {
+    case 0: case _SEMI: case _NL: case _AMP: case _DAMP: case _DBAR:
+    case _KW_if: case _KW_then: case _KW_else: case _KW_elif: case _KW_while: case _KW_do:
+      for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        if (strcmp(lvalp->_string, keywords[i].word) == 0) {
+          token = keywords[i].token;
+          break;
+        }
+      }
+      break;
+    case T_Word:
+      if (token_before_last == _KW_for && strcmp(lvalp->_string, "in") == 0) {
+        token = _KW_in;
+      }
+      break;
+    }
+  }
+  token_before_last = last_token;
+  last_token = token;
+  return token;
+}
 
 /* Entrypoint: parse Input from file. */
 Input pInput(FILE *inp)
@@ -1626,6 +1828,7 @@ Input pInput(FILE *inp)
     fprintf(stderr, "Failed to initialize lexer.\n");
     return 0;
   }
+  last_token = token_before_last = 0;
   int error = yyparse(scanner, &result);
   shell_lex_destroy(scanner);
   if (error)
@@ -1648,6 +1851,7 @@ Input psInput(const char *str)
     return 0;
   }
   YY_BUFFER_STATE buf = shell__scan_string(str, scanner);
+  last_token = token_before_last = 0;
   int error = yyparse(scanner, &result);
   shell__delete_buffer(buf, scanner);
   shell_lex_destroy(scanner);
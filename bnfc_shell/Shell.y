@@ -126,6 +126,10 @@ void yyerror(YYLTYPE *loc, yyscan_t scanner, YYSTYPE *result, const char *msg)
 int yyparse(yyscan_t scanner, YYSTYPE *result);
 
 extern int yylex(YYSTYPE *lvalp, YYLTYPE *llocp, yyscan_t scanner);
+
+/* The parser reads tokens through keyword_lex() (see below) */
+static int keyword_lex(YYSTYPE *lvalp, YYLTYPE *llocp, yyscan_t scanner);
+#define yylex keyword_lex
 %}
 
 %token          _ERROR_
@@ -133,12 +137,31 @@ extern int yylex(YYSTYPE *lvalp, YYLTYPE *llocp, yyscan_t scanner);
 %token          _LT      /* < */
 %token          _GT      /* > */
 %token          _DGT     /* >> */
+%token          _DLT     /* << */
+%token          _TLT     /* <<< */
 %token          _KW_AI   /* AI */
 %token          _BAR     /* | */
+%token          _AMP     /* & */
+%token          _NL      /* newline */
+%token          _DAMP    /* && */
+%token          _DBAR    /* || */
+%token          _KW_if   /* if */
+%token          _KW_then /* then */
+%token          _KW_else /* else */
+%token          _KW_elif /* elif */
+%token          _KW_fi   /* fi */
+%token          _KW_while /* while */
+%token          _KW_for  /* for */
+%token          _KW_in   /* in */
+%token          _KW_do   /* do */
+%token          _KW_done /* done */
 %token<_string> T_Word   /* Word */
 
 %type <input_> Input
 %type <command_> Command
+%type <command_> Command1
+%type <command_> Command2
+%type <listcommand_> ElsePart
 %type <pipeline_> Pipeline
 %type <simplecommand_> SimpleCommand
 %type <redirection_> Redirection
@@ -153,9 +176,28 @@ extern int yylex(YYSTYPE *lvalp, YYLTYPE *llocp, yyscan_t scanner);
 
 Input : ListCommand { $$ = make_StartInput($1); result->input_ = $$; }
 ;
-Command : SimpleCommand { $$ = make_SimpleCmd($1); }
+Command : Command1 _AMP { $$ = make_BgCmd($1); }
+;
+Command1 : Command2 { $$ = $1; }
+  | Command1 _DAMP Newlines Command2 { $$ = make_AndCmd($1, $4); }
+  | Command1 _DBAR Newlines Command2 { $$ = make_OrCmd($1, $4); }
+;
+Command2 : SimpleCommand { $$ = make_SimpleCmd($1); }
   | Pipeline { $$ = make_PipeCmd($1); }
   | _KW_AI ListWord { $$ = make_AICmd($2); }
+  | _KW_if ListCommand _KW_then ListCommand ElsePart _KW_fi { $$ = make_IfCmd($2, $4, $5); }
+  | _KW_while ListCommand _KW_do ListCommand _KW_done { $$ = make_WhileCmd($2, $4); }
+  | _KW_for T_Word _KW_in ListWord ForSeparator _KW_do ListCommand _KW_done { $$ = make_ForCmd($2, $4, $7); }
+;
+ElsePart : /* empty */ { $$ = 0; }
+  | _KW_else ListCommand { $$ = $2; }
+  | _KW_elif ListCommand _KW_then ListCommand ElsePart { $$ = make_ListCommand(make_IfCmd($2, $4, $5), 0); }
+;
+ForSeparator : _SEMI Newlines
+  | _NL Newlines
+;
+Newlines : /* empty */
+  | _NL Newlines
 ;
 Pipeline : ListSimpleCommand { $$ = make_PipeLine($1); }
 ;
@@ -164,10 +206,15 @@ SimpleCommand : T_Word ListWord ListRedirection { $$ = make_Cmd($1, $2, reverseL
 Redirection : _LT T_Word { $$ = make_RedirIn($2); }
   | _GT T_Word { $$ = make_RedirOut($2); }
   | _DGT T_Word { $$ = make_RedirAppend($2); }
+  | _DLT T_Word { $$ = make_RedirHereDoc($2); }
+  | _TLT T_Word { $$ = make_RedirHereStr($2); }
 ;
 ListCommand : /* empty */ { $$ = 0; }
-  | Command { $$ = make_ListCommand($1, 0); }
-  | Command _SEMI ListCommand { $$ = make_ListCommand($1, $3); }
+  | Command1 { $$ = make_ListCommand($1, 0); }
+  | Command1 _SEMI ListCommand { $$ = make_ListCommand($1, $3); }
+  | Command1 _NL ListCommand { $$ = make_ListCommand($1, $3); }
+  | Command ListCommand { $$ = make_ListCommand($1, $2); }
+  | _NL ListCommand { $$ = $2; }
 ;
 ListSimpleCommand : /* empty */ { $$ = 0; }
   | SimpleCommand { $$ = make_ListSimpleCommand($1, 0); }
@@ -183,6 +230,50 @@ ListRedirection : /* empty */ { $$ = 0; }
 %%
 
 
+/*
+ * Keywords (if, then, else, elif, fi, while, for, do, done) are Words
+ * to the lexer. They are keywords only where a command can start: at
+ * the beginning, after ; & && || or a newline, and after a keyword
+ * that is followed by a command. "in" is one only as the third word of
+ * a for. So "echo done" prints "done". One parse runs at a time, so the
+ * tokens seen so far can be kept here (pInput()/psInput() reset them).
+ */
+static int last_token = 0;
+static int token_before_last = 0;
+
+static int keyword_lex(YYSTYPE *lvalp, YYLTYPE *llocp, yyscan_t scanner)
+{
+#undef yylex
+  static const struct { const char *word; int token; } keywords[] = {
+    { "if", _KW_if }, { "then", _KW_then }, { "else", _KW_else },
+    { "elif", _KW_elif }, { "fi", _KW_fi }, { "while", _KW_while },
+    { "for", _KW_for }, { "do", _KW_do }, { "done", _KW_done },
+  };
+  int token = yylex(lvalp, llocp, scanner);
+
+  if (token == T_Word) {
+    switch (last_token) {
+    case 0: case _SEMI: case _NL: case _AMP: case _DAMP: case _DBAR:
+    case _KW_if: case _KW_then: case _KW_else: case _KW_elif: case _KW_while: case _KW_do:
+      for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        if (strcmp(lvalp->_string, keywords[i].word) == 0) {
+          token = keywords[i].token;
+          break;
+        }
+      }
+      break;
+    case T_Word:
+      if (token_before_last == _KW_for && strcmp(lvalp->_string, "in") == 0) {
+        token = _KW_in;
+      }
+      break;
+    }
+  }
+  token_before_last = last_token;
+  last_token = token;
+  return token;
+}
+
 /* Entrypoint: parse Input from file. */
 Input pInput(FILE *inp)
 {
@@ -192,6 +283,7 @@ Input pInput(FILE *inp)
     fprintf(stderr, "Failed to initialize lexer.\n");
     return 0;
   }
+  last_token = token_before_last = 0;
   int error = yyparse(scanner, &result);
   shell_lex_destroy(scanner);
   if (error)
@@ -214,6 +306,7 @@ Input psInput(const char *str)
     return 0;
   }
   YY_BUFFER_STATE buf = shell__scan_string(str, scanner);
+  last_token = token_before_last = 0;
   int error = yyparse(scanner, &result);
   shell__delete_buffer(buf, scanner);
   shell_lex_destroy(scanner);
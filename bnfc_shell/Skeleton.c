@@ -8,19 +8,55 @@
  *   3. Updates the execution context
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* strndup() */
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
+#if defined(__GLIBC__)
+#include <stdio_ext.h>
+#endif
 
 #include "Skeleton.h"
+#include "Printer.h"
 #include "../include/picobox.h"
 #include "../include/exec_helpers.h"
 #include "../include/pipe_helpers.h"
 #include "../include/cmd_spec.h"
+#include "../include/path_cache.h"
+#include "../include/reaper.h"
+#include "../include/env_cache.h"
+#include "../include/zygote.h"
+#include "../include/time_stats.h"
+#include "../include/io_stats.h"
+#include "../include/trace.h"
+#include "../include/glob_expand.h"
+#include "../include/fast_parse.h"
+#include "../include/printf_format.h"
+
+extern char **environ;
+
+/* SimpleCommand execution steps and pipeline stage helpers (defined below) */
+static int is_assignment(const char *word);
+static int prepare_simple_command(SimpleCommand p, ExecContext *ctx);
+static void run_prepared_command(ExecContext *ctx);
+static int take_stage(pipe_stage_t *stage, ExecContext *ctx);
+static void free_stage(pipe_stage_t *stage);
+static int run_stage_in_child(pipe_stage_t *stage, void *data);
+static char *expand_variables(const char *word, ExecContext *ctx);
+
+/* Job table helpers (defined below) */
+static void update_jobs(ExecContext *ctx);
+static char *job_command_text(Command p);
+static void remove_done_jobs(ExecContext *ctx);
 
 /*
  * Create a new execution context
@@ -28,7 +64,14 @@
  */
 ExecContext *exec_context_new(void)
 {
-    ExecContext *ctx = calloc(1, sizeof(ExecContext));
+    ExecContext *ctx;
+
+    /* The zygote must be forked while the shell is still small */
+    if (get_spawn_backend() == SPAWN_BACKEND_ZYGOTE) {
+        zygote_start();
+    }
+
+    ctx = calloc(1, sizeof(ExecContext));
     if (!ctx) {
         perror("calloc");
         return NULL;
@@ -50,22 +93,6 @@ ExecContext *exec_context_new(void)
 
     /* Initialize pipeline state */
     ctx->in_pipeline = 0;
-    ctx->pipeline_position = 0;
-    ctx->pipeline_total = 0;
-    ctx->prev_pipe[0] = -1;
-    ctx->prev_pipe[1] = -1;
-    ctx->curr_pipe[0] = -1;
-    ctx->curr_pipe[1] = -1;
-
-    /* Initialize PID tracking array */
-    ctx->pid_capacity = 8;
-    ctx->pids = malloc(ctx->pid_capacity * sizeof(pid_t));
-    if (!ctx->pids) {
-        free(ctx->argv);
-        free(ctx);
-        return NULL;
-    }
-    ctx->pid_count = 0;
 
     /* Initialize execution state */
     ctx->exit_status = EXIT_OK;
@@ -73,9 +100,8 @@ ExecContext *exec_context_new(void)
     ctx->has_error = 0;
 
     /* Initialize variable table */
-    ctx->variables = var_table_create(64); /* 64 buckets should be enough */
+    ctx->variables = var_table_create(0); /* Grows as variables are added */
     if (!ctx->variables) {
-        free(ctx->pids);
         free(ctx->argv);
         free(ctx);
         return NULL;
@@ -98,6 +124,10 @@ void exec_context_free(ExecContext *ctx)
         }
         free(ctx->argv);
     }
+    for (int i = 0; i < ctx->assign_count; i++) {
+        free(ctx->assigns[i]);
+    }
+    free(ctx->assigns);
 
     /* Close any open file descriptors */
     if (ctx->stdin_fd != -1) {
@@ -110,12 +140,14 @@ void exec_context_free(ExecContext *ctx)
         close(ctx->stderr_fd);
     }
 
-    /* Free PID array */
-    free(ctx->pids);
-
     /* Free variable table */
     var_table_destroy(ctx->variables);
 
+    /* Forget background jobs (they keep running) */
+    for (int i = 0; i < ctx->job_count; i++) {
+        free(ctx->jobs[i].command);
+    }
+
     free(ctx);
 }
 
@@ -132,6 +164,13 @@ void exec_context_reset_command(ExecContext *ctx)
     }
     ctx->argc = 0;
 
+    for (int i = 0; i < ctx->assign_count; i++) {
+        free(ctx->assigns[i]);
+    }
+    free(ctx->assigns);
+    ctx->assigns = NULL;
+    ctx->assign_count = 0;
+
     /* Close and reset file descriptors */
     if (ctx->stdin_fd != -1) {
         close(ctx->stdin_fd);
@@ -164,7 +203,9 @@ void visitInput(Input p, ExecContext *ctx)
     {
     case is_StartInput:
         /* Visit all commands in sequence (separated by ;) */
+        TRACE_BEGIN("visit", NULL);
         visitListCommand(p->u.startInput_.listcommand_, ctx);
+        TRACE_END("visit");
         break;
 
     default:
@@ -207,7 +248,7 @@ void visitAICommand(ListWord listword, ExecContext *ctx)
     const cmd_spec_t *spec = find_command("AI");
     if (!spec) {
         fprintf(stderr, "Error: AI command not registered\n");
-        fprintf(stderr, "Make sure register_ai_command() was called at startup.\n");
+        fprintf(stderr, "Make sure cmd_ai.c is built into picobox.\n");
         ctx->exit_status = EXIT_ERROR;
         return;
     }
@@ -221,23 +262,294 @@ void visitAICommand(ListWord listword, ExecContext *ctx)
 }
 
 /*
- * Visit Command node - dispatches to SimpleCmd, PipeCmd, or AICmd
+ * Does this command start with the word `time`?
+ * (like sh, only at the start of a simple command or pipeline)
+ */
+static int is_timed_command(Command p)
+{
+    SimpleCommand first;
+
+    if (p->kind == is_SimpleCmd) {
+        first = p->u.simpleCmd_.simplecommand_;
+    } else if (p->kind == is_PipeCmd && p->u.pipeCmd_.pipeline_->u.pipeLine_.listsimplecommand_) {
+        first = p->u.pipeCmd_.pipeline_->u.pipeLine_.listsimplecommand_->simplecommand_;
+    } else {
+        return 0;
+    }
+
+    return strcmp(first->u.cmd_.word_, "time") == 0;
+}
+
+/*
+ * Run a simple command or pipeline and measure it
+ *
+ * `time CMD` reports real/user/sys time, max RSS and context switches
+ * on stderr; with PICOBOX_TIME_LOG every command is also logged, and
+ * with PICOBOX_STATS its I/O and allocations are reported (io_stats.h).
+ */
+static void visit_timed_command(Command p, ExecContext *ctx, int report)
+{
+    time_mark_t mark;
+    time_stats_t stats;
+    io_stats_t io_mark;
+    io_stats_t io;
+
+    ctx->timing = 1;
+    ctx->strip_time = report;
+
+    fflush(stdout);
+    time_stats_begin(&mark);
+    io_stats_begin(&io_mark);
+    visitCommand(p, ctx);
+    fflush(stdout);
+    io_stats_end(&io_mark, &io);
+    time_stats_end(&mark, &stats);
+
+    ctx->timing = 0;
+    ctx->strip_time = 0;
+
+    if (report) {
+        time_stats_print(stderr, &stats);
+    }
+    if (time_stats_log_enabled() || io_stats_on) {
+        char *text = job_command_text(p);
+
+        if (time_stats_log_enabled()) {
+            time_stats_log(&stats, ctx->exit_status, text);
+        }
+        if (io_stats_on) {
+            io_stats_print(stderr, text, &io, stats.real_ms);
+        }
+        free(text);
+    }
+}
+
+/*
+ * Should a loop stop? (exit was run, or the last command was killed by
+ * Ctrl-C, which the shell itself ignores)
+ */
+static int loop_interrupted(ExecContext *ctx)
+{
+    return ctx->should_exit || ctx->exit_status == 128 + SIGINT;
+}
+
+/*
+ * if LIST; then LIST; [else LIST;] fi
+ * The status is the branch's, or 0 when no branch runs
+ */
+static void visit_if(Command p, ExecContext *ctx)
+{
+    visitListCommand(p->u.ifCmd_.listcommand_1, ctx);
+    if (ctx->should_exit) {
+        return;
+    }
+    if (ctx->exit_status == EXIT_OK) {
+        visitListCommand(p->u.ifCmd_.listcommand_2, ctx);
+    } else if (p->u.ifCmd_.listcommand_3) {
+        visitListCommand(p->u.ifCmd_.listcommand_3, ctx);
+    } else {
+        ctx->exit_status = EXIT_OK;
+    }
+}
+
+/*
+ * while LIST; do LIST; done
+ * Both lists are re-run from the tree: an iteration costs no parsing,
+ * and builtins and registry commands in it no fork.
+ */
+static void visit_while(Command p, ExecContext *ctx)
+{
+    int status = EXIT_OK;
+
+    for (;;) {
+        visitListCommand(p->u.whileCmd_.listcommand_1, ctx);
+        if (ctx->exit_status != EXIT_OK || loop_interrupted(ctx)) {
+            break;
+        }
+        visitListCommand(p->u.whileCmd_.listcommand_2, ctx);
+        status = ctx->exit_status;
+        if (loop_interrupted(ctx)) {
+            break;
+        }
+    }
+    if (!loop_interrupted(ctx)) {
+        ctx->exit_status = status;
+    }
+}
+
+/*
+ * Split the expanded words of a for list at blanks and newlines, so
+ * that for f in $(ls) sees one file at a time
+ * Returns: the fields (NULL-terminated, caller frees each and the array)
+ */
+static char **split_fields(char **words, int count, int *field_count)
+{
+    static const char blanks[] = " \t\n";
+    char **fields = NULL;
+    int n = 0;
+    int capacity = 0;
+
+    for (int i = 0; i < count; i++) {
+        const char *p = words[i];
+
+        for (;;) {
+            size_t len;
+
+            p += strspn(p, blanks);
+            if (!*p) {
+                break;
+            }
+            len = strcspn(p, blanks);
+            if (n + 1 >= capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                fields = realloc(fields, capacity * sizeof(char *));
+                if (!fields) {
+                    perror("realloc");
+                    exit(1);
+                }
+            }
+            fields[n] = strndup(p, len);
+            if (!fields[n]) {
+                perror("strndup");
+                exit(1);
+            }
+            n++;
+            p += len;
+        }
+    }
+    if (fields) {
+        fields[n] = NULL;
+    }
+    *field_count = n;
+    return fields;
+}
+
+/*
+ * for NAME in WORDS; do LIST; done
+ * The words are expanded and split once, up front, with the argv of
+ * whatever command is being prepared set aside; NAME is then set to
+ * each field in turn.
+ */
+static void visit_for(Command p, ExecContext *ctx)
+{
+    char **argv = ctx->argv;
+    int argc = ctx->argc;
+    int argv_capacity = ctx->argv_capacity;
+    const char *name = p->u.forCmd_.word_;
+    char **items;
+    int count;
+
+    ctx->argv_capacity = 16;
+    ctx->argv = malloc(ctx->argv_capacity * sizeof(char *));
+    if (!ctx->argv) {
+        perror("malloc");
+        exit(1);
+    }
+    ctx->argc = 0;
+    visitListWord(p->u.forCmd_.listword_, ctx);
+    items = split_fields(ctx->argv, ctx->argc, &count);
+    for (int i = 0; i < ctx->argc; i++) {
+        free(ctx->argv[i]);
+    }
+    free(ctx->argv);
+    ctx->argv = argv;
+    ctx->argc = argc;
+    ctx->argv_capacity = argv_capacity;
+
+    ctx->exit_status = EXIT_OK;
+    if (!isalpha((unsigned char)name[0]) && name[0] != '_') {
+        fprintf(stderr, "for: invalid variable name: %s\n", name);
+        ctx->exit_status = EXIT_ERROR;
+        count = 0;
+    }
+    for (int i = 0; i < count; i++) {
+        if (var_table_set(ctx->variables, name, items[i]) != 0 ||
+            (env_is_exported(name) && env_export(name, items[i]) != 0)) {
+            fprintf(stderr, "Failed to set variable %s\n", name);
+            ctx->exit_status = EXIT_ERROR;
+            break;
+        }
+        visitListCommand(p->u.forCmd_.listcommand_, ctx);
+        if (loop_interrupted(ctx)) {
+            break;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        free(items[i]);
+    }
+    free(items);
+}
+
+/*
+ * Visit Command node - dispatches to SimpleCmd, PipeCmd, AICmd, BgCmd,
+ * the && and || lists, and the compound commands (if, while, for)
  */
 void visitCommand(Command p, ExecContext *ctx)
 {
+    if (!ctx->timing && (p->kind == is_SimpleCmd || p->kind == is_PipeCmd)) {
+        int report = is_timed_command(p);
+
+        if (report || time_stats_log_enabled() || io_stats_on) {
+            visit_timed_command(p, ctx, report);
+            return;
+        }
+    }
+
     switch(p->kind)
     {
     case is_SimpleCmd:
         /* Simple command - just one command with args and redirections */
+        TRACE_BEGIN("command", p->u.simpleCmd_.simplecommand_->u.cmd_.word_);
         visitSimpleCommand(p->u.simpleCmd_.simplecommand_, ctx);
+        TRACE_END("command");
         break;
     case is_PipeCmd:
         /* Pipeline command - multiple commands connected with | */
+        TRACE_BEGIN("pipeline", NULL);
         visitPipeline(p->u.pipeCmd_.pipeline_, ctx);
+        TRACE_END("pipeline");
         break;
     case is_AICmd:
         /* AI command - interactive assistant */
+        TRACE_BEGIN("ai", NULL);
         visitAICommand(p->u.aICmd_.listword_, ctx);
+        TRACE_END("ai");
+        break;
+    case is_BgCmd:
+        /* Background command - cmd & */
+        TRACE_BEGIN("background", NULL);
+        visitBackground(p->u.bgCmd_.command_, ctx);
+        TRACE_END("background");
+        break;
+    case is_AndCmd:
+        /* cmd1 && cmd2 - the second runs only if the first succeeds */
+        visitCommand(p->u.andCmd_.command_1, ctx);
+        if (ctx->exit_status == EXIT_OK && !ctx->should_exit) {
+            visitCommand(p->u.andCmd_.command_2, ctx);
+        }
+        break;
+    case is_OrCmd:
+        /* cmd1 || cmd2 - the second runs only if the first fails */
+        visitCommand(p->u.orCmd_.command_1, ctx);
+        if (ctx->exit_status != EXIT_OK && !ctx->should_exit) {
+            visitCommand(p->u.orCmd_.command_2, ctx);
+        }
+        break;
+    case is_IfCmd:
+        TRACE_BEGIN("if", NULL);
+        visit_if(p, ctx);
+        TRACE_END("if");
+        break;
+    case is_WhileCmd:
+        TRACE_BEGIN("while", NULL);
+        visit_while(p, ctx);
+        TRACE_END("while");
+        break;
+    case is_ForCmd:
+        TRACE_BEGIN("for", p->u.forCmd_.word_);
+        visit_for(p, ctx);
+        TRACE_END("for");
         break;
 
     default:
@@ -247,151 +559,261 @@ void visitCommand(Command p, ExecContext *ctx)
 }
 
 /*
- * Visit Pipeline - REFACTORED per plan.md Phase 4
- *
- * THIS IS THE KEY REFACTORING!
- * PROFESSOR'S WORDS: "You take this function and cut it into pieces,
- * and put them into all the different visit nodes."
- *
- * OLD APPROACH (WRONG):
- *   1. Collect all commands
- *   2. Call exec_pipeline() monolithic function
+ * Job text for `jobs`, from the AST (caller frees)
+ */
+static char *job_command_text(Command p)
+{
+    char *text = strdup(printCommand(p));
+    if (!text) {
+        return NULL;
+    }
+
+    size_t len = strlen(text);
+    while (len > 0 && isspace((unsigned char)text[len - 1])) {
+        text[--len] = '\0';
+    }
+    return text;
+}
+
+/*
+ * Visit BgCmd - run a command without waiting for it (cmd &)
  *
- * NEW APPROACH (CORRECT):
- *   1. Create pipes HERE in visitPipeline
- *   2. Fork HERE in visitPipeline
- *   3. visitSimpleCommand handles the exec (when in_pipeline flag is set)
- *   4. Logic is SCATTERED across the AST nodes
+ * The command runs in a forked subshell and goes into the job table;
+ * the reaper (src/reaper.c) notices when it exits, and `jobs`/`wait`
+ * report it. As in a non-interactive POSIX shell, its stdin is
+ * /dev/null unless the command redirects it.
  */
-void visitPipeline(Pipeline p, ExecContext *ctx)
+void visitBackground(Command p, ExecContext *ctx)
 {
-    switch(p->kind)
-    {
-    case is_PipeLine:
-    {
-        /* Count commands in pipeline */
-        int cmd_count = 0;
-        ListSimpleCommand temp = p->u.pipeLine_.listsimplecommand_;
-        while (temp) {
-            cmd_count++;
-            temp = temp->listsimplecommand_;
+    if (ctx->job_count == MAX_JOBS) {
+        /* Make room by forgetting jobs that already finished */
+        update_jobs(ctx);
+        remove_done_jobs(ctx);
+        if (ctx->job_count == MAX_JOBS) {
+            fprintf(stderr, "Error: too many background jobs (max %d)\n", MAX_JOBS);
+            ctx->exit_status = EXIT_ERROR;
+            return;
         }
+    }
 
-        /* Set pipeline context */
-        ctx->in_pipeline = 1; // one cmd in pipeline
-        ctx->pipeline_total = cmd_count; // total commands
-        ctx->prev_pipe[0] = -1; // set pipe ctx
-        ctx->prev_pipe[1] = -1;
+    /* Don't let the subshell inherit unflushed output */
+    fflush(stdout);
+    fflush(stderr);
 
-        /* Ensure PIDs array is large enough */
-        if (ctx->pid_count + cmd_count > ctx->pid_capacity) {
-            ctx->pid_capacity = ctx->pid_count + cmd_count;
-            ctx->pids = realloc(ctx->pids, ctx->pid_capacity * sizeof(pid_t));
-            if (!ctx->pids) {
-                perror("realloc");
-                ctx->has_error = 1;
-                break;
-            }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        ctx->exit_status = EXIT_ERROR;
+        return;
+    }
+
+    if (pid == 0) {
+        /* === SUBSHELL === */
+        int devnull = open("/dev/null", O_RDONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            close(devnull);
         }
+        /* Lines the shell buffered from its stdin are not ours either */
+#if defined(__GLIBC__)
+        __fpurge(stdin);
+#elif defined(__APPLE__)
+        fpurge(stdin);
+#endif
+        clearerr(stdin);
+
+        /* The parent's jobs are not this process's children */
+        reaper_forget_all();
+        ctx->job_count = 0;
+        ctx->interactive = 0;
+
+        visitCommand(p, ctx);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(ctx->exit_status);
+    }
 
-        /* Execute each command in pipeline */
-        ListSimpleCommand sc_list = p->u.pipeLine_.listsimplecommand_;
-        int position = 0;
+    /* === PARENT === */
+    bg_job_t *job = &ctx->jobs[ctx->job_count];
+    job->id = ctx->job_count > 0 ? ctx->jobs[ctx->job_count - 1].id + 1 : 1;
+    job->pid = pid;
+    job->command = job_command_text(p);
+    job->done = 0;
+    job->status = 0;
+    ctx->job_count++;
 
-        while (sc_list) {
-            ctx->pipeline_position = position;
+    /* If this fails, poll_job() falls back to waitpid() */
+    reaper_watch(pid);
 
-            /* Create pipe for all except last command */
-            if (position < cmd_count - 1) {
-                if (pipe(ctx->curr_pipe) < 0) {
-                    perror("pipe");
-                    ctx->has_error = 1;
-                    break;
-                }
+    ctx->last_bg_pid = pid;
+    ctx->exit_status = EXIT_OK;
+
+    if (ctx->interactive) {
+        fprintf(stderr, "[%d] %d\n", job->id, (int)pid);
+    }
+}
+
+/*
+ * Check whether a job has exited, optionally waiting for it
+ */
+static void poll_job(bg_job_t *job, int block)
+{
+    int raw_status = 0;
+
+    while (!job->done) {
+        int r = reaper_take(job->pid, &raw_status, NULL);
+
+        if (r < 0) {
+            /* Never watched (reaper_watch failed): wait directly */
+            pid_t w = waitpid(job->pid, &raw_status, block ? 0 : WNOHANG);
+            if (w == 0) {
+                return;
+            }
+            if (w < 0) {
+                raw_status = 0xff00;   /* lost it: exit status 255 */
+            }
+            r = 1;
+        }
+
+        if (r == 1) {
+            job->done = 1;
+            if (WIFEXITED(raw_status)) {
+                job->status = WEXITSTATUS(raw_status);
+            } else if (WIFSIGNALED(raw_status)) {
+                job->status = 128 + WTERMSIG(raw_status);
             } else {
-                ctx->curr_pipe[0] = -1;
-                ctx->curr_pipe[1] = -1;
+                job->status = EXIT_ERROR;
             }
+            return;
+        }
 
-            /* Fork for this command */
-            pid_t pid = fork();
+        if (!block || reaper_collect(-1) < 0) {
+            return;
+        }
+    }
+}
 
-            if (pid < 0) {
-                perror("fork");
-                ctx->has_error = 1;
-                break;
-            }
+/* Reap whatever jobs have exited, without blocking */
+static void update_jobs(ExecContext *ctx)
+{
+    if (ctx->job_count == 0) {
+        return;
+    }
 
-            if (pid == 0) {
-                /* === CHILD PROCESS === */
+    reaper_collect(0);
+    for (int i = 0; i < ctx->job_count; i++) {
+        poll_job(&ctx->jobs[i], 0);
+    }
+}
 
-                /* Connect stdin to previous pipe (if not first) */
-                if (ctx->prev_pipe[0] != -1) {
-                    dup2(ctx->prev_pipe[0], STDIN_FILENO);
-                    close(ctx->prev_pipe[0]);
-                    close(ctx->prev_pipe[1]);
-                }
+/* Drop finished jobs from the table, keeping the rest in order */
+static void remove_done_jobs(ExecContext *ctx)
+{
+    int kept = 0;
 
-                /* Connect stdout to current pipe (if not last) */
-                if (ctx->curr_pipe[1] != -1) {
-                    dup2(ctx->curr_pipe[1], STDOUT_FILENO);
-                    close(ctx->curr_pipe[0]);
-                    close(ctx->curr_pipe[1]);
-                }
+    for (int i = 0; i < ctx->job_count; i++) {
+        if (ctx->jobs[i].done) {
+            free(ctx->jobs[i].command);
+        } else {
+            ctx->jobs[kept++] = ctx->jobs[i];
+        }
+    }
+    ctx->job_count = kept;
+}
 
-                /* Execute this SimpleCommand
-                 * visitSimpleCommand will see in_pipeline==1
-                 * and will NOT fork again, just exec
-                 */
-                visitSimpleCommand(sc_list->simplecommand_, ctx);
+/* Print one job the way `jobs` shows it */
+static void print_job(FILE *out, const bg_job_t *job)
+{
+    char state[32];
 
-                /* If visitSimpleCommand didn't exec, exit */
-                _exit(ctx->exit_status);
-            }
+    if (!job->done) {
+        snprintf(state, sizeof(state), "Running");
+    } else if (job->status == 0) {
+        snprintf(state, sizeof(state), "Done");
+    } else {
+        snprintf(state, sizeof(state), "Exit %d", job->status);
+    }
+
+    fprintf(out, "[%d]  %-10s %s\n", job->id, state,
+            job->command ? job->command : "");
+}
 
-            /* === PARENT PROCESS === */
+void exec_context_notify_jobs(ExecContext *ctx)
+{
+    update_jobs(ctx);
 
-            /* Save PID */
-            ctx->pids[ctx->pid_count++] = pid;
+    if (!ctx->interactive) {
+        /* Scripts collect statuses with `wait`; keep them until then */
+        return;
+    }
 
-            /* Close previous pipe in parent */
-            if (ctx->prev_pipe[0] != -1) {
-                close(ctx->prev_pipe[0]);
-                close(ctx->prev_pipe[1]);
-            }
+    for (int i = 0; i < ctx->job_count; i++) {
+        if (ctx->jobs[i].done) {
+            print_job(stderr, &ctx->jobs[i]);
+        }
+    }
+    remove_done_jobs(ctx);
+}
 
-            /* Current pipe becomes previous for next iteration */
-            ctx->prev_pipe[0] = ctx->curr_pipe[0];
-            ctx->prev_pipe[1] = ctx->curr_pipe[1];
+/*
+ * Visit Pipeline - REFACTORED per plan.md Phase 4
+ *
+ * Each SimpleCommand node is still visited here, in the shell: its
+ * words are expanded and its redirections opened at their own nodes
+ * (prepare_simple_command). The pipe/fork/wait mechanics are shared
+ * with exec_pipeline() in run_pipeline() (src/pipe_helpers.c), which
+ * also picks threads for all-builtin pipelines.
+ *
+ * Stages that run shell code (registry commands, assignments) come
+ * back to run_stage_in_child() inside their forked child.
+ */
+void visitPipeline(Pipeline p, ExecContext *ctx)
+{
+    switch(p->kind)
+    {
+    case is_PipeLine:
+    {
+        /* Count commands in pipeline */
+        int cmd_count = 0;
+        ListSimpleCommand temp = p->u.pipeLine_.listsimplecommand_;
+        while (temp) {
+            cmd_count++;
+            temp = temp->listsimplecommand_;
+        }
 
-            /* Move to next command */
-            sc_list = sc_list->listsimplecommand_;
-            position++;
+        /* Empty command (e.g. "a ; ; b"): nothing to run */
+        if (cmd_count == 0) {
+            break;
         }
 
-        /* Close last pipe in parent */
-        if (ctx->prev_pipe[0] != -1) {
-            close(ctx->prev_pipe[0]);
-            close(ctx->prev_pipe[1]);
+        pipe_stage_t *stages = calloc(cmd_count, sizeof(pipe_stage_t));
+        if (!stages) {
+            perror("calloc");
+            ctx->has_error = 1;
+            break;
         }
 
-        /* Wait for all children */
-        for (int i = 0; i < ctx->pid_count; i++) {
-            int status;
-            if (waitpid(ctx->pids[i], &status, 0) >= 0) {
-                /* Last command's status is pipeline's status */
-                if (i == ctx->pid_count - 1) {
-                    if (WIFEXITED(status))
-                        ctx->exit_status = WEXITSTATUS(status);
-                    else if (WIFSIGNALED(status))
-                        ctx->exit_status = 128 + WTERMSIG(status);
-                }
+        /* Prepare each stage: expand words, open redirections */
+        ListSimpleCommand sc_list = p->u.pipeLine_.listsimplecommand_;
+        for (int i = 0; sc_list; sc_list = sc_list->listsimplecommand_, i++) {
+            stages[i].stdin_fd = -1;
+            stages[i].stdout_fd = -1;
+
+            if (prepare_simple_command(sc_list->simplecommand_, ctx) != 0 ||
+                take_stage(&stages[i], ctx) != 0) {
+                /* Empty command or failed redirection: stage never runs */
+                stages[i].status = ctx->has_error ? EXIT_ERROR : EXIT_OK;
+                exec_context_reset_command(ctx);
+                ctx->has_error = 0;
             }
         }
 
-        /* Reset pipeline state */
-        ctx->pid_count = 0;
-        ctx->in_pipeline = 0;
+        ctx->exit_status = run_pipeline(stages, cmd_count, run_stage_in_child, ctx);
+
+        for (int i = 0; i < cmd_count; i++) {
+            free_stage(&stages[i]);
+        }
+        free(stages);
 
         break;
     }
@@ -402,6 +824,98 @@ void visitPipeline(Pipeline p, ExecContext *ctx)
     }
 }
 
+/*
+ * Move a prepared command from the context into a pipeline stage
+ *
+ * The stage takes over the argv strings and redirection fds, so the
+ * context is free to prepare the next stage.
+ *
+ * Returns: 0 on success, -1 on allocation failure
+ */
+static int take_stage(pipe_stage_t *stage, ExecContext *ctx)
+{
+    stage->argv = malloc((ctx->argc + 1) * sizeof(char *));
+    if (!stage->argv) {
+        perror("malloc");
+        ctx->has_error = 1;
+        return -1;
+    }
+
+    memcpy(stage->argv, ctx->argv, ctx->argc * sizeof(char *));
+    stage->argv[ctx->argc] = NULL;
+    stage->argc = ctx->argc;
+
+    /* Assignments and registry commands need our code in the child */
+    if (is_assignment(stage->argv[0])) {
+        stage->run_in_shell = 1;
+    } else {
+        stage->spec = find_command(stage->argv[0]);
+        stage->run_in_shell = (stage->spec != NULL);
+    }
+
+    /* FOO=bar prefixes: the stage gets an environment of its own */
+    if (ctx->assign_count > 0) {
+        stage->envp = env_vector_with(ctx->assigns, ctx->assign_count);
+        if (!stage->envp) {
+            free(stage->argv);
+            stage->argv = NULL;
+            ctx->has_error = 1;
+            return -1;
+        }
+    }
+
+    stage->stdin_fd = ctx->stdin_fd;
+    stage->stdout_fd = ctx->stdout_fd;
+    ctx->argc = 0;
+    ctx->stdin_fd = -1;
+    ctx->stdout_fd = -1;
+
+    return 0;
+}
+
+/* Release what take_stage() moved into a stage */
+static void free_stage(pipe_stage_t *stage)
+{
+    if (stage->argv) {
+        for (int i = 0; i < stage->argc; i++) {
+            free(stage->argv[i]);
+        }
+        free(stage->argv);
+        stage->argv = NULL;
+    }
+    free(stage->envp);
+    stage->envp = NULL;
+    if (stage->stdin_fd != -1) {
+        close(stage->stdin_fd);
+        stage->stdin_fd = -1;
+    }
+    if (stage->stdout_fd != -1) {
+        close(stage->stdout_fd);
+        stage->stdout_fd = -1;
+    }
+}
+
+/*
+ * run_pipeline() hook: runs in the forked child of a stage, with
+ * stdin/stdout already connected to the pipes
+ */
+static int run_stage_in_child(pipe_stage_t *stage, void *data)
+{
+    ExecContext *ctx = data;
+
+    /* This process only ever runs this stage: borrow its argv */
+    ctx->argv = stage->argv;
+    ctx->argc = stage->argc;
+    ctx->argv_capacity = stage->argc + 1;
+    ctx->stdin_fd = -1;
+    ctx->stdout_fd = -1;
+    ctx->in_pipeline = 1;
+    ctx->child_envp = stage->envp;
+
+    run_prepared_command(ctx);
+    return ctx->exit_status;
+}
+
 /*
  * Helper function: Execute command in child process
  * REFACTORED per plan.md Phase 3
@@ -427,16 +941,29 @@ static void execute_in_child(ExecContext *ctx)
          * commands in a forked child, we can just call the function directly
          * and then _exit() to terminate the child.
          */
+        if (ctx->child_envp) {
+            environ = ctx->child_envp;
+        }
         int status = spec->run(ctx->argc, ctx->argv);
         fflush(stdout);
         fflush(stderr);
         _exit(status);
     } else {
         /* External command (ls, cat, grep, etc.) */
-        execvp(ctx->argv[0], ctx->argv);
-        perror(ctx->argv[0]);
-        _exit(127);
+        exec_child(ctx->argv, ctx->child_envp);
+    }
+}
+
+/*
+ * exit [N]: without N, keep the last command's status
+ */
+static int builtin_exit(ExecContext *ctx)
+{
+    ctx->should_exit = 1;
+    if (ctx->argc > 1) {
+        return atoi(ctx->argv[1]) & 0xff;
     }
+    return ctx->exit_status;
 }
 
 /*
@@ -471,14 +998,154 @@ static int builtin_help(ExecContext *ctx)
 
     printf("PicoBox BNFC Shell (Visitor Pattern - Refactored)\n");
     printf("Built-in commands:\n");
-    printf("  exit       - Exit the shell\n");
+    printf("  exit [N]   - Exit the shell\n");
     printf("  help       - Show this help message\n");
     printf("  cd [DIR]   - Change directory\n");
     printf("  export VAR[=VALUE] - Export variable to environment\n");
+    printf("  hash [-r] [NAME...] - Show, add, or forget remembered command paths\n");
+    printf("  set [-o|+o pipefail] - Show or change shell options\n");
+    printf("  jobs       - List background jobs (cmd &)\n");
+    printf("  wait [PID|%%N...] - Wait for background jobs\n");
+    printf("  time CMD   - Run CMD (or a pipeline) and report its resource usage\n");
+    printf("  echo [STRING...] - Print STRINGs (also a command)\n");
+    printf("  printf FORMAT [ARG...] - Print ARGs according to FORMAT (also a command)\n");
+
+    return EXIT_OK;
+}
+
+/*
+ * Print one remembered command for `hash`
+ */
+static void print_hash_entry(const char *name, const char *path, void *userdata)
+{
+    (void)userdata;
+    printf("%s\t%s\n", name, path);
+}
+
+/*
+ * Helper function: hash built-in
+ * Usage: hash            list remembered command paths
+ *        hash -r         forget all remembered paths
+ *        hash NAME...    look up NAME in PATH and remember it
+ */
+static int builtin_hash(ExecContext *ctx)
+{
+    int status = EXIT_OK;
+
+    if (ctx->argc < 2) {
+        path_cache_foreach(print_hash_entry, NULL);
+        return EXIT_OK;
+    }
+
+    for (int i = 1; i < ctx->argc; i++) {
+        if (strcmp(ctx->argv[i], "-r") == 0) {
+            path_cache_clear();
+        } else if (!path_cache_lookup(ctx->argv[i])) {
+            fprintf(stderr, "hash: %s: not found\n", ctx->argv[i]);
+            status = EXIT_ERROR;
+        }
+    }
+
+    return status;
+}
+
+/*
+ * Helper function: set built-in
+ * Usage: set -o            list options
+ *        set -o pipefail   pipeline fails if any stage fails
+ *        set +o pipefail   pipeline status is the last stage's (default)
+ */
+static int builtin_set(ExecContext *ctx)
+{
+    if (ctx->argc == 1 || (ctx->argc == 2 && strcmp(ctx->argv[1], "-o") == 0)) {
+        printf("pipefail\t%s\n", get_pipefail() ? "on" : "off");
+        return EXIT_OK;
+    }
+
+    if (ctx->argc == 3 && strcmp(ctx->argv[2], "pipefail") == 0) {
+        if (strcmp(ctx->argv[1], "-o") == 0) {
+            set_pipefail(1);
+            return EXIT_OK;
+        }
+        if (strcmp(ctx->argv[1], "+o") == 0) {
+            set_pipefail(0);
+            return EXIT_OK;
+        }
+    }
+
+    fprintf(stderr, "set: usage: set [-o|+o pipefail]\n");
+    return EXIT_ERROR;
+}
+
+/*
+ * Helper function: jobs built-in
+ * Lists background jobs; finished ones are listed once, then forgotten
+ */
+static int builtin_jobs(ExecContext *ctx)
+{
+    update_jobs(ctx);
+
+    for (int i = 0; i < ctx->job_count; i++) {
+        print_job(stdout, &ctx->jobs[i]);
+    }
+    remove_done_jobs(ctx);
 
     return EXIT_OK;
 }
 
+/*
+ * Find a job by PID or %N job number
+ */
+static bg_job_t *find_job(ExecContext *ctx, const char *arg)
+{
+    int by_id = (arg[0] == '%');
+    char *end;
+    long n = strtol(arg + by_id, &end, 10);
+
+    if (end == arg + by_id || *end != '\0') {
+        return NULL;
+    }
+
+    for (int i = 0; i < ctx->job_count; i++) {
+        if (by_id ? ctx->jobs[i].id == n : ctx->jobs[i].pid == (pid_t)n) {
+            return &ctx->jobs[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Helper function: wait built-in
+ * Usage: wait              wait for all background jobs, status 0
+ *        wait PID|%N...    wait for those jobs, status of the last one
+ */
+static int builtin_wait(ExecContext *ctx)
+{
+    int status = EXIT_OK;
+
+    if (ctx->argc < 2) {
+        for (int i = 0; i < ctx->job_count; i++) {
+            poll_job(&ctx->jobs[i], 1);
+        }
+        remove_done_jobs(ctx);
+        return EXIT_OK;
+    }
+
+    for (int i = 1; i < ctx->argc; i++) {
+        bg_job_t *job = find_job(ctx, ctx->argv[i]);
+        if (!job) {
+            fprintf(stderr, "wait: %s: no such job\n", ctx->argv[i]);
+            status = 127;
+            continue;
+        }
+        poll_job(job, 1);
+        status = job->status;
+    }
+    remove_done_jobs(ctx);
+
+    return status;
+}
+
 /*
  * Helper function: export built-in
  * Export shell variables to environment
@@ -510,12 +1177,15 @@ static int builtin_export(ExecContext *ctx)
                 return EXIT_ERROR;
             }
 
-            /* Set in environment */
-            if (setenv(name, value, 1) != 0) {
-                perror("export");
+            /* Set in environment (and in the envp given to children) */
+            if (env_export(name, value) != 0) {
+                fprintf(stderr, "export: cannot export %s\n", name);
                 *equals = '=';
                 return EXIT_ERROR;
             }
+            if (strcmp(name, "PATH") == 0) {
+                path_cache_clear();
+            }
             *equals = '=';
         } else {
             /* export VAR (value from shell variables) */
@@ -525,66 +1195,249 @@ static int builtin_export(ExecContext *ctx)
                 return EXIT_ERROR;
             }
 
-            if (setenv(arg, value, 1) != 0) {
-                perror("export");
+            if (env_export(arg, value) != 0) {
+                fprintf(stderr, "export: cannot export %s\n", arg);
                 return EXIT_ERROR;
             }
+            if (strcmp(arg, "PATH") == 0) {
+                path_cache_clear();
+            }
         }
     }
 
-    return EXIT_OK;
+    return EXIT_OK;
+}
+
+/*
+ * Helper function: echo built-in
+ * Plain words are written straight out; anything that looks like an
+ * option goes to the echo command, which parses them
+ */
+static int builtin_echo(ExecContext *ctx)
+{
+    pb_out_t out;
+
+    for (int i = 1; i < ctx->argc; i++) {
+        if (ctx->argv[i][0] == '-' && ctx->argv[i][1] != '\0') {
+            const cmd_spec_t *spec = find_command("echo");
+
+            return spec ? spec->run(ctx->argc, ctx->argv) : EXIT_ERROR;
+        }
+    }
+
+    if (pb_out_init(&out, stdout) != 0) {
+        perror("echo");
+        return EXIT_ERROR;
+    }
+    for (int i = 1; i < ctx->argc; i++) {
+        if (i > 1) {
+            pb_out_putc(&out, ' ');
+        }
+        pb_out_str(&out, ctx->argv[i]);
+    }
+    pb_out_putc(&out, '\n');
+    if (pb_out_close(&out) != 0) {
+        perror("echo");
+        return EXIT_ERROR;
+    }
+    return EXIT_OK;
+}
+
+/*
+ * Helper function: printf built-in (the format is compiled once and
+ * cached, see printf_format.h)
+ */
+static int builtin_printf(ExecContext *ctx)
+{
+    if (ctx->argc == 2 && strcmp(ctx->argv[1], "--help") == 0) {
+        const cmd_spec_t *spec = find_command("printf");
+
+        if (spec) {
+            spec->print_usage(stdout);
+            return EXIT_OK;
+        }
+    }
+    return printf_format_run(ctx->argc, ctx->argv, stdout);
+}
+
+/* Built-ins that run in the shell process */
+typedef int (*builtin_fn)(ExecContext *ctx);
+
+/*
+ * output_only: the builtin only writes to stdout and cannot change the
+ * shell, so $(...) may run it in-process too. echo and printf are also
+ * registry commands, which a pipeline stage runs instead.
+ */
+static const struct {
+    const char *name;
+    builtin_fn run;
+    int output_only;
+} shell_builtins[] = {
+    { "cd",     builtin_cd,     0 },
+    { "echo",   builtin_echo,   1 },
+    { "exit",   builtin_exit,   0 },
+    { "export", builtin_export, 0 },
+    { "hash",   builtin_hash,   0 },
+    { "help",   builtin_help,   0 },
+    { "jobs",   builtin_jobs,   0 },
+    { "printf", builtin_printf, 1 },
+    { "set",    builtin_set,    0 },
+    { "wait",   builtin_wait,   0 },
+};
+
+/*
+ * Look up a shell built-in
+ * output_only: if not NULL, set to the entry's output_only
+ * Returns: its function, or NULL if name is not a built-in
+ */
+static builtin_fn find_builtin(const char *name, int *output_only)
+{
+    for (size_t i = 0; i < sizeof(shell_builtins) / sizeof(shell_builtins[0]); i++) {
+        if (strcmp(shell_builtins[i].name, name) == 0) {
+            if (output_only) {
+                *output_only = shell_builtins[i].output_only;
+            }
+            return shell_builtins[i].run;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Check if a word is a shell variable assignment (VAR=VALUE)
+ */
+static int is_assignment(const char *word)
+{
+    /* NAME=..., so d=/tmp is one but /path/to/file=val is not */
+    if (!isalpha((unsigned char)*word) && *word != '_') {
+        return 0;
+    }
+    while (isalnum((unsigned char)*word) || *word == '_') {
+        word++;
+    }
+    return *word == '=';
+}
+
+/*
+ * Move leading NAME=VALUE words off argv into ctx->assigns
+ *
+ * Only done when a command follows them (FOO=bar cmd): the words then
+ * set the command's environment instead of shell variables. A line of
+ * nothing but assignments is left alone.
+ *
+ * Returns: 0 on success, -1 on allocation failure
+ */
+static int take_assignments(ExecContext *ctx)
+{
+    int count = 0;
+
+    while (count < ctx->argc && is_assignment(ctx->argv[count]) &&
+           (isalpha((unsigned char)ctx->argv[count][0]) || ctx->argv[count][0] == '_')) {
+        count++;
+    }
+
+    if (count == 0 || count == ctx->argc) {
+        return 0;
+    }
+
+    ctx->assigns = malloc(count * sizeof(char *));
+    if (!ctx->assigns) {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(ctx->assigns, ctx->argv, count * sizeof(char *));
+    ctx->assign_count = count;
+
+    ctx->argc -= count;
+    memmove(ctx->argv, ctx->argv + count, (ctx->argc + 1) * sizeof(char *));
+    return 0;
 }
 
 /*
- * Visit SimpleCommand - REFACTORED per plan.md Phase 3
+ * Build argv and open redirections for a SimpleCommand
  *
- * KEY INSIGHT: This function has TWO MODES:
- * 1. STANDALONE mode (in_pipeline == 0): We fork here
- * 2. PIPELINE mode (in_pipeline == 1): Already forked by visitPipeline, just exec
+ * After this, ctx->argv/argc hold the expanded words and
+ * ctx->stdin_fd/stdout_fd hold any opened redirection targets.
  *
- * This is the correct visitor pattern approach.
+ * Returns: 0 if there is a command to run, -1 on error or empty command
  */
-void visitSimpleCommand(SimpleCommand p, ExecContext *ctx)
+static int prepare_simple_command(SimpleCommand p, ExecContext *ctx)
 {
-    switch(p->kind)
-    {
-    case is_Cmd:
-        /* Reset command state for new command */
-        exec_context_reset_command(ctx);
+    /* Reset command state for new command */
+    exec_context_reset_command(ctx);
+    ctx->has_error = 0;
 
-        /* Build argv by visiting word nodes */
-        visitWord(p->u.cmd_.word_, ctx); // uses command data structure to build ctx
-        visitListWord(p->u.cmd_.listword_, ctx);
+    /* Build argv by visiting word nodes */
+    visitWord(p->u.cmd_.word_, ctx); // uses command data structure to build ctx
+    visitListWord(p->u.cmd_.listword_, ctx);
 
-        /* Visit redirections (opens files, stores fds in context) */
+    /* Visit redirections (opens files, stores fds in context) */
+    if (p->u.cmd_.listredirection_) {
+        TRACE_BEGIN("redirect", NULL);
         visitListRedirection(p->u.cmd_.listredirection_, ctx); // stores fds in ctx for redir applying later
+        TRACE_END("redirect");
+    }
 
-        /* Check for errors during tree walk */
-        if (ctx->has_error) {
-            break;
-        }
+    /* Check for errors during tree walk */
+    if (ctx->has_error) {
+        return -1;
+    }
 
-        /* NULL-terminate argv */
-        if (ctx->argc < ctx->argv_capacity) {
-            ctx->argv[ctx->argc] = NULL;
-        }
+    /* NULL-terminate argv */
+    if (ctx->argc < ctx->argv_capacity) {
+        ctx->argv[ctx->argc] = NULL;
+    }
 
-        /* Skip if no command */
-        if (ctx->argc == 0 || !ctx->argv[0]) {
-            break;
-        }
+    /* time CMD: the command is what follows the keyword */
+    if (ctx->strip_time && ctx->argc > 0) {
+        ctx->strip_time = 0;
+        free(ctx->argv[0]);
+        memmove(ctx->argv, ctx->argv + 1, ctx->argc * sizeof(char *));
+        ctx->argc--;
+    }
+
+    /* Skip if no command */
+    if (ctx->argc == 0 || !ctx->argv[0]) {
+        return -1;
+    }
+
+    if (take_assignments(ctx) < 0) {
+        ctx->has_error = 1;
+        return -1;
+    }
 
-        /* Handle shell variable assignment (VAR=VALUE) */
-        char *assign_eq = strchr(ctx->argv[0], '=');
-        if (assign_eq && !strchr(ctx->argv[0], '/')) {  /* Ensure it's not a path like /path/to/file=val */
+    return 0;
+}
+
+/*
+ * Run a command prepared by prepare_simple_command()
+ *
+ * KEY INSIGHT: This function has TWO MODES:
+ * 1. STANDALONE mode (in_pipeline == 0): We fork here
+ * 2. PIPELINE mode (in_pipeline == 1): Already forked by run_pipeline(), just exec
+ */
+static void run_prepared_command(ExecContext *ctx)
+{
+    /* Handle shell variable assignment (VAR=VALUE [VAR=VALUE...]) */
+    if (is_assignment(ctx->argv[0])) {
+        ctx->exit_status = EXIT_OK;
+        for (int i = 0; i < ctx->argc && is_assignment(ctx->argv[i]); i++) {
+            char *assign_eq = strchr(ctx->argv[i], '=');
             *assign_eq = '\0';
-            char *name = ctx->argv[0];
+            char *name = ctx->argv[i];
             char *value = assign_eq + 1;
 
             /* Variable names must start with letter or underscore */
             if ((isalpha((unsigned char)name[0]) || name[0] == '_')) {
                 if (var_table_set(ctx->variables, name, value) == 0) {
-                    ctx->exit_status = EXIT_OK;
+                    /* An exported variable changes for children too */
+                    if (env_is_exported(name) && env_export(name, value) != 0) {
+                        ctx->exit_status = EXIT_ERROR;
+                    }
+                    /* Remembered command paths are only valid for the old PATH */
+                    if (strcmp(name, "PATH") == 0) {
+                        path_cache_clear();
+                    }
                 } else {
                     fprintf(stderr, "Failed to set variable %s\n", name);
                     ctx->exit_status = EXIT_ERROR;
@@ -594,106 +1447,175 @@ void visitSimpleCommand(SimpleCommand p, ExecContext *ctx)
                 ctx->exit_status = EXIT_ERROR;
             }
             *assign_eq = '=';  /* Restore for cleanup */
-            break;  /* Don't execute, just set the variable */
         }
+        return;  /* Don't execute, just set the variables */
+    }
 
-        /* === EXECUTION LOGIC === */
+    /* === EXECUTION LOGIC === */
 
-        if (ctx->in_pipeline) {
-            /* MODE 1: We're in a pipeline - already forked in visitPipeline()
-             * Just apply redirections and exec */
+    if (ctx->in_pipeline) {
+        /* MODE 1: We're in a pipeline - already forked by run_pipeline()
+         * Just apply redirections and exec */
 
-            /* Apply file redirections */
-            if (ctx->stdin_fd != -1) {
-                dup2(ctx->stdin_fd, STDIN_FILENO);
-                close(ctx->stdin_fd);
-            }
+        /* Apply file redirections */
+        if (ctx->stdin_fd != -1) {
+            dup2(ctx->stdin_fd, STDIN_FILENO);
+            close(ctx->stdin_fd);
+        }
 
-            if (ctx->stdout_fd != -1) {
-                dup2(ctx->stdout_fd, STDOUT_FILENO);
-                close(ctx->stdout_fd);
-            }
+        if (ctx->stdout_fd != -1) {
+            dup2(ctx->stdout_fd, STDOUT_FILENO);
+            close(ctx->stdout_fd);
+        }
 
-            /* Execute command (will not return) */
-            execute_in_child(ctx);
+        /* Execute command (will not return) */
+        execute_in_child(ctx);
 
-            /* Should never reach here */
-            _exit(127);
+        /* Should never reach here */
+        _exit(127);
+    }
+
+    /* MODE 2: Standalone command - need to fork here */
+
+    /* Built-ins run in the shell process; their redirections apply
+     * only while they run (redirection scope, no fork) */
+    builtin_fn builtin = find_builtin(ctx->argv[0], NULL);
+    if (builtin) {
+        redir_scope_t scope;
 
+        if (redir_scope_apply(&scope, ctx->stdin_fd, ctx->stdout_fd) < 0) {
+            ctx->exit_status = EXIT_ERROR;
         } else {
-            /* MODE 2: Standalone command - need to fork here */
+            ctx->exit_status = builtin(ctx);
+            redir_scope_restore(&scope);
+        }
 
-            /* Check for built-ins that MUST run in parent */
-            if (strcmp(ctx->argv[0], "exit") == 0) {
-                ctx->should_exit = 1;
-                ctx->exit_status = EXIT_OK;
-                break;
-            } else if (strcmp(ctx->argv[0], "cd") == 0) {
-                ctx->exit_status = builtin_cd(ctx);
-                break;
-            } else if (strcmp(ctx->argv[0], "help") == 0) {
-                ctx->exit_status = builtin_help(ctx);
-                break;
-            } else if (strcmp(ctx->argv[0], "export") == 0) {
-                ctx->exit_status = builtin_export(ctx);
-                break;
-            }
+        if (ctx->stdin_fd != -1) {
+            close(ctx->stdin_fd);
+            ctx->stdin_fd = -1;
+        }
+        if (ctx->stdout_fd != -1) {
+            close(ctx->stdout_fd);
+            ctx->stdout_fd = -1;
+        }
+        return;
+    }
 
-            /* Fork for all other commands (registry + external) */
-            pid_t pid = fork();
+    /* Registry commands run in the shell process when safe -
+     * no fork/exec, redirected stdout is swapped in and restored */
+    const cmd_spec_t *spec = find_command(ctx->argv[0]);
+    if (spec && ctx->assign_count == 0 && can_run_inprocess(spec, ctx->stdin_fd != -1)) {
+        ctx->exit_status = exec_registry_inprocess(spec, ctx->argc, ctx->argv,
+                                                   ctx->stdout_fd);
+        if (ctx->stdout_fd != -1) {
+            close(ctx->stdout_fd);
+            ctx->stdout_fd = -1;
+        }
+        return;
+    }
 
-            if (pid < 0) {
-                perror("fork");
-                ctx->exit_status = EXIT_ERROR;
-                break;
-            }
+    pid_t pid;
+    char **envp = NULL;
 
-            if (pid == 0) {
-                /* === CHILD PROCESS === */
+    /* FOO=bar cmd: the exported variables plus this command's prefixes */
+    if (ctx->assign_count > 0) {
+        envp = env_vector_with(ctx->assigns, ctx->assign_count);
+        if (!envp) {
+            ctx->exit_status = EXIT_ERROR;
+            return;
+        }
+    }
 
-                /* Apply file redirections */
-                if (ctx->stdin_fd != -1) {
-                    dup2(ctx->stdin_fd, STDIN_FILENO);
-                    close(ctx->stdin_fd);
-                }
+    /* Our buffered output comes before the child's */
+    fflush(stdout);
 
-                if (ctx->stdout_fd != -1) {
-                    dup2(ctx->stdout_fd, STDOUT_FILENO);
-                    close(ctx->stdout_fd);
-                }
+    if (spec == NULL && get_spawn_backend() != SPAWN_BACKEND_FORK) {
+        /* External command: posix_spawnp() (or the zygote) with the redirects as file actions */
+        pid = spawn_external(ctx->argv, envp, ctx->stdin_fd, ctx->stdout_fd, NULL, 0);
+        free(envp);
+        if (pid < 0) {
+            ctx->exit_status = 127;
+            return;
+        }
+    } else {
+        /* Resolve before forking so the PATH cache keeps the result */
+        if (spec == NULL) {
+            path_cache_lookup(ctx->argv[0]);
+        }
 
-                /* Execute command (will not return) */
-                execute_in_child(ctx);
+        /* Fork for fork-only registry commands (or PICOBOX_SPAWN=fork) */
+        TRACE_BEGIN("fork", ctx->argv[0]);
+        pid = fork();
+        if (pid != 0) {
+            TRACE_END("fork");
+        }
 
-                /* Should never reach here */
-                _exit(127);
-            }
+        if (pid < 0) {
+            perror("fork");
+            free(envp);
+            ctx->exit_status = EXIT_ERROR;
+            return;
+        }
 
-            /* === PARENT PROCESS === */
+        if (pid == 0) {
+            /* === CHILD PROCESS === */
+            ctx->child_envp = envp;
 
-            /* Close file descriptors in parent */
+            /* Apply file redirections */
             if (ctx->stdin_fd != -1) {
+                dup2(ctx->stdin_fd, STDIN_FILENO);
                 close(ctx->stdin_fd);
-                ctx->stdin_fd = -1;
             }
+
             if (ctx->stdout_fd != -1) {
+                dup2(ctx->stdout_fd, STDOUT_FILENO);
                 close(ctx->stdout_fd);
-                ctx->stdout_fd = -1;
             }
 
-            /* Wait for child */
-            int status;
-            if (waitpid(pid, &status, 0) >= 0) {
-                if (WIFEXITED(status))
-                    ctx->exit_status = WEXITSTATUS(status);
-                else if (WIFSIGNALED(status))
-                    ctx->exit_status = 128 + WTERMSIG(status);
-            } else {
-                perror("waitpid");
-                ctx->exit_status = EXIT_ERROR;
-            }
+            /* Execute command (will not return) */
+            execute_in_child(ctx);
+
+            /* Should never reach here */
+            _exit(127);
         }
+        free(envp);
+    }
+
+    /* === PARENT PROCESS === */
+
+    /* Close file descriptors in parent */
+    if (ctx->stdin_fd != -1) {
+        close(ctx->stdin_fd);
+        ctx->stdin_fd = -1;
+    }
+    if (ctx->stdout_fd != -1) {
+        close(ctx->stdout_fd);
+        ctx->stdout_fd = -1;
+    }
+
+    /* Wait for child */
+    ctx->exit_status = wait_for_child(pid, ctx->argv[0]);
+}
 
+/*
+ * Visit SimpleCommand - REFACTORED per plan.md Phase 3
+ *
+ * Split into two steps so visitPipeline() can prepare every stage in the
+ * shell and run_stage_in_child() can run it in the stage's child:
+ *   prepare_simple_command() - expand words, open redirections
+ *   run_prepared_command()   - assignment, builtin, in-process, fork/spawn
+ */
+void visitSimpleCommand(SimpleCommand p, ExecContext *ctx)
+{
+    switch(p->kind)
+    {
+    case is_Cmd:
+        if (prepare_simple_command(p, ctx) == 0) {
+            run_prepared_command(ctx);
+        } else if (ctx->has_error) {
+            /* A redirection could not be opened: the command does not run */
+            ctx->exit_status = EXIT_ERROR;
+        }
         break;
 
     default:
@@ -710,6 +1632,9 @@ void visitSimpleCommand(SimpleCommand p, ExecContext *ctx)
  * - Open file immediately at the node level
  * - Store FD in context (not filename!)
  * - dup2() happens later in child process
+ * - O_CLOEXEC: other pipeline stages must not inherit this stage's files
+ * - Here-documents and here-strings are expanded like words (no globbing)
+ *   and read from a memory file, seekable like the files < opens
  */
 void visitRedirection(Redirection p, ExecContext *ctx)
 {
@@ -719,7 +1644,7 @@ void visitRedirection(Redirection p, ExecContext *ctx)
     {
     case is_RedirIn:
         /* Input redirection: < file */
-        fd = open(p->u.redirIn_.word_, O_RDONLY);
+        fd = open(p->u.redirIn_.word_, O_RDONLY | O_CLOEXEC);
         if (fd < 0) {
             perror(p->u.redirIn_.word_);
             ctx->has_error = 1;
@@ -734,7 +1659,7 @@ void visitRedirection(Redirection p, ExecContext *ctx)
 
     case is_RedirOut:
         /* Output redirection: > file (truncate) */
-        fd = open(p->u.redirOut_.word_, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        fd = open(p->u.redirOut_.word_, O_WRONLY | O_CREAT | O_CLOEXEC | O_TRUNC, 0644);
         if (fd < 0) {
             perror(p->u.redirOut_.word_);
             ctx->has_error = 1;
@@ -748,7 +1673,7 @@ void visitRedirection(Redirection p, ExecContext *ctx)
 
     case is_RedirAppend:
         /* Append redirection: >> file */
-        fd = open(p->u.redirAppend_.word_, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        fd = open(p->u.redirAppend_.word_, O_WRONLY | O_CREAT | O_CLOEXEC | O_APPEND, 0644);
         if (fd < 0) {
             perror(p->u.redirAppend_.word_);
             ctx->has_error = 1;
@@ -760,6 +1685,31 @@ void visitRedirection(Redirection p, ExecContext *ctx)
         ctx->stdout_fd = fd;
         break;
 
+    case is_RedirHereDoc:
+    case is_RedirHereStr: {
+        /* Here-document: <<EOF (its text), here-string: <<< word (and a newline) */
+        int here_str = p->kind == is_RedirHereStr;
+        char *text = expand_variables(here_str ? p->u.redirHereStr_.word_
+                                               : p->u.redirHereDoc_.word_, ctx);
+
+        if (!text) {
+            perror("expand_variables");
+            ctx->has_error = 1;
+            return;
+        }
+        fd = open_here_document(text, strlen(text), here_str);
+        free(text);
+        if (fd < 0) {
+            ctx->has_error = 1;
+            return;
+        }
+        if (ctx->stdin_fd != -1) {
+            close(ctx->stdin_fd);
+        }
+        ctx->stdin_fd = fd;
+        break;
+    }
+
     default:
         fprintf(stderr, "Error: bad kind field when visiting Redirection!\n");
         exit(1);
@@ -776,6 +1726,9 @@ void visitListCommand(ListCommand listcommand, ExecContext *ctx)
     {
         visitCommand(listcommand->command_, ctx);
 
+        /* The next command may see a changed directory: list it again */
+        glob_cache_reset();
+
         /* Check if shell should exit */
         if (ctx->should_exit) {
             break;
@@ -831,25 +1784,221 @@ void visitListRedirection(ListRedirection listredirection, ExecContext *ctx)
 }
 
 /*
- * Expand shell variables in a word
- * Supports: $VAR, $$, $?, $0
- * Returns: newly allocated string with expansions (caller must free)
+ * Can a $(...) line run in the shell process?
+ * Only a single simple command that cannot change the shell: not a
+ * builtin like cd, exit or export (echo and printf are fine), or an
+ * assignment. Its name must be
+ * plain text, since it is checked before expansion.
+ */
+static int substitution_in_shell(Input tree)
+{
+    ListCommand list = tree->u.startInput_.listcommand_;
+    int output_only = 1;
+    Word name;
+
+    if (!list || list->listcommand_ || list->command_->kind != is_SimpleCmd) {
+        return 0;
+    }
+    name = list->command_->u.simpleCmd_.simplecommand_->u.cmd_.word_;
+    if (strchr(name, '$') != NULL || strchr(name, '=') != NULL) {
+        return 0;
+    }
+    find_builtin(name, &output_only);
+    return output_only;
+}
+
+/*
+ * Run a simple command in the shell process, leaving the command the
+ * caller is still preparing (argv, assignments, redirections) as it was
+ */
+static void run_nested_command(SimpleCommand p, ExecContext *ctx)
+{
+    char **argv = ctx->argv;
+    int argc = ctx->argc;
+    int argv_capacity = ctx->argv_capacity;
+    char **assigns = ctx->assigns;
+    int assign_count = ctx->assign_count;
+    int stdin_fd = ctx->stdin_fd;
+    int stdout_fd = ctx->stdout_fd;
+    int has_error = ctx->has_error;
+    int strip_time = ctx->strip_time;
+
+    ctx->argv_capacity = 16;
+    ctx->argv = malloc(ctx->argv_capacity * sizeof(char *));
+    if (!ctx->argv) {
+        perror("malloc");
+        exit(1);
+    }
+    ctx->argc = 0;
+    ctx->assigns = NULL;
+    ctx->assign_count = 0;
+    ctx->stdin_fd = -1;
+    ctx->stdout_fd = -1;
+    ctx->strip_time = 0;
+
+    visitSimpleCommand(p, ctx);
+
+    exec_context_reset_command(ctx);
+    free(ctx->argv);
+    ctx->argv = argv;
+    ctx->argc = argc;
+    ctx->argv_capacity = argv_capacity;
+    ctx->assigns = assigns;
+    ctx->assign_count = assign_count;
+    ctx->stdin_fd = stdin_fd;
+    ctx->stdout_fd = stdout_fd;
+    ctx->has_error = has_error;
+    ctx->strip_time = strip_time;
+}
+
+/*
+ * $(line) - run line with its output captured
+ *
+ * The output goes to a memory file rather than a pipe, so nobody has to
+ * read it while the command runs, and a registry command can run in the
+ * shell itself (no fork) with stdout swapped for the file. An external
+ * command is spawned with the file as its stdout. Anything that could
+ * change the shell, or is more than one simple command, runs in a
+ * forked subshell.
+ *
+ * Returns: the output without trailing newlines (caller frees), or NULL
+ */
+static char *command_substitution(const char *line, ExecContext *ctx)
+{
+    Input tree = fast_parse_line(line);
+    redir_scope_t scope;
+    struct stat st;
+    char *output;
+    size_t len = 0;
+    int fd;
+
+    if (!tree) {
+        fprintf(stderr, "Parse error: invalid syntax in $(%s)\n", line);
+        return strdup("");
+    }
+    fd = open_memory_file("picobox-subst");
+    if (fd < 0) {
+        perror("$(...)");
+        return strdup("");
+    }
+
+    TRACE_BEGIN("substitution", line);
+    if (substitution_in_shell(tree)) {
+        if (redir_scope_apply(&scope, -1, fd) == 0) {
+            run_nested_command(tree->u.startInput_.listcommand_->command_->u.simpleCmd_.simplecommand_, ctx);
+            redir_scope_restore(&scope);
+        }
+    } else {
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid == 0) {
+            /* === SUBSHELL === */
+            dup2(fd, STDOUT_FILENO);
+            reaper_forget_all();
+            ctx->job_count = 0;
+            ctx->interactive = 0;
+            visitInput(tree, ctx);
+            fflush(stdout);
+            fflush(stderr);
+            _exit(ctx->exit_status);
+        }
+        if (pid < 0) {
+            perror("fork");
+        } else {
+            ctx->exit_status = wait_for_child(pid, "$(...)");
+        }
+    }
+    TRACE_END("substitution");
+
+    /* Read back what was written */
+    output = NULL;
+    if (fstat(fd, &st) == 0) {
+        output = malloc((size_t)st.st_size + 1);
+    }
+    if (output) {
+        ssize_t n;
+        while (len < (size_t)st.st_size &&
+               (n = pread(fd, output + len, (size_t)st.st_size - len, (off_t)len)) > 0) {
+            len += (size_t)n;
+        }
+        while (len > 0 && output[len - 1] == '\n') {
+            len--;
+        }
+        output[len] = '\0';
+    }
+    close(fd);
+    return output;
+}
+
+/* The ) that closes the ( at open, or NULL */
+static const char *matching_paren(const char *open)
+{
+    int depth = 0;
+
+    for (const char *p = open; *p; p++) {
+        if (*p == '(') {
+            depth++;
+        } else if (*p == ')' && --depth == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Append len bytes of text to the expansion in *result, growing it
+ * Returns: 0, or -1 if out of memory
+ */
+static int expand_append(char **result, size_t *len, size_t *cap, const char *text, size_t n)
+{
+    if (*len + n + 1 > *cap) {
+        size_t bigger = *cap * 2;
+        char *grown;
+
+        while (bigger < *len + n + 1) {
+            bigger *= 2;
+        }
+        grown = realloc(*result, bigger);
+        if (!grown) {
+            return -1;
+        }
+        *result = grown;
+        *cap = bigger;
+    }
+    memcpy(*result + *len, text, n);
+    *len += n;
+    return 0;
+}
+
+/*
+ * Expand shell variables in a word (or a here-document: any length)
+ * Supports: $VAR, $$, $?, $!, $0, $(command)
+ * Returns: newly allocated string with expansions (caller must free),
+ *          or NULL if out of memory
  */
 static char *expand_variables(const char *word, ExecContext *ctx)
 {
-    char *result = malloc(4096);
+    size_t cap = strlen(word) + 64;
+    size_t len = 0;
+    char *result = malloc(cap);
+    const char *src = word;
+    char num[32];
+    int failed = 0;
+
     if (!result) {
-        perror("malloc");
         return NULL;
     }
 
-    char *dst = result;
-    const char *src = word;
-    const size_t max_len = 4095;
+#define APPEND(text, n) (failed |= expand_append(&result, &len, &cap, (text), (n)))
+    while (*src && !failed) {
+        const char *dollar = strchr(src, '$');
 
-    while (*src && (size_t)(dst - result) < max_len) {
-        if (*src != '$') {
-            *dst++ = *src++;
+        if (dollar != src) {
+            size_t n = dollar ? (size_t)(dollar - src) : strlen(src);
+
+            APPEND(src, n);
+            src += n;
             continue;
         }
 
@@ -857,28 +2006,58 @@ static char *expand_variables(const char *word, ExecContext *ctx)
 
         /* $$ - process ID */
         if (*src == '$') {
-            dst += snprintf(dst, max_len - (dst - result), "%d", getpid());
+            APPEND(num, (size_t)snprintf(num, sizeof(num), "%d", getpid()));
             src++;
             continue;
         }
 
         /* $? - last exit status */
         if (*src == '?') {
-            dst += snprintf(dst, max_len - (dst - result), "%d", ctx->exit_status);
+            APPEND(num, (size_t)snprintf(num, sizeof(num), "%d", ctx->exit_status));
+            src++;
+            continue;
+        }
+
+        /* $! - PID of the last background job */
+        if (*src == '!') {
+            if (ctx->last_bg_pid > 0) {
+                APPEND(num, (size_t)snprintf(num, sizeof(num), "%d", (int)ctx->last_bg_pid));
+            }
             src++;
             continue;
         }
 
+        /* $(command) - its output */
+        if (*src == '(') {
+            const char *close = matching_paren(src);
+            char *line;
+            char *output;
+
+            if (!close) {
+                APPEND("$", 1);  /* Unbalanced, keep it as it is */
+                continue;
+            }
+            line = strndup(src + 1, (size_t)(close - src - 1));
+            output = line ? command_substitution(line, ctx) : NULL;
+            free(line);
+            if (output) {
+                APPEND(output, strlen(output));
+                free(output);
+            }
+            src = close + 1;
+            continue;
+        }
+
         /* $0 - shell name */
         if (*src == '0') {
-            dst += snprintf(dst, max_len - (dst - result), "%s", "picobox");
+            APPEND("picobox", 7);
             src++;
             continue;
         }
 
         /* Must be alphanumeric or _ to be a variable name */
         if (!isalnum((unsigned char)*src) && *src != '_') {
-            *dst++ = '$';  /* Not a variable, keep the $ */
+            APPEND("$", 1);  /* Not a variable, keep the $ */
             continue;
         }
 
@@ -905,42 +2084,89 @@ static char *expand_variables(const char *word, ExecContext *ctx)
         }
 
         /* Copy value into result */
-        size_t remaining = max_len - (size_t)(dst - result);
-        size_t value_len = strlen(value);
-        if (value_len > remaining) {
-            value_len = remaining;
-        }
-        memcpy(dst, value, value_len);
-        dst += value_len;
+        APPEND(value, strlen(value));
     }
+#undef APPEND
 
-    *dst = '\0';
+    if (failed) {
+        free(result);
+        return NULL;
+    }
+    result[len] = '\0';
     return result;
 }
 
 /*
- * Visit Word - adds word to argv with variable expansion
- * This is called for command name and each argument
+ * Are all the words so far NAME=VALUE assignments? (then a following
+ * assignment is one too, and its value is not globbed)
  */
-void visitWord(Word p, ExecContext *ctx)
+static int only_assignments(ExecContext *ctx)
 {
-    /* Grow argv if needed */
-    if (ctx->argc >= ctx->argv_capacity - 1) {  /* -1 for NULL terminator */
-        ctx->argv_capacity *= 2;
-        ctx->argv = realloc(ctx->argv, ctx->argv_capacity * sizeof(char *));
-        if (!ctx->argv) {
-            perror("realloc");
-            exit(1);
+    for (int i = 0; i < ctx->argc; i++) {
+        if (!is_assignment(ctx->argv[i])) {
+            return 0;
         }
     }
+    return 1;
+}
+
+/* Make room in argv for count more words and the NULL terminator */
+static void grow_argv(ExecContext *ctx, int count)
+{
+    if (ctx->argc + count < ctx->argv_capacity) {
+        return;
+    }
+    while (ctx->argc + count >= ctx->argv_capacity) {
+        ctx->argv_capacity *= 2;
+    }
+    ctx->argv = realloc(ctx->argv, ctx->argv_capacity * sizeof(char *));
+    if (!ctx->argv) {
+        perror("realloc");
+        exit(1);
+    }
+}
 
-    /* Expand variables and add to argv */
-    ctx->argv[ctx->argc] = expand_variables(p, ctx);
-    if (!ctx->argv[ctx->argc]) {
+/*
+ * Visit Word - adds word to argv with variable and glob expansion
+ * This is called for command name and each argument
+ */
+void visitWord(Word p, ExecContext *ctx)
+{
+    char **matches;
+    size_t count = 0;
+    char *word;
+
+    /* Expand variables */
+    TRACE_BEGIN("expand", p);
+    word = expand_variables(p, ctx);
+    TRACE_END("expand");
+    if (!word) {
         perror("expand_variables");
         exit(1);
     }
-    ctx->argc++;
+
+    /* Expand *, ? and [...]; a pattern that matches nothing stays as it is */
+    if (glob_has_magic(word) && !(is_assignment(word) && only_assignments(ctx))) {
+        TRACE_BEGIN("glob", word);
+        count = glob_expand(word, &matches);
+        TRACE_END("glob");
+    }
+    if (count == 0) {
+        grow_argv(ctx, 1);
+        ctx->argv[ctx->argc++] = word;
+        return;
+    }
+
+    free(word);
+    grow_argv(ctx, (int)count);
+    for (size_t i = 0; i < count; i++) {
+        ctx->argv[ctx->argc] = strdup(matches[i]);
+        if (!ctx->argv[ctx->argc]) {
+            perror("strdup");
+            exit(1);
+        }
+        ctx->argc++;
+    }
 }
 
 /* These visitor functions are not used in shell context */
@@ -7,6 +7,18 @@
 #include "Absyn.h"
 #include "../include/redirect_helpers.h"
 #include "../include/var_table.h"
+#include <sys/types.h>
+
+/* Background jobs (cmd &) the shell keeps track of */
+#define MAX_JOBS 64
+
+typedef struct bg_job {
+    int id;                /* Job number, shown as [N] */
+    pid_t pid;             /* Subshell running the command */
+    char *command;         /* Command text, for `jobs` */
+    int done;              /* Exited; status is valid */
+    int status;            /* Exit status (128+N if killed by signal N) */
+} bg_job_t;
 
 /*
  * Execution Context - holds state during AST traversal
@@ -14,39 +26,44 @@
  *
  * REFACTORED for proper visitor pattern (per plan.md):
  * - File descriptors stored directly (not filenames)
- * - Pipeline state tracked across visitor calls
- * - Process IDs tracked for waiting on children
+ * - Pipeline stages handed to run_pipeline() (src/pipe_helpers.c)
  */
 typedef struct exec_context {
     /* Current command being built */
     char **argv;           /* Argument array for current command */
     int argc;              /* Number of arguments */
     int argv_capacity;     /* Allocated capacity for argv */
+    char **assigns;        /* NAME=VALUE prefixes (FOO=bar cmd), environment
+                              for this command only */
+    int assign_count;
 
     /* Redirections - USE FILE DESCRIPTORS, not filenames */
     int stdin_fd;          /* -1 or actual fd for stdin */
     int stdout_fd;         /* -1 or actual fd for stdout */
     int stderr_fd;         /* -1 or actual fd for stderr (future) */
 
-    /* Pipeline state - tracks pipe FDs across visitor calls */
-    int in_pipeline;         /* Boolean: are we in a pipeline? */
-    int pipeline_position;   /* Which command (0, 1, 2...) */
-    int pipeline_total;      /* Total commands in pipeline */
-    int prev_pipe[2];        /* Pipe from previous command */
-    int curr_pipe[2];        /* Pipe to next command */
-
-    /* Process state - track child PIDs for waiting */
-    pid_t *pids;            /* Array of child PIDs */
-    int pid_count;          /* Number of children */
-    int pid_capacity;       /* Capacity of pids array */
+    /* Pipeline state */
+    int in_pipeline;         /* Boolean: running as a stage in a forked child? */
+    char **child_envp;       /* Environment for the command in this forked
+                                child (NULL = exported variables) */
 
     /* Execution result */
     int exit_status;       /* Last command exit status */
     int should_exit;       /* Set to 1 if shell should exit */
     int has_error;         /* Flag for errors during tree walk */
 
+    /* `time CMD` and PICOBOX_TIME_LOG (see time_stats.h) */
+    int timing;            /* Already measuring the current command */
+    int strip_time;        /* Next prepared command starts with the `time` word */
+
     /* Shell variables */
     var_table_t *variables; /* Hash table for shell variables */
+
+    /* Job table */
+    bg_job_t jobs[MAX_JOBS];
+    int job_count;
+    pid_t last_bg_pid;     /* $! */
+    int interactive;       /* Print [N] PID and Done notices */
 } ExecContext;
 
 /* Context management functions */
@@ -54,10 +71,14 @@ ExecContext *exec_context_new(void);
 void exec_context_free(ExecContext *ctx);
 void exec_context_reset_command(ExecContext *ctx);
 
+/* Reap finished background jobs; print "[N] Done" for them if interactive */
+void exec_context_notify_jobs(ExecContext *ctx);
+
 /* Visitor functions - these traverse the AST */
 void visitInput(Input p, ExecContext *ctx);
 void visitCommand(Command p, ExecContext *ctx);
 void visitAICommand(ListWord p, ExecContext *ctx);
+void visitBackground(Command p, ExecContext *ctx);
 void visitPipeline(Pipeline p, ExecContext *ctx);
 void visitSimpleCommand(SimpleCommand p, ExecContext *ctx);
 void visitRedirection(Redirection p, ExecContext *ctx);
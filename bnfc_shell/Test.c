@@ -62,7 +62,7 @@ int main(int argc, char ** argv)
       printf("[Linearized Tree]\n");
       printf("%s\n\n", printInput(parse_tree));
     }
-    free_Input(parse_tree);
+    ast_reset();
     return 0;
   }
   return 1;
@@ -391,13 +391,13 @@ static const YY_CHAR yy_ec[256] =
         1,    1,    1,    1,    1,    1,    1,    1,    2,    3,
         1,    2,    2,    1,    1,    1,    1,    1,    1,    1,
         1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
-        1,    2,    1,    1,    4,    5,    1,    1,    1,    1,
-        1,    6,    1,    1,    7,    8,    9,   10,   10,   10,
+        1,    2,    7,    1,    4,    5,    7,    1,    1,    1,
+        1,    7,    7,    1,    7,    8,    9,   10,   10,   10,
        10,   10,   10,   10,   10,   10,   10,   11,   12,   13,
        14,   15,   16,    1,   17,   18,   18,   18,   18,   18,
        18,   18,   19,   18,   18,   18,   18,   18,   18,   18,
        18,   18,   18,   18,   18,   18,   18,   18,   18,   18,
-        1,    1,    1,    1,   20,    1,   18,   18,   18,   18,
+        7,    7,    7,    1,   20,    1,   18,   18,   18,   18,
 
        18,   18,   18,   18,   18,   18,   18,   18,   18,   18,
        18,   18,   18,   18,   18,   18,   18,   18,   18,   18,
@@ -479,7 +479,6 @@ static const flex_int16_t yy_chk[77] =
 #line 1 "Shell.l"
 /* -*- c -*- File generated by the BNF Converter (bnfc 2.9.6.1). */
 /* Lexer definition for use with FLex */
-#define YY_NO_INPUT 1
 
 #line 16 "Shell.l"
 #include "Absyn.h"
@@ -487,6 +486,16 @@ static const flex_int16_t yy_chk[77] =
 
 #define initialize_lexer shell__initialize_lexer
 
+/* Word action: the rest of a word with $(...) in it (defined below) */
+static char *word_with_substitutions(const char *text, yyscan_t yyscanner);
+
+/* Word action after "<<": the here-document it ends (defined below) */
+static char *here_document(const char *delim, yyscan_t yyscanner);
+
+/* yyextra after "<<" and "<<-": the next Word is a here-document's delimiter */
+#define HERE_DOC ((void *)1)
+#define HERE_DOC_STRIP_TABS ((void *)2)
+
 static void update_loc(YYLTYPE* loc, char* text)
 {
   loc->first_line = loc->last_line;
@@ -858,7 +867,7 @@ do_action:	/* This label is used only to access EOF actions. */
 case 1:
 YY_RULE_SETUP
 #line 48 "Shell.l"
-return _LT;
+if (yyg->yy_hold_char == '<') { input(yyscanner); if (yyg->yy_hold_char == '<') { input(yyscanner); return _TLT; } yyextra = HERE_DOC; if (yyg->yy_hold_char == '-') { input(yyscanner); yyextra = HERE_DOC_STRIP_TABS; } return _DLT; } return _LT;
 	YY_BREAK
 case 2:
 YY_RULE_SETUP
@@ -878,7 +887,7 @@ return _SEMI;
 case 5:
 YY_RULE_SETUP
 #line 52 "Shell.l"
-return _BAR;
+if (yyg->yy_hold_char == '|') { input(yyscanner); return _DBAR; } return _BAR;
 	YY_BREAK
 case 6:
 YY_RULE_SETUP
@@ -915,7 +924,7 @@ case 12:
 /* rule 12 can match eol */
 YY_RULE_SETUP
 #line 60 "Shell.l"
-BEGIN INITIAL;
+BEGIN INITIAL; return _NL;
 	YY_BREAK
 case 13:
 YY_RULE_SETUP
@@ -937,7 +946,7 @@ case 16:
 /* rule 16 can match eol */
 YY_RULE_SETUP
 #line 64 "Shell.l"
-BEGIN INITIAL;
+BEGIN INITIAL; return _NL;
 	YY_BREAK
 case 17:
 YY_RULE_SETUP
@@ -953,18 +962,18 @@ YY_RULE_SETUP
 case 19:
 YY_RULE_SETUP
 #line 68 "Shell.l"
-yylval->_string = strdup(yytext); return T_Word;
+yylval->_string = yyextra ? here_document(yytext, yyscanner) : word_with_substitutions(yytext, yyscanner); if (!yylval->_string) return _ERROR_; return T_Word;
 	YY_BREAK
 case 20:
 /* rule 20 can match eol */
 YY_RULE_SETUP
 #line 69 "Shell.l"
-/* ignore white space. */;
+if (yytext[0] == '\n') return _NL; /* else ignore white space. */
 	YY_BREAK
 case 21:
 YY_RULE_SETUP
 #line 70 "Shell.l"
-return _ERROR_;
+if (yytext[0] == '&') { if (yyg->yy_hold_char == '&') { input(yyscanner); return _DAMP; } return _AMP; } return _ERROR_;
 	YY_BREAK
 case 22:
 YY_RULE_SETUP
@@ -2145,4 +2154,121 @@ yyscan_t initialize_lexer(FILE *inp)
   return scanner;
 }
 
+/* Is c one of the characters of the Word token? */
+static int is_word_char(int c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+         (c != 0 && strchr("$=?!%:-+./_~*[]\\", c) != NULL);
+}
+
+/*
+ * A word that ran into "$(": read on to the matching ")" (the command
+ * may hold blanks, |, ; and nested $(...)), then any word characters or
+ * further $(...) after it. The character after yytext is yy_hold_char,
+ * so peeking needs no unput().
+ * Returns: the whole word in the AST arena, or NULL if a ( is not closed
+ */
+static char *word_with_substitutions(const char *text, yyscan_t yyscanner)
+{
+  struct yyguts_t *yyg = (struct yyguts_t *)yyscanner;
+  size_t len = strlen(text);
+  size_t cap = len + 64;
+  char *buf, *word;
+
+  if (len == 0 || text[len - 1] != '$' || yyg->yy_hold_char != '(') {
+    return ast_strdup(text);
+  }
+  buf = malloc(cap);
+  if (!buf) return NULL;
+  memcpy(buf, text, len);
+
+  while (len > 0 && buf[len - 1] == '$' && yyg->yy_hold_char == '(') {
+    int depth = 0;
+    do {
+      int c = input(yyscanner);
+      if (c == 0 || c == EOF) {
+        free(buf);
+        return NULL;
+      }
+      if (len + 1 >= cap) {
+        char *grown = realloc(buf, cap * 2);
+        if (!grown) {
+          free(buf);
+          return NULL;
+        }
+        buf = grown;
+        cap *= 2;
+      }
+      buf[len++] = (char)c;
+      if (c == '(') depth++;
+      else if (c == ')') depth--;
+    } while (depth > 0);
+
+    while (is_word_char((unsigned char)yyg->yy_hold_char)) {
+      if (len + 1 >= cap) {
+        char *grown = realloc(buf, cap * 2);
+        if (!grown) {
+          free(buf);
+          return NULL;
+        }
+        buf = grown;
+        cap *= 2;
+      }
+      buf[len++] = (char)input(yyscanner);
+    }
+  }
+  buf[len] = '\0';
+  word = ast_strdup(buf);
+  free(buf);
+  return word;
+}
+
+/*
+ * The Word after "<<" is the delimiter. The here-document is the lines
+ * after the current one up to a line that is the delimiter (or the end
+ * of the input); it is taken out of the buffer, so the lexer goes on
+ * with the rest of this line and then the line after the delimiter. A
+ * second "<<" on the line takes the lines after the first one's. With
+ * "<<-", leading tabs are stripped from its lines and the delimiter's.
+ * The input must be in the buffer whole, as with psInput().
+ * Returns: the text, in the AST arena, or NULL if no line follows
+ */
+static char *here_document(const char *delim, yyscan_t yyscanner)
+{
+  struct yyguts_t *yyg = (struct yyguts_t *)yyscanner;
+  int strip = yyextra == HERE_DOC_STRIP_TABS;
+  size_t dlen = strlen(delim);
+  char *buf_end = YY_CURRENT_BUFFER_LVALUE->yy_ch_buf + yyg->yy_n_chars;
+  char *body, *line, *after, *text, *out;
+
+  yyextra = NULL;
+
+  /* yy_c_buf_p holds the NUL ending yytext; the byte is yy_hold_char */
+  *yyg->yy_c_buf_p = yyg->yy_hold_char;
+  body = memchr(yyg->yy_c_buf_p, '\n', (size_t)(buf_end - yyg->yy_c_buf_p));
+  *yyg->yy_c_buf_p = '\0';
+  if (!body) return NULL;
+  body++;
+
+  text = out = ast_alloc((size_t)(buf_end - body) + 1);
+  for (line = after = body; line < buf_end; line = after) {
+    char *end = memchr(line, '\n', (size_t)(buf_end - line));
+    if (!end) end = buf_end;
+    after = end < buf_end ? end + 1 : end;
+    if (strip) {
+      while (line < end && *line == '\t') line++;
+    }
+    if ((size_t)(end - line) == dlen && memcmp(line, delim, dlen) == 0) break;
+    memcpy(out, line, (size_t)(end - line));
+    out += end - line;
+    *out++ = '\n';
+  }
+  *out = '\0';
+
+  /* Close the gap, the two end-of-buffer NULs included */
+  memmove(body, after, (size_t)(buf_end - after) + 2);
+  yyg->yy_n_chars -= (int)(after - body);
+  YY_CURRENT_BUFFER_LVALUE->yy_n_chars = yyg->yy_n_chars;
+  return text;
+}
 
@@ -0,0 +1,72 @@
+#ifndef AI_CACHE_H
+#define AI_CACHE_H
+
+#include <stdint.h>
+#include "sha256.h"
+
+/*
+ * ai_cache.h - On-disk cache of AI answers
+ *
+ * AI and @-queries look their answer up here before going to the
+ * network. ~/.mysh/ai_cache.db is one fixed-size file that every shell
+ * maps shared and updates in place, under flock():
+ *
+ *   ai_cache_hdr_t
+ *   ai_cache_slot_t slots[AI_CACHE_SETS * AI_CACHE_WAYS]
+ *
+ * A query's key is the SHA-256 of the model, the system prompt, the
+ * query normalized (lower case, runs of blanks as one space, no blanks
+ * around it and no "?", "." or "!" after it) and the command catalog
+ * (every registered command's name and summary), so a new command,
+ * prompt or model never gets an answer cached for the old one. The
+ * key's first bytes pick a set; the key is in one of its ways or not
+ * cached.
+ *
+ * An answer older than AI_CACHE_TTL is not returned. Storing into a
+ * full set evicts its least recently used answer, so the file never
+ * grows. A file of another version or size is started afresh.
+ * Integers are in the host's byte order.
+ */
+
+#define AI_CACHE_MAGIC 0x43414250u      /* "PBAC" */
+#define AI_CACHE_VERSION 1
+
+#define AI_CACHE_SETS 128
+#define AI_CACHE_WAYS 8
+#define AI_CACHE_TEXT 1500              /* Longest answer kept, with its NUL */
+#define AI_CACHE_TTL (7 * 24 * 60 * 60) /* s */
+
+typedef struct ai_cache_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sets;
+    uint32_t ways;
+    uint64_t clock;             /* Ticks once per lookup or store */
+} ai_cache_hdr_t;
+
+typedef struct ai_cache_slot {
+    unsigned char key[SHA256_DIGEST_LEN];
+    int64_t stored;             /* time() it was stored; 0 if empty */
+    uint64_t used;              /* clock when last stored or returned */
+    char text[AI_CACHE_TEXT];
+} ai_cache_slot_t;
+
+typedef struct ai_cache_key {
+    unsigned char hash[SHA256_DIGEST_LEN];
+} ai_cache_key_t;
+
+/* The key of query, asked of model with system_prompt (either may be NULL) */
+void ai_cache_key(ai_cache_key_t *key, const char *model, const char *system_prompt,
+                  const char *query);
+
+/*
+ * Look key up
+ * Returns: a copy of its answer (caller free()s it), or NULL if it is
+ *          not cached, has expired, or the cache cannot be opened
+ */
+char *ai_cache_get(const ai_cache_key_t *key);
+
+/* Store text as key's answer (nothing happens if the cache cannot be opened) */
+void ai_cache_put(const ai_cache_key_t *key, const char *text);
+
+#endif /* AI_CACHE_H */
@@ -0,0 +1,39 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * arena.h - Bump allocator for short-lived objects
+ *
+ * Allocations are carved out of large blocks and never freed one by one;
+ * arena_reset() releases everything at once. The BNFC AST lives in one
+ * (see ast_alloc() in bnfc_shell/Absyn.h), reset after each input line.
+ */
+
+typedef struct arena arena_t;
+
+/* Create an arena that grabs memory block_size bytes at a time (0 = default) */
+arena_t *arena_create(size_t block_size);
+
+/* Free the arena and everything allocated from it */
+void arena_destroy(arena_t *a);
+
+/* Allocate size bytes, aligned for any type. Returns NULL if out of memory */
+void *arena_alloc(arena_t *a, size_t size);
+
+/* Copy a string into the arena. Returns NULL if out of memory */
+char *arena_strdup(arena_t *a, const char *s);
+
+/*
+ * Release every allocation at once
+ *
+ * The first block is kept for reuse, so an arena that stays within one
+ * block never calls malloc() again.
+ */
+void arena_reset(arena_t *a);
+
+/* Bytes handed out since the last reset */
+size_t arena_used(const arena_t *a);
+
+#endif /* ARENA_H */
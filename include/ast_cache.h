@@ -0,0 +1,36 @@
+#ifndef AST_CACHE_H
+#define AST_CACHE_H
+
+#include "../bnfc_shell/Absyn.h"
+
+/*
+ * ast_cache.h - Parsed-tree cache for repeated command lines
+ *
+ * Maps a command line to the Input tree the BNFC parser built for it, so
+ * lines replayed from loops, history or generated scripts skip the
+ * lexer and parser. Trees are immutable: variables are still expanded
+ * by the visitor at execution time, so a cached tree runs exactly like
+ * a fresh one.
+ */
+
+/*
+ * Parse a line, reusing the cached tree if the same line was seen before
+ *
+ * Lines are compared after trimming and collapsing blanks (words cannot
+ * contain spaces in this grammar, so that never changes the meaning).
+ * Returns: the tree (owned by the cache, valid until the next call), or
+ *          NULL on a syntax error. Syntax errors are not cached.
+ */
+Input ast_cache_parse(const char *line);
+
+/*
+ * Maximum number of cached trees (least recently used is evicted)
+ * PICOBOX_AST_CACHE=N sets the initial value; 0 disables the cache.
+ */
+int get_ast_cache_size(void);
+void set_ast_cache_size(int entries);
+
+/* Drop every cached tree */
+void ast_cache_clear(void);
+
+#endif /* AST_CACHE_H */
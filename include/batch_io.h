@@ -0,0 +1,47 @@
+#ifndef BATCH_IO_H
+#define BATCH_IO_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+/*
+ * batch_io.h - Filesystem calls made many at a time
+ *
+ * The tree commands make one stat or unlink per entry, each a blocking
+ * round trip; on storage far away (NFS, FUSE, network block devices)
+ * the round trip is the cost, and threads only hide as many of them as
+ * there are threads. A batch_io_t is an io_uring on which a whole run
+ * of calls is submitted with one system call and then reaped together.
+ *
+ * The ring is built only with PICOBOX_URING (make URING=1) on Linux,
+ * and only if the kernel lets it be set up; batch_io_create() returns
+ * NULL otherwise. Every call takes NULL too and then makes the calls
+ * one at a time, so callers need no second path. A ring is not to be
+ * shared between threads: callers keep one per worker.
+ */
+
+typedef struct batch_io batch_io_t;
+
+/*
+ * A ring for batches of up to a few hundred calls
+ * Returns: the ring, or NULL if there is none to be had
+ */
+batch_io_t *batch_io_create(void);
+
+void batch_io_destroy(batch_io_t *b);
+
+/*
+ * fstatat(dirfd, names[i], &st[i], flags) for i in [0, n), flags being
+ * 0 or AT_SYMLINK_NOFOLLOW; err[i] is 0 or the errno
+ */
+void batch_io_stat(batch_io_t *b, int dirfd, const char *const *names, size_t n, int flags,
+                   struct stat *st, int *err);
+
+/*
+ * unlinkat(dirfd, names[i], flags) for i in [0, n); err[i] is 0 or the
+ * errno
+ */
+void batch_io_unlink(batch_io_t *b, int dirfd, const char *const *names, size_t n, int flags,
+                     int *err);
+
+#endif /* BATCH_IO_H */
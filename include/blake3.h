@@ -0,0 +1,53 @@
+#ifndef BLAKE3_H
+#define BLAKE3_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * blake3.h - BLAKE3 hashing (default mode, 32-byte output)
+ *
+ * Input is split into 1 KiB chunks, each hashed on its own, and the
+ * chunk chaining values are combined pairwise up a binary tree. Any
+ * aligned run of 2^k chunks is a subtree whose value depends only on
+ * its bytes and position, so a large input can be hashed in pieces on
+ * several threads with blake3_subtree() and the pieces joined in order
+ * with blake3_push_subtree().
+ */
+
+#define BLAKE3_OUT_LEN 32
+#define BLAKE3_CHUNK_LEN 1024
+
+typedef struct blake3_hasher {
+    uint32_t cv_stack[54][8];   /* Completed subtrees, largest first */
+    size_t cv_stack_len;
+    uint32_t chunk_cv[8];       /* Current chunk */
+    uint64_t chunk_counter;
+    unsigned char buf[64];      /* Current block of the chunk */
+    size_t buf_len;
+    size_t blocks_compressed;
+} blake3_hasher_t;
+
+void blake3_init(blake3_hasher_t *h);
+
+void blake3_update(blake3_hasher_t *h, const void *data, size_t len);
+
+/* Write the hash; h must be initialized again before reuse */
+void blake3_final(blake3_hasher_t *h, unsigned char out[BLAKE3_OUT_LEN]);
+
+/*
+ * Chaining value of the subtree over data[0..len), which starts at
+ * chunk number chunk_offset. len must be a power of two number of
+ * chunks, and chunk_offset a multiple of that number.
+ */
+void blake3_subtree(const void *data, size_t len, uint64_t chunk_offset, uint32_t cv[8]);
+
+/*
+ * Add a subtree of nchunks chunks from blake3_subtree() as though its
+ * bytes had been passed to blake3_update(). h must be at a multiple of
+ * nchunks chunks, and at least one more byte must follow before
+ * blake3_final().
+ */
+void blake3_push_subtree(blake3_hasher_t *h, const uint32_t cv[8], uint64_t nchunks);
+
+#endif /* BLAKE3_H */
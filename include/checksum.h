@@ -0,0 +1,66 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdio.h>
+
+/*
+ * checksum.h - Hash files in parallel, and check them against manifests
+ *
+ * Shared by sha256sum, b3sum, crc32c and pkg. Files are hashed on a
+ * work-stealing pool (work_pool.h), one item per file; a large file
+ * hashed with BLAKE3 is further split into 1 MiB subtrees (blake3.h)
+ * hashed on any thread and joined in order by whichever finishes last.
+ * SHA-256 and CRC-32C are sequential, so one file is one item.
+ *
+ * Listing and manifest formats follow GNU coreutils: "HEX  NAME", one
+ * per line, where "HEX *NAME" (binary mode) is accepted when checking.
+ * Errors are reported on stderr as "prog: name: error".
+ */
+
+typedef enum {
+    CHECKSUM_SHA256,
+    CHECKSUM_BLAKE3,
+    CHECKSUM_CRC32C
+} checksum_kind_t;
+
+/* Longest digest in hex, with its terminator */
+#define CHECKSUM_HEX_MAX 65
+
+typedef struct checksum_result {
+    int err;                        /* errno value, or 0 */
+    char hex[CHECKSUM_HEX_MAX];     /* Lowercase hex digest when err is 0 */
+} checksum_result_t;
+
+/* Check flags */
+#define CHECKSUM_QUIET  0x01        /* Don't print a line for each file that is OK */
+#define CHECKSUM_STATUS 0x02        /* Print nothing; the return value tells */
+
+/*
+ * Hex digits in a digest of this kind
+ */
+size_t checksum_hex_len(checksum_kind_t kind);
+
+/*
+ * Hash names[0..n), relative to dirfd (or AT_FDCWD), into results[].
+ * "-" is read from in, on the calling thread.
+ */
+void checksum_files(checksum_kind_t kind, int dirfd, FILE *in, char **names, size_t n,
+                    checksum_result_t *results);
+
+/*
+ * Print "HEX  NAME" for each of names[0..n), in order
+ * Returns: 0, or -1 if any could not be read
+ */
+int checksum_list(checksum_kind_t kind, FILE *in, FILE *out, char **names, size_t n,
+                  const char *prog);
+
+/*
+ * Check every file listed in manifest (read to its end; manifest_name
+ * is for messages), printing "NAME: OK" or "NAME: FAILED" per line and
+ * GNU's warnings for mismatches, unreadable files and malformed lines
+ * Returns: 0 if every listed file matched, -1 otherwise
+ */
+int checksum_check(checksum_kind_t kind, int dirfd, FILE *in, FILE *manifest,
+                   const char *manifest_name, FILE *out, int flags, const char *prog);
+
+#endif /* CHECKSUM_H */
@@ -1,6 +1,7 @@
 #ifndef CMD_SPEC_H
 #define CMD_SPEC_H
 
+#include <stddef.h>
 #include <stdio.h>
 
 /**
@@ -18,7 +19,39 @@
  *   - Built as standalone binaries
  *   - Registered as shell built-ins
  *   - Packaged and distributed separately
+ *
+ * A command's argtable is built on its first run (or --help) and kept
+ * for the life of the process, never freed: arg_parse() resets every
+ * entry before it parses, so a command the shell runs in-process from a
+ * loop, find -exec or xargs parses its words without allocating. The
+ * builder returns at once if the table is already there, and a command
+ * that may run itself (find, xargs) copies out what it needs before it
+ * does.
+ */
+
+/**
+ * Command flags
+ *
+ * CMD_FLAG_FORK - Command must run in a child process. By default the
+ *                 shell runs registry commands directly in its own
+ *                 process; set this for commands that are not safe there.
+ */
+#define CMD_FLAG_FORK   0x01
+
+/**
+ * CMD_FLAG_STREAMS - Command does all of its I/O through cmd_stdin() and
+ *                    cmd_stdout() and keeps no state outside its argtable,
+ *                    so a pipeline stage can run it on its own thread.
+ */
+#define CMD_FLAG_STREAMS 0x02
+
+/**
+ * CMD_FLAG_PURE - Command's output and exit status depend only on its
+ *                 arguments, the environment and the files its arguments
+ *                 name (or stdin), and it changes nothing, so `cache` can
+ *                 replay a result while those files are unchanged.
  */
+#define CMD_FLAG_PURE   0x04
 
 /**
  * Command specification structure
@@ -36,6 +69,8 @@ typedef struct cmd_spec {
 
     /* Function to print usage/help information */
     void (*print_usage)(FILE *out);
+
+    unsigned int flags;      /* CMD_FLAG_* bits (0 for most commands) */
 } cmd_spec_t;
 
 /**
@@ -53,6 +88,25 @@ typedef struct cmd_spec {
  */
 void register_command(const cmd_spec_t *spec);
 
+/**
+ * Install the table of built-in commands
+ *
+ * The table is generated at build time (scripts/gen_builtin_table.sh)
+ * and must be sorted by name; it is used in place, so this does no work
+ * beyond remembering the pointer. Commands passed to register_command()
+ * afterwards (e.g. pkg-installed ones) are looked up after the table.
+ *
+ * @param table Sorted array of command specs (must remain valid)
+ * @param count Number of entries in table
+ */
+void register_command_table(const cmd_spec_t *const *table, size_t count);
+
+/**
+ * Built-in command table generated into the picobox binary
+ */
+extern const cmd_spec_t *const builtin_commands[];
+extern const size_t builtin_command_count;
+
 /**
  * Find a command by name
  *
@@ -76,4 +130,70 @@ const cmd_spec_t *find_command(const char *name);
 void for_each_command(void (*callback)(const cmd_spec_t *spec, void *userdata),
                       void *userdata);
 
+/**
+ * Registry generation
+ *
+ * @return A number that changes whenever a command is registered, so
+ *         data built from the registry knows when to rebuild
+ */
+unsigned long registry_generation(void);
+
+/**
+ * Per-thread command streams
+ *
+ * Commands flagged CMD_FLAG_STREAMS read and write through these instead
+ * of stdin/stdout. Outside a threaded pipeline they return stdin/stdout.
+ */
+
+/**
+ * Get the input stream for the calling thread's command
+ *
+ * @return Stream set with cmd_set_streams(), or stdin
+ */
+FILE *cmd_stdin(void);
+
+/**
+ * Get the output stream for the calling thread's command
+ *
+ * @return Stream set with cmd_set_streams(), or stdout
+ */
+FILE *cmd_stdout(void);
+
+/**
+ * Set the calling thread's command streams
+ *
+ * @param in  Input stream (NULL for stdin)
+ * @param out Output stream (NULL for stdout)
+ */
+void cmd_set_streams(FILE *in, FILE *out);
+
+/**
+ * Tell the producer feeding this command that no more input will be read
+ *
+ * A command that stops early (head) calls this as soon as it has what
+ * it needs, so the stage writing to it gets EPIPE now instead of
+ * filling the pipe until the command returns. Further reads from
+ * cmd_stdin() see end of input. Does nothing outside a threaded
+ * pipeline: a forked stage exits, closing its pipe, right after.
+ */
+void cmd_stdin_done(void);
+
+/**
+ * Set what cmd_stdin_done() does on the calling thread
+ *
+ * @param fn  Called once with arg (NULL for nothing)
+ * @param arg Argument for fn
+ */
+void cmd_set_stdin_done(void (*fn)(void *), void *arg);
+
+/**
+ * Parse arguments with argtable3, serialized across threads
+ *
+ * argtable3's getopt keeps global state, so commands that may run on
+ * a pipeline thread parse through this instead of arg_parse().
+ *
+ * @return Number of parse errors, as arg_parse()
+ */
+int cmd_arg_parse(int argc, char **argv, void **argtable);
+
 #endif /* CMD_SPEC_H */
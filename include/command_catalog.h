@@ -0,0 +1,46 @@
+#ifndef COMMAND_CATALOG_H
+#define COMMAND_CATALOG_H
+
+#include <stddef.h>
+
+/*
+ * command_catalog.h - The command catalog as JSON
+ *
+ * What picobox --commands-json prints and the @-query helper reads:
+ *
+ *   {
+ *     "version": 1,
+ *     "commands": [
+ *       { "name": ..., "summary": ..., "description": ..., "usage": ... },
+ *       ...
+ *     ]
+ *   }
+ *
+ * It is formatted once per process (and again if the registry has
+ * changed since, see registry_generation()), not per request.
+ *
+ * For readers in other processes it is also kept in a file named after
+ * its SHA-256, ~/.mysh/catalog-<hash>.json: a file of that name already
+ * holds this very catalog, so checking it is one stat(), and a shell
+ * whose commands differ (another build, new packages) uses another
+ * file rather than overwriting this one.
+ */
+
+#define COMMAND_CATALOG_VERSION 1
+
+/*
+ * The catalog
+ * len: set to its length
+ * Returns: the JSON text (owned by the module, valid until the registry
+ *          changes), or NULL (out of memory)
+ */
+const char *command_catalog_json(size_t *len);
+
+/*
+ * The catalog's file, written if it does not exist yet
+ * Returns: its path (owned by the module), or NULL if it cannot be
+ *          written ($HOME unset, or an I/O error)
+ */
+const char *command_catalog_file(void);
+
+#endif /* COMMAND_CATALOG_H */
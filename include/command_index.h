@@ -0,0 +1,39 @@
+#ifndef COMMAND_INDEX_H
+#define COMMAND_INDEX_H
+
+#include <stddef.h>
+#include "cmd_spec.h"
+
+/*
+ * command_index.h - Full-text search over the registered commands
+ *
+ * An inverted index of every command's name, summary, long_help and
+ * usage text (what its print_usage() writes), ranked with BM25. It
+ * picks the commands an @-query's prompt describes, and the command
+ * the heuristic fallback suggests.
+ *
+ * The index is built on the first search, not at startup (registering
+ * the built-in table does no work), and again whenever the registry
+ * has changed since, e.g. after pkg registers new commands.
+ *
+ * Text is split into lower-case runs of letters and digits; common
+ * English words are dropped, and a plural "s" is taken off, so "files"
+ * finds "file". A name counts three times, a summary twice.
+ */
+
+/*
+ * Find the commands most relevant to query
+ * out: filled with up to k commands, best first; only commands that
+ *      share a word with the query are returned
+ * Returns: number found
+ */
+size_t command_index_search(const char *query, const cmd_spec_t **out, size_t k);
+
+/*
+ * Usage text of a command, as its print_usage() writes it
+ * Returns: the text (owned by the index, valid until the registry changes),
+ *          or "" if it has none
+ */
+const char *command_index_usage(const cmd_spec_t *spec);
+
+#endif /* COMMAND_INDEX_H */
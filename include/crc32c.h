@@ -0,0 +1,27 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * crc32c.h - CRC-32C (Castagnoli, as in iSCSI, ext4 and SCTP)
+ *
+ * Computed with the CPU's CRC32 instruction where there is one (SSE4.2
+ * on x86, checked at run time; the ARMv8 CRC extension when the
+ * compiler targets it), eight bytes at a time, otherwise from a
+ * slicing-by-8 table. PICOBOX_SIMD=scalar forces the table.
+ */
+
+/*
+ * Continue a CRC over buf[0..len): start with crc = 0, and pass the
+ * result back in for the next piece
+ */
+uint32_t crc32c_update(uint32_t crc, const void *buf, size_t len);
+
+/*
+ * Name of the implementation in use ("sse4.2", "armv8" or "scalar")
+ */
+const char *crc32c_kernel(void);
+
+#endif /* CRC32C_H */
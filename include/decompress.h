@@ -0,0 +1,72 @@
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "utils.h"
+
+/*
+ * decompress.h - Streaming gzip and zstd decompression for command input
+ *
+ * What cat/grep/head/wc -z read: input is recognized by its first bytes
+ * and decompressed on threads of its own while the command reads the
+ * result, so decompression and the command's work overlap. A regular
+ * file made of independent frames (zstd written by pzstd or zstd
+ * --block-size, gzip in BGZF blocks as bgzip writes) is mapped and its
+ * frames decompressed on several threads at once, handed out in order.
+ *
+ * zlib and libzstd are loaded with dlopen() the first time input needs
+ * them, so picobox does not link either (like the plugins, plugin.c);
+ * without the library the input cannot be read (errno ELIBACC).
+ * Corrupt or truncated input is a read error with errno EBADMSG.
+ */
+
+enum {
+    DECOMPRESS_NONE,
+    DECOMPRESS_GZIP,
+    DECOMPRESS_ZSTD
+};
+
+/* Bytes decompress_format() needs to tell the formats apart */
+#define DECOMPRESS_MAGIC 4
+
+/* Format of input that starts with the len bytes at head */
+int decompress_format(const void *head, size_t len);
+
+/*
+ * Format of a regular file from its current offset, looked at with
+ * pread() (nothing is consumed)
+ * Returns: the format, or -1 if fd is not a regular file, which cannot
+ * be looked at without reading it (line_reader_decompress() does)
+ */
+int decompress_fd_format(int fd);
+
+typedef struct decoder decoder_t;
+
+/*
+ * Start decompressing input of the given format: the len bytes at head,
+ * already read from the source, then the rest of fd (or of fp if fd is
+ * -1). Neither is closed by the decoder.
+ * Returns: decoder, or NULL with errno set
+ */
+decoder_t *decoder_open(int format, int fd, FILE *fp, const void *head, size_t len);
+
+/*
+ * Read up to len decompressed bytes
+ * Returns: the byte count, 0 at end of input, -1 on error (errno set)
+ */
+ssize_t decoder_read(decoder_t *d, char *buf, size_t len);
+
+/* Stop the decoder's threads, wherever they are, and free it */
+void decoder_close(decoder_t *d);
+
+/*
+ * Have lr decompress its input if it is gzip or zstd, which the first
+ * few bytes tell; call before taking any lines. Input that is neither
+ * is read as it is. Kept here rather than in utils.c, so the line
+ * reader does not pull in the decoder.
+ * Returns: 1 if decompressing, 0 if not, -1 on error (errno set)
+ */
+int line_reader_decompress(line_reader_t *lr);
+
+#endif /* DECOMPRESS_H */
@@ -0,0 +1,54 @@
+#ifndef DIR_CURSOR_H
+#define DIR_CURSOR_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * dir_cursor.h - Open directories kept from one path to the next
+ *
+ * Commands that create or touch many paths (mkdir -p, touch) look up
+ * the directory each path is in. A cursor keeps every component of the
+ * last directory it opened open, so the next path only opens (or with
+ * create, mkdirat()s) the components after the prefix it shares with
+ * the one before: a sorted list of a million files under a few hundred
+ * directories costs a few hundred directory lookups, and every file
+ * is then one *at() call on its parent's descriptor.
+ *
+ * Components are opened relative to their parent's descriptor, never
+ * by a path from the start, so renaming a directory above the cursor
+ * leaves the files made after it where the cursor is.
+ */
+
+typedef struct dir_cursor {
+    char *path;         /* Directory the descriptors lead to, as last asked for */
+    size_t len;
+    int *fds;           /* fds[i]: the directory of the first i+1 components */
+    size_t *ends;       /* Where component i ends in path */
+    size_t depth;
+    size_t cap;
+} dir_cursor_t;
+
+void dir_cursor_init(dir_cursor_t *c);
+
+/*
+ * Open the directory dir[0..len) ("" for the current one), reusing
+ * what the cursor has open from the last call; with create, components
+ * that do not exist are made with mkdirat(..., mode)
+ * Returns: its descriptor (the cursor's: do not close it), or -1 with
+ * errno set
+ */
+int dir_cursor_open(dir_cursor_t *c, const char *dir, size_t len, int create, mode_t mode);
+
+/* Close everything the cursor holds */
+void dir_cursor_free(dir_cursor_t *c);
+
+/*
+ * Split path into the directory it is in and its last component,
+ * ignoring trailing slashes: *dir_len is the length of the directory
+ * part ("a/b" for "a/b/c/", 0 for "c"), and the name starts at *name
+ * and is *name_len long ("/" is its own name)
+ */
+void dir_cursor_split(const char *path, size_t *dir_len, const char **name, size_t *name_len);
+
+#endif /* DIR_CURSOR_H */
@@ -0,0 +1,40 @@
+#ifndef ENV_CACHE_H
+#define ENV_CACHE_H
+
+/*
+ * env_cache.h - Exported variables and the environment given to children
+ *
+ * Exported variables are kept in a var_table_t (seeded from the
+ * environment picobox was started with) next to a ready-made envp
+ * array. The array is only rebuilt when an exported variable changes,
+ * so launching a command passes it to posix_spawn()/execve() as is.
+ */
+
+/*
+ * Export a variable (creates or updates it)
+ * The process environment is updated too, for getenv() in the shell.
+ * Returns: 0 on success, -1 on error
+ */
+int env_export(const char *name, const char *value);
+
+/* Is this variable exported? */
+int env_is_exported(const char *name);
+
+/*
+ * Environment for child processes (NULL-terminated "NAME=VALUE" array)
+ * Returns: the cached array (owned by the cache, valid until the next
+ *          env_export()), or environ if it cannot be built
+ */
+char **env_vector(void);
+
+/*
+ * Environment for one command with NAME=VALUE prefixes (FOO=bar cmd)
+ *
+ * Entries of env_vector() named in assigns are replaced; the rest are
+ * shared with the cached array, so only the pointer array and the
+ * assignment strings are copied.
+ * Returns: array to pass to the child (caller free()s it), or NULL
+ */
+char **env_vector_with(char *const *assigns, int count);
+
+#endif /* ENV_CACHE_H */
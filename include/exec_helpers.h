@@ -6,6 +6,43 @@
 #define EXEC_HELPERS_H
 
 #include "redirect_helpers.h"
+#include "cmd_spec.h"
+#include <sys/types.h>
+
+/* Backends for launching external commands */
+#define SPAWN_BACKEND_FORK   0   /* fork() + execvp() */
+#define SPAWN_BACKEND_SPAWN  1   /* posix_spawnp() with file actions (default) */
+#define SPAWN_BACKEND_ZYGOTE 2   /* pre-forked helper, see zygote.h */
+
+/*
+ * Get/set the backend used for external commands
+ * Default comes from PICOBOX_SPAWN ("fork", "spawn" or "zygote")
+ */
+int get_spawn_backend(void);
+void set_spawn_backend(int backend);
+
+/*
+ * Launch an external command with posix_spawnp() (or the zygote) without waiting
+ * envp: environment for the child, NULL for the exported variables
+ * stdin_fd/stdout_fd: -1 to inherit, otherwise fd to install as stdin/stdout
+ * close_fds: additional fds (max 6) the child must not inherit
+ * Returns child pid, or -1 on error
+ */
+pid_t spawn_external(char **argv, char **envp, int stdin_fd, int stdout_fd,
+                     const int *close_fds, int nclose);
+
+/*
+ * Exec an external command in a forked child via the PATH cache
+ * envp: environment for the program, NULL for the exported variables
+ * Does not return (exits 127 if the command cannot be executed)
+ */
+void exec_child(char **argv, char **envp);
+
+/*
+ * Wait for a child process
+ * Returns its exit code, or 128+signal if it was killed
+ */
+int wait_for_child(pid_t pid, const char *name);
 
 /*
  * Execute command in child process using fork/exec
@@ -19,6 +56,19 @@ int exec_command_external(char **argv);
  */
 int exec_command_with_redirects(char **argv, struct redirection *redirs, int redir_count);
 
+/*
+ * Check if a registry command may run inside the shell process
+ * Returns 1 if it can run in-process, 0 if it must fork
+ */
+int can_run_inprocess(const cmd_spec_t *spec, int stdin_redirected);
+
+/*
+ * Run a registry command in the shell process (no fork)
+ * stdout_fd: -1 to keep stdout, otherwise fd to redirect stdout to
+ * Returns exit status of the command
+ */
+int exec_registry_inprocess(const cmd_spec_t *spec, int argc, char **argv, int stdout_fd);
+
 /*
  * Check if command is a shell built-in
  * Returns 1 if built-in, 0 otherwise
@@ -0,0 +1,34 @@
+#ifndef FAST_PARSE_H
+#define FAST_PARSE_H
+
+#include "../bnfc_shell/Absyn.h"
+
+/*
+ * fast_parse.h - Parser fast path for simple command lines
+ *
+ * Most lines typed at a prompt are a command and its arguments: words
+ * separated by blanks, with no |, <, >, ;, &, comment or AI keyword.
+ * For those the tree is built directly, in one pass over the line,
+ * without setting up the flex scanner and bison parser. It is the same
+ * tree psInput() builds:
+ *
+ *   (StartInput [(SimpleCmd (Cmd "ls" ["-la"] []))])
+ *
+ * Any other line is left to psInput(). Nodes and words come from the
+ * AST arena (ast_alloc()), as the parser's do.
+ */
+
+/*
+ * Parse a line: the fast path if it is a simple command, else psInput()
+ * Returns: the tree, or NULL on a syntax error
+ */
+Input fast_parse_line(const char *line);
+
+/*
+ * The fast path alone
+ * Returns: the tree, or NULL if the line is not a simple command (which
+ *          does not mean it is invalid; the caller falls back to psInput())
+ */
+Input fast_parse_simple(const char *line);
+
+#endif /* FAST_PARSE_H */
@@ -0,0 +1,38 @@
+#ifndef GLOB_EXPAND_H
+#define GLOB_EXPAND_H
+
+#include <stddef.h>
+
+/*
+ * glob_expand.h - Pathname expansion (*, ? and [...]) for the shell
+ *
+ * A word with a glob character is matched against the file system one
+ * path component at a time, with fnmatch(): src/[a-c]*.c reads src,
+ * and lib?/Makefile reads . and then looks for Makefile in each lib?
+ * directory. As in sh, * ? and [ do not match a leading dot, a pattern
+ * ending in / matches only directories, and a pattern that matches
+ * nothing is left as it is.
+ *
+ * Directory listings are cached until glob_cache_reset(), keyed by the
+ * directory's device, inode and mtime (from an fstat() of its fd), so
+ * cp *.o *.a dest/ reads . once, and a listing is never used after the
+ * directory has changed. Entries are classified by d_type, so a match
+ * costs no stat() at all unless the file system does not report types.
+ */
+
+/* Does word contain a glob character (*, ? or [)? */
+int glob_has_magic(const char *word);
+
+/*
+ * Expand a pattern
+ * matches: set to the matching paths, sorted (one array in the module's
+ *          arena, valid until glob_cache_reset())
+ * Returns: how many there are; 0 if none (or out of memory), in which
+ *          case the caller keeps the word as it is
+ */
+size_t glob_expand(const char *pattern, char ***matches);
+
+/* Forget the cached listings (called after each command) */
+void glob_cache_reset(void);
+
+#endif /* GLOB_EXPAND_H */
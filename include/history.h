@@ -0,0 +1,113 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * history.h - Command history shared by every shell
+ *
+ * ~/.mysh/history ($HISTFILE if set) is plain text, one command line
+ * per line, oldest first. Shells only ever append to it, each line with
+ * a single write() on an O_APPEND descriptor, so lines from concurrent
+ * shells interleave but never tear. The file is mapped read-only, not
+ * read into memory, and mapped again when it has grown.
+ *
+ * Substring search is served by HISTFILE.idx, a trigram index the
+ * shells extend as the history grows:
+ *
+ *   history_idx_hdr_t
+ *   history_idx_block_t blocks[nblocks]
+ *
+ * The history is cut into blocks of whole lines, each ending at the
+ * first line end past HISTORY_BLOCK bytes. A block's record holds its
+ * byte range and a Bloom filter of the trigrams (three consecutive
+ * bytes) of its lines, one bit each. A search for a string of three or
+ * more bytes reads only the blocks whose filters have the bits of all
+ * its trigrams, and the lines past the last block. Blocks are only ever
+ * added, so extending the index is appending records; it is rebuilt if
+ * the history no longer starts with the bytes it was built from.
+ * Writers hold flock() on it. Integers are in the host's byte order.
+ */
+
+#define HISTORY_IDX_MAGIC 0x49484250u   /* "PBHI" */
+#define HISTORY_IDX_VERSION 1
+
+#define HISTORY_BLOCK 2048              /* Bytes of history per block, about */
+#define HISTORY_BLOOM_BITS 4096
+
+typedef struct history_idx_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_bytes;       /* HISTORY_BLOCK when built */
+    uint32_t bloom_bits;        /* HISTORY_BLOOM_BITS when built */
+    uint64_t nblocks;
+    uint64_t covered;           /* Bytes of history in blocks */
+    uint64_t check;             /* FNV-1a of its first bytes, up to HISTORY_BLOCK */
+} history_idx_hdr_t;
+
+typedef struct history_idx_block {
+    uint64_t start;             /* Byte range of its lines */
+    uint64_t end;
+    uint64_t bloom[HISTORY_BLOOM_BITS / 64];
+} history_idx_block_t;
+
+/*
+ * One line of history. text is not NUL-terminated and points into the
+ * mapping, so it is valid only until the next history_*() call.
+ */
+typedef struct history_entry {
+    const char *text;
+    size_t len;
+    uint64_t off;               /* Where it starts in the file */
+} history_entry_t;
+
+/*
+ * Map the history (creating ~/.mysh if needed) and bring its index up
+ * to date. The other functions open it on first use.
+ * Returns: 0, or -1 if there is no home or the file cannot be opened
+ */
+int history_open(void);
+
+/* Unmap and close */
+void history_close(void);
+
+/*
+ * Append line (one line; empty lines and a repeat of the newest entry
+ * are not added)
+ */
+void history_add(const char *line);
+
+/*
+ * Size of the history, picking up lines other shells have appended.
+ * It is also the offset just past the newest entry.
+ */
+uint64_t history_end(void);
+
+/*
+ * The entry before offset off (history_end() for the newest)
+ * Returns: 0, or -1 if there is none
+ */
+int history_before(uint64_t off, history_entry_t *entry);
+
+/*
+ * The entry after the one starting at off
+ * Returns: 0, or -1 if that was the newest
+ */
+int history_after(uint64_t off, history_entry_t *entry);
+
+/*
+ * The newest entry starting before off that contains needle
+ * Returns: 0, or -1 if there is none
+ */
+int history_search(const char *needle, uint64_t off, history_entry_t *entry);
+
+/*
+ * The lines entered most often among the newest window entries, most
+ * frequent first, as strings the caller free()s
+ * Returns: how many were stored in lines (at most max); lines entered
+ *          only once are left out
+ */
+size_t history_frequent(char **lines, size_t max, size_t window);
+
+#endif /* HISTORY_H */
@@ -0,0 +1,40 @@
+#ifndef LINE_EDIT_H
+#define LINE_EDIT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * line_edit.h - Interactive line input with history
+ *
+ * On a terminal, the line is edited in raw mode: Left/Right, Home/End
+ * (Ctrl-A/Ctrl-E), Backspace/Delete, Ctrl-K/Ctrl-U/Ctrl-W to kill, Up/
+ * Down (Ctrl-P/Ctrl-N) through the history and Ctrl-R to search it
+ * (history.h): each key narrows the search to the newest line holding
+ * what has been typed, Ctrl-R again goes further back, Enter runs the
+ * line found, Ctrl-G cancels and any other key edits it. Ctrl-C drops
+ * the line; Ctrl-D on an empty line is end of input.
+ *
+ * Anywhere else (a pipe, a file, TERM=dumb), the prompt is printed and
+ * the line read with getline(); the shell reads such input itself, in
+ * blocks (line_reader_t).
+ */
+
+/* Whether line_edit_read() edits: stdin and stdout are a terminal */
+int line_edit_terminal(void);
+
+/*
+ * Whether input has arrived that has not been read yet: after Enter,
+ * the rest of a paste
+ */
+int line_edit_pending(void);
+
+/*
+ * Print prompt and read a line, of any length, into *line: a buffer of
+ * *size bytes, allocated or grown as getline() does (*line may be NULL)
+ * The line end is not stored.
+ * Returns: its length, or -1 at end of input
+ */
+ssize_t line_edit_read(const char *prompt, char **line, size_t *size);
+
+#endif /* LINE_EDIT_H */
@@ -0,0 +1,70 @@
+#ifndef LITERAL_SEARCH_H
+#define LITERAL_SEARCH_H
+
+#include <stddef.h>
+
+/*
+ * literal_search.h - Fast search for a fixed string
+ *
+ * The two rarest bytes of the needle (by a rough byte-frequency table
+ * for text and logs) are compared against 16 or 32 haystack positions
+ * at once; only positions where both match are verified in full.
+ * Case-insensitive search folds ASCII letters with a single OR, so it
+ * runs as fast as the case-sensitive one.
+ *
+ * The kernel is picked at init from what the CPU supports: AVX2 or
+ * SSE2 on x86, NEON on ARM, otherwise a memchr()-based scalar loop.
+ * PICOBOX_SIMD=scalar|sse2|avx2|neon forces one (if available), for
+ * testing and benchmarks.
+ */
+
+typedef struct literal_search literal_search_t;
+
+struct literal_search {
+    unsigned char *needle;   /* Lower-cased when icase */
+    size_t len;
+    int icase;
+    size_t rare1, rare2;     /* Offsets of the two rarest needle bytes */
+    const char *(*find)(const literal_search_t *ls, const char *hay, size_t len);
+};
+
+/*
+ * Prepare a search for needle[0..len)
+ * Returns: 0 on success, -1 if out of memory
+ */
+int literal_search_init(literal_search_t *ls, const char *needle, size_t len, int icase);
+
+/*
+ * Find the first occurrence in hay[0..len)
+ * Returns: pointer to it, or NULL if there is none
+ */
+static inline const char *literal_search_find(const literal_search_t *ls,
+                                              const char *hay, size_t len)
+{
+    return ls->find(ls, hay, len);
+}
+
+/*
+ * Name of the kernel in use ("avx2", "sse2", "neon" or "scalar")
+ */
+const char *literal_search_kernel(const literal_search_t *ls);
+
+/*
+ * Release what literal_search_init() allocated
+ */
+void literal_search_free(literal_search_t *ls);
+
+/*
+ * Count occurrences of byte c in buf[0..len) (e.g. newlines, for line
+ * numbers), with the same kernel choice as the search
+ */
+size_t literal_count_byte(const char *buf, size_t len, unsigned char c);
+
+/*
+ * Find the first byte in buf[0..len) that is a or b (a field delimiter
+ * or the newline, say), with the same kernel choice as the search
+ * Returns: pointer to it, or NULL if there is none
+ */
+const char *literal_find_either(const char *buf, size_t len, unsigned char a, unsigned char b);
+
+#endif /* LITERAL_SEARCH_H */
@@ -0,0 +1,61 @@
+#ifndef LITERAL_SET_H
+#define LITERAL_SET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * literal_set.h - Search for any of many fixed strings at once
+ *
+ * The strings are compiled into an Aho-Corasick automaton: a trie of
+ * all of them whose missing edges are filled in from the failure links,
+ * so that a scan is a single table lookup per haystack byte however
+ * many strings there are. Bytes that occur in no string share one
+ * column of the table (byte classes), which keeps it small for sets of
+ * IDs or words.
+ *
+ * When the shortest string is long enough the search skips instead
+ * (Horspool on the last byte of a window as long as that string): a
+ * byte that ends no string's prefix moves the window on by up to its
+ * whole length, and only the remaining windows are checked by walking
+ * the trie. Log lines, where most bytes are not part of any ID, are
+ * then scanned at a fraction of a lookup per byte.
+ *
+ * Case folding (icase) is ASCII only, as in literal_search.h.
+ */
+
+typedef struct literal_set {
+    unsigned char classmap[256];  /* Byte -> column */
+    uint32_t nclasses;
+    uint32_t nstates;
+    uint32_t *trans;              /* Next state * nclasses, plus the LITERAL_SET_* flags */
+    size_t minlen;                /* Length of the shortest string */
+    uint32_t skip[256];           /* Window shift per last byte, 0 = check it */
+    int has_empty;                /* An empty string matches anywhere */
+} literal_set_t;
+
+#define LITERAL_SET_HIT  0x80000000u  /* Some string ends at the target */
+#define LITERAL_SET_TRIE 0x40000000u  /* Edge of the trie, not a failure */
+#define LITERAL_SET_END  0x20000000u  /* The target itself is a whole string */
+
+/*
+ * Build the automaton for strings[i][0..lens[i]), i < n (n may be 0,
+ * which matches nothing)
+ * Returns: 0 on success, -1 if out of memory
+ */
+int literal_set_init(literal_set_t *ls, const char *const *strings, const size_t *lens,
+                     size_t n, int icase);
+
+/*
+ * Find a match of any of the strings in hay[0..len)
+ * Returns: pointer into a match that no other match lies wholly before
+ * (so it is on the first line that has one), or NULL if there is none
+ */
+const char *literal_set_find(const literal_set_t *ls, const char *hay, size_t len);
+
+/*
+ * Release what literal_set_init() allocated
+ */
+void literal_set_free(literal_set_t *ls);
+
+#endif /* LITERAL_SET_H */
@@ -0,0 +1,91 @@
+#ifndef LOCATE_DB_H
+#define LOCATE_DB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * locate_db.h - File name database of updatedb and locate
+ *
+ * updatedb walks the trees and writes every path, sorted by strcmp(),
+ * into one file that locate maps read-only and searches without going
+ * near the trees again:
+ *
+ *   locate_db_hdr_t
+ *   uint64_t blocks[nblocks + 1]     Offsets of the blocks in the data
+ *   data                             The paths, LOCATE_DB_BLOCK to a block
+ *   locate_db_tri_t tris[ntris]      Sorted by tri
+ *   postings                         Per trigram, the blocks holding it
+ *
+ * Within a block each path is front-compressed against the one before:
+ * a varint of the bytes it shares with it, a varint of the bytes that
+ * follow, and those bytes. The first path of a block shares nothing,
+ * so any block decodes on its own.
+ *
+ * Every three consecutive bytes of a path are a trigram. A trigram's
+ * posting list holds, as varint deltas from the one before, the number
+ * of every block with a path containing it. A query needs only the
+ * blocks on the lists of all the trigrams in its literal parts.
+ *
+ * Varints are LEB128: seven bits a byte, low bits first, the top bit
+ * set on all but the last. Integers are in the host's byte order.
+ */
+
+#define LOCATE_DB_MAGIC 0x444c4250u   /* "PBLD" */
+#define LOCATE_DB_VERSION 1
+
+/* Paths per block */
+#define LOCATE_DB_BLOCK 256
+
+/* Used by both commands when not given one */
+#define LOCATE_DB_DEFAULT "/var/tmp/picobox-locate.db"
+
+typedef struct locate_db_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t npaths;
+    uint64_t nblocks;
+    uint64_t ntris;
+    uint64_t blocks_off;        /* File offsets of each part */
+    uint64_t data_off;
+    uint64_t tris_off;
+    uint64_t post_off;
+    uint64_t size;              /* Of the whole file */
+} locate_db_hdr_t;
+
+typedef struct locate_db_tri {
+    uint32_t tri;               /* Bytes a, b, c as a << 16 | b << 8 | c */
+    uint32_t count;             /* Blocks on its list */
+    uint64_t off;               /* Of its list, from post_off */
+} locate_db_tri_t;
+
+static inline uint32_t locate_db_trigram(const char *s)
+{
+    return (uint32_t)(unsigned char)s[0] << 16 | (uint32_t)(unsigned char)s[1] << 8 |
+           (uint32_t)(unsigned char)s[2];
+}
+
+/*
+ * Read a varint at *p, not going past end
+ * Returns: 0, or -1 if it runs off the end (a damaged database)
+ */
+static inline int locate_db_varint(const unsigned char **p, const unsigned char *end,
+                                   uint64_t *v)
+{
+    uint64_t x = 0;
+    int shift = 0;
+
+    while (*p < end && shift < 64) {
+        unsigned char c = *(*p)++;
+
+        x |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            *v = x;
+            return 0;
+        }
+        shift += 7;
+    }
+    return -1;
+}
+
+#endif /* LOCATE_DB_H */
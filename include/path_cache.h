@@ -0,0 +1,30 @@
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+/*
+ * path_cache.h - Cached PATH lookup for external commands
+ *
+ * Remembers where each external command was found in PATH (like bash's
+ * `hash`), so repeated launches exec the full path directly instead of
+ * searching every PATH entry again.
+ */
+
+/*
+ * Resolve a command name to an executable path
+ * Names containing '/' are returned unchanged.
+ * Returns: path (owned by the cache, valid until it is invalidated),
+ *          or NULL with errno set if not found in PATH
+ */
+const char *path_cache_lookup(const char *name);
+
+/* Forget one remembered command (e.g. after exec of its path failed) */
+void path_cache_forget(const char *name);
+
+/* Forget all remembered commands (PATH changed, `hash -r`) */
+void path_cache_clear(void);
+
+/* Call callback for every remembered command */
+void path_cache_foreach(void (*callback)(const char *name, const char *path, void *userdata),
+                        void *userdata);
+
+#endif /* PATH_CACHE_H */
@@ -0,0 +1,109 @@
+#ifndef PB_OUT_H
+#define PB_OUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+ * pb_out.h - Buffered command output
+ *
+ * Commands that print a field or a line at a time put it in one large
+ * buffer instead of making a stdio call per field. The buffer is only
+ * written out when it is full and when the writer is closed at the end
+ * of the command, so a pipeline reader sees the same large writes a
+ * forked command's exit would give it.
+ *
+ * A stream with a file descriptor is written with writev() straight
+ * to it: a piece of data larger than the free space goes out in the
+ * same call as what is buffered in front of it, without being copied.
+ * A stream without one (a threaded pipeline's ring) gets fwrite().
+ * With no stream at all the writer collects its output in memory,
+ * growing as needed, for the caller to hand on (pb_out_data()).
+ *
+ * Write errors are remembered, not reported per call: once one has
+ * happened further output is dropped, and pb_out_close() returns -1.
+ */
+
+typedef struct pb_out {
+    FILE *fp;          /* Destination, or NULL to collect in memory */
+    int fd;            /* fp's descriptor to write directly, or -1 */
+    char *buf;
+    size_t len;
+    size_t cap;
+    int error;         /* errno of the first failed write, or 0 */
+} pb_out_t;
+
+/*
+ * Start writing to fp (NULL: collect in memory). Whatever fp already
+ * buffers is flushed first, so the output stays in order.
+ * Returns: 0, or -1 if out of memory
+ */
+int pb_out_init(pb_out_t *o, FILE *fp);
+
+/*
+ * Write out everything buffered (nothing for a memory writer)
+ * Returns: 0, or -1 if this or an earlier write failed
+ */
+int pb_out_flush(pb_out_t *o);
+
+/*
+ * Flush and release the writer
+ * Returns: 0, or -1 if any write failed (errno set)
+ */
+int pb_out_close(pb_out_t *o);
+
+/*
+ * Make room for n more bytes in the buffer (used by the inline
+ * writers; n must not exceed the buffer size)
+ */
+void pb_out_reserve(pb_out_t *o, size_t n);
+
+/* Append len bytes */
+void pb_out_write(pb_out_t *o, const void *data, size_t len);
+
+/* Append a NUL-terminated string */
+void pb_out_str(pb_out_t *o, const char *s);
+
+/*
+ * Append s padded with spaces to |width| columns (bytes): on the left
+ * for width > 0, on the right for width < 0, as printf's "%*s"
+ */
+void pb_out_pad(pb_out_t *o, const char *s, int width);
+
+/* Append v in decimal, right-aligned in width columns (as "%*ju") */
+void pb_out_uint(pb_out_t *o, uintmax_t v, int width);
+
+/* Append v in decimal, right-aligned in width columns (as "%*jd") */
+void pb_out_int(pb_out_t *o, intmax_t v, int width);
+
+/* Append size as format_size() writes it, right-aligned in width columns */
+void pb_out_size(pb_out_t *o, off_t size, int width);
+
+/*
+ * What a memory writer has collected, and forgetting it again
+ */
+static inline const char *pb_out_data(const pb_out_t *o, size_t *len)
+{
+    *len = o->len;
+    return o->buf;
+}
+
+static inline void pb_out_reset(pb_out_t *o)
+{
+    o->len = 0;
+}
+
+/* Append one byte */
+static inline void pb_out_putc(pb_out_t *o, char c)
+{
+    if (o->len == o->cap) {
+        pb_out_reserve(o, 1);
+    }
+    if (o->len < o->cap) {
+        o->buf[o->len++] = c;
+    }
+}
+
+#endif /* PB_OUT_H */
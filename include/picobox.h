@@ -19,12 +19,6 @@
 /* Command function type - all commands follow this signature */
 typedef int (*cmd_func_t)(int argc, char **argv);
 
-/* Command structure for dispatcher */
-struct command {
-    const char *name;
-    cmd_func_t func;
-};
-
 /* Command function prototypes */
 /* These will be implemented in separate cmd_*.c files */
 
@@ -74,5 +68,7 @@ int cmd_ai(int argc, char **argv);
 /* Shell mode */
 int shell_main(void);
 int shell_bnfc_main(void);
+int shell_bnfc_run_string(const char *script);
+int shell_bnfc_run_file(const char *path);
 
 #endif /* PICOBOX_H */
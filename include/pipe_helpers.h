@@ -1,17 +1,90 @@
 /*
  * pipe_helpers.h - Pipeline execution helpers
+ *
+ * One engine runs every pipeline: the BNFC visitor and the old
+ * exec_pipeline() entry point both describe their stages as
+ * pipe_stage_t and call run_pipeline().
  */
 
 #ifndef PIPE_HELPERS_H
 #define PIPE_HELPERS_H
 
+#include <stdio.h>
+#include <sys/types.h>
+#include "cmd_spec.h"
+
+/* One stage of a pipeline */
+typedef struct pipe_stage {
+    char **argv;                 /* NULL-terminated; NULL if the stage could
+                                    not be set up (status set by caller) */
+    int argc;
+    const cmd_spec_t *spec;      /* Registry command, or NULL */
+    int run_in_shell;            /* 1: fork and call the child hook instead
+                                    of exec'ing argv (builtins, registry) */
+    int stdin_fd;                /* Redirection, or -1; closed by the engine */
+    int stdout_fd;               /* Redirection, or -1; closed by the engine */
+    char **envp;                 /* Environment (NULL = exported variables);
+                                    owned by the caller */
+
+    /* Filled in by run_pipeline() */
+    pid_t pid;                   /* -1 if never started (or ran on a thread) */
+    int status;                  /* Exit status */
+    double wall_ms;              /* Start to reap (or thread exit) */
+    double user_ms;              /* User CPU time */
+    double sys_ms;               /* System CPU time */
+} pipe_stage_t;
+
+/*
+ * Runs a run_in_shell stage inside its forked child, after stdin/stdout
+ * have been connected. Returns the stage's exit status.
+ */
+typedef int (*pipe_child_fn)(pipe_stage_t *stage, void *data);
+
+/*
+ * Pipeline options
+ *
+ * pipefail:  status is the rightmost non-zero stage status (`set -o pipefail`)
+ * pipe size: bytes per pipe via F_SETPIPE_SZ where supported, 0 = kernel
+ *            default (PICOBOX_PIPE_SIZE)
+ * stats:     print per-stage wall/CPU times to stderr (PICOBOX_PIPE_STATS=1)
+ */
+int get_pipefail(void);
+void set_pipefail(int enabled);
+int get_pipe_size(void);
+void set_pipe_size(int bytes);
+int get_pipe_stats(void);
+void set_pipe_stats(int enabled);
+
+/*
+ * Run a pipeline and wait for all stages
+ *
+ * Stages whose commands are all flagged CMD_FLAG_STREAMS run on threads
+ * (see thread_pipeline.h); everything else runs as processes connected
+ * by pipes. External stages use posix_spawn() with the spawn backend.
+ *
+ * child_fn: hook for run_in_shell stages (NULL runs stage->spec directly)
+ *
+ * Returns exit status of the pipeline
+ */
+int run_pipeline(pipe_stage_t *stages, int count, pipe_child_fn child_fn, void *data);
+
+/*
+ * Exit status of a finished pipeline (last stage, or pipefail rule)
+ */
+int pipeline_exit_status(const pipe_stage_t *stages, int count);
+
+/*
+ * Print one line per stage: status, wall, user and system time
+ */
+void pipeline_print_stats(FILE *out, const pipe_stage_t *stages, int count);
+
 /*
- * Execute a pipeline of commands
+ * Execute a pipeline of external commands
  *
  * argv_list: Array of argv arrays (one per command)
  * count: Number of commands in pipeline
  *
- * Returns exit status of last command
+ * Returns exit status of pipeline
  */
 int exec_pipeline(char ***argv_list, int count);
 
@@ -0,0 +1,70 @@
+#ifndef PKG_DB_H
+#define PKG_DB_H
+
+#include <stdint.h>
+
+/*
+ * pkg_db.h - Package databases of pkg
+ *
+ * Two files share this layout, and pkg maps both read-only:
+ * ~/.mysh/pkgdb.db, the installed packages, and ~/.mysh/repo.db, the
+ * cached index of the package repository.
+ *
+ *   pkg_db_hdr_t
+ *   uint32_t buckets[nbuckets]       Per name hash, 1 + its first record, or 0
+ *   uint32_t by_name[nrecs]          Record numbers in strcmp() order of name
+ *   pkg_db_rec_t recs[nrecs]         In the order they were added
+ *   char strings[]                   The fields, each ending in NUL
+ *
+ * Records whose names hash to the same bucket are chained through
+ * next. nbuckets is a power of two at least twice nrecs, so looking a
+ * package up reads one bucket and, nearly always, one record. A prefix
+ * search is a binary search of by_name.
+ *
+ * The files are never changed in place: pkg writes a new one beside
+ * the old and renames it over, so a reader has the old database or the
+ * new one. Each change to pkgdb.db is also exported to pkgdb.json (the
+ * format before this one) the same way, for anything that reads that;
+ * a pkgdb.json with no usable pkgdb.db beside it is imported. Integers
+ * are in the host's byte order.
+ */
+
+#define PKG_DB_MAGIC 0x44504250u      /* "PBPD" */
+#define PKG_DB_VERSION 2
+
+/* Fields are offsets into strings; those a file does not use are "" */
+typedef struct pkg_db_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nrecs;
+    uint32_t nbuckets;
+    uint64_t size;              /* Of the whole file */
+    uint32_t origin;            /* repo.db: URL of the index it holds */
+    uint32_t etag;              /* repo.db: the index's ETag and Last-Modified, */
+    uint32_t last_modified;     /* for the next conditional request */
+    uint32_t reserved;
+} pkg_db_hdr_t;
+
+typedef struct pkg_db_rec {
+    uint32_t next;              /* 1 + the next record in its chain, or 0 */
+    uint32_t name;
+    uint32_t version;
+    uint32_t description;
+    uint32_t install_date;      /* pkgdb.db */
+    uint32_t path;              /* pkgdb.db: full path to package directory */
+    uint32_t sha256;            /* repo.db: of the archive */
+    uint32_t url;               /* repo.db: of the archive */
+} pkg_db_rec_t;
+
+/* FNV-1a of a package name */
+static inline uint32_t pkg_db_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+
+    while (*name) {
+        h = (h ^ (unsigned char)*name++) * 16777619u;
+    }
+    return h;
+}
+
+#endif /* PKG_DB_H */
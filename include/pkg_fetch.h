@@ -0,0 +1,47 @@
+#ifndef PKG_FETCH_H
+#define PKG_FETCH_H
+
+#include <stddef.h>
+#include "sha256.h"
+
+/*
+ * pkg_fetch.h - Concurrent package downloads for pkg
+ *
+ * Every transfer runs at once on one libcurl multi handle. HTTP/2 is
+ * asked for, and transfers to a host wait to share its connection
+ * rather than open their own, so one TLS connection carries them all
+ * where the server multiplexes; otherwise up to PKG_FETCH_CONNECTIONS
+ * connections are opened and the remaining transfers queue for them.
+ *
+ * A body is not stored: each piece is hashed with SHA-256 and written
+ * to the job's fd as it arrives. For an archive that is the write end
+ * of a pipe whose reader is extracting it (tar_extract_fd()), so
+ * download and unpack overlap; the reader must read to the end.
+ * Failures are reported on stderr as "prog: url: error".
+ *
+ * A job can carry the validators of a copy it already has; the request
+ * is then conditional, and a 304 reply (status) writes nothing.
+ */
+
+#define PKG_FETCH_CONNECTIONS 8
+
+typedef struct pkg_fetch {
+    const char *url;                    /* http(s)://, or file:// */
+    int fd;                             /* The body goes here; closed when done */
+    const char *if_none_match;          /* Sent unless NULL or "": an ETag, */
+    const char *if_modified_since;      /* a Last-Modified date */
+    int failed;                         /* Set if the transfer failed */
+    long status;                        /* HTTP status (0 for file://) */
+    char etag[128];                     /* The reply's validators, or "" */
+    char last_modified[64];
+    unsigned char digest[SHA256_DIGEST_LEN];   /* Of the whole body */
+} pkg_fetch_t;
+
+/*
+ * Run jobs[0..n) to completion, closing each fd as soon as its
+ * transfer ends so its reader sees the end of the data
+ * Returns: 0 if every transfer succeeded, -1 otherwise
+ */
+int pkg_fetch_all(pkg_fetch_t *jobs, size_t n, const char *prog);
+
+#endif /* PKG_FETCH_H */
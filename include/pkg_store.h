@@ -0,0 +1,39 @@
+#ifndef PKG_STORE_H
+#define PKG_STORE_H
+
+/*
+ * pkg_store.h - Content-addressed file store shared by installed packages
+ *
+ * ~/.mysh/store holds one object per distinct file content and mode:
+ *
+ *   store/ab/cdef...0123.555        BLAKE3 of the contents in hex, split
+ *                                   after two digits; then the mode
+ *
+ * Every regular file of an installed package is a hard link to its
+ * object, so a file that several packages, or several versions of one,
+ * carry is on disk once. Objects are read-only (write bits are cleared
+ * before a file is shared), since a change through one link would show
+ * in every package linking it. The first file linked as an object
+ * gives it its timestamps.
+ *
+ * An object no package links to any more has a link count of 1 and is
+ * removed by pkg_store_gc(). Errors are reported on stderr as
+ * "prog: path: error".
+ */
+
+/*
+ * Turn every regular file under dir (a package being installed, on the
+ * same filesystem as store) into a link to its object, adding objects
+ * for contents the store does not have yet. A file that cannot be
+ * shared is left as it is.
+ * Returns: 0, or -1 if any file could not be shared
+ */
+int pkg_store_link(const char *store, const char *dir, const char *prog);
+
+/*
+ * Remove the objects nothing else links to
+ * Returns: number removed, or -1 if the store could not be read
+ */
+int pkg_store_gc(const char *store, const char *prog);
+
+#endif /* PKG_STORE_H */
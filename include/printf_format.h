@@ -0,0 +1,46 @@
+#ifndef PRINTF_FORMAT_H
+#define PRINTF_FORMAT_H
+
+#include "pb_out.h"
+
+/*
+ * printf_format.h - Compiled formats for the printf command and builtin
+ *
+ * A format is split once into text (with its backslash escapes already
+ * resolved) and conversions (%[flags][width][.precision]C, where width
+ * and precision may be *), and the result is kept in a small cache
+ * keyed by the format's text. A loop that runs printf "%s: %d\n" $f $n
+ * on every iteration parses the format the first time only.
+ *
+ * Conversions are those of POSIX printf(1): d i o u x X c s b e E f F
+ * g G a A and %%. As in sh, the format is reused while arguments are
+ * left, a missing argument is "" or 0, a number may be given as 'C (the
+ * character's value), and \c (in the format, or in the argument of %b)
+ * ends all output.
+ */
+
+typedef struct printf_format printf_format_t;
+
+/*
+ * The compiled form of format, from the cache or compiled now (valid
+ * until a few more distinct formats have been compiled)
+ * bad: on an invalid conversion, set to its % in format; else NULL
+ * Returns: the format, or NULL if it is invalid or out of memory
+ */
+const printf_format_t *printf_format_get(const char *format, const char **bad);
+
+/*
+ * Write args through f to out, reusing f while arguments are left
+ * Returns: 0, or 1 if an argument was not a valid number (an error has
+ *          been printed, and the number read up to there is used)
+ */
+int printf_format_write(pb_out_t *out, const printf_format_t *f, char **args, int nargs);
+
+/*
+ * printf FORMAT [ARGUMENT]... on fp, as the command and the shell
+ * builtin both run it (argv[0] is "printf"; --help is the caller's)
+ * Returns: the exit status
+ */
+int printf_format_run(int argc, char **argv, FILE *fp);
+
+#endif /* PRINTF_FORMAT_H */
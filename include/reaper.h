@@ -0,0 +1,49 @@
+#ifndef REAPER_H
+#define REAPER_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/*
+ * reaper.h - Collect child processes in the order they exit
+ *
+ * Children are registered with reaper_watch(). reaper_collect() sleeps
+ * until at least one of them exits (pidfd + poll() on Linux, otherwise
+ * a SIGCHLD self-pipe) and reaps it; reaper_take() hands the result to
+ * whoever is interested in that pid. Only watched pids are ever reaped,
+ * so children waited for elsewhere with waitpid() are left alone.
+ */
+
+/*
+ * Start watching a child
+ * Returns: 0 on success, -1 on error (caller should waitpid() itself)
+ */
+int reaper_watch(pid_t pid);
+
+/*
+ * Reap watched children that have exited
+ *
+ * timeout_ms: how long to wait for the first exit (-1 = no limit, 0 = poll)
+ * Returns: number of children reaped, 0 on timeout or if nothing is
+ *          watched, -1 on error
+ */
+int reaper_collect(int timeout_ms);
+
+/*
+ * Claim the result for a watched child
+ *
+ * status/usage: filled in as by wait4() (either may be NULL)
+ * Returns: 1 if it exited (pid is no longer watched), 0 if still running,
+ *          -1 if pid is not watched
+ */
+int reaper_take(pid_t pid, int *status, struct rusage *usage);
+
+/*
+ * Stop watching everything, without reaping
+ *
+ * For a forked child (e.g. a background job's subshell): the entries it
+ * inherited are its parent's children, not its own.
+ */
+void reaper_forget_all(void);
+
+#endif /* REAPER_H */
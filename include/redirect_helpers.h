@@ -5,17 +5,44 @@
 #ifndef REDIRECT_HELPERS_H
 #define REDIRECT_HELPERS_H
 
+#include <stddef.h>
+
 /* Redirection types */
 #define REDIR_INPUT  0   /* < file */
 #define REDIR_OUTPUT 1   /* > file */
 #define REDIR_APPEND 2   /* >> file */
+#define REDIR_HEREDOC 3  /* <<EOF: filename is the document's text */
+#define REDIR_HERESTRING 4 /* <<< word: filename is the word */
 
 /* Redirection structure */
 struct redirection {
-    int type;            /* REDIR_INPUT, REDIR_OUTPUT, or REDIR_APPEND */
+    int type;            /* REDIR_INPUT, REDIR_OUTPUT, ... */
     const char *filename; /* File to redirect to/from */
 };
 
+/*
+ * A file in memory: a memfd where there is one, else an unlinked file
+ * in $TMPDIR (or /tmp). name only labels the memfd.
+ * Returns: its fd (close-on-exec), or -1
+ */
+int open_memory_file(const char *name);
+
+/*
+ * A here-document or here-string to read: text (and a newline if
+ * newline is set) in a memory file, positioned at its start. Being a
+ * file, it is seekable: commands that seek or map their input (tail's
+ * reverse scan, wc, grep) take their fast paths on it.
+ * Returns: its fd (close-on-exec), or -1 with a message printed
+ */
+int open_here_document(const char *text, size_t len, int newline);
+
+/*
+ * Open the target of a redirection without applying it
+ * target_fd is set to STDIN_FILENO or STDOUT_FILENO
+ * Returns: open fd on success, -1 on error
+ */
+int open_redirection(int type, const char *filename, int *target_fd);
+
 /*
  * Apply a single redirection
  * Returns: 0 on success, -1 on error
@@ -28,4 +55,37 @@ int apply_redirection(int type, const char *filename);
  */
 int apply_redirections(struct redirection *redirections, int count);
 
+/*
+ * Redirection scope: redirect the shell process's own stdin/stdout
+ * around an in-process command, then restore them
+ *
+ *   redir_scope_t scope;
+ *   if (redir_scope_open(&scope, redirs, count) == 0) {
+ *       status = run_builtin(...);
+ *       redir_scope_restore(&scope);
+ *   }
+ */
+typedef struct redir_scope {
+    int saved[2];        /* Saved stdin/stdout, -1 if not redirected */
+} redir_scope_t;
+
+/*
+ * Open the targets (O_CLOEXEC) and redirect to them
+ * Returns: 0 on success; -1 if a target could not be opened (message
+ *          printed, nothing redirected, nothing left open)
+ */
+int redir_scope_open(redir_scope_t *scope, struct redirection *redirs, int count);
+
+/*
+ * Redirect to fds that are already open (-1 = leave that stream alone)
+ * The caller keeps ownership of stdin_fd/stdout_fd.
+ * Returns: 0 on success, -1 on error (nothing redirected)
+ */
+int redir_scope_apply(redir_scope_t *scope, int stdin_fd, int stdout_fd);
+
+/*
+ * Flush stdout and restore the streams saved by the scope
+ */
+void redir_scope_restore(redir_scope_t *scope);
+
 #endif /* REDIRECT_HELPERS_H */
@@ -0,0 +1,61 @@
+#ifndef REGEX_DFA_H
+#define REGEX_DFA_H
+
+#include <stddef.h>
+
+/*
+ * regex_dfa.h - POSIX regular expressions matched by a lazy DFA
+ *
+ * A pattern is parsed (BRE as grep -G, or ERE as grep -E), compiled to
+ * a Thompson NFA, and matched by a DFA whose states are built from the
+ * NFA on first use and cached, so each input byte costs one table
+ * lookup. A literal every match must contain (e.g. "ERROR" in
+ * "^[0-9]+ ERROR (disk|net)") is found first (literal_search.h), and
+ * only lines containing it are run through the automaton.
+ *
+ * Supported: literals, ., [...] (ranges, negation, [:class:]), * + ?
+ * {m,n}, grouping, alternation, ^ $, and the GNU escapes \w \W \s \S.
+ * Back-references and word-boundary assertions are rejected at
+ * compile time.
+ *
+ * Matching updates the DFA cache, so a compiled pattern must not be
+ * searched from two threads at once.
+ */
+
+#define REGEX_EXTENDED 0x01   /* ERE syntax (default: BRE) */
+#define REGEX_ICASE    0x02   /* Ignore case */
+
+typedef struct regex_dfa regex_dfa_t;
+
+/*
+ * Compile a pattern
+ *
+ * errbuf: receives a message if the pattern is invalid
+ * Returns: compiled pattern, or NULL on error
+ */
+regex_dfa_t *regex_dfa_compile(const char *pattern, int flags,
+                               char *errbuf, size_t errlen);
+
+/*
+ * Compile patterns[0..n) into one automaton that matches where any of
+ * them does (grep -e A -e B); the input is still scanned only once.
+ * n == 0 gives a pattern that never matches.
+ */
+regex_dfa_t *regex_dfa_compile_set(const char *const *patterns, size_t n, int flags,
+                                   char *errbuf, size_t errlen);
+
+/*
+ * Find the first line of buf[0..len) that contains a match
+ *
+ * Lines are separated by '\n'; the last one need not end with it (a
+ * buffer ending in '\n' therefore has an empty last line).
+ * Returns: start of the matching line, or NULL if no line matches
+ */
+const char *regex_dfa_search(regex_dfa_t *re, const char *buf, size_t len);
+
+/*
+ * Free a compiled pattern
+ */
+void regex_dfa_free(regex_dfa_t *re);
+
+#endif /* REGEX_DFA_H */
@@ -0,0 +1,42 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * ring_buffer.h - Single-producer/single-consumer byte ring
+ *
+ * Connects two threads of a threaded pipeline. One thread writes, one
+ * reads; the indices are lock-free atomics and a thread only sleeps
+ * (on a condition variable) when the ring is full or empty.
+ */
+
+typedef struct ring_buffer ring_buffer_t;
+
+/* Create a ring holding at least capacity bytes (rounded up to a power of 2) */
+ring_buffer_t *ring_buffer_create(size_t capacity);
+
+/* Destroy a ring (both ends must be finished with it) */
+void ring_buffer_destroy(ring_buffer_t *rb);
+
+/*
+ * Write len bytes, blocking while the ring is full.
+ * Returns len, or -1 with errno = EPIPE once the reader has closed.
+ */
+ssize_t ring_buffer_write(ring_buffer_t *rb, const char *data, size_t len);
+
+/*
+ * Read up to len bytes, blocking while the ring is empty.
+ * Returns the byte count, or 0 at end of input (writer closed, or the
+ * reader closed its end early).
+ */
+ssize_t ring_buffer_read(ring_buffer_t *rb, char *data, size_t len);
+
+/* Producer is done: the reader sees end of input after draining */
+void ring_buffer_close_write(ring_buffer_t *rb);
+
+/* Consumer is done: further writes fail with EPIPE */
+void ring_buffer_close_read(ring_buffer_t *rb);
+
+#endif /* RING_BUFFER_H */
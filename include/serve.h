@@ -0,0 +1,63 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+/*
+ * serve.h - Resident picobox server (picobox --serve) and its protocol
+ *
+ * Starting picobox costs more than most of its commands: the dynamic
+ * linker maps and relocates argtable3 and libc into every process. The
+ * server pays that once. Clients (picobox-client, built from
+ * src/picobox_client.c and linked against libc only) connect to a unix
+ * socket and send one request per connection:
+ *
+ *   1. serve_request_t, sent with SCM_RIGHTS carrying the client's
+ *      stdin, stdout and stderr
+ *   2. payload_len bytes: cwd, then argc argv strings, then envc
+ *      "NAME=VALUE" strings, each NUL-terminated
+ *
+ * The server runs argv[0] from the command registry with those fds,
+ * that directory and that environment. It answers with an int32_t
+ * exit status.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define SERVE_MAGIC 0x70696362u          /* "picb" */
+#define SERVE_MAX_PAYLOAD (1u << 20)     /* argv + env + cwd */
+
+typedef struct serve_request {
+    uint32_t magic;
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t payload_len;
+} serve_request_t;
+
+/*
+ * Socket path: $PICOBOX_SOCKET, or /tmp/picobox-UID.sock
+ */
+static inline void serve_socket_path(char *buf, size_t size)
+{
+    const char *env = getenv("PICOBOX_SOCKET");
+
+    if (env && env[0]) {
+        snprintf(buf, size, "%s", env);
+    } else {
+        snprintf(buf, size, "/tmp/picobox-%ld.sock", (long)getuid());
+    }
+}
+
+/*
+ * Run the server until SIGINT/SIGTERM
+ *
+ * socket_path: NULL for serve_socket_path()
+ * Workers: $PICOBOX_SERVE_WORKERS (default 4) pre-forked processes
+ * accept connections; each request runs in a fork of its worker, so
+ * commands never see another request's state.
+ * Returns: exit status for main()
+ */
+int serve_main(const char *socket_path);
+
+#endif /* SERVE_H */
@@ -0,0 +1,37 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * sha256.h - SHA-256 (FIPS 180-4)
+ *
+ * Blocks are compressed with the SHA extensions where the CPU has them
+ * (SHA-NI on x86, checked at run time; the ARMv8 crypto extension when
+ * the compiler targets it), otherwise in portable C. PICOBOX_SIMD=scalar
+ * forces the portable code, for testing and benchmarks.
+ */
+
+#define SHA256_DIGEST_LEN 32
+
+typedef struct sha256_ctx {
+    uint32_t state[8];
+    uint64_t len;               /* Bytes hashed so far */
+    unsigned char buf[64];      /* Partial block */
+    size_t buffered;
+} sha256_ctx_t;
+
+void sha256_init(sha256_ctx_t *ctx);
+
+void sha256_update(sha256_ctx_t *ctx, const void *data, size_t len);
+
+/* Write the digest; ctx must be initialized again before reuse */
+void sha256_final(sha256_ctx_t *ctx, unsigned char digest[SHA256_DIGEST_LEN]);
+
+/*
+ * Name of the block function in use ("sha-ni", "armv8" or "scalar")
+ */
+const char *sha256_kernel(void);
+
+#endif /* SHA256_H */
@@ -0,0 +1,37 @@
+#ifndef TAR_EXTRACT_H
+#define TAR_EXTRACT_H
+
+/*
+ * tar_extract.h - In-process tar extraction with streaming gunzip
+ *
+ * Reads a tar archive (ustar, GNU long names, pax path/linkpath/size
+ * records), gzip-compressed or not, and writes its members straight
+ * into a directory: the archive is inflated block by block with zlib
+ * and each file's data written from the inflate buffer to the file,
+ * which was created with openat() and preallocated to its final size.
+ * Nothing is spawned and nothing is staged.
+ *
+ * Leading "/" is stripped from member names and members with a ".."
+ * component are refused, as GNU tar does. Symbolic links are created
+ * after every other member, so the archive cannot write through a link
+ * of its own making. Devices are skipped. Each failure is reported on
+ * stderr as "prog: member: error" and extraction carries on, except
+ * for a damaged archive, which stops it.
+ */
+
+/*
+ * Extract archive (relative to the current directory) into the
+ * directory dirfd
+ * Returns: 0 if every member was extracted, -1 otherwise
+ */
+int tar_extract_at(const char *archive, int dirfd, const char *prog);
+
+/*
+ * Extract the archive read from fd, which may be a pipe, into dirfd;
+ * name is for messages. Reading stops at the end-of-archive marker, so
+ * whatever follows it is left unread; fd is not closed.
+ * Returns: 0 if every member was extracted, -1 otherwise
+ */
+int tar_extract_fd(int fd, const char *name, int dirfd, const char *prog);
+
+#endif /* TAR_EXTRACT_H */
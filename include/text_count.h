@@ -0,0 +1,73 @@
+#ifndef TEXT_COUNT_H
+#define TEXT_COUNT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * text_count.h - Block counters for wc
+ *
+ * Lines, words and UTF-8 characters are counted 16 or 32 bytes at a
+ * time: each block is turned into bitmasks (newline, whitespace,
+ * character start) and the masks are popcounted. A word starts where a
+ * non-space byte follows a space, so the word mask needs one bit of
+ * carry from the previous block; the caller may feed a file in
+ * arbitrary pieces and get the same answer.
+ *
+ * Whitespace is the C locale's isspace() set. A character is any byte
+ * that is not a UTF-8 continuation byte (10xxxxxx). Line width (-L)
+ * counts one column per character and two for East Asian wide ones,
+ * tabs to the next multiple of 8, and restarts at '\r' and '\f';
+ * other control bytes take no space.
+ *
+ * The kernel is picked like literal_search.h's (AVX2, SSE2, NEON or
+ * scalar), and PICOBOX_SIMD forces one.
+ */
+
+#define TEXT_COUNT_LINES 0x01
+#define TEXT_COUNT_WORDS 0x02
+#define TEXT_COUNT_CHARS 0x04
+#define TEXT_COUNT_WIDTH 0x08
+
+typedef struct {
+    uint64_t lines;
+    uint64_t words;
+    uint64_t chars;
+    uint64_t max_width;   /* Widest line seen */
+    uint64_t width;       /* Columns so far on the current line */
+    int in_word;          /* The last byte seen was inside a word */
+    uint32_t cp;          /* Multibyte character being decoded for -L */
+    int need;             /* Continuation bytes it still needs */
+} text_count_t;
+
+/*
+ * Start counting a new input
+ */
+void text_count_init(text_count_t *tc);
+
+/*
+ * Continue an input split into ranges: the range about to be counted
+ * follows byte prev, so a word running across the split is counted
+ * once. Call right after text_count_init().
+ */
+void text_count_after(text_count_t *tc, unsigned char prev);
+
+/*
+ * Count the next piece of input, buf[0..len)
+ *
+ * what: TEXT_COUNT_* flags for the counts wanted; others may be left
+ * unchanged (lines alone skip the word and character masks)
+ */
+void text_count_block(text_count_t *tc, const char *buf, size_t len, int what);
+
+/*
+ * Finish the input: an unterminated last line still counts for -L
+ */
+void text_count_end(text_count_t *tc);
+
+/*
+ * Name of the kernel in use ("avx2", "sse2", "neon" or "scalar")
+ */
+const char *text_count_kernel(void);
+
+#endif /* TEXT_COUNT_H */
@@ -0,0 +1,43 @@
+/*
+ * thread_pipeline.h - Run an all-builtin pipeline on threads
+ *
+ * When every stage of a pipeline is a registry command flagged
+ * CMD_FLAG_STREAMS, the stages run as threads in the shell process,
+ * connected by in-memory ring buffers instead of pipe() + fork().
+ * Called by run_pipeline() when thread_pipeline_supported() agrees.
+ */
+
+#ifndef THREAD_PIPELINE_H
+#define THREAD_PIPELINE_H
+
+#include "cmd_spec.h"
+#include "pipe_helpers.h"
+
+/*
+ * Check whether a command can run as a pipeline thread
+ *
+ * Returns 1 if spec is flagged CMD_FLAG_STREAMS, 0 otherwise
+ */
+int thread_stage_supported(const cmd_spec_t *spec);
+
+/*
+ * Check whether a whole pipeline can run on threads
+ *
+ * Every stage must be supported, and no command may appear twice
+ * (commands keep their parsed arguments in file-scope argtables).
+ *
+ * Returns 1 if so, 0 otherwise
+ */
+int thread_pipeline_supported(const cmd_spec_t **specs, int count);
+
+/*
+ * Run the stages as threads and wait for all of them
+ *
+ * The first stage reads the shell's stdin and the last writes its
+ * stdout unless redirected. Redirection fds are closed when done.
+ * Fills in each stage's status and timings (stages with argv == NULL
+ * are skipped and keep the status set by the caller).
+ */
+void run_thread_pipeline(pipe_stage_t *stages, int count);
+
+#endif /* THREAD_PIPELINE_H */
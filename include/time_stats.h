@@ -0,0 +1,55 @@
+#ifndef TIME_STATS_H
+#define TIME_STATS_H
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/resource.h>
+
+/*
+ * time_stats.h - Resource usage of shell commands (`time`, PICOBOX_TIME_LOG)
+ *
+ * Every command child the shell reaps with wait4() is reported through
+ * time_stats_child(). A measurement between time_stats_begin() and
+ * time_stats_end() adds up those children and the shell's own usage
+ * (for commands run in-process or on pipeline threads).
+ */
+
+typedef struct time_stats {
+    double real_ms;
+    double user_ms;
+    double sys_ms;
+    long maxrss_kb;         /* Largest child, or the shell if none ran */
+    long nvcsw;             /* Voluntary context switches */
+    long nivcsw;            /* Involuntary context switches */
+} time_stats_t;
+
+/* Start of a measurement (filled in by time_stats_begin()) */
+typedef struct time_mark {
+    struct timespec start;
+    struct rusage self;
+    time_stats_t children;  /* Child totals so far */
+    unsigned long reaped;   /* Children reaped so far */
+    long saved_maxrss;      /* Outer measurement's largest child */
+} time_mark_t;
+
+/* Record a reaped command child (usage as filled in by wait4()) */
+void time_stats_child(const struct rusage *usage);
+
+/*
+ * Measure what runs between begin and end
+ * Measurements may nest; end them in reverse order.
+ */
+void time_stats_begin(time_mark_t *mark);
+void time_stats_end(const time_mark_t *mark, time_stats_t *out);
+
+/* Report for the `time` builtin */
+void time_stats_print(FILE *out, const time_stats_t *stats);
+
+/*
+ * Per-command log (PICOBOX_TIME_LOG=FILE): one line per command,
+ *   real_ms user_ms sys_ms maxrss_kb nvcsw nivcsw status command
+ */
+int time_stats_log_enabled(void);
+void time_stats_log(const time_stats_t *stats, int status, const char *command);
+
+#endif /* TIME_STATS_H */
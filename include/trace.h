@@ -0,0 +1,37 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * trace.h - Execution trace for Perfetto / chrome://tracing
+ *
+ * PICOBOX_TRACE=FILE writes Trace Event Format JSON to FILE: a span for
+ * each parse, AST walk, command, variable expansion, redirection, spawn
+ * or fork and wait, plus an instant event where a forked child execs.
+ * Every event is a single O_APPEND write(), so forked children and
+ * pipeline threads can add to the same file; the closing ']' is
+ * optional in that format and never written.
+ *
+ * When PICOBOX_TRACE is unset, each TRACE_* macro is one test of
+ * trace_fd.
+ */
+
+extern int trace_fd;    /* -1 = tracing disabled */
+
+/* Open $PICOBOX_TRACE if set (called once from main()) */
+void trace_init(void);
+
+/*
+ * Write one event
+ * phase: 'B' (begin span), 'E' (end span) or 'i' (instant)
+ * detail: shown as args.detail, or NULL
+ */
+void trace_event(const char *name, char phase, const char *detail);
+
+#define TRACE_BEGIN(name, detail) \
+    do { if (trace_fd >= 0) trace_event((name), 'B', (detail)); } while (0)
+#define TRACE_END(name) \
+    do { if (trace_fd >= 0) trace_event((name), 'E', NULL); } while (0)
+#define TRACE_INSTANT(name, detail) \
+    do { if (trace_fd >= 0) trace_event((name), 'i', (detail)); } while (0)
+
+#endif /* TRACE_H */
@@ -0,0 +1,32 @@
+#ifndef TREE_COPY_H
+#define TREE_COPY_H
+
+/*
+ * tree_copy.h - Parallel recursive copy
+ *
+ * The tree is walked in parallel (walk.h), files handed out as well as
+ * directories: every directory is held open on both sides and its
+ * entries are opened, created and stat'ed relative to those
+ * descriptors (openat(), mkdirat(), fstatat()). A directory is created
+ * before any of its entries are queued, so workers never race their
+ * parent; files are copied with copy_file_at(), in parallel.
+ *
+ * Directories get their source's permissions once everything in them
+ * has been copied (until then they stay writable, so a read-only
+ * source directory can still be filled). Symbolic links are copied as
+ * links and FIFOs recreated; other special files are reported and
+ * skipped. Every failure is reported on stderr as "prog: path: error"
+ * and the copy carries on with the rest of the tree.
+ */
+
+/*
+ * Copy src (a directory or a single file; a symbolic link named by src
+ * itself is followed) to dest. An existing dest directory is copied
+ * into, merging with what is there. Names are relative to the given
+ * directory descriptors, or AT_FDCWD.
+ * Returns: 0 if everything was copied, -1 if anything failed
+ */
+int tree_copy_at(int src_dirfd, const char *src, int dest_dirfd, const char *dest,
+                 const char *prog);
+
+#endif /* TREE_COPY_H */
@@ -0,0 +1,24 @@
+#ifndef TREE_REMOVE_H
+#define TREE_REMOVE_H
+
+/*
+ * tree_remove.h - Parallel recursive removal
+ *
+ * Directories are opened once and emptied with unlinkat() relative to
+ * their descriptor, the type of each entry coming from the listing
+ * where the filesystem reports it, so nothing is stat'ed. Sibling
+ * subtrees are emptied at the same time on the parallel walk (walk.h);
+ * a directory is removed by whichever thread finishes its last
+ * subdirectory. Symbolic links are removed, never followed. Failures
+ * are reported on stderr as "prog: path: error"; whatever can be
+ * removed still is.
+ */
+
+/*
+ * Remove path (relative to dirfd, or AT_FDCWD) and, if it is a
+ * directory, everything in it
+ * Returns: 0 if everything was removed, -1 if anything failed
+ */
+int tree_remove_at(int dirfd, const char *path, const char *prog);
+
+#endif /* TREE_REMOVE_H */
@@ -1,6 +1,7 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stdio.h>
 #include <sys/types.h>
 #include <time.h>
 
@@ -53,6 +54,15 @@ int str_starts_with(const char *str, const char *prefix);
  */
 char *trim_whitespace(char *str);
 
+/**
+ * Find the last byte c in s[0..n) (memrchr(), which Darwin's libc lacks)
+ * @param s Bytes to search
+ * @param c Byte to find
+ * @param n Length of s
+ * @return Pointer to it, or NULL if there is none
+ */
+void *mem_rchr(const void *s, int c, size_t n);
+
 
 /* ===== Path Manipulation ===== */
 
@@ -104,12 +114,149 @@ int file_exists(const char *path);
 
 /**
  * Copy file from src to dest
+ *
+ * A regular file is reflinked where the filesystem can share blocks
+ * (FICLONE, clonefile()), else copied in the kernel with
+ * copy_file_range() or through a 1 MB buffer; holes are skipped
+ * (SEEK_DATA/SEEK_HOLE) so sparse files stay sparse.
+ *
  * @param src Source file path
  * @param dest Destination file path
  * @return Number of bytes copied, or -1 on error
  */
 ssize_t copy_file(const char *src, const char *dest);
 
+/**
+ * Copy file as copy_file(), with names relative to directory fds
+ * @param src_dirfd Directory src is relative to (or AT_FDCWD)
+ * @param src Source file name
+ * @param dest_dirfd Directory dest is relative to (or AT_FDCWD)
+ * @param dest Destination file name
+ * @param mode Permissions for a new dest, or (mode_t)-1 for the source's
+ * @return Number of bytes copied, or -1 on error
+ */
+ssize_t copy_file_at(int src_dirfd, const char *src, int dest_dirfd, const char *dest,
+                     mode_t mode);
+
+/**
+ * Check whether a stdio stream holds input read ahead from its fd
+ *
+ * A command may read a stream's descriptor directly (splice(), read())
+ * only when nothing is buffered in front of it: the shell's stdin holds
+ * the rest of the script it was fed. Known for glibc and the BSD stdio;
+ * elsewhere the answer is always yes.
+ *
+ * @param fp Input stream
+ * @return 1 if bytes may be buffered, 0 if the fd is where input resumes
+ */
+int stream_input_pending(FILE *fp);
+
+
+/* ===== Line Reading ===== */
+
+/**
+ * Reader handing out lines as (pointer, length) views into one large
+ * buffer: no copy per line and no line-length limit (the buffer grows
+ * to hold the longest line). Views include the line's '\n', if it has
+ * one, and stay valid until the next call on the reader.
+ */
+typedef struct line_reader {
+    int fd;            /* read() this, or -1 to read fp */
+    FILE *fp;
+    char *buf;
+    size_t cap;
+    size_t start;      /* Unconsumed input is buf[start..end) */
+    size_t end;
+    size_t scanned;    /* buf[start..scanned) holds no delim */
+    int delim;         /* Ends a line: '\n', or '\0' for NUL-separated paths */
+    int eof;
+    void *src;         /* Read instead of fd/fp if set (line_reader_set_source()) */
+    ssize_t (*src_read)(void *src, char *buf, size_t len);
+    void (*src_close)(void *src);
+} line_reader_t;
+
+/**
+ * Set up a reader on a file descriptor, read() a large block at a time
+ * @param lr Reader to initialize
+ * @param fd Descriptor to read (not closed by the reader)
+ * @return 0, or -1 if out of memory
+ */
+int line_reader_init_fd(line_reader_t *lr, int fd);
+
+/**
+ * Set up a reader on a stdio stream
+ *
+ * The stream is read one line per fill, under one lock: fread() would
+ * wait for a whole block, so a slow writer (a terminal, tail -f
+ * feeding a threaded pipeline) would not see its lines handled as they
+ * come, and nothing after the current line is taken out of the
+ * stream's buffer (the shell reads on from its stdin). With another
+ * line end (line_reader_set_delim()) the stream is read a block at a
+ * time like a descriptor.
+ *
+ * @param lr Reader to initialize
+ * @param fp Stream to read (not closed by the reader)
+ * @return 0, or -1 if out of memory
+ */
+int line_reader_init_stream(line_reader_t *lr, FILE *fp);
+
+/**
+ * Buffer at least n bytes of input without taking them, fewer only at
+ * end of input or, on a stream, at the end of the current line
+ * @param lr Reader
+ * @param n Bytes wanted
+ * @param data Set to the start of the buffered input
+ * @return Bytes buffered, or -1 on error (errno set)
+ */
+ssize_t line_reader_peek(line_reader_t *lr, size_t n, const char **data);
+
+/**
+ * Read through read_fn(src, ...) from now on instead of the descriptor
+ * or stream: src has taken over what is buffered, which is dropped
+ * (line_reader_decompress(), decompress.h). line_reader_free() calls
+ * close_fn(src).
+ * @param lr Reader
+ * @param src Source handed to read_fn and close_fn
+ * @param read_fn Reads as read() does
+ * @param close_fn Releases src
+ */
+void line_reader_set_source(line_reader_t *lr, void *src,
+                            ssize_t (*read_fn)(void *src, char *buf, size_t len),
+                            void (*close_fn)(void *src));
+
+/**
+ * End lines with delim instead of '\n' (find -print0 output is '\0'
+ * separated); call before taking any lines
+ * @param lr Reader
+ * @param delim Line end
+ */
+void line_reader_set_delim(line_reader_t *lr, int delim);
+
+/**
+ * Get the next line
+ * @param lr Reader
+ * @param line Set to the start of the line
+ * @param len Set to its length, including any line end
+ * @return 1 for a line, 0 at end of input, -1 on error (errno set)
+ */
+int line_reader_next(line_reader_t *lr, const char **line, size_t *len);
+
+/**
+ * Get every whole line buffered so far, at least one: the span from
+ * the next line to the last line end read (or to end of input)
+ * @param lr Reader
+ * @param data Set to the start of the span
+ * @param len Set to its length
+ * @return 1 for a span, 0 at end of input, -1 on error (errno set)
+ */
+int line_reader_lines(line_reader_t *lr, const char **data, size_t *len);
+
+/**
+ * Release the reader's buffer
+ * @param lr Reader
+ */
+void line_reader_free(line_reader_t *lr);
+
 
 /* ===== Human-Readable Formatting ===== */
 
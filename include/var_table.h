@@ -6,25 +6,19 @@
 /*
  * var_table.h - Shell variable storage
  *
- * Simple hash table for storing shell variables (e.g., FOO=bar).
+ * Hash table for storing shell variables (e.g., FOO=bar). It grows with
+ * the number of variables: when it gets full a bucket array twice the
+ * size is started and entries move over a few buckets per set/unset, so
+ * no single call pays for a whole rehash. Names are interned (each
+ * distinct name is stored once, with its hash) and entries are matched
+ * by pointer, not strcmp().
+ *
  * Thread-safe for concurrent reads, but writes must be synchronized externally.
  */
 
-/* Variable entry in hash table (linked list for collision resolution) */
-typedef struct var_entry {
-    char *name;
-    char *value;
-    struct var_entry *next;
-} var_entry_t;
-
-/* Variable hash table */
-typedef struct var_table {
-    size_t size;
-    size_t count;
-    var_entry_t **buckets;
-} var_table_t;
-
-/* Create new variable table with given size */
+typedef struct var_table var_table_t;
+
+/* Create new variable table with given initial size (0 = default) */
 var_table_t *var_table_create(size_t size);
 
 /* Destroy variable table and free all entries */
@@ -39,4 +33,12 @@ const char *var_table_get(var_table_t *table, const char *name);
 /* Unset (remove) variable */
 int var_table_unset(var_table_t *table, const char *name);
 
+/* Number of variables */
+size_t var_table_count(const var_table_t *table);
+
+/* Call callback for every variable (in no particular order) */
+void var_table_foreach(var_table_t *table,
+                       void (*callback)(const char *name, const char *value, void *userdata),
+                       void *userdata);
+
 #endif /* VAR_TABLE_H */
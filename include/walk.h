@@ -0,0 +1,106 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+/*
+ * walk.h - Directory tree walker
+ *
+ * One engine for the commands that go through trees (cp -r, rm -r, du,
+ * find). Directories are opened relative to their parent's descriptor,
+ * listed in large batches (getdents64() on Linux, readdir() elsewhere),
+ * and an entry is stat'ed only if the caller asks for it or its type
+ * is not in d_type. No path is put together with snprintf() into a
+ * fixed buffer: each directory keeps its path, and an entry's is built
+ * from it at any length.
+ *
+ * The callback sees every entry once: a directory before its entries
+ * (WALK_PRE) and again after all of them (WALK_POST), anything else as
+ * WALK_LEAF, and what could not be stat'ed or opened as WALK_ERROR. A
+ * directory stays open until its post-order visit, so callbacks can
+ * use the *at() calls on e->dirfd (the directory the entry is in) and
+ * e->fd (a directory's own).
+ *
+ * Serially the walk is depth first in directory order. With
+ * WALK_PARALLEL subdirectories (and with WALK_SPREAD every entry) are
+ * handed out on a work-stealing pool (work_pool.h): the callback runs
+ * on several threads at once, in no particular order, except that a
+ * directory's WALK_PRE still comes before and its WALK_POST after
+ * everything in it.
+ */
+
+/* Entry types */
+enum {
+    WALK_T_DIR,
+    WALK_T_REG,
+    WALK_T_LNK,
+    WALK_T_OTHER
+};
+
+/* Visits */
+enum {
+    WALK_PRE,     /* A directory, before its entries */
+    WALK_POST,    /* A directory, after its entries */
+    WALK_LEAF,    /* Anything not descended into */
+    WALK_ERROR    /* Not stat'ed or not opened: e->error says why */
+};
+
+/* Callback results */
+enum {
+    WALK_CONTINUE,
+    WALK_SKIP,    /* From WALK_PRE: leave its entries out (and no WALK_POST) */
+    WALK_STOP     /* End the walk */
+};
+
+/* Flags */
+#define WALK_STAT          0x01   /* Stat every entry (e->st never NULL) */
+#define WALK_FOLLOW        0x02   /* Follow symbolic links (loops are WALK_ERROR, ELOOP) */
+#define WALK_FOLLOW_ROOTS  0x04   /* Follow symbolic links given as roots */
+#define WALK_PARALLEL      0x08   /* Walk on a thread pool */
+#define WALK_SPREAD        0x10   /* With WALK_PARALLEL, hand out files too, not only
+                                     directories (for callbacks with real work per file) */
+
+typedef struct walk_entry {
+    int visit;              /* WALK_PRE, ... */
+    int type;               /* WALK_T_*; for WALK_ERROR as far as known */
+    int error;              /* WALK_ERROR: errno */
+    const char *path;       /* Root as given, then "/name" per level */
+    size_t path_len;
+    const char *name;       /* Name in dirfd (a root: its path) */
+    int dirfd;              /* Directory the entry is in, or the walk's dirfd */
+    int fd;                 /* WALK_PRE/WALK_POST: the directory itself */
+    int depth;              /* 0 for a root */
+    int worker;             /* Calling thread, 0..nworkers-1 */
+    const struct stat *st;  /* NULL unless stat'ed */
+    void *data;             /* WALK_PRE/WALK_POST, and WALK_ERROR for a directory
+                               opened but not listed: the directory's data */
+    void *parent_data;      /* Data of the directory the entry is in (NULL: root) */
+} walk_entry_t;
+
+typedef int (*walk_fn_t)(const walk_entry_t *e, void *arg);
+
+/*
+ * Optional test of an entry that is not a directory, by its name and
+ * type alone (arg is walk()'s): those it returns 0 for are passed over
+ * without a visit, before their path is even put together
+ */
+typedef int (*walk_filter_t)(const char *name, int type, void *arg);
+
+typedef struct walk_opts {
+    int flags;              /* WALK_* */
+    int nworkers;           /* With WALK_PARALLEL; 0 for one per CPU */
+    size_t data_size;       /* Zeroed bytes kept per directory for the callback */
+    walk_filter_t filter;   /* NULL: visit everything */
+} walk_opts_t;
+
+/*
+ * Walk the trees at roots[0..nroots), names relative to dirfd (or
+ * AT_FDCWD)
+ * Returns: 0 when done, WALK_STOP if the callback ended it, -1 if the
+ * walk could not be started (errno set)
+ */
+int walk(int dirfd, const char *const *roots, int nroots, const walk_opts_t *opts,
+         walk_fn_t fn, void *arg);
+
+#endif /* WALK_H */
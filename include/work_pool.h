@@ -0,0 +1,54 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+/*
+ * work_pool.h - Work-stealing thread pool for item-at-a-time jobs
+ *
+ * Each worker has its own queue. A worker takes its newest item first
+ * (so a tree walk goes depth first and stays small), and when its queue
+ * is empty steals the oldest item from another worker, which is
+ * usually the largest remaining piece of work (a directory near the
+ * root). Items are opaque to the pool; handling one may push more,
+ * and the pool is finished once every queue is empty and no item is
+ * still being handled.
+ */
+
+typedef struct work_pool work_pool_t;
+
+/*
+ * Handle one item. worker is 0..nworkers-1 and identifies the calling
+ * thread, for per-thread state in arg.
+ */
+typedef void (*work_fn_t)(work_pool_t *pool, int worker, void *item, void *arg);
+
+/*
+ * Create a pool of nworkers threads (the thread calling work_pool_run()
+ * is worker 0)
+ * Returns: pool, or NULL if out of memory
+ */
+work_pool_t *work_pool_create(int nworkers, work_fn_t fn, void *arg);
+
+/*
+ * Queue an item (not NULL) on a worker's queue; from outside the pool,
+ * any worker
+ * Returns: 0 on success, -1 if out of memory
+ */
+int work_pool_push(work_pool_t *pool, int worker, void *item);
+
+/*
+ * Handle every item, including the ones pushed while running, then
+ * return. Workers that cannot be started are done without; worst case
+ * the calling thread does all of it.
+ */
+void work_pool_run(work_pool_t *pool);
+
+/*
+ * Number of workers a pool of nworkers would default to for 0: one
+ * per online CPU
+ */
+int work_pool_default_workers(void);
+
+/* Free a pool after work_pool_run() */
+void work_pool_destroy(work_pool_t *pool);
+
+#endif /* WORK_POOL_H */
@@ -0,0 +1,41 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include <sys/types.h>
+
+/*
+ * zygote.h - Launch external commands from a small pre-forked process
+ *
+ * fork() copies the page tables of the process calling it, so forking
+ * the shell gets slower as its history and variable tables grow. With
+ * PICOBOX_SPAWN=zygote the shell forks a helper once, at start-up while
+ * it is still small, and asks it over a socketpair to start each
+ * external command. The helper creates the command with
+ * clone(CLONE_PARENT), so the command is the shell's own child: waitpid(),
+ * the reaper and jobs work exactly as with fork().
+ *
+ * Linux only (CLONE_PARENT); elsewhere zygote_spawn() always reports
+ * the zygote as unavailable and callers fall back to posix_spawn().
+ */
+
+/*
+ * Start the zygote if it is not running yet
+ * Call early, before the shell allocates much.
+ * Returns: 0 on success, -1 if it could not be started
+ */
+int zygote_start(void);
+
+/*
+ * Launch path with argv/envp through the zygote (no wait)
+ *
+ * The command gets the shell's current directory, stdin_fd/stdout_fd
+ * (-1 to use the shell's own) and the shell's stderr; it inherits no
+ * other fds.
+ * Returns: child pid, -1 if the zygote is not available (nothing was
+ *          started, errno unchanged), or -2 with errno set if the
+ *          program could not be executed
+ */
+pid_t zygote_spawn(const char *path, char **argv, char **envp,
+                   int stdin_fd, int stdout_fd);
+
+#endif /* ZYGOTE_H */
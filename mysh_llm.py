@@ -9,11 +9,20 @@ This script provides natural language to shell command translation using:
 
 Usage:
     python3 mysh_llm.py "show me all files"
+    python3 mysh_llm.py --serve
+
+With --serve it stays running: the catalog is loaded once, then each
+line read from stdin is a query, answered with one line on stdout. The
+shell starts it this way on the first @ query and keeps it for the
+session, so later queries cost only the model call. The shell ranks the
+commands itself (a BM25 index in command_index.c), so a line may be
+"query<TAB>name1 name2 ...": the prompt then describes those commands.
 
 Environment Variables:
     OPENAI_API_KEY     - OpenAI API key (optional, uses fallback if not set)
     AI_SHELL           - Alternative API key (same as cmd_ai.c uses)
     MYSH_PATH          - Path to picobox binary (default: picobox)
+    MYSH_CATALOG_FILE  - Catalog file to read instead (the shell sets it for --serve)
     MYSH_CATALOG_CMD   - Command to get catalog (default: ./build/picobox --commands-json)
     MYSH_LLM_MODEL     - OpenAI model (default: gpt-4o-mini)
     MYSH_LLM_DEBUG     - Enable debug output (set to 1)
@@ -22,6 +31,7 @@ Environment Variables:
 import os
 import sys
 import json
+import mmap
 import subprocess
 from typing import List, Optional, Dict, Any
 from dataclasses import dataclass
@@ -82,19 +92,45 @@ def load_catalog_from_file(filename: str = "commands.json") -> Optional[str]:
         return None
 
 
+def map_catalog_file(filename: str) -> Optional[str]:
+    """
+    Read the catalog file the shell keeps (~/.mysh/catalog-<hash>.json,
+    see command_catalog.h) through mmap: no process to spawn and no
+    JSON for the shell to format
+
+    Returns JSON string or None if it cannot be read
+    """
+    try:
+        with open(filename, 'rb') as f:
+            with mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as m:
+                return m[:].decode('utf-8')
+    except (OSError, ValueError) as e:
+        debug_print(f"Cannot map catalog file {filename}: {e}")
+        return None
+
+
 def load_command_catalog() -> List[CommandInfo]:
     """
     Load the command catalog using available methods
 
     Tries (in order):
-    1. Run catalog command (picobox --commands-json)
-    2. Load from commands.json file
-    3. Return empty list
+    1. Map the shell's catalog file ($MYSH_CATALOG_FILE)
+    2. Run catalog command (picobox --commands-json)
+    3. Load from commands.json file
+    4. Return empty list
 
     Returns list of CommandInfo objects
     """
+    json_str = None
+
+    # The file the shell passes its helper
+    catalog_file = os.environ.get('MYSH_CATALOG_FILE')
+    if catalog_file:
+        json_str = map_catalog_file(catalog_file)
+
     # Try running catalog command
-    json_str = run_catalog_command()
+    if not json_str:
+        json_str = run_catalog_command()
 
     # Fallback to file
     if not json_str:
@@ -178,19 +214,21 @@ def select_relevant_commands(query: str, catalog: List[CommandInfo], k: int = 5)
     return [cmd for cmd, score in scored[:k]]
 
 
-def build_prompt(query: str, catalog: List[CommandInfo]) -> str:
+def build_prompt(query: str, catalog: List[CommandInfo],
+                 relevant: Optional[List[CommandInfo]] = None) -> str:
     """
     Build the prompt for the LLM
 
     Includes:
     - System instructions
-    - Relevant command documentation (RAG context)
+    - Relevant command documentation (RAG context): the given commands,
+      else the top 5 by score_command()
     - User query
 
     Returns formatted prompt string
     """
-    # Get top 5 relevant commands
-    relevant = select_relevant_commands(query, catalog, k=5)
+    if relevant is None:
+        relevant = select_relevant_commands(query, catalog, k=5)
 
     # Build command documentation
     cmd_docs = []
@@ -222,6 +260,22 @@ Command:"""
     return prompt
 
 
+_openai_clients: Dict[str, Any] = {}
+
+
+def openai_client(api_key: str) -> Any:
+    """
+    The openai client for api_key, made once, so a long-running helper
+    keeps its connection pool (and open connection) between queries
+
+    Raises ImportError if the openai library is not installed
+    """
+    if api_key not in _openai_clients:
+        import openai
+        _openai_clients[api_key] = openai.OpenAI(api_key=api_key)
+    return _openai_clients[api_key]
+
+
 def call_llm(prompt: str) -> Optional[str]:
     """
     Call OpenAI API to get command suggestion
@@ -239,8 +293,7 @@ def call_llm(prompt: str) -> Optional[str]:
     try:
         # Use openai library if available
         try:
-            import openai
-            client = openai.OpenAI(api_key=api_key)
+            client = openai_client(api_key)
 
             response = client.chat.completions.create(
                 model=model,
@@ -345,22 +398,25 @@ def heuristic_suggestion(query: str, catalog: List[CommandInfo]) -> str:
     return 'help'
 
 
-def suggest_command(query: str) -> str:
+def suggest_command(query: str, catalog: Optional[List[CommandInfo]] = None,
+                    relevant: Optional[List[CommandInfo]] = None) -> str:
     """
     Main function: suggest a command for the given query
 
     Process:
-    1. Load command catalog
-    2. Try LLM (if API key available)
+    1. Load command catalog (unless given one)
+    2. Try LLM (if API key available), describing the relevant commands
+       (chosen from the catalog unless given)
     3. Fall back to heuristic
 
     Returns suggested command string
     """
     # Load catalog
-    catalog = load_command_catalog()
+    if catalog is None:
+        catalog = load_command_catalog()
 
     # Build prompt
-    prompt = build_prompt(query, catalog)
+    prompt = build_prompt(query, catalog, relevant)
 
     # Try LLM first
     suggestion = call_llm(prompt)
@@ -373,19 +429,57 @@ def suggest_command(query: str) -> str:
     return suggestion
 
 
+def serve() -> int:
+    """
+    Answer queries until stdin ends: one query per line in, one
+    suggestion per line out, flushed at once
+    """
+    catalog = load_command_catalog()
+    by_name = {cmd.name: cmd for cmd in catalog}
+
+    for line in sys.stdin:
+        query, _, names = line.partition('\t')
+        query = query.strip()
+        if not query:
+            suggestion = "echo 'LLM helper: empty query'"
+        else:
+            try:
+                relevant = None
+                if names.split():
+                    # A command installed since the catalog was loaded
+                    if any(name not in by_name for name in names.split()):
+                        catalog = load_command_catalog()
+                        by_name = {cmd.name: cmd for cmd in catalog}
+                    relevant = [by_name[name] for name in names.split() if name in by_name]
+                suggestion = suggest_command(query, catalog, relevant)
+            except Exception as e:
+                debug_print(f"Query failed: {e}")
+                suggestion = ""
+
+        # The shell reads exactly one line per query
+        lines = (suggestion or "").strip().splitlines()
+        print(lines[0] if lines else "", flush=True)
+
+    return 0
+
+
 def main(argv: List[str]) -> int:
     """
     Entry point
 
     Usage: mysh_llm.py <query>
+           mysh_llm.py --serve
     Prints suggestion to stdout (single line, no newline at end)
 
     Returns 0 on success, 1 on error
     """
     if len(argv) < 2:
-        print("Usage: mysh_llm.py <natural language query>", file=sys.stderr)
+        print("Usage: mysh_llm.py <natural language query> | --serve", file=sys.stderr)
         return 1
 
+    if argv[1] == '--serve':
+        return serve()
+
     query = ' '.join(argv[1:])
 
     if not query.strip():
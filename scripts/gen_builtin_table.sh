@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# gen_builtin_table.sh - Generate the built-in command table
+#
+# Usage: gen_builtin_table.sh src/commands/cmd_*.c > builtin_table.c
+#
+# Finds the cmd_spec_t definition and its .name in every command source
+# and writes them out as one array sorted by name (byte order, the same
+# as strcmp()), so the registry can binary-search it without any
+# registration work at startup.
+
+set -e
+
+awk '
+    /cmd_spec_t [A-Za-z0-9_]+_spec = \{/ {
+        for (i = 1; i <= NF; i++) {
+            if ($i ~ /_spec$/) {
+                spec = $i
+            }
+        }
+    }
+    spec != "" && /\.name = "/ {
+        split($0, quoted, "\"")
+        print quoted[2], spec
+        spec = ""
+    }
+' "$@" | LC_ALL=C sort | awk '
+    BEGIN {
+        print "/* Generated by scripts/gen_builtin_table.sh - do not edit */"
+        print ""
+        print "#include \"cmd_spec.h\""
+        print ""
+    }
+    {
+        name[NR] = $1
+        spec[NR] = $2
+        print "extern cmd_spec_t " $2 ";"
+    }
+    END {
+        print ""
+        print "/* Sorted by command name */"
+        print "const cmd_spec_t *const builtin_commands[] = {"
+        for (i = 1; i <= NR; i++) {
+            printf "    &%s,%*s/* %s */\n", spec[i], 24 - length(spec[i]), "", name[i]
+        }
+        print "};"
+        print ""
+        print "const size_t builtin_command_count = sizeof(builtin_commands) / sizeof(builtin_commands[0]);"
+    }
+'
@@ -0,0 +1,217 @@
+/*
+ * ai_cache.c - On-disk cache of AI answers
+ *
+ * The file is mapped once per process and stays mapped, so a lookup is
+ * hashing the key, taking the lock and comparing at most
+ * AI_CACHE_WAYS keys: microseconds, against seconds for a model. The
+ * lock is held for lookups too, since they update the LRU clock.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* strndup(), flock() */
+#endif
+
+#include "ai_cache.h"
+#include "cmd_spec.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define AI_CACHE_SIZE (sizeof(ai_cache_hdr_t) + \
+                       (size_t)AI_CACHE_SETS * AI_CACHE_WAYS * sizeof(ai_cache_slot_t))
+
+static int cache_fd = -1;
+static ai_cache_hdr_t *cache_hdr = NULL;
+static int cache_failed = 0;            /* Not opened, and not worth trying again */
+
+/* Hash str and its NUL, so neighbouring fields cannot run together */
+static void hash_field(sha256_ctx_t *ctx, const char *str)
+{
+    if (!str) {
+        str = "";
+    }
+    sha256_update(ctx, str, strlen(str) + 1);
+}
+
+static void hash_command(const cmd_spec_t *spec, void *arg)
+{
+    hash_field(arg, spec->name);
+    hash_field(arg, spec->summary);
+}
+
+void ai_cache_key(ai_cache_key_t *key, const char *model, const char *system_prompt,
+                  const char *query)
+{
+    sha256_ctx_t ctx;
+    char *norm = malloc(strlen(query) + 1);
+    size_t len = 0;
+
+    sha256_init(&ctx);
+    hash_field(&ctx, model);
+    hash_field(&ctx, system_prompt);
+
+    if (norm) {
+        for (const char *p = query; *p; p++) {
+            if (isspace((unsigned char)*p)) {
+                if (len > 0 && norm[len - 1] != ' ') {
+                    norm[len++] = ' ';
+                }
+            } else {
+                norm[len++] = (char)tolower((unsigned char)*p);
+            }
+        }
+        while (len > 0 && strchr(" ?.!", norm[len - 1])) {
+            len--;
+        }
+        norm[len] = '\0';
+    }
+    hash_field(&ctx, norm ? norm : query);
+    free(norm);
+
+    for_each_command(hash_command, &ctx);
+    sha256_final(&ctx, key->hash);
+}
+
+/*
+ * Map ~/.mysh/ai_cache.db, creating it (or starting it afresh, if it
+ * is of another version or size) the first time
+ * Returns: its header, or NULL
+ */
+static ai_cache_hdr_t *cache_open(void)
+{
+    const char *home = getenv("HOME");
+    char path[512];
+    ai_cache_hdr_t hdr;
+    struct stat st;
+    void *map;
+    int fd;
+
+    if (cache_hdr || cache_failed) {
+        return cache_hdr;
+    }
+    cache_failed = 1;
+    if (!home || !*home) {
+        return NULL;
+    }
+    snprintf(path, sizeof(path), "%s/.mysh", home);
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        return NULL;
+    }
+    snprintf(path, sizeof(path), "%s/.mysh/ai_cache.db", home);
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    flock(fd, LOCK_EX);
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != AI_CACHE_SIZE ||
+        pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+        hdr.magic != AI_CACHE_MAGIC || hdr.version != AI_CACHE_VERSION ||
+        hdr.sets != AI_CACHE_SETS || hdr.ways != AI_CACHE_WAYS) {
+        /* Truncating first leaves every slot zero, i.e. empty */
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.magic = AI_CACHE_MAGIC;
+        hdr.version = AI_CACHE_VERSION;
+        hdr.sets = AI_CACHE_SETS;
+        hdr.ways = AI_CACHE_WAYS;
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)AI_CACHE_SIZE) != 0 ||
+            pwrite(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+            flock(fd, LOCK_UN);
+            close(fd);
+            return NULL;
+        }
+    }
+    map = mmap(NULL, AI_CACHE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    flock(fd, LOCK_UN);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    cache_fd = fd;
+    cache_hdr = map;
+    cache_failed = 0;
+    return cache_hdr;
+}
+
+/* The set key belongs in */
+static ai_cache_slot_t *cache_set(ai_cache_hdr_t *hdr, const ai_cache_key_t *key)
+{
+    uint32_t set = ((uint32_t)key->hash[0] | (uint32_t)key->hash[1] << 8) % AI_CACHE_SETS;
+
+    return (ai_cache_slot_t *)(hdr + 1) + (size_t)set * AI_CACHE_WAYS;
+}
+
+static int slot_live(const ai_cache_slot_t *slot, time_t now)
+{
+    return slot->stored != 0 && now >= slot->stored && now - slot->stored < AI_CACHE_TTL;
+}
+
+char *ai_cache_get(const ai_cache_key_t *key)
+{
+    ai_cache_hdr_t *hdr = cache_open();
+    ai_cache_slot_t *set;
+    time_t now = time(NULL);
+    char *text = NULL;
+
+    if (!hdr) {
+        return NULL;
+    }
+    set = cache_set(hdr, key);
+
+    flock(cache_fd, LOCK_EX);
+    for (int w = 0; w < AI_CACHE_WAYS; w++) {
+        ai_cache_slot_t *slot = &set[w];
+
+        if (slot_live(slot, now) && memcmp(slot->key, key->hash, sizeof(slot->key)) == 0) {
+            slot->used = ++hdr->clock;
+            text = strndup(slot->text, AI_CACHE_TEXT - 1);
+            break;
+        }
+    }
+    flock(cache_fd, LOCK_UN);
+    return text;
+}
+
+void ai_cache_put(const ai_cache_key_t *key, const char *text)
+{
+    ai_cache_hdr_t *hdr;
+    ai_cache_slot_t *set;
+    ai_cache_slot_t *victim = NULL;
+    time_t now = time(NULL);
+    size_t len = strlen(text);
+
+    if (len >= AI_CACHE_TEXT || !(hdr = cache_open())) {
+        return;
+    }
+    set = cache_set(hdr, key);
+
+    flock(cache_fd, LOCK_EX);
+    /* The key's own slot, else an empty or expired one, else the least recently used */
+    for (int w = 0; w < AI_CACHE_WAYS; w++) {
+        ai_cache_slot_t *slot = &set[w];
+
+        if (slot->stored != 0 && memcmp(slot->key, key->hash, sizeof(slot->key)) == 0) {
+            victim = slot;
+            break;
+        }
+        if (!victim || (slot_live(victim, now) &&
+                        (!slot_live(slot, now) || slot->used < victim->used))) {
+            victim = slot;
+        }
+    }
+    memcpy(victim->key, key->hash, sizeof(victim->key));
+    memcpy(victim->text, text, len + 1);
+    victim->stored = (int64_t)now;
+    victim->used = ++hdr->clock;
+    flock(cache_fd, LOCK_UN);
+}
@@ -0,0 +1,126 @@
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Blocks form a list, newest first; only the newest one is allocated
+ * from. A request bigger than the block size gets a block of its own.
+ */
+
+#define ARENA_DEFAULT_BLOCK 8192
+#define ARENA_ALIGN _Alignof(max_align_t)
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;                /* Usable bytes in data[] */
+    size_t used;
+    _Alignas(max_align_t) unsigned char data[];
+} arena_block_t;
+
+struct arena {
+    arena_block_t *head;        /* Current block */
+    arena_block_t *first;       /* Oldest block, kept by arena_reset() */
+    size_t block_size;
+    size_t used;                /* Bytes handed out since reset */
+};
+
+static arena_block_t *new_block(size_t size)
+{
+    arena_block_t *block = malloc(sizeof(arena_block_t) + size);
+    if (!block) {
+        return NULL;
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+arena_t *arena_create(size_t block_size)
+{
+    arena_t *a = malloc(sizeof(arena_t));
+    if (!a) {
+        return NULL;
+    }
+
+    a->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK;
+    a->used = 0;
+    a->first = new_block(a->block_size);
+    if (!a->first) {
+        free(a);
+        return NULL;
+    }
+    a->head = a->first;
+    return a;
+}
+
+/* Free blocks from head down to (not including) stop */
+static void free_blocks(arena_block_t *block, arena_block_t *stop)
+{
+    while (block && block != stop) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+void arena_destroy(arena_t *a)
+{
+    if (!a) {
+        return;
+    }
+    free_blocks(a->head, NULL);
+    free(a);
+}
+
+void *arena_alloc(arena_t *a, size_t size)
+{
+    arena_block_t *block = a->head;
+    size_t offset;
+
+    /* Round up so the next allocation stays aligned */
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size == 0) {
+        size = ARENA_ALIGN;
+    }
+
+    if (block->size - block->used < size) {
+        block = new_block(size > a->block_size ? size : a->block_size);
+        if (!block) {
+            return NULL;
+        }
+        block->next = a->head;
+        a->head = block;
+    }
+
+    offset = block->used;
+    block->used += size;
+    a->used += size;
+    return block->data + offset;
+}
+
+char *arena_strdup(arena_t *a, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *copy = arena_alloc(a, len);
+
+    if (copy) {
+        memcpy(copy, s, len);
+    }
+    return copy;
+}
+
+void arena_reset(arena_t *a)
+{
+    free_blocks(a->head, a->first);
+    a->head = a->first;
+    a->first->used = 0;
+    a->used = 0;
+}
+
+size_t arena_used(const arena_t *a)
+{
+    return a->used;
+}
@@ -0,0 +1,236 @@
+/*
+ * ast_cache.c - Parsed-tree cache for repeated command lines
+ *
+ * Once commands run in-process or via posix_spawn(), lexing and parsing
+ * are the biggest fixed cost of a short command line. Lines repeat a
+ * lot (loops, history, generated scripts), so the trees are kept:
+ *
+ *   - key: the line with blanks trimmed and collapsed, hashed (FNV-1a)
+ *     into a fixed bucket array
+ *   - value: the Input tree, parsed into an arena of its own (the
+ *     per-line AST arena is reset after every line)
+ *   - bounded: least recently used entries are evicted, and eviction
+ *     simply destroys the entry's arena
+ *
+ * A miss is parsed by fast_parse_line(), so a simple command line does
+ * not go through the BNFC parser even the first time.
+ */
+
+#include "ast_cache.h"
+#include "arena.h"
+#include "fast_parse.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AST_CACHE_BUCKETS 256      /* Power of 2 */
+#define AST_CACHE_DEFAULT 128
+#define AST_ENTRY_BLOCK 2048       /* Arena block size per entry */
+
+/* One cached line; lives in its own arena together with its tree */
+typedef struct ast_entry {
+    struct ast_entry *prev;        /* LRU list, most recent first */
+    struct ast_entry *next;
+    struct ast_entry *chain;       /* Next entry in the same bucket */
+    uint64_t hash;
+    const char *key;
+    Input tree;
+    arena_t *arena;
+} ast_entry_t;
+
+static ast_entry_t *buckets[AST_CACHE_BUCKETS];
+static ast_entry_t *lru_head = NULL;
+static ast_entry_t *lru_tail = NULL;
+static int entry_count = 0;
+static int cache_size = -1;        /* -1 = not read from the environment yet */
+
+int get_ast_cache_size(void)
+{
+    if (cache_size < 0) {
+        const char *env = getenv("PICOBOX_AST_CACHE");
+        cache_size = env ? atoi(env) : AST_CACHE_DEFAULT;
+        if (cache_size < 0) {
+            cache_size = 0;
+        }
+    }
+    return cache_size;
+}
+
+static uint64_t hash_key(const char *key)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*
+ * Trim the line and squeeze runs of blanks to one space (caller frees)
+ * A line with a here-document is kept as it is: blanks in its text count.
+ */
+static char *normalize_line(const char *line)
+{
+    char *key = malloc(strlen(line) + 1);
+    char *dst = key;
+    int pending_space = 0;
+
+    if (!key) {
+        return NULL;
+    }
+    if (strstr(line, "<<")) {
+        return strcpy(key, line);
+    }
+
+    for (const char *src = line; *src; src++) {
+        if (*src == ' ' || *src == '\t') {
+            pending_space = (dst != key);
+            continue;
+        }
+        if (pending_space) {
+            *dst++ = ' ';
+            pending_space = 0;
+        }
+        *dst++ = *src;
+    }
+    *dst = '\0';
+    return key;
+}
+
+static void lru_unlink(ast_entry_t *entry)
+{
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        lru_head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        lru_tail = entry->prev;
+    }
+}
+
+static void lru_push_front(ast_entry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = lru_head;
+    if (lru_head) {
+        lru_head->prev = entry;
+    }
+    lru_head = entry;
+    if (!lru_tail) {
+        lru_tail = entry;
+    }
+}
+
+/* Remove an entry from the cache and free it */
+static void drop_entry(ast_entry_t *entry)
+{
+    ast_entry_t **link = &buckets[entry->hash & (AST_CACHE_BUCKETS - 1)];
+
+    while (*link != entry) {
+        link = &(*link)->chain;
+    }
+    *link = entry->chain;
+
+    lru_unlink(entry);
+    entry_count--;
+    arena_destroy(entry->arena);
+}
+
+void set_ast_cache_size(int entries)
+{
+    cache_size = entries > 0 ? entries : 0;
+    while (entry_count > cache_size) {
+        drop_entry(lru_tail);
+    }
+}
+
+void ast_cache_clear(void)
+{
+    while (lru_tail) {
+        drop_entry(lru_tail);
+    }
+}
+
+/*
+ * Parse key into a new arena and add it to the cache
+ * Returns: the entry, or NULL on a syntax error or out of memory
+ */
+static ast_entry_t *add_entry(const char *key, uint64_t hash)
+{
+    arena_t *arena = arena_create(AST_ENTRY_BLOCK);
+    ast_entry_t *entry;
+    struct arena *prev;
+    Input tree;
+
+    if (!arena) {
+        return NULL;
+    }
+
+    /* Build the tree in the entry's arena, not the per-line one */
+    prev = ast_arena_swap(arena);
+    tree = fast_parse_line(key);
+    ast_arena_swap(prev);
+
+    entry = tree ? arena_alloc(arena, sizeof(ast_entry_t)) : NULL;
+    if (entry) {
+        entry->key = arena_strdup(arena, key);
+    }
+    if (!entry || !entry->key) {
+        arena_destroy(arena);
+        return NULL;
+    }
+
+    if (entry_count >= get_ast_cache_size()) {
+        drop_entry(lru_tail);
+    }
+
+    entry->hash = hash;
+    entry->tree = tree;
+    entry->arena = arena;
+    entry->chain = buckets[hash & (AST_CACHE_BUCKETS - 1)];
+    buckets[hash & (AST_CACHE_BUCKETS - 1)] = entry;
+    lru_push_front(entry);
+    entry_count++;
+
+    return entry;
+}
+
+Input ast_cache_parse(const char *line)
+{
+    ast_entry_t *entry;
+    uint64_t hash;
+    char *key;
+
+    if (get_ast_cache_size() == 0) {
+        return fast_parse_line(line);
+    }
+
+    key = normalize_line(line);
+    if (!key) {
+        return fast_parse_line(line);
+    }
+
+    hash = hash_key(key);
+    for (entry = buckets[hash & (AST_CACHE_BUCKETS - 1)]; entry; entry = entry->chain) {
+        if (entry->hash == hash && strcmp(entry->key, key) == 0) {
+            break;
+        }
+    }
+
+    if (entry) {
+        /* Hit: most recently used now */
+        lru_unlink(entry);
+        lru_push_front(entry);
+    } else {
+        entry = add_entry(key, hash);
+    }
+
+    free(key);
+    return entry ? entry->tree : NULL;
+}
@@ -0,0 +1,331 @@
+/*
+ * batch_io.c - Filesystem calls made many at a time
+ *
+ * The ring is driven with the raw io_uring_setup() and io_uring_enter()
+ * system calls, with no liburing: it only ever holds one batch, filled,
+ * submitted and reaped to the last completion before the call returns,
+ * so the caller's names and results stay valid throughout and nothing
+ * is left in flight between calls. A batch longer than the ring goes
+ * through in ring-sized runs.
+ *
+ * A call the kernel's ring does not know (statx and unlinkat came to
+ * io_uring in 5.6 and 5.11) completes with EINVAL; those, and the rest
+ * of a batch the ring fails on, are made again synchronously.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* fstatat(), unlinkat() and struct statx */
+#endif
+
+#include "batch_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(PICOBOX_URING)
+#define BIO_URING 1
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+#endif
+
+/* Calls in flight at once */
+#define BIO_ENTRIES 256
+
+enum {
+    BIO_STAT,
+    BIO_UNLINK
+};
+
+static void bio_sync(int op, int dirfd, const char *name, int flags, struct stat *st, int *err)
+{
+    int ret = op == BIO_STAT ? fstatat(dirfd, name, st, flags) : unlinkat(dirfd, name, flags);
+
+    *err = ret == 0 ? 0 : errno;
+}
+
+static void bio_sync_all(int op, int dirfd, const char *const *names, size_t n, int flags,
+                         struct stat *st, int *err)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        bio_sync(op, dirfd, names[i], flags, st ? &st[i] : NULL, &err[i]);
+    }
+}
+
+#ifdef BIO_URING
+
+struct batch_io {
+    int fd;
+    int broken;               /* io_uring_enter() failed: calls are made here */
+    unsigned entries;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;            /* sq_ring when the kernel maps both at once */
+    size_t cq_ring_size;
+    size_t sqes_size;
+    struct statx *stx;        /* One per entry, for BIO_STAT */
+};
+
+batch_io_t *batch_io_create(void)
+{
+    struct io_uring_params p;
+    batch_io_t *b = calloc(1, sizeof(*b));
+    char *sq;
+    char *cq;
+
+    if (!b) {
+        return NULL;
+    }
+    memset(&p, 0, sizeof(p));
+    b->fd = (int)syscall(__NR_io_uring_setup, BIO_ENTRIES, &p);
+    if (b->fd < 0) {
+        free(b);
+        return NULL;
+    }
+    b->entries = p.sq_entries;
+
+    b->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    b->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (b->cq_ring_size > b->sq_ring_size) {
+            b->sq_ring_size = b->cq_ring_size;
+        }
+        b->cq_ring_size = b->sq_ring_size;
+    }
+    b->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    b->sq_ring = mmap(NULL, b->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      b->fd, IORING_OFF_SQ_RING);
+    b->cq_ring = MAP_FAILED;
+    b->sqes = MAP_FAILED;
+    if (b->sq_ring == MAP_FAILED) {
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        b->cq_ring = b->sq_ring;
+    } else {
+        b->cq_ring = mmap(NULL, b->cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, b->fd, IORING_OFF_CQ_RING);
+        if (b->cq_ring == MAP_FAILED) {
+            goto fail;
+        }
+    }
+    b->sqes = mmap(NULL, b->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   b->fd, IORING_OFF_SQES);
+    if (b->sqes == MAP_FAILED) {
+        goto fail;
+    }
+    b->stx = calloc(b->entries, sizeof(struct statx));
+    if (!b->stx) {
+        goto fail;
+    }
+
+    sq = b->sq_ring;
+    cq = b->cq_ring;
+    b->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    b->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    b->sq_array = (unsigned *)(sq + p.sq_off.array);
+    b->cq_head = (unsigned *)(cq + p.cq_off.head);
+    b->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    b->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    b->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return b;
+
+fail:
+    batch_io_destroy(b);
+    return NULL;
+}
+
+void batch_io_destroy(batch_io_t *b)
+{
+    if (!b) {
+        return;
+    }
+    if (b->sqes != MAP_FAILED) {
+        munmap(b->sqes, b->sqes_size);
+    }
+    if (b->cq_ring != MAP_FAILED && b->cq_ring != b->sq_ring) {
+        munmap(b->cq_ring, b->cq_ring_size);
+    }
+    if (b->sq_ring != MAP_FAILED) {
+        munmap(b->sq_ring, b->sq_ring_size);
+    }
+    close(b->fd);
+    free(b->stx);
+    free(b);
+}
+
+static void bio_stat_from_statx(struct stat *st, const struct statx *s)
+{
+    memset(st, 0, sizeof(*st));
+    st->st_dev = makedev(s->stx_dev_major, s->stx_dev_minor);
+    st->st_ino = s->stx_ino;
+    st->st_mode = s->stx_mode;
+    st->st_nlink = s->stx_nlink;
+    st->st_uid = s->stx_uid;
+    st->st_gid = s->stx_gid;
+    st->st_rdev = makedev(s->stx_rdev_major, s->stx_rdev_minor);
+    st->st_size = (off_t)s->stx_size;
+    st->st_blksize = s->stx_blksize;
+    st->st_blocks = (blkcnt_t)s->stx_blocks;
+    st->st_atim.tv_sec = s->stx_atime.tv_sec;
+    st->st_atim.tv_nsec = s->stx_atime.tv_nsec;
+    st->st_mtim.tv_sec = s->stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = s->stx_mtime.tv_nsec;
+    st->st_ctim.tv_sec = s->stx_ctime.tv_sec;
+    st->st_ctim.tv_nsec = s->stx_ctime.tv_nsec;
+}
+
+/* Queue call i of a run: names[i], with its statx buffer */
+static void bio_prep(batch_io_t *b, int op, int dirfd, const char *name, int flags, unsigned i,
+                     unsigned tail)
+{
+    unsigned idx = tail & *b->sq_mask;
+    struct io_uring_sqe *sqe = &b->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = dirfd;
+    sqe->addr = (uint64_t)(uintptr_t)name;
+    sqe->user_data = i;
+    if (op == BIO_STAT) {
+        sqe->opcode = IORING_OP_STATX;
+        sqe->len = STATX_BASIC_STATS;
+        sqe->off = (uint64_t)(uintptr_t)&b->stx[i];
+        sqe->statx_flags = (uint32_t)flags;
+    } else {
+        sqe->opcode = IORING_OP_UNLINKAT;
+        sqe->unlink_flags = (uint32_t)flags;
+    }
+    b->sq_array[idx] = idx;
+}
+
+/* One run of at most b->entries calls, all completed before it returns */
+static void bio_run(batch_io_t *b, int op, int dirfd, const char *const *names, unsigned n,
+                    int flags, struct stat *st, int *err)
+{
+    unsigned tail = *b->sq_tail;
+    unsigned submitted = 0;
+    unsigned reaped = 0;
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        bio_prep(b, op, dirfd, names[i], flags, i, tail++);
+        err[i] = -1;
+    }
+    __atomic_store_n(b->sq_tail, tail, __ATOMIC_RELEASE);
+
+    while (reaped < n) {
+        unsigned head = *b->cq_head;
+        unsigned ctail;
+        long ret = syscall(__NR_io_uring_enter, b->fd, n - submitted, 1,
+                           IORING_ENTER_GETEVENTS, NULL, 0);
+
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            b->broken = 1;
+            break;
+        }
+        if (ret > 0) {
+            submitted += (unsigned)ret;
+        }
+
+        ctail = __atomic_load_n(b->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != ctail) {
+            const struct io_uring_cqe *cqe = &b->cqes[head & *b->cq_mask];
+            unsigned k = (unsigned)cqe->user_data;
+
+            if (cqe->res == -EINVAL) {
+                bio_sync(op, dirfd, names[k], flags, op == BIO_STAT ? &st[k] : NULL, &err[k]);
+            } else if (cqe->res < 0) {
+                err[k] = -cqe->res;
+            } else {
+                err[k] = 0;
+                if (op == BIO_STAT) {
+                    bio_stat_from_statx(&st[k], &b->stx[k]);
+                }
+            }
+            head++;
+            reaped++;
+        }
+        __atomic_store_n(b->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    /* The ring gave out: whatever did not complete is done here */
+    for (i = 0; i < n && b->broken; i++) {
+        if (err[i] == -1) {
+            bio_sync(op, dirfd, names[i], flags, op == BIO_STAT ? &st[i] : NULL, &err[i]);
+        }
+    }
+}
+
+static void bio_batch(batch_io_t *b, int op, int dirfd, const char *const *names, size_t n,
+                      int flags, struct stat *st, int *err)
+{
+    size_t done = 0;
+
+    if (!b || b->broken) {
+        bio_sync_all(op, dirfd, names, n, flags, st, err);
+        return;
+    }
+    while (done < n && !b->broken) {
+        unsigned run = n - done < b->entries ? (unsigned)(n - done) : b->entries;
+
+        bio_run(b, op, dirfd, names + done, run, flags, st ? st + done : NULL, err + done);
+        done += run;
+    }
+    if (done < n) {
+        bio_sync_all(op, dirfd, names + done, n - done, flags, st ? st + done : NULL,
+                     err + done);
+    }
+}
+
+#else /* !BIO_URING */
+
+struct batch_io {
+    int unused;
+};
+
+batch_io_t *batch_io_create(void)
+{
+    return NULL;
+}
+
+void batch_io_destroy(batch_io_t *b)
+{
+    (void)b;
+}
+
+static void bio_batch(batch_io_t *b, int op, int dirfd, const char *const *names, size_t n,
+                      int flags, struct stat *st, int *err)
+{
+    (void)b;
+    bio_sync_all(op, dirfd, names, n, flags, st, err);
+}
+
+#endif /* BIO_URING */
+
+void batch_io_stat(batch_io_t *b, int dirfd, const char *const *names, size_t n, int flags,
+                   struct stat *st, int *err)
+{
+    bio_batch(b, BIO_STAT, dirfd, names, n, flags, st, err);
+}
+
+void batch_io_unlink(batch_io_t *b, int dirfd, const char *const *names, size_t n, int flags,
+                     int *err)
+{
+    bio_batch(b, BIO_UNLINK, dirfd, names, n, flags, NULL, err);
+}
@@ -0,0 +1,289 @@
+/*
+ * blake3.c - Portable BLAKE3
+ *
+ * Follows the reference implementation: a chunk is compressed 64 bytes
+ * at a time, and is finished only once more input arrives, so that
+ * whichever chunk or parent turns out to be last can be finalized with
+ * the ROOT flag. Completed chunk values are merged eagerly: after chunk
+ * n (counting from 1) the stack is merged once per trailing zero bit
+ * of n, leaving one entry per set bit.
+ */
+
+#include "blake3.h"
+
+#include <string.h>
+
+#define CHUNK_START 1u
+#define CHUNK_END   2u
+#define PARENT      4u
+#define ROOT        8u
+
+static const uint32_t IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const unsigned char MSG_PERMUTATION[16] = {
+    2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8
+};
+
+/* What is needed to finish a chunk or parent, as a chaining value or root hash */
+typedef struct {
+    uint32_t cv[8];
+    uint32_t block[16];
+    uint64_t counter;
+    uint32_t block_len;
+    uint32_t flags;
+} output_t;
+
+static uint32_t ror(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static void g(uint32_t s[16], int a, int b, int c, int d, uint32_t mx, uint32_t my)
+{
+    s[a] = s[a] + s[b] + mx;
+    s[d] = ror(s[d] ^ s[a], 16);
+    s[c] = s[c] + s[d];
+    s[b] = ror(s[b] ^ s[c], 12);
+    s[a] = s[a] + s[b] + my;
+    s[d] = ror(s[d] ^ s[a], 8);
+    s[c] = s[c] + s[d];
+    s[b] = ror(s[b] ^ s[c], 7);
+}
+
+static void compress(const uint32_t cv[8], const uint32_t block[16], uint64_t counter,
+                     uint32_t block_len, uint32_t flags, uint32_t out[16])
+{
+    uint32_t s[16];
+    uint32_t m[16];
+    int r, i;
+
+    memcpy(s, cv, 8 * sizeof(uint32_t));
+    memcpy(s + 8, IV, 4 * sizeof(uint32_t));
+    s[12] = (uint32_t)counter;
+    s[13] = (uint32_t)(counter >> 32);
+    s[14] = block_len;
+    s[15] = flags;
+    memcpy(m, block, sizeof(m));
+
+    for (r = 0; r < 7; r++) {
+        uint32_t p[16];
+
+        g(s, 0, 4, 8, 12, m[0], m[1]);
+        g(s, 1, 5, 9, 13, m[2], m[3]);
+        g(s, 2, 6, 10, 14, m[4], m[5]);
+        g(s, 3, 7, 11, 15, m[6], m[7]);
+        g(s, 0, 5, 10, 15, m[8], m[9]);
+        g(s, 1, 6, 11, 12, m[10], m[11]);
+        g(s, 2, 7, 8, 13, m[12], m[13]);
+        g(s, 3, 4, 9, 14, m[14], m[15]);
+        for (i = 0; i < 16; i++) {
+            p[i] = m[MSG_PERMUTATION[i]];
+        }
+        memcpy(m, p, sizeof(m));
+    }
+
+    for (i = 0; i < 8; i++) {
+        out[i] = s[i] ^ s[i + 8];
+        out[i + 8] = s[i + 8] ^ cv[i];
+    }
+}
+
+static void load_block(uint32_t w[16], const unsigned char *p)
+{
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[4 * i] | (uint32_t)p[4 * i + 1] << 8 |
+               (uint32_t)p[4 * i + 2] << 16 | (uint32_t)p[4 * i + 3] << 24;
+    }
+}
+
+static void output_cv(const output_t *o, uint32_t cv[8])
+{
+    uint32_t out[16];
+
+    compress(o->cv, o->block, o->counter, o->block_len, o->flags, out);
+    memcpy(cv, out, 8 * sizeof(uint32_t));
+}
+
+static void parent_output(output_t *o, const uint32_t left[8], const uint32_t right[8])
+{
+    memcpy(o->cv, IV, sizeof(IV));
+    memcpy(o->block, left, 8 * sizeof(uint32_t));
+    memcpy(o->block + 8, right, 8 * sizeof(uint32_t));
+    o->counter = 0;
+    o->block_len = 64;
+    o->flags = PARENT;
+}
+
+static void parent_cv(const uint32_t left[8], const uint32_t right[8], uint32_t cv[8])
+{
+    output_t o;
+
+    parent_output(&o, left, right);
+    output_cv(&o, cv);
+}
+
+/* ===== CHUNKS ===== */
+
+static size_t chunk_len(const blake3_hasher_t *h)
+{
+    return 64 * h->blocks_compressed + h->buf_len;
+}
+
+static uint32_t chunk_start_flag(const blake3_hasher_t *h)
+{
+    return h->blocks_compressed == 0 ? CHUNK_START : 0;
+}
+
+static void chunk_update(blake3_hasher_t *h, const unsigned char *p, size_t len)
+{
+    while (len > 0) {
+        size_t take;
+
+        if (h->buf_len == 64) {
+            uint32_t w[16];
+            uint32_t out[16];
+
+            load_block(w, h->buf);
+            compress(h->chunk_cv, w, h->chunk_counter, 64, chunk_start_flag(h), out);
+            memcpy(h->chunk_cv, out, sizeof(h->chunk_cv));
+            h->blocks_compressed++;
+            h->buf_len = 0;
+        }
+
+        take = 64 - h->buf_len < len ? 64 - h->buf_len : len;
+        memcpy(h->buf + h->buf_len, p, take);
+        h->buf_len += take;
+        p += take;
+        len -= take;
+    }
+}
+
+static void chunk_output(const blake3_hasher_t *h, output_t *o)
+{
+    unsigned char block[64];
+
+    memcpy(block, h->buf, h->buf_len);
+    memset(block + h->buf_len, 0, 64 - h->buf_len);
+    memcpy(o->cv, h->chunk_cv, sizeof(o->cv));
+    load_block(o->block, block);
+    o->counter = h->chunk_counter;
+    o->block_len = (uint32_t)h->buf_len;
+    o->flags = chunk_start_flag(h) | CHUNK_END;
+}
+
+static void chunk_reset(blake3_hasher_t *h, uint64_t counter)
+{
+    memcpy(h->chunk_cv, IV, sizeof(IV));
+    h->chunk_counter = counter;
+    h->buf_len = 0;
+    h->blocks_compressed = 0;
+}
+
+/* ===== TREE ===== */
+
+/*
+ * Push the value of a subtree that brings the input to total units of
+ * its own size, merging it with every completed sibling on the stack
+ */
+static void push_cv(blake3_hasher_t *h, const uint32_t cv[8], uint64_t total)
+{
+    uint32_t merged[8];
+
+    memcpy(merged, cv, sizeof(merged));
+    while ((total & 1) == 0) {
+        h->cv_stack_len--;
+        parent_cv(h->cv_stack[h->cv_stack_len], merged, merged);
+        total >>= 1;
+    }
+    memcpy(h->cv_stack[h->cv_stack_len++], merged, sizeof(merged));
+}
+
+/* The last chunk folded with every subtree before it, right to left */
+static void tree_output(const blake3_hasher_t *h, output_t *o)
+{
+    size_t i = h->cv_stack_len;
+
+    chunk_output(h, o);
+    while (i > 0) {
+        uint32_t cv[8];
+
+        output_cv(o, cv);
+        i--;
+        parent_output(o, h->cv_stack[i], cv);
+    }
+}
+
+void blake3_init(blake3_hasher_t *h)
+{
+    h->cv_stack_len = 0;
+    chunk_reset(h, 0);
+}
+
+void blake3_update(blake3_hasher_t *h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    while (len > 0) {
+        size_t take;
+
+        if (chunk_len(h) == BLAKE3_CHUNK_LEN) {
+            output_t o;
+            uint32_t cv[8];
+
+            chunk_output(h, &o);
+            output_cv(&o, cv);
+            push_cv(h, cv, h->chunk_counter + 1);
+            chunk_reset(h, h->chunk_counter + 1);
+        }
+
+        take = BLAKE3_CHUNK_LEN - chunk_len(h);
+        if (take > len) {
+            take = len;
+        }
+        chunk_update(h, p, take);
+        p += take;
+        len -= take;
+    }
+}
+
+void blake3_final(blake3_hasher_t *h, unsigned char out[BLAKE3_OUT_LEN])
+{
+    output_t o;
+    uint32_t words[16];
+    int i;
+
+    tree_output(h, &o);
+    compress(o.cv, o.block, 0, o.block_len, o.flags | ROOT, words);
+    for (i = 0; i < 8; i++) {
+        out[4 * i] = (unsigned char)words[i];
+        out[4 * i + 1] = (unsigned char)(words[i] >> 8);
+        out[4 * i + 2] = (unsigned char)(words[i] >> 16);
+        out[4 * i + 3] = (unsigned char)(words[i] >> 24);
+    }
+}
+
+void blake3_subtree(const void *data, size_t len, uint64_t chunk_offset, uint32_t cv[8])
+{
+    blake3_hasher_t h;
+    output_t o;
+
+    /*
+     * The merge test looks at the low bits of the absolute count, which
+     * within an aligned subtree are the count from its start
+     */
+    h.cv_stack_len = 0;
+    chunk_reset(&h, chunk_offset);
+    blake3_update(&h, data, len);
+    tree_output(&h, &o);
+    output_cv(&o, cv);
+}
+
+void blake3_push_subtree(blake3_hasher_t *h, const uint32_t cv[8], uint64_t nchunks)
+{
+    push_cv(h, cv, (h->chunk_counter + nchunks) / nchunks);
+    chunk_reset(h, h->chunk_counter + nchunks);
+}
@@ -0,0 +1,582 @@
+/*
+ * checksum.c - Parallel file hashing and manifest checks
+ *
+ * Every operand is a job with one pool item for the whole file. A
+ * BLAKE3 job on a regular file of two or more segments (CS_SEGMENT
+ * bytes, a power of two number of chunks) instead queues an item per
+ * segment but the last; each of those preads its segment into the
+ * worker's buffer and stores the subtree value, and the item that
+ * brings the job's count of running items to zero pushes them all into
+ * a hasher in order and hashes the last segment itself, which gives the
+ * root its ROOT flag. Results are printed in operand order once the
+ * pool is done.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* posix_fadvise(), pread(), openat() */
+#endif
+
+#include "checksum.h"
+#include "io_stats.h"
+#include "blake3.h"
+#include "crc32c.h"
+#include "sha256.h"
+#include "work_pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CS_SEGMENT (1024 * BLAKE3_CHUNK_LEN)   /* Also the read size */
+#define CS_MAX_WORKERS 64
+
+typedef struct {
+    checksum_kind_t kind;
+    union {
+        sha256_ctx_t sha;
+        blake3_hasher_t b3;
+        uint32_t crc;
+    } u;
+} cs_ctx_t;
+
+typedef struct cs_job cs_job_t;
+
+typedef struct {
+    cs_job_t *job;
+    size_t seg;                 /* Segment number, for split jobs */
+    int err;
+} cs_item_t;
+
+struct cs_job {
+    const char *name;
+    checksum_result_t *res;
+    int fd;
+    cs_item_t whole;
+    cs_item_t *segs;            /* All segments but the last */
+    uint32_t (*cvs)[8];
+    size_t nsegs;
+    off_t size;
+    atomic_size_t running;
+};
+
+typedef struct {
+    checksum_kind_t kind;
+    int dirfd;
+    char *bufs[CS_MAX_WORKERS];
+} cs_pool_t;
+
+size_t checksum_hex_len(checksum_kind_t kind)
+{
+    return kind == CHECKSUM_CRC32C ? 8 : 64;
+}
+
+static int cs_is_stdin(const char *name)
+{
+    return strcmp(name, "-") == 0;
+}
+
+/* ===== HASH CONTEXTS ===== */
+
+static void ctx_init(cs_ctx_t *c, checksum_kind_t kind)
+{
+    c->kind = kind;
+    switch (kind) {
+    case CHECKSUM_SHA256:
+        sha256_init(&c->u.sha);
+        break;
+    case CHECKSUM_BLAKE3:
+        blake3_init(&c->u.b3);
+        break;
+    case CHECKSUM_CRC32C:
+        c->u.crc = 0;
+        break;
+    }
+}
+
+static void ctx_update(cs_ctx_t *c, const void *data, size_t len)
+{
+    switch (c->kind) {
+    case CHECKSUM_SHA256:
+        sha256_update(&c->u.sha, data, len);
+        break;
+    case CHECKSUM_BLAKE3:
+        blake3_update(&c->u.b3, data, len);
+        break;
+    case CHECKSUM_CRC32C:
+        c->u.crc = crc32c_update(c->u.crc, data, len);
+        break;
+    }
+}
+
+static void ctx_final(cs_ctx_t *c, char hex[CHECKSUM_HEX_MAX])
+{
+    static const char digits[] = "0123456789abcdef";
+    unsigned char digest[32];
+    size_t len = 0;
+    size_t i;
+
+    switch (c->kind) {
+    case CHECKSUM_SHA256:
+        sha256_final(&c->u.sha, digest);
+        len = SHA256_DIGEST_LEN;
+        break;
+    case CHECKSUM_BLAKE3:
+        blake3_final(&c->u.b3, digest);
+        len = BLAKE3_OUT_LEN;
+        break;
+    case CHECKSUM_CRC32C:
+        for (i = 0; i < 4; i++) {
+            digest[i] = (unsigned char)(c->u.crc >> (24 - 8 * i));
+        }
+        len = 4;
+        break;
+    }
+    for (i = 0; i < len; i++) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 15];
+    }
+    hex[2 * len] = '\0';
+}
+
+/* ===== WHOLE FILES ===== */
+
+/*
+ * Hash from the current offset of fd (or from fp) to the end
+ * Returns: 0, or an errno value
+ */
+static int hash_rest(cs_ctx_t *c, int fd, FILE *fp, char *buf)
+{
+    for (;;) {
+        ssize_t n;
+
+        if (fp) {
+            n = (ssize_t)fread(buf, 1, CS_SEGMENT, fp);
+            if (n == 0) {
+                return ferror(fp) ? EIO : 0;
+            }
+        } else {
+            n = read(fd, buf, CS_SEGMENT);
+            IO_STATS_READ(n);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno;
+            }
+            if (n == 0) {
+                return 0;
+            }
+        }
+        ctx_update(c, buf, (size_t)n);
+    }
+}
+
+static void hash_whole(checksum_kind_t kind, int fd, FILE *fp, char *buf, checksum_result_t *res)
+{
+    cs_ctx_t c;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+    ctx_init(&c, kind);
+    res->err = hash_rest(&c, fd, fp, buf);
+    if (!res->err) {
+        ctx_final(&c, res->hex);
+    }
+}
+
+static void hash_name(checksum_kind_t kind, int dirfd, FILE *in, const char *name, char *buf,
+                      checksum_result_t *res)
+{
+    int fd;
+
+    if (cs_is_stdin(name)) {
+        hash_whole(kind, -1, in, buf, res);
+        return;
+    }
+    fd = openat(dirfd, name, O_RDONLY);
+    if (fd < 0) {
+        res->err = errno;
+        return;
+    }
+    hash_whole(kind, fd, NULL, buf, res);
+    close(fd);
+}
+
+/* ===== SPLIT BLAKE3 FILES ===== */
+
+/* Join the segments in order, hash the last one and finish the job */
+static void b3_finish(cs_job_t *job, char *buf)
+{
+    cs_ctx_t c;
+    size_t i;
+
+    for (i = 0; i < job->nsegs; i++) {
+        if (job->segs[i].err) {
+            job->res->err = job->segs[i].err;
+            close(job->fd);
+            return;
+        }
+    }
+
+    ctx_init(&c, CHECKSUM_BLAKE3);
+    for (i = 0; i < job->nsegs; i++) {
+        blake3_push_subtree(&c.u.b3, job->cvs[i], CS_SEGMENT / BLAKE3_CHUNK_LEN);
+    }
+    if (lseek(job->fd, (off_t)job->nsegs * CS_SEGMENT, SEEK_SET) < 0) {
+        job->res->err = errno;
+    } else {
+        job->res->err = hash_rest(&c, job->fd, NULL, buf);
+    }
+    if (!job->res->err) {
+        ctx_final(&c, job->res->hex);
+    }
+    close(job->fd);
+}
+
+static void b3_segment(cs_item_t *item, char *buf)
+{
+    cs_job_t *job = item->job;
+    off_t off = (off_t)item->seg * CS_SEGMENT;
+    size_t got = 0;
+
+    while (got < CS_SEGMENT) {
+        ssize_t n = pread(job->fd, buf + got, CS_SEGMENT - got, off + (off_t)got);
+
+        IO_STATS_READ(n);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            item->err = errno;
+            break;
+        }
+        if (n == 0) {
+            item->err = EIO;    /* Truncated while being hashed */
+            break;
+        }
+        got += (size_t)n;
+    }
+    if (!item->err) {
+        blake3_subtree(buf, CS_SEGMENT, (uint64_t)item->seg * (CS_SEGMENT / BLAKE3_CHUNK_LEN),
+                       job->cvs[item->seg]);
+    }
+
+    if (atomic_fetch_sub(&job->running, 1) == 1) {
+        b3_finish(job, buf);
+    }
+}
+
+static int splittable(checksum_kind_t kind, const struct stat *st)
+{
+    return kind == CHECKSUM_BLAKE3 && S_ISREG(st->st_mode) && st->st_size >= 2 * (off_t)CS_SEGMENT;
+}
+
+/*
+ * Open a job's file and hash it, or queue its segments
+ */
+static void cs_job_start(work_pool_t *pool, int worker, cs_pool_t *p, cs_job_t *job)
+{
+    char *buf = p->bufs[worker];
+    struct stat st;
+
+    job->fd = openat(p->dirfd, job->name, O_RDONLY);
+    if (job->fd < 0) {
+        job->res->err = errno;
+        return;
+    }
+
+    if (fstat(job->fd, &st) == 0 && splittable(p->kind, &st)) {
+        size_t n = (size_t)((st.st_size - 1) / CS_SEGMENT);
+
+        job->segs = calloc(n, sizeof(cs_item_t));
+        job->cvs = malloc(n * sizeof(*job->cvs));
+        if (job->segs && job->cvs) {
+            job->nsegs = n;
+            atomic_store(&job->running, n);
+            for (size_t i = 0; i < n; i++) {
+                job->segs[i].job = job;
+                job->segs[i].seg = i;
+                if (work_pool_push(pool, worker, &job->segs[i]) != 0) {
+                    b3_segment(&job->segs[i], buf);
+                }
+            }
+            return;
+        }
+        free(job->segs);
+        free(job->cvs);
+        job->segs = NULL;
+        job->cvs = NULL;
+    }
+
+    hash_whole(p->kind, job->fd, NULL, buf, job->res);
+    close(job->fd);
+}
+
+static void cs_visit(work_pool_t *pool, int worker, void *item, void *arg)
+{
+    cs_pool_t *p = arg;
+    cs_item_t *it = item;
+
+    if (it == &it->job->whole) {
+        cs_job_start(pool, worker, p, it->job);
+    } else {
+        b3_segment(it, p->bufs[worker]);
+    }
+}
+
+/*
+ * Items the operands would make, to size the pool; stat() only
+ */
+static size_t cs_plan(checksum_kind_t kind, int dirfd, char **names, size_t n)
+{
+    size_t tasks = 0;
+    struct stat st;
+
+    for (size_t i = 0; i < n; i++) {
+        if (cs_is_stdin(names[i])) {
+            continue;
+        }
+        if (fstatat(dirfd, names[i], &st, 0) == 0 && splittable(kind, &st)) {
+            tasks += (size_t)((st.st_size - 1) / CS_SEGMENT);
+        } else {
+            tasks++;
+        }
+    }
+    return tasks;
+}
+
+void checksum_files(checksum_kind_t kind, int dirfd, FILE *in, char **names, size_t n,
+                    checksum_result_t *results)
+{
+    cs_pool_t p;
+    cs_job_t *jobs = NULL;
+    work_pool_t *pool = NULL;
+    size_t tasks = cs_plan(kind, dirfd, names, n);
+    int nworkers = work_pool_default_workers();
+    int ready = 0;
+    size_t i;
+
+    memset(&p, 0, sizeof(p));
+    p.kind = kind;
+    p.dirfd = dirfd;
+    memset(results, 0, n * sizeof(*results));
+
+    if (nworkers > CS_MAX_WORKERS) {
+        nworkers = CS_MAX_WORKERS;
+    }
+    if ((size_t)nworkers > tasks) {
+        nworkers = (int)tasks;
+    }
+    for (ready = 0; ready < (nworkers > 1 ? nworkers : 1); ready++) {
+        p.bufs[ready] = malloc(CS_SEGMENT);
+        if (!p.bufs[ready]) {
+            break;
+        }
+    }
+    if (ready == 0) {
+        for (i = 0; i < n; i++) {
+            results[i].err = ENOMEM;
+        }
+        return;
+    }
+
+    if (nworkers > 1) {
+        jobs = calloc(n, sizeof(cs_job_t));
+        pool = jobs ? work_pool_create(ready, cs_visit, &p) : NULL;
+    }
+    if (!pool) {
+        /* One file, or no threads to be had: hash in order here */
+        for (i = 0; i < n; i++) {
+            hash_name(kind, dirfd, in, names[i], p.bufs[0], &results[i]);
+        }
+        goto out;
+    }
+
+    for (i = 0; i < n; i++) {
+        cs_job_t *job = &jobs[i];
+
+        job->name = names[i];
+        job->res = &results[i];
+        job->whole.job = job;
+        if (cs_is_stdin(names[i]) || work_pool_push(pool, (int)(i % (size_t)ready), &job->whole) != 0) {
+            hash_name(kind, dirfd, in, names[i], p.bufs[0], &results[i]);
+        }
+    }
+    work_pool_run(pool);
+
+out:
+    work_pool_destroy(pool);
+    if (jobs) {
+        for (i = 0; i < n; i++) {
+            free(jobs[i].segs);
+            free(jobs[i].cvs);
+        }
+        free(jobs);
+    }
+    for (i = 0; i < (size_t)ready; i++) {
+        free(p.bufs[i]);
+    }
+}
+
+/* ===== LISTING AND CHECKING ===== */
+
+int checksum_list(checksum_kind_t kind, FILE *in, FILE *out, char **names, size_t n,
+                  const char *prog)
+{
+    checksum_result_t *results = malloc((n ? n : 1) * sizeof(*results));
+    int ret = 0;
+
+    if (!results) {
+        fprintf(stderr, "%s: %s\n", prog, strerror(ENOMEM));
+        return -1;
+    }
+    checksum_files(kind, AT_FDCWD, in, names, n, results);
+
+    for (size_t i = 0; i < n; i++) {
+        if (results[i].err) {
+            fprintf(stderr, "%s: %s: %s\n", prog, names[i], strerror(results[i].err));
+            ret = -1;
+            continue;
+        }
+        fprintf(out, "%s  %s\n", results[i].hex, names[i]);
+    }
+    free(results);
+    return ret;
+}
+
+/*
+ * Split a manifest line into its digest and name, in place
+ * Returns: name, or NULL if the line is not "HEX  NAME" or "HEX *NAME"
+ */
+static char *parse_line(char *line, size_t hexlen)
+{
+    size_t len = strlen(line);
+    size_t i;
+
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+        line[--len] = '\0';
+    }
+    if (len < hexlen + 3) {
+        return NULL;
+    }
+    for (i = 0; i < hexlen; i++) {
+        char ch = line[i];
+
+        if (!((ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F'))) {
+            return NULL;
+        }
+    }
+    if (line[hexlen] != ' ' || (line[hexlen + 1] != ' ' && line[hexlen + 1] != '*')) {
+        return NULL;
+    }
+    line[hexlen] = '\0';
+    return line + hexlen + 2;
+}
+
+static void warn_count(const char *prog, size_t n, const char *one, const char *many)
+{
+    if (n > 0) {
+        fprintf(stderr, "%s: WARNING: %zu %s\n", prog, n, n == 1 ? one : many);
+    }
+}
+
+int checksum_check(checksum_kind_t kind, int dirfd, FILE *in, FILE *manifest,
+                   const char *manifest_name, FILE *out, int flags, const char *prog)
+{
+    size_t hexlen = checksum_hex_len(kind);
+    char **lines = NULL;
+    char **names = NULL;
+    size_t nlines = 0, cap = 0;
+    size_t bad_format = 0, unreadable = 0, mismatched = 0;
+    checksum_result_t *results = NULL;
+    char *line = NULL;
+    size_t linecap = 0;
+    int quiet = flags & (CHECKSUM_QUIET | CHECKSUM_STATUS);
+    int ret = -1;
+    size_t i;
+
+    while (getline(&line, &linecap, manifest) >= 0) {
+        char *name = parse_line(line, hexlen);
+
+        if (!name) {
+            bad_format++;
+            continue;
+        }
+        if (nlines == cap) {
+            size_t ncap = cap ? 2 * cap : 64;
+            char **nl = realloc(lines, ncap * sizeof(*nl));
+            char **nn = nl ? realloc(names, ncap * sizeof(*nn)) : NULL;
+
+            if (nl) {
+                lines = nl;
+            }
+            if (!nn) {
+                fprintf(stderr, "%s: %s\n", prog, strerror(ENOMEM));
+                goto out;
+            }
+            names = nn;
+            cap = ncap;
+        }
+        lines[nlines] = line;
+        names[nlines] = name;
+        nlines++;
+        line = NULL;
+        linecap = 0;
+    }
+
+    if (nlines == 0) {
+        fprintf(stderr, "%s: %s: no properly formatted checksum lines found\n", prog, manifest_name);
+        goto out;
+    }
+
+    results = malloc(nlines * sizeof(*results));
+    if (!results) {
+        fprintf(stderr, "%s: %s\n", prog, strerror(ENOMEM));
+        goto out;
+    }
+    checksum_files(kind, dirfd, in, names, nlines, results);
+
+    for (i = 0; i < nlines; i++) {
+        if (results[i].err) {
+            unreadable++;
+            if (!(flags & CHECKSUM_STATUS)) {
+                fprintf(stderr, "%s: %s: %s\n", prog, names[i], strerror(results[i].err));
+                fprintf(out, "%s: FAILED open or read\n", names[i]);
+            }
+        } else if (strcasecmp(results[i].hex, lines[i]) != 0) {
+            mismatched++;
+            if (!(flags & CHECKSUM_STATUS)) {
+                fprintf(out, "%s: FAILED\n", names[i]);
+            }
+        } else if (!quiet) {
+            fprintf(out, "%s: OK\n", names[i]);
+        }
+    }
+
+    if (!(flags & CHECKSUM_STATUS)) {
+        fflush(out);
+        warn_count(prog, bad_format, "line is improperly formatted", "lines are improperly formatted");
+        warn_count(prog, unreadable, "listed file could not be read", "listed files could not be read");
+        warn_count(prog, mismatched, "computed checksum did NOT match", "computed checksums did NOT match");
+    }
+    ret = unreadable == 0 && mismatched == 0 ? 0 : -1;
+
+out:
+    for (i = 0; i < nlines; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+    free(names);
+    free(results);
+    free(line);
+    return ret;
+}
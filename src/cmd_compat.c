@@ -4,9 +4,9 @@
  * This file provides stub implementations for commands that have been
  * refactored to use the new argtable3/registry infrastructure.
  *
- * These stubs redirect to the new implementations via the registry.
- * This allows the old dispatch table in main.c to continue working
- * while we gradually refactor all commands.
+ * These stubs redirect to the new implementations via the registry,
+ * so code that still calls cmd_NAME() directly keeps working. main()
+ * itself dispatches through find_command().
  */
 
 #include "picobox.h"
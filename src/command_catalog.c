@@ -0,0 +1,170 @@
+/*
+ * command_catalog.c - The command catalog as JSON
+ *
+ * Formatted into memory with open_memstream(), then hashed for its file
+ * name. The file is written to a temporary name beside it and renamed
+ * into place, so a reader never sees half a catalog.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* open_memstream() */
+#endif
+
+#include "command_catalog.h"
+#include "cmd_spec.h"
+#include "sha256.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static char *catalog = NULL;
+static size_t catalog_len = 0;
+static unsigned long catalog_generation = 0;
+static char catalog_path[600];          /* "" until written or found */
+
+/* str as a JSON string */
+static void put_json_string(FILE *out, const char *str)
+{
+    putc('"', out);
+    for (const char *p = str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            putc('\\', out);
+            putc(*p, out);
+        } else if (*p == '\n') {
+            fputs("\\n", out);
+        } else if (*p == '\t') {
+            fputs("\\t", out);
+        } else if ((unsigned char)*p < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char)*p);
+        } else {
+            putc(*p, out);
+        }
+    }
+    putc('"', out);
+}
+
+struct catalog_writer {
+    FILE *out;
+    int first;
+};
+
+/* for_each_command() callback: one entry of the "commands" array */
+static void put_command(const cmd_spec_t *spec, void *userdata)
+{
+    struct catalog_writer *w = userdata;
+    FILE *out = w->out;
+
+    /* Comma before all but the first command */
+    if (!w->first) {
+        fputs(",\n", out);
+    }
+    w->first = 0;
+
+    fputs("    {\n      \"name\": ", out);
+    put_json_string(out, spec->name);
+    fputs(",\n      \"summary\": ", out);
+    put_json_string(out, spec->summary ? spec->summary : "");
+    fputs(",\n      \"description\": ", out);
+    if (spec->long_help) {
+        put_json_string(out, spec->long_help);
+    } else {
+        fprintf(out, "\"See '%s --help' for details\"", spec->name);
+    }
+    fputs(",\n      \"usage\": ", out);
+    fprintf(out, "\"%s [OPTIONS]...\"\n    }", spec->name);
+}
+
+const char *command_catalog_json(size_t *len)
+{
+    size_t size = 0;
+    struct catalog_writer w;
+    FILE *out;
+
+    if (catalog && catalog_generation == registry_generation()) {
+        *len = catalog_len;
+        return catalog;
+    }
+    free(catalog);
+    catalog = NULL;
+    catalog_path[0] = '\0';
+
+    out = open_memstream(&catalog, &size);
+    if (!out) {
+        return NULL;
+    }
+    fprintf(out, "{\n  \"version\": %d,\n  \"commands\": [\n", COMMAND_CATALOG_VERSION);
+    w.out = out;
+    w.first = 1;
+    for_each_command(put_command, &w);
+    fputs("\n  ]\n}\n", out);
+    if (fclose(out) != 0) {
+        free(catalog);
+        catalog = NULL;
+        return NULL;
+    }
+
+    catalog_len = size;
+    catalog_generation = registry_generation();
+    *len = catalog_len;
+    return catalog;
+}
+
+const char *command_catalog_file(void)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char *home = getenv("HOME");
+    unsigned char digest[SHA256_DIGEST_LEN];
+    char name[2 * 8 + 1];
+    char tmp[sizeof(catalog_path) + 16];
+    sha256_ctx_t ctx;
+    struct stat st;
+    const char *json;
+    size_t len;
+    FILE *fp;
+    int ok;
+
+    json = command_catalog_json(&len);
+    if (!json || !home || !*home) {
+        return NULL;
+    }
+    if (catalog_path[0]) {
+        return catalog_path;
+    }
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, json, len);
+    sha256_final(&ctx, digest);
+    for (int i = 0; i < 8; i++) {
+        name[2 * i] = hex[digest[i] >> 4];
+        name[2 * i + 1] = hex[digest[i] & 0xf];
+    }
+    name[16] = '\0';
+
+    snprintf(catalog_path, sizeof(catalog_path), "%s/.mysh", home);
+    if (mkdir(catalog_path, 0755) != 0 && errno != EEXIST) {
+        catalog_path[0] = '\0';
+        return NULL;
+    }
+    snprintf(catalog_path, sizeof(catalog_path), "%s/.mysh/catalog-%s.json", home, name);
+    if (stat(catalog_path, &st) == 0 && (size_t)st.st_size == len) {
+        return catalog_path;
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp%d", catalog_path, (int)getpid());
+    fp = fopen(tmp, "w");
+    if (!fp) {
+        catalog_path[0] = '\0';
+        return NULL;
+    }
+    ok = fwrite(json, 1, len, fp) == len;
+    if (fclose(fp) != 0 || !ok || rename(tmp, catalog_path) != 0) {
+        unlink(tmp);
+        catalog_path[0] = '\0';
+        return NULL;
+    }
+    return catalog_path;
+}
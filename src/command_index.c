@@ -0,0 +1,385 @@
+/*
+ * command_index.c - Full-text search over the registered commands
+ *
+ * Terms live in an open-addressing hash table, each with its posting
+ * list: the documents (commands, in registry order) it occurs in and
+ * its field-weighted count in each. Documents are indexed in order, so
+ * a term's posting for the current document, if any, is its last one.
+ *
+ * A search looks each distinct query term up once and adds its BM25
+ * contribution to every document on its list,
+ *
+ *   idf * tf * (k1 + 1) / (tf + k1 * (1 - b + b * len / avglen))
+ *   idf = ln(1 + (N - df + 0.5) / (df + 0.5))
+ *
+ * then takes the k best scores. For a few hundred commands that is a
+ * few microseconds; building the index costs one print_usage() per
+ * command, once.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* open_memstream() */
+#endif
+
+#include "command_index.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BM25_K1 1.2f
+#define BM25_B 0.75f
+
+#define TERM_MAX 32             /* Longer words are cut to this, with the NUL */
+#define QUERY_TERMS 32          /* Distinct words of a query that count */
+
+#define WEIGHT_NAME 3.0f
+#define WEIGHT_SUMMARY 2.0f
+#define WEIGHT_TEXT 1.0f
+
+typedef struct {
+    uint32_t doc;
+    float tf;                   /* Weighted occurrences in doc */
+} posting_t;
+
+typedef struct {
+    char *term;                 /* NULL: empty slot */
+    posting_t *post;
+    uint32_t npost;
+    uint32_t cap;
+} term_t;
+
+static struct {
+    int built;
+    unsigned long generation;   /* registry_generation() it was built for */
+    const cmd_spec_t **docs;
+    char **usage;
+    float *len;
+    size_t ndocs;
+    size_t cap;
+    float avglen;
+    term_t *terms;              /* Hash table, nslots a power of two */
+    size_t nslots;
+    size_t nterms;
+} idx;
+
+/* Words too common to tell commands apart */
+static const char *const stopwords[] = {
+    "a", "an", "and", "are", "as", "at", "be", "by", "can", "do", "for", "from",
+    "how", "i", "in", "into", "is", "it", "its", "me", "my", "of", "on", "or",
+    "that", "the", "this", "to", "what", "when", "which", "with", "you", "your",
+};
+
+static int is_stopword(const char *word)
+{
+    for (size_t i = 0; i < sizeof(stopwords) / sizeof(stopwords[0]); i++) {
+        if (strcmp(word, stopwords[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Read the next term at *p into term
+ * Returns: 1, or 0 at the end of the text
+ */
+static int next_term(const char **p, char term[TERM_MAX])
+{
+    for (;;) {
+        size_t len = 0;
+
+        while (**p && !isalnum((unsigned char)**p)) {
+            (*p)++;
+        }
+        if (!**p) {
+            return 0;
+        }
+        while (isalnum((unsigned char)**p)) {
+            if (len < TERM_MAX - 1) {
+                term[len++] = (char)tolower((unsigned char)**p);
+            }
+            (*p)++;
+        }
+        term[len] = '\0';
+
+        if (len > 3 && term[len - 1] == 's' && term[len - 2] != 's') {
+            term[--len] = '\0';
+        }
+        if (!is_stopword(term)) {
+            return 1;
+        }
+    }
+}
+
+static uint32_t term_hash(const char *term)
+{
+    uint32_t h = 2166136261u;
+
+    while (*term) {
+        h = (h ^ (unsigned char)*term++) * 16777619u;
+    }
+    return h;
+}
+
+/* The slot of term: where it is, or the empty slot it would go in */
+static term_t *term_slot(const char *term)
+{
+    size_t mask = idx.nslots - 1;
+    size_t i = term_hash(term) & mask;
+
+    while (idx.terms[i].term && strcmp(idx.terms[i].term, term) != 0) {
+        i = (i + 1) & mask;
+    }
+    return &idx.terms[i];
+}
+
+/* Double the hash table */
+static int grow_terms(void)
+{
+    term_t *old = idx.terms;
+    size_t old_slots = idx.nslots;
+
+    idx.nslots = old_slots ? old_slots * 2 : 256;
+    idx.terms = calloc(idx.nslots, sizeof(*idx.terms));
+    if (!idx.terms) {
+        idx.terms = old;
+        idx.nslots = old_slots;
+        return -1;
+    }
+    for (size_t i = 0; i < old_slots; i++) {
+        if (old[i].term) {
+            *term_slot(old[i].term) = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+/* Count term once more, with weight, in document doc */
+static int add_term(const char *term, uint32_t doc, float weight)
+{
+    term_t *t;
+
+    if (2 * (idx.nterms + 1) > idx.nslots && grow_terms() != 0) {
+        return -1;
+    }
+    t = term_slot(term);
+    if (!t->term) {
+        t->term = strdup(term);
+        if (!t->term) {
+            return -1;
+        }
+        idx.nterms++;
+    }
+
+    if (t->npost > 0 && t->post[t->npost - 1].doc == doc) {
+        t->post[t->npost - 1].tf += weight;
+        return 0;
+    }
+    if (t->npost == t->cap) {
+        uint32_t cap = t->cap ? t->cap * 2 : 4;
+        posting_t *post = realloc(t->post, cap * sizeof(*post));
+
+        if (!post) {
+            return -1;
+        }
+        t->post = post;
+        t->cap = cap;
+    }
+    t->post[t->npost].doc = doc;
+    t->post[t->npost].tf = weight;
+    t->npost++;
+    return 0;
+}
+
+static void add_field(const char *text, uint32_t doc, float weight)
+{
+    char term[TERM_MAX];
+
+    if (!text) {
+        return;
+    }
+    while (next_term(&text, term)) {
+        if (add_term(term, doc, weight) == 0) {
+            idx.len[doc] += weight;
+        }
+    }
+}
+
+/* What spec's print_usage() writes, or NULL */
+static char *capture_usage(const cmd_spec_t *spec)
+{
+    char *text = NULL;
+    size_t size = 0;
+    FILE *out;
+
+    if (!spec->print_usage) {
+        return NULL;
+    }
+    out = open_memstream(&text, &size);
+    if (!out) {
+        return NULL;
+    }
+    spec->print_usage(out);
+    fclose(out);
+    return text;
+}
+
+static void free_index(void)
+{
+    for (size_t i = 0; i < idx.nslots; i++) {
+        free(idx.terms[i].term);
+        free(idx.terms[i].post);
+    }
+    for (size_t i = 0; i < idx.ndocs; i++) {
+        free(idx.usage[i]);
+    }
+    free(idx.terms);
+    free(idx.docs);
+    free(idx.usage);
+    free(idx.len);
+    memset(&idx, 0, sizeof(idx));
+}
+
+static void collect_doc(const cmd_spec_t *spec, void *userdata)
+{
+    (void)userdata;
+
+    if (idx.ndocs == idx.cap) {
+        size_t cap = idx.cap ? idx.cap * 2 : 64;
+        const cmd_spec_t **docs = realloc(idx.docs, cap * sizeof(*docs));
+        char **usage = docs ? realloc(idx.usage, cap * sizeof(*usage)) : NULL;
+        float *len = usage ? realloc(idx.len, cap * sizeof(*len)) : NULL;
+
+        if (docs) {
+            idx.docs = docs;
+        }
+        if (usage) {
+            idx.usage = usage;
+        }
+        if (!len) {
+            return;
+        }
+        idx.len = len;
+        idx.cap = cap;
+    }
+    idx.docs[idx.ndocs] = spec;
+    idx.usage[idx.ndocs] = NULL;
+    idx.len[idx.ndocs] = 0.0f;
+    idx.ndocs++;
+}
+
+/*
+ * Build the index if there is none or the registry has changed
+ * Returns: 0, or -1 (out of memory)
+ */
+static int index_build(void)
+{
+    float total = 0.0f;
+
+    if (idx.built && idx.generation == registry_generation()) {
+        return 0;
+    }
+    free_index();
+    idx.generation = registry_generation();
+
+    for_each_command(collect_doc, NULL);
+    for (size_t d = 0; d < idx.ndocs; d++) {
+        const cmd_spec_t *spec = idx.docs[d];
+
+        idx.usage[d] = capture_usage(spec);
+        add_field(spec->name, (uint32_t)d, WEIGHT_NAME);
+        add_field(spec->summary, (uint32_t)d, WEIGHT_SUMMARY);
+        add_field(spec->long_help, (uint32_t)d, WEIGHT_TEXT);
+        add_field(idx.usage[d], (uint32_t)d, WEIGHT_TEXT);
+        total += idx.len[d];
+    }
+    if (idx.nslots == 0 && grow_terms() != 0) {
+        free_index();
+        return -1;
+    }
+    idx.avglen = idx.ndocs > 0 && total > 0.0f ? total / (float)idx.ndocs : 1.0f;
+    idx.built = 1;
+    return 0;
+}
+
+size_t command_index_search(const char *query, const cmd_spec_t **out, size_t k)
+{
+    char terms[QUERY_TERMS][TERM_MAX];
+    size_t nterms = 0;
+    char term[TERM_MAX];
+    float *score;
+    size_t found = 0;
+
+    if (!query || index_build() != 0 || idx.ndocs == 0) {
+        return 0;
+    }
+    score = calloc(idx.ndocs, sizeof(*score));
+    if (!score) {
+        return 0;
+    }
+
+    /* Each distinct term once */
+    while (nterms < QUERY_TERMS && next_term(&query, term)) {
+        size_t i;
+
+        for (i = 0; i < nterms && strcmp(terms[i], term) != 0; i++) {
+        }
+        if (i == nterms) {
+            memcpy(terms[nterms++], term, TERM_MAX);
+        }
+    }
+
+    for (size_t i = 0; i < nterms; i++) {
+        const term_t *t = term_slot(terms[i]);
+        float df;
+        float idf;
+
+        if (!t->term) {
+            continue;
+        }
+        df = (float)t->npost;
+        idf = logf(1.0f + ((float)idx.ndocs - df + 0.5f) / (df + 0.5f));
+        for (uint32_t p = 0; p < t->npost; p++) {
+            const posting_t *post = &t->post[p];
+            float norm = BM25_K1 * (1.0f - BM25_B + BM25_B * idx.len[post->doc] / idx.avglen);
+
+            score[post->doc] += idf * post->tf * (BM25_K1 + 1.0f) / (post->tf + norm);
+        }
+    }
+
+    /* The k best, ties in name order */
+    while (found < k) {
+        size_t best = idx.ndocs;
+
+        for (size_t d = 0; d < idx.ndocs; d++) {
+            if (score[d] > 0.0f && (best == idx.ndocs || score[d] > score[best])) {
+                best = d;
+            }
+        }
+        if (best == idx.ndocs) {
+            break;
+        }
+        out[found++] = idx.docs[best];
+        score[best] = 0.0f;
+    }
+
+    free(score);
+    return found;
+}
+
+const char *command_index_usage(const cmd_spec_t *spec)
+{
+    if (index_build() == 0) {
+        for (size_t d = 0; d < idx.ndocs; d++) {
+            if (idx.docs[d] == spec) {
+                return idx.usage[d] ? idx.usage[d] : "";
+            }
+        }
+    }
+    return "";
+}
@@ -0,0 +1,179 @@
+/*
+ * cmd_b3sum.c - Print or check BLAKE3 checksums
+ *
+ * Usage: b3sum [OPTIONS] [FILE...]
+ * Options:
+ *   -c, --check       Read checksums from the FILEs and check them
+ *       --quiet       Don't print OK for each successfully verified file
+ *       --status      Don't output anything; the exit status shows success
+ *   -h, --help        Display help message
+ *
+ * BLAKE3 hashes a file as a tree of 1 KiB chunks (blake3.h), so a large
+ * file is split into 1 MiB subtrees hashed on every thread, on top of
+ * several files, including the ones a manifest lists, being hashed at
+ * once (checksum.h); output is in order.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* AT_FDCWD */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include "argtable3.h"
+#include "cmd_spec.h"
+#include "picobox.h"
+#include "checksum.h"
+
+/* Forward declarations */
+int b3sum_run(int argc, char **argv);
+void b3sum_print_usage(FILE *out);
+
+/* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
+
+static struct arg_lit *b3sum_help;
+static struct arg_lit *b3sum_check;
+static struct arg_lit *b3sum_quiet;
+static struct arg_lit *b3sum_status;
+static struct arg_file *b3sum_files;
+static struct arg_end *b3sum_end;
+static void *b3sum_argtable[7];
+
+/* ===== SECTION 2: ARGTABLE BUILDER ===== */
+
+static void build_b3sum_argtable(void)
+{
+    if (b3sum_argtable[0] != NULL) {
+        return;
+    }
+
+    b3sum_help = arg_lit0("h", "help", "display this help and exit");
+    b3sum_check = arg_lit0("c", "check", "read checksums from the FILEs and check them");
+    b3sum_quiet = arg_lit0(NULL, "quiet", "don't print OK for each successfully verified file");
+    b3sum_status = arg_lit0(NULL, "status", "don't output anything, status code shows success");
+    b3sum_files = arg_filen(NULL, NULL, "FILE", 0, 1000, "files to hash, or manifests with -c");
+    b3sum_end = arg_end(20);
+
+    b3sum_argtable[0] = b3sum_help;
+    b3sum_argtable[1] = b3sum_check;
+    b3sum_argtable[2] = b3sum_quiet;
+    b3sum_argtable[3] = b3sum_status;
+    b3sum_argtable[4] = b3sum_files;
+    b3sum_argtable[5] = b3sum_end;
+    b3sum_argtable[6] = NULL;
+}
+
+/* ===== HELPER FUNCTIONS ===== */
+
+/*
+ * List or check the operands (standard input when there are none)
+ * Returns: EXIT_OK or EXIT_ERROR
+ */
+static int b3sum_operands(FILE *in, FILE *out)
+{
+    static char *dash[] = { "-" };
+    char **names = b3sum_files->count > 0 ? (char **)b3sum_files->filename : dash;
+    size_t n = b3sum_files->count > 0 ? (size_t)b3sum_files->count : 1;
+    int ret = EXIT_OK;
+
+    if (b3sum_check->count == 0) {
+        return checksum_list(CHECKSUM_BLAKE3, in, out, names, n, "b3sum") == 0 ? EXIT_OK : EXIT_ERROR;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        int flags = (b3sum_quiet->count > 0 ? CHECKSUM_QUIET : 0) |
+                    (b3sum_status->count > 0 ? CHECKSUM_STATUS : 0);
+        FILE *manifest = strcmp(names[i], "-") == 0 ? in : fopen(names[i], "r");
+
+        if (!manifest) {
+            perror(names[i]);
+            ret = EXIT_ERROR;
+            continue;
+        }
+        if (checksum_check(CHECKSUM_BLAKE3, AT_FDCWD, in, manifest,
+                           manifest == in ? "standard input" : names[i], out, flags, "b3sum") != 0) {
+            ret = EXIT_ERROR;
+        }
+        if (manifest != in) {
+            fclose(manifest);
+        }
+    }
+    return ret;
+}
+
+/* ===== SECTION 3: RUN FUNCTION ===== */
+
+int b3sum_run(int argc, char **argv)
+{
+    int nerrors;
+    int ret;
+
+    build_b3sum_argtable();
+    nerrors = cmd_arg_parse(argc, argv, b3sum_argtable);
+
+    /* Handle --help */
+    if (b3sum_help->count > 0) {
+        b3sum_print_usage(cmd_stdout());
+        return EXIT_OK;
+    }
+
+    /* Handle parsing errors */
+    if (nerrors > 0) {
+        arg_print_errors(stderr, b3sum_end, "b3sum");
+        fprintf(stderr, "Try 'b3sum --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
+    /* ===== ACTUAL COMMAND LOGIC ===== */
+
+    ret = b3sum_operands(cmd_stdin(), cmd_stdout());
+    return ret;
+}
+
+/* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
+
+void b3sum_print_usage(FILE *out)
+{
+    build_b3sum_argtable();
+
+    fprintf(out, "Usage: b3sum ");
+    arg_print_syntax(out, b3sum_argtable, "\n");
+    fprintf(out, "Print or check BLAKE3 (256-bit) checksums.\n");
+    fprintf(out, "With no FILE, or when FILE is -, read standard input.\n\n");
+    fprintf(out, "Options:\n");
+    arg_print_glossary(out, b3sum_argtable, "  %-20s %s\n");
+    fprintf(out, "\n");
+    fprintf(out, "Examples:\n");
+    fprintf(out, "  b3sum *.tar.gz > B3SUMS   Write a manifest\n");
+    fprintf(out, "  b3sum -c B3SUMS           Check files against it\n");
+}
+
+/* ===== SECTION 5: COMMAND SPECIFICATION ===== */
+
+cmd_spec_t cmd_b3sum_spec = {
+    .name = "b3sum",
+    .summary = "print or check BLAKE3 checksums",
+    .long_help = "Print or check BLAKE3 (256-bit) checksums. Files, and 1 MiB pieces of "
+                 "large ones, are hashed in parallel.",
+    .run = b3sum_run,
+    .print_usage = b3sum_print_usage,
+    .flags = CMD_FLAG_STREAMS | CMD_FLAG_PURE
+};
+
+/* ===== SECTION 6: REGISTRATION FUNCTION ===== */
+
+void register_b3sum_command(void)
+{
+    register_command(&cmd_b3sum_spec);
+}
+
+/* ===== SECTION 7: STANDALONE MAIN ===== */
+
+#ifndef BUILTIN_ONLY
+int main(int argc, char **argv)
+{
+    return cmd_b3sum_spec.run(argc, argv);
+}
+#endif
@@ -36,6 +36,10 @@ static void *basename_argtable[5];
 
 static void build_basename_argtable(void)
 {
+    if (basename_argtable[0] != NULL) {
+        return;
+    }
+
     basename_help = arg_lit0("h", "help", "display this help and exit");
     basename_name = arg_str1(NULL, NULL, "NAME", "pathname to strip directory from");
     basename_suffix = arg_str0(NULL, NULL, "SUFFIX", "optional suffix to remove");
@@ -62,7 +66,6 @@ int basename_run(int argc, char **argv)
     /* Handle --help */
     if (basename_help->count > 0) {
         basename_print_usage(stdout);
-        arg_freetable(basename_argtable, 4);
         return EXIT_OK;
     }
 
@@ -70,7 +73,6 @@ int basename_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, basename_end, "basename");
         fprintf(stderr, "Try 'basename --help' for more information.\n");
-        arg_freetable(basename_argtable, 4);
         return EXIT_ERROR;
     }
 
@@ -80,7 +82,6 @@ int basename_run(int argc, char **argv)
     result = get_basename(basename_name->sval[0]);
     if (!result) {
         perror("basename");
-        arg_freetable(basename_argtable, 4);
         return EXIT_ERROR;
     }
 
@@ -95,7 +96,6 @@ int basename_run(int argc, char **argv)
     printf("%s\n", result);
     free(result);
 
-    arg_freetable(basename_argtable, 4);
     return EXIT_OK;
 }
 
@@ -116,8 +116,6 @@ void basename_print_usage(FILE *out)
     fprintf(out, "  basename /usr/bin/sort          Output: sort\n");
     fprintf(out, "  basename include/stdio.h .h     Output: stdio\n");
     fprintf(out, "  basename /home/user/file.txt    Output: file.txt\n");
-
-    arg_freetable(basename_argtable, 4);
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
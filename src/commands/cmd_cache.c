@@ -0,0 +1,616 @@
+/*
+ * cmd_cache.c - Replay the output of a command whose inputs have not changed
+ *
+ * Follows the standard command anatomy for PicoBox (argtable3).
+ *
+ * Usage: cache [OPTIONS] COMMAND [ARG...]
+ * Options:
+ *   -t, --max-age=SECONDS  Keep the result for SECONDS, for any command
+ *   --clear                Empty the cache
+ *   -h, --help             Display help message
+ *
+ * A run is keyed by the SHA-256 of COMMAND and its arguments, the
+ * working directory, the variables that change what commands print
+ * (PATH, the locale, TZ), the picobox binary, and the device, inode,
+ * size, mtime and ctime of every argument that names a file (or that
+ * it names nothing), plus stdin when it is a regular file. If
+ * ~/.mysh/cache holds a result under that key, its stdout, stderr and
+ * exit status are replayed and COMMAND does not run. Otherwise COMMAND
+ * runs with its output going to a file in the cache, which is then
+ * written out and, once complete, renamed to its key, so concurrent
+ * shells only ever see whole results.
+ *
+ * Without -t, only commands flagged CMD_FLAG_PURE are cached, and only
+ * when the key covers everything they read: a command with no file
+ * argument (it reads a pipe or the terminal), with "-", or with a
+ * directory (what is below it can change without the directory's own
+ * stat changing) just runs. Anything else - du, ls, external programs -
+ * needs -t, and its result is then kept for that long (its file
+ * arguments are still part of the key).
+ *
+ * Results of a command that could not run (exit status 126 or more, or
+ * killed by a signal) are not kept. Entries are files of
+ *
+ *   stdout bytes, stderr bytes, cache_trailer_t
+ *
+ * and the least recently used go once they add up to CACHE_BYTES.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* mkstemp(), fstatat(), futimens() under -std=c11 */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "argtable3.h"
+#include "cmd_spec.h"
+#include "picobox.h"
+#include "exec_helpers.h"
+#include "redirect_helpers.h"
+#include "sha256.h"
+
+/* Forward declarations */
+int cache_run(int argc, char **argv);
+void cache_print_usage(FILE *out);
+
+/* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
+
+static struct arg_lit *cache_help;
+static struct arg_int *cache_max_age;
+static struct arg_lit *cache_clear;
+static struct arg_end *cache_end;
+static void *cache_argtable[5];
+
+/* ===== SECTION 2: ARGTABLE BUILDER ===== */
+
+static void build_cache_argtable(void)
+{
+    if (cache_argtable[0] != NULL) {
+        return;
+    }
+
+    cache_help = arg_lit0("h", "help", "display this help and exit");
+    cache_max_age = arg_int0("t", "max-age", "SECONDS", "keep the result for SECONDS, for any command");
+    cache_clear = arg_lit0(NULL, "clear", "empty the cache");
+    cache_end = arg_end(20);
+
+    cache_argtable[0] = cache_help;
+    cache_argtable[1] = cache_max_age;
+    cache_argtable[2] = cache_clear;
+    cache_argtable[3] = cache_end;
+    cache_argtable[4] = NULL;
+}
+
+/* ===== HELPER FUNCTIONS ===== */
+
+#define CACHE_MAGIC 0x43524250u             /* "PBRC" */
+#define CACHE_VERSION 1
+#define CACHE_BYTES (256L * 1024 * 1024)    /* All entries together */
+#define CACHE_ENTRY_MAX (CACHE_BYTES / 4)   /* Larger results are not kept */
+#define CACHE_COPY_BUF (64 * 1024)
+
+/* At the end of every entry; integers in the host's byte order */
+typedef struct cache_trailer {
+    uint64_t out_len;
+    uint64_t err_len;
+    int64_t stored;             /* time() it was stored */
+    int64_t expires;            /* time() it expires; 0 = when its inputs change */
+    int32_t status;
+    uint32_t version;
+    uint32_t magic;
+    uint32_t pad;
+} cache_trailer_t;
+
+/* Variables that change what a command prints, hashed into every key */
+static const char *const cache_env[] = {
+    "PATH", "LANG", "LC_ALL", "LC_COLLATE", "LC_CTYPE", "LC_MESSAGES",
+    "LC_NUMERIC", "LC_TIME", "TZ", NULL
+};
+
+/*
+ * Options end at COMMAND, whose own options are left alone
+ * Returns: index of COMMAND in argv (argc if there is none)
+ */
+static int command_index(int argc, char **argv)
+{
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if (strcmp(arg, "--") == 0) {
+            return i + 1;
+        }
+        if (arg[0] != '-' || arg[1] == '\0') {
+            break;
+        }
+        if (strcmp(arg, "-t") == 0 || strcmp(arg, "--max-age") == 0) {
+            i++;
+        }
+    }
+
+    return i < argc ? i : argc;
+}
+
+/* Hash str and its NUL, so neighbouring fields cannot run together */
+static void hash_str(sha256_ctx_t *ctx, const char *str)
+{
+    sha256_update(ctx, str, strlen(str) + 1);
+}
+
+/* Hash what identifies st's file and its contents */
+static void hash_stat(sha256_ctx_t *ctx, const struct stat *st)
+{
+    int64_t f[9];
+
+    f[0] = (int64_t)st->st_dev;
+    f[1] = (int64_t)st->st_ino;
+    f[2] = (int64_t)st->st_mode;
+    f[3] = (int64_t)st->st_size;
+#if defined(__APPLE__)
+    f[4] = (int64_t)st->st_mtimespec.tv_sec;
+    f[5] = (int64_t)st->st_mtimespec.tv_nsec;
+    f[6] = (int64_t)st->st_ctimespec.tv_sec;
+    f[7] = (int64_t)st->st_ctimespec.tv_nsec;
+#else
+    f[4] = (int64_t)st->st_mtim.tv_sec;
+    f[5] = (int64_t)st->st_mtim.tv_nsec;
+    f[6] = (int64_t)st->st_ctim.tv_sec;
+    f[7] = (int64_t)st->st_ctim.tv_nsec;
+#endif
+    f[8] = 1;
+    sha256_update(ctx, f, sizeof(f));
+}
+
+/*
+ * Key of running cmd here and now
+ * timed: -t was given, so inputs the key cannot cover are allowed
+ * Returns: 0, or -1 if cmd reads something the key does not cover
+ */
+static int cache_key(unsigned char key[SHA256_DIGEST_LEN], char **cmd, int ncmd, int timed)
+{
+    sha256_ctx_t ctx;
+    struct stat st;
+    char cwd[PATH_MAX];
+    int files = 0;
+
+    sha256_init(&ctx);
+    hash_str(&ctx, "picobox cache");
+    for (int i = 0; i < ncmd; i++) {
+        hash_str(&ctx, cmd[i]);
+    }
+    hash_str(&ctx, getcwd(cwd, sizeof(cwd)) ? cwd : "");
+    for (int i = 0; cache_env[i]; i++) {
+        const char *value = getenv(cache_env[i]);
+
+        hash_str(&ctx, cache_env[i]);
+        hash_str(&ctx, value ? "=" : "");
+        hash_str(&ctx, value ? value : "");
+    }
+
+    /* A new picobox may print something else */
+#ifdef __linux__
+    if (stat("/proc/self/exe", &st) == 0) {
+        hash_stat(&ctx, &st);
+    }
+#endif
+
+    for (int i = 1; i < ncmd; i++) {
+        if (strcmp(cmd[i], "-") == 0) {
+            if (!timed) {
+                return -1;
+            }
+        } else if (stat(cmd[i], &st) != 0) {
+            sha256_update(&ctx, "", 1);
+        } else if (S_ISDIR(st.st_mode) && !timed) {
+            return -1;
+        } else {
+            hash_stat(&ctx, &st);
+            files++;
+        }
+    }
+
+    /* stdin counts as an input when it is a file */
+    if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode)) {
+        off_t pos = lseek(STDIN_FILENO, 0, SEEK_CUR);
+
+        hash_stat(&ctx, &st);
+        sha256_update(&ctx, &pos, sizeof(pos));
+        files++;
+    }
+
+    if (files == 0 && !timed) {
+        return -1;
+    }
+    sha256_final(&ctx, key);
+    return 0;
+}
+
+/*
+ * ~/.mysh/cache into dir, created if needed
+ * Returns: 0, or -1 if there is no home or it cannot be created
+ */
+static int cache_dir(char *dir, size_t size)
+{
+    const char *home = getenv("HOME");
+
+    if (!home || !*home) {
+        return -1;
+    }
+    snprintf(dir, size, "%s/.mysh", home);
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    snprintf(dir, size, "%s/.mysh/cache", home);
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Copy len bytes from offset off of in to out (at out's offset)
+ * Returns: 0, or -1 on error (errno set)
+ */
+static int cache_copy(int in, off_t off, uint64_t len, int out)
+{
+    char buf[CACHE_COPY_BUF];
+
+    while (len > 0) {
+        size_t want = len < sizeof(buf) ? (size_t)len : sizeof(buf);
+        ssize_t n = pread(in, buf, want, off);
+
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n == 0) {
+                errno = EIO;
+            }
+            return -1;
+        }
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = write(out, buf + done, (size_t)(n - done));
+
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            done += w;
+        }
+        off += n;
+        len -= (uint64_t)n;
+    }
+    return 0;
+}
+
+/*
+ * Replay the entry at path, if it is whole and current
+ * Returns: 0 with *status set, or -1 if there is none
+ */
+static int cache_replay(const char *path, int *status)
+{
+    cache_trailer_t t;
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    int ok;
+
+    if (fd < 0) {
+        return -1;
+    }
+    ok = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(t) &&
+         pread(fd, &t, sizeof(t), st.st_size - (off_t)sizeof(t)) == (ssize_t)sizeof(t) &&
+         t.magic == CACHE_MAGIC && t.version == CACHE_VERSION &&
+         t.out_len + t.err_len + sizeof(t) == (uint64_t)st.st_size;
+    if (ok && t.expires != 0 && time(NULL) >= t.expires) {
+        unlink(path);
+        ok = 0;
+    }
+    if (!ok) {
+        close(fd);
+        return -1;
+    }
+
+    /* Most recently used, for pruning */
+    futimens(fd, NULL);
+
+    fflush(stdout);
+    if (cache_copy(fd, 0, t.out_len, STDOUT_FILENO) != 0 ||
+        cache_copy(fd, (off_t)t.out_len, t.err_len, STDERR_FILENO) != 0) {
+        perror("cache: write");
+        *status = EXIT_ERROR;
+    } else {
+        *status = t.status;
+    }
+    close(fd);
+    return 0;
+}
+
+typedef struct cache_file {
+    char name[2 * SHA256_DIGEST_LEN + 1];
+    time_t used;
+    off_t size;
+} cache_file_t;
+
+static int cache_file_cmp(const void *a, const void *b)
+{
+    const cache_file_t *x = a;
+    const cache_file_t *y = b;
+
+    return (x->used > y->used) - (x->used < y->used);
+}
+
+/*
+ * Remove entries, least recently used first, until the rest add up to
+ * keep bytes (0: remove them all)
+ */
+static void cache_prune(const char *dir, off_t keep)
+{
+    DIR *d = opendir(dir);
+    cache_file_t *files = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    off_t total = 0;
+    struct dirent *de;
+
+    if (!d) {
+        return;
+    }
+    while ((de = readdir(d)) != NULL) {
+        struct stat st;
+
+        if (de->d_name[0] == '.' || strlen(de->d_name) >= sizeof(files->name) ||
+            fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+            !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (count == capacity) {
+            size_t grown_cap = capacity ? capacity * 2 : 64;
+            cache_file_t *grown = realloc(files, grown_cap * sizeof(*files));
+
+            if (!grown) {
+                break;
+            }
+            files = grown;
+            capacity = grown_cap;
+        }
+        strcpy(files[count].name, de->d_name);
+        files[count].used = st.st_mtime;
+        files[count].size = st.st_size;
+        total += st.st_size;
+        count++;
+    }
+
+    if (total > keep) {
+        qsort(files, count, sizeof(*files), cache_file_cmp);
+        for (size_t i = 0; i < count && total > keep; i++) {
+            if (unlinkat(dirfd(d), files[i].name, 0) == 0) {
+                total -= files[i].size;
+            }
+        }
+    }
+    free(files);
+    closedir(d);
+}
+
+/*
+ * Run cmd with its output captured in dir, write the output out, and
+ * keep it as path if the run is worth replaying
+ * Returns: cmd's exit status
+ */
+static int cache_store(const char *dir, const char *path, char **cmd, long max_age)
+{
+    char tmp[PATH_MAX];
+    char err_tmp[PATH_MAX];
+    struct redirection to_tmp = { REDIR_OUTPUT, tmp };
+    cache_trailer_t t;
+    struct stat out_st;
+    struct stat err_st;
+    int out_fd;
+    int err_fd;
+    int saved_err;
+    int status;
+    int ok;
+
+    if (snprintf(tmp, sizeof(tmp), "%s/.tmp.XXXXXX", dir) >= (int)sizeof(tmp) ||
+        snprintf(err_tmp, sizeof(err_tmp), "%s/.err.XXXXXX", dir) >= (int)sizeof(err_tmp)) {
+        return exec_command_with_redirects(cmd, NULL, 0);
+    }
+    out_fd = mkstemp(tmp);
+    err_fd = out_fd >= 0 ? mkstemp(err_tmp) : -1;
+    if (err_fd < 0) {
+        if (out_fd >= 0) {
+            close(out_fd);
+            unlink(tmp);
+        }
+        return exec_command_with_redirects(cmd, NULL, 0);
+    }
+    unlink(err_tmp);
+
+    /* cmd's stdout goes to tmp and its stderr to err_fd */
+    fflush(stdout);
+    fflush(stderr);
+    saved_err = dup(STDERR_FILENO);
+    dup2(err_fd, STDERR_FILENO);
+    status = exec_command_with_redirects(cmd, &to_tmp, 1);
+    fflush(stderr);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_err);
+
+    /* The entry: stdout, stderr, trailer */
+    memset(&t, 0, sizeof(t));
+    ok = fstat(out_fd, &out_st) == 0 && fstat(err_fd, &err_st) == 0;
+    if (ok) {
+        t.out_len = (uint64_t)out_st.st_size;
+        t.err_len = (uint64_t)err_st.st_size;
+        t.stored = (int64_t)time(NULL);
+        t.expires = max_age > 0 ? t.stored + max_age : 0;
+        t.status = status;
+        t.version = CACHE_VERSION;
+        t.magic = CACHE_MAGIC;
+        ok = lseek(out_fd, 0, SEEK_END) >= 0 &&
+             cache_copy(err_fd, 0, t.err_len, out_fd) == 0 &&
+             write(out_fd, &t, sizeof(t)) == (ssize_t)sizeof(t);
+    }
+
+    /* Out to the caller, as if it had run directly */
+    if (cache_copy(out_fd, 0, ok ? t.out_len : (uint64_t)out_st.st_size, STDOUT_FILENO) != 0 ||
+        cache_copy(err_fd, 0, ok ? t.err_len : (uint64_t)err_st.st_size, STDERR_FILENO) != 0) {
+        perror("cache: write");
+        status = EXIT_ERROR;
+        ok = 0;
+    }
+    close(err_fd);
+    close(out_fd);
+
+    if (ok && status < 126 && t.out_len + t.err_len <= (uint64_t)CACHE_ENTRY_MAX &&
+        rename(tmp, path) == 0) {
+        cache_prune(dir, CACHE_BYTES);
+    } else {
+        unlink(tmp);
+    }
+    return status;
+}
+
+/* ===== SECTION 3: RUN FUNCTION ===== */
+
+int cache_run(int argc, char **argv)
+{
+    unsigned char key[SHA256_DIGEST_LEN];
+    char dir[PATH_MAX];
+    char path[PATH_MAX];
+    char name[2 * SHA256_DIGEST_LEN + 1];
+    const cmd_spec_t *spec;
+    char **cmd;
+    long max_age = 0;
+    int cmd_start;
+    int nerrors;
+    int status;
+
+    cmd_start = command_index(argc, argv);
+
+    build_cache_argtable();
+    nerrors = cmd_arg_parse(cmd_start, argv, cache_argtable);
+
+    /* Handle --help */
+    if (cache_help->count > 0) {
+        cache_print_usage(stdout);
+        return EXIT_OK;
+    }
+
+    /* Handle parsing errors */
+    if (nerrors > 0) {
+        arg_print_errors(stderr, cache_end, "cache");
+        fprintf(stderr, "Try 'cache --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
+    /* ===== ACTUAL COMMAND LOGIC ===== */
+
+    if (cache_clear->count > 0) {
+        if (cache_dir(dir, sizeof(dir)) == 0) {
+            cache_prune(dir, 0);
+        }
+        return EXIT_OK;
+    }
+    if (cmd_start >= argc) {
+        fprintf(stderr, "cache: missing command\n");
+        fprintf(stderr, "Try 'cache --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+    if (cache_max_age->count > 0) {
+        max_age = cache_max_age->ival[0];
+        if (max_age <= 0) {
+            fprintf(stderr, "cache: invalid max age: '%ld'\n", max_age);
+            return EXIT_ERROR;
+        }
+    }
+
+    /* Nothing below reads the argtable: the command may be cache itself */
+
+    cmd = argv + cmd_start;
+    spec = find_command(cmd[0]);
+    if (max_age == 0 && !(spec && (spec->flags & CMD_FLAG_PURE))) {
+        fprintf(stderr, "cache: %s: output may change with its files unchanged; "
+                "not cached without -t SECONDS\n", cmd[0]);
+        return exec_command_with_redirects(cmd, NULL, 0);
+    }
+    if (cache_key(key, cmd, argc - cmd_start, max_age > 0) != 0 ||
+        cache_dir(dir, sizeof(dir)) != 0) {
+        return exec_command_with_redirects(cmd, NULL, 0);
+    }
+
+    for (int i = 0; i < SHA256_DIGEST_LEN; i++) {
+        snprintf(name + 2 * i, 3, "%02x", key[i]);
+    }
+    if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path)) {
+        return exec_command_with_redirects(cmd, NULL, 0);
+    }
+
+    if (cache_replay(path, &status) == 0) {
+        return status;
+    }
+    return cache_store(dir, path, cmd, max_age);
+}
+
+/* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
+
+void cache_print_usage(FILE *out)
+{
+    build_cache_argtable();
+
+    fprintf(out, "Usage: cache ");
+    arg_print_syntax(out, cache_argtable, " COMMAND [ARG...]\n");
+    fprintf(out, "Run COMMAND, or replay its stdout, stderr and exit status from\n");
+    fprintf(out, "~/.mysh/cache if it ran before with the same arguments, directory,\n");
+    fprintf(out, "environment and files (by device, inode, size, mtime and ctime).\n\n");
+    fprintf(out, "Options:\n");
+    arg_print_glossary(out, cache_argtable, "  %-25s %s\n");
+    fprintf(out, "\n");
+    fprintf(out, "Without -t, only commands whose output depends on nothing but their\n");
+    fprintf(out, "arguments and the files they name are cached (cat, wc, head, cut,\n");
+    fprintf(out, "grep, sha256sum, b3sum, crc32c), and only when they are given files,\n");
+    fprintf(out, "not directories or stdin. Anything else needs -t.\n\n");
+    fprintf(out, "Examples:\n");
+    fprintf(out, "  cache wc -l access.log           Count again only once the log changes\n");
+    fprintf(out, "  cache -t 300 du -sh /data        Reuse the total for five minutes\n");
+}
+
+/* ===== SECTION 5: COMMAND SPECIFICATION ===== */
+
+cmd_spec_t cmd_cache_spec = {
+    .name = "cache",
+    .summary = "replay a command's output while its inputs are unchanged",
+    .long_help = "Run COMMAND, or replay its stdout, stderr and exit status from "
+                 "~/.mysh/cache if it ran before with the same arguments, directory, "
+                 "environment and files.",
+    .run = cache_run,
+    .print_usage = cache_print_usage
+};
+
+/* ===== SECTION 6: REGISTRATION FUNCTION ===== */
+
+void register_cache_command(void)
+{
+    register_command(&cmd_cache_spec);
+}
+
+/* ===== SECTION 7: STANDALONE MAIN ===== */
+
+#ifndef BUILTIN_ONLY
+int main(int argc, char **argv)
+{
+    return cmd_cache_spec.run(argc, argv);
+}
+#endif
@@ -7,14 +7,41 @@
  * Usage: cat [OPTIONS] [FILE...]
  * Options:
  *   -n, --number      Number all output lines
+ *   -z, --decompress  Decompress gzip and zstd input
  *   -h, --help        Display help message
+ *
+ * Without -n, data is moved by the kernel where it can be: with
+ * copy_file_range() into a regular file, splice() into a pipe and
+ * sendfile() into a socket. Anything else, and streams without a file
+ * descriptor (threaded pipelines), go through a large read/write loop.
+ * With -n, lines come from the shared line reader (utils.h), so a long
+ * line is numbered once however long it is. With -z, so does any input
+ * that is compressed or cannot be looked at first (a pipe), decompressed
+ * on threads of its own (decompress.h); plain regular files are copied
+ * as without it.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* copy_file_range(), splice() */
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
+#include "io_stats.h"
+#include "decompress.h"
+#include "utils.h"
+#include "pb_out.h"
 
 /* Forward declarations */
 int cat_run(int argc, char **argv);
@@ -24,33 +51,204 @@ void cat_print_usage(FILE *out);
 
 static struct arg_lit *cat_help;
 static struct arg_lit *cat_number;
+static struct arg_lit *cat_decompress;
 static struct arg_file *cat_files;
 static struct arg_end *cat_end;
-static void *cat_argtable[5];
+static void *cat_argtable[6];
 
 /* ===== SECTION 2: ARGTABLE BUILDER ===== */
 
 static void build_cat_argtable(void)
 {
+    if (cat_argtable[0] != NULL) {
+        return;
+    }
+
     cat_help = arg_lit0("h", "help", "display this help and exit");
     cat_number = arg_lit0("n", "number", "number all output lines");
+    cat_decompress = arg_lit0("z", "decompress", "decompress gzip and zstd input");
     cat_files = arg_filen(NULL, NULL, "FILE", 0, 100, "files to concatenate (or stdin if none)");
     cat_end = arg_end(20);
 
     cat_argtable[0] = cat_help;
     cat_argtable[1] = cat_number;
-    cat_argtable[2] = cat_files;
-    cat_argtable[3] = cat_end;
-    cat_argtable[4] = NULL;
+    cat_argtable[2] = cat_decompress;
+    cat_argtable[3] = cat_files;
+    cat_argtable[4] = cat_end;
+    cat_argtable[5] = NULL;
 }
 
-/* ===== HELPER FUNCTION ===== */
+/* ===== HELPER FUNCTIONS ===== */
+
+/* Size of each kernel copy request, and of the fallback buffer */
+#define CAT_CHUNK (1024 * 1024)
+#define CAT_BUFFER (128 * 1024)
+
+/*
+ * Copy in_fd to out_fd inside the kernel, for as long as it will
+ * Returns: 1 at end of input, 0 if the caller should carry on with
+ * read()/write() from the current offsets, -1 on a write error
+ */
+static int cat_kernel_copy(int in_fd, int out_fd)
+{
+#ifdef __linux__
+    struct stat in_st, out_st;
+    int how;
+
+    if (fstat(in_fd, &in_st) != 0 || fstat(out_fd, &out_st) != 0) {
+        return 0;
+    }
+
+    if (S_ISREG(out_st.st_mode) && S_ISREG(in_st.st_mode)) {
+        how = 'c';
+    } else if (S_ISFIFO(out_st.st_mode)) {
+        how = 'p';
+    } else if (S_ISSOCK(out_st.st_mode) && S_ISREG(in_st.st_mode)) {
+        how = 's';
+    } else {
+        return 0;
+    }
+
+    for (;;) {
+        ssize_t n;
+
+        if (how == 'c') {
+            n = copy_file_range(in_fd, NULL, out_fd, NULL, CAT_CHUNK, 0);
+        } else if (how == 'p') {
+            n = splice(in_fd, NULL, out_fd, NULL, CAT_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+        } else {
+            n = sendfile(out_fd, in_fd, NULL, CAT_CHUNK);
+        }
+        IO_STATS_READ(n);
+        IO_STATS_WRITE(n);
+
+        if (n > 0) {
+            continue;
+        }
+        if (n == 0) {
+            return 1;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        /* Not supported for this pair (EINVAL, EXDEV, ENOSYS, ...) */
+        if (errno == EPIPE) {
+            return -1;
+        }
+        return 0;
+    }
+#else
+    (void)in_fd;
+    (void)out_fd;
+    return 0;
+#endif
+}
+
+/*
+ * Copy in_fd to out_fd, in the kernel when possible. Errors are
+ * reported here, except EPIPE (the reader went away: stop quietly).
+ * Returns: 0 on success, -1 on error
+ */
+static int cat_fd(int in_fd, int out_fd, const char *filename)
+{
+    char *buf;
+    int copied = cat_kernel_copy(in_fd, out_fd);
+    ssize_t n;
+
+    if (copied != 0) {
+        return copied > 0 ? 0 : -1;
+    }
+
+    buf = malloc(CAT_BUFFER);
+    if (!buf) {
+        perror("cat");
+        return -1;
+    }
+
+    while ((n = read(in_fd, buf, CAT_BUFFER)) != 0) {
+        char *p = buf;
+
+        IO_STATS_READ(n);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror(filename);
+            free(buf);
+            return -1;
+        }
+        while (n > 0) {
+            ssize_t w = write(out_fd, p, (size_t)n);
+
+            IO_STATS_WRITE(w);
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EPIPE) {
+                    perror("cat: write error");
+                }
+                free(buf);
+                return -1;
+            }
+            p += w;
+            n -= w;
+        }
+    }
+
+    free(buf);
+    return 0;
+}
+
+/*
+ * Copy a line reader's input to stdout, numbering the lines with -n
+ * Returns: 0, or -1 after reporting an error
+ */
+static int cat_lines(line_reader_t *lr, int number_lines, int *line_number,
+                     const char *filename)
+{
+    pb_out_t out;
+    const char *data;
+    size_t len;
+    int r;
+    int err;
+
+    if (pb_out_init(&out, cmd_stdout()) != 0) {
+        perror("cat");
+        return -1;
+    }
+    if (number_lines) {
+        while ((r = line_reader_next(lr, &data, &len)) > 0) {
+            pb_out_int(&out, (*line_number)++, 6);
+            pb_out_write(&out, "  ", 2);
+            pb_out_write(&out, data, len);
+        }
+    } else {
+        while ((r = line_reader_lines(lr, &data, &len)) > 0) {
+            pb_out_write(&out, data, len);
+        }
+    }
+    err = r < 0 ? errno : 0;
+
+    if (pb_out_close(&out) != 0) {
+        if (errno != EPIPE) {
+            perror("cat: write error");
+        }
+        return -1;
+    }
+    if (err) {
+        errno = err;
+        perror(filename);
+        return -1;
+    }
+    return 0;
+}
 
 /*
  * Cat a single file to stdout
  * If filename is "-" or NULL, read from stdin
  */
-static int cat_file(const char *filename, int number_lines, int *line_number)
+static int cat_file(const char *filename, int number_lines, int decompress, int *line_number)
 {
     FILE *fp;
     char buffer[8192];
@@ -58,7 +256,7 @@ static int cat_file(const char *filename, int number_lines, int *line_number)
 
     /* Determine input source */
     if (filename == NULL || strcmp(filename, "-") == 0) {
-        fp = stdin;
+        fp = cmd_stdin();
         using_stdin = 1;
     } else {
         fp = fopen(filename, "r");
@@ -68,18 +266,55 @@ static int cat_file(const char *filename, int number_lines, int *line_number)
         }
     }
 
+    /* A plain regular file needs no decompressing */
+    if (decompress && !using_stdin && fileno(fp) >= 0 &&
+        decompress_fd_format(fileno(fp)) == DECOMPRESS_NONE) {
+        decompress = 0;
+    }
+
     /* Read and output the file */
-    if (number_lines) {
-        /* Line-by-line with numbering */
-        while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-            printf("%6d  %s", (*line_number)++, buffer);
+    if (number_lines || decompress) {
+        /* Through the line reader, numbering or decompressing */
+        line_reader_t lr;
+        int failed;
+
+        if ((using_stdin ? line_reader_init_stream(&lr, fp)
+                         : line_reader_init_fd(&lr, fileno(fp))) != 0) {
+            perror("cat");
+            if (!using_stdin) fclose(fp);
+            return EXIT_ERROR;
+        }
+        if (decompress && line_reader_decompress(&lr) < 0) {
+            perror(filename ? filename : "stdin");
+            line_reader_free(&lr);
+            if (!using_stdin) fclose(fp);
+            return EXIT_ERROR;
+        }
+        failed = cat_lines(&lr, number_lines, line_number, filename ? filename : "stdin");
+        line_reader_free(&lr);
+        if (failed) {
+            if (!using_stdin) fclose(fp);
+            return EXIT_ERROR;
+        }
+    } else if (fp != stdin && fileno(fp) >= 0 && fileno(cmd_stdout()) >= 0) {
+        /*
+         * Straight between descriptors. Not for the process's stdin: the
+         * shell may have buffered some of it in the FILE already.
+         */
+        fflush(cmd_stdout());
+        if (cat_fd(fileno(fp), fileno(cmd_stdout()), filename ? filename : "stdin") != 0) {
+            if (!using_stdin) fclose(fp);
+            return EXIT_ERROR;
         }
     } else {
         /* Efficient block read */
         size_t bytes_read;
         while ((bytes_read = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
-            if (fwrite(buffer, 1, bytes_read, stdout) != bytes_read) {
-                perror("cat: write error");
+            if (fwrite(buffer, 1, bytes_read, cmd_stdout()) != bytes_read) {
+                /* Reader went away (threaded pipeline): stop quietly */
+                if (errno != EPIPE) {
+                    perror("cat: write error");
+                }
                 if (!using_stdin) fclose(fp);
                 return EXIT_ERROR;
             }
@@ -107,17 +342,17 @@ int cat_run(int argc, char **argv)
 {
     int nerrors;
     int number_lines;
+    int decompress;
     int line_number = 1;
     int i;
     int ret = EXIT_OK;
 
     build_cat_argtable();
-    nerrors = arg_parse(argc, argv, cat_argtable);
+    nerrors = cmd_arg_parse(argc, argv, cat_argtable);
 
     /* Handle --help */
     if (cat_help->count > 0) {
-        cat_print_usage(stdout);
-        arg_freetable(cat_argtable, 4);
+        cat_print_usage(cmd_stdout());
         return EXIT_OK;
     }
 
@@ -125,28 +360,27 @@ int cat_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, cat_end, "cat");
         fprintf(stderr, "Try 'cat --help' for more information.\n");
-        arg_freetable(cat_argtable, 4);
         return EXIT_ERROR;
     }
 
     /* ===== ACTUAL COMMAND LOGIC ===== */
 
     number_lines = (cat_number->count > 0);
+    decompress = (cat_decompress->count > 0);
 
     /* If no files specified, read from stdin */
     if (cat_files->count == 0) {
-        ret = cat_file(NULL, number_lines, &line_number);
+        ret = cat_file(NULL, number_lines, decompress, &line_number);
     } else {
         /* Process each file */
         for (i = 0; i < cat_files->count; i++) {
-            if (cat_file(cat_files->filename[i], number_lines, &line_number) != EXIT_OK) {
+            if (cat_file(cat_files->filename[i], number_lines, decompress, &line_number) != EXIT_OK) {
                 ret = EXIT_ERROR;
                 /* Continue processing remaining files */
             }
         }
     }
 
-    arg_freetable(cat_argtable, 4);
     return ret;
 }
 
@@ -167,9 +401,8 @@ void cat_print_usage(FILE *out)
     fprintf(out, "  cat file.txt              Output contents of file.txt\n");
     fprintf(out, "  cat file1 file2           Concatenate files and output\n");
     fprintf(out, "  cat -n file.txt           Number all output lines\n");
+    fprintf(out, "  cat -z app.log.gz         Output app.log.gz decompressed\n");
     fprintf(out, "  cat                       Copy stdin to stdout\n");
-
-    arg_freetable(cat_argtable, 4);
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -178,9 +411,10 @@ cmd_spec_t cmd_cat_spec = {
     .name = "cat",
     .summary = "concatenate files and print on the standard output",
     .long_help = "Concatenate FILE(s), or standard input, to standard output. "
-                 "With -n, number all output lines.",
+                 "With -n, number all output lines; with -z, decompress gzip and zstd input.",
     .run = cat_run,
-    .print_usage = cat_print_usage
+    .print_usage = cat_print_usage,
+    .flags = CMD_FLAG_STREAMS | CMD_FLAG_PURE
 };
 
 /* ===== SECTION 6: REGISTRATION FUNCTION ===== */
@@ -4,17 +4,33 @@
  * This is the refactored version using argtable3 and following
  * the standard command anatomy for PicoBox.
  *
- * Usage: chmod MODE FILE...
- * MODE is an octal number like 755 or 644.
+ * Usage: chmod [-R] MODE FILE...
+ * MODE is an octal number like 755 or 644, or symbolic clauses like
+ * u+x,go-w. It is parsed once into a list of operations; each file's
+ * new mode is worked out from the st_mode it already has, and the
+ * fchmodat() is left out when nothing would change.
+ *
+ * -R goes through each FILE on the shared walker (walk.h), in parallel,
+ * with fchmodat() on the directory an entry is in. Symbolic links met
+ * on the way are left alone; ones given as FILE are followed.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* fchmodat() */
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
 #include <sys/stat.h>
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
+#include "walk.h"
+#include "work_pool.h"
 
 /* Forward declarations */
 int chmod_run(int argc, char **argv);
@@ -23,25 +39,226 @@ void chmod_print_usage(FILE *out);
 /* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
 
 static struct arg_lit *chmod_help;
+static struct arg_lit *chmod_recursive;
 static struct arg_str *chmod_mode;
 static struct arg_file *chmod_files;
 static struct arg_end *chmod_end;
-static void *chmod_argtable[5];
+static void *chmod_argtable[6];
 
 /* ===== SECTION 2: ARGTABLE BUILDER ===== */
 
 static void build_chmod_argtable(void)
 {
+    if (chmod_argtable[0] != NULL) {
+        return;
+    }
+
     chmod_help = arg_lit0("h", "help", "display this help and exit");
-    chmod_mode = arg_str1(NULL, NULL, "MODE", "octal mode (e.g., 755, 644)");
+    chmod_recursive = arg_lit0("R", "recursive", "change files and directories recursively");
+    chmod_mode = arg_str1(NULL, NULL, "MODE", "octal mode (e.g., 755) or symbolic (e.g., u+x,go-w)");
     chmod_files = arg_filen(NULL, NULL, "FILE", 1, 100, "files to change mode");
     chmod_end = arg_end(20);
 
     chmod_argtable[0] = chmod_help;
-    chmod_argtable[1] = chmod_mode;
-    chmod_argtable[2] = chmod_files;
-    chmod_argtable[3] = chmod_end;
-    chmod_argtable[4] = NULL;
+    chmod_argtable[1] = chmod_recursive;
+    chmod_argtable[2] = chmod_mode;
+    chmod_argtable[3] = chmod_files;
+    chmod_argtable[4] = chmod_end;
+    chmod_argtable[5] = NULL;
+}
+
+/* ===== HELPER FUNCTIONS ===== */
+
+#define CHMOD_ALL  (S_ISUID | S_ISGID | S_ISVTX | 0777)
+
+/*
+ * One operation of a mode: the bits it affects are bits & who (and for
+ * '=' every bit in who is cleared first, except a directory's set-id
+ * bits unless the mode names them). For X they are set only on a
+ * directory or a file with an execute bit already; copy takes them
+ * from the file's own u, g or o permissions instead.
+ */
+typedef struct chmod_op {
+    char op;        /* '+', '-' or '=' */
+    char copy;      /* 'u', 'g', 'o', or 0 */
+    char dir_ids;   /* '=' clears a directory's set-id bits: octal with 5 digits */
+    mode_t who;
+    mode_t bits;
+    mode_t xbits;   /* X: execute bits set only where they make sense */
+} chmod_op_t;
+
+typedef struct chmod_mode {
+    chmod_op_t *ops;
+    size_t nops;
+} chmod_mode_t;
+
+/*
+ * Parse MODE, octal or comma-separated [ugoa]*([-+=]([rwxXst]*|[ugo]))+
+ * clauses, into ops; a clause without [ugoa] leaves the bits in the
+ * umask alone
+ * Returns: 0, or -1 if MODE is not valid
+ */
+static int parse_mode(const char *s, chmod_mode_t *m)
+{
+    mode_t mask;
+    const char *p;
+
+    m->ops = calloc(strlen(s) + 1, sizeof(chmod_op_t));
+    m->nops = 0;
+    if (!m->ops) {
+        return -1;
+    }
+
+    if (*s >= '0' && *s <= '7') {
+        char *endptr;
+        long val = strtol(s, &endptr, 8);
+
+        if (*endptr != '\0' || val > CHMOD_ALL) {
+            return -1;
+        }
+        m->ops[0].op = '=';
+        m->ops[0].who = CHMOD_ALL;
+        m->ops[0].bits = (mode_t)val;
+        m->ops[0].dir_ids = endptr - s > 4;
+        m->nops = 1;
+        return 0;
+    }
+
+    mask = umask(0);
+    umask(mask);
+
+    p = s;
+    for (;;) {
+        mode_t who = 0;
+        mode_t limit;
+
+        for (; *p && strchr("ugoa", *p); p++) {
+            who |= *p == 'u' ? S_ISUID | S_IRWXU :
+                   *p == 'g' ? S_ISGID | S_IRWXG :
+                   *p == 'o' ? S_ISVTX | S_IRWXO : CHMOD_ALL;
+        }
+        limit = who ? CHMOD_ALL : (mode_t)~mask;
+        if (!who) {
+            who = CHMOD_ALL;
+        }
+        if (*p != '+' && *p != '-' && *p != '=') {
+            return -1;
+        }
+
+        while (*p == '+' || *p == '-' || *p == '=') {
+            chmod_op_t *op = &m->ops[m->nops++];
+
+            op->op = *p++;
+            op->who = who;
+            if (*p == 'u' || *p == 'g' || *p == 'o') {
+                op->copy = *p++;
+                op->bits = 0777 & limit;
+                continue;
+            }
+            for (; *p && strchr("rwxXst", *p); p++) {
+                op->bits |= *p == 'r' ? 0444 :
+                            *p == 'w' ? 0222 :
+                            *p == 'x' ? 0111 :
+                            *p == 's' ? S_ISUID | S_ISGID :
+                            *p == 't' ? S_ISVTX : 0;
+                op->xbits |= *p == 'X' ? 0111 : 0;
+            }
+            op->bits &= limit;
+            op->xbits &= limit;
+        }
+
+        if (*p == '\0') {
+            return 0;
+        }
+        if (*p++ != ',') {
+            return -1;
+        }
+    }
+}
+
+/* The mode a file with mode old gets */
+static mode_t apply_mode(const chmod_mode_t *m, mode_t old)
+{
+    mode_t mode = old & CHMOD_ALL;
+    size_t i;
+
+    for (i = 0; i < m->nops; i++) {
+        const chmod_op_t *op = &m->ops[i];
+        mode_t bits = op->bits;
+        mode_t clear;
+
+        if (op->copy) {
+            mode_t from = op->copy == 'u' ? (mode >> 6) & 7 :
+                          op->copy == 'g' ? (mode >> 3) & 7 : mode & 7;
+
+            bits &= from * 0111;
+        }
+        if (op->xbits && (S_ISDIR(old) || (mode & 0111))) {
+            bits |= op->xbits;
+        }
+        bits &= op->who;
+
+        switch (op->op) {
+        case '+':
+            mode |= bits;
+            break;
+        case '-':
+            mode &= ~bits;
+            break;
+        default:
+            clear = op->who;
+            if (S_ISDIR(old) && !op->dir_ids) {
+                clear &= ~(S_ISUID | S_ISGID);
+            }
+            mode = (mode & ~clear) | bits;
+            break;
+        }
+    }
+    return mode;
+}
+
+/*
+ * Give the file name in dirfd the mode m makes of st; nothing is done
+ * when it already has it
+ * Returns: 0, or -1 with errno set
+ */
+static int chmod_at(int dirfd, const char *name, const struct stat *st,
+                    const chmod_mode_t *m)
+{
+    mode_t mode = apply_mode(m, st->st_mode);
+
+    if (mode == (st->st_mode & CHMOD_ALL)) {
+        return 0;
+    }
+    return fchmodat(dirfd, name, mode, 0);
+}
+
+typedef struct chmod_ctx {
+    const chmod_mode_t *mode;
+    atomic_int failed;
+} chmod_ctx_t;
+
+static int chmod_visit(const walk_entry_t *e, void *arg)
+{
+    chmod_ctx_t *ctx = arg;
+
+    if (e->visit == WALK_ERROR) {
+        fprintf(stderr, "%s: %s\n", e->path, strerror(e->error));
+        atomic_store(&ctx->failed, 1);
+        /* A directory that could not be listed still gets its mode */
+        if (!e->st || e->type != WALK_T_DIR) {
+            return WALK_CONTINUE;
+        }
+    } else if (e->visit == WALK_POST || e->type == WALK_T_LNK) {
+        return WALK_CONTINUE;
+    }
+
+    /* A directory's mode changes before its entries: it is open already */
+    if (chmod_at(e->dirfd, e->name, e->st, ctx->mode) != 0) {
+        fprintf(stderr, "%s: %s\n", e->path, strerror(errno));
+        atomic_store(&ctx->failed, 1);
+    }
+    return WALK_CONTINUE;
 }
 
 /* ===== SECTION 3: RUN FUNCTION ===== */
@@ -49,9 +266,8 @@ static void build_chmod_argtable(void)
 int chmod_run(int argc, char **argv)
 {
     int nerrors;
-    mode_t mode;
-    char *endptr;
-    long val;
+    chmod_mode_t mode;
+    struct stat st;
     int i;
     int ret = EXIT_OK;
 
@@ -61,7 +277,6 @@ int chmod_run(int argc, char **argv)
     /* Handle --help */
     if (chmod_help->count > 0) {
         chmod_print_usage(stdout);
-        arg_freetable(chmod_argtable, 4);
         return EXIT_OK;
     }
 
@@ -69,30 +284,45 @@ int chmod_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, chmod_end, "chmod");
         fprintf(stderr, "Try 'chmod --help' for more information.\n");
-        arg_freetable(chmod_argtable, 4);
         return EXIT_ERROR;
     }
 
     /* ===== ACTUAL COMMAND LOGIC ===== */
 
-    /* Parse mode (octal) */
-    val = strtol(chmod_mode->sval[0], &endptr, 8);
-    if (*endptr != '\0' || val < 0 || val > 0777) {
+    /* Parse mode (octal or symbolic), once for every file */
+    if (parse_mode(chmod_mode->sval[0], &mode) != 0) {
         fprintf(stderr, "chmod: invalid mode '%s'\n", chmod_mode->sval[0]);
-        arg_freetable(chmod_argtable, 4);
+        free(mode.ops);
         return EXIT_ERROR;
     }
-    mode = (mode_t)val;
 
-    /* Change mode for each file */
-    for (i = 0; i < chmod_files->count; i++) {
-        if (chmod(chmod_files->filename[i], mode) != 0) {
-            perror(chmod_files->filename[i]);
+    if (chmod_recursive->count > 0) {
+        walk_opts_t opts = { WALK_STAT | WALK_FOLLOW_ROOTS | WALK_PARALLEL | WALK_SPREAD,
+                             work_pool_default_workers(), 0, NULL };
+        chmod_ctx_t ctx;
+
+        ctx.mode = &mode;
+        atomic_init(&ctx.failed, 0);
+        if (walk(AT_FDCWD, (const char *const *)chmod_files->filename, chmod_files->count,
+                 &opts, chmod_visit, &ctx) < 0) {
+            perror("chmod");
             ret = EXIT_ERROR;
         }
+        if (atomic_load(&ctx.failed)) {
+            ret = EXIT_ERROR;
+        }
+    } else {
+        /* Change mode for each file */
+        for (i = 0; i < chmod_files->count; i++) {
+            if (stat(chmod_files->filename[i], &st) != 0 ||
+                chmod_at(AT_FDCWD, chmod_files->filename[i], &st, &mode) != 0) {
+                perror(chmod_files->filename[i]);
+                ret = EXIT_ERROR;
+            }
+        }
     }
 
-    arg_freetable(chmod_argtable, 4);
+    free(mode.ops);
     return ret;
 }
 
@@ -105,7 +335,8 @@ void chmod_print_usage(FILE *out)
     fprintf(out, "Usage: chmod ");
     arg_print_syntax(out, chmod_argtable, "\n");
     fprintf(out, "Change the mode of each FILE to MODE.\n");
-    fprintf(out, "MODE is an octal number like 755 or 644.\n\n");
+    fprintf(out, "MODE is an octal number like 755 or 644, or comma-separated clauses\n");
+    fprintf(out, "[ugoa]*[-+=][rwxXst]* like u+x,go-w.\n\n");
     fprintf(out, "Options:\n");
     arg_print_glossary(out, chmod_argtable, "  %-25s %s\n");
     fprintf(out, "\n");
@@ -113,8 +344,8 @@ void chmod_print_usage(FILE *out)
     fprintf(out, "  chmod 755 script.sh   Make file rwxr-xr-x\n");
     fprintf(out, "  chmod 644 file.txt    Make file rw-r--r--\n");
     fprintf(out, "  chmod 600 secret.txt  Make file rw-------\n");
-
-    arg_freetable(chmod_argtable, 4);
+    fprintf(out, "  chmod -R u+rwX,go-w dir\n");
+    fprintf(out, "                        Fix permissions on a whole tree\n");
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -6,20 +6,25 @@
  *
  * Usage: cp [OPTIONS] SOURCE DEST
  * Options:
- *   -r, -R, --recursive   Copy directories recursively
+ *   -r, -R, --recursive   Copy directories recursively (in parallel,
+ *                         see tree_copy.h)
  *   -f, --force           Force overwrite (accepted but not fully implemented)
  *   -h, --help            Display help message
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* AT_FDCWD */
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
-#include <sys/stat.h>
-#include <dirent.h>
+#include <fcntl.h>
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
+#include "tree_copy.h"
 #include "utils.h"
 
 /* Forward declarations */
@@ -40,6 +45,10 @@ static void *cp_argtable[6];
 
 static void build_cp_argtable(void)
 {
+    if (cp_argtable[0] != NULL) {
+        return;
+    }
+
     cp_help = arg_lit0("h", "help", "display this help and exit");
     cp_recursive_flag = arg_lit0("rR", "recursive", "copy directories recursively");
     cp_force = arg_lit0("f", "force", "force overwrite");
@@ -65,49 +74,10 @@ static int cp_file_to_file(const char *src, const char *dest)
     return EXIT_OK;
 }
 
+/* Copy a tree on the thread pool; see tree_copy.h */
 static int cp_recursive(const char *src, const char *dest)
 {
-    DIR *dir;
-    struct dirent *entry;
-    char src_path[4096];
-    char dest_path[4096];
-    struct stat st;
-
-    if (stat(src, &st) != 0) {
-        perror(src);
-        return EXIT_ERROR;
-    }
-
-    if (!S_ISDIR(st.st_mode)) {
-        return cp_file_to_file(src, dest);
-    }
-
-    /* Create destination directory */
-    if (mkdir(dest, st.st_mode) != 0 && errno != EEXIST) {
-        perror(dest);
-        return EXIT_ERROR;
-    }
-
-    /* Copy directory contents */
-    dir = opendir(src);
-    if (!dir) {
-        perror(src);
-        return EXIT_ERROR;
-    }
-
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
-
-        snprintf(src_path, sizeof(src_path), "%s/%s", src, entry->d_name);
-        snprintf(dest_path, sizeof(dest_path), "%s/%s", dest, entry->d_name);
-
-        cp_recursive(src_path, dest_path);
-    }
-
-    closedir(dir);
-    return EXIT_OK;
+    return tree_copy_at(AT_FDCWD, src, AT_FDCWD, dest, "cp") == 0 ? EXIT_OK : EXIT_ERROR;
 }
 
 /* ===== SECTION 3: RUN FUNCTION ===== */
@@ -125,7 +95,6 @@ int cp_run(int argc, char **argv)
     /* Handle --help */
     if (cp_help->count > 0) {
         cp_print_usage(stdout);
-        arg_freetable(cp_argtable, 5);
         return EXIT_OK;
     }
 
@@ -133,7 +102,6 @@ int cp_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, cp_end, "cp");
         fprintf(stderr, "Try 'cp --help' for more information.\n");
-        arg_freetable(cp_argtable, 5);
         return EXIT_ERROR;
     }
 
@@ -151,7 +119,6 @@ int cp_run(int argc, char **argv)
     /* If source is a directory but -r wasn't specified → error */
     if (is_directory(src) && !recursive) {
         fprintf(stderr, "cp: '%s' is a directory (use -r)\n", src);
-        arg_freetable(cp_argtable, 5);
         return EXIT_ERROR;
     }
 
@@ -163,7 +130,6 @@ int cp_run(int argc, char **argv)
         ret = cp_file_to_file(src, dest);
     }
 
-    arg_freetable(cp_argtable, 5);
     return ret;
 }
 
@@ -183,8 +149,6 @@ void cp_print_usage(FILE *out)
     fprintf(out, "  cp file1.txt file2.txt        Copy single file\n");
     fprintf(out, "  cp script.sh /usr/local/bin/  Copy file to directory\n");
     fprintf(out, "  cp -r mydir backup/           Copy directory recursively\n");
-
-    arg_freetable(cp_argtable, 5);
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
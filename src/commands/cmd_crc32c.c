@@ -0,0 +1,179 @@
+/*
+ * cmd_crc32c.c - Print or check CRC-32C checksums
+ *
+ * Usage: crc32c [OPTIONS] [FILE...]
+ * Options:
+ *   -c, --check       Read checksums from the FILEs and check them
+ *       --quiet       Don't print OK for each successfully verified file
+ *       --status      Don't output anything; the exit status shows success
+ *   -h, --help        Display help message
+ *
+ * The CRC is taken eight bytes at a time with the CPU's CRC32
+ * instruction when it has one (crc32c.h). It is printed as eight hex
+ * digits, in the same "CRC  NAME" manifest format as sha256sum, and
+ * several files are checked at once (checksum.h); output is in order.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* AT_FDCWD */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include "argtable3.h"
+#include "cmd_spec.h"
+#include "picobox.h"
+#include "checksum.h"
+
+/* Forward declarations */
+int crc32c_run(int argc, char **argv);
+void crc32c_print_usage(FILE *out);
+
+/* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
+
+static struct arg_lit *crc32c_help;
+static struct arg_lit *crc32c_check;
+static struct arg_lit *crc32c_quiet;
+static struct arg_lit *crc32c_status;
+static struct arg_file *crc32c_files;
+static struct arg_end *crc32c_end;
+static void *crc32c_argtable[7];
+
+/* ===== SECTION 2: ARGTABLE BUILDER ===== */
+
+static void build_crc32c_argtable(void)
+{
+    if (crc32c_argtable[0] != NULL) {
+        return;
+    }
+
+    crc32c_help = arg_lit0("h", "help", "display this help and exit");
+    crc32c_check = arg_lit0("c", "check", "read checksums from the FILEs and check them");
+    crc32c_quiet = arg_lit0(NULL, "quiet", "don't print OK for each successfully verified file");
+    crc32c_status = arg_lit0(NULL, "status", "don't output anything, status code shows success");
+    crc32c_files = arg_filen(NULL, NULL, "FILE", 0, 1000, "files to hash, or manifests with -c");
+    crc32c_end = arg_end(20);
+
+    crc32c_argtable[0] = crc32c_help;
+    crc32c_argtable[1] = crc32c_check;
+    crc32c_argtable[2] = crc32c_quiet;
+    crc32c_argtable[3] = crc32c_status;
+    crc32c_argtable[4] = crc32c_files;
+    crc32c_argtable[5] = crc32c_end;
+    crc32c_argtable[6] = NULL;
+}
+
+/* ===== HELPER FUNCTIONS ===== */
+
+/*
+ * List or check the operands (standard input when there are none)
+ * Returns: EXIT_OK or EXIT_ERROR
+ */
+static int crc32c_operands(FILE *in, FILE *out)
+{
+    static char *dash[] = { "-" };
+    char **names = crc32c_files->count > 0 ? (char **)crc32c_files->filename : dash;
+    size_t n = crc32c_files->count > 0 ? (size_t)crc32c_files->count : 1;
+    int ret = EXIT_OK;
+
+    if (crc32c_check->count == 0) {
+        return checksum_list(CHECKSUM_CRC32C, in, out, names, n, "crc32c") == 0 ? EXIT_OK : EXIT_ERROR;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        int flags = (crc32c_quiet->count > 0 ? CHECKSUM_QUIET : 0) |
+                    (crc32c_status->count > 0 ? CHECKSUM_STATUS : 0);
+        FILE *manifest = strcmp(names[i], "-") == 0 ? in : fopen(names[i], "r");
+
+        if (!manifest) {
+            perror(names[i]);
+            ret = EXIT_ERROR;
+            continue;
+        }
+        if (checksum_check(CHECKSUM_CRC32C, AT_FDCWD, in, manifest,
+                           manifest == in ? "standard input" : names[i], out, flags, "crc32c") != 0) {
+            ret = EXIT_ERROR;
+        }
+        if (manifest != in) {
+            fclose(manifest);
+        }
+    }
+    return ret;
+}
+
+/* ===== SECTION 3: RUN FUNCTION ===== */
+
+int crc32c_run(int argc, char **argv)
+{
+    int nerrors;
+    int ret;
+
+    build_crc32c_argtable();
+    nerrors = cmd_arg_parse(argc, argv, crc32c_argtable);
+
+    /* Handle --help */
+    if (crc32c_help->count > 0) {
+        crc32c_print_usage(cmd_stdout());
+        return EXIT_OK;
+    }
+
+    /* Handle parsing errors */
+    if (nerrors > 0) {
+        arg_print_errors(stderr, crc32c_end, "crc32c");
+        fprintf(stderr, "Try 'crc32c --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
+    /* ===== ACTUAL COMMAND LOGIC ===== */
+
+    ret = crc32c_operands(cmd_stdin(), cmd_stdout());
+    return ret;
+}
+
+/* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
+
+void crc32c_print_usage(FILE *out)
+{
+    build_crc32c_argtable();
+
+    fprintf(out, "Usage: crc32c ");
+    arg_print_syntax(out, crc32c_argtable, "\n");
+    fprintf(out, "Print or check CRC-32C (Castagnoli) checksums.\n");
+    fprintf(out, "With no FILE, or when FILE is -, read standard input.\n\n");
+    fprintf(out, "Options:\n");
+    arg_print_glossary(out, crc32c_argtable, "  %-20s %s\n");
+    fprintf(out, "\n");
+    fprintf(out, "Examples:\n");
+    fprintf(out, "  crc32c *.img > CRC32C   Write a manifest\n");
+    fprintf(out, "  crc32c -c CRC32C         Check files against it\n");
+}
+
+/* ===== SECTION 5: COMMAND SPECIFICATION ===== */
+
+cmd_spec_t cmd_crc32c_spec = {
+    .name = "crc32c",
+    .summary = "print or check CRC-32C checksums",
+    .long_help = "Print or check CRC-32C (Castagnoli) checksums. Files are checked in parallel, "
+                 "with the CPU's CRC32 instruction when it has one.",
+    .run = crc32c_run,
+    .print_usage = crc32c_print_usage,
+    .flags = CMD_FLAG_STREAMS | CMD_FLAG_PURE
+};
+
+/* ===== SECTION 6: REGISTRATION FUNCTION ===== */
+
+void register_crc32c_command(void)
+{
+    register_command(&cmd_crc32c_spec);
+}
+
+/* ===== SECTION 7: STANDALONE MAIN ===== */
+
+#ifndef BUILTIN_ONLY
+int main(int argc, char **argv)
+{
+    return cmd_crc32c_spec.run(argc, argv);
+}
+#endif
@@ -0,0 +1,556 @@
+/*
+ * cmd_cut.c - Select fields or byte ranges from each line
+ *
+ * Usage: cut OPTION... [FILE...]
+ * Options:
+ *   -b, --bytes=LIST              Select these bytes
+ *   -c, --characters=LIST         Select these characters (bytes, in the C locale)
+ *   -f, --fields=LIST             Select these fields; lines without a delimiter
+ *                                 are printed whole
+ *   -d, --delimiter=DELIM         Fields end at DELIM instead of TAB
+ *   --output-delimiter=STRING     Put STRING between the selected pieces
+ *   -h, --help                    Display help message
+ *
+ * LIST is compiled once: ranges are sorted and overlapping ones merged
+ * (byte mode walks them per line), and the selected fields are set in a
+ * bitmap, with every field from the start of an open range (N-) on
+ * selected without a bit. Input is taken a buffer of whole lines at a
+ * time (line_reader_lines()) and never copied line by line: the
+ * selected pieces are written to the output as slices of the read
+ * buffer.
+ *
+ * Delimiters are found with literal_find_either(), which looks for the
+ * delimiter and the newline together 16 or 32 bytes at a time. Once a
+ * line is past its last selected field the rest is skipped with one
+ * memchr() for the newline, and when every field from there on is
+ * selected (and is to be joined with the input delimiter) the rest of
+ * the line goes out as one slice.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* O_CLOEXEC */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "argtable3.h"
+#include "cmd_spec.h"
+#include "picobox.h"
+#include "literal_search.h"
+#include "pb_out.h"
+#include "utils.h"
+
+/* Forward declarations */
+int cut_run(int argc, char **argv);
+void cut_print_usage(FILE *out);
+
+/* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
+
+static struct arg_lit *cut_help;
+static struct arg_str *cut_bytes;
+static struct arg_str *cut_chars;
+static struct arg_str *cut_fields;
+static struct arg_str *cut_delim;
+static struct arg_str *cut_odelim;
+static struct arg_file *cut_files;
+static struct arg_end *cut_end;
+static void *cut_argtable[9];
+
+/* ===== SECTION 2: ARGTABLE BUILDER ===== */
+
+static void build_cut_argtable(void)
+{
+    if (cut_argtable[0] != NULL) {
+        return;
+    }
+
+    cut_help = arg_lit0("h", "help", "display this help and exit");
+    cut_bytes = arg_str0("b", "bytes", "LIST", "select only these bytes");
+    cut_chars = arg_str0("c", "characters", "LIST", "select only these characters");
+    cut_fields = arg_str0("f", "fields", "LIST",
+                          "select only these fields; lines without a delimiter are printed whole");
+    cut_delim = arg_str0("d", "delimiter", "DELIM", "use DELIM instead of TAB as the field delimiter");
+    cut_odelim = arg_str0(NULL, "output-delimiter", "STRING",
+                          "join the selected pieces with STRING (default: the input delimiter)");
+    cut_files = arg_filen(NULL, NULL, "FILE", 0, 100, "files to process (or stdin if none)");
+    cut_end = arg_end(20);
+
+    cut_argtable[0] = cut_help;
+    cut_argtable[1] = cut_bytes;
+    cut_argtable[2] = cut_chars;
+    cut_argtable[3] = cut_fields;
+    cut_argtable[4] = cut_delim;
+    cut_argtable[5] = cut_odelim;
+    cut_argtable[6] = cut_files;
+    cut_argtable[7] = cut_end;
+    cut_argtable[8] = NULL;
+}
+
+/* ===== HELPER FUNCTIONS ===== */
+
+typedef struct cut_range {
+    size_t lo;                 /* 1-based, inclusive */
+    size_t hi;                 /* SIZE_MAX: to the end of the line */
+} cut_range_t;
+
+typedef struct cut_list {
+    cut_range_t *ranges;       /* Sorted, overlapping ones merged */
+    size_t nranges;
+    uint64_t *bits;            /* Bit n: field n selected, for n <= nbits */
+    size_t nbits;
+    size_t open_from;          /* Every field from here on, or SIZE_MAX */
+    size_t last;               /* Last selected field, or SIZE_MAX */
+} cut_list_t;
+
+typedef struct cut_ctx {
+    cut_list_t list;
+    int fields;                /* -f, not -b/-c */
+    unsigned char delim;
+    const char *odelim;        /* NULL: the input delimiter (-f) or nothing (-b) */
+    size_t odelim_len;
+} cut_ctx_t;
+
+static int cut_range_cmp(const void *a, const void *b)
+{
+    const cut_range_t *x = a;
+    const cut_range_t *y = b;
+
+    return x->lo < y->lo ? -1 : x->lo > y->lo;
+}
+
+/* Parse a decimal position. Returns: the rest of s, or NULL */
+static const char *cut_number(const char *s, size_t *n)
+{
+    size_t v = 0;
+
+    if (*s < '0' || *s > '9') {
+        return NULL;
+    }
+    for (; *s >= '0' && *s <= '9'; s++) {
+        if (v > (SIZE_MAX - 10) / 10) {
+            return NULL;
+        }
+        v = v * 10 + (size_t)(*s - '0');
+    }
+    *n = v;
+    return s;
+}
+
+/*
+ * Compile LIST (N, N-M, N-, -M, separated by commas) into l
+ * what: "fields" or "byte/character positions", for the messages
+ * Returns: 0, or -1 after a message
+ */
+static int cut_parse_list(const char *list, const char *what, cut_list_t *l)
+{
+    const char *s = list;
+    size_t cap = 8;
+    size_t i;
+
+    memset(l, 0, sizeof(*l));
+    l->open_from = SIZE_MAX;
+    l->ranges = malloc(cap * sizeof(*l->ranges));
+    if (!l->ranges) {
+        perror("cut");
+        return -1;
+    }
+
+    for (;;) {
+        cut_range_t r = { 1, SIZE_MAX };
+
+        if (*s != '-') {
+            s = cut_number(s, &r.lo);
+            if (!s) {
+                goto invalid;
+            }
+            r.hi = r.lo;
+        }
+        if (*s == '-') {
+            s++;
+            r.hi = SIZE_MAX;
+            if (*s >= '0' && *s <= '9') {
+                s = cut_number(s, &r.hi);
+                if (!s) {
+                    goto invalid;
+                }
+            } else if (s == list + 1) {
+                goto invalid;          /* A lone "-" */
+            }
+        }
+        if (r.lo == 0 || r.hi == 0) {
+            fprintf(stderr, "cut: %s are numbered from 1\n", what);
+            return -1;
+        }
+        if (r.hi < r.lo) {
+            fprintf(stderr, "cut: invalid decreasing range\n");
+            return -1;
+        }
+
+        if (l->nranges == cap) {
+            cut_range_t *p = realloc(l->ranges, cap * 2 * sizeof(*p));
+
+            if (!p) {
+                perror("cut");
+                return -1;
+            }
+            l->ranges = p;
+            cap *= 2;
+        }
+        l->ranges[l->nranges++] = r;
+
+        if (*s == '\0') {
+            break;
+        }
+        if (*s != ',') {
+            goto invalid;
+        }
+        s++;
+    }
+
+    /* Sort, and merge ranges that overlap (adjacent ones stay apart) */
+    qsort(l->ranges, l->nranges, sizeof(*l->ranges), cut_range_cmp);
+    for (i = 1, cap = 0; i < l->nranges; i++) {
+        cut_range_t *prev = &l->ranges[cap];
+
+        if (l->ranges[i].lo <= prev->hi) {
+            if (l->ranges[i].hi > prev->hi) {
+                prev->hi = l->ranges[i].hi;
+            }
+        } else {
+            l->ranges[++cap] = l->ranges[i];
+        }
+    }
+    l->nranges = cap + 1;
+
+    /* The bitmap covers every field up to the last finite bound */
+    for (i = 0; i < l->nranges; i++) {
+        const cut_range_t *r = &l->ranges[i];
+
+        if (r->hi == SIZE_MAX) {
+            if (r->lo < l->open_from) {
+                l->open_from = r->lo;
+            }
+            if (r->lo - 1 > l->nbits) {
+                l->nbits = r->lo - 1;
+            }
+        } else if (r->hi > l->nbits) {
+            l->nbits = r->hi;
+        }
+    }
+    l->bits = calloc(l->nbits / 64 + 1, sizeof(uint64_t));
+    if (!l->bits) {
+        perror("cut");
+        return -1;
+    }
+    for (i = 0; i < l->nranges; i++) {
+        size_t hi = l->ranges[i].hi < l->nbits ? l->ranges[i].hi : l->nbits;
+        size_t n;
+
+        for (n = l->ranges[i].lo; n <= hi; n++) {
+            l->bits[n / 64] |= (uint64_t)1 << (n % 64);
+        }
+    }
+    l->last = l->open_from == SIZE_MAX ? l->ranges[l->nranges - 1].hi : SIZE_MAX;
+    return 0;
+
+invalid:
+    fprintf(stderr, "cut: invalid %s list '%s'\n",
+            strcmp(what, "fields") == 0 ? "field" : "byte or character", list);
+    return -1;
+}
+
+static void cut_list_free(cut_list_t *l)
+{
+    free(l->ranges);
+    free(l->bits);
+}
+
+static int cut_selected(const cut_list_t *l, size_t n)
+{
+    if (n >= l->open_from) {
+        return 1;
+    }
+    return n <= l->nbits && (l->bits[n / 64] >> (n % 64) & 1);
+}
+
+static void cut_sep(const cut_ctx_t *c, pb_out_t *out)
+{
+    if (c->odelim) {
+        pb_out_write(out, c->odelim, c->odelim_len);
+    } else if (c->fields) {
+        pb_out_putc(out, (char)c->delim);
+    }
+}
+
+/* End of the line starting at p: its '\n', or end */
+static const char *cut_eol(const char *p, const char *end)
+{
+    const char *nl = memchr(p, '\n', (size_t)(end - p));
+
+    return nl ? nl : end;
+}
+
+/* Write the selected fields of every line in p..end */
+static void cut_fields_span(const cut_ctx_t *c, pb_out_t *out, const char *p, const char *end)
+{
+    const cut_list_t *l = &c->list;
+    /* The rest of a line can go out as one slice only if it needs no rewriting */
+    int whole_tail = !c->odelim || (c->odelim_len == 1 && (unsigned char)c->odelim[0] == c->delim);
+
+    while (p < end) {
+        const char *q = literal_find_either(p, (size_t)(end - p), c->delim, '\n');
+        const char *fs = p;
+        size_t f = 1;
+        int first = 1;
+
+        if (!q) {
+            q = end;
+        }
+        if (q == end || *q == '\n') {
+            /* No delimiter: the line is printed as it is */
+            pb_out_write(out, p, (size_t)(q - p));
+            pb_out_putc(out, '\n');
+            p = q < end ? q + 1 : end;
+            continue;
+        }
+
+        for (;;) {
+            /* Field f is fs..q, and q is a delimiter, the newline or the end */
+            if (cut_selected(l, f)) {
+                if (!first) {
+                    cut_sep(c, out);
+                }
+                pb_out_write(out, fs, (size_t)(q - fs));
+                first = 0;
+            }
+            if (q == end || *q == '\n') {
+                break;
+            }
+            fs = q + 1;
+            f++;
+            if (f > l->last) {
+                q = cut_eol(fs, end);
+                break;
+            }
+            if (f >= l->open_from && whole_tail) {
+                q = cut_eol(fs, end);
+                if (!first) {
+                    cut_sep(c, out);
+                }
+                pb_out_write(out, fs, (size_t)(q - fs));
+                break;
+            }
+            q = literal_find_either(fs, (size_t)(end - fs), c->delim, '\n');
+            if (!q) {
+                q = end;
+            }
+        }
+        pb_out_putc(out, '\n');
+        p = q < end ? q + 1 : end;
+    }
+}
+
+/* Write the selected byte ranges of every line in p..end */
+static void cut_bytes_span(const cut_ctx_t *c, pb_out_t *out, const char *p, const char *end)
+{
+    const cut_list_t *l = &c->list;
+
+    while (p < end) {
+        const char *eol = cut_eol(p, end);
+        size_t len = (size_t)(eol - p);
+        size_t i;
+
+        for (i = 0; i < l->nranges && l->ranges[i].lo <= len; i++) {
+            size_t hi = l->ranges[i].hi < len ? l->ranges[i].hi : len;
+
+            if (i > 0) {
+                cut_sep(c, out);
+            }
+            pb_out_write(out, p + l->ranges[i].lo - 1, hi - l->ranges[i].lo + 1);
+        }
+        pb_out_putc(out, '\n');
+        p = eol < end ? eol + 1 : end;
+    }
+}
+
+/* Cut one input. Returns: EXIT_OK or EXIT_ERROR */
+static int cut_file(const cut_ctx_t *c, const char *filename, pb_out_t *out)
+{
+    int use_stdin = strcmp(filename, "-") == 0;
+    int fd = use_stdin ? -1 : open(filename, O_RDONLY | O_CLOEXEC);
+    line_reader_t lr;
+    const char *data;
+    size_t len;
+    int r;
+
+    if (!use_stdin && fd < 0) {
+        perror(filename);
+        return EXIT_ERROR;
+    }
+    if ((use_stdin ? line_reader_init_stream(&lr, cmd_stdin())
+                   : line_reader_init_fd(&lr, fd)) != 0) {
+        perror("cut");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return EXIT_ERROR;
+    }
+
+    while ((r = line_reader_lines(&lr, &data, &len)) > 0) {
+        if (c->fields) {
+            cut_fields_span(c, out, data, data + len);
+        } else {
+            cut_bytes_span(c, out, data, data + len);
+        }
+    }
+    line_reader_free(&lr);
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (r < 0) {
+        perror(use_stdin ? "stdin" : filename);
+        return EXIT_ERROR;
+    }
+    return EXIT_OK;
+}
+
+/* ===== SECTION 3: RUN FUNCTION ===== */
+
+int cut_run(int argc, char **argv)
+{
+    int nerrors;
+    cut_ctx_t ctx;
+    const char *list;
+    int nlists;
+    pb_out_t out;
+    int ret = EXIT_OK;
+    int i;
+
+    build_cut_argtable();
+    nerrors = cmd_arg_parse(argc, argv, cut_argtable);
+
+    /* Handle --help */
+    if (cut_help->count > 0) {
+        cut_print_usage(cmd_stdout());
+        return EXIT_OK;
+    }
+
+    /* Handle parsing errors */
+    if (nerrors > 0) {
+        arg_print_errors(stderr, cut_end, "cut");
+        fprintf(stderr, "Try 'cut --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
+    /* ===== ACTUAL COMMAND LOGIC ===== */
+
+    memset(&ctx, 0, sizeof(ctx));
+    nlists = cut_bytes->count + cut_chars->count + cut_fields->count;
+    if (nlists != 1) {
+        fprintf(stderr, nlists == 0 ? "cut: you must specify a list of bytes, characters, or fields\n"
+                                    : "cut: only one type of list may be specified\n");
+        fprintf(stderr, "Try 'cut --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+    ctx.fields = cut_fields->count > 0;
+    if (cut_delim->count > 0 && !ctx.fields) {
+        fprintf(stderr, "cut: an input delimiter may be specified only when operating on fields\n");
+        return EXIT_ERROR;
+    }
+    ctx.delim = '\t';
+    if (cut_delim->count > 0) {
+        if (strlen(cut_delim->sval[0]) != 1) {
+            fprintf(stderr, "cut: the delimiter must be a single character\n");
+            return EXIT_ERROR;
+        }
+        ctx.delim = (unsigned char)cut_delim->sval[0][0];
+    }
+    if (cut_odelim->count > 0) {
+        ctx.odelim = cut_odelim->sval[0];
+        ctx.odelim_len = strlen(ctx.odelim);
+    }
+
+    list = ctx.fields ? cut_fields->sval[0]
+                      : cut_bytes->count > 0 ? cut_bytes->sval[0] : cut_chars->sval[0];
+    if (cut_parse_list(list, ctx.fields ? "fields" : "byte/character positions", &ctx.list) != 0) {
+        cut_list_free(&ctx.list);
+        return EXIT_ERROR;
+    }
+
+    if (pb_out_init(&out, cmd_stdout()) != 0) {
+        perror("cut");
+        cut_list_free(&ctx.list);
+        return EXIT_ERROR;
+    }
+
+    if (cut_files->count == 0) {
+        ret = cut_file(&ctx, "-", &out);
+    }
+    for (i = 0; i < cut_files->count; i++) {
+        if (cut_file(&ctx, cut_files->filename[i], &out) != EXIT_OK) {
+            ret = EXIT_ERROR;
+        }
+    }
+
+    if (pb_out_close(&out) != 0) {
+        if (errno != EPIPE) {
+            perror("cut: write error");
+        }
+        ret = EXIT_ERROR;
+    }
+    cut_list_free(&ctx.list);
+    return ret;
+}
+
+/* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
+
+void cut_print_usage(FILE *out)
+{
+    build_cut_argtable();
+
+    fprintf(out, "Usage: cut ");
+    arg_print_syntax(out, cut_argtable, "\n");
+    fprintf(out, "Print the selected parts of each line of all FILEs (or stdin).\n\n");
+    fprintf(out, "Options:\n");
+    arg_print_glossary(out, cut_argtable, "  %-28s %s\n");
+    fprintf(out, "\n");
+    fprintf(out, "LIST is one or more ranges separated by commas: N, N-M, N- (to the end\n");
+    fprintf(out, "of the line) or -M (from the first). Characters are bytes.\n\n");
+    fprintf(out, "Examples:\n");
+    fprintf(out, "  cut -f 1,3 export.tsv          Print the first and third columns\n");
+    fprintf(out, "  cut -d : -f 1,7 /etc/passwd    Print user names and shells\n");
+    fprintf(out, "  cut -b 1-8 log.txt             Print the first eight bytes of each line\n");
+}
+
+/* ===== SECTION 5: COMMAND SPECIFICATION ===== */
+
+cmd_spec_t cmd_cut_spec = {
+    .name = "cut",
+    .summary = "remove sections from each line of files",
+    .long_help = "Print the selected parts of each line of all FILEs (or stdin): "
+                 "fields (-f, split at -d), bytes (-b) or characters (-c).",
+    .run = cut_run,
+    .print_usage = cut_print_usage,
+    .flags = CMD_FLAG_STREAMS | CMD_FLAG_PURE
+};
+
+/* ===== SECTION 6: REGISTRATION FUNCTION ===== */
+
+void register_cut_command(void)
+{
+    register_command(&cmd_cut_spec);
+}
+
+/* ===== SECTION 7: STANDALONE MAIN ===== */
+
+#ifndef BUILTIN_ONLY
+int main(int argc, char **argv)
+{
+    return cmd_cut_spec.run(argc, argv);
+}
+#endif
@@ -7,12 +7,35 @@
  * Usage: df [OPTIONS] [FILE]
  * Options:
  *   -h, --human-readable   Print sizes in human readable format
+ *   -a, --all              With no FILE, include every mount, even of no size
+ *   --timeout=SEC          Give up on a filesystem after SEC seconds
  *   --help                 Display help message
+ *
+ * With no FILE every mounted filesystem is reported, as listed in
+ * /proc/self/mountinfo (getmntinfo() on macOS). The statvfs() calls run
+ * at once on detached threads while df waits, up to the timeout, for
+ * them to finish: a hung NFS server holds up its own line, which is
+ * reported as timed out, and not the rest of the report. A thread
+ * still stuck in the kernel is left behind; it frees what it shares
+ * with df when it returns.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* getline() and clock_gettime() under -std=c11 */
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/statvfs.h>
+#ifdef __APPLE__
+#include <sys/param.h>
+#include <sys/ucred.h>
+#include <sys/mount.h>
+#endif
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
@@ -26,24 +49,486 @@ void df_print_usage(FILE *out);
 
 static struct arg_lit *df_help;
 static struct arg_lit *df_human;
+static struct arg_lit *df_all;
+static struct arg_int *df_timeout;
 static struct arg_file *df_path;
 static struct arg_end *df_end;
-static void *df_argtable[5];
+static void *df_argtable[7];
 
 /* ===== SECTION 2: ARGTABLE BUILDER ===== */
 
 static void build_df_argtable(void)
 {
+    if (df_argtable[0] != NULL) {
+        return;
+    }
+
     df_help = arg_lit0(NULL, "help", "display this help and exit");
     df_human = arg_lit0("h", "human-readable", "print sizes in human readable format");
-    df_path = arg_file0(NULL, NULL, "FILE", "filesystem to check (default: current directory)");
+    df_all = arg_lit0("a", "all", "include every mount, even of no size (proc, sysfs, ...)");
+    df_timeout = arg_int0(NULL, "timeout", "SEC",
+                          "report a filesystem as timed out after SEC seconds (default 5)");
+    df_path = arg_file0(NULL, NULL, "FILE", "filesystem to check (default: all mounted)");
     df_end = arg_end(20);
 
     df_argtable[0] = df_help;
     df_argtable[1] = df_human;
-    df_argtable[2] = df_path;
-    df_argtable[3] = df_end;
-    df_argtable[4] = NULL;
+    df_argtable[2] = df_all;
+    df_argtable[3] = df_timeout;
+    df_argtable[4] = df_path;
+    df_argtable[5] = df_end;
+    df_argtable[6] = NULL;
+}
+
+/* ===== HELPER FUNCTION ===== */
+
+#define DF_TIMEOUT_DEFAULT 5
+
+/* statvfs() threads at most; more mounts than this queue up behind them */
+#define DF_MAX_THREADS 64
+
+/* Small stacks: a thread only calls statvfs() */
+#define DF_THREAD_STACK (64 * 1024)
+
+typedef struct df_mount {
+    char *source;               /* Device or server:path */
+    char *target;               /* Mount point */
+    unsigned long long dev;     /* For leaving out the same filesystem mounted again */
+} df_mount_t;
+
+enum {
+    DF_PENDING,                 /* Not answered in time */
+    DF_DONE,
+    DF_FAILED
+};
+
+typedef struct df_result {
+    int state;
+    int error;                  /* DF_FAILED: errno */
+    struct statvfs vfs;
+} df_result_t;
+
+/*
+ * What df and its threads share. Threads that outlive the timeout
+ * still hold a reference, so the last one out frees it.
+ */
+typedef struct df_batch {
+    pthread_mutex_t lock;
+    pthread_cond_t done_cv;
+    char **paths;               /* Copies, owned here */
+    df_result_t *results;
+    size_t n;
+    size_t next;                /* Next path to hand out */
+    size_t done;
+    int abandoned;              /* df has stopped waiting */
+    int refs;
+} df_batch_t;
+
+static void df_batch_free(df_batch_t *b)
+{
+    for (size_t i = 0; i < b->n; i++) {
+        free(b->paths[i]);
+    }
+    free(b->paths);
+    free(b->results);
+    pthread_cond_destroy(&b->done_cv);
+    pthread_mutex_destroy(&b->lock);
+    free(b);
+}
+
+/* Drop a reference (lock held; released here) */
+static void df_batch_release(df_batch_t *b)
+{
+    int last = --b->refs == 0;
+
+    pthread_mutex_unlock(&b->lock);
+    if (last) {
+        df_batch_free(b);
+    }
+}
+
+static void *df_worker(void *arg)
+{
+    df_batch_t *b = arg;
+
+    pthread_mutex_lock(&b->lock);
+    while (!b->abandoned && b->next < b->n) {
+        size_t i = b->next++;
+        struct statvfs vfs;
+        int r;
+        int err;
+
+        pthread_mutex_unlock(&b->lock);
+        r = statvfs(b->paths[i], &vfs);
+        err = errno;
+        pthread_mutex_lock(&b->lock);
+
+        b->results[i].state = r == 0 ? DF_DONE : DF_FAILED;
+        b->results[i].error = err;
+        b->results[i].vfs = vfs;
+        if (++b->done == b->n) {
+            pthread_cond_signal(&b->done_cv);
+        }
+    }
+    df_batch_release(b);
+    return NULL;
+}
+
+/*
+ * statvfs() every path on threads, waiting at most timeout seconds
+ * for all of them; results[i] is left DF_PENDING for those not back
+ * Returns: 0, or -1 if out of memory
+ */
+static int df_statvfs_all(char *const *paths, size_t n, int timeout, df_result_t *results)
+{
+    df_batch_t *b;
+    pthread_attr_t attr;
+    struct timespec deadline;
+    size_t nthreads = n < DF_MAX_THREADS ? n : DF_MAX_THREADS;
+    size_t started = 0;
+    size_t i;
+
+    memset(results, 0, n * sizeof(df_result_t));
+    if (n == 0) {
+        return 0;
+    }
+
+    b = calloc(1, sizeof(df_batch_t));
+    if (!b) {
+        return -1;
+    }
+    b->paths = calloc(n, sizeof(char *));
+    b->results = calloc(n, sizeof(df_result_t));
+    if (!b->paths || !b->results) {
+        free(b->paths);
+        free(b->results);
+        free(b);
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        b->paths[i] = strdup(paths[i]);
+        if (!b->paths[i]) {
+            b->n = i;
+            pthread_mutex_init(&b->lock, NULL);
+            pthread_cond_init(&b->done_cv, NULL);
+            df_batch_free(b);
+            return -1;
+        }
+    }
+    b->n = n;
+    b->refs = 1;
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->done_cv, NULL);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, DF_THREAD_STACK);
+    pthread_mutex_lock(&b->lock);
+    for (i = 0; i < nthreads; i++) {
+        pthread_t tid;
+
+        b->refs++;
+        if (pthread_create(&tid, &attr, df_worker, b) != 0) {
+            b->refs--;
+            break;
+        }
+        started++;
+    }
+    pthread_attr_destroy(&attr);
+
+    /* No threads at all: do them here, without the guard */
+    if (started == 0) {
+        pthread_mutex_unlock(&b->lock);
+        for (i = 0; i < n; i++) {
+            results[i].state = statvfs(paths[i], &results[i].vfs) == 0 ? DF_DONE : DF_FAILED;
+            results[i].error = errno;
+        }
+        pthread_mutex_lock(&b->lock);
+        df_batch_release(b);
+        return 0;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout;
+    while (b->done < b->n) {
+        if (pthread_cond_timedwait(&b->done_cv, &b->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+
+    memcpy(results, b->results, n * sizeof(df_result_t));
+    b->abandoned = 1;
+    df_batch_release(b);
+    return 0;
+}
+
+static void df_mounts_free(df_mount_t *m, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        free(m[i].source);
+        free(m[i].target);
+    }
+    free(m);
+}
+
+#ifndef __APPLE__
+/* Undo mountinfo's octal escapes ("\040" for a space) in place */
+static void df_unescape(char *s)
+{
+    char *out = s;
+
+    while (*s) {
+        if (s[0] == '\\' && s[1] >= '0' && s[1] <= '3' && s[2] >= '0' && s[2] <= '7' &&
+            s[3] >= '0' && s[3] <= '7') {
+            *out++ = (char)((s[1] - '0') << 6 | (s[2] - '0') << 3 | (s[3] - '0'));
+            s += 4;
+        } else {
+            *out++ = *s++;
+        }
+    }
+    *out = '\0';
+}
+#endif
+
+/*
+ * The mounted filesystems, in mount order
+ * Returns: 0, or -1 (errno set)
+ */
+static int df_list_mounts(df_mount_t **out, size_t *count)
+{
+    df_mount_t *m = NULL;
+    size_t n = 0;
+    size_t cap = 0;
+
+#ifdef __APPLE__
+    struct statfs *fs;
+    int nfs = getmntinfo(&fs, MNT_NOWAIT);
+
+    if (nfs <= 0) {
+        return -1;
+    }
+    m = calloc((size_t)nfs, sizeof(df_mount_t));
+    if (!m) {
+        return -1;
+    }
+    for (int i = 0; i < nfs; i++) {
+        m[n].source = strdup(fs[i].f_mntfromname);
+        m[n].target = strdup(fs[i].f_mntonname);
+        m[n].dev = (unsigned long long)(unsigned)fs[i].f_fsid.val[0];
+        if (!m[n].source || !m[n].target) {
+            df_mounts_free(m, n + 1);
+            errno = ENOMEM;
+            return -1;
+        }
+        n++;
+    }
+    (void)cap;
+#else
+    FILE *fp = fopen("/proc/self/mountinfo", "r");
+    char *line = NULL;
+    size_t len = 0;
+
+    if (!fp) {
+        return -1;
+    }
+
+    /* ID PARENT MAJOR:MINOR ROOT MOUNTPOINT OPTIONS [TAGS...] - TYPE SOURCE SUPEROPTS */
+    while (getline(&line, &len, fp) > 0) {
+        char *field[5];
+        char *save = NULL;
+        char *tok;
+        char *source = NULL;
+        unsigned int major = 0;
+        unsigned int minor = 0;
+        int i;
+
+        for (i = 0, tok = strtok_r(line, " \n", &save); tok && i < 5;
+             tok = strtok_r(NULL, " \n", &save)) {
+            field[i++] = tok;
+        }
+        if (i < 5 || sscanf(field[2], "%u:%u", &major, &minor) != 2) {
+            continue;
+        }
+        /* Past the optional tags: "-", then type and source */
+        while (tok && strcmp(tok, "-") != 0) {
+            tok = strtok_r(NULL, " \n", &save);
+        }
+        if (tok && strtok_r(NULL, " \n", &save)) {
+            source = strtok_r(NULL, " \n", &save);
+        }
+
+        if (n == cap) {
+            size_t ncap = cap ? cap * 2 : 64;
+            df_mount_t *nm = realloc(m, ncap * sizeof(df_mount_t));
+
+            if (!nm) {
+                break;
+            }
+            m = nm;
+            cap = ncap;
+        }
+        m[n].source = strdup(source ? source : "none");
+        m[n].target = strdup(field[4]);
+        m[n].dev = (unsigned long long)major << 32 | minor;
+        if (!m[n].source || !m[n].target) {
+            free(m[n].source);
+            free(m[n].target);
+            break;
+        }
+        df_unescape(m[n].source);
+        df_unescape(m[n].target);
+        n++;
+    }
+    free(line);
+    fclose(fp);
+#endif
+
+    *out = m;
+    *count = n;
+    return 0;
+}
+
+/* One line: SOURCE SIZE USED AVAIL USE% [TARGET], SOURCE padded to width */
+static void df_print_line(const char *source, int width, const struct statvfs *vfs, int human,
+                          const char *target)
+{
+    char size_buf[32];
+    off_t total = (off_t)vfs->f_blocks * (off_t)vfs->f_frsize;
+    off_t avail = (off_t)vfs->f_bavail * (off_t)vfs->f_frsize;
+    off_t used = total - (off_t)vfs->f_bfree * (off_t)vfs->f_frsize;
+    int use_percent = total > 0 ? (int)((used * 100) / total) : 0;
+
+    printf("%-*s", width, source);
+
+    if (human) {
+        format_size(total, size_buf, sizeof(size_buf));
+        printf("%5s ", size_buf);
+        format_size(used, size_buf, sizeof(size_buf));
+        printf("%5s ", size_buf);
+        format_size(avail, size_buf, sizeof(size_buf));
+        printf("%5s ", size_buf);
+    } else {
+        printf("%10lld %10lld %10lld ",
+               (long long)(total / 1024),
+               (long long)(used / 1024),
+               (long long)(avail / 1024));
+    }
+
+    printf("%3d%%", use_percent);
+    if (target) {
+        printf(" %s", target);
+    }
+    printf("\n");
+}
+
+static void df_print_header(int width, int human, int mounts)
+{
+    printf("%-*s", width, "Filesystem");
+    if (human) {
+        printf("%5s %5s %5s Use%%", "Size", "Used", "Avail");
+    } else {
+        printf("%10s %10s %10s Use%%", "1K-blocks", "Used", "Available");
+    }
+    printf(mounts ? " Mounted on\n" : "\n");
+}
+
+/*
+ * Whether m[i] is left out of the report: mounted over by a later
+ * mount on the same directory, or a filesystem already shown
+ */
+static int df_hidden(const df_mount_t *m, size_t n, const unsigned char *shown, size_t i)
+{
+    size_t j;
+
+    for (j = i + 1; j < n; j++) {
+        if (strcmp(m[j].target, m[i].target) == 0) {
+            return 1;
+        }
+    }
+    for (j = 0; j < i; j++) {
+        if (shown[j] && m[j].dev == m[i].dev) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Report every mounted filesystem; with all == 0 those of no size
+ * (proc, sysfs, ...), repeat mounts of one filesystem and mounts
+ * hidden under later ones are left out
+ * Returns: EXIT_OK, or EXIT_ERROR if one could not be read in time
+ */
+static int df_all_mounts(int human, int all, int timeout)
+{
+    df_mount_t *m = NULL;
+    df_result_t *res;
+    char **paths;
+    unsigned char *shown;
+    size_t n = 0;
+    size_t i;
+    int width = 15;
+    int ret = EXIT_OK;
+
+    if (df_list_mounts(&m, &n) != 0) {
+        perror("df: cannot read the mount table");
+        return EXIT_ERROR;
+    }
+
+    res = calloc(n + 1, sizeof(df_result_t));
+    paths = calloc(n + 1, sizeof(char *));
+    shown = calloc(n + 1, 1);
+    if (!res || !paths || !shown) {
+        perror("df");
+        ret = EXIT_ERROR;
+        goto out;
+    }
+    for (i = 0; i < n; i++) {
+        paths[i] = m[i].target;
+    }
+    if (df_statvfs_all(paths, n, timeout, res) != 0) {
+        perror("df");
+        ret = EXIT_ERROR;
+        goto out;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (!all) {
+            if ((res[i].state == DF_DONE && res[i].vfs.f_blocks == 0) ||
+                df_hidden(m, n, shown, i)) {
+                continue;
+            }
+        }
+        shown[i] = 1;
+        if ((int)strlen(m[i].source) + 1 > width) {
+            width = (int)strlen(m[i].source) + 1;
+        }
+    }
+
+    df_print_header(width, human, 1);
+    for (i = 0; i < n; i++) {
+        if (!shown[i]) {
+            continue;
+        }
+        if (res[i].state == DF_DONE) {
+            df_print_line(m[i].source, width, &res[i].vfs, human, m[i].target);
+            continue;
+        }
+        fflush(stdout);
+        if (res[i].state == DF_PENDING) {
+            fprintf(stderr, "df: %s: timed out\n", m[i].target);
+        } else {
+            fprintf(stderr, "df: %s: %s\n", m[i].target, strerror(res[i].error));
+        }
+        ret = EXIT_ERROR;
+    }
+
+out:
+    free(shown);
+    free(paths);
+    free(res);
+    df_mounts_free(m, n);
+    return ret;
 }
 
 /* ===== SECTION 3: RUN FUNCTION ===== */
@@ -51,12 +536,11 @@ static void build_df_argtable(void)
 int df_run(int argc, char **argv)
 {
     int nerrors;
-    struct statvfs vfs;
+    df_result_t res;
     int human = 0;
-    const char *path = ".";
-    char size_buf[32];
-    off_t total, avail, used;
-    int use_percent;
+    int timeout = DF_TIMEOUT_DEFAULT;
+    char *path;
+    int ret;
 
     build_df_argtable();
     nerrors = arg_parse(argc, argv, df_argtable);
@@ -64,7 +548,6 @@ int df_run(int argc, char **argv)
     /* Handle --help */
     if (df_help->count > 0) {
         df_print_usage(stdout);
-        arg_freetable(df_argtable, 4);
         return EXIT_OK;
     }
 
@@ -72,7 +555,6 @@ int df_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, df_end, "df");
         fprintf(stderr, "Try 'df --help' for more information.\n");
-        arg_freetable(df_argtable, 4);
         return EXIT_ERROR;
     }
 
@@ -83,52 +565,33 @@ int df_run(int argc, char **argv)
         human = 1;
     }
 
-    /* Get path if provided */
-    if (df_path->count > 0) {
-        path = df_path->filename[0];
-    }
-
-    /* Get filesystem statistics */
-    if (statvfs(path, &vfs) != 0) {
-        perror("df");
-        arg_freetable(df_argtable, 4);
-        return EXIT_ERROR;
+    if (df_timeout->count > 0) {
+        timeout = df_timeout->ival[0];
+        if (timeout < 1) {
+            fprintf(stderr, "df: invalid timeout: '%d'\n", timeout);
+            return EXIT_ERROR;
+        }
     }
 
-    /* Print header */
-    printf("Filesystem     ");
-    if (human) {
-        printf("Size  Used Avail Use%%\n");
-    } else {
-        printf("1K-blocks      Used Available Use%%\n");
+    if (df_path->count == 0) {
+        ret = df_all_mounts(human, df_all->count > 0, timeout);
+        return ret;
     }
 
-    /* Calculate statistics */
-    total = vfs.f_blocks * vfs.f_frsize;
-    avail = vfs.f_bavail * vfs.f_frsize;
-    used = total - (vfs.f_bfree * vfs.f_frsize);
-    use_percent = total > 0 ? (int)((used * 100) / total) : 0;
-
-    /* Print filesystem info */
-    printf("%-15s", path);
-
-    if (human) {
-        format_size(total, size_buf, sizeof(size_buf));
-        printf("%5s ", size_buf);
-        format_size(used, size_buf, sizeof(size_buf));
-        printf("%5s ", size_buf);
-        format_size(avail, size_buf, sizeof(size_buf));
-        printf("%5s ", size_buf);
-    } else {
-        printf("%10lld %10lld %10lld ",
-               (long long)(total / 1024),
-               (long long)(used / 1024),
-               (long long)(avail / 1024));
+    /* Get filesystem statistics, under the same guard */
+    path = (char *)df_path->filename[0];
+    if (df_statvfs_all(&path, 1, timeout, &res) != 0 || res.state != DF_DONE) {
+        if (res.state == DF_PENDING) {
+            fprintf(stderr, "df: %s: timed out\n", path);
+        } else {
+            fprintf(stderr, "df: %s: %s\n", path, strerror(res.error));
+        }
+        return EXIT_ERROR;
     }
 
-    printf("%3d%%\n", use_percent);
+    df_print_header(15, human, 0);
+    df_print_line(path, 15, &res.vfs, human, NULL);
 
-    arg_freetable(df_argtable, 4);
     return EXIT_OK;
 }
 
@@ -140,16 +603,16 @@ void df_print_usage(FILE *out)
 
     fprintf(out, "Usage: df ");
     arg_print_syntax(out, df_argtable, "\n");
-    fprintf(out, "Show information about the file system on which each FILE resides.\n\n");
+    fprintf(out, "Show information about the file system on which each FILE resides,\n");
+    fprintf(out, "or with no FILE about every mounted file system.\n\n");
     fprintf(out, "Options:\n");
     arg_print_glossary(out, df_argtable, "  %-25s %s\n");
     fprintf(out, "\n");
     fprintf(out, "Examples:\n");
-    fprintf(out, "  df              Show filesystem info for current directory\n");
+    fprintf(out, "  df              Show every mounted filesystem\n");
     fprintf(out, "  df -h           Show with human-readable sizes\n");
     fprintf(out, "  df /tmp         Show filesystem info for /tmp\n");
-
-    arg_freetable(df_argtable, 4);
+    fprintf(out, "  df --timeout=1  Give up on a hung mount after a second\n");
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -157,7 +620,8 @@ void df_print_usage(FILE *out)
 cmd_spec_t cmd_df_spec = {
     .name = "df",
     .summary = "report file system disk space usage",
-    .long_help = "Show information about the file system on which each FILE resides.",
+    .long_help = "Show information about the file system on which each FILE resides, "
+                 "or with no FILE about every mounted file system.",
     .run = df_run,
     .print_usage = df_print_usage
 };
@@ -34,6 +34,10 @@ static void *dirname_argtable[4];
 
 static void build_dirname_argtable(void)
 {
+    if (dirname_argtable[0] != NULL) {
+        return;
+    }
+
     dirname_help = arg_lit0("h", "help", "display this help and exit");
     dirname_name = arg_str1(NULL, NULL, "NAME", "pathname to extract directory from");
     dirname_end = arg_end(20);
@@ -57,7 +61,6 @@ int dirname_run(int argc, char **argv)
     /* Handle --help */
     if (dirname_help->count > 0) {
         dirname_print_usage(stdout);
-        arg_freetable(dirname_argtable, 3);
         return EXIT_OK;
     }
 
@@ -65,7 +68,6 @@ int dirname_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, dirname_end, "dirname");
         fprintf(stderr, "Try 'dirname --help' for more information.\n");
-        arg_freetable(dirname_argtable, 3);
         return EXIT_ERROR;
     }
 
@@ -75,14 +77,12 @@ int dirname_run(int argc, char **argv)
     result = get_dirname(dirname_name->sval[0]);
     if (!result) {
         perror("dirname");
-        arg_freetable(dirname_argtable, 3);
         return EXIT_ERROR;
     }
 
     printf("%s\n", result);
     free(result);
 
-    arg_freetable(dirname_argtable, 3);
     return EXIT_OK;
 }
 
@@ -103,8 +103,6 @@ void dirname_print_usage(FILE *out)
     fprintf(out, "  dirname /usr/bin/sort      Output: /usr/bin\n");
     fprintf(out, "  dirname stdio.h            Output: .\n");
     fprintf(out, "  dirname /home/user/        Output: /home\n");
-
-    arg_freetable(dirname_argtable, 3);
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -8,94 +8,536 @@
  * Options:
  *   -h, --human-readable   Print sizes in human readable format
  *   -s, --summarize        Display only a total for each argument
+ *   -0, --null             End each output line with NUL, not newline
+ *   --cache=PATH           Reuse sizes of unchanged directories kept in PATH
  *   --help                 Display help message
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* AT_FDCWD, st_mtim and mmap() under -std=c11 */
+#endif
+
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/stat.h>
-#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
 #include "utils.h"
+#include "pb_out.h"
+#include "walk.h"
+#include "work_pool.h"
 
 /* Forward declarations */
 int du_run(int argc, char **argv);
 void du_print_usage(FILE *out);
-static off_t du_recursive(const char *path, int summary, int human);
 
 /* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
 
 static struct arg_lit *du_help;
 static struct arg_lit *du_human;
 static struct arg_lit *du_summary;
+static struct arg_lit *du_null;
+static struct arg_file *du_cache;
 static struct arg_file *du_paths;
 static struct arg_end *du_end;
-static void *du_argtable[6];
+static void *du_argtable[8];
 
 /* ===== SECTION 2: ARGTABLE BUILDER ===== */
 
 static void build_du_argtable(void)
 {
+    if (du_argtable[0] != NULL) {
+        return;
+    }
+
     du_help = arg_lit0(NULL, "help", "display this help and exit");
     du_human = arg_lit0("h", "human-readable", "print sizes in human readable format");
     du_summary = arg_lit0("s", "summarize", "display only a total for each argument");
+    du_null = arg_lit0("0", "null", "end each output line with NUL, not newline");
+    du_cache = arg_file0(NULL, "cache", "PATH", "reuse sizes of unchanged directories kept in PATH");
     du_paths = arg_filen(NULL, NULL, "FILE", 0, 100, "files/directories to check");
     du_end = arg_end(20);
 
     du_argtable[0] = du_help;
     du_argtable[1] = du_human;
     du_argtable[2] = du_summary;
-    du_argtable[3] = du_paths;
-    du_argtable[4] = du_end;
-    du_argtable[5] = NULL;
+    du_argtable[3] = du_null;
+    du_argtable[4] = du_cache;
+    du_argtable[5] = du_paths;
+    du_argtable[6] = du_end;
+    du_argtable[7] = NULL;
 }
 
 /* ===== HELPER FUNCTION ===== */
 
-static off_t du_recursive(const char *path, int summary, int human)
+/* Worker bounds for the walk */
+#define DU_MIN_WORKERS 4
+#define DU_MAX_WORKERS 16
+
+/* One line of output: SIZE<TAB>PATH, ended by eol ('\0' with -0) */
+static void du_print(pb_out_t *out, off_t total, const char *path, int human, char eol)
+{
+    if (human) {
+        pb_out_size(out, total, 0);
+    } else {
+        pb_out_int(out, (intmax_t)(total / 1024), 0);
+    }
+    pb_out_putc(out, '\t');
+    pb_out_str(out, path);
+    pb_out_putc(out, eol);
+}
+
+/*
+ * Files with more than one link seen so far, as (dev, ino), so each is
+ * counted once. Split into shards, each behind its own lock, so the
+ * walk's threads seldom wait on each other.
+ */
+#define DU_SHARDS 64
+#define DU_SHARD_SLOTS 64   /* First size of a shard; doubles */
+
+typedef struct du_inode {
+    dev_t dev;
+    ino_t ino;
+    int used;
+} du_inode_t;
+
+typedef struct du_shard {
+    pthread_mutex_t lock;
+    du_inode_t *slots;
+    size_t cap;             /* Power of two */
+    size_t count;
+} du_shard_t;
+
+/*
+ * --cache=PATH keeps, for every directory walked, the bytes in the
+ * directory itself and its files (not its subdirectories), keyed by
+ * (dev, ino) and stamped with its mtime and ctime. Those change when an
+ * entry is added, removed or renamed, so while they match the cached
+ * bytes are used and the files are not stat'ed again. A file changing
+ * size in place goes unnoticed until its directory changes.
+ *
+ * The file is a du_cache_hdr_t and then its records sorted by (dev,
+ * ino), read through a read-only mapping by binary search. A run
+ * writes them back merged with what it walked, in a temporary file
+ * renamed over PATH; records of directories not walked are kept.
+ */
+#define DU_CACHE_MAGIC 0x55444250u   /* "PBDU" */
+#define DU_CACHE_VERSION 1
+
+typedef struct du_cache_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+} du_cache_hdr_t;
+
+typedef struct du_cache_rec {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    int64_t own;            /* Bytes in the directory and its files */
+} du_cache_rec_t;
+
+typedef struct du_recs {
+    du_cache_rec_t *v;
+    size_t len;
+    size_t cap;
+} du_recs_t;
+
+typedef struct du_cache {
+    const char *path;
+    void *map;              /* NULL: nothing cached yet */
+    size_t map_size;
+    const du_cache_rec_t *old;
+    size_t nold;
+    du_recs_t fresh[DU_MAX_WORKERS];  /* Walked this run, per worker */
+} du_cache_t;
+
+static int64_t du_ns(time_t sec, long nsec)
+{
+    return (int64_t)sec * 1000000000 + nsec;
+}
+
+/* Record for st as it is now */
+static du_cache_rec_t du_cache_rec(const struct stat *st, off_t own)
+{
+    du_cache_rec_t r;
+
+    r.dev = (uint64_t)st->st_dev;
+    r.ino = (uint64_t)st->st_ino;
+#if defined(__APPLE__)
+    r.mtime_ns = du_ns(st->st_mtimespec.tv_sec, st->st_mtimespec.tv_nsec);
+    r.ctime_ns = du_ns(st->st_ctimespec.tv_sec, st->st_ctimespec.tv_nsec);
+#else
+    r.mtime_ns = du_ns(st->st_mtim.tv_sec, st->st_mtim.tv_nsec);
+    r.ctime_ns = du_ns(st->st_ctim.tv_sec, st->st_ctim.tv_nsec);
+#endif
+    r.own = (int64_t)own;
+    return r;
+}
+
+static int du_cache_cmp(const void *a, const void *b)
 {
+    const du_cache_rec_t *x = a;
+    const du_cache_rec_t *y = b;
+
+    if (x->dev != y->dev) {
+        return x->dev < y->dev ? -1 : 1;
+    }
+    if (x->ino != y->ino) {
+        return x->ino < y->ino ? -1 : 1;
+    }
+    return 0;
+}
+
+/* Map PATH if it holds a cache; anything else is as good as empty */
+static void du_cache_open(du_cache_t *c, const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
     struct stat st;
-    DIR *dir;
-    struct dirent *entry;
-    char filepath[4096];
-    off_t total = 0;
+    const du_cache_hdr_t *hdr;
+
+    memset(c, 0, sizeof(*c));
+    c->path = path;
+    if (fd < 0) {
+        return;
+    }
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(du_cache_hdr_t)) {
+        c->map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (c->map == MAP_FAILED) {
+            c->map = NULL;
+        } else {
+            c->map_size = (size_t)st.st_size;
+        }
+    }
+    close(fd);
+    if (!c->map) {
+        return;
+    }
 
-    if (lstat(path, &st) != 0) {
-        perror(path);
+    hdr = c->map;
+    if (hdr->magic == DU_CACHE_MAGIC && hdr->version == DU_CACHE_VERSION &&
+        hdr->count == (c->map_size - sizeof(*hdr)) / sizeof(du_cache_rec_t) &&
+        (c->map_size - sizeof(*hdr)) % sizeof(du_cache_rec_t) == 0) {
+        c->old = (const du_cache_rec_t *)(hdr + 1);
+        c->nold = (size_t)hdr->count;
+    }
+}
+
+/* Cached record for key's directory, if it has not changed since */
+static const du_cache_rec_t *du_cache_find(const du_cache_t *c, const du_cache_rec_t *key)
+{
+    const du_cache_rec_t *r = bsearch(key, c->old, c->nold, sizeof(*key), du_cache_cmp);
+
+    if (r && r->mtime_ns == key->mtime_ns && r->ctime_ns == key->ctime_ns) {
+        return r;
+    }
+    return NULL;
+}
+
+/* Keep r for the next run (called from walk worker threads) */
+static void du_cache_add(du_cache_t *c, int worker, du_cache_rec_t r)
+{
+    du_recs_t *f = &c->fresh[worker];
+
+    if (f->len == f->cap) {
+        size_t cap = f->cap ? f->cap * 2 : 256;
+        du_cache_rec_t *v = realloc(f->v, cap * sizeof(du_cache_rec_t));
+
+        if (!v) {
+            return;
+        }
+        f->v = v;
+        f->cap = cap;
+    }
+    f->v[f->len++] = r;
+}
+
+/*
+ * Write the cache back: this run's records, and the old ones of
+ * directories it did not see
+ * Returns: 0, or -1 (errno set)
+ */
+static int du_cache_save(du_cache_t *c)
+{
+    du_cache_rec_t *all;
+    size_t n = 0;
+    size_t nfresh;
+    size_t i;
+    size_t j;
+    du_cache_hdr_t hdr;
+    char tmp[4096];
+    FILE *fp;
+    int ok;
+
+    for (i = 0; i < DU_MAX_WORKERS; i++) {
+        n += c->fresh[i].len;
+    }
+    all = malloc((n + c->nold + 1) * sizeof(du_cache_rec_t));
+    if (!all) {
+        return -1;
+    }
+
+    /* This run's, sorted, one per directory */
+    n = 0;
+    for (i = 0; i < DU_MAX_WORKERS; i++) {
+        memcpy(all + n, c->fresh[i].v, c->fresh[i].len * sizeof(du_cache_rec_t));
+        n += c->fresh[i].len;
+    }
+    qsort(all, n, sizeof(du_cache_rec_t), du_cache_cmp);
+    for (i = j = 0; i < n; i++) {
+        if (j == 0 || du_cache_cmp(&all[j - 1], &all[i]) != 0) {
+            all[j++] = all[i];
+        }
+    }
+    nfresh = j;
+
+    /* Old ones not walked again, then all in order */
+    n = nfresh;
+    for (i = 0; i < c->nold; i++) {
+        if (!bsearch(&c->old[i], all, nfresh, sizeof(du_cache_rec_t), du_cache_cmp)) {
+            all[n++] = c->old[i];
+        }
+    }
+    qsort(all, n, sizeof(du_cache_rec_t), du_cache_cmp);
+
+    hdr.magic = DU_CACHE_MAGIC;
+    hdr.version = DU_CACHE_VERSION;
+    hdr.count = n;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", c->path);
+    fp = fopen(tmp, "wb");
+    if (!fp) {
+        free(all);
+        return -1;
+    }
+    ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+         fwrite(all, sizeof(du_cache_rec_t), n, fp) == n;
+    ok = fclose(fp) == 0 && ok;
+    free(all);
+    if (!ok || rename(tmp, c->path) != 0) {
+        int err = errno;
+
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static void du_cache_close(du_cache_t *c)
+{
+    for (int i = 0; i < DU_MAX_WORKERS; i++) {
+        free(c->fresh[i].v);
+    }
+    if (c->map) {
+        munmap(c->map, c->map_size);
+    }
+}
+
+typedef struct du_ctx {
+    atomic_llong total;     /* Of the root being walked */
+    du_shard_t seen[DU_SHARDS];
+    du_cache_t *cache;      /* With --cache */
+} du_ctx_t;
+
+static void du_ctx_init(du_ctx_t *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    atomic_init(&ctx->total, 0);
+    for (int i = 0; i < DU_SHARDS; i++) {
+        pthread_mutex_init(&ctx->seen[i].lock, NULL);
+    }
+}
+
+static void du_ctx_free(du_ctx_t *ctx)
+{
+    for (int i = 0; i < DU_SHARDS; i++) {
+        pthread_mutex_destroy(&ctx->seen[i].lock);
+        free(ctx->seen[i].slots);
+    }
+}
+
+static size_t du_hash(dev_t dev, ino_t ino)
+{
+    return (size_t)(((uint64_t)ino * 2654435761u) ^ ((uint64_t)dev * 40503u));
+}
+
+static int du_shard_grow(du_shard_t *sh)
+{
+    size_t cap = sh->cap ? sh->cap * 2 : DU_SHARD_SLOTS;
+    du_inode_t *slots = calloc(cap, sizeof(du_inode_t));
+
+    if (!slots) {
+        return -1;
+    }
+    for (size_t i = 0; i < sh->cap; i++) {
+        size_t j;
+
+        if (!sh->slots[i].used) {
+            continue;
+        }
+        j = (du_hash(sh->slots[i].dev, sh->slots[i].ino) / DU_SHARDS) & (cap - 1);
+        while (slots[j].used) {
+            j = (j + 1) & (cap - 1);
+        }
+        slots[j] = sh->slots[i];
+    }
+    free(sh->slots);
+    sh->slots = slots;
+    sh->cap = cap;
+    return 0;
+}
+
+/*
+ * Note that (dev, ino) has been counted
+ * Returns: 1 if it already had been, 0 if not (or out of memory)
+ */
+static int du_seen(du_ctx_t *ctx, dev_t dev, ino_t ino)
+{
+    size_t h = du_hash(dev, ino);
+    du_shard_t *sh = &ctx->seen[h % DU_SHARDS];
+    int found = 0;
+    size_t i;
+
+    pthread_mutex_lock(&sh->lock);
+    if ((sh->count + 1) * 2 > sh->cap && du_shard_grow(sh) != 0) {
+        pthread_mutex_unlock(&sh->lock);
         return 0;
     }
+    for (i = (h / DU_SHARDS) & (sh->cap - 1); sh->slots[i].used; i = (i + 1) & (sh->cap - 1)) {
+        if (sh->slots[i].dev == dev && sh->slots[i].ino == ino) {
+            found = 1;
+            break;
+        }
+    }
+    if (!found) {
+        sh->slots[i].dev = dev;
+        sh->slots[i].ino = ino;
+        sh->slots[i].used = 1;
+        sh->count++;
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return found;
+}
 
-    total = st.st_blocks * 512;  /* Convert blocks to bytes */
+/* Walk data of a directory */
+typedef struct du_dir {
+    atomic_llong total;     /* The subtree */
+    atomic_llong own;       /* The directory and its files: what --cache keeps */
+    int cached;             /* own came from the cache */
+    du_cache_rec_t rec;     /* Key and stamps for the cache */
+} du_dir_t;
 
-    if (S_ISDIR(st.st_mode)) {
-        dir = opendir(path);
-        if (!dir) {
-            perror(path);
-            return total;
+/* Count a file (hard links once) into the directory it is in */
+static void du_file(du_ctx_t *ctx, const walk_entry_t *e)
+{
+    du_dir_t *parent = e->parent_data;
+    struct stat st;
+    const struct stat *sp = e->st;
+    long long bytes;
+
+    if (!sp) {
+        if (fstatat(e->dirfd, e->name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            fprintf(stderr, "%s: %s\n", e->path, strerror(errno));
+            return;
         }
+        sp = &st;
+    }
+    if (sp->st_nlink > 1 && du_seen(ctx, sp->st_dev, sp->st_ino)) {
+        return;
+    }
 
-        while ((entry = readdir(dir)) != NULL) {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-                continue;
-            }
+    bytes = (long long)sp->st_blocks * 512;  /* Blocks to bytes */
+    if (!parent) {
+        atomic_fetch_add(&ctx->total, bytes);
+        return;
+    }
+    atomic_fetch_add(&parent->own, bytes);
+    atomic_fetch_add(&parent->total, bytes);
+}
 
-            snprintf(filepath, sizeof(filepath), "%s/%s", path, entry->d_name);
-            total += du_recursive(filepath, 1, human);
+/*
+ * The thread that lists a directory adds its files to the directory's
+ * data, and at WALK_POST the directory's total is added to its
+ * parent's, so sums merge up the tree as subtrees finish.
+ *
+ * With --cache, a directory whose stamps are unchanged takes its own
+ * total from the cache and its files are not stat'ed; it is still
+ * listed, since its subdirectories may have changed.
+ */
+static int du_visit(const walk_entry_t *e, void *arg)
+{
+    du_ctx_t *ctx = arg;
+    du_dir_t *d = e->data;
+    du_dir_t *parent = e->parent_data;
+    const du_cache_rec_t *r;
+    struct stat st;
+    long long own;
+
+    switch (e->visit) {
+    case WALK_ERROR:
+        fprintf(stderr, "%s: %s\n", e->path, strerror(e->error));
+        break;
+    case WALK_PRE:
+        if (!e->st && fstat(e->fd, &st) != 0) {
+            fprintf(stderr, "%s: %s\n", e->path, strerror(errno));
+            return WALK_SKIP;
+        }
+        d->rec = du_cache_rec(e->st ? e->st : &st, 0);
+        own = (long long)(e->st ? e->st : &st)->st_blocks * 512;
+        if (ctx->cache && (r = du_cache_find(ctx->cache, &d->rec)) != NULL) {
+            own = r->own;
+            d->cached = 1;
         }
+        atomic_store(&d->own, own);
+        atomic_store(&d->total, own);
+        break;
+    case WALK_POST:
+        if (ctx->cache) {
+            d->rec.own = atomic_load(&d->own);
+            du_cache_add(ctx->cache, e->worker, d->rec);
+        }
+        atomic_fetch_add(parent ? &parent->total : &ctx->total, atomic_load(&d->total));
+        break;
+    default:
+        if (!parent || !parent->cached) {
+            du_file(ctx, e);
+        }
+        break;
+    }
+    return WALK_CONTINUE;
+}
 
-        closedir(dir);
+static off_t du_recursive(du_ctx_t *ctx, pb_out_t *out, const char *path, int summary,
+                          int human, char eol)
+{
+    /* With the cache, files under unchanged directories are not stat'ed */
+    walk_opts_t opts = { WALK_PARALLEL | (ctx->cache ? 0 : WALK_STAT),
+                         work_pool_default_workers(), sizeof(du_dir_t), NULL };
+    off_t total;
+
+    /* Waiting on stat() more than on the CPU, as in tree_copy.c */
+    if (opts.nworkers < DU_MIN_WORKERS) {
+        opts.nworkers = DU_MIN_WORKERS;
+    } else if (opts.nworkers > DU_MAX_WORKERS) {
+        opts.nworkers = DU_MAX_WORKERS;
     }
 
+    atomic_store(&ctx->total, 0);
+    walk(AT_FDCWD, &path, 1, &opts, du_visit, ctx);
+    total = (off_t)atomic_load(&ctx->total);
+
     if (!summary) {
-        char size_buf[32];
-        if (human) {
-            format_size(total, size_buf, sizeof(size_buf));
-            printf("%s\t%s\n", size_buf, path);
-        } else {
-            printf("%lld\t%s\n", (long long)(total / 1024), path);
-        }
+        du_print(out, total, path, human, eol);
     }
 
     return total;
@@ -108,9 +550,13 @@ int du_run(int argc, char **argv)
     int nerrors;
     int summary = 0;
     int human = 0;
+    char eol = '\n';
     int i;
+    int ret = EXIT_OK;
     off_t total;
-    char size_buf[32];
+    pb_out_t out;
+    du_ctx_t ctx;
+    du_cache_t cache;
 
     build_du_argtable();
     nerrors = arg_parse(argc, argv, du_argtable);
@@ -118,7 +564,6 @@ int du_run(int argc, char **argv)
     /* Handle --help */
     if (du_help->count > 0) {
         du_print_usage(stdout);
-        arg_freetable(du_argtable, 5);
         return EXIT_OK;
     }
 
@@ -126,7 +571,6 @@ int du_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, du_end, "du");
         fprintf(stderr, "Try 'du --help' for more information.\n");
-        arg_freetable(du_argtable, 5);
         return EXIT_ERROR;
     }
 
@@ -139,37 +583,54 @@ int du_run(int argc, char **argv)
     if (du_summary->count > 0) {
         summary = 1;
     }
+    if (du_null->count > 0) {
+        eol = '\0';
+    }
+
+    if (pb_out_init(&out, stdout) != 0) {
+        perror("du");
+        return EXIT_ERROR;
+    }
+
+    /* Hard links are counted once across all the operands */
+    du_ctx_init(&ctx);
+    if (du_cache->count > 0) {
+        du_cache_open(&cache, du_cache->filename[0]);
+        ctx.cache = &cache;
+    }
 
     /* If no path, use current directory */
     if (du_paths->count == 0) {
-        total = du_recursive(".", summary, human);
+        total = du_recursive(&ctx, &out, ".", summary, human, eol);
         if (summary) {
-            if (human) {
-                format_size(total, size_buf, sizeof(size_buf));
-                printf("%s\t.\n", size_buf);
-            } else {
-                printf("%lld\t.\n", (long long)(total / 1024));
-            }
+            du_print(&out, total, ".", human, eol);
         }
-        arg_freetable(du_argtable, 5);
-        return EXIT_OK;
     }
 
     /* Process each path */
     for (i = 0; i < du_paths->count; i++) {
-        total = du_recursive(du_paths->filename[i], summary, human);
+        total = du_recursive(&ctx, &out, du_paths->filename[i], summary, human, eol);
         if (summary) {
-            if (human) {
-                format_size(total, size_buf, sizeof(size_buf));
-                printf("%s\t%s\n", size_buf, du_paths->filename[i]);
-            } else {
-                printf("%lld\t%s\n", (long long)(total / 1024), du_paths->filename[i]);
-            }
+            du_print(&out, total, du_paths->filename[i], human, eol);
+        }
+    }
+
+    du_ctx_free(&ctx);
+
+    if (pb_out_close(&out) != 0 && errno != EPIPE) {
+        perror("du: write error");
+        ret = EXIT_ERROR;
+    }
+
+    if (ctx.cache) {
+        if (du_cache_save(&cache) != 0) {
+            fprintf(stderr, "du: %s: %s\n", cache.path, strerror(errno));
+            ret = EXIT_ERROR;
         }
+        du_cache_close(&cache);
     }
 
-    arg_freetable(du_argtable, 5);
-    return EXIT_OK;
+    return ret;
 }
 
 /* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
@@ -189,8 +650,9 @@ void du_print_usage(FILE *out)
     fprintf(out, "  du -h           Show with human-readable sizes\n");
     fprintf(out, "  du -s /tmp      Show only total for /tmp\n");
     fprintf(out, "  du -sh /tmp     Show total in human-readable format\n");
-
-    arg_freetable(du_argtable, 5);
+    fprintf(out, "  du -s0 *        Lines ended by NUL, for names holding newlines\n");
+    fprintf(out, "  du -s --cache=/var/cache/du.db /srv\n");
+    fprintf(out, "                  Stat only files in directories changed since the last run\n");
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -15,6 +15,7 @@
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
+#include "pb_out.h"
 
 /* Forward declarations */
 int echo_run(int argc, char **argv);
@@ -40,6 +41,10 @@ static void *echo_argtable[5];
  */
 static void build_echo_argtable(void)
 {
+    if (echo_argtable[0] != NULL) {
+        return;
+    }
+
     /* Define help flag */
     echo_help = arg_lit0("h", "help", "display this help and exit");
 
@@ -75,6 +80,7 @@ static void build_echo_argtable(void)
  */
 int echo_run(int argc, char **argv)
 {
+    pb_out_t out;
     int nerrors;
     int i;
 
@@ -82,12 +88,11 @@ int echo_run(int argc, char **argv)
     build_echo_argtable(); // Sets up arg_lit, arg_str structures
 
     /* Parse command-line arguments */
-    nerrors = arg_parse(argc, argv, echo_argtable);
+    nerrors = cmd_arg_parse(argc, argv, echo_argtable);
 
     /* Handle --help FIRST (before checking for errors) */
     if (echo_help->count > 0) {
-        echo_print_usage(stdout);
-        arg_freetable(echo_argtable, 4);
+        echo_print_usage(cmd_stdout());
         return EXIT_OK;
     }
 
@@ -96,32 +101,34 @@ int echo_run(int argc, char **argv)
         /* Print errors to stderr */
         arg_print_errors(stderr, echo_end, "echo");
         fprintf(stderr, "Try 'echo --help' for more information.\n");
-        arg_freetable(echo_argtable, 4);
         return EXIT_ERROR;
     }
 
     /* ===== ACTUAL COMMAND LOGIC ===== */
 
-    /* Print each argument, separated by spaces */
+    /* Print each argument, separated by spaces, in one write */
+    if (pb_out_init(&out, cmd_stdout()) != 0) {
+        perror("echo");
+        return EXIT_ERROR;
+    }
     for (i = 0; i < echo_args->count; i++) {
         /* Add space between arguments (but not before first one) */
         if (i > 0) {
-            printf(" ");
+            pb_out_putc(&out, ' ');
         }
-        /* Print the argument */
-        printf("%s", echo_args->sval[i]);
+        pb_out_str(&out, echo_args->sval[i]);
     }
 
     /* Print newline unless -n was specified */
     if (echo_no_newline->count == 0) {
-        printf("\n");
+        pb_out_putc(&out, '\n');
     }
 
-    /* Flush output to ensure it appears immediately */
-    fflush(stdout);
+    if (pb_out_close(&out) != 0) {
+        perror("echo");
+        return EXIT_ERROR;
+    }
 
-    /* Clean up and return */
-    arg_freetable(echo_argtable, 4);
     return EXIT_OK;
 }
 
@@ -149,8 +156,6 @@ void echo_print_usage(FILE *out)
     fprintf(out, "  echo hello world           Print 'hello world' with newline\n");
     fprintf(out, "  echo -n \"no newline\"        Print without trailing newline\n");
     fprintf(out, "  echo --help                Show this help message\n");
-
-    arg_freetable(echo_argtable, 4);
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -170,7 +175,8 @@ cmd_spec_t cmd_echo_spec = {
                  "With -n, do not output the trailing newline. "
                  "This is a refactored version using argtable3.",
     .run = echo_run,
-    .print_usage = echo_print_usage
+    .print_usage = echo_print_usage,
+    .flags = CMD_FLAG_STREAMS
 };
 
 /* ===== SECTION 6: REGISTRATION FUNCTION ===== */
@@ -37,6 +37,10 @@ static void *env_argtable[3];
 
 static void build_env_argtable(void)
 {
+    if (env_argtable[0] != NULL) {
+        return;
+    }
+
     env_help = arg_lit0("h", "help", "display this help and exit");
     env_end = arg_end(20);
 
@@ -58,7 +62,6 @@ int env_run(int argc, char **argv)
     /* Handle --help */
     if (env_help->count > 0) {
         env_print_usage(stdout);
-        arg_freetable(env_argtable, 2);
         return EXIT_OK;
     }
 
@@ -66,7 +69,6 @@ int env_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, env_end, "env");
         fprintf(stderr, "Try 'env --help' for more information.\n");
-        arg_freetable(env_argtable, 2);
         return EXIT_ERROR;
     }
 
@@ -77,7 +79,6 @@ int env_run(int argc, char **argv)
         printf("%s\n", environ[i]);
     }
 
-    arg_freetable(env_argtable, 2);
     return EXIT_OK;
 }
 
@@ -100,8 +101,6 @@ void env_print_usage(FILE *out)
     fprintf(out, "Examples:\n");
     fprintf(out, "  env                      Print all environment variables\n");
     fprintf(out, "  env | grep PATH          Show PATH-related variables\n");
-
-    arg_freetable(env_argtable, 2);
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
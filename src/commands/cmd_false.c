@@ -32,6 +32,10 @@ static void *false_argtable[3];
 
 static void build_false_argtable(void)
 {
+    if (false_argtable[0] != NULL) {
+        return;
+    }
+
     false_help = arg_lit0("h", "help", "display this help and exit");
     false_end = arg_end(20);
 
@@ -47,26 +51,23 @@ int false_run(int argc, char **argv)
     int nerrors;
 
     build_false_argtable();
-    nerrors = arg_parse(argc, argv, false_argtable);
+    nerrors = cmd_arg_parse(argc, argv, false_argtable);
 
     /* Handle --help (special case: help succeeds even though it's "false") */
     if (false_help->count > 0) {
-        false_print_usage(stdout);
-        arg_freetable(false_argtable, 2);
+        false_print_usage(cmd_stdout());
         return EXIT_OK;  /* Help text prints successfully */
     }
 
     /* Handle parsing errors */
     if (nerrors > 0) {
         /* false fails regardless of errors */
-        arg_freetable(false_argtable, 2);
         return EXIT_ERROR;
     }
 
     /* ===== ACTUAL COMMAND LOGIC ===== */
     /* false always fails */
 
-    arg_freetable(false_argtable, 2);
     return EXIT_ERROR;
 }
 
@@ -87,8 +88,6 @@ void false_print_usage(FILE *out)
     fprintf(out, "  if false; then\n");
     fprintf(out, "    echo \"This will never run\"\n");
     fprintf(out, "  fi\n");
-
-    arg_freetable(false_argtable, 2);
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -99,7 +98,8 @@ cmd_spec_t cmd_false_spec = {
     .long_help = "Exit with a status code indicating failure. "
                  "The false utility always returns 1 (failure).",
     .run = false_run,
-    .print_usage = false_print_usage
+    .print_usage = false_print_usage,
+    .flags = CMD_FLAG_STREAMS
 };
 
 /* ===== SECTION 6: REGISTRATION FUNCTION ===== */
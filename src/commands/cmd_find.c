@@ -8,102 +8,557 @@
  * Options:
  *   -name PATTERN   Base of file name matches PATTERN
  *   -type TYPE      File is of type TYPE (f=file, d=directory)
+ *   -j N            Walk with N threads (output sorted per directory)
+ *   --unordered     With -j, print matches as they are found
+ *   -print0         End each path with NUL instead of newline (for xargs -0)
+ *   -exec CMD [ARG...] ;     Run CMD for each match, {} standing for its path
+ *   -exec CMD [ARG...] {} +  Run CMD with as many matches at a time as fit
  *   -h, --help      Display help message
+ *
+ * -exec is taken out of the arguments before argtable3 sees them, since
+ * the command's words run up to the ";" or "{} +" that ends them. A
+ * registry command runs in this process; find has read all it needs
+ * from its own argtable, which is kept from run to run, before the walk
+ * starts, so the command may be find itself. Anything else is spawned.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* AT_FDCWD and flockfile() under -std=c11 */
+#endif
+
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/stat.h>
-#include <dirent.h>
+#include <fcntl.h>
 #include <fnmatch.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
+#include "pb_out.h"
+#include "walk.h"
+#include "exec_helpers.h"
 
 /* Forward declarations */
 int find_run(int argc, char **argv);
 void find_print_usage(FILE *out);
-static void find_recursive(const char *path, const char *name_pattern, char type_filter);
 
 /* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
 
 static struct arg_lit *find_help;
 static struct arg_str *find_name;
 static struct arg_str *find_type;
+static struct arg_int *find_jobs;
+static struct arg_lit *find_unordered;
+static struct arg_lit *find_print0;
 static struct arg_file *find_path;
 static struct arg_end *find_end;
-static void *find_argtable[6];
+static void *find_argtable[9];
 
 /* ===== SECTION 2: ARGTABLE BUILDER ===== */
 
 static void build_find_argtable(void)
 {
+    if (find_argtable[0] != NULL) {
+        return;
+    }
+
     find_help = arg_lit0("h", "help", "display this help and exit");
     find_name = arg_str0(NULL, "name", "PATTERN", "base of file name matches PATTERN");
     find_type = arg_str0(NULL, "type", "TYPE", "file is of type TYPE (f=file, d=directory)");
+    find_jobs = arg_int0("j", "jobs", "N", "walk with N threads");
+    find_unordered = arg_lit0(NULL, "unordered",
+                              "with -j, print matches as found instead of sorted per directory");
+    find_print0 = arg_lit0(NULL, "print0", "end each path with NUL, not newline (for xargs -0)");
     find_path = arg_file0(NULL, NULL, "PATH", "starting directory (default: current)");
     find_end = arg_end(20);
 
     find_argtable[0] = find_help;
     find_argtable[1] = find_name;
     find_argtable[2] = find_type;
-    find_argtable[3] = find_path;
-    find_argtable[4] = find_end;
-    find_argtable[5] = NULL;
+    find_argtable[3] = find_jobs;
+    find_argtable[4] = find_unordered;
+    find_argtable[5] = find_print0;
+    find_argtable[6] = find_path;
+    find_argtable[7] = find_end;
+    find_argtable[8] = NULL;
 }
 
 /* ===== HELPER FUNCTION ===== */
 
-static void find_recursive(const char *path, const char *name_pattern, char type_filter)
+/* Per-thread output of an unordered -j walk, written out in whole lines */
+#define FIND_OUT_SIZE (64 * 1024)
+
+typedef struct find_out {
+    char *buf;
+    size_t len;
+} find_out_t;
+
+/*
+ * Ordered -j output: every directory with a match at or below it is a
+ * find_item_t holding its own line (if it matched) and its entries'
+ * items, which are sorted by name at its WALK_POST and then hung on
+ * its parent. The root's WALK_POST prints the tree depth first, so the
+ * output is the same whichever thread found what.
+ */
+typedef struct find_item {
+    const char *name;           /* Sort key */
+    char *line;                 /* The path and its line end, NULL if it did not match */
+    size_t len;
+    struct find_item **kids;
+    size_t nkids;
+    size_t cap;
+} find_item_t;
+
+/* Walk data of a directory in an ordered -j walk */
+typedef struct find_dir {
+    pthread_mutex_t lock;       /* Over item->kids */
+    find_item_t *item;
+} find_dir_t;
+
+extern char **environ;
+
+/* Kept free under ARG_MAX besides the environment and the command's words */
+#define FIND_ARG_HEADROOM 2048
+
+/*
+ * A registry command takes at most this many operands (the limit its
+ * argtable sets), so in-process batches stop there as well as at ARG_MAX
+ */
+#define FIND_REGISTRY_MAX_ARGS 100
+
+/* -exec: the command's words, and with "{} +" the batch being filled */
+typedef struct find_exec {
+    char **tmpl;                /* CMD [ARG...], from find's own argv */
+    int ntmpl;
+    int batch;                  /* "{} +" rather than ";" */
+    const cmd_spec_t *spec;     /* CMD in the registry, NULL to spawn it */
+    char **argv;                /* Batch: tmpl, then the paths (owned) */
+    size_t argc;
+    size_t cap;
+    size_t bytes;               /* Of argv's strings and pointers */
+    size_t max_bytes;
+    size_t max_paths;
+    int failed;                 /* A batch exited non-zero */
+    pthread_mutex_t lock;       /* Walk threads take turns */
+} find_exec_t;
+
+typedef struct find_ctx {
+    const char *name_pattern;
+    char type_filter;
+    int jobs;                   /* 0: serial */
+    int unordered;
+    char eol;                   /* Ends each path: '\n', or '\0' for -print0 */
+    pb_out_t *pb;               /* Serial and ordered output */
+    find_out_t *out;            /* Unordered: one per thread */
+    pthread_mutex_t out_lock;
+    find_exec_t *exec;          /* -exec given */
+} find_ctx_t;
+
+/* The -name and -type tests, on what the directory listing says */
+static int find_match(const char *name, int type, void *arg)
+{
+    const find_ctx_t *ctx = arg;
+
+    if ((ctx->type_filter == 'f' && type != WALK_T_REG) ||
+        (ctx->type_filter == 'd' && type != WALK_T_DIR)) {
+        return 0;
+    }
+    return !ctx->name_pattern || fnmatch(ctx->name_pattern, name, 0) == 0;
+}
+
+static void find_out_flush(find_ctx_t *ctx, find_out_t *o)
+{
+    pthread_mutex_lock(&ctx->out_lock);
+    fwrite(o->buf, 1, o->len, stdout);
+    pthread_mutex_unlock(&ctx->out_lock);
+    o->len = 0;
+}
+
+static void find_out_line(find_ctx_t *ctx, int worker, const char *path, size_t len)
 {
-    DIR *dir;
-    struct dirent *entry;
-    char filepath[4096];
-    struct stat st;
+    find_out_t *o = &ctx->out[worker];
 
-    dir = opendir(path);
-    if (!dir) {
+    if (o->len + len + 1 > FIND_OUT_SIZE) {
+        find_out_flush(ctx, o);
+    }
+    if (len + 1 > FIND_OUT_SIZE) {
+        pthread_mutex_lock(&ctx->out_lock);
+        fwrite(path, 1, len, stdout);
+        putchar(ctx->eol);
+        pthread_mutex_unlock(&ctx->out_lock);
         return;
     }
+    memcpy(o->buf + o->len, path, len);
+    o->buf[o->len + len] = ctx->eol;
+    o->len += len + 1;
+}
 
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
+/* Run argv[0..argc) once; returns its exit status */
+static int find_exec_run(find_exec_t *x, int argc, char **argv)
+{
+    pid_t pid;
+    int status;
+
+    argv[argc] = NULL;
+    if (x->spec && !(x->spec->flags & CMD_FLAG_FORK)) {
+        status = x->spec->run(argc, argv);
+        fflush(cmd_stdout());
+        return status;
+    }
+
+    fflush(stdout);
+    pid = spawn_external(argv, NULL, -1, -1, NULL, 0);
+    if (pid < 0) {
+        /* spawn_external() has already said why */
+        return 127;
+    }
+    return wait_for_child(pid, argv[0]);
+}
+
+/* Run the batch gathered so far (lock held) */
+static void find_exec_flush(find_exec_t *x)
+{
+    size_t i;
+
+    if (x->argc == (size_t)x->ntmpl) {
+        return;
+    }
+    if (find_exec_run(x, (int)x->argc, x->argv) != 0) {
+        x->failed = 1;
+    }
+    for (i = (size_t)x->ntmpl; i < x->argc; i++) {
+        free(x->argv[i]);
+    }
+    x->argc = (size_t)x->ntmpl;
+    x->bytes = 0;
+}
+
+/* -exec for one match (from any walk thread) */
+static void find_exec_path(find_exec_t *x, const char *path, size_t len)
+{
+    pthread_mutex_lock(&x->lock);
+
+    if (!x->batch) {
+        char **argv = malloc(((size_t)x->ntmpl + 1) * sizeof(char *));
+
+        if (argv) {
+            for (int i = 0; i < x->ntmpl; i++) {
+                argv[i] = strcmp(x->tmpl[i], "{}") == 0 ? (char *)path : x->tmpl[i];
+            }
+            find_exec_run(x, x->ntmpl, argv);
+            free(argv);
         }
+        pthread_mutex_unlock(&x->lock);
+        return;
+    }
 
-        snprintf(filepath, sizeof(filepath), "%s/%s", path, entry->d_name);
+    if (x->argc > (size_t)x->ntmpl && (x->bytes + len + 1 + sizeof(char *) > x->max_bytes ||
+                                       x->argc - (size_t)x->ntmpl >= x->max_paths)) {
+        find_exec_flush(x);
+    }
+    if (x->argc + 2 > x->cap) {
+        size_t cap = x->cap * 2;
+        char **argv = realloc(x->argv, cap * sizeof(char *));
 
-        if (lstat(filepath, &st) != 0) {
-            continue;
+        if (!argv) {
+            pthread_mutex_unlock(&x->lock);
+            return;
         }
+        x->argv = argv;
+        x->cap = cap;
+    }
+    x->argv[x->argc] = strdup(path);
+    if (x->argv[x->argc]) {
+        x->argc++;
+        x->bytes += len + 1 + sizeof(char *);
+    }
 
-        int match = 1;
+    pthread_mutex_unlock(&x->lock);
+}
+
+/*
+ * Take "-exec CMD [ARG...] ;" or "-exec CMD [ARG...] {} +" out of argv:
+ * what is left goes into rest (NULL-terminated, *nrest words)
+ * Returns: 1 if -exec was found, 0 if not, -1 if it is malformed
+ */
+static int find_exec_take(int argc, char **argv, find_exec_t *x, char **rest, int *nrest)
+{
+    int found = 0;
+    int n = 0;
 
-        /* Check name pattern */
-        if (name_pattern && fnmatch(name_pattern, entry->d_name, 0) != 0) {
-            match = 0;
+    for (int i = 0; i < argc; i++) {
+        int j;
+
+        if (found || i == 0 || (strcmp(argv[i], "-exec") != 0 && strcmp(argv[i], "--exec") != 0)) {
+            rest[n++] = argv[i];
+            continue;
         }
 
-        /* Check type filter */
-        if (type_filter) {
-            if (type_filter == 'f' && !S_ISREG(st.st_mode)) {
-                match = 0;
-            } else if (type_filter == 'd' && !S_ISDIR(st.st_mode)) {
-                match = 0;
+        for (j = i + 1; j < argc; j++) {
+            if (strcmp(argv[j], ";") == 0 ||
+                (strcmp(argv[j], "+") == 0 && strcmp(argv[j - 1], "{}") == 0)) {
+                break;
             }
         }
+        x->batch = j < argc && strcmp(argv[j], "+") == 0;
+        x->tmpl = argv + i + 1;
+        x->ntmpl = j - i - 1 - x->batch;
+        if (j == argc || x->ntmpl < 1) {
+            return -1;
+        }
+        found = 1;
+        i = j;
+    }
 
-        if (match) {
-            printf("%s\n", filepath);
+    rest[n] = NULL;
+    *nrest = n;
+    return found;
+}
+
+/* Ready x for its walk; returns 0, or -1 out of memory */
+static int find_exec_init(find_exec_t *x)
+{
+    long arg_max = sysconf(_SC_ARG_MAX);
+    size_t limit;
+    size_t used;
+
+    x->spec = find_command(x->tmpl[0]);
+    pthread_mutex_init(&x->lock, NULL);
+
+    if (!x->batch) {
+        return 0;
+    }
+    /* What the environment and the command's own words leave of ARG_MAX */
+    used = FIND_ARG_HEADROOM;
+    for (char **e = environ; e && *e; e++) {
+        used += strlen(*e) + 1 + sizeof(char *);
+    }
+    for (int i = 0; i < x->ntmpl; i++) {
+        used += strlen(x->tmpl[i]) + 1 + sizeof(char *);
+    }
+    limit = arg_max > 0 ? (size_t)arg_max : 128 * 1024;
+    x->max_bytes = limit > used + FIND_ARG_HEADROOM ? limit - used : FIND_ARG_HEADROOM;
+    x->max_paths = (size_t)-1;
+    if (x->spec && !(x->spec->flags & CMD_FLAG_FORK)) {
+        x->max_paths = x->ntmpl < FIND_REGISTRY_MAX_ARGS ? FIND_REGISTRY_MAX_ARGS - (size_t)x->ntmpl + 1
+                                                         : 1;
+    }
+
+    x->cap = (size_t)x->ntmpl + 64;
+    x->argv = malloc(x->cap * sizeof(char *));
+    if (!x->argv) {
+        return -1;
+    }
+    memcpy(x->argv, x->tmpl, (size_t)x->ntmpl * sizeof(char *));
+    x->argc = (size_t)x->ntmpl;
+    return 0;
+}
+
+/* Run what is left of the batch; returns non-zero if any run failed */
+static int find_exec_finish(find_exec_t *x)
+{
+    if (x->batch) {
+        find_exec_flush(x);
+        free(x->argv);
+    }
+    pthread_mutex_destroy(&x->lock);
+    return x->failed;
+}
+
+/* Item for e (path matched or not), name and line stored after it */
+static find_item_t *find_item_new(const walk_entry_t *e, int matched, char eol)
+{
+    size_t nlen = strlen(e->name);
+    size_t llen = matched ? e->path_len + 1 : 0;
+    find_item_t *it = calloc(1, sizeof(find_item_t) + nlen + 1 + llen);
+    char *p;
+
+    if (!it) {
+        return NULL;
+    }
+    p = (char *)(it + 1);
+    memcpy(p, e->name, nlen + 1);
+    it->name = p;
+    if (matched) {
+        it->line = p + nlen + 1;
+        memcpy(it->line, e->path, e->path_len);
+        it->line[e->path_len] = eol;
+        it->len = llen;
+    }
+    return it;
+}
+
+static void find_item_free(find_item_t *it)
+{
+    for (size_t i = 0; i < it->nkids; i++) {
+        find_item_free(it->kids[i]);
+    }
+    free(it->kids);
+    free(it);
+}
+
+/* Hang it on directory d (from any thread) */
+static void find_item_add(find_dir_t *d, find_item_t *it)
+{
+    find_item_t *p = d->item;
+
+    pthread_mutex_lock(&d->lock);
+    if (p->nkids == p->cap) {
+        size_t cap = p->cap ? p->cap * 2 : 16;
+        find_item_t **kids = realloc(p->kids, cap * sizeof(*kids));
+
+        if (!kids) {
+            pthread_mutex_unlock(&d->lock);
+            find_item_free(it);
+            return;
+        }
+        p->kids = kids;
+        p->cap = cap;
+    }
+    p->kids[p->nkids++] = it;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static int find_item_cmp(const void *a, const void *b)
+{
+    return strcmp((*(find_item_t *const *)a)->name, (*(find_item_t *const *)b)->name);
+}
+
+static void find_item_print(pb_out_t *pb, const find_item_t *it)
+{
+    if (it->line) {
+        pb_out_write(pb, it->line, it->len);
+    }
+    for (size_t i = 0; i < it->nkids; i++) {
+        find_item_print(pb, it->kids[i]);
+    }
+}
+
+/* Ordered -j: collect matches per directory */
+static void find_visit_ordered(find_ctx_t *ctx, const walk_entry_t *e, int matched)
+{
+    find_dir_t *d = e->data;
+    find_dir_t *parent = e->parent_data;
+    find_item_t *it;
+
+    switch (e->visit) {
+    case WALK_PRE:
+        pthread_mutex_init(&d->lock, NULL);
+        d->item = find_item_new(e, matched, ctx->eol);
+        break;
+    case WALK_POST:
+        pthread_mutex_destroy(&d->lock);
+        it = d->item;
+        if (!it) {
+            break;
+        }
+        qsort(it->kids, it->nkids, sizeof(*it->kids), find_item_cmp);
+        if (!parent) {
+            find_item_print(ctx->pb, it);
+            find_item_free(it);
+        } else if (!it->line && it->nkids == 0) {
+            find_item_free(it);
+        } else if (parent->item) {
+            find_item_add(parent, it);
+        } else {
+            find_item_free(it);
+        }
+        break;
+    default:
+        if (parent && parent->item && (it = find_item_new(e, 1, ctx->eol)) != NULL) {
+            find_item_add(parent, it);
+        }
+        break;
+    }
+}
+
+static int find_visit(const walk_entry_t *e, void *arg)
+{
+    find_ctx_t *ctx = arg;
+    int matched;
+
+    /* What cannot be read is passed over */
+    if (e->visit == WALK_ERROR) {
+        return WALK_CONTINUE;
+    }
+
+    /* The starting point is not listed; files reach here matched already */
+    matched = e->depth > 0 && e->visit != WALK_POST &&
+              (e->visit != WALK_PRE || find_match(e->name, e->type, arg));
+
+    if (ctx->exec) {
+        if (matched) {
+            find_exec_path(ctx->exec, e->path, e->path_len);
+        }
+    } else if (ctx->jobs > 0 && !ctx->unordered) {
+        find_visit_ordered(ctx, e, matched);
+    } else if (matched && ctx->jobs > 0) {
+        find_out_line(ctx, e->worker, e->path, e->path_len);
+    } else if (matched) {
+        pb_out_write(ctx->pb, e->path, e->path_len);
+        pb_out_putc(ctx->pb, ctx->eol);
+    }
+    return WALK_CONTINUE;
+}
+
+/*
+ * Nothing is stat'ed unless the listing leaves the type out: -name and
+ * -type are answered from the name and d_type, and files that fail
+ * them are dropped before their path is put together. With -j the tests
+ * run on the walk's threads.
+ */
+static int find_recursive(const char *path, find_ctx_t *ctx)
+{
+    walk_opts_t opts = { WALK_FOLLOW_ROOTS, 0, 0, find_match };
+    int ret = 0;
+    int i;
+
+    if (ctx->jobs > 0) {
+        opts.flags |= WALK_PARALLEL;
+        opts.nworkers = ctx->jobs;
+        if (!ctx->unordered && !ctx->exec) {
+            opts.data_size = sizeof(find_dir_t);
+        }
+    }
+    if (ctx->jobs > 0 && ctx->unordered && !ctx->exec) {
+        ctx->out = calloc((size_t)ctx->jobs, sizeof(find_out_t));
+        for (i = 0; ctx->out && i < ctx->jobs; i++) {
+            ctx->out[i].buf = malloc(FIND_OUT_SIZE);
+            if (!ctx->out[i].buf) {
+                ret = -1;
+            }
+        }
+        if (!ctx->out || ret != 0) {
+            ret = -1;
+            goto done;
         }
+        pthread_mutex_init(&ctx->out_lock, NULL);
+    }
+
+    if (walk(AT_FDCWD, &path, 1, &opts, find_visit, ctx) < 0) {
+        ret = -1;
+    }
 
-        /* Recurse into directories */
-        if (S_ISDIR(st.st_mode)) {
-            find_recursive(filepath, name_pattern, type_filter);
+    if (ctx->out) {
+        for (i = 0; i < ctx->jobs; i++) {
+            find_out_flush(ctx, &ctx->out[i]);
         }
+        pthread_mutex_destroy(&ctx->out_lock);
     }
 
-    closedir(dir);
+done:
+    if (ctx->out) {
+        for (i = 0; i < ctx->jobs; i++) {
+            free(ctx->out[i].buf);
+        }
+        free(ctx->out);
+        ctx->out = NULL;
+    }
+    return ret;
 }
 
 /* ===== SECTION 3: RUN FUNCTION ===== */
@@ -112,16 +567,42 @@ int find_run(int argc, char **argv)
 {
     int nerrors;
     const char *start_path = ".";
-    const char *name_pattern = NULL;
-    char type_filter = 0;
+    find_ctx_t ctx;
+    find_exec_t exec;
+    pb_out_t pb;
+    char **rest;
+    int nrest;
+    int has_exec;
+    int ret = EXIT_OK;
+
+    /* -exec and its command's words first: argtable3 cannot tell where they end */
+    memset(&exec, 0, sizeof(exec));
+    rest = malloc(((size_t)argc + 1) * sizeof(char *));
+    if (!rest) {
+        perror("find");
+        return EXIT_ERROR;
+    }
+    has_exec = find_exec_take(argc, argv, &exec, rest, &nrest);
+    if (has_exec < 0) {
+        fprintf(stderr, "find: missing argument to '-exec' (end it with ';' or '{} +')\n");
+        free(rest);
+        return EXIT_ERROR;
+    }
+
+    /* -print0 as other finds spell it */
+    for (int i = 1; i < nrest; i++) {
+        if (strcmp(rest[i], "-print0") == 0) {
+            rest[i] = (char *)"--print0";
+        }
+    }
 
     build_find_argtable();
-    nerrors = arg_parse(argc, argv, find_argtable);
+    nerrors = arg_parse(nrest, rest, find_argtable);
 
     /* Handle --help */
     if (find_help->count > 0) {
         find_print_usage(stdout);
-        arg_freetable(find_argtable, 5);
+        free(rest);
         return EXIT_OK;
     }
 
@@ -129,7 +610,7 @@ int find_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, find_end, "find");
         fprintf(stderr, "Try 'find --help' for more information.\n");
-        arg_freetable(find_argtable, 5);
+        free(rest);
         return EXIT_ERROR;
     }
 
@@ -140,21 +621,64 @@ int find_run(int argc, char **argv)
         start_path = find_path->filename[0];
     }
 
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.eol = find_print0->count > 0 ? '\0' : '\n';
+
     /* Get name pattern if specified */
     if (find_name->count > 0) {
-        name_pattern = find_name->sval[0];
+        ctx.name_pattern = find_name->sval[0];
     }
 
     /* Get type filter if specified */
     if (find_type->count > 0) {
-        type_filter = find_type->sval[0][0];
+        ctx.type_filter = find_type->sval[0][0];
+    }
+
+    /* -j N: walk on N threads */
+    if (find_jobs->count > 0) {
+        if (find_jobs->ival[0] < 1) {
+            fprintf(stderr, "find: invalid number of jobs: '%d'\n", find_jobs->ival[0]);
+            free(rest);
+            return EXIT_ERROR;
+        }
+        ctx.jobs = find_jobs->ival[0];
+        ctx.unordered = find_unordered->count > 0;
+    }
+
+    /* Nothing below reads the argtable: -exec may run find itself */
+
+    if (has_exec) {
+        if (find_exec_init(&exec) != 0) {
+            perror("find");
+            free(rest);
+            return EXIT_ERROR;
+        }
+        ctx.exec = &exec;
+    }
+
+    /* Paths go out in large blocks, not a stdio call each */
+    if (pb_out_init(&pb, stdout) != 0) {
+        perror("find");
+        free(rest);
+        return EXIT_ERROR;
     }
+    ctx.pb = &pb;
 
     /* Perform the find */
-    find_recursive(start_path, name_pattern, type_filter);
+    if (find_recursive(start_path, &ctx) != 0) {
+        perror("find");
+        ret = EXIT_ERROR;
+    }
+    if (has_exec && find_exec_finish(&exec) != 0) {
+        ret = EXIT_ERROR;
+    }
+    if (pb_out_close(&pb) != 0 && errno != EPIPE) {
+        perror("find: write error");
+        ret = EXIT_ERROR;
+    }
 
-    arg_freetable(find_argtable, 5);
-    return EXIT_OK;
+    free(rest);
+    return ret;
 }
 
 /* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
@@ -164,7 +688,7 @@ void find_print_usage(FILE *out)
     build_find_argtable();
 
     fprintf(out, "Usage: find ");
-    arg_print_syntax(out, find_argtable, "\n");
+    arg_print_syntax(out, find_argtable, " [-exec CMD [ARG...] (; | {} +)]\n");
     fprintf(out, "Search for files in a directory hierarchy.\n\n");
     fprintf(out, "Options:\n");
     arg_print_glossary(out, find_argtable, "  %-25s %s\n");
@@ -180,8 +704,11 @@ void find_print_usage(FILE *out)
     fprintf(out, "  find --name '*.c'        Find all .c files\n");
     fprintf(out, "  find --type f            Find only regular files\n");
     fprintf(out, "  find --type d            Find only directories\n");
-
-    arg_freetable(find_argtable, 5);
+    fprintf(out, "  find -j 8 --name '*.o'   Search on 8 threads, output sorted per directory\n");
+    fprintf(out, "  find . --name '*.o' -print0 | xargs -0 rm\n");
+    fprintf(out, "                           Remove them, whatever their names hold\n");
+    fprintf(out, "  find . --name '*.o' -exec rm {} +\n");
+    fprintf(out, "                           Remove them, as many per rm as fit\n");
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
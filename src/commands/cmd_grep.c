@@ -5,19 +5,73 @@
  * the standard command anatomy for PicoBox.
  *
  * Usage: grep [OPTIONS] PATTERN [FILE...]
+ *        grep [OPTIONS] -e PATTERN... | -f FILE... [FILE...]
  * Options:
+ *   -e, --regexp=PATTERN   Search for PATTERN (repeatable)
+ *   -f, --file=FILE        Search for the patterns in FILE, one per line
+ *   -E, --extended-regexp  PATTERN is an extended regular expression
+ *   -G, --basic-regexp     PATTERN is a basic regular expression (default)
+ *   -F, --fixed-strings    PATTERN is a plain string
  *   -i, --ignore-case   Ignore case distinctions
  *   -n, --line-number   Print line numbers
  *   -v, --invert-match  Invert match (select non-matching lines)
+ *   -c, --count         Print only a count of selected lines per file
+ *   -l, --files-with-matches     Print only names of files with a match
+ *   -L, --files-without-match    Print only names of files without one
+ *   -q, --quiet         Print nothing; exit status only
+ *   -m, --max-count=NUM Stop reading a file after NUM selected lines
+ *   -r, --recursive     Search directories recursively
+ *   -R, --dereference-recursive  Likewise, following all symbolic links
+ *   -z, --decompress    Decompress gzip and zstd input
  *   -h, --help          Display help message
+ *
+ * Regular expressions are compiled once (regex_dfa.h) and the same
+ * automaton is used for every file; -F strings go straight to the SIMD
+ * search in literal_search.h. Several patterns (-e, -f) are searched for
+ * together in one pass: fixed strings, or patterns with no special
+ * characters, by the Aho-Corasick automaton in literal_set.h, anything
+ * else as one alternation compiled by regex_dfa_compile_set().
+ *
+ * -r walks the trees on a work-stealing thread pool (work_pool.h); each
+ * thread buffers a file's output and writes it in one piece, so lines
+ * from different files never interleave (their order is not fixed).
+ *
+ * -l, -L and -q stop reading a file at its first selected line, -m at
+ * its NUMth, and -q stops at the first file with one.
+ *
+ * Regular files are mapped and searched as one buffer, other input is
+ * read in large blocks; either way the search runs across many lines at
+ * a time rather than line by line, and there is no line length limit.
+ * With -z, compressed input goes through the line reader, decompressed
+ * on threads of its own (decompress.h) while the search runs.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* mmap(), fileno() under -std=c11 */
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <strings.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
+#include "io_stats.h"
+#include "decompress.h"
+#include "regex_dfa.h"
+#include "literal_search.h"
+#include "literal_set.h"
+#include "work_pool.h"
+#include "utils.h"
+#include "pb_out.h"
 
 /* Forward declarations */
 int grep_run(int argc, char **argv);
@@ -26,49 +80,316 @@ void grep_print_usage(FILE *out);
 /* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
 
 static struct arg_lit *grep_help;
+static struct arg_lit *grep_extended;
+static struct arg_lit *grep_basic;
+static struct arg_lit *grep_fixed;
 static struct arg_lit *grep_ignore_case;
 static struct arg_lit *grep_line_numbers;
 static struct arg_lit *grep_invert;
+static struct arg_lit *grep_count;
+static struct arg_lit *grep_files_with;
+static struct arg_lit *grep_files_without;
+static struct arg_lit *grep_quiet;
+static struct arg_int *grep_max_count;
+static struct arg_lit *grep_recursive;
+static struct arg_lit *grep_dereference;
+static struct arg_lit *grep_decompress;
+static struct arg_str *grep_regexp;
+static struct arg_file *grep_pattern_file;
 static struct arg_str *grep_pattern;
 static struct arg_file *grep_files;
 static struct arg_end *grep_end;
-static void *grep_argtable[8];
+static void *grep_argtable[21];
 
 /* ===== SECTION 2: ARGTABLE BUILDER ===== */
 
 static void build_grep_argtable(void)
 {
+    if (grep_argtable[0] != NULL) {
+        return;
+    }
+
     grep_help = arg_lit0("h", "help", "display this help and exit");
+    grep_extended = arg_lit0("E", "extended-regexp", "PATTERN is an extended regular expression");
+    grep_basic = arg_lit0("G", "basic-regexp", "PATTERN is a basic regular expression (default)");
+    grep_fixed = arg_lit0("F", "fixed-strings", "PATTERN is a string, not a regular expression");
     grep_ignore_case = arg_lit0("i", "ignore-case", "ignore case distinctions");
     grep_line_numbers = arg_lit0("n", "line-number", "print line numbers");
     grep_invert = arg_lit0("v", "invert-match", "invert match (select non-matching lines)");
-    grep_pattern = arg_str1(NULL, NULL, "PATTERN", "pattern to search for");
+    grep_count = arg_lit0("c", "count", "print only a count of selected lines per file");
+    grep_files_with = arg_lit0("l", "files-with-matches", "print only names of files with selected lines");
+    grep_files_without = arg_lit0("L", "files-without-match", "print only names of files without any");
+    grep_quiet = arg_lit0("q", "quiet", "print nothing; exit 0 at the first selected line");
+    grep_max_count = arg_int0("m", "max-count", "NUM", "stop reading a file after NUM selected lines");
+    grep_recursive = arg_lit0("r", "recursive", "search directories recursively");
+    grep_dereference = arg_lit0("R", "dereference-recursive", "likewise, following all symbolic links");
+    grep_decompress = arg_lit0("z", "decompress", "decompress gzip and zstd input");
+    grep_regexp = arg_strn("e", "regexp", "PATTERN", 0, 1000, "search for PATTERN (repeatable)");
+    grep_pattern_file = arg_filen("f", "file", "FILE", 0, 100, "search for the patterns in FILE, one per line");
+    grep_pattern = arg_str0(NULL, NULL, "PATTERN", "pattern to search for (unless -e or -f is given)");
     grep_files = arg_filen(NULL, NULL, "FILE", 0, 100, "files to search (or stdin if none)");
     grep_end = arg_end(20);
 
     grep_argtable[0] = grep_help;
-    grep_argtable[1] = grep_ignore_case;
-    grep_argtable[2] = grep_line_numbers;
-    grep_argtable[3] = grep_invert;
-    grep_argtable[4] = grep_pattern;
-    grep_argtable[5] = grep_files;
-    grep_argtable[6] = grep_end;
-    grep_argtable[7] = NULL;
+    grep_argtable[1] = grep_extended;
+    grep_argtable[2] = grep_basic;
+    grep_argtable[3] = grep_fixed;
+    grep_argtable[4] = grep_ignore_case;
+    grep_argtable[5] = grep_line_numbers;
+    grep_argtable[6] = grep_invert;
+    grep_argtable[7] = grep_count;
+    grep_argtable[8] = grep_files_with;
+    grep_argtable[9] = grep_files_without;
+    grep_argtable[10] = grep_quiet;
+    grep_argtable[11] = grep_max_count;
+    grep_argtable[12] = grep_recursive;
+    grep_argtable[13] = grep_dereference;
+    grep_argtable[14] = grep_decompress;
+    grep_argtable[15] = grep_regexp;
+    grep_argtable[16] = grep_pattern_file;
+    grep_argtable[17] = grep_pattern;
+    grep_argtable[18] = grep_files;
+    grep_argtable[19] = grep_end;
+    grep_argtable[20] = NULL;
+}
+
+/* ===== HELPER FUNCTIONS ===== */
+
+/* Input is scanned in blocks of at least this size */
+#define GREP_BLOCK (256 * 1024)
+
+/* What to print */
+enum {
+    GREP_MODE_LINES,      /* The selected lines */
+    GREP_MODE_COUNT,      /* -c: how many there are */
+    GREP_MODE_WITH,       /* -l: the file name if there are any */
+    GREP_MODE_WITHOUT,    /* -L: the file name if there are none */
+    GREP_MODE_QUIET       /* -q: nothing */
+};
+
+/*
+ * State carried across the blocks of one file
+ */
+typedef struct {
+    regex_dfa_t *re;                /* Compiled pattern, or NULL for strings */
+    const literal_set_t *set;       /* Several strings, or NULL */
+    const literal_search_t *fixed;  /* One string */
+    int mode;                       /* GREP_MODE_* */
+    size_t max_count;               /* -m, or SIZE_MAX */
+    int line_numbers;
+    int invert;
+    int with_filename;              /* Prefix lines with the file name */
+    int decompress;                 /* -z */
+    const char *label;              /* That name, for the current file */
+    size_t lineno;                  /* Number of the next line (with -n) */
+    size_t count;                   /* Lines selected in this file */
+    int done;                       /* The rest of the file is not needed */
+    int found;
+    pb_out_t *out;
+} grep_scan_t;
+
+/*
+ * Find the first line of [p, end) with a match
+ * Returns: start of that line, or NULL
+ */
+static const char *grep_find_line(grep_scan_t *sc, const char *p, const char *end)
+{
+    const char *hit;
+
+    if (sc->re) {
+        return regex_dfa_search(sc->re, p, (size_t)(end - p));
+    }
+
+    if (sc->set) {
+        hit = literal_set_find(sc->set, p, (size_t)(end - p));
+    } else {
+        hit = literal_search_find(sc->fixed, p, (size_t)(end - p));
+    }
+    if (hit) {
+        while (hit > p && hit[-1] != '\n') {
+            hit--;
+        }
+    }
+    return hit;
+}
+
+/*
+ * Select the lines in [from, to), where to is the end of the last one:
+ * print or count them, as the mode says
+ * Returns: 1 once the file's answer is known (no more lines needed)
+ */
+static int grep_select(grep_scan_t *sc, const char *from, const char *to)
+{
+    const char *eol;
+
+    sc->found = 1;
+    if (sc->max_count == SIZE_MAX) {
+        if (sc->mode == GREP_MODE_COUNT) {
+            sc->count += literal_count_byte(from, (size_t)(to - from), '\n') + 1;
+            return 0;
+        }
+        if (sc->mode == GREP_MODE_LINES && !sc->line_numbers && !sc->label) {
+            pb_out_write(sc->out, from, (size_t)(to - from));
+            pb_out_putc(sc->out, '\n');
+            return 0;
+        }
+    }
+    if (sc->mode != GREP_MODE_LINES && sc->mode != GREP_MODE_COUNT) {
+        sc->count++;
+        return 1;
+    }
+
+    for (;;) {
+        eol = memchr(from, '\n', (size_t)(to - from));
+        if (!eol) {
+            eol = to;
+        }
+        if (sc->mode == GREP_MODE_LINES) {
+            if (sc->label) {
+                pb_out_str(sc->out, sc->label);
+                pb_out_putc(sc->out, ':');
+            }
+            if (sc->line_numbers) {
+                pb_out_uint(sc->out, sc->lineno++, 0);
+                pb_out_putc(sc->out, ':');
+            }
+            pb_out_write(sc->out, from, (size_t)(eol - from));
+            pb_out_putc(sc->out, '\n');
+        }
+        if (++sc->count == sc->max_count) {
+            return 1;
+        }
+        if (eol == to) {
+            return 0;
+        }
+        from = eol + 1;
+    }
+}
+
+/*
+ * Search buf[0..len), which holds whole lines without the final newline
+ * (so len == 0 is one empty line). The pattern is run over the whole
+ * block at once; line boundaries are only looked for around matches,
+ * and lines are only counted (with -n) between them.
+ */
+static void grep_lines(grep_scan_t *sc, const char *buf, size_t len)
+{
+    const char *p = buf;
+    const char *end = buf + len;
+    const char *line;
+    const char *eol;
+
+    for (;;) {
+        line = grep_find_line(sc, p, end);
+        if (!line) {
+            if (sc->invert) {
+                sc->done = grep_select(sc, p, end);
+            } else if (sc->line_numbers) {
+                sc->lineno += literal_count_byte(p, (size_t)(end - p), '\n') + 1;
+            }
+            return;
+        }
+
+        eol = memchr(line, '\n', (size_t)(end - line));
+        if (!eol) {
+            eol = end;
+        }
+
+        if (sc->invert) {
+            if (line > p && grep_select(sc, p, line - 1)) {
+                sc->done = 1;
+                return;
+            }
+            sc->lineno++;
+        } else {
+            if (sc->line_numbers) {
+                sc->lineno += literal_count_byte(p, (size_t)(line - p), '\n');
+            }
+            if (grep_select(sc, line, eol)) {
+                sc->done = 1;
+                return;
+            }
+        }
+
+        if (eol == end) {
+            return;
+        }
+        p = eol + 1;
+    }
+}
+
+/*
+ * Search a regular file through a read-only mapping
+ * Returns: 0, or -1 if it could not be mapped (fall back to reading)
+ */
+static int grep_mapped(grep_scan_t *sc, int fd, size_t size)
+{
+    char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    IO_STATS_READ((ssize_t)size);     /* Mapped: counted as one read of it all */
+    posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+
+    grep_lines(sc, map, map[size - 1] == '\n' ? size - 1 : size);
+
+    munmap(map, size);
+    return 0;
 }
 
-/* ===== HELPER FUNCTION ===== */
+/*
+ * Search a stream through the line reader: large blocks of whole lines
+ * from an fd, and from the stdio streams that threaded pipeline stages
+ * hand us (no fd) each line as it arrives. Lines have no length limit.
+ * decompress: decompress the input if it is compressed
+ * Returns: 0, or -1 on a read error
+ */
+static int grep_stream(grep_scan_t *sc, FILE *fp, int decompress)
+{
+    line_reader_t lr;
+    const char *data;
+    size_t len;
+    int r = 0;
+
+    if ((fileno(fp) >= 0 ? line_reader_init_fd(&lr, fileno(fp))
+                         : line_reader_init_stream(&lr, fp)) != 0) {
+        return -1;
+    }
+    if (decompress && line_reader_decompress(&lr) < 0) {
+        line_reader_free(&lr);
+        return -1;
+    }
+
+    while (!sc->done && (r = line_reader_lines(&lr, &data, &len)) > 0) {
+        grep_lines(sc, data, data[len - 1] == '\n' ? len - 1 : len);
+    }
+
+    line_reader_free(&lr);
+    return sc->done || r == 0 ? 0 : -1;
+}
 
-static int grep_file(const char *filename, const char *pattern, int ignore_case, int line_numbers, int invert)
+/*
+ * proto: matcher and options, as set up by grep_run()
+ */
+static int grep_file(const char *filename, const grep_scan_t *proto)
 {
+    grep_scan_t sc = *proto;
     FILE *fp;
-    char buffer[8192];
-    int line_num = 0;
-    int found = 0;
+    struct stat st;
     int using_stdin = 0;
+    int decompress = sc.decompress;
+    int ret = -1;
+
+    sc.lineno = 1;
+    sc.count = 0;
+    sc.done = 0;
+    sc.found = 0;
 
     if (filename == NULL || strcmp(filename, "-") == 0) {
-        fp = stdin;
+        fp = cmd_stdin();
         using_stdin = 1;
+        filename = "(standard input)";
     } else {
         fp = fopen(filename, "r");
         if (!fp) {
@@ -77,34 +398,461 @@ static int grep_file(const char *filename, const char *pattern, int ignore_case,
         }
     }
 
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-        line_num++;
-        int match;
+    sc.label = sc.with_filename ? filename : NULL;
 
-        if (ignore_case) {
-            match = (strcasestr(buffer, pattern) != NULL);
-        } else {
-            match = (strstr(buffer, pattern) != NULL);
+    /* A plain regular file needs no decompressing */
+    if (decompress && fileno(fp) >= 0 && decompress_fd_format(fileno(fp)) == DECOMPRESS_NONE) {
+        decompress = 0;
+    }
+
+    if (!using_stdin && !decompress && fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            ret = 0;
+        } else if ((uintmax_t)st.st_size <= SIZE_MAX) {
+            ret = grep_mapped(&sc, fileno(fp), (size_t)st.st_size);
         }
+    }
+    if (ret != 0 && grep_stream(&sc, fp, decompress) != 0) {
+        perror(filename);
+    }
 
-        if (invert) {
-            match = !match;
+    if (!using_stdin) {
+        fclose(fp);
+    }
+
+    switch (sc.mode) {
+    case GREP_MODE_COUNT:
+        if (sc.label) {
+            pb_out_str(sc.out, sc.label);
+            pb_out_putc(sc.out, ':');
+        }
+        pb_out_uint(sc.out, sc.count, 0);
+        pb_out_putc(sc.out, '\n');
+        break;
+    case GREP_MODE_WITH:
+        if (sc.found) {
+            pb_out_str(sc.out, filename);
+            pb_out_putc(sc.out, '\n');
+        }
+        break;
+    case GREP_MODE_WITHOUT:
+        if (!sc.found) {
+            pb_out_str(sc.out, filename);
+            pb_out_putc(sc.out, '\n');
         }
+        break;
+    }
+
+    return sc.found ? EXIT_OK : EXIT_ERROR;
+}
+
+/* ===== RECURSIVE SEARCH (-r, -R) ===== */
+
+#define GREP_MAX_WORKERS 64
 
-        if (match) {
-            if (line_numbers) {
-                printf("%d:", line_num);
+enum {
+    GREP_ENTRY_UNKNOWN,   /* Not known yet: stat() it */
+    GREP_ENTRY_FILE,
+    GREP_ENTRY_DIR
+};
+
+/*
+ * With -R, the directories above an entry, shared by all the entries
+ * of one directory; a directory that is its own ancestor is a loop
+ */
+typedef struct grep_ancestors {
+    atomic_int refs;
+    size_t n;
+    struct {
+        dev_t dev;
+        ino_t ino;
+    } ids[];
+} grep_ancestors_t;
+
+/* A path waiting in the pool */
+typedef struct {
+    int type;
+    int operand;          /* Named on the command line: always followed */
+    grep_ancestors_t *up; /* NULL without -R */
+    char path[];
+} grep_entry_t;
+
+/* Per thread: its own matcher copy and a buffer for one file's output */
+typedef struct {
+    grep_scan_t sc;
+    pb_out_t out;         /* Collects in memory */
+} grep_worker_t;
+
+typedef struct {
+    grep_worker_t *workers;
+    int follow_links;     /* -R */
+    pb_out_t *out;
+    pthread_mutex_t out_lock;
+    atomic_int found;
+    atomic_int stop;      /* -q has its answer: skip the rest */
+} grep_tree_t;
+
+static void grep_ancestors_put(grep_ancestors_t *up)
+{
+    if (up && atomic_fetch_sub(&up->refs, 1) == 1) {
+        free(up);
+    }
+}
+
+static int grep_tree_push(work_pool_t *pool, int worker, const char *dir, const char *name,
+                          int type, int operand, grep_ancestors_t *up)
+{
+    size_t dlen = strlen(dir);
+    size_t nlen = strlen(name);
+    int slash = dlen > 0 && dir[dlen - 1] != '/';
+    grep_entry_t *e = malloc(sizeof(grep_entry_t) + dlen + slash + nlen + 1);
+
+    if (!e) {
+        return -1;
+    }
+    e->type = type;
+    e->operand = operand;
+    e->up = up;
+    memcpy(e->path, dir, dlen);
+    if (slash) {
+        e->path[dlen] = '/';
+    }
+    memcpy(e->path + dlen + slash, name, nlen + 1);
+
+    if (up) {
+        atomic_fetch_add(&up->refs, 1);
+    }
+    if (work_pool_push(pool, worker, e) != 0) {
+        grep_ancestors_put(up);
+        free(e);
+        return -1;
+    }
+    return 0;
+}
+
+/* Queue a directory's entries; "" is the current directory, unprefixed */
+static void grep_tree_dir(work_pool_t *pool, int worker, grep_tree_t *t, grep_entry_t *e)
+{
+    const char *path = e->path;
+    DIR *dir = opendir(*path ? path : ".");
+    grep_ancestors_t *up = NULL;
+    struct dirent *entry;
+    struct stat st;
+
+    if (!dir) {
+        perror(*path ? path : ".");
+        return;
+    }
+
+    if (t->follow_links && fstat(dirfd(dir), &st) == 0) {
+        size_t n = e->up ? e->up->n : 0;
+
+        for (size_t i = 0; i < n; i++) {
+            if (e->up->ids[i].dev == st.st_dev && e->up->ids[i].ino == st.st_ino) {
+                fprintf(stderr, "grep: %s: warning: recursive directory loop\n", path);
+                closedir(dir);
+                return;
             }
-            printf("%s", buffer);
-            found = 1;
         }
+
+        up = malloc(sizeof(grep_ancestors_t) + (n + 1) * sizeof(up->ids[0]));
+        if (!up) {
+            perror("grep");
+            closedir(dir);
+            return;
+        }
+        atomic_init(&up->refs, 1);
+        up->n = n + 1;
+        if (n > 0) {
+            memcpy(up->ids, e->up->ids, n * sizeof(up->ids[0]));
+        }
+        up->ids[n].dev = st.st_dev;
+        up->ids[n].ino = st.st_ino;
     }
 
-    if (!using_stdin) {
+    while ((entry = readdir(dir)) != NULL) {
+        int type = GREP_ENTRY_UNKNOWN;
+
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+#ifdef DT_DIR
+        /* Saves a stat() per entry; symlinks are resolved when visited */
+        if (entry->d_type == DT_DIR) {
+            type = GREP_ENTRY_DIR;
+        } else if (entry->d_type == DT_REG) {
+            type = GREP_ENTRY_FILE;
+        } else if (entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN) {
+            continue;   /* Devices, FIFOs and sockets are not searched */
+        }
+#endif
+
+        if (grep_tree_push(pool, worker, path, entry->d_name, type, 0, up) != 0) {
+            perror("grep");
+            break;
+        }
+    }
+
+    grep_ancestors_put(up);
+    closedir(dir);
+}
+
+static void grep_tree_file(grep_tree_t *t, grep_worker_t *w, const char *path)
+{
+    const char *data;
+    size_t len;
+
+    if (grep_file(path, &w->sc) == EXIT_OK) {
+        atomic_store(&t->found, 1);
+        if (w->sc.mode == GREP_MODE_QUIET) {
+            atomic_store(&t->stop, 1);
+        }
+    }
+
+    /* The whole file's output at once, so files never interleave */
+    data = pb_out_data(&w->out, &len);
+    if (len > 0) {
+        pthread_mutex_lock(&t->out_lock);
+        pb_out_write(t->out, data, len);
+        pthread_mutex_unlock(&t->out_lock);
+        pb_out_reset(&w->out);
+    }
+}
+
+static void grep_tree_visit(work_pool_t *pool, int worker, void *item, void *arg)
+{
+    grep_tree_t *t = arg;
+    grep_entry_t *e = item;
+
+    if (atomic_load(&t->stop)) {
+        grep_ancestors_put(e->up);
+        free(e);
+        return;
+    }
+
+    if (e->type == GREP_ENTRY_UNKNOWN) {
+        struct stat st;
+        int follow = e->operand || t->follow_links;
+
+        if ((follow ? stat(e->path, &st) : lstat(e->path, &st)) != 0) {
+            perror(e->path);
+        } else if (S_ISDIR(st.st_mode)) {
+            e->type = GREP_ENTRY_DIR;
+        } else if (S_ISREG(st.st_mode) || e->operand) {
+            e->type = GREP_ENTRY_FILE;
+        }
+    }
+
+    if (e->type == GREP_ENTRY_DIR) {
+        grep_tree_dir(pool, worker, t, e);
+    } else if (e->type == GREP_ENTRY_FILE) {
+        grep_tree_file(t, &t->workers[worker], e->path);
+    }
+    grep_ancestors_put(e->up);
+    free(e);
+}
+
+/*
+ * Search the trees under roots[0..nroots) (none: the current directory)
+ * on a work-stealing pool, one file at a time per thread
+ *
+ * proto: as for grep_file(); its regular expression, if any, is
+ * compiled again for each extra thread from patterns and re_flags
+ * Returns: EXIT_OK if any line was selected
+ */
+static int grep_tree(const grep_scan_t *proto, const char **roots, int nroots,
+                     int follow_links, char *const *patterns, size_t npatterns, int re_flags)
+{
+    grep_tree_t t;
+    work_pool_t *pool = NULL;
+    int nworkers = work_pool_default_workers();
+    int ready = 0;
+    int i;
+
+    if (nworkers > GREP_MAX_WORKERS) {
+        nworkers = GREP_MAX_WORKERS;
+    }
+
+    memset(&t, 0, sizeof(t));
+    t.follow_links = follow_links;
+    t.out = proto->out;
+    pthread_mutex_init(&t.out_lock, NULL);
+    atomic_init(&t.found, 0);
+    atomic_init(&t.stop, 0);
+
+    t.workers = calloc((size_t)nworkers, sizeof(grep_worker_t));
+    if (!t.workers) {
+        perror("grep");
+        goto out;
+    }
+    for (ready = 0; ready < nworkers; ready++) {
+        grep_worker_t *w = &t.workers[ready];
+        char err[128];
+
+        w->sc = *proto;
+        w->sc.with_filename = 1;
+        if (proto->re && ready > 0) {
+            w->sc.re = regex_dfa_compile_set((const char *const *)patterns, npatterns,
+                                             re_flags, err, sizeof(err));
+            if (!w->sc.re) {
+                break;
+            }
+        }
+        w->sc.out = &w->out;
+        if (pb_out_init(&w->out, NULL) != 0) {
+            if (w->sc.re != proto->re) {
+                regex_dfa_free(w->sc.re);
+            }
+            break;
+        }
+    }
+    if (ready == 0) {
+        perror("grep");
+        goto out;
+    }
+
+    pool = work_pool_create(ready, grep_tree_visit, &t);
+    if (!pool) {
+        perror("grep");
+        goto out;
+    }
+
+    for (i = 0; i < nroots || (i == 0 && nroots == 0); i++) {
+        const char *root = nroots > 0 ? roots[i] : "";
+        int type = nroots > 0 ? GREP_ENTRY_UNKNOWN : GREP_ENTRY_DIR;
+
+        /* Standard input belongs to this thread; search it right here */
+        if (strcmp(root, "-") == 0) {
+            grep_tree_file(&t, &t.workers[0], root);
+            continue;
+        }
+        if (grep_tree_push(pool, i, "", root, type, 1, NULL) != 0) {
+            perror("grep");
+        }
+    }
+    work_pool_run(pool);
+
+out:
+    work_pool_destroy(pool);
+    for (i = 0; i < ready; i++) {
+        pb_out_close(&t.workers[i].out);
+        if (t.workers[i].sc.re != proto->re) {
+            regex_dfa_free(t.workers[i].sc.re);
+        }
+    }
+    free(t.workers);
+    pthread_mutex_destroy(&t.out_lock);
+
+    return atomic_load(&t.found) ? EXIT_OK : EXIT_ERROR;
+}
+
+/*
+ * Patterns from the command line, -e and -f
+ */
+typedef struct {
+    char **pats;
+    size_t *lens;
+    size_t n, cap;
+} grep_patterns_t;
+
+static int grep_add_pattern(grep_patterns_t *gp, const char *s, size_t len)
+{
+    char *copy;
+
+    if (gp->n == gp->cap) {
+        size_t cap = gp->cap ? gp->cap * 2 : 16;
+        char **pats = realloc(gp->pats, cap * sizeof(char *));
+        size_t *lens;
+
+        if (!pats) {
+            return -1;
+        }
+        gp->pats = pats;
+        lens = realloc(gp->lens, cap * sizeof(size_t));
+        if (!lens) {
+            return -1;
+        }
+        gp->lens = lens;
+        gp->cap = cap;
+    }
+
+    copy = malloc(len + 1);
+    if (!copy) {
+        return -1;
+    }
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    gp->pats[gp->n] = copy;
+    gp->lens[gp->n] = len;
+    gp->n++;
+    return 0;
+}
+
+/*
+ * Add each line of a file as a pattern (an empty line matches everything)
+ * Returns: 0, or -1 after printing an error
+ */
+static int grep_read_patterns(grep_patterns_t *gp, const char *filename)
+{
+    FILE *fp;
+    line_reader_t lr;
+    const char *line;
+    size_t len;
+    int r;
+    int ret = 0;
+
+    if (strcmp(filename, "-") == 0) {
+        fp = cmd_stdin();
+    } else {
+        fp = fopen(filename, "r");
+        if (!fp) {
+            perror(filename);
+            return -1;
+        }
+    }
+
+    if ((fp == cmd_stdin() ? line_reader_init_stream(&lr, fp)
+                           : line_reader_init_fd(&lr, fileno(fp))) != 0) {
+        ret = -1;
+    }
+    while (ret == 0 && (r = line_reader_next(&lr, &line, &len)) != 0) {
+        if (r < 0) {
+            ret = -1;
+            break;
+        }
+        if (line[len - 1] == '\n') {
+            len--;
+        }
+        ret = grep_add_pattern(gp, line, len);
+    }
+
+    if (ret != 0) {
+        perror(filename);
+    }
+    line_reader_free(&lr);
+    if (fp != cmd_stdin()) {
         fclose(fp);
     }
+    return ret;
+}
 
-    return found ? EXIT_OK : EXIT_ERROR;
+static void grep_free_patterns(grep_patterns_t *gp)
+{
+    for (size_t i = 0; i < gp->n; i++) {
+        free(gp->pats[i]);
+    }
+    free(gp->pats);
+    free(gp->lens);
+}
+
+/*
+ * A pattern with none of the special characters of its syntax matches
+ * exactly itself
+ */
+static int grep_is_plain(const char *pattern, int extended)
+{
+    return strpbrk(pattern, extended ? "\\.[*^$+?{}|()" : "\\.[*^$") == NULL;
 }
 
 /* ===== SECTION 3: RUN FUNCTION ===== */
@@ -113,19 +861,31 @@ int grep_run(int argc, char **argv)
 {
     int nerrors;
     int ignore_case = 0;
-    int line_numbers = 0;
-    int invert = 0;
-    const char *pattern;
+    int extended = 0;
+    int recursive = 0;
+    int re_flags = 0;
+    int plain;
+    grep_scan_t sc;
+    grep_patterns_t patterns;
+    regex_dfa_t *re = NULL;
+    literal_search_t fixed;
+    literal_set_t set;
+    const char **files = NULL;
+    int nfiles = 0;
+    int found = 0;
     int i;
     int ret = EXIT_OK;
+    pb_out_t out;
+
+    memset(&sc, 0, sizeof(sc));
+    memset(&patterns, 0, sizeof(patterns));
 
     build_grep_argtable();
-    nerrors = arg_parse(argc, argv, grep_argtable);
+    nerrors = cmd_arg_parse(argc, argv, grep_argtable);
 
     /* Handle --help */
     if (grep_help->count > 0) {
-        grep_print_usage(stdout);
-        arg_freetable(grep_argtable, 7);
+        grep_print_usage(cmd_stdout());
         return EXIT_OK;
     }
 
@@ -133,7 +893,6 @@ int grep_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, grep_end, "grep");
         fprintf(stderr, "Try 'grep --help' for more information.\n");
-        arg_freetable(grep_argtable, 7);
         return EXIT_ERROR;
     }
 
@@ -144,30 +903,173 @@ int grep_run(int argc, char **argv)
         ignore_case = 1;
     }
     if (grep_line_numbers->count > 0) {
-        line_numbers = 1;
+        sc.line_numbers = 1;
     }
     if (grep_invert->count > 0) {
-        invert = 1;
+        sc.invert = 1;
+    }
+    if (grep_extended->count > 0) {
+        extended = 1;
+        re_flags |= REGEX_EXTENDED;
+    }
+    if (ignore_case) {
+        re_flags |= REGEX_ICASE;
+    }
+    if (grep_recursive->count + grep_dereference->count > 0) {
+        recursive = 1;
+    }
+    if (grep_decompress->count > 0) {
+        sc.decompress = 1;
     }
 
-    /* Get pattern */
-    pattern = grep_pattern->sval[0];
+    /* -q wins over -l and -L, which win over -c */
+    if (grep_quiet->count > 0) {
+        sc.mode = GREP_MODE_QUIET;
+    } else if (grep_files_with->count > 0) {
+        sc.mode = GREP_MODE_WITH;
+    } else if (grep_files_without->count > 0) {
+        sc.mode = GREP_MODE_WITHOUT;
+    } else if (grep_count->count > 0) {
+        sc.mode = GREP_MODE_COUNT;
+    }
+    sc.max_count = SIZE_MAX;
+    if (grep_max_count->count > 0 && grep_max_count->ival[0] >= 0) {
+        sc.max_count = (size_t)grep_max_count->ival[0];
+    }
+
+    if (grep_extended->count + grep_basic->count + grep_fixed->count > 1) {
+        fprintf(stderr, "grep: conflicting matchers specified\n");
+        return EXIT_ERROR;
+    }
 
-    /* If no files, use stdin */
-    if (grep_files->count == 0) {
-        ret = grep_file(NULL, pattern, ignore_case, line_numbers, invert);
-        arg_freetable(grep_argtable, 7);
-        return ret;
+    files = malloc((size_t)(grep_files->count + 1) * sizeof(char *));
+    if (!files) {
+        perror("grep");
+        return EXIT_ERROR;
     }
 
-    /* Process each file */
+    /* Collect patterns; with -e or -f the first operand is a file */
+    if (grep_regexp->count + grep_pattern_file->count > 0) {
+        for (i = 0; i < grep_regexp->count && ret == EXIT_OK; i++) {
+            if (grep_add_pattern(&patterns, grep_regexp->sval[i],
+                                 strlen(grep_regexp->sval[i])) != 0) {
+                perror("grep");
+                ret = EXIT_ERROR;
+            }
+        }
+        for (i = 0; i < grep_pattern_file->count && ret == EXIT_OK; i++) {
+            if (grep_read_patterns(&patterns, grep_pattern_file->filename[i]) != 0) {
+                ret = EXIT_ERROR;
+            }
+        }
+        if (grep_pattern->count > 0) {
+            files[nfiles++] = grep_pattern->sval[0];
+        }
+    } else if (grep_pattern->count == 0) {
+        fprintf(stderr, "grep: missing PATTERN\n");
+        fprintf(stderr, "Try 'grep --help' for more information.\n");
+        ret = EXIT_ERROR;
+    } else if (grep_add_pattern(&patterns, grep_pattern->sval[0],
+                                strlen(grep_pattern->sval[0])) != 0) {
+        perror("grep");
+        ret = EXIT_ERROR;
+    }
     for (i = 0; i < grep_files->count; i++) {
-        if (grep_file(grep_files->filename[i], pattern, ignore_case, line_numbers, invert) != EXIT_OK) {
+        files[nfiles++] = grep_files->filename[i];
+    }
+    if (ret != EXIT_OK) {
+        goto out;
+    }
+
+    /* -m 0: nothing can be selected, so nothing is read */
+    if (sc.max_count == 0) {
+        ret = EXIT_ERROR;
+        goto out;
+    }
+
+    /* Compile them once for all files */
+    plain = 1;
+    for (size_t p = 0; p < patterns.n && grep_fixed->count == 0; p++) {
+        if (!grep_is_plain(patterns.pats[p], extended)) {
+            plain = 0;
+            break;
+        }
+    }
+
+    if (grep_fixed->count > 0 && patterns.n == 1) {
+        if (literal_search_init(&fixed, patterns.pats[0], patterns.lens[0], ignore_case) != 0) {
+            perror("grep");
             ret = EXIT_ERROR;
+            goto out;
         }
+        sc.fixed = &fixed;
+    } else if (plain && patterns.n != 1) {
+        if (literal_set_init(&set, (const char *const *)patterns.pats, patterns.lens,
+                             patterns.n, ignore_case) != 0) {
+            perror("grep");
+            ret = EXIT_ERROR;
+            goto out;
+        }
+        sc.set = &set;
+    } else {
+        char err[128];
+
+        re = regex_dfa_compile_set((const char *const *)patterns.pats, patterns.n,
+                                   re_flags, err, sizeof(err));
+        if (!re) {
+            fprintf(stderr, "grep: %s\n", err);
+            ret = EXIT_ERROR;
+            goto out;
+        }
+        sc.re = re;
+    }
+
+    if (pb_out_init(&out, cmd_stdout()) != 0) {
+        perror("grep");
+        ret = EXIT_ERROR;
+        goto done;
+    }
+    sc.out = &out;
+    sc.with_filename = nfiles > 1;
+
+    /* If no files, use stdin (or the current directory with -r) */
+    if (recursive) {
+        ret = grep_tree(&sc, files, nfiles, grep_dereference->count > 0,
+                        patterns.pats, patterns.n, re_flags);
+    } else if (nfiles == 0) {
+        ret = grep_file(NULL, &sc);
     }
 
-    arg_freetable(grep_argtable, 7);
+    /* Process each file (-q needs only one that matches) */
+    for (i = 0; i < nfiles && !recursive; i++) {
+        if (grep_file(files[i], &sc) == EXIT_OK) {
+            found = 1;
+            if (sc.mode == GREP_MODE_QUIET) {
+                break;
+            }
+        }
+    }
+    if (nfiles > 0 && !recursive) {
+        ret = found ? EXIT_OK : EXIT_ERROR;
+    }
+
+    if (pb_out_close(&out) != 0 && errno != EPIPE) {
+        perror("grep: write error");
+        ret = EXIT_ERROR;
+    }
+
+done:
+    if (re) {
+        regex_dfa_free(re);
+    } else if (sc.set) {
+        literal_set_free(&set);
+    } else {
+        literal_search_free(&fixed);
+    }
+
+out:
+    grep_free_patterns(&patterns);
+    free(files);
     return ret;
 }
 
@@ -179,8 +1081,11 @@ void grep_print_usage(FILE *out)
 
     fprintf(out, "Usage: grep ");
     arg_print_syntax(out, grep_argtable, "\n");
-    fprintf(out, "Search for PATTERN in each FILE.\n");
-    fprintf(out, "With no FILE, or when FILE is -, read standard input.\n\n");
+    fprintf(out, "Search for PATTERN in each FILE. PATTERN is a basic regular expression\n");
+    fprintf(out, "unless -E or -F is given. With -e or -f, lines matching any of the\n");
+    fprintf(out, "patterns are selected.\n");
+    fprintf(out, "With no FILE, or when FILE is -, read standard input (with -r, search\n");
+    fprintf(out, "the current directory).\n\n");
     fprintf(out, "Options:\n");
     arg_print_glossary(out, grep_argtable, "  %-25s %s\n");
     fprintf(out, "\n");
@@ -189,8 +1094,14 @@ void grep_print_usage(FILE *out)
     fprintf(out, "  grep -i hello file.txt    Case-insensitive search\n");
     fprintf(out, "  grep -n hello file.txt    Show line numbers\n");
     fprintf(out, "  grep -v hello file.txt    Show lines NOT matching 'hello'\n");
-
-    arg_freetable(grep_argtable, 7);
+    fprintf(out, "  grep -E 'a|b' file.txt    Lines containing a or b\n");
+    fprintf(out, "  grep -F a.b file.txt      Search for the string a.b\n");
+    fprintf(out, "  grep -e a -e b file.txt   Lines containing a or b\n");
+    fprintf(out, "  grep -F -f ids.txt log    Lines containing any line of ids.txt\n");
+    fprintf(out, "  grep -rn TODO src         Search every file under src\n");
+    fprintf(out, "  grep -q ERROR build.log   Exit 0 at the first ERROR line, or 1\n");
+    fprintf(out, "  grep -rl TODO src         Names of the files under src with a TODO\n");
+    fprintf(out, "  grep -z ERROR app.log.gz  Search app.log.gz decompressed\n");
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -198,9 +1109,12 @@ void grep_print_usage(FILE *out)
 cmd_spec_t cmd_grep_spec = {
     .name = "grep",
     .summary = "search for patterns in files",
-    .long_help = "Search for PATTERN in each FILE. With no FILE, or when FILE is -, read standard input.",
+    .long_help = "Search for PATTERN (a basic regular expression, or extended with -E, "
+                 "or a plain string with -F) in each FILE. With no FILE, or when FILE is -, "
+                 "read standard input.",
     .run = grep_run,
-    .print_usage = grep_print_usage
+    .print_usage = grep_print_usage,
+    .flags = CMD_FLAG_STREAMS | CMD_FLAG_PURE
 };
 
 /* ===== SECTION 6: REGISTRATION FUNCTION ===== */
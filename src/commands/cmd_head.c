@@ -7,14 +7,42 @@
  * Usage: head [OPTIONS] [FILE...]
  * Options:
  *   -n, --lines=NUM   Print first NUM lines (default 10)
+ *   -c, --bytes=NUM   Print first NUM bytes
+ *   -z, --decompress  Decompress gzip and zstd input
  *   -h, --help        Display help message
+ *
+ * Files are read with read() in large blocks and the lines counted
+ * with memchr(), so reading stops in the block holding the NUMth
+ * newline. Byte mode never looks at the data: sendfile() copies the
+ * bytes from the file to the output, or pread() and fwrite() where the
+ * output has no fd or refuses sendfile. Once head has what it needs
+ * from standard input it calls cmd_stdin_done(), so in a threaded
+ * pipeline the stage feeding it stops with EPIPE right away.
+ *
+ * With -z, compressed input (and anything that cannot be looked at
+ * first, such as a pipe) goes through the line reader, decompressed on
+ * threads of its own (decompress.h) that stop when head has enough.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* pread(), fileno() */
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
+#include "io_stats.h"
+#include "decompress.h"
+#include "utils.h"
 
 /* Forward declarations */
 int head_run(int argc, char **argv);
@@ -24,61 +52,274 @@ void head_print_usage(FILE *out);
 
 static struct arg_lit *head_help;
 static struct arg_int *head_lines;
+static struct arg_int *head_bytes;
+static struct arg_lit *head_decompress;
 static struct arg_file *head_files;
 static struct arg_end *head_end;
-static void *head_argtable[5];
+static void *head_argtable[7];
 
 /* ===== SECTION 2: ARGTABLE BUILDER ===== */
 
 static void build_head_argtable(void)
 {
+    if (head_argtable[0] != NULL) {
+        return;
+    }
+
     head_help = arg_lit0("h", "help", "display this help and exit");
     head_lines = arg_int0("n", "lines", "NUM", "print the first NUM lines instead of 10");
+    head_bytes = arg_int0("c", "bytes", "NUM", "print the first NUM bytes instead of lines");
+    head_decompress = arg_lit0("z", "decompress", "decompress gzip and zstd input");
     head_files = arg_filen(NULL, NULL, "FILE", 0, 100, "files to process (or stdin if none)");
     head_end = arg_end(20);
 
     head_argtable[0] = head_help;
     head_argtable[1] = head_lines;
-    head_argtable[2] = head_files;
-    head_argtable[3] = head_end;
-    head_argtable[4] = NULL;
+    head_argtable[2] = head_bytes;
+    head_argtable[3] = head_decompress;
+    head_argtable[4] = head_files;
+    head_argtable[5] = head_end;
+    head_argtable[6] = NULL;
 }
 
 /* ===== HELPER FUNCTION ===== */
 
-static int head_file(const char *filename, int num_lines)
+#define HEAD_BLOCK (64 * 1024)
+
+/*
+ * Copy the first count lines of fd to out, a read() block at a time
+ * Returns: 0, or -1 on a read error
+ */
+static int head_lines_fd(int fd, long count, FILE *out, char *buf)
 {
-    FILE *fp;
-    char buffer[8192];
-    int lines = 0;
-    int using_stdin = 0;
+    while (count > 0) {
+        ssize_t n = read(fd, buf, HEAD_BLOCK);
+        const char *p = buf;
+        const char *nl;
+
+        IO_STATS_READ(n);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        while (count > 0 && (nl = memchr(p, '\n', (size_t)(buf + n - p))) != NULL) {
+            p = nl + 1;
+            count--;
+        }
+        fwrite(buf, 1, count == 0 ? (size_t)(p - buf) : (size_t)n, out);
+    }
+
+    return 0;
+}
+
+/*
+ * Copy the first count lines (or bytes) a line reader hands out to out
+ * Returns: 0, or -1 on a read error
+ */
+static int head_reader(line_reader_t *lr, long count, int bytes, FILE *out)
+{
+    const char *data;
+    size_t len;
+    int r = 0;
+
+    while (count > 0 && (r = line_reader_lines(lr, &data, &len)) > 0) {
+        const char *p = data;
+        const char *nl;
+
+        if (bytes) {
+            p += len < (size_t)count ? len : (size_t)count;
+            count -= (long)(p - data);
+        } else {
+            while (count > 0 && (nl = memchr(p, '\n', (size_t)(data + len - p))) != NULL) {
+                p = nl + 1;
+                count--;
+            }
+            if (count > 0) {
+                p = data + len;
+            }
+        }
+        fwrite(data, 1, (size_t)(p - data), out);
+    }
+
+    return count > 0 && r < 0 ? -1 : 0;
+}
+
+/*
+ * Same for a stdio stream: the shell's stdin, whose buffer may already
+ * hold input, or a pipeline ring, which has no fd. The line reader
+ * takes no more from it than the lines it hands out.
+ */
+static int head_lines_stream(FILE *fp, long count, FILE *out)
+{
+    line_reader_t lr;
+    int ret;
+
+    if (line_reader_init_stream(&lr, fp) != 0) {
+        return -1;
+    }
+    ret = head_reader(&lr, count, 0, out);
+    line_reader_free(&lr);
+    return ret;
+}
+
+/*
+ * head -z of fd (or of fp if fd is -1): through the line reader,
+ * decompressed if it is compressed
+ * Returns: 0, or -1 on an error
+ */
+static int head_decompress_input(int fd, FILE *fp, long count, int bytes, FILE *out)
+{
+    line_reader_t lr;
+    int ret = -1;
+
+    if ((fd >= 0 ? line_reader_init_fd(&lr, fd) : line_reader_init_stream(&lr, fp)) != 0) {
+        return -1;
+    }
+    if (line_reader_decompress(&lr) >= 0) {
+        ret = head_reader(&lr, count, bytes, out);
+    }
+    line_reader_free(&lr);
+    return ret;
+}
+
+/*
+ * Copy the first count bytes of fd to out: sendfile() where the kernel
+ * can, otherwise pread() (read() for a FIFO) and fwrite()
+ * Returns: 0, or -1 on an error
+ */
+static int head_bytes_fd(int fd, long count, FILE *out, char *buf)
+{
+    off_t off = 0;
+    int seekable = 1;
+
+#ifdef __linux__
+    int out_fd = fileno(out);
+
+    if (out_fd >= 0 && fflush(out) == 0) {
+        while (off < count) {
+            /* Count what was sent: devices such as /dev/zero leave pos alone */
+            off_t pos = off;
+            ssize_t n = sendfile(out_fd, fd, &pos, (size_t)(count - off));
+
+            IO_STATS_READ(n);
+            IO_STATS_WRITE(n);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EPIPE) {
+                    return 0;
+                }
+                /* Not a file sendfile() reads, or an fd it cannot write */
+                if (off == 0 && (errno == EINVAL || errno == ENOSYS || errno == ESPIPE)) {
+                    break;
+                }
+                return -1;
+            }
+            if (n == 0) {
+                return 0;
+            }
+            off += n;
+        }
+        if (off >= count) {
+            return 0;
+        }
+    }
+#endif
+
+    while (off < count) {
+        size_t want = count - off < HEAD_BLOCK ? (size_t)(count - off) : HEAD_BLOCK;
+        ssize_t n = seekable ? pread(fd, buf, want, off) : read(fd, buf, want);
+
+        IO_STATS_READ(n);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ESPIPE && seekable) {
+                seekable = 0;
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        fwrite(buf, 1, (size_t)n, out);
+        off += n;
+    }
+
+    return 0;
+}
+
+static int head_bytes_stream(FILE *fp, long count, FILE *out, char *buf)
+{
+    while (count > 0) {
+        size_t want = count < HEAD_BLOCK ? (size_t)count : HEAD_BLOCK;
+        size_t n = fread(buf, 1, want, fp);
+
+        if (n == 0) {
+            break;
+        }
+        fwrite(buf, 1, n, out);
+        count -= (long)n;
+    }
+
+    return ferror(fp) ? -1 : 0;
+}
+
+/*
+ * Print the first count lines (or bytes) of one operand
+ *
+ * stdin_last: this is the last read of standard input, so the producer
+ * may be told to stop (cmd_stdin_done()) as soon as it is over
+ * decompress: -z
+ */
+static int head_file(const char *filename, long count, int bytes, int decompress,
+                     int stdin_last, char *buf)
+{
+    FILE *out = cmd_stdout();
+    int fd;
+    int ret;
 
     if (filename == NULL || strcmp(filename, "-") == 0) {
-        fp = stdin;
-        using_stdin = 1;
+        FILE *fp = cmd_stdin();
+
+        if (decompress) {
+            ret = head_decompress_input(-1, fp, count, bytes, out);
+        } else {
+            ret = bytes ? head_bytes_stream(fp, count, out, buf)
+                        : head_lines_stream(fp, count, out);
+        }
+        if (stdin_last) {
+            cmd_stdin_done();
+        }
     } else {
-        fp = fopen(filename, "r");
-        if (!fp) {
+        fd = open(filename, O_RDONLY);
+        if (fd < 0) {
             perror(filename);
             return EXIT_ERROR;
         }
+        if (decompress && decompress_fd_format(fd) != DECOMPRESS_NONE) {
+            ret = head_decompress_input(fd, NULL, count, bytes, out);
+        } else {
+            ret = bytes ? head_bytes_fd(fd, count, out, buf)
+                        : head_lines_fd(fd, count, out, buf);
+        }
+        close(fd);
     }
 
-    while (lines < num_lines && fgets(buffer, sizeof(buffer), fp) != NULL) {
-        printf("%s", buffer);
-        lines++;
-    }
-
-    if (ferror(fp)) {
+    if (ret != 0) {
         perror(filename ? filename : "stdin");
-        if (!using_stdin) fclose(fp);
         return EXIT_ERROR;
     }
 
-    if (!using_stdin) {
-        fclose(fp);
-    }
-
     return EXIT_OK;
 }
 
@@ -87,18 +328,21 @@ static int head_file(const char *filename, int num_lines)
 int head_run(int argc, char **argv)
 {
     int nerrors;
-    int num_lines = 10;  /* default */
+    long count = 10;  /* default */
+    int bytes = 0;
+    int decompress;
+    char *buf;
+    int last_stdin = -1;
     int i;
     int ret = EXIT_OK;
     int multiple_files;
 
     build_head_argtable();
-    nerrors = arg_parse(argc, argv, head_argtable);
+    nerrors = cmd_arg_parse(argc, argv, head_argtable);
 
     /* Handle --help */
     if (head_help->count > 0) {
-        head_print_usage(stdout);
-        arg_freetable(head_argtable, 4);
+        head_print_usage(cmd_stdout());
         return EXIT_OK;
     }
 
@@ -106,7 +350,6 @@ int head_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, head_end, "head");
         fprintf(stderr, "Try 'head --help' for more information.\n");
-        arg_freetable(head_argtable, 4);
         return EXIT_ERROR;
     }
 
@@ -114,40 +357,64 @@ int head_run(int argc, char **argv)
 
     /* Get number of lines if specified */
     if (head_lines->count > 0) {
-        num_lines = head_lines->ival[0];
-        if (num_lines < 0) {
-            fprintf(stderr, "head: invalid number of lines: '%d'\n", num_lines);
-            arg_freetable(head_argtable, 4);
+        count = head_lines->ival[0];
+        if (count < 0) {
+            fprintf(stderr, "head: invalid number of lines: '%ld'\n", count);
+            return EXIT_ERROR;
+        }
+    }
+
+    /* -c counts bytes instead (and wins over -n) */
+    if (head_bytes->count > 0) {
+        count = head_bytes->ival[0];
+        bytes = 1;
+        if (count < 0) {
+            fprintf(stderr, "head: invalid number of bytes: '%ld'\n", count);
             return EXIT_ERROR;
         }
     }
 
+    decompress = (head_decompress->count > 0);
+
+    buf = malloc(HEAD_BLOCK);
+    if (!buf) {
+        perror("head");
+        return EXIT_ERROR;
+    }
+
     /* If no files specified, read from stdin */
     if (head_files->count == 0) {
-        ret = head_file(NULL, num_lines);
-        arg_freetable(head_argtable, 4);
+        ret = head_file(NULL, count, bytes, decompress, 1, buf);
+        free(buf);
         return ret;
     }
 
     /* Check if we have multiple files (for headers) */
     multiple_files = (head_files->count > 1);
 
+    for (i = 0; i < head_files->count; i++) {
+        if (strcmp(head_files->filename[i], "-") == 0) {
+            last_stdin = i;
+        }
+    }
+
     /* Process each file */
     for (i = 0; i < head_files->count; i++) {
         /* Print header if multiple files */
         if (multiple_files) {
             if (i > 0) {
-                printf("\n");
+                fprintf(cmd_stdout(), "\n");
             }
-            printf("==> %s <==\n", head_files->filename[i]);
+            fprintf(cmd_stdout(), "==> %s <==\n", head_files->filename[i]);
         }
 
-        if (head_file(head_files->filename[i], num_lines) != EXIT_OK) {
+        if (head_file(head_files->filename[i], count, bytes, decompress, i == last_stdin,
+                      buf) != EXIT_OK) {
             ret = EXIT_ERROR;
         }
     }
 
-    arg_freetable(head_argtable, 4);
+    free(buf);
     return ret;
 }
 
@@ -168,9 +435,9 @@ void head_print_usage(FILE *out)
     fprintf(out, "Examples:\n");
     fprintf(out, "  head file.txt             Print first 10 lines of file.txt\n");
     fprintf(out, "  head -n 20 file.txt       Print first 20 lines\n");
+    fprintf(out, "  head -c 512 file.bin      Print first 512 bytes\n");
     fprintf(out, "  head file1 file2          Print first 10 lines of each file\n");
-
-    arg_freetable(head_argtable, 4);
+    fprintf(out, "  head -z app.log.zst       Print first 10 lines, decompressed\n");
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -181,7 +448,8 @@ cmd_spec_t cmd_head_spec = {
     .long_help = "Print the first 10 lines of each FILE to standard output. "
                  "With more than one FILE, precede each with a header giving the file name.",
     .run = head_run,
-    .print_usage = head_print_usage
+    .print_usage = head_print_usage,
+    .flags = CMD_FLAG_STREAMS | CMD_FLAG_PURE
 };
 
 /* ===== SECTION 6: REGISTRATION FUNCTION ===== */
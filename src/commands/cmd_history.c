@@ -0,0 +1,180 @@
+/*
+ * cmd_history.c - Print or search the command history
+ *
+ * Follows the standard command anatomy for PicoBox (argtable3).
+ *
+ * Usage: history [OPTIONS] [N]
+ * Options:
+ *   -s, --search=TEXT  Print the lines containing TEXT, newest first
+ *   -h, --help         Display help message
+ *
+ * The history is the one every interactive shell appends to and
+ * searches with Ctrl-R (history.h); a search here goes through the
+ * same trigram index.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "argtable3.h"
+#include "cmd_spec.h"
+#include "picobox.h"
+#include "history.h"
+
+/* Forward declarations */
+int history_run(int argc, char **argv);
+void history_print_usage(FILE *out);
+
+/* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
+
+static struct arg_lit *history_help;
+static struct arg_str *history_search_text;
+static struct arg_int *history_count;
+static struct arg_end *history_end_arg;
+static void *history_argtable[5];
+
+/* ===== SECTION 2: ARGTABLE BUILDER ===== */
+
+static void build_history_argtable(void)
+{
+    if (history_argtable[0] != NULL) {
+        return;
+    }
+
+    history_help = arg_lit0("h", "help", "display this help and exit");
+    history_search_text = arg_str0("s", "search", "TEXT", "print the lines containing TEXT, newest first");
+    history_count = arg_int0(NULL, NULL, "N", "only the last N lines (or N matches)");
+    history_end_arg = arg_end(20);
+
+    history_argtable[0] = history_help;
+    history_argtable[1] = history_search_text;
+    history_argtable[2] = history_count;
+    history_argtable[3] = history_end_arg;
+    history_argtable[4] = NULL;
+}
+
+/* ===== SECTION 3: RUN FUNCTION ===== */
+
+int history_run(int argc, char **argv)
+{
+    history_entry_t entry;
+    long limit = -1;
+    long total = 0;
+    uint64_t off;
+    int nerrors;
+
+    build_history_argtable();
+    nerrors = arg_parse(argc, argv, history_argtable);
+
+    /* Handle --help */
+    if (history_help->count > 0) {
+        history_print_usage(stdout);
+        return EXIT_OK;
+    }
+
+    /* Handle parsing errors */
+    if (nerrors > 0) {
+        arg_print_errors(stderr, history_end_arg, "history");
+        fprintf(stderr, "Try 'history --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
+    /* ===== ACTUAL COMMAND LOGIC ===== */
+
+    if (history_count->count > 0) {
+        limit = history_count->ival[0];
+        if (limit < 0) {
+            fprintf(stderr, "history: invalid count: '%ld'\n", limit);
+            return EXIT_ERROR;
+        }
+    }
+    if (history_open() != 0) {
+        fprintf(stderr, "history: cannot open the history (is HOME set?)\n");
+        return EXIT_ERROR;
+    }
+
+    /* Matches, newest first */
+    if (history_search_text->count > 0) {
+        const char *text = history_search_text->sval[0];
+        long found = 0;
+
+        off = history_end();
+        while (found != limit && history_search(text, off, &entry) == 0) {
+            printf("%.*s\n", (int)entry.len, entry.text);
+            off = entry.off;
+            found++;
+        }
+        return found > 0 ? EXIT_OK : EXIT_ERROR;
+    }
+
+    /* The last N lines, numbered from the first line of the file */
+    for (off = history_end(); history_before(off, &entry) == 0; off = entry.off) {
+        total++;
+    }
+    if (limit < 0 || limit > total) {
+        limit = total;
+    }
+    if (limit == 0) {
+        return EXIT_OK;
+    }
+    off = history_end();
+    for (long i = 0; i < limit && history_before(off, &entry) == 0; i++) {
+        off = entry.off;
+    }
+
+    /* entry is the first of them */
+    for (long n = total - limit + 1; ; n++) {
+        printf("%5ld  %.*s\n", n, (int)entry.len, entry.text);
+        if (history_after(entry.off, &entry) != 0) {
+            break;
+        }
+    }
+
+    return EXIT_OK;
+}
+
+/* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
+
+void history_print_usage(FILE *out)
+{
+    build_history_argtable();
+
+    fprintf(out, "Usage: history ");
+    arg_print_syntax(out, history_argtable, "\n");
+    fprintf(out, "Print the command history, numbered, or the lines in it that\n");
+    fprintf(out, "contain TEXT.\n\n");
+    fprintf(out, "Options:\n");
+    arg_print_glossary(out, history_argtable, "  %-25s %s\n");
+    fprintf(out, "\n");
+    fprintf(out, "Interactive shells share one history, ~/.mysh/history ($HISTFILE if\n");
+    fprintf(out, "set). At the prompt, Up and Down walk it and Ctrl-R searches it.\n\n");
+    fprintf(out, "Examples:\n");
+    fprintf(out, "  history 20                 The last 20 lines\n");
+    fprintf(out, "  history -s make 5          The 5 newest lines containing 'make'\n");
+}
+
+/* ===== SECTION 5: COMMAND SPECIFICATION ===== */
+
+cmd_spec_t cmd_history_spec = {
+    .name = "history",
+    .summary = "print or search the command history",
+    .long_help = "Print the command history shared by interactive shells, or the "
+                 "lines in it that contain TEXT, newest first.",
+    .run = history_run,
+    .print_usage = history_print_usage
+};
+
+/* ===== SECTION 6: REGISTRATION FUNCTION ===== */
+
+void register_history_command(void)
+{
+    register_command(&cmd_history_spec);
+}
+
+/* ===== SECTION 7: STANDALONE MAIN ===== */
+
+#ifndef BUILTIN_ONLY
+int main(int argc, char **argv)
+{
+    return cmd_history_spec.run(argc, argv);
+}
+#endif
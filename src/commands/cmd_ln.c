@@ -11,6 +11,10 @@
  *   -h, --help       Display help message
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* symlink() */
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -35,6 +39,10 @@ static void *ln_argtable[6];
 
 static void build_ln_argtable(void)
 {
+    if (ln_argtable[0] != NULL) {
+        return;
+    }
+
     ln_help = arg_lit0("h", "help", "display this help and exit");
     ln_symbolic = arg_lit0("s", "symbolic", "make symbolic links instead of hard links");
     ln_force = arg_lit0("f", "force", "remove existing destination files");
@@ -65,7 +73,6 @@ int ln_run(int argc, char **argv)
     /* Handle --help */
     if (ln_help->count > 0) {
         ln_print_usage(stdout);
-        arg_freetable(ln_argtable, 5);
         return EXIT_OK;
     }
 
@@ -73,7 +80,6 @@ int ln_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, ln_end, "ln");
         fprintf(stderr, "Try 'ln --help' for more information.\n");
-        arg_freetable(ln_argtable, 5);
         return EXIT_ERROR;
     }
 
@@ -100,18 +106,15 @@ int ln_run(int argc, char **argv)
     if (symbolic) {
         if (symlink(target, linkname) != 0) {
             perror("ln");
-            arg_freetable(ln_argtable, 5);
             return EXIT_ERROR;
         }
     } else {
         if (link(target, linkname) != 0) {
             perror("ln");
-            arg_freetable(ln_argtable, 5);
             return EXIT_ERROR;
         }
     }
 
-    arg_freetable(ln_argtable, 5);
     return EXIT_OK;
 }
 
@@ -131,8 +134,6 @@ void ln_print_usage(FILE *out)
     fprintf(out, "  ln file.txt link.txt       Create hard link\n");
     fprintf(out, "  ln -s file.txt link.txt    Create symbolic link\n");
     fprintf(out, "  ln -sf file.txt link.txt   Force create symbolic link\n");
-
-    arg_freetable(ln_argtable, 5);
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
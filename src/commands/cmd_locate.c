@@ -0,0 +1,581 @@
+/*
+ * cmd_locate.c - Find files by name in the updatedb database
+ *
+ * This follows the standard command anatomy for PicoBox, using argtable3.
+ *
+ * Usage: locate [OPTIONS] PATTERN...
+ * Options:
+ *   -d, --database=FILE   Search FILE instead of the default database
+ *   -b, --basename        Match the last component of each path only
+ *   -c, --count           Print how many paths match instead of them
+ *   -l, --limit=N         Stop after N matches
+ *   -h, --help            Display help message
+ *
+ * A PATTERN without wildcards matches any path containing it; one with
+ * them must match the whole path (with -b, the base name) as fnmatch()
+ * decides, the same test as find --name. The database is mapped
+ * read-only and the filesystem is not touched: the trigram index
+ * narrows each pattern to the blocks that can hold a match, and only
+ * those are decompressed and tested.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* memmem() under -std=c11 */
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "argtable3.h"
+#include "cmd_spec.h"
+#include "picobox.h"
+#include "pb_out.h"
+#include "locate_db.h"
+#include "utils.h"
+
+/* Forward declarations */
+int locate_run(int argc, char **argv);
+void locate_print_usage(FILE *out);
+
+/* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
+
+static struct arg_lit *locate_help;
+static struct arg_file *locate_database;
+static struct arg_lit *locate_basename;
+static struct arg_lit *locate_count;
+static struct arg_int *locate_limit;
+static struct arg_str *locate_patterns;
+static struct arg_end *locate_end;
+static void *locate_argtable[8];
+
+/* ===== SECTION 2: ARGTABLE BUILDER ===== */
+
+static void build_locate_argtable(void)
+{
+    if (locate_argtable[0] != NULL) {
+        return;
+    }
+
+    locate_help = arg_lit0("h", "help", "display this help and exit");
+    locate_database = arg_file0("d", "database", "FILE",
+                                "search FILE (default " LOCATE_DB_DEFAULT ")");
+    locate_basename = arg_lit0("b", "basename", "match the base name of each path only");
+    locate_count = arg_lit0("c", "count", "print the number of matches instead");
+    locate_limit = arg_int0("l", "limit", "N", "stop after N matches");
+    locate_patterns = arg_strn(NULL, NULL, "PATTERN", 1, 100, "what to look for");
+    locate_end = arg_end(20);
+
+    locate_argtable[0] = locate_help;
+    locate_argtable[1] = locate_database;
+    locate_argtable[2] = locate_basename;
+    locate_argtable[3] = locate_count;
+    locate_argtable[4] = locate_limit;
+    locate_argtable[5] = locate_patterns;
+    locate_argtable[6] = locate_end;
+    locate_argtable[7] = NULL;
+}
+
+/* ===== HELPER FUNCTION ===== */
+
+/* The database, mapped */
+typedef struct locate_db {
+    const unsigned char *map;
+    size_t size;
+    const locate_db_hdr_t *hdr;
+    const uint64_t *blocks;
+    const unsigned char *data;
+    const locate_db_tri_t *tris;
+    const unsigned char *post;
+} locate_db_t;
+
+typedef struct locate_pattern {
+    const char *text;
+    size_t len;
+    int glob;                   /* Has wildcards: fnmatch() on the whole name */
+} locate_pattern_t;
+
+/* A list of block numbers */
+typedef struct locate_blocks {
+    uint32_t *v;
+    size_t len;
+} locate_blocks_t;
+
+/*
+ * Map path and check that its parts lie inside it
+ * Returns: 0, or -1 with a message printed
+ */
+static int locate_db_open(locate_db_t *db, const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    const locate_db_hdr_t *h;
+    void *map;
+
+    memset(db, 0, sizeof(*db));
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "locate: %s: %s\n", path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(locate_db_hdr_t)) {
+        close(fd);
+        fprintf(stderr, "locate: %s: not a locate database\n", path);
+        return -1;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "locate: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    db->map = map;
+    db->size = (size_t)st.st_size;
+
+    h = map;
+    if (h->magic != LOCATE_DB_MAGIC || h->version != LOCATE_DB_VERSION ||
+        h->size != db->size || h->blocks_off != sizeof(*h) ||
+        h->nblocks != (h->npaths + LOCATE_DB_BLOCK - 1) / LOCATE_DB_BLOCK ||
+        h->data_off != h->blocks_off + (h->nblocks + 1) * sizeof(uint64_t) ||
+        h->tris_off < h->data_off || h->tris_off % 8 != 0 ||
+        h->post_off != h->tris_off + h->ntris * sizeof(locate_db_tri_t) ||
+        h->post_off > h->size) {
+        munmap(map, db->size);
+        db->map = NULL;
+        fprintf(stderr, "locate: %s: not a locate database\n", path);
+        return -1;
+    }
+    db->hdr = h;
+    db->blocks = (const uint64_t *)(db->map + h->blocks_off);
+    db->data = db->map + h->data_off;
+    db->tris = (const locate_db_tri_t *)(db->map + h->tris_off);
+    db->post = db->map + h->post_off;
+    return 0;
+}
+
+static void locate_db_close(locate_db_t *db)
+{
+    if (db->map) {
+        munmap((void *)db->map, db->size);
+    }
+}
+
+/*
+ * Add the trigrams of pattern's literal parts to tris (room for len
+ * of them): runs of plain characters between the wildcards, with
+ * bracket expressions and escaped characters left out
+ */
+static size_t locate_pattern_trigrams(const locate_pattern_t *p, uint32_t *tris)
+{
+    const char *s = p->text;
+    const char *run = s;
+    size_t n = 0;
+
+    for (;;) {
+        const char *end = s;
+
+        if (p->glob && (*s == '*' || *s == '?' || *s == '[' || *s == '\\')) {
+            /* The run ends here */
+        } else if (*s) {
+            s++;
+            continue;
+        }
+
+        for (; run + 3 <= end; run++) {
+            tris[n++] = locate_db_trigram(run);
+        }
+        if (!*s) {
+            break;
+        }
+        if (*s == '[') {
+            s++;
+            if (*s == '!' || *s == '^') {
+                s++;
+            }
+            if (*s == ']') {
+                s++;
+            }
+            while (*s && *s != ']') {
+                s++;
+            }
+            if (*s) {
+                s++;
+            }
+        } else if (*s == '\\' && s[1]) {
+            s += 2;
+        } else {
+            s++;
+        }
+        run = s;
+    }
+    return n;
+}
+
+static int locate_tri_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = ((const locate_db_tri_t *)b)->tri;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Decode a trigram's posting list into out (room for its count)
+ * Returns: the number of blocks, or -1 if the list is damaged
+ */
+static long locate_postings(const locate_db_t *db, const locate_db_tri_t *t, uint32_t *out)
+{
+    const unsigned char *p = db->post + t->off;
+    const unsigned char *end = db->map + db->size;
+    uint64_t block = 0;
+    uint32_t i;
+
+    if (t->off > db->hdr->size - db->hdr->post_off || t->count > db->hdr->nblocks) {
+        return -1;
+    }
+    for (i = 0; i < t->count; i++) {
+        uint64_t delta;
+
+        if (locate_db_varint(&p, end, &delta) != 0) {
+            return -1;
+        }
+        block += delta;
+        if (block >= db->hdr->nblocks) {
+            return -1;
+        }
+        out[i] = (uint32_t)block;
+    }
+    return (long)t->count;
+}
+
+/*
+ * Mark in cand the blocks that can hold a match for p: those on the
+ * posting lists of all its trigrams, or every block if it has none
+ * Returns: 0, or -1 if out of memory or the index is damaged
+ */
+static int locate_candidates(const locate_db_t *db, const locate_pattern_t *p,
+                             unsigned char *cand)
+{
+    uint32_t *tris;
+    const locate_db_tri_t **lists;
+    locate_blocks_t have = { NULL, 0 };
+    uint32_t *next = NULL;
+    size_t ntris;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    tris = malloc((p->len + 1) * sizeof(uint32_t));
+    lists = malloc((p->len + 1) * sizeof(*lists));
+    if (!tris || !lists) {
+        goto out;
+    }
+
+    ntris = locate_pattern_trigrams(p, tris);
+    if (ntris == 0) {
+        memset(cand, 1, (size_t)db->hdr->nblocks);
+        ret = 0;
+        goto out;
+    }
+
+    /* A trigram no path has rules the pattern out */
+    for (i = 0; i < ntris; i++) {
+        lists[i] = bsearch(&tris[i], db->tris, (size_t)db->hdr->ntris,
+                           sizeof(locate_db_tri_t), locate_tri_cmp);
+        if (!lists[i]) {
+            ret = 0;
+            goto out;
+        }
+    }
+
+    /* Start from the shortest list and keep what every other one has */
+    for (i = 1, j = 0; i < ntris; i++) {
+        if (lists[i]->count < lists[j]->count) {
+            j = i;
+        }
+    }
+    have.v = malloc(((size_t)lists[j]->count + 1) * sizeof(uint32_t));
+    next = malloc(((size_t)db->hdr->nblocks + 1) * sizeof(uint32_t));
+    if (!have.v || !next) {
+        goto out;
+    }
+    if (locate_postings(db, lists[j], have.v) < 0) {
+        goto out;
+    }
+    have.len = lists[j]->count;
+
+    for (i = 0; i < ntris && have.len > 0; i++) {
+        size_t a = 0;
+        size_t b = 0;
+        size_t k = 0;
+        long n;
+
+        if (lists[i] == lists[j]) {
+            continue;
+        }
+        n = locate_postings(db, lists[i], next);
+        if (n < 0) {
+            goto out;
+        }
+        while (a < have.len && b < (size_t)n) {
+            if (have.v[a] < next[b]) {
+                a++;
+            } else if (have.v[a] > next[b]) {
+                b++;
+            } else {
+                have.v[k++] = have.v[a++];
+                b++;
+            }
+        }
+        have.len = k;
+    }
+
+    for (i = 0; i < have.len; i++) {
+        cand[have.v[i]] = 1;
+    }
+    ret = 0;
+
+out:
+    free(tris);
+    free(lists);
+    free(have.v);
+    free(next);
+    return ret;
+}
+
+static int locate_match(const locate_pattern_t *pats, int npats, const char *path,
+                        size_t len, int basename)
+{
+    const char *name = path;
+    size_t nlen = len;
+
+    if (basename) {
+        const char *slash = mem_rchr(path, '/', len);
+
+        /* "/" is its own base name */
+        if (slash && slash[1]) {
+            name = slash + 1;
+            nlen = len - (size_t)(name - path);
+        }
+    }
+
+    for (int i = 0; i < npats; i++) {
+        if (pats[i].glob ? fnmatch(pats[i].text, name, 0) == 0
+                         : memmem(name, nlen, pats[i].text, pats[i].len) != NULL) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Decode the paths of one block, passing those that match to out
+ * Returns: 0 to go on, 1 once limit is reached, -1 if the block is damaged
+ */
+static int locate_block(const locate_db_t *db, uint64_t b, const locate_pattern_t *pats,
+                        int npats, int basename, pb_out_t *out, unsigned long *found,
+                        unsigned long limit, char **buf, size_t *cap)
+{
+    const unsigned char *p;
+    const unsigned char *end;
+    size_t len = 0;
+
+    if (db->blocks[b] > db->blocks[b + 1] ||
+        db->blocks[b + 1] > db->hdr->tris_off - db->hdr->data_off) {
+        return -1;
+    }
+    p = db->data + db->blocks[b];
+    end = db->data + db->blocks[b + 1];
+
+    while (p < end) {
+        uint64_t shared;
+        uint64_t more;
+
+        if (locate_db_varint(&p, end, &shared) != 0 ||
+            locate_db_varint(&p, end, &more) != 0 ||
+            shared > len || more > (uint64_t)(end - p)) {
+            return -1;
+        }
+        if (shared + more + 1 > *cap) {
+            size_t ncap = (size_t)(shared + more + 1) * 2;
+            char *nbuf = realloc(*buf, ncap);
+
+            if (!nbuf) {
+                return -1;
+            }
+            *buf = nbuf;
+            *cap = ncap;
+        }
+        memcpy(*buf + shared, p, (size_t)more);
+        p += more;
+        len = (size_t)(shared + more);
+        (*buf)[len] = '\0';
+
+        if (locate_match(pats, npats, *buf, len, basename)) {
+            if (out) {
+                pb_out_write(out, *buf, len);
+                pb_out_putc(out, '\n');
+            }
+            if (++*found == limit) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* ===== SECTION 3: RUN FUNCTION ===== */
+
+int locate_run(int argc, char **argv)
+{
+    int nerrors;
+    const char *path = LOCATE_DB_DEFAULT;
+    locate_db_t db;
+    locate_pattern_t *pats = NULL;
+    unsigned char *cand = NULL;
+    unsigned long found = 0;
+    unsigned long limit = 0;
+    char *buf = NULL;
+    size_t cap = 0;
+    pb_out_t out;
+    int count;
+    int npats;
+    int ret = EXIT_ERROR;
+    int r = 0;
+    uint64_t b;
+    int i;
+
+    build_locate_argtable();
+    nerrors = cmd_arg_parse(argc, argv, locate_argtable);
+
+    /* Handle --help */
+    if (locate_help->count > 0) {
+        locate_print_usage(cmd_stdout());
+        return EXIT_OK;
+    }
+
+    /* Handle parsing errors */
+    if (nerrors > 0) {
+        arg_print_errors(stderr, locate_end, "locate");
+        fprintf(stderr, "Try 'locate --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
+    /* ===== ACTUAL COMMAND LOGIC ===== */
+
+    if (locate_database->count > 0) {
+        path = locate_database->filename[0];
+    }
+    if (locate_limit->count > 0) {
+        if (locate_limit->ival[0] < 0) {
+            fprintf(stderr, "locate: invalid limit: '%d'\n", locate_limit->ival[0]);
+            return EXIT_ERROR;
+        }
+        limit = (unsigned long)locate_limit->ival[0];
+    }
+    count = locate_count->count > 0;
+
+    if (locate_db_open(&db, path) != 0) {
+        return EXIT_ERROR;
+    }
+
+    npats = locate_patterns->count;
+    pats = malloc((size_t)npats * sizeof(locate_pattern_t));
+    cand = calloc((size_t)db.hdr->nblocks + 1, 1);
+    if (!pats || !cand || pb_out_init(&out, cmd_stdout()) != 0) {
+        perror("locate");
+        goto done;
+    }
+
+    for (i = 0; i < npats; i++) {
+        pats[i].text = locate_patterns->sval[i];
+        pats[i].len = strlen(pats[i].text);
+        pats[i].glob = strpbrk(pats[i].text, "*?[\\") != NULL;
+        if (locate_candidates(&db, &pats[i], cand) != 0) {
+            r = -1;
+            break;
+        }
+    }
+
+    /* Blocks in order, so the output is sorted */
+    for (b = 0; r == 0 && b < db.hdr->nblocks && (limit == 0 || found < limit); b++) {
+        if (cand[b]) {
+            r = locate_block(&db, b, pats, npats, locate_basename->count > 0,
+                             count ? NULL : &out, &found, limit, &buf, &cap);
+        }
+    }
+
+    if (count) {
+        pb_out_uint(&out, found, 0);
+        pb_out_putc(&out, '\n');
+    }
+    if (pb_out_close(&out) != 0 && errno != EPIPE) {
+        perror("locate: write error");
+    } else if (r < 0) {
+        fprintf(stderr, "locate: %s: damaged database\n", path);
+    } else if (found > 0) {
+        ret = EXIT_OK;
+    }
+
+done:
+    free(buf);
+    free(cand);
+    free(pats);
+    locate_db_close(&db);
+    return ret;
+}
+
+/* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
+
+void locate_print_usage(FILE *out)
+{
+    build_locate_argtable();
+
+    fprintf(out, "Usage: locate ");
+    arg_print_syntax(out, locate_argtable, "\n");
+    fprintf(out, "Print the paths in the updatedb database that match any PATTERN.\n");
+    fprintf(out, "A PATTERN without wildcards matches anywhere in a path; with them, it\n");
+    fprintf(out, "must match the whole path (or with -b, the base name).\n\n");
+    fprintf(out, "Options:\n");
+    arg_print_glossary(out, locate_argtable, "  %-25s %s\n");
+    fprintf(out, "\n");
+    fprintf(out, "Examples:\n");
+    fprintf(out, "  locate stdio.h           Paths containing stdio.h\n");
+    fprintf(out, "  locate -b '*.conf'       Paths whose base name ends in .conf\n");
+    fprintf(out, "  locate -c /srv/          How many paths are under /srv\n");
+}
+
+/* ===== SECTION 5: COMMAND SPECIFICATION ===== */
+
+cmd_spec_t cmd_locate_spec = {
+    .name = "locate",
+    .summary = "find files by name in the updatedb database",
+    .long_help = "Print the paths in the updatedb database that match any PATTERN.",
+    .run = locate_run,
+    .print_usage = locate_print_usage,
+    .flags = CMD_FLAG_STREAMS
+};
+
+/* ===== SECTION 6: REGISTRATION FUNCTION ===== */
+
+void register_locate_command(void)
+{
+    register_command(&cmd_locate_spec);
+}
+
+/* ===== SECTION 7: STANDALONE MAIN ===== */
+
+#ifndef BUILTIN_ONLY
+int main(int argc, char **argv)
+{
+    return cmd_locate_spec.run(argc, argv);
+}
+#endif
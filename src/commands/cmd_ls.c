@@ -9,11 +9,42 @@
  *   -a, --all           Do not ignore entries starting with .
  *   -l, --long          Use a long listing format
  *   -h, --human         With -l, print human readable sizes
+ *   -t                  Sort by modification time, newest first
+ *   -S                  Sort by file size, largest first
+ *   -R, --recursive     List subdirectories recursively
+ *   -C                  List in columns (the default on a terminal)
+ *   -1                  List one entry per line
  *   --help              Display help message
+ *
+ * A directory's entries are collected (names in an arena), stat'ed
+ * relative to the open directory only if -l, -t or -S needs it, sorted
+ * and then printed. Where statx() exists it is asked for just the
+ * fields in use. Owner and group names are looked up once per id per
+ * invocation, not once per file: with NSS on LDAP each lookup can be a
+ * network round trip.
+ *
+ * -R goes depth first through the sorted listing, opening each
+ * subdirectory relative to its parent's descriptor; each depth has its
+ * own name arena, so a directory's names stay put while its
+ * subdirectories are listed. Columns are laid out as wide as the
+ * terminal (one TIOCGWINSZ per invocation) allows, every candidate
+ * column count being tried in the same pass over the names' widths.
+ *
+ * Output is built in a pb_out buffer and written in large pieces, not
+ * with a stdio call per field.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* statx() */
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <dirent.h>
 #include <pwd.h>
@@ -23,12 +54,12 @@
 #include "cmd_spec.h"
 #include "picobox.h"
 #include "utils.h"
+#include "arena.h"
+#include "pb_out.h"
 
 /* Forward declarations */
 int ls_run(int argc, char **argv);
 void ls_print_usage(FILE *out);
-static void print_long_format(const char *path, const char *name, int human);
-static int ls_dir(const char *path, int show_all, int long_format, int human);
 
 /* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
 
@@ -36,18 +67,32 @@ static struct arg_lit *ls_help;
 static struct arg_lit *ls_all;
 static struct arg_lit *ls_long;
 static struct arg_lit *ls_human;
+static struct arg_lit *ls_by_time;
+static struct arg_lit *ls_by_size;
+static struct arg_lit *ls_recursive;
+static struct arg_lit *ls_columns;
+static struct arg_lit *ls_one;
 static struct arg_file *ls_paths;
 static struct arg_end *ls_end;
-static void *ls_argtable[7];
+static void *ls_argtable[12];
 
 /* ===== SECTION 2: ARGTABLE BUILDER ===== */
 
 static void build_ls_argtable(void)
 {
+    if (ls_argtable[0] != NULL) {
+        return;
+    }
+
     ls_help = arg_lit0(NULL, "help", "display this help and exit");
     ls_all = arg_lit0("a", "all", "do not ignore entries starting with .");
     ls_long = arg_lit0("l", "long", "use a long listing format");
     ls_human = arg_lit0("h", "human-readable", "with -l, print human readable sizes");
+    ls_by_time = arg_lit0("t", NULL, "sort by modification time, newest first");
+    ls_by_size = arg_lit0("S", NULL, "sort by file size, largest first");
+    ls_recursive = arg_lit0("R", "recursive", "list subdirectories recursively");
+    ls_columns = arg_lit0("C", NULL, "list entries in columns");
+    ls_one = arg_lit0("1", NULL, "list one entry per line");
     ls_paths = arg_filen(NULL, NULL, "FILE", 0, 100, "files/directories to list");
     ls_end = arg_end(20);
 
@@ -55,92 +100,578 @@ static void build_ls_argtable(void)
     ls_argtable[1] = ls_all;
     ls_argtable[2] = ls_long;
     ls_argtable[3] = ls_human;
-    ls_argtable[4] = ls_paths;
-    ls_argtable[5] = ls_end;
-    ls_argtable[6] = NULL;
+    ls_argtable[4] = ls_by_time;
+    ls_argtable[5] = ls_by_size;
+    ls_argtable[6] = ls_recursive;
+    ls_argtable[7] = ls_columns;
+    ls_argtable[8] = ls_one;
+    ls_argtable[9] = ls_paths;
+    ls_argtable[10] = ls_end;
+    ls_argtable[11] = NULL;
 }
 
 /* ===== HELPER FUNCTIONS ===== */
 
-static void print_long_format(const char *path, const char *name, int human)
+enum {
+    LS_SORT_NAME,
+    LS_SORT_TIME,
+    LS_SORT_SIZE
+};
+
+/* What an entry has to be stat'ed for (statx() mask bits where it exists) */
+#ifdef STATX_BASIC_STATS
+#define LS_WANT_TYPE STATX_TYPE
+#define LS_WANT_TIME STATX_MTIME
+#define LS_WANT_SIZE STATX_SIZE
+#define LS_WANT_LONG (STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_UID | STATX_GID | \
+                      STATX_SIZE | STATX_MTIME)
+#else
+#define LS_WANT_TYPE 0x1
+#define LS_WANT_TIME 0x2
+#define LS_WANT_SIZE 0x4
+#define LS_WANT_LONG 0x7
+#endif
+
+typedef struct ls_entry {
+    const char *name;         /* In the arena for its depth */
+    size_t width;             /* Columns name takes (with -C) */
+    int is_dir;               /* 1, 0, or -1 if not known yet */
+    mode_t mode;
+    nlink_t nlink;
+    uid_t uid;
+    gid_t gid;
+    off_t size;
+    time_t mtime;
+    long mtime_ns;
+} ls_entry_t;
+
+/* Open-addressed id -> name table (uids or gids) */
+typedef struct ls_id_cache {
+    struct ls_id_slot {
+        unsigned long id;
+        char *name;           /* NULL: free slot */
+    } *slots;
+    size_t used;
+    size_t cap;               /* Power of two, or 0 */
+} ls_id_cache_t;
+
+typedef struct ls_ctx {
+    pb_out_t *out;
+    int show_all;
+    int long_format;
+    int human;
+    int sort;
+    int recursive;
+    int headers;              /* Print "DIR:" before each directory */
+    int printed;              /* Something is out: separate by a blank line */
+    size_t width;             /* Terminal width for columns, 0: one per line */
+    unsigned int want;        /* LS_WANT_* */
+    int no_statx;             /* statx() said ENOSYS: use fstatat() */
+    arena_t **arenas;         /* Names, one arena per depth */
+    size_t narenas;
+    ls_entry_t *entries;      /* Listings being printed, outermost first */
+    size_t count;
+    size_t cap;
+    size_t *col_widths;       /* Column layout scratch for up to max_cols */
+    size_t *line_lens;
+    size_t max_cols;
+    ls_id_cache_t users;
+    ls_id_cache_t groups;
+} ls_ctx_t;
+
+static int ls_id_insert(ls_id_cache_t *c, unsigned long id, char *name)
+{
+    size_t i;
+
+    if ((c->used + 1) * 2 > c->cap) {
+        size_t cap = c->cap ? c->cap * 2 : 16;
+        struct ls_id_slot *slots = calloc(cap, sizeof(*slots));
+
+        if (!slots) {
+            return -1;
+        }
+        for (i = 0; i < c->cap; i++) {
+            if (c->slots[i].name) {
+                size_t j = (c->slots[i].id * 2654435761u) & (cap - 1);
+
+                while (slots[j].name) {
+                    j = (j + 1) & (cap - 1);
+                }
+                slots[j] = c->slots[i];
+            }
+        }
+        free(c->slots);
+        c->slots = slots;
+        c->cap = cap;
+    }
+
+    i = (id * 2654435761u) & (c->cap - 1);
+    while (c->slots[i].name) {
+        i = (i + 1) & (c->cap - 1);
+    }
+    c->slots[i].id = id;
+    c->slots[i].name = name;
+    c->used++;
+    return 0;
+}
+
+/*
+ * Name for a uid (group == 0) or gid, "unknown" if it has none
+ * Returns: the cached name
+ */
+static const char *ls_id_name(ls_id_cache_t *c, unsigned long id, int group)
+{
+    const char *found = NULL;
+    char *name;
+    size_t i;
+
+    if (c->cap > 0) {
+        for (i = (id * 2654435761u) & (c->cap - 1); c->slots[i].name;
+             i = (i + 1) & (c->cap - 1)) {
+            if (c->slots[i].id == id) {
+                return c->slots[i].name;
+            }
+        }
+    }
+
+    if (group) {
+        struct group *gr = getgrgid((gid_t)id);
+
+        found = gr ? gr->gr_name : NULL;
+    } else {
+        struct passwd *pw = getpwuid((uid_t)id);
+
+        found = pw ? pw->pw_name : NULL;
+    }
+
+    name = strdup(found ? found : "unknown");
+    if (!name) {
+        return "unknown";
+    }
+    if (ls_id_insert(c, id, name) != 0) {
+        free(name);
+        return found ? found : "unknown";
+    }
+    return name;
+}
+
+static void ls_id_free(ls_id_cache_t *c)
+{
+    for (size_t i = 0; i < c->cap; i++) {
+        free(c->slots[i].name);
+    }
+    free(c->slots);
+}
+
+/*
+ * Stat name in dirfd for the fields in want, without following a symlink
+ * Returns: 0, or -1 with errno set
+ */
+static int ls_stat(ls_ctx_t *ctx, int dirfd, const char *name, unsigned int want,
+                   ls_entry_t *e)
 {
     struct stat st;
-    char full_path[4096];
-    char time_buf[64];
-    char size_buf[32];
-    struct passwd *pw;
-    struct group *gr;
 
-    snprintf(full_path, sizeof(full_path), "%s/%s", path, name);
+#ifdef STATX_BASIC_STATS
+    if (!ctx->no_statx) {
+        struct statx sx;
+
+        if (statx(dirfd, name, AT_SYMLINK_NOFOLLOW, want, &sx) == 0) {
+            e->mode = sx.stx_mode;
+            e->nlink = sx.stx_nlink;
+            e->uid = sx.stx_uid;
+            e->gid = sx.stx_gid;
+            e->size = (off_t)sx.stx_size;
+            e->mtime = (time_t)sx.stx_mtime.tv_sec;
+            e->mtime_ns = (long)sx.stx_mtime.tv_nsec;
+            return 0;
+        }
+        if (errno != ENOSYS) {
+            return -1;
+        }
+        ctx->no_statx = 1;
+    }
+#else
+    (void)want;
+#endif
 
-    if (lstat(full_path, &st) != 0) {
-        perror(name);
-        return;
+    if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        return -1;
+    }
+    e->mode = st.st_mode;
+    e->nlink = st.st_nlink;
+    e->uid = st.st_uid;
+    e->gid = st.st_gid;
+    e->size = st.st_size;
+    e->mtime = st.st_mtime;
+#if defined(__APPLE__)
+    e->mtime_ns = st.st_mtimespec.tv_nsec;
+#else
+    e->mtime_ns = st.st_mtim.tv_nsec;
+#endif
+    return 0;
+}
+
+/* Name arena for a depth, created on first use */
+static arena_t *ls_arena(ls_ctx_t *ctx, size_t depth)
+{
+    if (depth >= ctx->narenas) {
+        arena_t **bigger = realloc(ctx->arenas, (depth + 1) * sizeof(arena_t *));
+
+        if (!bigger) {
+            return NULL;
+        }
+        ctx->arenas = bigger;
+        while (ctx->narenas <= depth) {
+            ctx->arenas[ctx->narenas++] = NULL;
+        }
+    }
+    if (!ctx->arenas[depth]) {
+        ctx->arenas[depth] = arena_create(depth == 0 ? 64 * 1024 : 16 * 1024);
+    }
+    return ctx->arenas[depth];
+}
+
+/* Display width of a UTF-8 name: one column per character */
+static size_t ls_width(const char *name)
+{
+    size_t w = 0;
+
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        w += (*p & 0xC0) != 0x80;
+    }
+    return w;
+}
+
+/*
+ * Add name (relative to dirfd) to the listing, stat'ed if needed;
+ * is_dir as far as readdir() knows (-1: not known)
+ * Returns: 0, or -1 if it was reported and left out
+ */
+static int ls_add(ls_ctx_t *ctx, arena_t *names, int dirfd, const char *name, int is_dir)
+{
+    ls_entry_t *e;
+
+    if (ctx->count == ctx->cap) {
+        size_t cap = ctx->cap ? ctx->cap * 2 : 64;
+        ls_entry_t *bigger = realloc(ctx->entries, cap * sizeof(ls_entry_t));
+
+        if (!bigger) {
+            perror("ls");
+            return -1;
+        }
+        ctx->entries = bigger;
+        ctx->cap = cap;
+    }
+
+    e = &ctx->entries[ctx->count];
+    memset(e, 0, sizeof(*e));
+    e->is_dir = is_dir;
+
+    /* -R has to know which entries are directories */
+    if (ctx->want || (ctx->recursive && is_dir < 0)) {
+        if (ls_stat(ctx, dirfd, name, ctx->want | LS_WANT_TYPE, e) != 0) {
+            fprintf(stderr, "ls: %s: %s\n", name, strerror(errno));
+            return -1;
+        }
+        e->is_dir = S_ISDIR(e->mode) != 0;
+    }
+    if (ctx->width > 0) {
+        e->width = ls_width(name);
     }
+    e->name = names ? arena_strdup(names, name) : NULL;
+    if (!e->name) {
+        perror("ls");
+        return -1;
+    }
+    ctx->count++;
+    return 0;
+}
+
+static int ls_cmp_name(const void *a, const void *b)
+{
+    return strcmp(((const ls_entry_t *)a)->name, ((const ls_entry_t *)b)->name);
+}
+
+/* Newest first, then by name */
+static int ls_cmp_time(const void *a, const void *b)
+{
+    const ls_entry_t *x = a;
+    const ls_entry_t *y = b;
+
+    if (x->mtime != y->mtime) {
+        return x->mtime < y->mtime ? 1 : -1;
+    }
+    if (x->mtime_ns != y->mtime_ns) {
+        return x->mtime_ns < y->mtime_ns ? 1 : -1;
+    }
+    return strcmp(x->name, y->name);
+}
+
+/* Largest first, then by name */
+static int ls_cmp_size(const void *a, const void *b)
+{
+    const ls_entry_t *x = a;
+    const ls_entry_t *y = b;
+
+    if (x->size != y->size) {
+        return x->size < y->size ? 1 : -1;
+    }
+    return strcmp(x->name, y->name);
+}
+
+static void print_long_format(ls_ctx_t *ctx, const ls_entry_t *e)
+{
+    pb_out_t *out = ctx->out;
+    char time_buf[64];
+    char mode[10];
 
     /* File type and permissions */
-    printf("%c", S_ISDIR(st.st_mode) ? 'd' : S_ISLNK(st.st_mode) ? 'l' : '-');
-    printf("%c", (st.st_mode & S_IRUSR) ? 'r' : '-');
-    printf("%c", (st.st_mode & S_IWUSR) ? 'w' : '-');
-    printf("%c", (st.st_mode & S_IXUSR) ? 'x' : '-');
-    printf("%c", (st.st_mode & S_IRGRP) ? 'r' : '-');
-    printf("%c", (st.st_mode & S_IWGRP) ? 'w' : '-');
-    printf("%c", (st.st_mode & S_IXGRP) ? 'x' : '-');
-    printf("%c", (st.st_mode & S_IROTH) ? 'r' : '-');
-    printf("%c", (st.st_mode & S_IWOTH) ? 'w' : '-');
-    printf("%c", (st.st_mode & S_IXOTH) ? 'x' : '-');
+    mode[0] = S_ISDIR(e->mode) ? 'd' : S_ISLNK(e->mode) ? 'l' : '-';
+    mode[1] = (e->mode & S_IRUSR) ? 'r' : '-';
+    mode[2] = (e->mode & S_IWUSR) ? 'w' : '-';
+    mode[3] = (e->mode & S_IXUSR) ? 'x' : '-';
+    mode[4] = (e->mode & S_IRGRP) ? 'r' : '-';
+    mode[5] = (e->mode & S_IWGRP) ? 'w' : '-';
+    mode[6] = (e->mode & S_IXGRP) ? 'x' : '-';
+    mode[7] = (e->mode & S_IROTH) ? 'r' : '-';
+    mode[8] = (e->mode & S_IWOTH) ? 'w' : '-';
+    mode[9] = (e->mode & S_IXOTH) ? 'x' : '-';
+    pb_out_write(out, mode, 10);
 
     /* Number of links */
-    printf(" %3ld", (long)st.st_nlink);
+    pb_out_putc(out, ' ');
+    pb_out_uint(out, (uintmax_t)e->nlink, 3);
 
     /* Owner and group */
-    pw = getpwuid(st.st_uid);
-    gr = getgrgid(st.st_gid);
-    printf(" %-8s", pw ? pw->pw_name : "unknown");
-    printf(" %-8s", gr ? gr->gr_name : "unknown");
+    pb_out_putc(out, ' ');
+    pb_out_pad(out, ls_id_name(&ctx->users, (unsigned long)e->uid, 0), -8);
+    pb_out_putc(out, ' ');
+    pb_out_pad(out, ls_id_name(&ctx->groups, (unsigned long)e->gid, 1), -8);
 
     /* Size */
-    if (human) {
-        format_size(st.st_size, size_buf, sizeof(size_buf));
-        printf(" %8s", size_buf);
+    pb_out_putc(out, ' ');
+    if (ctx->human) {
+        pb_out_size(out, e->size, 8);
     } else {
-        printf(" %8ld", (long)st.st_size);
+        pb_out_int(out, (intmax_t)e->size, 8);
     }
 
     /* Modification time */
-    format_time(st.st_mtime, time_buf, sizeof(time_buf));
-    printf(" %s", time_buf);
+    format_time(e->mtime, time_buf, sizeof(time_buf));
+    pb_out_putc(out, ' ');
+    pb_out_str(out, time_buf);
 
     /* Name */
-    printf(" %s\n", name);
+    pb_out_putc(out, ' ');
+    pb_out_str(out, e->name);
+    pb_out_putc(out, '\n');
+}
+
+/*
+ * Print v[0..n) in as many columns as fit in ctx->width, filled top
+ * to bottom, then left to right
+ */
+static void ls_print_columns(ls_ctx_t *ctx, const ls_entry_t *v, size_t n)
+{
+    size_t max_cols = ctx->width / 3 > 0 ? ctx->width / 3 : 1;
+    size_t cols = 1;
+    size_t rows;
+
+    if (max_cols > n) {
+        max_cols = n;
+    }
+    if (max_cols > ctx->max_cols) {
+        size_t *widths = realloc(ctx->col_widths, max_cols * (max_cols + 1) / 2 * sizeof(size_t));
+        size_t *lens = widths ? realloc(ctx->line_lens, max_cols * sizeof(size_t)) : NULL;
+
+        if (widths) {
+            ctx->col_widths = widths;
+        }
+        if (!lens) {
+            max_cols = 1;
+        } else {
+            ctx->line_lens = lens;
+            ctx->max_cols = max_cols;
+        }
+    }
+    if (max_cols > 1) {
+        memset(ctx->col_widths, 0, max_cols * (max_cols + 1) / 2 * sizeof(size_t));
+        memset(ctx->line_lens, 0, max_cols * sizeof(size_t));
+    }
+
+    /*
+     * One pass for every column count c at once: line_lens[c - 1] is the
+     * width of a line so far, the widest of c columns of
+     * ceil(n / c) names, 2 spaces apart; c is dropped (its line length
+     * pushed past the terminal) as soon as it no longer fits
+     */
+    for (size_t i = 0; i < n && max_cols > 1; i++) {
+        for (size_t c = 2; c <= max_cols; c++) {
+            size_t *widths = ctx->col_widths + c * (c - 1) / 2;
+            size_t col = i / ((n + c - 1) / c);
+            size_t need = v[i].width + (col + 1 < c ? 2 : 0);
+
+            if (ctx->line_lens[c - 1] >= ctx->width) {
+                continue;
+            }
+            if (need > widths[col]) {
+                ctx->line_lens[c - 1] += need - widths[col];
+                widths[col] = need;
+            }
+        }
+    }
+    for (size_t c = max_cols; c > 1; c--) {
+        if (ctx->line_lens[c - 1] < ctx->width) {
+            cols = c;
+            break;
+        }
+    }
+
+    rows = (n + cols - 1) / cols;
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t col = 0; col < cols; col++) {
+            size_t i = col * rows + r;
+
+            if (i >= n) {
+                break;
+            }
+            pb_out_str(ctx->out, v[i].name);
+            if (col + 1 < cols && i + rows < n) {
+                size_t w = ctx->col_widths[cols * (cols - 1) / 2 + col];
+
+                pb_out_pad(ctx->out, "", (int)(w - v[i].width));
+            }
+        }
+        pb_out_putc(ctx->out, '\n');
+    }
 }
 
-static int ls_dir(const char *path, int show_all, int long_format, int human)
+/* Sort and print the entries collected from base on */
+static void ls_print(ls_ctx_t *ctx, size_t base)
 {
-    DIR *dir;
+    ls_entry_t *v = ctx->entries + base;
+    size_t n = ctx->count - base;
+
+    if (ctx->sort == LS_SORT_TIME) {
+        qsort(v, n, sizeof(ls_entry_t), ls_cmp_time);
+    } else if (ctx->sort == LS_SORT_SIZE) {
+        qsort(v, n, sizeof(ls_entry_t), ls_cmp_size);
+    } else {
+        qsort(v, n, sizeof(ls_entry_t), ls_cmp_name);
+    }
+
+    if (ctx->width > 0) {
+        ls_print_columns(ctx, v, n);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (ctx->long_format) {
+            print_long_format(ctx, &v[i]);
+        } else {
+            pb_out_str(ctx->out, v[i].name);
+            pb_out_putc(ctx->out, '\n');
+        }
+    }
+}
+
+/*
+ * List directory name in parent_fd, path being how to show it, and
+ * with -R the directories in it
+ */
+static int ls_dir(ls_ctx_t *ctx, int parent_fd, const char *name, const char *path, size_t depth)
+{
+    arena_t *names = ls_arena(ctx, depth);
+    size_t base = ctx->count;
+    int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | (depth ? O_NOFOLLOW : 0));
+    DIR *dir = fd >= 0 ? fdopendir(fd) : NULL;
     struct dirent *entry;
+    int ret = EXIT_OK;
 
-    dir = opendir(path);
-    if (!dir) {
+    if (!dir || !names) {
         perror(path);
+        if (dir) {
+            closedir(dir);
+        } else if (fd >= 0) {
+            close(fd);
+        }
         return EXIT_ERROR;
     }
 
+    if (ctx->headers) {
+        if (ctx->printed) {
+            pb_out_putc(ctx->out, '\n');
+        }
+        pb_out_str(ctx->out, path);
+        pb_out_str(ctx->out, ":\n");
+    }
+    ctx->printed = 1;
+
     while ((entry = readdir(dir)) != NULL) {
+        int is_dir = -1;
+
         /* Skip hidden files unless -a */
-        if (!show_all && entry->d_name[0] == '.') {
+        if (!ctx->show_all && entry->d_name[0] == '.') {
             continue;
         }
+#ifdef DT_DIR
+        if (entry->d_type != DT_UNKNOWN) {
+            is_dir = entry->d_type == DT_DIR;
+        }
+#endif
+        if (ls_add(ctx, names, fd, entry->d_name, is_dir) != 0) {
+            ret = EXIT_ERROR;
+        }
+    }
+    ls_print(ctx, base);
 
-        if (long_format) {
-            print_long_format(path, entry->d_name, human);
-        } else {
-            printf("%s\n", entry->d_name);
+    /* Entries may move as subdirectories add theirs: go by index */
+    for (size_t i = base; ctx->recursive && i < ctx->count; i++) {
+        const char *sub = ctx->entries[i].name;
+        char *sub_path;
+
+        if (ctx->entries[i].is_dir != 1 || strcmp(sub, ".") == 0 || strcmp(sub, "..") == 0) {
+            continue;
+        }
+        sub_path = path_join(path, sub);
+        if (!sub_path) {
+            perror("ls");
+            ret = EXIT_ERROR;
+            break;
         }
+        if (ls_dir(ctx, fd, sub, sub_path, depth + 1) != EXIT_OK) {
+            ret = EXIT_ERROR;
+        }
+        free(sub_path);
     }
 
+    ctx->count = base;
+    arena_reset(names);
     closedir(dir);
-    return EXIT_OK;
+    return ret;
+}
+
+/*
+ * Width to lay columns out in: the terminal's for -C on a terminal or
+ * by default there, else $COLUMNS or 80 for -C; 0 for one per line
+ */
+static size_t ls_term_width(int fd, int columns, int one)
+{
+    struct winsize ws;
+    const char *env;
+    int tty = fd >= 0 && isatty(fd);
+
+    if (one || (!columns && !tty)) {
+        return 0;
+    }
+    if (tty && ioctl(fd, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) {
+        return ws.ws_col;
+    }
+    env = getenv("COLUMNS");
+    if (env && atoi(env) > 0) {
+        return (size_t)atoi(env);
+    }
+    return 80;
 }
 
 /* ===== SECTION 3: RUN FUNCTION ===== */
@@ -148,11 +679,10 @@ static int ls_dir(const char *path, int show_all, int long_format, int human)
 int ls_run(int argc, char **argv)
 {
     int nerrors;
-    int show_all = 0;
-    int long_format = 0;
-    int human = 0;
     int i;
     int ret = EXIT_OK;
+    pb_out_t out;
+    ls_ctx_t ctx;
 
     build_ls_argtable();
     nerrors = arg_parse(argc, argv, ls_argtable);
@@ -160,7 +690,6 @@ int ls_run(int argc, char **argv)
     /* Handle --help */
     if (ls_help->count > 0) {
         ls_print_usage(stdout);
-        arg_freetable(ls_argtable, 6);
         return EXIT_OK;
     }
 
@@ -168,38 +697,90 @@ int ls_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, ls_end, "ls");
         fprintf(stderr, "Try 'ls --help' for more information.\n");
-        arg_freetable(ls_argtable, 6);
         return EXIT_ERROR;
     }
 
     /* ===== ACTUAL COMMAND LOGIC ===== */
 
     /* Check flags */
-    if (ls_all->count > 0) {
-        show_all = 1;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.out = &out;
+    ctx.show_all = ls_all->count > 0;
+    ctx.long_format = ls_long->count > 0;
+    ctx.human = ls_human->count > 0;
+    if (ls_by_time->count > 0) {
+        ctx.sort = LS_SORT_TIME;
+        ctx.want |= LS_WANT_TIME;
+    } else if (ls_by_size->count > 0) {
+        ctx.sort = LS_SORT_SIZE;
+        ctx.want |= LS_WANT_SIZE;
     }
-    if (ls_long->count > 0) {
-        long_format = 1;
+    if (ctx.long_format) {
+        ctx.want |= LS_WANT_LONG;
     }
-    if (ls_human->count > 0) {
-        human = 1;
+    ctx.recursive = ls_recursive->count > 0;
+    ctx.headers = ctx.recursive || ls_paths->count > 1;
+
+    if (pb_out_init(&out, stdout) != 0 || !ls_arena(&ctx, 0)) {
+        perror("ls");
+        pb_out_close(&out);
+        free(ctx.arenas);
+        return EXIT_ERROR;
+    }
+    if (!ctx.long_format) {
+        ctx.width = ls_term_width(out.fd, ls_columns->count > 0, ls_one->count > 0);
     }
 
     /* If no directory specified, use current directory */
     if (ls_paths->count == 0) {
-        ret = ls_dir(".", show_all, long_format, human);
-        arg_freetable(ls_argtable, 6);
-        return ret;
+        ret = ls_dir(&ctx, AT_FDCWD, ".", ".", 0);
     }
 
-    /* List each directory */
+    /* Operands that are not directories first, sorted together */
     for (i = 0; i < ls_paths->count; i++) {
-        if (ls_dir(ls_paths->filename[i], show_all, long_format, human) != EXIT_OK) {
+        struct stat st;
+
+        if (stat(ls_paths->filename[i], &st) != 0) {
+            if (lstat(ls_paths->filename[i], &st) != 0) {
+                perror(ls_paths->filename[i]);
+                ret = EXIT_ERROR;
+                continue;
+            }
+        }
+        if (!S_ISDIR(st.st_mode) &&
+            ls_add(&ctx, ctx.arenas[0], AT_FDCWD, ls_paths->filename[i], 0) != 0) {
             ret = EXIT_ERROR;
         }
     }
+    if (ctx.count > 0) {
+        ls_print(&ctx, 0);
+        ctx.count = 0;
+        ctx.printed = 1;
+    }
+    arena_reset(ctx.arenas[0]);
+
+    /* Then the contents of each directory */
+    for (i = 0; i < ls_paths->count; i++) {
+        if (is_directory(ls_paths->filename[i]) &&
+            ls_dir(&ctx, AT_FDCWD, ls_paths->filename[i], ls_paths->filename[i], 0) != EXIT_OK) {
+            ret = EXIT_ERROR;
+        }
+    }
+
+    if (pb_out_close(&out) != 0 && errno != EPIPE) {
+        perror("ls: write error");
+        ret = EXIT_ERROR;
+    }
 
-    arg_freetable(ls_argtable, 6);
+    free(ctx.entries);
+    free(ctx.col_widths);
+    free(ctx.line_lens);
+    for (size_t d = 0; d < ctx.narenas; d++) {
+        arena_destroy(ctx.arenas[d]);
+    }
+    free(ctx.arenas);
+    ls_id_free(&ctx.users);
+    ls_id_free(&ctx.groups);
     return ret;
 }
 
@@ -220,9 +801,9 @@ void ls_print_usage(FILE *out)
     fprintf(out, "  ls -a           List all files including hidden\n");
     fprintf(out, "  ls -l           Long format listing\n");
     fprintf(out, "  ls -lh          Long format with human-readable sizes\n");
+    fprintf(out, "  ls -lt          Long format, most recently modified first\n");
+    fprintf(out, "  ls -R src       List src and everything below it\n");
     fprintf(out, "  ls /tmp         List /tmp directory\n");
-
-    arg_freetable(ls_argtable, 6);
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -8,17 +8,31 @@
  * Options:
  *   -p, --parents      Create parent directories as needed
  *   -m, --mode=MODE    Set file mode (permissions)
+ *   --from-file=FILE   Also create the directories listed in FILE
+ *   -0, --null         Names in FILE end with NUL rather than newline
  *   -h, --help         Display help message
+ *
+ * Each directory is made with mkdirat() in the one above it, opened
+ * through a dir_cursor (dir_cursor.h): with a long list the directories
+ * the names share stay open from one to the next, and -p only looks at
+ * the components past that shared prefix. --from-file takes names from
+ * a file or stdin, past the length limit on an argument list.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* mkdirat(), fstatat() and getdelim() */
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
+#include "dir_cursor.h"
 
 /* Forward declarations */
 int mkdir_run(int argc, char **argv);
@@ -29,26 +43,37 @@ void mkdir_print_usage(FILE *out);
 static struct arg_lit *mkdir_help;
 static struct arg_lit *mkdir_parents;
 static struct arg_str *mkdir_mode;
+static struct arg_file *mkdir_from;
+static struct arg_lit *mkdir_null;
 static struct arg_file *mkdir_dirs;
 static struct arg_end *mkdir_end;
-static void *mkdir_argtable[6];
+static void *mkdir_argtable[8];
 
 /* ===== SECTION 2: ARGTABLE BUILDER ===== */
 
 static void build_mkdir_argtable(void)
 {
+    if (mkdir_argtable[0] != NULL) {
+        return;
+    }
+
     mkdir_help = arg_lit0("h", "help", "display this help and exit");
     mkdir_parents = arg_lit0("p", "parents", "make parent directories as needed");
     mkdir_mode = arg_str0("m", "mode", "MODE", "set file mode (as in chmod)");
-    mkdir_dirs = arg_filen(NULL, NULL, "DIRECTORY", 1, 100, "directories to create");
+    mkdir_from = arg_file0(NULL, "from-file", "FILE",
+                           "also create the directories listed in FILE (- for stdin), one per line");
+    mkdir_null = arg_lit0("0", "null", "with --from-file, names end with NUL, not newline");
+    mkdir_dirs = arg_filen(NULL, NULL, "DIRECTORY", 0, 100, "directories to create");
     mkdir_end = arg_end(20);
 
     mkdir_argtable[0] = mkdir_help;
     mkdir_argtable[1] = mkdir_parents;
     mkdir_argtable[2] = mkdir_mode;
-    mkdir_argtable[3] = mkdir_dirs;
-    mkdir_argtable[4] = mkdir_end;
-    mkdir_argtable[5] = NULL;
+    mkdir_argtable[3] = mkdir_from;
+    mkdir_argtable[4] = mkdir_null;
+    mkdir_argtable[5] = mkdir_dirs;
+    mkdir_argtable[6] = mkdir_end;
+    mkdir_argtable[7] = NULL;
 }
 
 /* ===== HELPER FUNCTIONS ===== */
@@ -72,64 +97,74 @@ static int parse_mode(const char *mode_str, mode_t *mode)
 }
 
 /*
- * Create a single directory with given mode
+ * Create one directory in the one its path names, opened through the
+ * cursor; with parents, the ones above are made too, and one already
+ * there is not an error
  */
-static int create_single_dir(const char *path, mode_t mode)
+static int create_dir(dir_cursor_t *dc, const char *path, mode_t mode, int parents)
 {
-    if (mkdir(path, mode) != 0) {
-        if (errno != EEXIST) {
-            perror(path);
+    const char *name;
+    size_t dir_len;
+    size_t name_len;
+    struct stat st;
+    int dirfd;
+
+    dir_cursor_split(path, &dir_len, &name, &name_len);
+    dirfd = dir_cursor_open(dc, path, dir_len, parents, mode);
+    if (dirfd < 0 && dirfd != AT_FDCWD) {
+        perror(path);
+        return EXIT_ERROR;
+    }
+
+    if (mkdirat(dirfd, name, mode) != 0) {
+        /* Already there: fine with -p if it is a directory */
+        if (errno != EEXIST ||
+            (parents && (fstatat(dirfd, name, &st, 0) != 0 || !S_ISDIR(st.st_mode)))) {
+            if (errno != EEXIST) {
+                perror(path);
+            } else {
+                fprintf(stderr, "%s: File exists\n", path);
+            }
             return EXIT_ERROR;
         }
-        /* Directory already exists - not an error with -p */
     }
     return EXIT_OK;
 }
 
 /*
- * Create directory and all parents as needed
- * Example: "a/b/c" creates "a", then "a/b", then "a/b/c"
+ * Create every directory named in --from-file, one per line or with
+ * -0 one per NUL
+ * Returns: EXIT_OK, or EXIT_ERROR if any failed
  */
-static int create_parents(const char *path, mode_t mode)
+static int create_from_file(dir_cursor_t *dc, const char *list, int delim, mode_t mode,
+                            int parents)
 {
-    char *path_copy;
-    char *p;
+    FILE *in = strcmp(list, "-") == 0 ? cmd_stdin() : fopen(list, "r");
+    char *buf = NULL;
+    size_t cap = 0;
+    ssize_t len;
     int ret = EXIT_OK;
 
-    /* Make a copy we can modify */
-    path_copy = strdup(path);
-    if (path_copy == NULL) {
-        perror("mkdir");
+    if (!in) {
+        perror(list);
         return EXIT_ERROR;
     }
-
-    /* Create each directory in the path */
-    for (p = path_copy + 1; *p; p++) {
-        if (*p == '/') {
-            /* Temporarily truncate */
-            *p = '\0';
-
-            /* Create this level */
-            if (create_single_dir(path_copy, mode) != EXIT_OK) {
-                /* Only fail if it's not EEXIST */
-                if (errno != EEXIST) {
-                    ret = EXIT_ERROR;
-                    goto cleanup;
-                }
-            }
-
-            /* Restore the slash */
-            *p = '/';
+    while ((len = getdelim(&buf, &cap, delim, in)) >= 0) {
+        if (len > 0 && buf[len - 1] == delim) {
+            buf[--len] = '\0';
+        }
+        if (len > 0 && create_dir(dc, buf, mode, parents) != EXIT_OK) {
+            ret = EXIT_ERROR;
         }
     }
-
-    /* Create the final directory */
-    if (create_single_dir(path_copy, mode) != EXIT_OK) {
+    if (ferror(in)) {
+        perror(list);
         ret = EXIT_ERROR;
     }
-
-cleanup:
-    free(path_copy);
+    free(buf);
+    if (in != cmd_stdin()) {
+        fclose(in);
+    }
     return ret;
 }
 
@@ -140,6 +175,7 @@ int mkdir_run(int argc, char **argv)
     int nerrors;
     int parents = 0;
     mode_t mode = 0777;  /* Default: rwxrwxrwx (modified by umask) */
+    dir_cursor_t dc;
     int i;
     int ret = EXIT_OK;
 
@@ -149,7 +185,6 @@ int mkdir_run(int argc, char **argv)
     /* Handle --help */
     if (mkdir_help->count > 0) {
         mkdir_print_usage(stdout);
-        arg_freetable(mkdir_argtable, 5);
         return EXIT_OK;
     }
 
@@ -157,12 +192,17 @@ int mkdir_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, mkdir_end, "mkdir");
         fprintf(stderr, "Try 'mkdir --help' for more information.\n");
-        arg_freetable(mkdir_argtable, 5);
         return EXIT_ERROR;
     }
 
     /* ===== ACTUAL COMMAND LOGIC ===== */
 
+    if (mkdir_dirs->count == 0 && mkdir_from->count == 0) {
+        fprintf(stderr, "mkdir: missing operand\n");
+        fprintf(stderr, "Try 'mkdir --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
     /* Check if -p flag was specified */
     if (mkdir_parents->count > 0) {
         parents = 1;
@@ -171,25 +211,24 @@ int mkdir_run(int argc, char **argv)
     /* Parse mode if specified */
     if (mkdir_mode->count > 0) {
         if (parse_mode(mkdir_mode->sval[0], &mode) != 0) {
-            arg_freetable(mkdir_argtable, 5);
             return EXIT_ERROR;
         }
     }
 
-    /* Create each directory */
+    /* Create each directory, the one they are in kept open for the next */
+    dir_cursor_init(&dc);
     for (i = 0; i < mkdir_dirs->count; i++) {
-        if (parents) {
-            if (create_parents(mkdir_dirs->filename[i], mode) != EXIT_OK) {
-                ret = EXIT_ERROR;
-            }
-        } else {
-            if (create_single_dir(mkdir_dirs->filename[i], mode) != EXIT_OK) {
-                ret = EXIT_ERROR;
-            }
+        if (create_dir(&dc, mkdir_dirs->filename[i], mode, parents) != EXIT_OK) {
+            ret = EXIT_ERROR;
         }
     }
+    if (mkdir_from->count > 0 &&
+        create_from_file(&dc, mkdir_from->filename[0], mkdir_null->count > 0 ? '\0' : '\n',
+                         mode, parents) != EXIT_OK) {
+        ret = EXIT_ERROR;
+    }
+    dir_cursor_free(&dc);
 
-    arg_freetable(mkdir_argtable, 5);
     return ret;
 }
 
@@ -209,8 +248,8 @@ void mkdir_print_usage(FILE *out)
     fprintf(out, "  mkdir newdir           Create directory 'newdir'\n");
     fprintf(out, "  mkdir -p a/b/c         Create nested directories\n");
     fprintf(out, "  mkdir -m 755 mydir     Create with specific permissions\n");
-
-    arg_freetable(mkdir_argtable, 5);
+    fprintf(out, "  find src --type d | mkdir -p --from-file=-\n");
+    fprintf(out, "                         Create every directory named on stdin\n");
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
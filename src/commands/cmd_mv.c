@@ -5,16 +5,39 @@
  * the standard command anatomy for PicoBox.
  *
  * Usage: mv [OPTIONS] SOURCE DEST
+ *        mv [OPTIONS] SOURCE... DIRECTORY
+ *
+ * Sources moved into a directory are renamed relative to the
+ * directory's descriptor, opened once. Across filesystems (EXDEV) the
+ * source is copied (copy_file_at(), or tree_copy_at() for a directory)
+ * and only removed once the copy has fully succeeded.
+ *
  * Options:
  *   -f, --force     Force overwrite (accepted but not fully implemented)
  *   -h, --help      Display help message
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* AT_FDCWD, renameat() and the *at() calls of the EXDEV copy */
+#endif
+
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
+#include "tree_copy.h"
+#include "tree_remove.h"
+#include "utils.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
 
 /* Forward declarations */
 int mv_run(int argc, char **argv);
@@ -32,9 +55,13 @@ static void *mv_argtable[5];
 
 static void build_mv_argtable(void)
 {
+    if (mv_argtable[0] != NULL) {
+        return;
+    }
+
     mv_help = arg_lit0("h", "help", "display this help and exit");
     mv_force = arg_lit0("f", "force", "force overwrite");
-    mv_files = arg_filen(NULL, NULL, "FILE", 2, 2, "source and destination");
+    mv_files = arg_filen(NULL, NULL, "FILE", 2, 100, "sources and destination");
     mv_end = arg_end(20);
 
     mv_argtable[0] = mv_help;
@@ -44,13 +71,100 @@ static void build_mv_argtable(void)
     mv_argtable[4] = NULL;
 }
 
+/* ===== HELPER FUNCTIONS ===== */
+
+static int mv_fail(const char *path)
+{
+    fprintf(stderr, "mv: %s: %s\n", path, strerror(errno));
+    return EXIT_ERROR;
+}
+
+/*
+ * Move src to dest_name in dest_dirfd by copying, for a rename that
+ * would cross filesystems; src is removed only if all of it was copied
+ */
+static int mv_across(const char *src, int dest_dirfd, const char *dest_name, const char *dest)
+{
+    struct stat st;
+    char target[PATH_MAX];
+    ssize_t n;
+
+    if (lstat(src, &st) != 0) {
+        return mv_fail(src);
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        if (tree_copy_at(AT_FDCWD, src, dest_dirfd, dest_name, "mv") != 0) {
+            fprintf(stderr, "mv: %s: not removed, copy incomplete\n", src);
+            return EXIT_ERROR;
+        }
+        return tree_remove_at(AT_FDCWD, src, "mv") == 0 ? EXIT_OK : EXIT_ERROR;
+    }
+
+    if (S_ISLNK(st.st_mode)) {
+        n = readlink(src, target, sizeof(target) - 1);
+        if (n < 0) {
+            return mv_fail(src);
+        }
+        target[n] = '\0';
+        if (symlinkat(target, dest_dirfd, dest_name) != 0 &&
+            (errno != EEXIST || unlinkat(dest_dirfd, dest_name, 0) != 0 ||
+             symlinkat(target, dest_dirfd, dest_name) != 0)) {
+            return mv_fail(dest);
+        }
+    } else if (S_ISREG(st.st_mode)) {
+        if (copy_file_at(AT_FDCWD, src, dest_dirfd, dest_name, st.st_mode & 07777) < 0) {
+            return mv_fail(dest);
+        }
+    } else {
+        fprintf(stderr, "mv: %s: cannot move special file across filesystems\n", src);
+        return EXIT_ERROR;
+    }
+
+    if (unlink(src) != 0) {
+        return mv_fail(src);
+    }
+    return EXIT_OK;
+}
+
+/* Rename src to dest_name in dest_dirfd, copying if it has to */
+static int mv_one(const char *src, int dest_dirfd, const char *dest_name, const char *dest)
+{
+    if (renameat(AT_FDCWD, src, dest_dirfd, dest_name) == 0) {
+        return EXIT_OK;
+    }
+    if (errno == EXDEV) {
+        return mv_across(src, dest_dirfd, dest_name, dest);
+    }
+    fprintf(stderr, "mv: cannot move '%s' to '%s': %s\n", src, dest, strerror(errno));
+    return EXIT_ERROR;
+}
+
+/*
+ * Last component of path, ignoring trailing slashes, into buf
+ * Returns: buf
+ */
+static const char *mv_name(const char *path, char *buf, size_t size)
+{
+    size_t end = strlen(path);
+    size_t start;
+
+    while (end > 1 && path[end - 1] == '/') {
+        end--;
+    }
+    start = end;
+    while (start > 0 && path[start - 1] != '/') {
+        start--;
+    }
+    snprintf(buf, size, "%.*s", (int)(end - start), path + start);
+    return buf;
+}
+
 /* ===== SECTION 3: RUN FUNCTION ===== */
 
 int mv_run(int argc, char **argv)
 {
     int nerrors;
-    const char *src;
-    const char *dest;
 
     build_mv_argtable();
     nerrors = arg_parse(argc, argv, mv_argtable);
@@ -58,7 +172,6 @@ int mv_run(int argc, char **argv)
     /* Handle --help */
     if (mv_help->count > 0) {
         mv_print_usage(stdout);
-        arg_freetable(mv_argtable, 4);
         return EXIT_OK;
     }
 
@@ -66,25 +179,41 @@ int mv_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, mv_end, "mv");
         fprintf(stderr, "Try 'mv --help' for more information.\n");
-        arg_freetable(mv_argtable, 4);
         return EXIT_ERROR;
     }
 
     /* ===== ACTUAL COMMAND LOGIC ===== */
 
-    /* Get source and destination */
-    src = mv_files->filename[0];
-    dest = mv_files->filename[1];
+    int nsrc = mv_files->count - 1;
+    const char *dest = mv_files->filename[nsrc];
+    int ret = EXIT_OK;
+    int dirfd;
 
-    /* Try rename (works on same filesystem) */
-    if (rename(src, dest) != 0) {
-        perror("mv");
-        arg_freetable(mv_argtable, 4);
-        return EXIT_ERROR;
+    /* Into a directory: open it once and rename relative to it */
+    dirfd = open(dest, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) {
+        if (nsrc > 1) {
+            fprintf(stderr, "mv: target '%s' is not a directory\n", dest);
+            return EXIT_ERROR;
+        }
+        ret = mv_one(mv_files->filename[0], AT_FDCWD, dest, dest);
+        return ret;
     }
 
-    arg_freetable(mv_argtable, 4);
-    return EXIT_OK;
+    for (int i = 0; i < nsrc; i++) {
+        const char *src = mv_files->filename[i];
+        char name[PATH_MAX];
+        char shown[2 * PATH_MAX];
+
+        mv_name(src, name, sizeof(name));
+        snprintf(shown, sizeof(shown), "%s/%s", dest, name);
+        if (mv_one(src, dirfd, name, shown) != EXIT_OK) {
+            ret = EXIT_ERROR;
+        }
+    }
+    close(dirfd);
+
+    return ret;
 }
 
 /* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
@@ -103,8 +232,7 @@ void mv_print_usage(FILE *out)
     fprintf(out, "  mv file1.txt file2.txt    Rename file1.txt to file2.txt\n");
     fprintf(out, "  mv file.txt /tmp/         Move file.txt to /tmp/\n");
     fprintf(out, "  mv oldname newname        Rename oldname to newname\n");
-
-    arg_freetable(mv_argtable, 4);
+    fprintf(out, "  mv a.o b.o c.o build/     Move several files into build/\n");
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -0,0 +1,118 @@
+/*
+ * cmd_printf.c - Format and print arguments
+ *
+ * Usage: printf FORMAT [ARGUMENT]...
+ * Options:
+ *   --help    Display help message
+ *
+ * The format is compiled and cached by printf_format.c, which the shell's
+ * printf builtin shares: a loop running printf parses its format once.
+ * Only a lone --help is an option, since a format may start with '-'.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "argtable3.h"
+#include "cmd_spec.h"
+#include "picobox.h"
+#include "printf_format.h"
+
+/* Forward declarations */
+int printf_run(int argc, char **argv);
+void printf_print_usage(FILE *out);
+
+/* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
+
+static struct arg_lit *printf_help;
+static struct arg_str *printf_fmt;
+static struct arg_str *printf_args;
+static struct arg_end *printf_end;
+static void *printf_argtable[5];
+
+/* ===== SECTION 2: ARGTABLE BUILDER ===== */
+
+/*
+ * The table only describes the command for --help: FORMAT and the
+ * arguments are taken as they are, never parsed as options.
+ */
+static void build_printf_argtable(void)
+{
+    if (printf_argtable[0] != NULL) {
+        return;
+    }
+
+    printf_help = arg_lit0(NULL, "help", "display this help and exit");
+    printf_fmt = arg_str1(NULL, NULL, "FORMAT", "format, as printf(1)");
+    printf_args = arg_strn(NULL, NULL, "ARGUMENT", 0, 100, "values for the conversions");
+    printf_end = arg_end(20);
+
+    printf_argtable[0] = printf_help;
+    printf_argtable[1] = printf_fmt;
+    printf_argtable[2] = printf_args;
+    printf_argtable[3] = printf_end;
+    printf_argtable[4] = NULL;
+}
+
+/* ===== SECTION 3: RUN FUNCTION ===== */
+
+int printf_run(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "--help") == 0) {
+        printf_print_usage(cmd_stdout());
+        return EXIT_OK;
+    }
+
+    return printf_format_run(argc, argv, cmd_stdout());
+}
+
+/* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
+
+void printf_print_usage(FILE *out)
+{
+    build_printf_argtable();
+
+    fprintf(out, "Usage: printf ");
+    arg_print_syntax(out, printf_argtable, "\n");
+    fprintf(out, "Print ARGUMENTs according to FORMAT.\n\n");
+    fprintf(out, "Options:\n");
+    arg_print_glossary(out, printf_argtable, "  %-25s %s\n");
+    fprintf(out, "\n");
+    fprintf(out, "FORMAT is printed with its escapes (\\n \\t \\\\ \\0NNN \\xHH \\c...)\n");
+    fprintf(out, "resolved, and each conversion replaced by the next ARGUMENT:\n");
+    fprintf(out, "  %%s %%b %%c            string, string with escapes, character\n");
+    fprintf(out, "  %%d %%i %%o %%u %%x %%X  integer ('C is the value of C)\n");
+    fprintf(out, "  %%e %%f %%g %%a        floating point\n");
+    fprintf(out, "  %%%%                  a single %%\n");
+    fprintf(out, "FORMAT is reused while ARGUMENTs are left.\n\n");
+    fprintf(out, "Examples:\n");
+    fprintf(out, "  printf '%%s=%%d\\n' a 1 b 2     Print 'a=1' and 'b=2'\n");
+    fprintf(out, "  printf '%%-8s|%%5.2f\\n' x 3.14159\n");
+}
+
+/* ===== SECTION 5: COMMAND SPECIFICATION ===== */
+
+cmd_spec_t cmd_printf_spec = {
+    .name = "printf",
+    .summary = "format and print data",
+    .long_help = "Print ARGUMENTs according to FORMAT, as printf(1). "
+                 "The shell also runs printf as a builtin.",
+    .run = printf_run,
+    .print_usage = printf_print_usage,
+    .flags = CMD_FLAG_STREAMS
+};
+
+/* ===== SECTION 6: REGISTRATION FUNCTION ===== */
+
+void register_printf_command(void)
+{
+    register_command(&cmd_printf_spec);
+}
+
+/* ===== SECTION 7: STANDALONE MAIN ===== */
+
+#ifndef BUILTIN_ONLY
+int main(int argc, char **argv)
+{
+    return cmd_printf_spec.run(argc, argv);
+}
+#endif
@@ -11,6 +11,10 @@
  *   -h, --help        Display help message
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* PATH_MAX */
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -44,6 +48,10 @@ static void *pwd_argtable[5];
  */
 static void build_pwd_argtable(void)
 {
+    if (pwd_argtable[0] != NULL) {
+        return;
+    }
+
     /* Define help flag */
     pwd_help = arg_lit0("h", "help", "display this help and exit");
 
@@ -88,12 +96,11 @@ int pwd_run(int argc, char **argv)
     build_pwd_argtable();
 
     /* Parse command-line arguments */
-    nerrors = arg_parse(argc, argv, pwd_argtable);
+    nerrors = cmd_arg_parse(argc, argv, pwd_argtable);
 
     /* Handle --help FIRST (before checking for errors) */
     if (pwd_help->count > 0) {
-        pwd_print_usage(stdout);
-        arg_freetable(pwd_argtable, 4);
+        pwd_print_usage(cmd_stdout());
         return EXIT_OK;
     }
 
@@ -101,7 +108,6 @@ int pwd_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, pwd_end, "pwd");
         fprintf(stderr, "Try 'pwd --help' for more information.\n");
-        arg_freetable(pwd_argtable, 4);
         return EXIT_ERROR;
     }
 
@@ -122,8 +128,7 @@ int pwd_run(int argc, char **argv)
     if (use_logical) {
         pwd_env = getenv("PWD");
         if (pwd_env != NULL && pwd_env[0] != '\0') {
-            printf("%s\n", pwd_env);
-            arg_freetable(pwd_argtable, 4);
+            fprintf(cmd_stdout(), "%s\n", pwd_env);
             return EXIT_OK;
         }
         /* Fall through to getcwd() if PWD not set or empty */
@@ -133,14 +138,11 @@ int pwd_run(int argc, char **argv)
      * This is the default behavior and also fallback for -L */
     if (getcwd(cwd, sizeof(cwd)) == NULL) {
         perror("pwd");
-        arg_freetable(pwd_argtable, 4);
         return EXIT_ERROR;
     }
 
-    printf("%s\n", cwd);
+    fprintf(cmd_stdout(), "%s\n", cwd);
 
-    /* Clean up and return */
-    arg_freetable(pwd_argtable, 4);
     return EXIT_OK;
 }
 
@@ -168,8 +170,6 @@ void pwd_print_usage(FILE *out)
     fprintf(out, "  pwd                        Print physical current directory\n");
     fprintf(out, "  pwd -L                     Print logical current directory (with symlinks)\n");
     fprintf(out, "  pwd -P                     Print physical current directory (resolve symlinks)\n");
-
-    arg_freetable(pwd_argtable, 4);
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -189,7 +189,8 @@ cmd_spec_t cmd_pwd_spec = {
                  "With -L, use PWD from environment (even if it contains symlinks). "
                  "With -P (default), resolve all symlinks to get physical path.",
     .run = pwd_run,
-    .print_usage = pwd_print_usage
+    .print_usage = pwd_print_usage,
+    .flags = CMD_FLAG_STREAMS
 };
 
 /* ===== SECTION 6: REGISTRATION FUNCTION ===== */
@@ -8,98 +8,163 @@
  * Options:
  *   -r, -R, --recursive   Remove directories and contents recursively
  *   -f, --force           Force removal, ignore nonexistent files
+ *   --files0-from=FILE    Remove the NUL-separated paths in FILE (- for stdin)
  *   -h, --help            Display help message
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* strndup() and O_CLOEXEC under -std=c11 */
+#endif
+
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
 #include <sys/stat.h>
-#include <dirent.h>
 #include <unistd.h>
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
+#include "tree_remove.h"
 #include "utils.h"
 
 /* Forward declarations */
 int rm_run(int argc, char **argv);
 void rm_print_usage(FILE *out);
-static int rm_recursive(const char *path);
 
 /* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
 
 static struct arg_lit *rm_help;
 static struct arg_lit *rm_recursive_flag;
 static struct arg_lit *rm_force;
+static struct arg_file *rm_files0;
 static struct arg_file *rm_files;
 static struct arg_end *rm_end;
-static void *rm_argtable[6];
+static void *rm_argtable[7];
 
 /* ===== SECTION 2: ARGTABLE BUILDER ===== */
 
 static void build_rm_argtable(void)
 {
+    if (rm_argtable[0] != NULL) {
+        return;
+    }
+
     rm_help = arg_lit0("h", "help", "display this help and exit");
     rm_recursive_flag = arg_lit0("rR", "recursive", "remove directories and their contents recursively");
     rm_force = arg_lit0("f", "force", "force removal, ignore nonexistent files");
-    rm_files = arg_filen(NULL, NULL, "FILE", 1, 100, "files to remove");
+    rm_files0 = arg_file0(NULL, "files0-from", "FILE",
+                          "remove the NUL-separated paths read from FILE (- for stdin)");
+    rm_files = arg_filen(NULL, NULL, "FILE", 0, 100, "files to remove");
     rm_end = arg_end(20);
 
     rm_argtable[0] = rm_help;
     rm_argtable[1] = rm_recursive_flag;
     rm_argtable[2] = rm_force;
-    rm_argtable[3] = rm_files;
-    rm_argtable[4] = rm_end;
-    rm_argtable[5] = NULL;
+    rm_argtable[3] = rm_files0;
+    rm_argtable[4] = rm_files;
+    rm_argtable[5] = rm_end;
+    rm_argtable[6] = NULL;
 }
 
-/* ===== HELPER FUNCTION ===== */
+/* ===== HELPER FUNCTIONS ===== */
 
-static int rm_recursive(const char *path)
+/*
+ * Remove one path as the options say
+ * Returns: 0, or -1 if it could not be removed (and -f does not excuse it)
+ */
+static int rm_path(const char *path, int recursive, int force)
 {
-    DIR *dir;
-    struct dirent *entry;
-    char filepath[4096];
-    struct stat st;
+    if (recursive) {
+        struct stat st;
 
-    if (lstat(path, &st) != 0) {
+        /* Parallel and fd-relative; see tree_remove.h */
+        if (force && lstat(path, &st) != 0 && errno == ENOENT) {
+            return 0;
+        }
+        if (tree_remove_at(AT_FDCWD, path, "rm") != 0 && !force) {
+            return -1;
+        }
+    } else if (is_directory(path)) {
+        fprintf(stderr, "rm: '%s' is a directory (use -r)\n", path);
+        return -1;
+    } else if (unlink(path) != 0 && !force) {
         perror(path);
-        return EXIT_ERROR;
+        return -1;
     }
+    return 0;
+}
 
-    if (!S_ISDIR(st.st_mode)) {
-        if (unlink(path) != 0) {
-            perror(path);
-            return EXIT_ERROR;
-        }
-        return EXIT_OK;
+/*
+ * --files0-from: remove the paths in name ("-": standard input), each
+ * ended by a NUL as find -print0 writes them. The line reader hands
+ * them over a large block at a time and each path is removed where it
+ * lies in the block.
+ * Returns: 0, or -1 if a path could not be removed or the input read
+ */
+static int rm_files0_from(const char *name, int recursive, int force)
+{
+    line_reader_t lr;
+    FILE *in = NULL;
+    int fd;
+    const char *data;
+    size_t len;
+    int ret = 0;
+    int r;
+
+    if (strcmp(name, "-") == 0) {
+        in = cmd_stdin();
+        fd = fileno(in);
+    } else if ((fd = open(name, O_RDONLY | O_CLOEXEC)) < 0) {
+        fprintf(stderr, "rm: %s: %s\n", name, strerror(errno));
+        return -1;
     }
-
-    /* Remove directory contents */
-    dir = opendir(path);
-    if (!dir) {
-        perror(path);
-        return EXIT_ERROR;
+    if ((fd >= 0 ? line_reader_init_fd(&lr, fd) : line_reader_init_stream(&lr, in)) != 0) {
+        perror("rm");
+        if (!in) {
+            close(fd);
+        }
+        return -1;
     }
+    line_reader_set_delim(&lr, '\0');
 
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
+    while ((r = line_reader_lines(&lr, &data, &len)) > 0) {
+        const char *end = data + len;
 
-        snprintf(filepath, sizeof(filepath), "%s/%s", path, entry->d_name);
-        rm_recursive(filepath);
-    }
+        for (const char *p = data; p < end; ) {
+            const char *nul = memchr(p, '\0', (size_t)(end - p));
+            size_t n = nul ? (size_t)(nul - p) : (size_t)(end - p);
 
-    closedir(dir);
+            if (n == 0) {
+                fprintf(stderr, "rm: %s: invalid zero-length file name\n", name);
+                ret = -1;
+            } else if (nul) {
+                if (rm_path(p, recursive, force) != 0) {
+                    ret = -1;
+                }
+            } else {
+                /* The last path, without a NUL to end it */
+                char *last = strndup(p, n);
 
-    /* Remove the directory itself */
-    if (rmdir(path) != 0) {
-        perror(path);
-        return EXIT_ERROR;
+                if (!last || rm_path(last, recursive, force) != 0) {
+                    ret = -1;
+                }
+                free(last);
+            }
+            p += n + 1;
+        }
+    }
+    if (r < 0) {
+        fprintf(stderr, "rm: %s: %s\n", name, strerror(errno));
+        ret = -1;
     }
 
-    return EXIT_OK;
+    line_reader_free(&lr);
+    if (!in) {
+        close(fd);
+    }
+    return ret;
 }
 
 /* ===== SECTION 3: RUN FUNCTION ===== */
@@ -118,7 +183,6 @@ int rm_run(int argc, char **argv)
     /* Handle --help */
     if (rm_help->count > 0) {
         rm_print_usage(stdout);
-        arg_freetable(rm_argtable, 5);
         return EXIT_OK;
     }
 
@@ -126,7 +190,6 @@ int rm_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, rm_end, "rm");
         fprintf(stderr, "Try 'rm --help' for more information.\n");
-        arg_freetable(rm_argtable, 5);
         return EXIT_ERROR;
     }
 
@@ -140,30 +203,27 @@ int rm_run(int argc, char **argv)
         force = 1;
     }
 
+    /* Paths come from the operands or from --files0-from, not both */
+    if (rm_files0->count > 0) {
+        if (rm_files->count > 0) {
+            fprintf(stderr, "rm: file operands cannot be combined with --files0-from\n");
+            return EXIT_ERROR;
+        }
+        return rm_files0_from(rm_files0->filename[0], recursive, force) == 0 ? EXIT_OK : EXIT_ERROR;
+    }
+    if (rm_files->count == 0) {
+        fprintf(stderr, "rm: missing operand\n");
+        fprintf(stderr, "Try 'rm --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
     /* Remove each file */
     for (i = 0; i < rm_files->count; i++) {
-        const char *path = rm_files->filename[i];
-
-        if (is_directory(path)) {
-            if (!recursive) {
-                fprintf(stderr, "rm: '%s' is a directory (use -r)\n", path);
-                ret = EXIT_ERROR;
-                continue;
-            }
-            if (rm_recursive(path) != EXIT_OK && !force) {
-                ret = EXIT_ERROR;
-            }
-        } else {
-            if (unlink(path) != 0) {
-                if (!force) {
-                    perror(path);
-                    ret = EXIT_ERROR;
-                }
-            }
+        if (rm_path(rm_files->filename[i], recursive, force) != 0) {
+            ret = EXIT_ERROR;
         }
     }
 
-    arg_freetable(rm_argtable, 5);
     return ret;
 }
 
@@ -184,8 +244,8 @@ void rm_print_usage(FILE *out)
     fprintf(out, "  rm -r mydir               Remove directory and contents\n");
     fprintf(out, "  rm -f file.txt            Force removal, ignore errors\n");
     fprintf(out, "  rm file1.txt file2.txt    Remove multiple files\n");
-
-    arg_freetable(rm_argtable, 5);
+    fprintf(out, "  find . --name '*.tmp' -print0 | rm --files0-from=-\n");
+    fprintf(out, "                            Remove what find lists, blanks and all\n");
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
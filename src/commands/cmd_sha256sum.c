@@ -0,0 +1,178 @@
+/*
+ * cmd_sha256sum.c - Print or check SHA-256 checksums
+ *
+ * Usage: sha256sum [OPTIONS] [FILE...]
+ * Options:
+ *   -c, --check       Read checksums from the FILEs and check them
+ *       --quiet       Don't print OK for each successfully verified file
+ *       --status      Don't output anything; the exit status shows success
+ *   -h, --help        Display help message
+ *
+ * Blocks are compressed with the SHA extensions when the CPU has them
+ * (sha256.h). Several files, including the ones a manifest lists, are
+ * hashed at once on a thread pool (checksum.h); output is in order.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* AT_FDCWD */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include "argtable3.h"
+#include "cmd_spec.h"
+#include "picobox.h"
+#include "checksum.h"
+
+/* Forward declarations */
+int sha256sum_run(int argc, char **argv);
+void sha256sum_print_usage(FILE *out);
+
+/* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
+
+static struct arg_lit *sha256sum_help;
+static struct arg_lit *sha256sum_check;
+static struct arg_lit *sha256sum_quiet;
+static struct arg_lit *sha256sum_status;
+static struct arg_file *sha256sum_files;
+static struct arg_end *sha256sum_end;
+static void *sha256sum_argtable[7];
+
+/* ===== SECTION 2: ARGTABLE BUILDER ===== */
+
+static void build_sha256sum_argtable(void)
+{
+    if (sha256sum_argtable[0] != NULL) {
+        return;
+    }
+
+    sha256sum_help = arg_lit0("h", "help", "display this help and exit");
+    sha256sum_check = arg_lit0("c", "check", "read checksums from the FILEs and check them");
+    sha256sum_quiet = arg_lit0(NULL, "quiet", "don't print OK for each successfully verified file");
+    sha256sum_status = arg_lit0(NULL, "status", "don't output anything, status code shows success");
+    sha256sum_files = arg_filen(NULL, NULL, "FILE", 0, 1000, "files to hash, or manifests with -c");
+    sha256sum_end = arg_end(20);
+
+    sha256sum_argtable[0] = sha256sum_help;
+    sha256sum_argtable[1] = sha256sum_check;
+    sha256sum_argtable[2] = sha256sum_quiet;
+    sha256sum_argtable[3] = sha256sum_status;
+    sha256sum_argtable[4] = sha256sum_files;
+    sha256sum_argtable[5] = sha256sum_end;
+    sha256sum_argtable[6] = NULL;
+}
+
+/* ===== HELPER FUNCTIONS ===== */
+
+/*
+ * List or check the operands (standard input when there are none)
+ * Returns: EXIT_OK or EXIT_ERROR
+ */
+static int sha256sum_operands(FILE *in, FILE *out)
+{
+    static char *dash[] = { "-" };
+    char **names = sha256sum_files->count > 0 ? (char **)sha256sum_files->filename : dash;
+    size_t n = sha256sum_files->count > 0 ? (size_t)sha256sum_files->count : 1;
+    int ret = EXIT_OK;
+
+    if (sha256sum_check->count == 0) {
+        return checksum_list(CHECKSUM_SHA256, in, out, names, n, "sha256sum") == 0 ? EXIT_OK : EXIT_ERROR;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        int flags = (sha256sum_quiet->count > 0 ? CHECKSUM_QUIET : 0) |
+                    (sha256sum_status->count > 0 ? CHECKSUM_STATUS : 0);
+        FILE *manifest = strcmp(names[i], "-") == 0 ? in : fopen(names[i], "r");
+
+        if (!manifest) {
+            perror(names[i]);
+            ret = EXIT_ERROR;
+            continue;
+        }
+        if (checksum_check(CHECKSUM_SHA256, AT_FDCWD, in, manifest,
+                           manifest == in ? "standard input" : names[i], out, flags, "sha256sum") != 0) {
+            ret = EXIT_ERROR;
+        }
+        if (manifest != in) {
+            fclose(manifest);
+        }
+    }
+    return ret;
+}
+
+/* ===== SECTION 3: RUN FUNCTION ===== */
+
+int sha256sum_run(int argc, char **argv)
+{
+    int nerrors;
+    int ret;
+
+    build_sha256sum_argtable();
+    nerrors = cmd_arg_parse(argc, argv, sha256sum_argtable);
+
+    /* Handle --help */
+    if (sha256sum_help->count > 0) {
+        sha256sum_print_usage(cmd_stdout());
+        return EXIT_OK;
+    }
+
+    /* Handle parsing errors */
+    if (nerrors > 0) {
+        arg_print_errors(stderr, sha256sum_end, "sha256sum");
+        fprintf(stderr, "Try 'sha256sum --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
+    /* ===== ACTUAL COMMAND LOGIC ===== */
+
+    ret = sha256sum_operands(cmd_stdin(), cmd_stdout());
+    return ret;
+}
+
+/* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
+
+void sha256sum_print_usage(FILE *out)
+{
+    build_sha256sum_argtable();
+
+    fprintf(out, "Usage: sha256sum ");
+    arg_print_syntax(out, sha256sum_argtable, "\n");
+    fprintf(out, "Print or check SHA256 (256-bit) checksums.\n");
+    fprintf(out, "With no FILE, or when FILE is -, read standard input.\n\n");
+    fprintf(out, "Options:\n");
+    arg_print_glossary(out, sha256sum_argtable, "  %-20s %s\n");
+    fprintf(out, "\n");
+    fprintf(out, "Examples:\n");
+    fprintf(out, "  sha256sum *.tar.gz > SHA256SUMS   Write a manifest\n");
+    fprintf(out, "  sha256sum -c SHA256SUMS           Check files against it\n");
+}
+
+/* ===== SECTION 5: COMMAND SPECIFICATION ===== */
+
+cmd_spec_t cmd_sha256sum_spec = {
+    .name = "sha256sum",
+    .summary = "print or check SHA-256 checksums",
+    .long_help = "Print or check SHA256 (256-bit) checksums. Files are hashed in parallel, "
+                 "with the CPU's SHA instructions when it has them.",
+    .run = sha256sum_run,
+    .print_usage = sha256sum_print_usage,
+    .flags = CMD_FLAG_STREAMS | CMD_FLAG_PURE
+};
+
+/* ===== SECTION 6: REGISTRATION FUNCTION ===== */
+
+void register_sha256sum_command(void)
+{
+    register_command(&cmd_sha256sum_spec);
+}
+
+/* ===== SECTION 7: STANDALONE MAIN ===== */
+
+#ifndef BUILTIN_ONLY
+int main(int argc, char **argv)
+{
+    return cmd_sha256sum_spec.run(argc, argv);
+}
+#endif
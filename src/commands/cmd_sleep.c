@@ -36,6 +36,10 @@ static void *sleep_argtable[4];
 
 static void build_sleep_argtable(void)
 {
+    if (sleep_argtable[0] != NULL) {
+        return;
+    }
+
     sleep_help = arg_lit0("h", "help", "display this help and exit");
     sleep_duration = arg_str1(NULL, NULL, "NUMBER[SUFFIX]", "duration to sleep");
     sleep_end = arg_end(20);
@@ -62,7 +66,6 @@ int sleep_run(int argc, char **argv)
     /* Handle --help */
     if (sleep_help->count > 0) {
         sleep_print_usage(stdout);
-        arg_freetable(sleep_argtable, 3);
         return EXIT_OK;
     }
 
@@ -70,7 +73,6 @@ int sleep_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, sleep_end, "sleep");
         fprintf(stderr, "Try 'sleep --help' for more information.\n");
-        arg_freetable(sleep_argtable, 3);
         return EXIT_ERROR;
     }
 
@@ -82,7 +84,6 @@ int sleep_run(int argc, char **argv)
     seconds = strtod(duration_str, &endptr);
     if (endptr == duration_str || seconds < 0) {
         fprintf(stderr, "sleep: invalid time interval '%s'\n", duration_str);
-        arg_freetable(sleep_argtable, 3);
         return EXIT_ERROR;
     }
 
@@ -93,7 +94,6 @@ int sleep_run(int argc, char **argv)
         /* Check that suffix is the last character */
         if (*(endptr + 1) != '\0') {
             fprintf(stderr, "sleep: invalid time interval '%s'\n", duration_str);
-            arg_freetable(sleep_argtable, 3);
             return EXIT_ERROR;
         }
 
@@ -112,7 +112,6 @@ int sleep_run(int argc, char **argv)
                 break;
             default:
                 fprintf(stderr, "sleep: invalid time suffix '%c'\n", suffix);
-                arg_freetable(sleep_argtable, 3);
                 return EXIT_ERROR;
         }
     }
@@ -120,7 +119,6 @@ int sleep_run(int argc, char **argv)
     /* Perform the sleep */
     sleep((unsigned int)seconds);
 
-    arg_freetable(sleep_argtable, 3);
     return EXIT_OK;
 }
 
@@ -145,8 +143,6 @@ void sleep_print_usage(FILE *out)
     fprintf(out, "  sleep 1.5       Pause for 1.5 seconds\n");
     fprintf(out, "  sleep 2m        Pause for 2 minutes\n");
     fprintf(out, "  sleep 1h        Pause for 1 hour\n");
-
-    arg_freetable(sleep_argtable, 3);
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
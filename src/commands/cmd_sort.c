@@ -0,0 +1,1183 @@
+/*
+ * cmd_sort.c - Sort lines of text
+ *
+ * Usage: sort [OPTIONS] [FILE...]
+ * Options:
+ *   -n, --numeric-sort              Compare by numeric value
+ *   -r, --reverse                   Reverse the result of comparisons
+ *   -k, --key=KEYDEF                Sort by a key; KEYDEF is F[.C][OPTS][,F[.C][OPTS]]
+ *   -t, --field-separator=SEP       Fields end at SEP rather than at blanks
+ *   -u, --unique                    Output only the first of lines with equal keys
+ *   -S, --buffer-size=SIZE          Memory for lines before spilling to disk
+ *   -T, --temporary-directory=DIR   Where the spilled runs go
+ *   -h, --help                      Display help message
+ *
+ * Lines are copied into an arena and sorted as records of a key prefix
+ * (the first 8 bytes of the first key, or the floor of its number with
+ * -n) and a pointer: most comparisons are settled by the prefix alone,
+ * without looking at the lines. The records are cut into one chunk per
+ * CPU, each merge-sorted on the work pool (work_pool.h), and the chunks
+ * are merged as they are written out.
+ *
+ * When the lines and records outgrow -S the batch is sorted the same
+ * way and written to a temporary file as a sorted run, and the arena
+ * starts over. At the end up to SORT_FANIN runs are merged at a time
+ * into longer ones until the rest can be merged, with the last batch
+ * still in memory, straight to the output; so the input may be far
+ * larger than memory, as long as the temporary directory can hold it.
+ *
+ * Comparisons are byte by byte (the C locale). Lines with equal keys
+ * are compared whole as a last resort, except with -u, and a merge
+ * prefers the earlier input, so -u keeps the first of equal lines.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* mkstemp(), fdopen() and O_CLOEXEC */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "argtable3.h"
+#include "cmd_spec.h"
+#include "picobox.h"
+#include "arena.h"
+#include "pb_out.h"
+#include "utils.h"
+#include "work_pool.h"
+
+/* Forward declarations */
+int sort_run(int argc, char **argv);
+void sort_print_usage(FILE *out);
+
+/* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
+
+#define SORT_MAX_KEYS 10
+
+static struct arg_lit *sort_help;
+static struct arg_lit *sort_numeric;
+static struct arg_lit *sort_reverse;
+static struct arg_str *sort_keys;
+static struct arg_str *sort_tab;
+static struct arg_lit *sort_unique;
+static struct arg_str *sort_size;
+static struct arg_str *sort_tmpdir;
+static struct arg_file *sort_files;
+static struct arg_end *sort_end;
+static void *sort_argtable[11];
+
+/* ===== SECTION 2: ARGTABLE BUILDER ===== */
+
+static void build_sort_argtable(void)
+{
+    if (sort_argtable[0] != NULL) {
+        return;
+    }
+
+    sort_help = arg_lit0("h", "help", "display this help and exit");
+    sort_numeric = arg_lit0("n", "numeric-sort", "compare according to numeric value");
+    sort_reverse = arg_lit0("r", "reverse", "reverse the result of comparisons");
+    sort_keys = arg_strn("k", "key", "KEYDEF", 0, SORT_MAX_KEYS,
+                         "sort by a key: F[.C][bnr][,F[.C][bnr]]");
+    sort_tab = arg_str0("t", "field-separator", "SEP", "use SEP instead of blank to end fields");
+    sort_unique = arg_lit0("u", "unique", "output only the first of lines with equal keys");
+    sort_size = arg_str0("S", "buffer-size", "SIZE",
+                         "memory for lines before sorted runs go to disk (K by default; b, K, M, G, %)");
+    sort_tmpdir = arg_str0("T", "temporary-directory", "DIR",
+                           "put the sorted runs in DIR, not $TMPDIR or /tmp");
+    sort_files = arg_filen(NULL, NULL, "FILE", 0, 100, "files to sort (or stdin if none)");
+    sort_end = arg_end(20);
+
+    sort_argtable[0] = sort_help;
+    sort_argtable[1] = sort_numeric;
+    sort_argtable[2] = sort_reverse;
+    sort_argtable[3] = sort_keys;
+    sort_argtable[4] = sort_tab;
+    sort_argtable[5] = sort_unique;
+    sort_argtable[6] = sort_size;
+    sort_argtable[7] = sort_tmpdir;
+    sort_argtable[8] = sort_files;
+    sort_argtable[9] = sort_end;
+    sort_argtable[10] = NULL;
+}
+
+/* ===== HELPER FUNCTIONS ===== */
+
+#define SORT_DEFAULT_MEM (256UL * 1024 * 1024)
+#define SORT_MIN_MEM (64UL * 1024)
+#define SORT_FANIN 64          /* Runs merged at once */
+#define SORT_PAR_MIN 32768     /* Fewer records are sorted on one thread */
+#define SORT_INSERTION 16      /* Runs this short are insertion sorted */
+
+/* Numbers of more integer digits than this share a prefix */
+#define SORT_PREFIX_MAX 1000000000000000LL
+
+typedef struct sort_key {
+    size_t sfield;             /* 1-based; 0: the whole line */
+    size_t schar;              /* 1-based in the field */
+    size_t efield;             /* 0: to the end of the line */
+    size_t echar;              /* 0: to the end of the field */
+    int sblanks;               /* b: leading blanks of a field are not counted */
+    int eblanks;
+    int numeric;
+    int reverse;
+} sort_key_t;
+
+typedef struct sort_opts {
+    sort_key_t keys[SORT_MAX_KEYS];
+    int nkeys;
+    int tab;                   /* -t character, or -1: fields start at blanks */
+    int unique;
+    int reverse;               /* -r: the last-resort comparison too */
+} sort_opts_t;
+
+typedef struct sort_rec {
+    uint64_t prefix;           /* Of the first key, in its order */
+    const char *line;
+    size_t len;                /* Without the '\n' */
+} sort_rec_t;
+
+typedef struct sort_ctx {
+    sort_opts_t opts;
+    size_t mem;                /* -S */
+    const char *tmpdir;
+    arena_t *arena;
+    sort_rec_t *recs;
+    sort_rec_t *tmp;           /* Merge sort scratch, as large as recs */
+    size_t n;
+    size_t cap;
+    char **runs;               /* Temporary files, in input order */
+    size_t nruns;
+    size_t runs_cap;
+    int nworkers;
+} sort_ctx_t;
+
+/* A sorted piece of input to merge: records in memory, or a run file */
+typedef struct sort_src {
+    const sort_rec_t *recs;
+    size_t i;
+    size_t n;
+    int fd;                    /* Run file, or -1 */
+    int error;                 /* errno of a failed read */
+    line_reader_t lr;
+    const char *line;          /* Current line */
+    size_t len;
+} sort_src_t;
+
+/* A chunk of records for one worker */
+typedef struct sort_chunk {
+    sort_rec_t *recs;
+    sort_rec_t *tmp;
+    size_t n;
+} sort_chunk_t;
+
+static int sort_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+/* Start of field f (1-based) of [p, end), or end if there are fewer */
+static const char *sort_field(const sort_opts_t *o, const char *p, const char *end, size_t f)
+{
+    while (--f > 0 && p < end) {
+        if (o->tab >= 0) {
+            p = memchr(p, o->tab, (size_t)(end - p));
+            p = p ? p + 1 : end;
+        } else {
+            while (p < end && sort_blank(*p)) {
+                p++;
+            }
+            while (p < end && !sort_blank(*p)) {
+                p++;
+            }
+        }
+    }
+    return p;
+}
+
+/* End of the field starting at p */
+static const char *sort_field_end(const sort_opts_t *o, const char *p, const char *end)
+{
+    if (o->tab >= 0) {
+        const char *t = memchr(p, o->tab, (size_t)(end - p));
+
+        return t ? t : end;
+    }
+    while (p < end && sort_blank(*p)) {
+        p++;
+    }
+    while (p < end && !sort_blank(*p)) {
+        p++;
+    }
+    return p;
+}
+
+/* Key k of line: [*kp, *kp + *kl) */
+static void sort_span(const sort_opts_t *o, const sort_key_t *k, const char *line, size_t len,
+                      const char **kp, size_t *kl)
+{
+    const char *end = line + len;
+    const char *s;
+    const char *e;
+
+    if (k->sfield == 0) {
+        *kp = line;
+        *kl = len;
+        return;
+    }
+
+    /* Character positions run on past their field, to the end of the line */
+    s = sort_field(o, line, end, k->sfield);
+    if (k->sblanks) {
+        while (s < end && sort_blank(*s)) {
+            s++;
+        }
+    }
+    s = (size_t)(end - s) < k->schar - 1 ? end : s + k->schar - 1;
+
+    if (k->efield == 0) {
+        e = end;
+    } else {
+        e = sort_field(o, line, end, k->efield);
+        if (k->echar == 0) {
+            e = sort_field_end(o, e, end);
+        } else {
+            if (k->eblanks) {
+                while (e < end && sort_blank(*e)) {
+                    e++;
+                }
+            }
+            e = (size_t)(end - e) < k->echar ? end : e + k->echar;
+        }
+    }
+
+    *kp = s;
+    *kl = e > s ? (size_t)(e - s) : 0;
+}
+
+static int sort_bytecmp(const char *a, size_t al, const char *b, size_t bl)
+{
+    int r = memcmp(a, b, al < bl ? al : bl);
+
+    if (r != 0) {
+        return r < 0 ? -1 : 1;
+    }
+    return al < bl ? -1 : al > bl;
+}
+
+/* A number as -n reads it: [-]digits[.digits], leading blanks skipped */
+typedef struct sort_num {
+    int neg;
+    const char *ip;            /* Integer digits, no leading zeros */
+    size_t il;
+    const char *fp;            /* Fraction digits, no trailing zeros */
+    size_t fl;
+} sort_num_t;
+
+static void sort_num_parse(const char *p, size_t len, sort_num_t *num)
+{
+    const char *end = p + len;
+
+    while (p < end && sort_blank(*p)) {
+        p++;
+    }
+    num->neg = p < end && *p == '-';
+    p += num->neg;
+    while (p < end && *p == '0') {
+        p++;
+    }
+    num->ip = p;
+    while (p < end && *p >= '0' && *p <= '9') {
+        p++;
+    }
+    num->il = (size_t)(p - num->ip);
+    num->fp = p;
+    num->fl = 0;
+    if (p < end && *p == '.') {
+        num->fp = ++p;
+        while (p < end && *p >= '0' && *p <= '9') {
+            p++;
+        }
+        num->fl = (size_t)(p - num->fp);
+        while (num->fl > 0 && num->fp[num->fl - 1] == '0') {
+            num->fl--;
+        }
+    }
+    if (num->il == 0 && num->fl == 0) {
+        num->neg = 0;          /* -0 is 0 */
+    }
+}
+
+static int sort_numcmp(const char *a, size_t al, const char *b, size_t bl)
+{
+    sort_num_t x;
+    sort_num_t y;
+    size_t fl;
+    int r;
+
+    sort_num_parse(a, al, &x);
+    sort_num_parse(b, bl, &y);
+    if (x.neg != y.neg) {
+        return x.neg ? -1 : 1;
+    }
+
+    if (x.il != y.il) {
+        r = x.il < y.il ? -1 : 1;
+    } else if ((r = memcmp(x.ip, y.ip, x.il)) == 0) {
+        fl = x.fl < y.fl ? x.fl : y.fl;
+        r = memcmp(x.fp, y.fp, fl);
+        if (r == 0) {
+            r = x.fl < y.fl ? -1 : x.fl > y.fl;
+        }
+    }
+    r = r < 0 ? -1 : r > 0;
+    return x.neg ? -r : r;
+}
+
+/* Compare two lines by the keys, then whole unless -u */
+static int sort_compare(const sort_opts_t *o, const char *a, size_t al, const char *b, size_t bl)
+{
+    int i;
+    int r;
+
+    for (i = 0; i < o->nkeys; i++) {
+        const sort_key_t *k = &o->keys[i];
+        const char *ka;
+        const char *kb;
+        size_t kal;
+        size_t kbl;
+
+        sort_span(o, k, a, al, &ka, &kal);
+        sort_span(o, k, b, bl, &kb, &kbl);
+        r = k->numeric ? sort_numcmp(ka, kal, kb, kbl) : sort_bytecmp(ka, kal, kb, kbl);
+        if (r != 0) {
+            return k->reverse ? -r : r;
+        }
+    }
+    if (o->unique) {
+        return 0;
+    }
+    r = sort_bytecmp(a, al, b, bl);
+    return o->reverse ? -r : r;
+}
+
+/*
+ * The prefix of a line: never larger for a line whose first key is
+ * smaller, so a difference in prefixes decides a comparison
+ */
+static uint64_t sort_prefix(const sort_opts_t *o, const char *line, size_t len)
+{
+    const sort_key_t *k = &o->keys[0];
+    const char *kp;
+    size_t kl;
+    uint64_t p = 0;
+    size_t i;
+
+    sort_span(o, k, line, len, &kp, &kl);
+    if (k->numeric) {
+        sort_num_t num;
+        long long v = 0;
+
+        sort_num_parse(kp, kl, &num);
+        if (num.il > 15) {
+            v = SORT_PREFIX_MAX;
+        } else {
+            for (i = 0; i < num.il; i++) {
+                v = v * 10 + (num.ip[i] - '0');
+            }
+        }
+        if (num.neg) {
+            /* The floor: -1.5 is below -1 */
+            v = -v - (num.fl > 0 || num.il > 15);
+        }
+        return (uint64_t)v ^ (1ULL << 63);
+    }
+
+    for (i = 0; i < 8; i++) {
+        p = p << 8 | (i < kl ? (unsigned char)kp[i] : 0);
+    }
+    return p;
+}
+
+static int sort_rec_cmp(const sort_opts_t *o, const sort_rec_t *a, const sort_rec_t *b)
+{
+    if (a->prefix != b->prefix) {
+        int r = a->prefix < b->prefix ? -1 : 1;
+
+        return o->keys[0].reverse ? -r : r;
+    }
+    return sort_compare(o, a->line, a->len, b->line, b->len);
+}
+
+/* Stable merge sort of a[0..n), with tmp as large */
+static void sort_merge_sort(const sort_opts_t *o, sort_rec_t *a, sort_rec_t *tmp, size_t n)
+{
+    size_t h = n / 2;
+    size_t i;
+    size_t j;
+    size_t k;
+
+    if (n <= SORT_INSERTION) {
+        for (i = 1; i < n; i++) {
+            sort_rec_t r = a[i];
+
+            for (j = i; j > 0 && sort_rec_cmp(o, &a[j - 1], &r) > 0; j--) {
+                a[j] = a[j - 1];
+            }
+            a[j] = r;
+        }
+        return;
+    }
+
+    sort_merge_sort(o, a, tmp, h);
+    sort_merge_sort(o, a + h, tmp + h, n - h);
+    if (sort_rec_cmp(o, &a[h - 1], &a[h]) <= 0) {
+        return;
+    }
+
+    /* The left half moves out of the way; the merge fills a from the front */
+    memcpy(tmp, a, h * sizeof(sort_rec_t));
+    i = 0;
+    j = h;
+    k = 0;
+    while (i < h && j < n) {
+        a[k++] = sort_rec_cmp(o, &tmp[i], &a[j]) <= 0 ? tmp[i++] : a[j++];
+    }
+    memcpy(a + k, tmp + i, (h - i) * sizeof(sort_rec_t));
+}
+
+static void sort_chunk_fn(work_pool_t *pool, int worker, void *item, void *arg)
+{
+    sort_chunk_t *c = item;
+
+    (void)pool;
+    (void)worker;
+    sort_merge_sort(arg, c->recs, c->tmp, c->n);
+}
+
+/*
+ * Sort the batch as chunks, one per worker, each its own sorted
+ * source in srcs
+ * Returns: the number of chunks
+ */
+static int sort_batch(sort_ctx_t *ctx, sort_src_t *srcs)
+{
+    int nchunks = ctx->n >= SORT_PAR_MIN ? ctx->nworkers : 1;
+    sort_chunk_t *chunks = nchunks > 1 ? calloc((size_t)nchunks, sizeof(sort_chunk_t)) : NULL;
+    work_pool_t *pool = chunks ? work_pool_create(nchunks, sort_chunk_fn, &ctx->opts) : NULL;
+    size_t start = 0;
+    int i;
+
+    if (!pool) {
+        nchunks = 1;
+    }
+    for (i = 0; i < nchunks; i++) {
+        size_t end = ctx->n * (size_t)(i + 1) / (size_t)nchunks;
+
+        memset(&srcs[i], 0, sizeof(sort_src_t));
+        srcs[i].recs = ctx->recs + start;
+        srcs[i].n = end - start;
+        srcs[i].fd = -1;
+        if (pool) {
+            chunks[i].recs = ctx->recs + start;
+            chunks[i].tmp = ctx->tmp + start;
+            chunks[i].n = end - start;
+            if (work_pool_push(pool, i, &chunks[i]) != 0) {
+                sort_merge_sort(&ctx->opts, chunks[i].recs, chunks[i].tmp, chunks[i].n);
+            }
+        } else {
+            sort_merge_sort(&ctx->opts, ctx->recs, ctx->tmp, ctx->n);
+        }
+        start = end;
+    }
+    if (pool) {
+        work_pool_run(pool);
+        work_pool_destroy(pool);
+    }
+    free(chunks);
+    return nchunks;
+}
+
+/* Move src to its next line; 0 when it has none left */
+static int sort_src_next(sort_src_t *s)
+{
+    if (s->fd < 0) {
+        if (s->i == s->n) {
+            return 0;
+        }
+        s->line = s->recs[s->i].line;
+        s->len = s->recs[s->i].len;
+        s->i++;
+        return 1;
+    }
+    switch (line_reader_next(&s->lr, &s->line, &s->len)) {
+    case 1:
+        break;
+    case 0:
+        return 0;
+    default:
+        s->error = errno;
+        return 0;
+    }
+    if (s->len > 0 && s->line[s->len - 1] == '\n') {
+        s->len--;
+    }
+    return 1;
+}
+
+/* Heap order: by line, then the earlier source */
+static int sort_heap_less(const sort_opts_t *o, const sort_src_t *srcs, int a, int b)
+{
+    int r = sort_compare(o, srcs[a].line, srcs[a].len, srcs[b].line, srcs[b].len);
+
+    return r < 0 || (r == 0 && a < b);
+}
+
+static void sort_sift(const sort_opts_t *o, const sort_src_t *srcs, int *heap, int n, int i)
+{
+    for (;;) {
+        int l = 2 * i + 1;
+        int m = i;
+        int t;
+
+        if (l < n && sort_heap_less(o, srcs, heap[l], heap[m])) {
+            m = l;
+        }
+        if (l + 1 < n && sort_heap_less(o, srcs, heap[l + 1], heap[m])) {
+            m = l + 1;
+        }
+        if (m == i) {
+            return;
+        }
+        t = heap[i];
+        heap[i] = heap[m];
+        heap[m] = t;
+        i = m;
+    }
+}
+
+/*
+ * Merge srcs[0..nsrcs) into out, dropping lines equal to the one before
+ * with -u
+ * Returns: 0, or -1 on a read error from a run (errno set)
+ */
+static int sort_merge(sort_ctx_t *ctx, sort_src_t *srcs, int nsrcs, pb_out_t *out)
+{
+    const sort_opts_t *o = &ctx->opts;
+    int *heap = malloc((size_t)nsrcs * sizeof(int));
+    char *last = NULL;
+    size_t last_len = 0;
+    size_t last_cap = 0;
+    int have_last = 0;
+    int n = 0;
+    int i;
+
+    if (!heap) {
+        return -1;
+    }
+    for (i = 0; i < nsrcs; i++) {
+        if (sort_src_next(&srcs[i])) {
+            heap[n++] = i;
+        }
+    }
+    for (i = n / 2 - 1; i >= 0; i--) {
+        sort_sift(o, srcs, heap, n, i);
+    }
+
+    while (n > 0) {
+        sort_src_t *s = &srcs[heap[0]];
+
+        if (!o->unique || !have_last || sort_compare(o, last, last_len, s->line, s->len) != 0) {
+            pb_out_write(out, s->line, s->len);
+            pb_out_putc(out, '\n');
+            if (o->unique) {
+                /* Kept: a run's line is gone at its next read */
+                if (s->len > last_cap) {
+                    char *bigger = realloc(last, s->len);
+
+                    if (!bigger) {
+                        free(last);
+                        free(heap);
+                        errno = ENOMEM;
+                        return -1;
+                    }
+                    last = bigger;
+                    last_cap = s->len;
+                }
+                memcpy(last, s->line, s->len);
+                last_len = s->len;
+                have_last = 1;
+            }
+        }
+        if (!sort_src_next(s)) {
+            heap[0] = heap[--n];
+        }
+        sort_sift(o, srcs, heap, n, 0);
+    }
+
+    free(last);
+    free(heap);
+    for (i = 0; i < nsrcs; i++) {
+        if (srcs[i].error) {
+            errno = srcs[i].error;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Remember a run's name; it is removed at the end */
+static int sort_add_run(sort_ctx_t *ctx, char *name, size_t at)
+{
+    if (ctx->nruns == ctx->runs_cap) {
+        size_t cap = ctx->runs_cap ? ctx->runs_cap * 2 : 16;
+        char **runs = realloc(ctx->runs, cap * sizeof(char *));
+
+        if (!runs) {
+            return -1;
+        }
+        ctx->runs = runs;
+        ctx->runs_cap = cap;
+    }
+    memmove(ctx->runs + at + 1, ctx->runs + at, (ctx->nruns - at) * sizeof(char *));
+    ctx->runs[at] = name;
+    ctx->nruns++;
+    return 0;
+}
+
+/*
+ * Merge srcs into a new temporary file, put in the run list at at
+ * Returns: 0, or -1 (reported)
+ */
+static int sort_write_run(sort_ctx_t *ctx, sort_src_t *srcs, int nsrcs, size_t at)
+{
+    size_t dlen = strlen(ctx->tmpdir);
+    char *name = malloc(dlen + sizeof("/picobox-sortXXXXXX"));
+    pb_out_t out;
+    FILE *fp;
+    int fd;
+
+    if (!name) {
+        perror("sort");
+        return -1;
+    }
+    memcpy(name, ctx->tmpdir, dlen);
+    memcpy(name + dlen, "/picobox-sortXXXXXX", sizeof("/picobox-sortXXXXXX"));
+    fd = mkstemp(name);
+    if (fd < 0) {
+        fprintf(stderr, "sort: %s: %s\n", ctx->tmpdir, strerror(errno));
+        free(name);
+        return -1;
+    }
+    if (sort_add_run(ctx, name, at) != 0) {
+        perror("sort");
+        unlink(name);
+        free(name);
+        close(fd);
+        return -1;
+    }
+
+    fp = fdopen(fd, "w");
+    if (!fp || pb_out_init(&out, fp) != 0) {
+        perror("sort");
+        if (fp) {
+            fclose(fp);
+        } else {
+            close(fd);
+        }
+        return -1;
+    }
+    if (sort_merge(ctx, srcs, nsrcs, &out) != 0) {
+        fprintf(stderr, "sort: reading a run: %s\n", strerror(errno));
+        pb_out_close(&out);
+        fclose(fp);
+        return -1;
+    }
+    if (pb_out_close(&out) != 0 || fclose(fp) != 0) {
+        fprintf(stderr, "sort: %s: %s\n", name, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* Sort what is in memory into a run and start the arena over */
+static int sort_spill(sort_ctx_t *ctx)
+{
+    sort_src_t *srcs = calloc((size_t)ctx->nworkers, sizeof(sort_src_t));
+    int nsrcs;
+    int ret;
+
+    if (!srcs) {
+        perror("sort");
+        return -1;
+    }
+    nsrcs = sort_batch(ctx, srcs);
+    ret = sort_write_run(ctx, srcs, nsrcs, ctx->nruns);
+    free(srcs);
+    arena_reset(ctx->arena);
+    ctx->n = 0;
+    return ret;
+}
+
+/* Open runs[0..n) as sources */
+static int sort_open_runs(sort_ctx_t *ctx, sort_src_t *srcs, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        memset(&srcs[i], 0, sizeof(sort_src_t));
+        srcs[i].fd = open(ctx->runs[i], O_RDONLY | O_CLOEXEC);
+        if (srcs[i].fd < 0 || line_reader_init_fd(&srcs[i].lr, srcs[i].fd) != 0) {
+            fprintf(stderr, "sort: %s: %s\n", ctx->runs[i], strerror(errno));
+            if (srcs[i].fd >= 0) {
+                close(srcs[i].fd);
+            }
+            while (i-- > 0) {
+                line_reader_free(&srcs[i].lr);
+                close(srcs[i].fd);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void sort_close_runs(sort_src_t *srcs, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        line_reader_free(&srcs[i].lr);
+        close(srcs[i].fd);
+    }
+}
+
+/*
+ * Merge the first SORT_FANIN runs into one, in their place, until no
+ * more than SORT_FANIN are left to merge with the chunks in memory
+ */
+static int sort_reduce_runs(sort_ctx_t *ctx)
+{
+    sort_src_t srcs[SORT_FANIN];
+
+    while (ctx->nruns > SORT_FANIN) {
+        size_t i;
+        int ret;
+
+        if (sort_open_runs(ctx, srcs, SORT_FANIN) != 0) {
+            return -1;
+        }
+        ret = sort_write_run(ctx, srcs, SORT_FANIN, 0);
+        sort_close_runs(srcs, SORT_FANIN);
+        if (ret != 0) {
+            return -1;
+        }
+
+        /* The merged ones are now runs[1..SORT_FANIN] */
+        for (i = 1; i <= SORT_FANIN; i++) {
+            unlink(ctx->runs[i]);
+            free(ctx->runs[i]);
+        }
+        memmove(ctx->runs + 1, ctx->runs + 1 + SORT_FANIN,
+                (ctx->nruns - 1 - SORT_FANIN) * sizeof(char *));
+        ctx->nruns -= SORT_FANIN;
+    }
+    return 0;
+}
+
+/* Add a line to the batch, spilling it first if it would outgrow -S */
+static int sort_add(sort_ctx_t *ctx, const char *line, size_t len)
+{
+    sort_rec_t *r;
+    char *copy;
+
+    if (ctx->n > 0 &&
+        arena_used(ctx->arena) + len + (ctx->n + 1) * 2 * sizeof(sort_rec_t) > ctx->mem &&
+        sort_spill(ctx) != 0) {
+        return -1;
+    }
+
+    if (ctx->n == ctx->cap) {
+        size_t cap = ctx->cap ? ctx->cap * 2 : 4096;
+        sort_rec_t *recs = realloc(ctx->recs, cap * sizeof(sort_rec_t));
+        sort_rec_t *tmp;
+
+        if (!recs) {
+            perror("sort");
+            return -1;
+        }
+        ctx->recs = recs;
+        tmp = realloc(ctx->tmp, cap * sizeof(sort_rec_t));
+        if (!tmp) {
+            perror("sort");
+            return -1;
+        }
+        ctx->tmp = tmp;
+        ctx->cap = cap;
+    }
+
+    copy = arena_alloc(ctx->arena, len ? len : 1);
+    if (!copy) {
+        perror("sort");
+        return -1;
+    }
+    memcpy(copy, line, len);
+    r = &ctx->recs[ctx->n++];
+    r->line = copy;
+    r->len = len;
+    r->prefix = sort_prefix(&ctx->opts, copy, len);
+    return 0;
+}
+
+/*
+ * Read the lines of one input into the batch
+ * Returns: EXIT_OK, EXIT_ERROR for an input that could not be read, or
+ * -1 when sorting cannot go on
+ */
+static int sort_read(sort_ctx_t *ctx, const char *filename)
+{
+    int use_stdin = strcmp(filename, "-") == 0;
+    int fd = use_stdin ? -1 : open(filename, O_RDONLY | O_CLOEXEC);
+    line_reader_t lr;
+    const char *line;
+    size_t len;
+    int r;
+
+    if (!use_stdin && fd < 0) {
+        perror(filename);
+        return EXIT_ERROR;
+    }
+    if ((use_stdin ? line_reader_init_stream(&lr, cmd_stdin())
+                   : line_reader_init_fd(&lr, fd)) != 0) {
+        perror("sort");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    while ((r = line_reader_next(&lr, &line, &len)) > 0) {
+        if (len > 0 && line[len - 1] == '\n') {
+            len--;
+        }
+        if (sort_add(ctx, line, len) != 0) {
+            r = -2;
+            break;
+        }
+    }
+    line_reader_free(&lr);
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (r == -1) {
+        perror(use_stdin ? "stdin" : filename);
+        return EXIT_ERROR;
+    }
+    return r == -2 ? -1 : EXIT_OK;
+}
+
+/*
+ * Parse one end of a KEYDEF: F[.C] then any of b, n, r
+ * Returns: the character after it, or NULL if it is not valid
+ */
+static const char *sort_parse_pos(const char *p, size_t *field, size_t *chr, int *blanks,
+                                  sort_key_t *k)
+{
+    char *end;
+
+    *field = (size_t)strtoul(p, &end, 10);
+    if (end == p || *field == 0) {
+        return NULL;
+    }
+    p = end;
+    if (*p == '.') {
+        *chr = (size_t)strtoul(p + 1, &end, 10);
+        if (end == p + 1) {
+            return NULL;
+        }
+        p = end;
+    }
+    for (; *p && *p != ','; p++) {
+        if (*p == 'b') {
+            *blanks = 1;
+        } else if (*p == 'n') {
+            k->numeric = 1;
+        } else if (*p == 'r') {
+            k->reverse = 1;
+        } else {
+            return NULL;
+        }
+    }
+    return p;
+}
+
+/* Parse -k KEYDEF: F[.C][bnr][,F[.C][bnr]] */
+static int sort_parse_key(const char *s, sort_key_t *k)
+{
+    const char *p;
+
+    memset(k, 0, sizeof(*k));
+    k->schar = 1;
+    p = sort_parse_pos(s, &k->sfield, &k->schar, &k->sblanks, k);
+    if (!p || k->schar == 0) {
+        return -1;
+    }
+    if (*p == ',') {
+        p = sort_parse_pos(p + 1, &k->efield, &k->echar, &k->eblanks, k);
+        if (!p || *p) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Parse -S SIZE: a number of K (by default), or with a suffix b, K, M,
+ * G, T, or % of physical memory
+ */
+static int sort_parse_size(const char *s, size_t *size)
+{
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    unsigned long long unit = 1024;
+
+    if (end == s) {
+        return -1;
+    }
+    switch (*end) {
+    case '\0': break;
+    case 'b': unit = 1; break;
+    case 'k': case 'K': unit = 1024; break;
+    case 'm': case 'M': unit = 1024ULL * 1024; break;
+    case 'g': case 'G': unit = 1024ULL * 1024 * 1024; break;
+    case 't': case 'T': unit = 1024ULL * 1024 * 1024 * 1024; break;
+    case '%': {
+        long pages = sysconf(_SC_PHYS_PAGES);
+        long page = sysconf(_SC_PAGESIZE);
+
+        if (pages <= 0 || page <= 0 || v > 100) {
+            return -1;
+        }
+        v = (unsigned long long)pages * (unsigned long long)page / 100 * v;
+        unit = 1;
+        break;
+    }
+    default:
+        return -1;
+    }
+    if (*end && end[1]) {
+        return -1;
+    }
+    *size = (size_t)(v * unit);
+    if (*size < SORT_MIN_MEM) {
+        *size = SORT_MIN_MEM;
+    }
+    return 0;
+}
+
+static void sort_cleanup(sort_ctx_t *ctx)
+{
+    size_t i;
+
+    for (i = 0; i < ctx->nruns; i++) {
+        unlink(ctx->runs[i]);
+        free(ctx->runs[i]);
+    }
+    free(ctx->runs);
+    free(ctx->recs);
+    free(ctx->tmp);
+    if (ctx->arena) {
+        arena_destroy(ctx->arena);
+    }
+}
+
+/*
+ * Sort the inputs, already parsed into ctx, to stdout
+ * Returns: EXIT_OK or EXIT_ERROR
+ */
+static int sort_all(sort_ctx_t *ctx, int nfiles, const char **files)
+{
+    sort_src_t *srcs;
+    pb_out_t out;
+    int nchunks;
+    int ret = EXIT_OK;
+    int i;
+
+    for (i = 0; i < (nfiles ? nfiles : 1); i++) {
+        int r = sort_read(ctx, nfiles ? files[i] : "-");
+
+        if (r < 0) {
+            return EXIT_ERROR;
+        }
+        if (r != EXIT_OK) {
+            ret = EXIT_ERROR;
+        }
+    }
+
+    /* The runs, then the last batch's chunks */
+    srcs = calloc(SORT_FANIN + (size_t)ctx->nworkers, sizeof(sort_src_t));
+    if (!srcs) {
+        perror("sort");
+        return EXIT_ERROR;
+    }
+    if (sort_reduce_runs(ctx) != 0 || sort_open_runs(ctx, srcs, ctx->nruns) != 0) {
+        free(srcs);
+        return EXIT_ERROR;
+    }
+    nchunks = sort_batch(ctx, srcs + ctx->nruns);
+
+    if (pb_out_init(&out, cmd_stdout()) != 0) {
+        perror("sort");
+        sort_close_runs(srcs, ctx->nruns);
+        free(srcs);
+        return EXIT_ERROR;
+    }
+    if (sort_merge(ctx, srcs, (int)ctx->nruns + nchunks, &out) != 0) {
+        fprintf(stderr, "sort: reading a run: %s\n", strerror(errno));
+        ret = EXIT_ERROR;
+    }
+    if (pb_out_close(&out) != 0) {
+        if (errno != EPIPE) {
+            perror("sort: write error");
+        }
+        ret = EXIT_ERROR;
+    }
+    sort_close_runs(srcs, ctx->nruns);
+    free(srcs);
+    return ret;
+}
+
+/* ===== SECTION 3: RUN FUNCTION ===== */
+
+int sort_run(int argc, char **argv)
+{
+    int nerrors;
+    sort_ctx_t ctx;
+    const char *tmpdir;
+    int i;
+    int ret;
+
+    build_sort_argtable();
+    nerrors = cmd_arg_parse(argc, argv, sort_argtable);
+
+    /* Handle --help */
+    if (sort_help->count > 0) {
+        sort_print_usage(cmd_stdout());
+        return EXIT_OK;
+    }
+
+    /* Handle parsing errors */
+    if (nerrors > 0) {
+        arg_print_errors(stderr, sort_end, "sort");
+        fprintf(stderr, "Try 'sort --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
+    /* ===== ACTUAL COMMAND LOGIC ===== */
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.opts.tab = -1;
+    ctx.opts.unique = sort_unique->count > 0;
+    ctx.opts.reverse = sort_reverse->count > 0;
+    ctx.mem = SORT_DEFAULT_MEM;
+
+    if (sort_tab->count > 0) {
+        if (strlen(sort_tab->sval[0]) != 1) {
+            fprintf(stderr, "sort: the separator must be one character: '%s'\n",
+                    sort_tab->sval[0]);
+            return EXIT_ERROR;
+        }
+        ctx.opts.tab = (unsigned char)sort_tab->sval[0][0];
+    }
+    if (sort_size->count > 0 && sort_parse_size(sort_size->sval[0], &ctx.mem) != 0) {
+        fprintf(stderr, "sort: invalid buffer size '%s'\n", sort_size->sval[0]);
+        return EXIT_ERROR;
+    }
+
+    /* Keys without n or r of their own take -n and -r */
+    for (i = 0; i < sort_keys->count; i++) {
+        sort_key_t *k = &ctx.opts.keys[i];
+
+        if (sort_parse_key(sort_keys->sval[i], k) != 0) {
+            fprintf(stderr, "sort: invalid key '%s'\n", sort_keys->sval[i]);
+            return EXIT_ERROR;
+        }
+        if (!k->numeric && !k->reverse) {
+            k->numeric = sort_numeric->count > 0;
+            k->reverse = ctx.opts.reverse;
+        }
+    }
+    ctx.opts.nkeys = sort_keys->count;
+    if (ctx.opts.nkeys == 0) {
+        ctx.opts.keys[0].numeric = sort_numeric->count > 0;
+        ctx.opts.keys[0].reverse = ctx.opts.reverse;
+        ctx.opts.nkeys = 1;
+    }
+
+    tmpdir = sort_tmpdir->count > 0 ? sort_tmpdir->sval[0] : getenv("TMPDIR");
+    ctx.tmpdir = tmpdir && *tmpdir ? tmpdir : "/tmp";
+    ctx.nworkers = work_pool_default_workers();
+    ctx.arena = arena_create(0);
+    if (!ctx.arena) {
+        perror("sort");
+        return EXIT_ERROR;
+    }
+
+    ret = sort_all(&ctx, sort_files->count, sort_files->filename);
+
+    sort_cleanup(&ctx);
+    return ret;
+}
+
+/* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
+
+void sort_print_usage(FILE *out)
+{
+    build_sort_argtable();
+
+    fprintf(out, "Usage: sort ");
+    arg_print_syntax(out, sort_argtable, "\n");
+    fprintf(out, "Write the lines of all FILEs (or stdin) to standard output, sorted.\n");
+    fprintf(out, "Input larger than the buffer size is sorted in runs on disk and merged.\n\n");
+    fprintf(out, "Options:\n");
+    arg_print_glossary(out, sort_argtable, "  %-28s %s\n");
+    fprintf(out, "\n");
+    fprintf(out, "A KEYDEF F[.C][,F[.C]] runs from field F, character C, to the end of the\n");
+    fprintf(out, "second field (or line); b skips leading blanks, n and r apply to that key.\n\n");
+    fprintf(out, "Examples:\n");
+    fprintf(out, "  sort names.txt               Sort lines bytewise\n");
+    fprintf(out, "  sort -t : -k 3n /etc/passwd  Sort by the third field, numerically\n");
+    fprintf(out, "  sort -u -S 1G huge.log       Sort a large file, without duplicates\n");
+}
+
+/* ===== SECTION 5: COMMAND SPECIFICATION ===== */
+
+cmd_spec_t cmd_sort_spec = {
+    .name = "sort",
+    .summary = "sort lines of text files",
+    .long_help = "Write the lines of all FILEs (or stdin) to standard output, sorted. "
+                 "Input larger than the buffer size is sorted in runs on disk and merged.",
+    .run = sort_run,
+    .print_usage = sort_print_usage,
+    .flags = CMD_FLAG_STREAMS
+};
+
+/* ===== SECTION 6: REGISTRATION FUNCTION ===== */
+
+void register_sort_command(void)
+{
+    register_command(&cmd_sort_spec);
+}
+
+/* ===== SECTION 7: STANDALONE MAIN ===== */
+
+#ifndef BUILTIN_ONLY
+int main(int argc, char **argv)
+{
+    return cmd_sort_spec.run(argc, argv);
+}
+#endif
@@ -4,18 +4,40 @@
  * This is the refactored version using argtable3 and following
  * the standard command anatomy for PicoBox.
  *
- * Usage: stat FILE...
+ * Usage: stat [OPTIONS] FILE...
  * Display file or file system status.
+ * Options:
+ *   -c, --format=FORMAT   Print FORMAT for each file instead of the default
+ *   -h, --help            Display help message
+ *
+ * FORMAT is compiled once into a list of literal pieces and conversions,
+ * and the fields its conversions use become the statx() mask, so a
+ * format such as '%s %Y %n' fetches the size and mtime and nothing else.
+ * Where statx() is missing stat() fills in everything. The lines go out
+ * through a pb_out buffer rather than a printf() per field.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* statx() and localtime_r() */
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <pwd.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
 #include <time.h>
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
 #include "utils.h"
+#include "pb_out.h"
 
 /* Forward declarations */
 int stat_run(int argc, char **argv);
@@ -24,22 +46,531 @@ void stat_print_usage(FILE *out);
 /* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
 
 static struct arg_lit *stat_help;
+static struct arg_str *stat_format;
 static struct arg_file *stat_files;
 static struct arg_end *stat_end;
-static void *stat_argtable[4];
+static void *stat_argtable[5];
 
 /* ===== SECTION 2: ARGTABLE BUILDER ===== */
 
 static void build_stat_argtable(void)
 {
+    if (stat_argtable[0] != NULL) {
+        return;
+    }
+
     stat_help = arg_lit0("h", "help", "display this help and exit");
+    stat_format = arg_str0("c", "format", "FORMAT",
+                           "print FORMAT and a newline for each file instead of the default");
     stat_files = arg_filen(NULL, NULL, "FILE", 1, 100, "files to stat");
     stat_end = arg_end(20);
 
     stat_argtable[0] = stat_help;
-    stat_argtable[1] = stat_files;
-    stat_argtable[2] = stat_end;
-    stat_argtable[3] = NULL;
+    stat_argtable[1] = stat_format;
+    stat_argtable[2] = stat_files;
+    stat_argtable[3] = stat_end;
+    stat_argtable[4] = NULL;
+}
+
+/* ===== HELPER FUNCTION ===== */
+
+/* Fields a conversion needs (statx() mask bits where it exists) */
+#ifdef STATX_BASIC_STATS
+#define STAT_WANT_TYPE   STATX_TYPE
+#define STAT_WANT_MODE   STATX_MODE
+#define STAT_WANT_NLINK  STATX_NLINK
+#define STAT_WANT_UID    STATX_UID
+#define STAT_WANT_GID    STATX_GID
+#define STAT_WANT_ATIME  STATX_ATIME
+#define STAT_WANT_MTIME  STATX_MTIME
+#define STAT_WANT_CTIME  STATX_CTIME
+#define STAT_WANT_INO    STATX_INO
+#define STAT_WANT_SIZE   STATX_SIZE
+#define STAT_WANT_BLOCKS STATX_BLOCKS
+#define STAT_WANT_BTIME  STATX_BTIME
+#else
+#define STAT_WANT_TYPE   0x001
+#define STAT_WANT_MODE   0x002
+#define STAT_WANT_NLINK  0x004
+#define STAT_WANT_UID    0x008
+#define STAT_WANT_GID    0x010
+#define STAT_WANT_ATIME  0x020
+#define STAT_WANT_MTIME  0x040
+#define STAT_WANT_CTIME  0x080
+#define STAT_WANT_INO    0x100
+#define STAT_WANT_SIZE   0x200
+#define STAT_WANT_BLOCKS 0x400
+#define STAT_WANT_BTIME  0x800
+#endif
+
+/* The conversions -c knows and what each needs fetched */
+static const struct {
+    char conv;
+    unsigned int want;
+} stat_convs[] = {
+    { 'a', STAT_WANT_MODE },                    /* Permissions in octal */
+    { 'A', STAT_WANT_TYPE | STAT_WANT_MODE },   /* Permissions as ls -l shows them */
+    { 'b', STAT_WANT_BLOCKS },                  /* Blocks allocated (see %B) */
+    { 'B', 0 },                                 /* Size of those blocks */
+    { 'd', 0 },                                 /* Device number */
+    { 'f', STAT_WANT_TYPE | STAT_WANT_MODE },   /* Raw mode in hex */
+    { 'F', STAT_WANT_TYPE },                    /* File type */
+    { 'g', STAT_WANT_GID },
+    { 'G', STAT_WANT_GID },                     /* Group name */
+    { 'h', STAT_WANT_NLINK },
+    { 'i', STAT_WANT_INO },
+    { 'n', 0 },                                 /* File name */
+    { 'o', 0 },                                 /* Optimal I/O size */
+    { 's', STAT_WANT_SIZE },
+    { 'u', STAT_WANT_UID },
+    { 'U', STAT_WANT_UID },                     /* Owner name */
+    { 'w', STAT_WANT_BTIME },                   /* Times readable ... */
+    { 'x', STAT_WANT_ATIME },
+    { 'y', STAT_WANT_MTIME },
+    { 'z', STAT_WANT_CTIME },
+    { 'W', STAT_WANT_BTIME },                   /* ... and in seconds since the Epoch */
+    { 'X', STAT_WANT_ATIME },
+    { 'Y', STAT_WANT_MTIME },
+    { 'Z', STAT_WANT_CTIME },
+};
+
+/* One piece of a compiled format: text, or a conversion with its width */
+typedef struct stat_item {
+    char conv;                  /* 0 for text */
+    int width;                  /* Negative: left-aligned */
+    int zero;                   /* Pad numbers with zeros */
+    const char *text;
+    size_t len;
+} stat_item_t;
+
+typedef struct stat_fmt {
+    stat_item_t *items;
+    size_t count;
+    unsigned int want;
+} stat_fmt_t;
+
+/* What the format asked for, from statx() or stat() */
+typedef struct stat_info {
+    unsigned int mode;
+    unsigned long nlink;
+    unsigned long uid;
+    unsigned long gid;
+    unsigned long long ino;
+    unsigned long long size;
+    unsigned long long blocks;
+    unsigned long blksize;
+    unsigned long long dev;
+    struct timespec atime;
+    struct timespec mtime;
+    struct timespec ctime;
+    struct timespec btime;
+    int has_btime;
+} stat_info_t;
+
+typedef struct stat_ctx {
+    pb_out_t *out;
+    int no_statx;               /* statx() said ENOSYS: use stat() */
+    unsigned long uid;          /* Last owner and group named, */
+    unsigned long gid;          /* as files mostly share them */
+    char user[64];
+    char group[64];
+} stat_ctx_t;
+
+static unsigned int stat_conv_want(char conv)
+{
+    for (size_t i = 0; i < sizeof(stat_convs) / sizeof(stat_convs[0]); i++) {
+        if (stat_convs[i].conv == conv) {
+            return stat_convs[i].want;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Split fmt into items once: "%[-][0][WIDTH]C" is a conversion, "%%" a
+ * percent sign, everything else text taken as it is
+ * Returns: 0, or -1 if out of memory
+ */
+static int stat_compile(const char *fmt, stat_fmt_t *f)
+{
+    size_t cap = 1;
+    const char *p;
+
+    for (p = fmt; *p; p++) {
+        cap += *p == '%' ? 2 : 0;
+    }
+    f->items = calloc(cap, sizeof(stat_item_t));
+    f->count = 0;
+    f->want = 0;
+    if (!f->items) {
+        return -1;
+    }
+
+    p = fmt;
+    while (*p) {
+        stat_item_t *it = &f->items[f->count++];
+        const char *q = p;
+        int left = 0;
+
+        /* Text up to the next conversion (a '%' ending fmt is text) */
+        if (*p != '%' || !p[1]) {
+            p++;
+            while (*p && *p != '%') {
+                p++;
+            }
+            it->text = q;
+            it->len = (size_t)(p - q);
+            continue;
+        }
+        if (p[1] == '%') {
+            it->text = p;
+            it->len = 1;
+            p += 2;
+            continue;
+        }
+
+        p++;
+        for (; *p == '-' || *p == '0'; p++) {
+            left |= *p == '-';
+            it->zero |= *p == '0';
+        }
+        while (*p >= '0' && *p <= '9') {
+            it->width = it->width * 10 + (*p++ - '0');
+        }
+        if (left) {
+            it->width = -it->width;
+        }
+        it->conv = *p ? *p++ : '?';
+        f->want |= stat_conv_want(it->conv);
+    }
+    return 0;
+}
+
+/*
+ * Fetch the fields in want for path (following symbolic links)
+ * Returns: 0, or -1 with errno set
+ */
+static int stat_fetch(stat_ctx_t *ctx, const char *path, unsigned int want, stat_info_t *si)
+{
+    struct stat st;
+
+    memset(si, 0, sizeof(*si));
+
+#ifdef STATX_BASIC_STATS
+    if (!ctx->no_statx) {
+        struct statx sx;
+
+        if (statx(AT_FDCWD, path, 0, want, &sx) == 0) {
+            si->mode = sx.stx_mode;
+            si->nlink = sx.stx_nlink;
+            si->uid = sx.stx_uid;
+            si->gid = sx.stx_gid;
+            si->ino = sx.stx_ino;
+            si->size = sx.stx_size;
+            si->blocks = sx.stx_blocks;
+            si->blksize = sx.stx_blksize;
+            si->dev = makedev(sx.stx_dev_major, sx.stx_dev_minor);
+            si->atime.tv_sec = (time_t)sx.stx_atime.tv_sec;
+            si->atime.tv_nsec = (long)sx.stx_atime.tv_nsec;
+            si->mtime.tv_sec = (time_t)sx.stx_mtime.tv_sec;
+            si->mtime.tv_nsec = (long)sx.stx_mtime.tv_nsec;
+            si->ctime.tv_sec = (time_t)sx.stx_ctime.tv_sec;
+            si->ctime.tv_nsec = (long)sx.stx_ctime.tv_nsec;
+            si->btime.tv_sec = (time_t)sx.stx_btime.tv_sec;
+            si->btime.tv_nsec = (long)sx.stx_btime.tv_nsec;
+            si->has_btime = (sx.stx_mask & STATX_BTIME) != 0;
+            return 0;
+        }
+        if (errno != ENOSYS) {
+            return -1;
+        }
+        ctx->no_statx = 1;
+    }
+#else
+    (void)want;
+#endif
+
+    if (stat(path, &st) != 0) {
+        return -1;
+    }
+    si->mode = st.st_mode;
+    si->nlink = (unsigned long)st.st_nlink;
+    si->uid = st.st_uid;
+    si->gid = st.st_gid;
+    si->ino = st.st_ino;
+    si->size = (unsigned long long)st.st_size;
+    si->blocks = (unsigned long long)st.st_blocks;
+    si->blksize = (unsigned long)st.st_blksize;
+    si->dev = st.st_dev;
+#if defined(__APPLE__)
+    si->atime = st.st_atimespec;
+    si->mtime = st.st_mtimespec;
+    si->ctime = st.st_ctimespec;
+#else
+    si->atime = st.st_atim;
+    si->mtime = st.st_mtim;
+    si->ctime = st.st_ctim;
+#endif
+    return 0;
+}
+
+/* Name of a uid (group == 0) or gid; the number if it has none */
+static const char *stat_id_name(stat_ctx_t *ctx, unsigned long id, int group)
+{
+    char *buf = group ? ctx->group : ctx->user;
+    unsigned long *last = group ? &ctx->gid : &ctx->uid;
+    const char *name = NULL;
+
+    if (buf[0] && *last == id) {
+        return buf;
+    }
+    if (group) {
+        struct group *gr = getgrgid((gid_t)id);
+
+        name = gr ? gr->gr_name : NULL;
+    } else {
+        struct passwd *pw = getpwuid((uid_t)id);
+
+        name = pw ? pw->pw_name : NULL;
+    }
+    if (name) {
+        snprintf(buf, 64, "%s", name);
+    } else {
+        snprintf(buf, 64, "%lu", id);
+    }
+    *last = id;
+    return buf;
+}
+
+static const char *stat_type_name(unsigned int mode, unsigned long long size)
+{
+    if (S_ISREG(mode)) {
+        return size == 0 ? "regular empty file" : "regular file";
+    }
+    if (S_ISDIR(mode)) {
+        return "directory";
+    }
+    if (S_ISLNK(mode)) {
+        return "symbolic link";
+    }
+    if (S_ISFIFO(mode)) {
+        return "fifo";
+    }
+    if (S_ISSOCK(mode)) {
+        return "socket";
+    }
+    if (S_ISCHR(mode)) {
+        return "character special file";
+    }
+    if (S_ISBLK(mode)) {
+        return "block special file";
+    }
+    return "weird file";
+}
+
+/* "2024-05-01 10:20:30.123456789 +0200" */
+static void stat_human_time(const struct timespec *ts, char *buf, size_t size)
+{
+    struct tm tm;
+    size_t n;
+
+    if (!localtime_r(&ts->tv_sec, &tm)) {
+        snprintf(buf, size, "?");
+        return;
+    }
+    n = strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm);
+    n += (size_t)snprintf(buf + n, size - n, ".%09ld", ts->tv_nsec);
+    strftime(buf + n, size - n, " %z", &tm);
+}
+
+/* Write s for it, padded to its width */
+static void stat_put(pb_out_t *out, const stat_item_t *it, const char *s, int number)
+{
+    if (it->zero && number && it->width > 0) {
+        size_t len = strlen(s);
+
+        for (size_t i = len; i < (size_t)it->width; i++) {
+            pb_out_putc(out, '0');
+        }
+        pb_out_str(out, s);
+    } else {
+        pb_out_pad(out, s, it->width);
+    }
+}
+
+static void stat_put_uint(pb_out_t *out, const stat_item_t *it, unsigned long long v)
+{
+    char buf[24];
+    char *p = buf + sizeof(buf);
+
+    *--p = '\0';
+    do {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+    } while (v > 0);
+    stat_put(out, it, p, 1);
+}
+
+static void stat_put_mode(pb_out_t *out, const stat_item_t *it, unsigned int mode)
+{
+    char buf[11];
+
+    buf[0] = S_ISDIR(mode) ? 'd' : S_ISLNK(mode) ? 'l' : S_ISCHR(mode) ? 'c' :
+             S_ISBLK(mode) ? 'b' : S_ISFIFO(mode) ? 'p' : S_ISSOCK(mode) ? 's' : '-';
+    buf[1] = (mode & S_IRUSR) ? 'r' : '-';
+    buf[2] = (mode & S_IWUSR) ? 'w' : '-';
+    buf[3] = (mode & S_ISUID) ? ((mode & S_IXUSR) ? 's' : 'S') : (mode & S_IXUSR) ? 'x' : '-';
+    buf[4] = (mode & S_IRGRP) ? 'r' : '-';
+    buf[5] = (mode & S_IWGRP) ? 'w' : '-';
+    buf[6] = (mode & S_ISGID) ? ((mode & S_IXGRP) ? 's' : 'S') : (mode & S_IXGRP) ? 'x' : '-';
+    buf[7] = (mode & S_IROTH) ? 'r' : '-';
+    buf[8] = (mode & S_IWOTH) ? 'w' : '-';
+    buf[9] = (mode & S_ISVTX) ? ((mode & S_IXOTH) ? 't' : 'T') : (mode & S_IXOTH) ? 'x' : '-';
+    buf[10] = '\0';
+    stat_put(out, it, buf, 0);
+}
+
+/* One line of -c output for path */
+static void stat_print_format(stat_ctx_t *ctx, const stat_fmt_t *f, const char *path,
+                              const stat_info_t *si)
+{
+    pb_out_t *out = ctx->out;
+    char buf[64];
+
+    for (size_t i = 0; i < f->count; i++) {
+        const stat_item_t *it = &f->items[i];
+        const struct timespec *ts = NULL;
+
+        switch (it->conv) {
+        case 0:
+            pb_out_write(out, it->text, it->len);
+            break;
+        case 'a':
+            snprintf(buf, sizeof(buf), "%o", si->mode & 07777);
+            stat_put(out, it, buf, 1);
+            break;
+        case 'A':
+            stat_put_mode(out, it, si->mode);
+            break;
+        case 'b':
+            stat_put_uint(out, it, si->blocks);
+            break;
+        case 'B':
+            stat_put_uint(out, it, 512);
+            break;
+        case 'd':
+            stat_put_uint(out, it, si->dev);
+            break;
+        case 'f':
+            snprintf(buf, sizeof(buf), "%x", si->mode);
+            stat_put(out, it, buf, 1);
+            break;
+        case 'F':
+            stat_put(out, it, stat_type_name(si->mode, si->size), 0);
+            break;
+        case 'g':
+            stat_put_uint(out, it, si->gid);
+            break;
+        case 'G':
+            stat_put(out, it, stat_id_name(ctx, si->gid, 1), 0);
+            break;
+        case 'h':
+            stat_put_uint(out, it, si->nlink);
+            break;
+        case 'i':
+            stat_put_uint(out, it, si->ino);
+            break;
+        case 'n':
+            stat_put(out, it, path, 0);
+            break;
+        case 'o':
+            stat_put_uint(out, it, si->blksize);
+            break;
+        case 's':
+            stat_put_uint(out, it, si->size);
+            break;
+        case 'u':
+            stat_put_uint(out, it, si->uid);
+            break;
+        case 'U':
+            stat_put(out, it, stat_id_name(ctx, si->uid, 0), 0);
+            break;
+        case 'w':
+        case 'W':
+            if (!si->has_btime) {
+                stat_put(out, it, it->conv == 'w' ? "-" : "0", it->conv == 'W');
+                break;
+            }
+            ts = &si->btime;
+            break;
+        case 'x':
+        case 'X':
+            ts = &si->atime;
+            break;
+        case 'y':
+        case 'Y':
+            ts = &si->mtime;
+            break;
+        case 'z':
+        case 'Z':
+            ts = &si->ctime;
+            break;
+        default:
+            stat_put(out, it, "?", 0);
+            break;
+        }
+
+        if (ts && it->conv >= 'a') {
+            stat_human_time(ts, buf, sizeof(buf));
+            stat_put(out, it, buf, 0);
+        } else if (ts) {
+            if (ts->tv_sec < 0) {
+                snprintf(buf, sizeof(buf), "%lld", (long long)ts->tv_sec);
+                stat_put(out, it, buf, 1);
+            } else {
+                stat_put_uint(out, it, (unsigned long long)ts->tv_sec);
+            }
+        }
+    }
+    pb_out_putc(out, '\n');
+}
+
+/*
+ * stat -c: every file through the one compiled format
+ * Returns: EXIT_OK, or EXIT_ERROR if a file could not be stat'ed
+ */
+static int stat_with_format(const char *format, const char **files, int nfiles)
+{
+    stat_fmt_t f;
+    stat_ctx_t ctx;
+    stat_info_t si;
+    pb_out_t out;
+    int ret = EXIT_OK;
+
+    memset(&ctx, 0, sizeof(ctx));
+    if (stat_compile(format, &f) != 0 || pb_out_init(&out, stdout) != 0) {
+        perror("stat");
+        free(f.items);
+        return EXIT_ERROR;
+    }
+    ctx.out = &out;
+
+    for (int i = 0; i < nfiles; i++) {
+        if (stat_fetch(&ctx, files[i], f.want, &si) != 0) {
+            pb_out_flush(&out);
+            fprintf(stderr, "stat: cannot stat '%s': %s\n", files[i], strerror(errno));
+            ret = EXIT_ERROR;
+            continue;
+        }
+        stat_print_format(&ctx, &f, files[i], &si);
+    }
+
+    if (pb_out_close(&out) != 0 && errno != EPIPE) {
+        perror("stat: write error");
+        ret = EXIT_ERROR;
+    }
+    free(f.items);
+    return ret;
 }
 
 /* ===== SECTION 3: RUN FUNCTION ===== */
@@ -58,7 +589,6 @@ int stat_run(int argc, char **argv)
     /* Handle --help */
     if (stat_help->count > 0) {
         stat_print_usage(stdout);
-        arg_freetable(stat_argtable, 3);
         return EXIT_OK;
     }
 
@@ -66,12 +596,16 @@ int stat_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, stat_end, "stat");
         fprintf(stderr, "Try 'stat --help' for more information.\n");
-        arg_freetable(stat_argtable, 3);
         return EXIT_ERROR;
     }
 
     /* ===== ACTUAL COMMAND LOGIC ===== */
 
+    if (stat_format->count > 0) {
+        ret = stat_with_format(stat_format->sval[0], stat_files->filename, stat_files->count);
+        return ret;
+    }
+
     /* Process each file */
     for (i = 0; i < stat_files->count; i++) {
         const char *filename = stat_files->filename[i];
@@ -99,7 +633,6 @@ int stat_run(int argc, char **argv)
         printf("Change: %s\n", time_buf);
     }
 
-    arg_freetable(stat_argtable, 3);
     return ret;
 }
 
@@ -112,14 +645,20 @@ void stat_print_usage(FILE *out)
     fprintf(out, "Usage: stat ");
     arg_print_syntax(out, stat_argtable, "\n");
     fprintf(out, "Display file or file system status.\n\n");
+    fprintf(out, "FORMAT conversions:\n");
+    fprintf(out, "  %%n name     %%s size      %%b blocks    %%B block size   %%o I/O size\n");
+    fprintf(out, "  %%a mode (octal)   %%A mode (rwx)   %%f raw mode (hex)   %%F file type\n");
+    fprintf(out, "  %%u %%U owner id, name    %%g %%G group id, name    %%h links   %%i inode\n");
+    fprintf(out, "  %%d device    %%x %%y %%z %%w access, modify, change, birth time\n");
+    fprintf(out, "  %%X %%Y %%Z %%W the same in seconds since the Epoch    %%%% a percent sign\n");
+    fprintf(out, "  A width may follow the %%, with - to align left or 0 to pad numbers.\n\n");
     fprintf(out, "Options:\n");
     arg_print_glossary(out, stat_argtable, "  %-25s %s\n");
     fprintf(out, "\n");
     fprintf(out, "Examples:\n");
     fprintf(out, "  stat file.txt            Display status of file.txt\n");
     fprintf(out, "  stat file1.txt file2.txt Display status of multiple files\n");
-
-    arg_freetable(stat_argtable, 3);
+    fprintf(out, "  stat -c '%%s %%Y %%n' *.log  Size, mtime and name, one line per file\n");
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
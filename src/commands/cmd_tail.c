@@ -7,18 +7,47 @@
  * Usage: tail [OPTIONS] [FILE...]
  * Options:
  *   -n, --lines=NUM   Print last NUM lines (default 10)
+ *   -f, --follow      Output appended data as the files grow
+ *   -F                Follow by name, re-opening rotated or re-created files
  *   -h, --help        Display help message
+ *
+ * A regular file is read backwards from its end, so the cost is the
+ * size of the last NUM lines, not of the file. Other input goes
+ * through one window buffer that keeps only the last NUM lines.
+ *
+ * Follow mode waits for the kernel to report changes instead of
+ * polling: one inotify instance (Linux) or kqueue (macOS, BSD) watches
+ * every file, so any number of them share a single event loop.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* pread() */
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#define TAIL_INOTIFY 1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__)
+#include <sys/event.h>
+#define TAIL_KQUEUE 1
+#endif
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
+#include "io_stats.h"
+#include "literal_search.h"
+#include "utils.h"
 
 #define DEFAULT_LINES 10
-#define MAX_LINES 10000
 
 /* Forward declarations */
 int tail_run(int argc, char **argv);
@@ -28,96 +57,573 @@ void tail_print_usage(FILE *out);
 
 static struct arg_lit *tail_help;
 static struct arg_int *tail_lines;
+static struct arg_lit *tail_follow;
+static struct arg_lit *tail_follow_name;
 static struct arg_file *tail_files;
 static struct arg_end *tail_end;
-static void *tail_argtable[5];
+static void *tail_argtable[7];
 
 /* ===== SECTION 2: ARGTABLE BUILDER ===== */
 
 static void build_tail_argtable(void)
 {
+    if (tail_argtable[0] != NULL) {
+        return;
+    }
+
     tail_help = arg_lit0("h", "help", "display this help and exit");
     tail_lines = arg_int0("n", "lines", "NUM", "output the last NUM lines instead of 10");
+    tail_follow = arg_lit0("f", "follow", "output appended data as the file grows");
+    tail_follow_name = arg_lit0("F", NULL, "follow by name and retry: re-open the file if it is rotated");
     tail_files = arg_filen(NULL, NULL, "FILE", 0, 100, "files to process (or stdin if none)");
     tail_end = arg_end(20);
 
     tail_argtable[0] = tail_help;
     tail_argtable[1] = tail_lines;
-    tail_argtable[2] = tail_files;
-    tail_argtable[3] = tail_end;
-    tail_argtable[4] = NULL;
+    tail_argtable[2] = tail_follow;
+    tail_argtable[3] = tail_follow_name;
+    tail_argtable[4] = tail_files;
+    tail_argtable[5] = tail_end;
+    tail_argtable[6] = NULL;
 }
 
 /* ===== HELPER FUNCTION ===== */
 
-static int tail_file(const char *filename, int num_lines)
+#define TAIL_BLOCK (64 * 1024)
+
+/* Write bytes [start, end) of fd to out */
+static int tail_copy(int fd, off_t start, off_t end, FILE *out, char *buf)
 {
-    FILE *fp;
-    char **lines;
-    int count = 0;
-    int start = 0;
-    int i;
-    char buffer[8192];
-    int using_stdin = 0;
+    while (start < end) {
+        size_t want = end - start < TAIL_BLOCK ? (size_t)(end - start) : TAIL_BLOCK;
+        ssize_t n = pread(fd, buf, want, start);
+
+        IO_STATS_READ(n);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        fwrite(buf, 1, (size_t)n, out);
+        start += n;
+    }
 
-    if (filename == NULL || strcmp(filename, "-") == 0) {
-        fp = stdin;
-        using_stdin = 1;
+    return 0;
+}
+
+/*
+ * Last num_lines lines of a regular file of size bytes: read backwards
+ * from the end, one TAIL_BLOCK-aligned block at a time, until enough
+ * newlines are behind us, then copy that range out
+ * Returns: 0, or -1 on a read error
+ */
+static int tail_seekable(int fd, off_t size, long num_lines, FILE *out, char *buf)
+{
+    off_t pos = size;
+    off_t start = 0;
+    long need = num_lines;
+
+    if (num_lines == 0 || size == 0) {
+        return 0;
+    }
+
+    while (pos > 0) {
+        off_t block = pos % TAIL_BLOCK ? pos - pos % TAIL_BLOCK : pos - TAIL_BLOCK;
+        size_t len = (size_t)(pos - block);
+        const char *end;
+        const char *nl;
+        ssize_t n;
+
+        n = pread(fd, buf, len, block);
+        IO_STATS_READ(n);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if ((size_t)n < len) {
+            /* Shrunk under us: start again from the new end */
+            size = block + n;
+            pos = size;
+            need = num_lines;
+            if (size == 0) {
+                return 0;
+            }
+            continue;
+        }
+
+        /* The newline ending the last line does not start another */
+        end = buf + len;
+        if (pos == size && buf[len - 1] == '\n') {
+            end--;
+        }
+        while ((nl = mem_rchr(buf, '\n', (size_t)(end - buf))) != NULL) {
+            if (--need == 0) {
+                start = block + (nl - buf) + 1;
+                return tail_copy(fd, start, size, out, buf);
+            }
+            end = nl;
+        }
+        pos = block;
+    }
+
+    return tail_copy(fd, 0, size, out, buf);
+}
+
+/*
+ * Last num_lines lines of a stream that cannot seek (stdin, a pipe):
+ * keep a window over the input that holds at most num_lines lines,
+ * dropping whole lines from its front as new data comes in. The window
+ * is one buffer, grown when a read will not fit and compacted when
+ * its dead front is larger than what it holds.
+ *
+ * fd: read() it directly, or -1 to read fp through stdio
+ * Returns: 0, or -1 on a read error or out of memory
+ */
+static int tail_stream(FILE *fp, int fd, long num_lines, FILE *out)
+{
+    size_t cap = 4 * TAIL_BLOCK;
+    size_t head = 0;       /* Window is buf[head..len) */
+    size_t len = 0;
+    size_t newlines = 0;   /* '\n' bytes in the window */
+    char *buf;
+    int ret = 0;
+
+    if (num_lines == 0) {
+        return 0;
+    }
+    buf = malloc(cap);
+    if (!buf) {
+        return -1;
+    }
+
+    for (;;) {
+        ssize_t n;
+
+        if (cap - len < TAIL_BLOCK) {
+            if (head >= len - head) {
+                memmove(buf, buf + head, len - head);
+                len -= head;
+                head = 0;
+            } else {
+                char *bigger = realloc(buf, cap * 2);
+
+                if (!bigger) {
+                    ret = -1;
+                    break;
+                }
+                buf = bigger;
+                cap *= 2;
+            }
+            continue;
+        }
+
+        if (fd >= 0) {
+            n = read(fd, buf + len, TAIL_BLOCK);
+            IO_STATS_READ(n);
+        } else {
+            n = (ssize_t)fread(buf + len, 1, TAIL_BLOCK, fp);
+            if (n == 0 && ferror(fp)) {
+                n = -1;
+            }
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ret = -1;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        newlines += literal_count_byte(buf + len, (size_t)n, '\n');
+        len += (size_t)n;
+
+        /* A last line without '\n' is a line too */
+        while (newlines + (buf[len - 1] != '\n') > (size_t)num_lines) {
+            char *nl = memchr(buf + head, '\n', len - head);
+
+            head = (size_t)(nl - buf) + 1;
+            newlines--;
+        }
+    }
+
+    if (ret == 0) {
+        fwrite(buf + head, 1, len - head, out);
+    }
+    free(buf);
+    return ret;
+}
+
+/* ===== FOLLOW MODE ===== */
+
+/* One followed file */
+typedef struct tail_watch {
+    const char *name;
+    int fd;            /* -1 while the name does not open (-F) */
+    dev_t dev;         /* Identity of fd, to notice rotation (-F) */
+    ino_t ino;
+    off_t pos;         /* Bytes of fd already written out */
+    int wd;            /* inotify watch on the file (kqueue: fd), or -1 */
+    int dir_wd;        /* Same for its directory (-F; kqueue: an open fd), or -1 */
+    int dirty;         /* An event came in for it */
+} tail_watch_t;
+
+/* Shared follow state */
+typedef struct tail_follower {
+    tail_watch_t *watches;
+    int count;
+    int by_name;       /* -F: re-open on inode change, retry missing files */
+    int headers;       /* Print ==> name <== when output switches file */
+    int last;          /* Watch whose data was written last */
+    int notify_fd;     /* inotify instance or kqueue, -1 to poll with stat() */
+    FILE *out;
+    char *buf;
+} tail_follower_t;
+
+/* Directory part of name, into dir[size] */
+static void tail_dirname(const char *name, char *dir, size_t size)
+{
+    const char *slash = strrchr(name, '/');
+
+    if (!slash) {
+        snprintf(dir, size, ".");
+    } else if (slash == name) {
+        snprintf(dir, size, "/");
     } else {
-        fp = fopen(filename, "r");
-        if (!fp) {
-            perror(filename);
-            return EXIT_ERROR;
+        snprintf(dir, size, "%.*s", (int)(slash - name), name);
+    }
+}
+
+/* Start watching w->fd (and, for -F, its directory) */
+static void tail_watch_add(tail_follower_t *f, tail_watch_t *w)
+{
+    char dir[4096];
+
+    if (f->notify_fd < 0) {
+        return;
+    }
+    tail_dirname(w->name, dir, sizeof(dir));
+
+#if defined(TAIL_INOTIFY)
+    if (w->fd >= 0) {
+        w->wd = inotify_add_watch(f->notify_fd, w->name,
+                                  IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF);
+    }
+    if (f->by_name && w->dir_wd < 0) {
+        /* Many files in one directory share its watch descriptor */
+        w->dir_wd = inotify_add_watch(f->notify_fd, dir,
+                                      IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM);
+    }
+#elif defined(TAIL_KQUEUE)
+    {
+        struct kevent ev[2];
+        int n = 0;
+
+        if (w->fd >= 0) {
+            EV_SET(&ev[n++], w->fd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+                   NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_DELETE | NOTE_RENAME,
+                   0, w);
+        }
+        if (f->by_name && w->dir_wd < 0) {
+            w->dir_wd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (w->dir_wd >= 0) {
+                EV_SET(&ev[n++], w->dir_wd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+                       NOTE_WRITE, 0, w);
+            }
+        }
+        if (n > 0 && kevent(f->notify_fd, ev, n, NULL, 0, NULL) == 0 && w->fd >= 0) {
+            w->wd = w->fd;
         }
     }
+#else
+    (void)dir;
+#endif
+}
 
-    /* Allocate circular buffer for lines */
-    lines = calloc(num_lines, sizeof(char *));
-    if (!lines) {
-        perror("tail");
-        if (!using_stdin) fclose(fp);
-        return EXIT_ERROR;
+/* Stop following w's current file; the kqueue watch goes with the fd */
+static void tail_watch_close(tail_follower_t *f, tail_watch_t *w)
+{
+#if defined(TAIL_INOTIFY)
+    if (w->wd >= 0) {
+        inotify_rm_watch(f->notify_fd, w->wd);
+    }
+#else
+    (void)f;
+#endif
+    w->wd = -1;
+    if (w->fd >= 0) {
+        close(w->fd);
+        w->fd = -1;
     }
+}
+
+/* Write out whatever w's file gained since last time */
+static int tail_drain(tail_follower_t *f, tail_watch_t *w)
+{
+    struct stat st;
+    int idx = (int)(w - f->watches);
 
-    /* Read all lines, keeping only the last N */
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-        free(lines[count % num_lines]);
-        lines[count % num_lines] = strdup(buffer);
-        count++;
+    if (w->fd < 0 || fstat(w->fd, &st) != 0) {
+        return 0;
+    }
+    if (st.st_size < w->pos) {
+        fprintf(stderr, "tail: %s: file truncated\n", w->name);
+        w->pos = 0;
+    }
+    if (st.st_size == w->pos) {
+        return 0;
     }
 
-    if (ferror(fp)) {
-        perror(filename ? filename : "stdin");
-        if (!using_stdin) fclose(fp);
-        for (i = 0; i < num_lines; i++) free(lines[i]);
-        free(lines);
-        return EXIT_ERROR;
+    if (f->headers && f->last != idx) {
+        fprintf(f->out, "\n==> %s <==\n", w->name);
+    }
+    f->last = idx;
+    if (tail_copy(w->fd, w->pos, st.st_size, f->out, f->buf) != 0) {
+        perror(w->name);
+        return 0;
     }
+    w->pos = st.st_size;
+    fflush(f->out);
+
+    return ferror(f->out) ? -1 : 0;
+}
 
-    /* Calculate where to start printing */
-    if (count < num_lines) {
-        start = 0;
-        num_lines = count;
+/*
+ * -F: see whether w's name still leads to the file we have open. If it
+ * was rotated or re-created, finish the old file and start on the new
+ * one from its beginning.
+ */
+static void tail_check_name(tail_follower_t *f, tail_watch_t *w)
+{
+    struct stat st;
+    int fd;
+
+    if (stat(w->name, &st) != 0) {
+        if (w->fd >= 0) {
+            tail_drain(f, w);
+            fprintf(stderr, "tail: '%s' has become inaccessible: %s\n",
+                    w->name, strerror(errno));
+            tail_watch_close(f, w);
+        }
+        return;
+    }
+    if (w->fd >= 0 && st.st_dev == w->dev && st.st_ino == w->ino) {
+        return;
+    }
+
+    fd = open(w->name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    if (w->fd >= 0) {
+        tail_drain(f, w);
+        fprintf(stderr, "tail: '%s' has been replaced; following new file\n", w->name);
+        tail_watch_close(f, w);
     } else {
-        start = count % num_lines;
+        fprintf(stderr, "tail: '%s' has appeared; following new file\n", w->name);
+    }
+    w->fd = fd;
+    w->dev = st.st_dev;
+    w->ino = st.st_ino;
+    w->pos = 0;
+    tail_watch_add(f, w);
+}
+
+/*
+ * Block until the kernel reports a change, then mark the watches it
+ * concerns. Falls back to a one-second timeout when a watch could not
+ * be placed, and marks everything when that timeout fires.
+ * Returns: 0, or -1 if the notifier failed
+ */
+static int tail_wait(tail_follower_t *f, int timeout_ms)
+{
+    int i;
+
+    if (f->notify_fd < 0) {
+        struct timespec ts = {1, 0};
+
+        nanosleep(&ts, NULL);
+        for (i = 0; i < f->count; i++) {
+            f->watches[i].dirty = 1;
+        }
+        return 0;
+    }
+
+#if defined(TAIL_INOTIFY)
+    {
+        char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        struct pollfd pfd = { f->notify_fd, POLLIN, 0 };
+        ssize_t n;
+        char *p;
+        int ready = poll(&pfd, 1, timeout_ms);
+
+        if (ready < 0) {
+            return errno == EINTR ? 0 : -1;
+        }
+        if (ready == 0) {
+            for (i = 0; i < f->count; i++) {
+                f->watches[i].dirty = 1;
+            }
+            return 0;
+        }
+        n = read(f->notify_fd, events, sizeof(events));
+        if (n < 0) {
+            return errno == EINTR || errno == EAGAIN ? 0 : -1;
+        }
+        for (p = events; p < events + n;
+             p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+
+            for (i = 0; i < f->count; i++) {
+                if (f->watches[i].wd == ev->wd || f->watches[i].dir_wd == ev->wd) {
+                    f->watches[i].dirty = 1;
+                }
+            }
+        }
+    }
+#elif defined(TAIL_KQUEUE)
+    {
+        struct kevent ev[64];
+        struct timespec ts = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+        int n = kevent(f->notify_fd, NULL, 0, ev, 64, timeout_ms < 0 ? NULL : &ts);
+
+        if (n < 0) {
+            return errno == EINTR ? 0 : -1;
+        }
+        if (n == 0) {
+            for (i = 0; i < f->count; i++) {
+                f->watches[i].dirty = 1;
+            }
+        }
+        for (i = 0; i < n; i++) {
+            ((tail_watch_t *)ev[i].udata)->dirty = 1;
+        }
+    }
+#else
+    (void)timeout_ms;
+#endif
+
+    return 0;
+}
+
+/*
+ * Follow the files in f until output fails or, without -F, none is
+ * left to follow. Does not return on its own otherwise.
+ */
+static int tail_follow_loop(tail_follower_t *f)
+{
+    int i;
+
+#if defined(TAIL_INOTIFY)
+    f->notify_fd = inotify_init1(IN_CLOEXEC);
+#elif defined(TAIL_KQUEUE)
+    f->notify_fd = kqueue();
+#endif
+    for (i = 0; i < f->count; i++) {
+        tail_watch_add(f, &f->watches[i]);
+    }
+
+    for (;;) {
+        int live = 0;
+        int timeout = -1;
+
+        for (i = 0; i < f->count; i++) {
+            tail_watch_t *w = &f->watches[i];
+
+            if (w->fd >= 0 || f->by_name) {
+                live++;
+            }
+            /* Without a watch, only a timeout notices changes */
+            if ((w->fd >= 0 && w->wd < 0) || (f->by_name && w->dir_wd < 0)) {
+                timeout = 1000;
+            }
+        }
+        if (live == 0) {
+            break;
+        }
+
+        if (tail_wait(f, timeout) != 0) {
+            perror("tail");
+            break;
+        }
+        for (i = 0; i < f->count; i++) {
+            tail_watch_t *w = &f->watches[i];
+
+            if (!w->dirty) {
+                continue;
+            }
+            w->dirty = 0;
+            if (f->by_name) {
+                tail_check_name(f, w);
+            }
+            if (tail_drain(f, w) != 0) {
+                goto out;
+            }
+        }
     }
 
-    /* Print the last N lines */
-    for (i = 0; i < num_lines; i++) {
-        int idx = (start + i) % num_lines;
-        if (lines[idx]) {
-            printf("%s", lines[idx]);
+out:
+    for (i = 0; i < f->count; i++) {
+        tail_watch_close(f, &f->watches[i]);
+#if defined(TAIL_KQUEUE)
+        if (f->watches[i].dir_wd >= 0) {
+            close(f->watches[i].dir_wd);
         }
+#endif
     }
+    if (f->notify_fd >= 0) {
+        close(f->notify_fd);
+    }
+
+    return EXIT_ERROR;
+}
 
-    /* Cleanup */
-    for (i = 0; i < num_lines; i++) {
-        free(lines[i]);
+/*
+ * Print the tail of one file. With w, a regular file is left open in
+ * it, positioned after what was printed, for follow mode.
+ */
+static int tail_file(const char *filename, long num_lines, char *buf, tail_watch_t *w)
+{
+    struct stat st;
+    int fd;
+    int ret;
+
+    if (filename == NULL || strcmp(filename, "-") == 0) {
+        ret = tail_stream(cmd_stdin(), -1, num_lines, cmd_stdout());
+    } else {
+        fd = open(filename, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            perror(filename);
+            return EXIT_ERROR;
+        }
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            ret = tail_seekable(fd, st.st_size, num_lines, cmd_stdout(), buf);
+            if (w && ret == 0) {
+                w->fd = fd;
+                w->dev = st.st_dev;
+                w->ino = st.st_ino;
+                w->pos = st.st_size;
+                return EXIT_OK;
+            }
+        } else {
+            ret = tail_stream(NULL, fd, num_lines, cmd_stdout());
+        }
+        close(fd);
     }
-    free(lines);
 
-    if (!using_stdin) {
-        fclose(fp);
+    if (ret != 0) {
+        perror(filename ? filename : "stdin");
+        return EXIT_ERROR;
     }
 
     return EXIT_OK;
@@ -128,18 +634,20 @@ static int tail_file(const char *filename, int num_lines)
 int tail_run(int argc, char **argv)
 {
     int nerrors;
-    int num_lines = DEFAULT_LINES;
+    long num_lines = DEFAULT_LINES;
+    char *buf;
     int i;
     int ret = EXIT_OK;
     int multiple_files;
+    int follow;
+    tail_follower_t follower;
 
     build_tail_argtable();
-    nerrors = arg_parse(argc, argv, tail_argtable);
+    nerrors = cmd_arg_parse(argc, argv, tail_argtable);
 
     /* Handle --help */
     if (tail_help->count > 0) {
-        tail_print_usage(stdout);
-        arg_freetable(tail_argtable, 4);
+        tail_print_usage(cmd_stdout());
         return EXIT_OK;
     }
 
@@ -147,7 +655,6 @@ int tail_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, tail_end, "tail");
         fprintf(stderr, "Try 'tail --help' for more information.\n");
-        arg_freetable(tail_argtable, 4);
         return EXIT_ERROR;
     }
 
@@ -156,20 +663,49 @@ int tail_run(int argc, char **argv)
     /* Get number of lines if specified */
     if (tail_lines->count > 0) {
         num_lines = tail_lines->ival[0];
-        if (num_lines < 0 || num_lines > MAX_LINES) {
-            fprintf(stderr, "tail: invalid number of lines: '%d'\n", num_lines);
-            arg_freetable(tail_argtable, 4);
+        if (num_lines < 0) {
+            fprintf(stderr, "tail: invalid number of lines: '%ld'\n", num_lines);
             return EXIT_ERROR;
         }
     }
 
-    /* If no files specified, read from stdin */
+    buf = malloc(TAIL_BLOCK);
+    if (!buf) {
+        perror("tail");
+        return EXIT_ERROR;
+    }
+
+    /* If no files specified, read from stdin (which is never followed) */
     if (tail_files->count == 0) {
-        ret = tail_file(NULL, num_lines);
-        arg_freetable(tail_argtable, 4);
+        ret = tail_file(NULL, num_lines, buf, NULL);
+        free(buf);
         return ret;
     }
 
+    follow = tail_follow->count > 0 || tail_follow_name->count > 0;
+    if (follow) {
+        memset(&follower, 0, sizeof(follower));
+        follower.watches = calloc((size_t)tail_files->count, sizeof(tail_watch_t));
+        if (!follower.watches) {
+            perror("tail");
+            free(buf);
+            return EXIT_ERROR;
+        }
+        follower.count = tail_files->count;
+        follower.by_name = tail_follow_name->count > 0;
+        follower.headers = tail_files->count > 1;
+        follower.last = tail_files->count - 1;
+        follower.notify_fd = -1;
+        follower.out = cmd_stdout();
+        follower.buf = buf;
+        for (i = 0; i < follower.count; i++) {
+            follower.watches[i].name = tail_files->filename[i];
+            follower.watches[i].fd = -1;
+            follower.watches[i].wd = -1;
+            follower.watches[i].dir_wd = -1;
+        }
+    }
+
     /* Check if we have multiple files (for headers) */
     multiple_files = (tail_files->count > 1);
 
@@ -178,17 +714,26 @@ int tail_run(int argc, char **argv)
         /* Print header if multiple files */
         if (multiple_files) {
             if (i > 0) {
-                printf("\n");
+                fprintf(cmd_stdout(), "\n");
             }
-            printf("==> %s <==\n", tail_files->filename[i]);
+            fprintf(cmd_stdout(), "==> %s <==\n", tail_files->filename[i]);
         }
 
-        if (tail_file(tail_files->filename[i], num_lines) != EXIT_OK) {
+        if (tail_file(tail_files->filename[i], num_lines, buf,
+                      follow ? &follower.watches[i] : NULL) != EXIT_OK) {
             ret = EXIT_ERROR;
         }
     }
 
-    arg_freetable(tail_argtable, 4);
+    if (follow) {
+        fflush(cmd_stdout());
+        if (tail_follow_loop(&follower) != EXIT_OK) {
+            ret = EXIT_ERROR;
+        }
+        free(follower.watches);
+    }
+
+    free(buf);
     return ret;
 }
 
@@ -210,8 +755,8 @@ void tail_print_usage(FILE *out)
     fprintf(out, "  tail file.txt             Print last 10 lines of file.txt\n");
     fprintf(out, "  tail -n 20 file.txt       Print last 20 lines\n");
     fprintf(out, "  tail file1 file2          Print last 10 lines of each file\n");
-
-    arg_freetable(tail_argtable, 4);
+    fprintf(out, "  tail -f app.log           Keep printing lines as they are appended\n");
+    fprintf(out, "  tail -F a.log b.log       Follow both, even across log rotation\n");
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -220,9 +765,11 @@ cmd_spec_t cmd_tail_spec = {
     .name = "tail",
     .summary = "output the last part of files",
     .long_help = "Print the last 10 lines of each FILE to standard output. "
-                 "With more than one FILE, precede each with a header giving the file name.",
+                 "With more than one FILE, precede each with a header giving the file name. "
+                 "With -f or -F, keep printing data as it is appended.",
     .run = tail_run,
-    .print_usage = tail_print_usage
+    .print_usage = tail_print_usage,
+    .flags = CMD_FLAG_STREAMS
 };
 
 /* ===== SECTION 6: REGISTRATION FUNCTION ===== */
@@ -0,0 +1,517 @@
+/*
+ * cmd_tee.c - Copy standard input to standard output and to files
+ *
+ * Usage: tee [OPTIONS] [FILE...]
+ * Options:
+ *   -a, --append      Append to the FILEs instead of overwriting them
+ *   -h, --help        Display help message
+ *
+ * When stdin and stdout are both pipes (a forked pipeline stage) the
+ * data never comes into user space on Linux: each round tee()s what is
+ * waiting in the input pipe into a private pipe per FILE, which only
+ * takes references to the pages, then splice()s the input on to stdout
+ * and each private pipe into its file. A file the kernel will not
+ * splice into (one opened for appending, on some kernels) gets its pipe
+ * drained with read()/write() instead, and the rest keep going.
+ *
+ * Anything else goes through a large read()/write() loop, or, for a
+ * stream without a descriptor (a threaded pipeline's ring) or stdin
+ * with input already buffered in the FILE, through the line reader,
+ * so each line is passed on as it comes.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* tee(), splice(), pipe2(), F_SETPIPE_SZ */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "argtable3.h"
+#include "cmd_spec.h"
+#include "picobox.h"
+#include "utils.h"
+
+/* Forward declarations */
+int tee_run(int argc, char **argv);
+void tee_print_usage(FILE *out);
+
+/* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
+
+static struct arg_lit *tee_help;
+static struct arg_lit *tee_append;
+static struct arg_file *tee_files;
+static struct arg_end *tee_end;
+static void *tee_argtable[5];
+
+/* ===== SECTION 2: ARGTABLE BUILDER ===== */
+
+static void build_tee_argtable(void)
+{
+    if (tee_argtable[0] != NULL) {
+        return;
+    }
+
+    tee_help = arg_lit0("h", "help", "display this help and exit");
+    tee_append = arg_lit0("a", "append", "append to the given FILEs, do not overwrite");
+    tee_files = arg_filen(NULL, NULL, "FILE", 0, 100, "files to write a copy to");
+    tee_end = arg_end(20);
+
+    tee_argtable[0] = tee_help;
+    tee_argtable[1] = tee_append;
+    tee_argtable[2] = tee_files;
+    tee_argtable[3] = tee_end;
+    tee_argtable[4] = NULL;
+}
+
+/* ===== HELPER FUNCTIONS ===== */
+
+/* Pipe size asked for each file's private pipe, and the copy buffer */
+#define TEE_CHUNK (1024 * 1024)
+#define TEE_BUFFER (128 * 1024)
+
+typedef struct tee_out {
+    const char *name;
+    int fd;                    /* -1 once writing to it failed */
+    int pipe[2];               /* Kernel path: this file's copy of the data */
+    int copy;                  /* The kernel will not splice into fd */
+} tee_out_t;
+
+/*
+ * Write all of buf to fd
+ * Returns: 0, or -1 on error (errno set)
+ */
+static int tee_write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t w = write(fd, buf, len);
+
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+/* Report a file that could not be written and stop writing to it */
+static void tee_fail(tee_out_t *o)
+{
+    perror(o->name);
+    close(o->fd);
+    o->fd = -1;
+}
+
+/* Write buf to every file still being written. Returns: 0, or -1 if one failed */
+static int tee_files_write(tee_out_t *outs, int nouts, const char *buf, size_t len)
+{
+    int ret = 0;
+    int i;
+
+    for (i = 0; i < nouts; i++) {
+        if (outs[i].fd >= 0 && tee_write_all(outs[i].fd, buf, len) != 0) {
+            tee_fail(&outs[i]);
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+#ifdef __linux__
+/*
+ * Move the len bytes in o's private pipe to its file: splice() while
+ * the kernel takes it, else through buf. A file that fails is dropped,
+ * but its pipe is still emptied for the next round.
+ * Returns: 0, or -1 if the file failed
+ */
+static int tee_drain(tee_out_t *o, size_t len, char *buf)
+{
+    int ret = 0;
+
+    while (len > 0) {
+        ssize_t n;
+
+        if (o->fd >= 0 && !o->copy) {
+            n = splice(o->pipe[0], NULL, o->fd, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n > 0) {
+                len -= (size_t)n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && errno != EINVAL && errno != ENOSYS) {
+                tee_fail(o);
+                ret = -1;
+                continue;
+            }
+            o->copy = 1;
+        }
+
+        n = read(o->pipe[0], buf, len < TEE_BUFFER ? len : TEE_BUFFER);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (o->fd >= 0 && tee_write_all(o->fd, buf, (size_t)n) != 0) {
+            tee_fail(o);
+            ret = -1;
+        }
+        len -= (size_t)n;
+    }
+    return ret;
+}
+
+static void tee_close_pipes(tee_out_t *outs, int nouts)
+{
+    int i;
+
+    for (i = 0; i < nouts; i++) {
+        if (outs[i].pipe[0] >= 0) {
+            close(outs[i].pipe[0]);
+            close(outs[i].pipe[1]);
+            outs[i].pipe[0] = outs[i].pipe[1] = -1;
+        }
+    }
+}
+#endif
+
+/*
+ * Copy pipe in_fd to pipe out_fd and to the files, inside the kernel
+ * Returns: 1 when done (*status says how it went), 0 if nothing was
+ * read and the caller should copy through user space instead
+ */
+static int tee_kernel(int in_fd, int out_fd, tee_out_t *outs, int nouts, int *status)
+{
+#ifdef __linux__
+    struct stat in_st, out_st;
+    size_t chunk = TEE_CHUNK;
+    char *buf = NULL;
+    int started = 0;
+    int i;
+
+    if (fstat(in_fd, &in_st) != 0 || fstat(out_fd, &out_st) != 0 ||
+        !S_ISFIFO(in_st.st_mode) || !S_ISFIFO(out_st.st_mode)) {
+        return 0;
+    }
+
+    /*
+     * tee() copies no more than the target pipe has room for, and a
+     * second call starts over at the head of the input: every private
+     * pipe must take a whole round, so rounds are as large as the
+     * smallest of them
+     */
+    for (i = 0; i < nouts; i++) {
+        int size;
+
+        if (outs[i].fd < 0) {
+            continue;
+        }
+        if (pipe2(outs[i].pipe, O_CLOEXEC) != 0) {
+            tee_close_pipes(outs, nouts);
+            return 0;
+        }
+        fcntl(outs[i].pipe[1], F_SETPIPE_SZ, TEE_CHUNK);
+        size = fcntl(outs[i].pipe[1], F_GETPIPE_SZ);
+        if (size > 0 && (size_t)size < chunk) {
+            chunk = (size_t)size;
+        }
+    }
+    if (nouts > 0) {
+        buf = malloc(TEE_BUFFER);
+        if (!buf) {
+            tee_close_pipes(outs, nouts);
+            return 0;
+        }
+    }
+
+    *status = EXIT_OK;
+    for (;;) {
+        ssize_t n = -1;
+        size_t moved = 0;
+
+        /* Give each file its copy of what is waiting, without consuming it */
+        for (i = 0; i < nouts; i++) {
+            ssize_t m;
+
+            if (outs[i].fd < 0) {
+                continue;
+            }
+            do {
+                m = tee(in_fd, outs[i].pipe[1], n < 0 ? chunk : (size_t)n, 0);
+            } while (m < 0 && errno == EINTR);
+            if (m < 0) {
+                if (!started) {
+                    /* No tee() for these pipes: nothing is lost yet */
+                    free(buf);
+                    tee_close_pipes(outs, nouts);
+                    return 0;
+                }
+                perror("tee");
+                *status = EXIT_ERROR;
+                goto done;
+            }
+            if (n < 0) {
+                n = m;
+            }
+        }
+        if (n == 0) {
+            break;          /* End of input */
+        }
+
+        /* Move the round to stdout, consuming it */
+        while (n < 0 || moved < (size_t)n) {
+            ssize_t s = splice(in_fd, NULL, out_fd, NULL, n < 0 ? TEE_CHUNK : (size_t)n - moved,
+                               SPLICE_F_MOVE | SPLICE_F_MORE);
+
+            if (s < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (!started && errno == EINVAL) {
+                    free(buf);
+                    tee_close_pipes(outs, nouts);
+                    return 0;
+                }
+                if (errno != EPIPE) {
+                    perror("tee: write error");
+                }
+                *status = EXIT_ERROR;
+                goto done;
+            }
+            if (n < 0) {
+                n = s;      /* No files: a round is what one splice() moved */
+                if (s == 0) {
+                    goto done;
+                }
+                break;
+            }
+            moved += (size_t)s;
+        }
+        started = 1;
+
+        for (i = 0; i < nouts; i++) {
+            if (outs[i].fd >= 0 && tee_drain(&outs[i], (size_t)n, buf) != 0) {
+                *status = EXIT_ERROR;
+            }
+        }
+    }
+
+done:
+    free(buf);
+    tee_close_pipes(outs, nouts);
+    return 1;
+#else
+    (void)in_fd;
+    (void)out_fd;
+    (void)outs;
+    (void)nouts;
+    (void)status;
+    return 0;
+#endif
+}
+
+/* Write a block to stdout. Returns: 0, or -1 after reporting the error */
+static int tee_stdout(FILE *out, int out_fd, const char *buf, size_t len)
+{
+    if (out_fd >= 0 ? tee_write_all(out_fd, buf, len) != 0
+                    : fwrite(buf, 1, len, out) != len || fflush(out) != 0) {
+        if (errno != EPIPE) {
+            perror("tee: write error");
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/* Copy through user space. Returns: EXIT_OK or EXIT_ERROR */
+static int tee_copy(FILE *in, FILE *out, tee_out_t *outs, int nouts)
+{
+    int in_fd = fileno(in);
+    int out_fd = fileno(out);
+    int status = EXIT_OK;
+
+    if (out_fd >= 0) {
+        fflush(out);
+    }
+
+    if (in_fd >= 0 && !stream_input_pending(in)) {
+        char *buf = malloc(TEE_BUFFER);
+        ssize_t n;
+
+        if (!buf) {
+            perror("tee");
+            return EXIT_ERROR;
+        }
+        while ((n = read(in_fd, buf, TEE_BUFFER)) != 0) {
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("stdin");
+                status = EXIT_ERROR;
+                break;
+            }
+            if (tee_files_write(outs, nouts, buf, (size_t)n) != 0) {
+                status = EXIT_ERROR;
+            }
+            if (tee_stdout(out, out_fd, buf, (size_t)n) != 0) {
+                status = EXIT_ERROR;
+                break;
+            }
+        }
+        free(buf);
+    } else {
+        line_reader_t lr;
+        const char *data;
+        size_t len;
+        int r;
+
+        if (line_reader_init_stream(&lr, in) != 0) {
+            perror("tee");
+            return EXIT_ERROR;
+        }
+        while ((r = line_reader_lines(&lr, &data, &len)) > 0) {
+            if (tee_files_write(outs, nouts, data, len) != 0) {
+                status = EXIT_ERROR;
+            }
+            if (tee_stdout(out, out_fd, data, len) != 0) {
+                status = EXIT_ERROR;
+                break;
+            }
+        }
+        if (r < 0) {
+            perror("stdin");
+            status = EXIT_ERROR;
+        }
+        line_reader_free(&lr);
+    }
+    return status;
+}
+
+/* ===== SECTION 3: RUN FUNCTION ===== */
+
+int tee_run(int argc, char **argv)
+{
+    int nerrors;
+    tee_out_t *outs;
+    int nouts;
+    FILE *in;
+    FILE *out;
+    int flags;
+    int status = EXIT_OK;
+    int ret = EXIT_OK;
+    int i;
+
+    build_tee_argtable();
+    nerrors = cmd_arg_parse(argc, argv, tee_argtable);
+
+    /* Handle --help */
+    if (tee_help->count > 0) {
+        tee_print_usage(cmd_stdout());
+        return EXIT_OK;
+    }
+
+    /* Handle parsing errors */
+    if (nerrors > 0) {
+        arg_print_errors(stderr, tee_end, "tee");
+        fprintf(stderr, "Try 'tee --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
+    /* ===== ACTUAL COMMAND LOGIC ===== */
+
+    nouts = tee_files->count;
+    outs = calloc(nouts > 0 ? (size_t)nouts : 1, sizeof(*outs));
+    if (!outs) {
+        perror("tee");
+        return EXIT_ERROR;
+    }
+
+    /* A file that cannot be opened is reported; the others still get a copy */
+    flags = O_WRONLY | O_CREAT | O_CLOEXEC | (tee_append->count > 0 ? O_APPEND : O_TRUNC);
+    for (i = 0; i < nouts; i++) {
+        outs[i].name = tee_files->filename[i];
+        outs[i].pipe[0] = outs[i].pipe[1] = -1;
+        outs[i].fd = open(outs[i].name, flags, 0666);
+        if (outs[i].fd < 0) {
+            perror(outs[i].name);
+            ret = EXIT_ERROR;
+        }
+    }
+
+    in = cmd_stdin();
+    out = cmd_stdout();
+    fflush(out);
+    if (fileno(in) < 0 || fileno(out) < 0 || stream_input_pending(in) ||
+        !tee_kernel(fileno(in), fileno(out), outs, nouts, &status)) {
+        status = tee_copy(in, out, outs, nouts);
+    }
+    if (status != EXIT_OK) {
+        ret = EXIT_ERROR;
+    }
+
+    for (i = 0; i < nouts; i++) {
+        if (outs[i].fd >= 0 && close(outs[i].fd) != 0) {
+            perror(outs[i].name);
+            ret = EXIT_ERROR;
+        }
+    }
+    free(outs);
+    return ret;
+}
+
+/* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
+
+void tee_print_usage(FILE *out)
+{
+    build_tee_argtable();
+
+    fprintf(out, "Usage: tee ");
+    arg_print_syntax(out, tee_argtable, "\n");
+    fprintf(out, "Copy standard input to each FILE, and also to standard output.\n\n");
+    fprintf(out, "Options:\n");
+    arg_print_glossary(out, tee_argtable, "  %-20s %s\n");
+    fprintf(out, "\n");
+    fprintf(out, "Examples:\n");
+    fprintf(out, "  make 2>&1 | tee build.log        Watch a build and keep its log\n");
+    fprintf(out, "  cat data | tee -a audit | wc -l  Append a copy to audit, count lines\n");
+}
+
+/* ===== SECTION 5: COMMAND SPECIFICATION ===== */
+
+cmd_spec_t cmd_tee_spec = {
+    .name = "tee",
+    .summary = "copy standard input to standard output and files",
+    .long_help = "Copy standard input to each FILE, and also to standard output. "
+                 "Between pipes the data is duplicated inside the kernel.",
+    .run = tee_run,
+    .print_usage = tee_print_usage,
+    .flags = CMD_FLAG_STREAMS
+};
+
+/* ===== SECTION 6: REGISTRATION FUNCTION ===== */
+
+void register_tee_command(void)
+{
+    register_command(&cmd_tee_spec);
+}
+
+/* ===== SECTION 7: STANDALONE MAIN ===== */
+
+#ifndef BUILTIN_ONLY
+int main(int argc, char **argv)
+{
+    return cmd_tee_spec.run(argc, argv);
+}
+#endif
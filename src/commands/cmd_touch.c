@@ -7,18 +7,31 @@
  * Usage: touch [OPTIONS] FILE...
  * Options:
  *   -c, --no-create   Do not create file if it doesn't exist
+ *   --from-file=FILE  Also touch the files listed in FILE
+ *   -0, --null        Names in FILE end with NUL rather than newline
  *   -h, --help        Display help message
+ *
+ * Files are created with openat() and their times set with utimensat()
+ * on the directory they are in, opened through a dir_cursor
+ * (dir_cursor.h), so a list of files in the same few directories looks
+ * each directory up once rather than once per file.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* openat(), utimensat() and getdelim() */
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/stat.h>
-#include <utime.h>
 #include <unistd.h>
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
+#include "dir_cursor.h"
 
 /* Forward declarations */
 int touch_run(int argc, char **argv);
@@ -28,24 +41,35 @@ void touch_print_usage(FILE *out);
 
 static struct arg_lit *touch_help;
 static struct arg_lit *touch_no_create;
+static struct arg_file *touch_from;
+static struct arg_lit *touch_null;
 static struct arg_file *touch_files;
 static struct arg_end *touch_end;
-static void *touch_argtable[5];
+static void *touch_argtable[7];
 
 /* ===== SECTION 2: ARGTABLE BUILDER ===== */
 
 static void build_touch_argtable(void)
 {
+    if (touch_argtable[0] != NULL) {
+        return;
+    }
+
     touch_help = arg_lit0("h", "help", "display this help and exit");
     touch_no_create = arg_lit0("c", "no-create", "do not create any files");
-    touch_files = arg_filen(NULL, NULL, "FILE", 1, 100, "files to touch");
+    touch_from = arg_file0(NULL, "from-file", "FILE",
+                           "also touch the files listed in FILE (- for stdin), one per line");
+    touch_null = arg_lit0("0", "null", "with --from-file, names end with NUL, not newline");
+    touch_files = arg_filen(NULL, NULL, "FILE", 0, 100, "files to touch");
     touch_end = arg_end(20);
 
     touch_argtable[0] = touch_help;
     touch_argtable[1] = touch_no_create;
-    touch_argtable[2] = touch_files;
-    touch_argtable[3] = touch_end;
-    touch_argtable[4] = NULL;
+    touch_argtable[2] = touch_from;
+    touch_argtable[3] = touch_null;
+    touch_argtable[4] = touch_files;
+    touch_argtable[5] = touch_end;
+    touch_argtable[6] = NULL;
 }
 
 /* ===== HELPER FUNCTION ===== */
@@ -53,44 +77,91 @@ static void build_touch_argtable(void)
 /*
  * Touch a single file - create if doesn't exist, update timestamp if it does
  */
-static int touch_file(const char *filename, int no_create)
+static int touch_file(dir_cursor_t *dc, const char *filename, int no_create)
 {
+    const char *name;
+    size_t dir_len;
+    size_t name_len;
+    int dirfd;
     int fd;
-    struct stat st;
 
-    /* Check if file exists */
-    if (stat(filename, &st) == 0) {
-        /* File exists - update its timestamp */
-        if (utime(filename, NULL) != 0) {
-            perror(filename);
-            return EXIT_ERROR;
+    dir_cursor_split(filename, &dir_len, &name, &name_len);
+    dirfd = dir_cursor_open(dc, filename, dir_len, 0, 0);
+    if (dirfd == -1) {
+        if (no_create && errno == ENOENT) {
+            return EXIT_OK;
         }
-        return EXIT_OK;
+        perror(filename);
+        return EXIT_ERROR;
     }
 
-    /* File doesn't exist */
-    if (no_create) {
-        /* -c flag: don't create, just silently succeed */
-        return EXIT_OK;
+    if (!no_create) {
+        /* Create the file; one already there just gets its times set */
+        fd = openat(dirfd, name, O_CREAT | O_WRONLY | O_EXCL | O_NOCTTY | O_CLOEXEC, 0666);
+        if (fd >= 0) {
+            close(fd);
+            return EXIT_OK;
+        }
+        if (errno != EEXIST) {
+            perror(filename);
+            return EXIT_ERROR;
+        }
     }
 
-    /* Create the file */
-    fd = open(filename, O_CREAT | O_WRONLY | O_EXCL, 0666);
-    if (fd < 0) {
+    if (utimensat(dirfd, name, NULL, 0) != 0) {
+        /* -c flag: a file that is not there is silently skipped */
+        if (no_create && errno == ENOENT) {
+            return EXIT_OK;
+        }
         perror(filename);
         return EXIT_ERROR;
     }
-
-    close(fd);
     return EXIT_OK;
 }
 
+/*
+ * Touch every file named in --from-file, one per line or with -0 one
+ * per NUL
+ * Returns: EXIT_OK, or EXIT_ERROR if any failed
+ */
+static int touch_from_file(dir_cursor_t *dc, const char *list, int delim, int no_create)
+{
+    FILE *in = strcmp(list, "-") == 0 ? cmd_stdin() : fopen(list, "r");
+    char *buf = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    int ret = EXIT_OK;
+
+    if (!in) {
+        perror(list);
+        return EXIT_ERROR;
+    }
+    while ((len = getdelim(&buf, &cap, delim, in)) >= 0) {
+        if (len > 0 && buf[len - 1] == delim) {
+            buf[--len] = '\0';
+        }
+        if (len > 0 && touch_file(dc, buf, no_create) != EXIT_OK) {
+            ret = EXIT_ERROR;
+        }
+    }
+    if (ferror(in)) {
+        perror(list);
+        ret = EXIT_ERROR;
+    }
+    free(buf);
+    if (in != cmd_stdin()) {
+        fclose(in);
+    }
+    return ret;
+}
+
 /* ===== SECTION 3: RUN FUNCTION ===== */
 
 int touch_run(int argc, char **argv)
 {
     int nerrors;
     int no_create = 0;
+    dir_cursor_t dc;
     int i;
     int ret = EXIT_OK;
 
@@ -100,7 +171,6 @@ int touch_run(int argc, char **argv)
     /* Handle --help */
     if (touch_help->count > 0) {
         touch_print_usage(stdout);
-        arg_freetable(touch_argtable, 4);
         return EXIT_OK;
     }
 
@@ -108,25 +178,36 @@ int touch_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, touch_end, "touch");
         fprintf(stderr, "Try 'touch --help' for more information.\n");
-        arg_freetable(touch_argtable, 4);
         return EXIT_ERROR;
     }
 
     /* ===== ACTUAL COMMAND LOGIC ===== */
 
+    if (touch_files->count == 0 && touch_from->count == 0) {
+        fprintf(stderr, "touch: missing file operand\n");
+        fprintf(stderr, "Try 'touch --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
     /* Check if -c flag was specified */
     if (touch_no_create->count > 0) {
         no_create = 1;
     }
 
-    /* Touch each file */
+    /* Touch each file, the directory it is in kept open for the next */
+    dir_cursor_init(&dc);
     for (i = 0; i < touch_files->count; i++) {
-        if (touch_file(touch_files->filename[i], no_create) != EXIT_OK) {
+        if (touch_file(&dc, touch_files->filename[i], no_create) != EXIT_OK) {
             ret = EXIT_ERROR;
         }
     }
+    if (touch_from->count > 0 &&
+        touch_from_file(&dc, touch_from->filename[0], touch_null->count > 0 ? '\0' : '\n',
+                        no_create) != EXIT_OK) {
+        ret = EXIT_ERROR;
+    }
+    dir_cursor_free(&dc);
 
-    arg_freetable(touch_argtable, 4);
     return ret;
 }
 
@@ -147,8 +228,8 @@ void touch_print_usage(FILE *out)
     fprintf(out, "  touch file.txt         Create file.txt or update its timestamp\n");
     fprintf(out, "  touch -c existing.txt  Update timestamp only if file exists\n");
     fprintf(out, "  touch f1.txt f2.txt    Touch multiple files\n");
-
-    arg_freetable(touch_argtable, 4);
+    fprintf(out, "  find . --type f | touch --from-file=-\n");
+    fprintf(out, "                         Touch every file named on stdin\n");
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
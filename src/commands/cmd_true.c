@@ -32,6 +32,10 @@ static void *true_argtable[3];
 
 static void build_true_argtable(void)
 {
+    if (true_argtable[0] != NULL) {
+        return;
+    }
+
     true_help = arg_lit0("h", "help", "display this help and exit");
     true_end = arg_end(20);
 
@@ -47,26 +51,23 @@ int true_run(int argc, char **argv)
     int nerrors;
 
     build_true_argtable();
-    nerrors = arg_parse(argc, argv, true_argtable);
+    nerrors = cmd_arg_parse(argc, argv, true_argtable);
 
     /* Handle --help */
     if (true_help->count > 0) {
-        true_print_usage(stdout);
-        arg_freetable(true_argtable, 2);
+        true_print_usage(cmd_stdout());
         return EXIT_OK;
     }
 
     /* Handle parsing errors (though true ignores most arguments) */
     if (nerrors > 0) {
         /* Even with errors, true still succeeds! */
-        arg_freetable(true_argtable, 2);
         return EXIT_OK;
     }
 
     /* ===== ACTUAL COMMAND LOGIC ===== */
     /* true always succeeds, nothing to do */
 
-    arg_freetable(true_argtable, 2);
     return EXIT_OK;
 }
 
@@ -87,8 +88,6 @@ void true_print_usage(FILE *out)
     fprintf(out, "  while true; do\n");
     fprintf(out, "    # commands\n");
     fprintf(out, "  done\n");
-
-    arg_freetable(true_argtable, 2);
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -99,7 +98,8 @@ cmd_spec_t cmd_true_spec = {
     .long_help = "Exit with a status code indicating success. "
                  "The true utility always returns 0 (success).",
     .run = true_run,
-    .print_usage = true_print_usage
+    .print_usage = true_print_usage,
+    .flags = CMD_FLAG_STREAMS
 };
 
 /* ===== SECTION 6: REGISTRATION FUNCTION ===== */
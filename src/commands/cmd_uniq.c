@@ -0,0 +1,460 @@
+/*
+ * cmd_uniq.c - Report or omit repeated lines
+ *
+ * Usage: uniq [OPTIONS] [INPUT [OUTPUT]]
+ * Options:
+ *   -c, --count       Prefix lines with the number of occurrences
+ *   -d, --repeated    Only print lines that occur more than once
+ *   -u, --unique      Only print lines that occur once
+ *   --hash            Count equal lines wherever they are, not only adjacent
+ *   -h, --help        Display help message
+ *
+ * Without --hash the input is streamed through the shared line reader
+ * and each line compared with a copy of the one before, so uniq holds
+ * one line at a time and is usually fed by sort.
+ *
+ * With --hash every distinct line is kept, once, in an arena, and
+ * found again through an open-addressing table of its hash; lines are
+ * written in the order they were first seen, after the whole input is
+ * read. `uniq --hash -c` gives the counts of `sort | uniq -c` without
+ * sorting, in memory proportional to the distinct lines rather than to
+ * the input.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* O_CLOEXEC */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "argtable3.h"
+#include "cmd_spec.h"
+#include "picobox.h"
+#include "arena.h"
+#include "pb_out.h"
+#include "utils.h"
+
+/* Forward declarations */
+int uniq_run(int argc, char **argv);
+void uniq_print_usage(FILE *out);
+
+/* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
+
+static struct arg_lit *uniq_help;
+static struct arg_lit *uniq_count;
+static struct arg_lit *uniq_repeated;
+static struct arg_lit *uniq_unique;
+static struct arg_lit *uniq_hash;
+static struct arg_file *uniq_files;
+static struct arg_end *uniq_end;
+static void *uniq_argtable[8];
+
+/* ===== SECTION 2: ARGTABLE BUILDER ===== */
+
+static void build_uniq_argtable(void)
+{
+    if (uniq_argtable[0] != NULL) {
+        return;
+    }
+
+    uniq_help = arg_lit0("h", "help", "display this help and exit");
+    uniq_count = arg_lit0("c", "count", "prefix lines by the number of occurrences");
+    uniq_repeated = arg_lit0("d", "repeated", "only print lines that occur more than once");
+    uniq_unique = arg_lit0("u", "unique", "only print lines that occur once");
+    uniq_hash = arg_lit0(NULL, "hash", "count equal lines anywhere in the input, not just adjacent");
+    uniq_files = arg_filen(NULL, NULL, "INPUT [OUTPUT]", 0, 2,
+                           "read INPUT (or stdin), write OUTPUT (or stdout)");
+    uniq_end = arg_end(20);
+
+    uniq_argtable[0] = uniq_help;
+    uniq_argtable[1] = uniq_count;
+    uniq_argtable[2] = uniq_repeated;
+    uniq_argtable[3] = uniq_unique;
+    uniq_argtable[4] = uniq_hash;
+    uniq_argtable[5] = uniq_files;
+    uniq_argtable[6] = uniq_end;
+    uniq_argtable[7] = NULL;
+}
+
+/* ===== HELPER FUNCTIONS ===== */
+
+#define UNIQ_TABLE_MIN 1024    /* Slots in a new table (a power of 2) */
+
+typedef struct uniq_opts {
+    int count;
+    int repeated;
+    int unique;
+} uniq_opts_t;
+
+/* A distinct line under --hash, allocated with its text in the arena */
+typedef struct uniq_ent {
+    struct uniq_ent *next;     /* In order of first appearance */
+    uint64_t hash;
+    uintmax_t count;
+    size_t len;
+    char line[];
+} uniq_ent_t;
+
+typedef struct uniq_table {
+    arena_t *arena;
+    uniq_ent_t **slots;
+    size_t mask;               /* Slots - 1 */
+    size_t used;
+    uniq_ent_t *head;
+    uniq_ent_t **tail;
+} uniq_table_t;
+
+/* Write one group of count equal lines, if -d or -u lets it through */
+static void uniq_emit(const uniq_opts_t *o, pb_out_t *out, const char *line, size_t len,
+                      uintmax_t count)
+{
+    if ((o->repeated && count < 2) || (o->unique && count > 1)) {
+        return;
+    }
+    if (o->count) {
+        pb_out_uint(out, count, 7);
+        pb_out_putc(out, ' ');
+    }
+    pb_out_write(out, line, len);
+    pb_out_putc(out, '\n');
+}
+
+/*
+ * Hash a line eight bytes at a time: each word is folded in with a
+ * multiply and a shift, which mixes well enough for linear probing
+ */
+static uint64_t uniq_hash_line(const char *p, size_t len)
+{
+    const uint64_t k = 0x9e3779b97f4a7c15ULL;
+    uint64_t h = (uint64_t)len * k;
+    uint64_t w;
+
+    while (len >= 8) {
+        memcpy(&w, p, 8);
+        h = (h ^ w) * k;
+        h ^= h >> 32;
+        p += 8;
+        len -= 8;
+    }
+    if (len > 0) {
+        w = 0;
+        memcpy(&w, p, len);
+        h = (h ^ w) * k;
+        h ^= h >> 32;
+    }
+    h *= k;
+    return h ^ (h >> 29);
+}
+
+static int uniq_table_init(uniq_table_t *t)
+{
+    memset(t, 0, sizeof(*t));
+    t->arena = arena_create(0);
+    t->slots = calloc(UNIQ_TABLE_MIN, sizeof(*t->slots));
+    if (!t->arena || !t->slots) {
+        arena_destroy(t->arena);
+        free(t->slots);
+        return -1;
+    }
+    t->mask = UNIQ_TABLE_MIN - 1;
+    t->tail = &t->head;
+    return 0;
+}
+
+static void uniq_table_free(uniq_table_t *t)
+{
+    arena_destroy(t->arena);
+    free(t->slots);
+}
+
+/* Double the slots, placing each entry again by its stored hash */
+static int uniq_table_grow(uniq_table_t *t)
+{
+    size_t size = (t->mask + 1) * 2;
+    uniq_ent_t **slots = calloc(size, sizeof(*slots));
+    size_t i;
+
+    if (!slots) {
+        return -1;
+    }
+    for (i = 0; i <= t->mask; i++) {
+        uniq_ent_t *e = t->slots[i];
+        size_t j;
+
+        if (!e) {
+            continue;
+        }
+        for (j = e->hash & (size - 1); slots[j]; j = (j + 1) & (size - 1)) {
+        }
+        slots[j] = e;
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->mask = size - 1;
+    return 0;
+}
+
+/* Count one more of line, adding it if it is new. Returns: 0, or -1 if out of memory */
+static int uniq_table_add(uniq_table_t *t, const char *line, size_t len)
+{
+    uint64_t h = uniq_hash_line(line, len);
+    size_t i;
+    uniq_ent_t *e;
+
+    for (i = h & t->mask; (e = t->slots[i]) != NULL; i = (i + 1) & t->mask) {
+        if (e->hash == h && e->len == len && memcmp(e->line, line, len) == 0) {
+            e->count++;
+            return 0;
+        }
+    }
+
+    e = arena_alloc(t->arena, sizeof(*e) + len);
+    if (!e) {
+        return -1;
+    }
+    e->next = NULL;
+    e->hash = h;
+    e->count = 1;
+    e->len = len;
+    memcpy(e->line, line, len);
+    t->slots[i] = e;
+    *t->tail = e;
+    t->tail = &e->next;
+
+    /* Keep the table at most half full, so probe runs stay short */
+    if (++t->used * 2 > t->mask + 1) {
+        return uniq_table_grow(t);
+    }
+    return 0;
+}
+
+/*
+ * Read lines from lr and write the groups of equal adjacent ones
+ * Returns: 0, -1 on a read error (errno set), -2 if out of memory
+ */
+static int uniq_stream(const uniq_opts_t *o, line_reader_t *lr, pb_out_t *out)
+{
+    char *prev = NULL;
+    size_t prev_len = 0;
+    size_t prev_cap = 0;
+    uintmax_t count = 0;
+    const char *line;
+    size_t len;
+    int r;
+
+    while ((r = line_reader_next(lr, &line, &len)) > 0) {
+        if (len > 0 && line[len - 1] == '\n') {
+            len--;
+        }
+        if (count > 0 && len == prev_len && memcmp(line, prev, len) == 0) {
+            count++;
+            continue;
+        }
+        if (count > 0) {
+            uniq_emit(o, out, prev, prev_len, count);
+        }
+        if (len > prev_cap) {
+            char *p = realloc(prev, len);
+
+            if (!p) {
+                free(prev);
+                return -2;
+            }
+            prev = p;
+            prev_cap = len;
+        }
+        memcpy(prev, line, len);
+        prev_len = len;
+        count = 1;
+    }
+    if (r == 0 && count > 0) {
+        uniq_emit(o, out, prev, prev_len, count);
+    }
+    free(prev);
+    return r;
+}
+
+/*
+ * Count every distinct line of lr, then write them in order of first
+ * appearance
+ * Returns: 0, -1 on a read error (errno set), -2 if out of memory
+ */
+static int uniq_hashed(const uniq_opts_t *o, line_reader_t *lr, pb_out_t *out)
+{
+    uniq_table_t t;
+    const uniq_ent_t *e;
+    const char *line;
+    size_t len;
+    int r;
+
+    if (uniq_table_init(&t) != 0) {
+        return -2;
+    }
+    while ((r = line_reader_next(lr, &line, &len)) > 0) {
+        if (len > 0 && line[len - 1] == '\n') {
+            len--;
+        }
+        if (uniq_table_add(&t, line, len) != 0) {
+            r = -2;
+            break;
+        }
+    }
+    if (r == 0) {
+        for (e = t.head; e; e = e->next) {
+            uniq_emit(o, out, e->line, e->len, e->count);
+        }
+    }
+    uniq_table_free(&t);
+    return r;
+}
+
+/* ===== SECTION 3: RUN FUNCTION ===== */
+
+int uniq_run(int argc, char **argv)
+{
+    int nerrors;
+    uniq_opts_t opts;
+    const char *input = "-";
+    FILE *outfp;
+    int fd = -1;
+    line_reader_t lr;
+    pb_out_t out;
+    int r;
+    int ret = EXIT_OK;
+
+    build_uniq_argtable();
+    nerrors = cmd_arg_parse(argc, argv, uniq_argtable);
+
+    /* Handle --help */
+    if (uniq_help->count > 0) {
+        uniq_print_usage(cmd_stdout());
+        return EXIT_OK;
+    }
+
+    /* Handle parsing errors */
+    if (nerrors > 0) {
+        arg_print_errors(stderr, uniq_end, "uniq");
+        fprintf(stderr, "Try 'uniq --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
+    /* ===== ACTUAL COMMAND LOGIC ===== */
+
+    opts.count = uniq_count->count > 0;
+    opts.repeated = uniq_repeated->count > 0;
+    opts.unique = uniq_unique->count > 0;
+
+    if (uniq_files->count > 0) {
+        input = uniq_files->filename[0];
+    }
+    if (strcmp(input, "-") != 0) {
+        fd = open(input, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            perror(input);
+            return EXIT_ERROR;
+        }
+    }
+
+    outfp = cmd_stdout();
+    if (uniq_files->count > 1 && strcmp(uniq_files->filename[1], "-") != 0) {
+        outfp = fopen(uniq_files->filename[1], "w");
+        if (!outfp) {
+            perror(uniq_files->filename[1]);
+            if (fd >= 0) {
+                close(fd);
+            }
+            return EXIT_ERROR;
+        }
+    }
+
+    if ((fd < 0 ? line_reader_init_stream(&lr, cmd_stdin()) : line_reader_init_fd(&lr, fd)) != 0) {
+        perror("uniq");
+        ret = EXIT_ERROR;
+        goto done;
+    }
+    if (pb_out_init(&out, outfp) != 0) {
+        perror("uniq");
+        line_reader_free(&lr);
+        ret = EXIT_ERROR;
+        goto done;
+    }
+
+    r = uniq_hash->count > 0 ? uniq_hashed(&opts, &lr, &out) : uniq_stream(&opts, &lr, &out);
+    if (r == -1) {
+        perror(fd < 0 ? "stdin" : input);
+        ret = EXIT_ERROR;
+    } else if (r == -2) {
+        fprintf(stderr, "uniq: out of memory\n");
+        ret = EXIT_ERROR;
+    }
+    line_reader_free(&lr);
+
+    if (pb_out_close(&out) != 0) {
+        if (errno != EPIPE) {
+            perror("uniq: write error");
+        }
+        ret = EXIT_ERROR;
+    }
+
+done:
+    if (outfp != cmd_stdout() && fclose(outfp) != 0 && ret == EXIT_OK) {
+        perror(uniq_files->filename[1]);
+        ret = EXIT_ERROR;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ret;
+}
+
+/* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
+
+void uniq_print_usage(FILE *out)
+{
+    build_uniq_argtable();
+
+    fprintf(out, "Usage: uniq ");
+    arg_print_syntax(out, uniq_argtable, "\n");
+    fprintf(out, "Write one of each group of equal adjacent lines of INPUT (or stdin)\n");
+    fprintf(out, "to OUTPUT (or stdout). With --hash, equal lines need not be adjacent.\n\n");
+    fprintf(out, "Options:\n");
+    arg_print_glossary(out, uniq_argtable, "  %-28s %s\n");
+    fprintf(out, "\n");
+    fprintf(out, "Examples:\n");
+    fprintf(out, "  sort access.log | uniq -c    Count each distinct line\n");
+    fprintf(out, "  uniq --hash -c access.log    The same counts, without sorting\n");
+    fprintf(out, "  sort words | uniq -d         Show only the repeated words\n");
+}
+
+/* ===== SECTION 5: COMMAND SPECIFICATION ===== */
+
+cmd_spec_t cmd_uniq_spec = {
+    .name = "uniq",
+    .summary = "report or omit repeated lines",
+    .long_help = "Write one of each group of equal adjacent lines of INPUT (or stdin) "
+                 "to OUTPUT (or stdout). With --hash, equal lines need not be adjacent.",
+    .run = uniq_run,
+    .print_usage = uniq_print_usage,
+    .flags = CMD_FLAG_STREAMS
+};
+
+/* ===== SECTION 6: REGISTRATION FUNCTION ===== */
+
+void register_uniq_command(void)
+{
+    register_command(&cmd_uniq_spec);
+}
+
+/* ===== SECTION 7: STANDALONE MAIN ===== */
+
+#ifndef BUILTIN_ONLY
+int main(int argc, char **argv)
+{
+    return cmd_uniq_spec.run(argc, argv);
+}
+#endif
@@ -0,0 +1,561 @@
+/*
+ * cmd_updatedb.c - Build the file name database for locate
+ *
+ * This follows the standard command anatomy for PicoBox, using argtable3.
+ *
+ * Usage: updatedb [OPTIONS] [ROOT...]
+ * Options:
+ *   -o, --output=FILE   Write the database to FILE
+ *   --prune=DIR         Leave DIR and everything in it out (may repeat)
+ *   -h, --help          Display help message
+ *
+ * The trees (default /) are walked on the parallel walker without
+ * stat'ing anything, every path is kept, and once the walk is over they
+ * are sorted and written out front-compressed with a trigram index (the
+ * format is in locate_db.h). The database is written to a temporary
+ * file and renamed over FILE, so a locate running meanwhile sees the old
+ * one or the new one, never half of one.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* AT_FDCWD under -std=c11 */
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "argtable3.h"
+#include "cmd_spec.h"
+#include "picobox.h"
+#include "arena.h"
+#include "locate_db.h"
+#include "walk.h"
+#include "work_pool.h"
+
+/* Forward declarations */
+int updatedb_run(int argc, char **argv);
+void updatedb_print_usage(FILE *out);
+
+/* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
+
+static struct arg_lit *updatedb_help;
+static struct arg_file *updatedb_output;
+static struct arg_file *updatedb_prune;
+static struct arg_file *updatedb_roots;
+static struct arg_end *updatedb_end;
+static void *updatedb_argtable[6];
+
+/* ===== SECTION 2: ARGTABLE BUILDER ===== */
+
+static void build_updatedb_argtable(void)
+{
+    if (updatedb_argtable[0] != NULL) {
+        return;
+    }
+
+    updatedb_help = arg_lit0("h", "help", "display this help and exit");
+    updatedb_output = arg_file0("o", "output", "FILE",
+                                "write the database to FILE (default " LOCATE_DB_DEFAULT ")");
+    updatedb_prune = arg_filen(NULL, "prune", "DIR", 0, 100,
+                               "leave DIR out (default /proc, /sys and /dev)");
+    updatedb_roots = arg_filen(NULL, NULL, "ROOT", 0, 100, "trees to index (default /)");
+    updatedb_end = arg_end(20);
+
+    updatedb_argtable[0] = updatedb_help;
+    updatedb_argtable[1] = updatedb_output;
+    updatedb_argtable[2] = updatedb_prune;
+    updatedb_argtable[3] = updatedb_roots;
+    updatedb_argtable[4] = updatedb_end;
+    updatedb_argtable[5] = NULL;
+}
+
+/* ===== HELPER FUNCTION ===== */
+
+/* Worker bounds for the walk */
+#define UPDATEDB_MIN_WORKERS 4
+#define UPDATEDB_MAX_WORKERS 16
+
+/* Pseudo filesystems, left out unless --prune says otherwise */
+static const char *const updatedb_default_prune[] = { "/proc", "/sys", "/dev" };
+
+/* Paths one walk thread has seen, in its own arena */
+typedef struct updatedb_list {
+    arena_t *names;
+    char **v;
+    size_t len;
+    size_t cap;
+} updatedb_list_t;
+
+typedef struct updatedb_ctx {
+    const char *const *prune;
+    int nprune;
+    updatedb_list_t lists[UPDATEDB_MAX_WORKERS];
+    int failed;                 /* Out of memory: the database would be short */
+} updatedb_ctx_t;
+
+/* A growing byte buffer */
+typedef struct updatedb_buf {
+    unsigned char *p;
+    size_t len;
+    size_t cap;
+    int failed;
+} updatedb_buf_t;
+
+static void updatedb_put(updatedb_buf_t *b, const void *data, size_t n)
+{
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 64 * 1024;
+        unsigned char *p;
+
+        while (cap < b->len + n) {
+            cap *= 2;
+        }
+        p = realloc(b->p, cap);
+        if (!p) {
+            b->failed = 1;
+            return;
+        }
+        b->p = p;
+        b->cap = cap;
+    }
+    memcpy(b->p + b->len, data, n);
+    b->len += n;
+}
+
+static void updatedb_varint(updatedb_buf_t *b, uint64_t v)
+{
+    unsigned char tmp[10];
+    size_t n = 0;
+
+    while (v >= 0x80) {
+        tmp[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    tmp[n++] = (unsigned char)v;
+    updatedb_put(b, tmp, n);
+}
+
+static int updatedb_pruned(const updatedb_ctx_t *ctx, const char *path)
+{
+    for (int i = 0; i < ctx->nprune; i++) {
+        if (strcmp(ctx->prune[i], path) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int updatedb_visit(const walk_entry_t *e, void *arg)
+{
+    updatedb_ctx_t *ctx = arg;
+    updatedb_list_t *l = &ctx->lists[e->worker];
+    char *copy;
+
+    if (e->visit == WALK_POST) {
+        return WALK_CONTINUE;
+    }
+    if (e->visit == WALK_PRE && updatedb_pruned(ctx, e->path)) {
+        return WALK_SKIP;
+    }
+
+    if (l->len == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 4096;
+        char **v = realloc(l->v, cap * sizeof(char *));
+
+        if (!v) {
+            ctx->failed = 1;
+            return WALK_STOP;
+        }
+        l->v = v;
+        l->cap = cap;
+    }
+    copy = arena_alloc(l->names, e->path_len + 1);
+    if (!copy) {
+        ctx->failed = 1;
+        return WALK_STOP;
+    }
+    memcpy(copy, e->path, e->path_len + 1);
+    l->v[l->len++] = copy;
+    return WALK_CONTINUE;
+}
+
+static int updatedb_path_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int updatedb_u32_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int updatedb_u64_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Front-compress the sorted paths into data (block offsets into blocks)
+ * and note each block's trigrams as (trigram << 32 | block) in pairs
+ */
+static void updatedb_encode(char **paths, size_t n, updatedb_buf_t *data,
+                            updatedb_buf_t *blocks, updatedb_buf_t *pairs)
+{
+    updatedb_buf_t tris = { NULL, 0, 0, 0 };
+    size_t i;
+
+    for (i = 0; i < n; i += LOCATE_DB_BLOCK) {
+        size_t end = i + LOCATE_DB_BLOCK < n ? i + LOCATE_DB_BLOCK : n;
+        uint64_t off = data->len;
+        uint64_t block = i / LOCATE_DB_BLOCK;
+        const char *prev = "";
+        size_t ntris;
+        size_t j;
+        size_t k;
+
+        updatedb_put(blocks, &off, sizeof(off));
+        tris.len = 0;
+        for (j = i; j < end; j++) {
+            const char *p = paths[j];
+            size_t len = strlen(p);
+            size_t shared = 0;
+            size_t from;
+
+            while (prev[shared] && prev[shared] == p[shared]) {
+                shared++;
+            }
+            updatedb_varint(data, shared);
+            updatedb_varint(data, len - shared);
+            updatedb_put(data, p + shared, len - shared);
+            prev = p;
+
+            /* Trigrams inside the shared prefix are in already */
+            from = shared >= 2 ? shared - 2 : 0;
+            for (k = from; k + 3 <= len; k++) {
+                uint32_t t = locate_db_trigram(p + k);
+
+                updatedb_put(&tris, &t, sizeof(t));
+            }
+        }
+
+        ntris = tris.len / sizeof(uint32_t);
+        qsort(tris.p, ntris, sizeof(uint32_t), updatedb_u32_cmp);
+        for (j = 0; j < ntris; j++) {
+            const uint32_t *t = (const uint32_t *)tris.p;
+
+            if (j == 0 || t[j] != t[j - 1]) {
+                uint64_t pair = (uint64_t)t[j] << 32 | block;
+
+                updatedb_put(pairs, &pair, sizeof(pair));
+            }
+        }
+    }
+
+    if (tris.failed) {
+        data->failed = 1;
+    }
+    free(tris.p);
+}
+
+/* The posting lists, from pairs sorted by trigram and then block */
+static void updatedb_index(const uint64_t *pairs, size_t n, updatedb_buf_t *tris,
+                           updatedb_buf_t *post)
+{
+    size_t i = 0;
+
+    while (i < n) {
+        locate_db_tri_t t;
+        uint64_t last = 0;
+
+        t.tri = (uint32_t)(pairs[i] >> 32);
+        t.count = 0;
+        t.off = post->len;
+        for (; i < n && (uint32_t)(pairs[i] >> 32) == t.tri; i++) {
+            uint64_t block = pairs[i] & 0xffffffffu;
+
+            updatedb_varint(post, block - last);
+            last = block;
+            t.count++;
+        }
+        updatedb_put(tris, &t, sizeof(t));
+    }
+}
+
+/*
+ * Write the database of the sorted, unique paths to path
+ * Returns: 0, or -1 (errno set)
+ */
+static int updatedb_write(const char *path, char **paths, size_t n)
+{
+    updatedb_buf_t data = { NULL, 0, 0, 0 };
+    updatedb_buf_t blocks = { NULL, 0, 0, 0 };
+    updatedb_buf_t pairs = { NULL, 0, 0, 0 };
+    updatedb_buf_t tris = { NULL, 0, 0, 0 };
+    updatedb_buf_t post = { NULL, 0, 0, 0 };
+    static const unsigned char pad[8];
+    locate_db_hdr_t hdr;
+    uint64_t off;
+    size_t npad;
+    char tmp[4096];
+    FILE *fp;
+    int ok = 0;
+
+    updatedb_encode(paths, n, &data, &blocks, &pairs);
+    off = data.len;
+    updatedb_put(&blocks, &off, sizeof(off));
+    qsort(pairs.p, pairs.len / sizeof(uint64_t), sizeof(uint64_t), updatedb_u64_cmp);
+    updatedb_index((const uint64_t *)pairs.p, pairs.len / sizeof(uint64_t), &tris, &post);
+    if (data.failed || blocks.failed || pairs.failed || tris.failed || post.failed) {
+        errno = ENOMEM;
+        goto out;
+    }
+
+    /* The trigram table is read in place, so it starts 8-byte aligned */
+    npad = (8 - data.len % 8) % 8;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = LOCATE_DB_MAGIC;
+    hdr.version = LOCATE_DB_VERSION;
+    hdr.npaths = n;
+    hdr.nblocks = blocks.len / sizeof(uint64_t) - 1;
+    hdr.ntris = tris.len / sizeof(locate_db_tri_t);
+    hdr.blocks_off = sizeof(hdr);
+    hdr.data_off = hdr.blocks_off + blocks.len;
+    hdr.tris_off = hdr.data_off + data.len + npad;
+    hdr.post_off = hdr.tris_off + tris.len;
+    hdr.size = hdr.post_off + post.len;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fp = fopen(tmp, "wb");
+    if (!fp) {
+        goto out;
+    }
+    ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+         fwrite(blocks.p, 1, blocks.len, fp) == blocks.len &&
+         fwrite(data.p, 1, data.len, fp) == data.len &&
+         fwrite(pad, 1, npad, fp) == npad &&
+         fwrite(tris.p, 1, tris.len, fp) == tris.len &&
+         fwrite(post.p, 1, post.len, fp) == post.len;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        int err = errno;
+
+        unlink(tmp);
+        errno = err;
+        ok = 0;
+    }
+
+out:
+    free(data.p);
+    free(blocks.p);
+    free(pairs.p);
+    free(tris.p);
+    free(post.p);
+    return ok ? 0 : -1;
+}
+
+/*
+ * Walk roots and write what is in them to path
+ * Returns: EXIT_OK or EXIT_ERROR
+ */
+static int updatedb_build(const char *path, const char *const *roots, int nroots,
+                          const char *const *prune, int nprune)
+{
+    walk_opts_t opts = { WALK_PARALLEL, work_pool_default_workers(), 0, NULL };
+    updatedb_ctx_t ctx;
+    char **all = NULL;
+    size_t n = 0;
+    size_t i;
+    size_t j;
+    int ret = EXIT_ERROR;
+
+    /* Waiting on getdents() more than on the CPU, as in du */
+    if (opts.nworkers < UPDATEDB_MIN_WORKERS) {
+        opts.nworkers = UPDATEDB_MIN_WORKERS;
+    } else if (opts.nworkers > UPDATEDB_MAX_WORKERS) {
+        opts.nworkers = UPDATEDB_MAX_WORKERS;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.prune = prune;
+    ctx.nprune = nprune;
+    for (i = 0; i < (size_t)opts.nworkers; i++) {
+        ctx.lists[i].names = arena_create(256 * 1024);
+        if (!ctx.lists[i].names) {
+            perror("updatedb");
+            goto out;
+        }
+    }
+
+    if (walk(AT_FDCWD, roots, nroots, &opts, updatedb_visit, &ctx) < 0 || ctx.failed) {
+        perror("updatedb");
+        goto out;
+    }
+
+    /* One sorted list, each path once (roots may overlap) */
+    for (i = 0; i < (size_t)opts.nworkers; i++) {
+        n += ctx.lists[i].len;
+    }
+    all = malloc((n + 1) * sizeof(char *));
+    if (!all) {
+        perror("updatedb");
+        goto out;
+    }
+    n = 0;
+    for (i = 0; i < (size_t)opts.nworkers; i++) {
+        memcpy(all + n, ctx.lists[i].v, ctx.lists[i].len * sizeof(char *));
+        n += ctx.lists[i].len;
+    }
+    qsort(all, n, sizeof(char *), updatedb_path_cmp);
+    for (i = j = 0; i < n; i++) {
+        if (j == 0 || strcmp(all[j - 1], all[i]) != 0) {
+            all[j++] = all[i];
+        }
+    }
+
+    if (updatedb_write(path, all, j) != 0) {
+        fprintf(stderr, "updatedb: %s: %s\n", path, strerror(errno));
+        goto out;
+    }
+    ret = EXIT_OK;
+
+out:
+    free(all);
+    for (i = 0; i < UPDATEDB_MAX_WORKERS; i++) {
+        free(ctx.lists[i].v);
+        if (ctx.lists[i].names) {
+            arena_destroy(ctx.lists[i].names);
+        }
+    }
+    return ret;
+}
+
+/* ===== SECTION 3: RUN FUNCTION ===== */
+
+int updatedb_run(int argc, char **argv)
+{
+    int nerrors;
+    const char *output = LOCATE_DB_DEFAULT;
+    const char *const *roots;
+    const char *const *prune = updatedb_default_prune;
+    int nroots = 1;
+    int nprune = (int)(sizeof(updatedb_default_prune) / sizeof(updatedb_default_prune[0]));
+    static const char *const root_default[] = { "/" };
+    char **stripped = NULL;
+    int ret;
+    int i;
+
+    build_updatedb_argtable();
+    nerrors = cmd_arg_parse(argc, argv, updatedb_argtable);
+
+    /* Handle --help */
+    if (updatedb_help->count > 0) {
+        updatedb_print_usage(stdout);
+        return EXIT_OK;
+    }
+
+    /* Handle parsing errors */
+    if (nerrors > 0) {
+        arg_print_errors(stderr, updatedb_end, "updatedb");
+        fprintf(stderr, "Try 'updatedb --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
+    /* ===== ACTUAL COMMAND LOGIC ===== */
+
+    if (updatedb_output->count > 0) {
+        output = updatedb_output->filename[0];
+    }
+
+    roots = root_default;
+    if (updatedb_roots->count > 0) {
+        roots = (const char *const *)updatedb_roots->filename;
+        nroots = updatedb_roots->count;
+    }
+
+    /* Pruned paths are compared with the walk's, which have no trailing '/' */
+    if (updatedb_prune->count > 0) {
+        stripped = calloc((size_t)updatedb_prune->count, sizeof(char *));
+        if (!stripped) {
+            perror("updatedb");
+            return EXIT_ERROR;
+        }
+        for (i = 0; i < updatedb_prune->count; i++) {
+            size_t len = strlen(updatedb_prune->filename[i]);
+
+            stripped[i] = strdup(updatedb_prune->filename[i]);
+            if (!stripped[i]) {
+                break;
+            }
+            while (len > 1 && stripped[i][len - 1] == '/') {
+                stripped[i][--len] = '\0';
+            }
+        }
+        prune = (const char *const *)stripped;
+        nprune = i;
+    }
+
+    ret = updatedb_build(output, roots, nroots, prune, nprune);
+
+    if (stripped) {
+        for (i = 0; i < updatedb_prune->count; i++) {
+            free(stripped[i]);
+        }
+        free(stripped);
+    }
+    return ret;
+}
+
+/* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
+
+void updatedb_print_usage(FILE *out)
+{
+    build_updatedb_argtable();
+
+    fprintf(out, "Usage: updatedb ");
+    arg_print_syntax(out, updatedb_argtable, "\n");
+    fprintf(out, "Write the names of all files under each ROOT to the database locate searches.\n\n");
+    fprintf(out, "Options:\n");
+    arg_print_glossary(out, updatedb_argtable, "  %-25s %s\n");
+    fprintf(out, "\n");
+    fprintf(out, "Examples:\n");
+    fprintf(out, "  updatedb                       Index the whole system\n");
+    fprintf(out, "  updatedb -o /srv/files.db /srv Index /srv into /srv/files.db\n");
+    fprintf(out, "  updatedb --prune /srv/tmp /srv Leave /srv/tmp out\n");
+}
+
+/* ===== SECTION 5: COMMAND SPECIFICATION ===== */
+
+cmd_spec_t cmd_updatedb_spec = {
+    .name = "updatedb",
+    .summary = "update the file name database for locate",
+    .long_help = "Write the names of all files under each ROOT (default /) to the "
+                 "database locate searches.",
+    .run = updatedb_run,
+    .print_usage = updatedb_print_usage
+};
+
+/* ===== SECTION 6: REGISTRATION FUNCTION ===== */
+
+void register_updatedb_command(void)
+{
+    register_command(&cmd_updatedb_spec);
+}
+
+/* ===== SECTION 7: STANDALONE MAIN ===== */
+
+#ifndef BUILTIN_ONLY
+int main(int argc, char **argv)
+{
+    return cmd_updatedb_spec.run(argc, argv);
+}
+#endif
@@ -6,18 +6,51 @@
  *
  * Usage: wc [OPTIONS] [FILE...]
  * Options:
- *   -l, --lines       Print line counts
- *   -w, --words       Print word counts
- *   -c, --bytes       Print byte counts
- *   -h, --help        Display help message
+ *   -l, --lines            Print line counts
+ *   -w, --words            Print word counts
+ *   -m, --chars            Print character (UTF-8) counts
+ *   -c, --bytes            Print byte counts
+ *   -L, --max-line-length  Print the width of the longest line
+ *   -z, --decompress       Count gzip and zstd input decompressed
+ *   -h, --help             Display help message
+ *
+ * Input is read in large page-aligned blocks and counted by the SIMD
+ * kernels in text_count.h; -c alone on a regular file is answered by
+ * fstat() without reading it.
+ *
+ * Several files, or one regular file of at least 2 * WC_CHUNK bytes,
+ * are counted on a work-stealing pool (work_pool.h): one task per file,
+ * and a large file is split into WC_CHUNK byte ranges read with pread().
+ * Each range starts from the byte before it, so words are not counted
+ * twice at a split; only -L, whose columns depend on the whole line,
+ * keeps a file in one piece. Results are printed in operand order once
+ * all are done, and match a serial pass.
+ *
+ * With -z, input whose first block is gzip or zstd is counted as it is
+ * decompressed on threads of its own (decompress.h); a compressed file
+ * is one task, never split.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* posix_memalign(), posix_fadvise(), pread() */
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "argtable3.h"
 #include "cmd_spec.h"
 #include "picobox.h"
+#include "io_stats.h"
+#include "decompress.h"
+#include "text_count.h"
+#include "work_pool.h"
+#include "pb_out.h"
 
 /* Forward declarations */
 int wc_run(int argc, char **argv);
@@ -28,114 +61,542 @@ void wc_print_usage(FILE *out);
 static struct arg_lit *wc_help;
 static struct arg_lit *wc_lines;
 static struct arg_lit *wc_words;
+static struct arg_lit *wc_chars;
 static struct arg_lit *wc_bytes;
+static struct arg_lit *wc_max_line;
+static struct arg_lit *wc_decompress;
 static struct arg_file *wc_files;
 static struct arg_end *wc_end;
-static void *wc_argtable[7];
+static void *wc_argtable[10];
 
 /* ===== SECTION 2: ARGTABLE BUILDER ===== */
 
 static void build_wc_argtable(void)
 {
+    if (wc_argtable[0] != NULL) {
+        return;
+    }
+
     wc_help = arg_lit0("h", "help", "display this help and exit");
     wc_lines = arg_lit0("l", "lines", "print the newline counts");
     wc_words = arg_lit0("w", "words", "print the word counts");
+    wc_chars = arg_lit0("m", "chars", "print the character counts");
     wc_bytes = arg_lit0("c", "bytes", "print the byte counts");
+    wc_max_line = arg_lit0("L", "max-line-length", "print the maximum display width");
+    wc_decompress = arg_lit0("z", "decompress", "count gzip and zstd input decompressed");
     wc_files = arg_filen(NULL, NULL, "FILE", 0, 100, "files to process (or stdin if none)");
     wc_end = arg_end(20);
 
     wc_argtable[0] = wc_help;
     wc_argtable[1] = wc_lines;
     wc_argtable[2] = wc_words;
-    wc_argtable[3] = wc_bytes;
-    wc_argtable[4] = wc_files;
-    wc_argtable[5] = wc_end;
-    wc_argtable[6] = NULL;
+    wc_argtable[3] = wc_chars;
+    wc_argtable[4] = wc_bytes;
+    wc_argtable[5] = wc_max_line;
+    wc_argtable[6] = wc_decompress;
+    wc_argtable[7] = wc_files;
+    wc_argtable[8] = wc_end;
+    wc_argtable[9] = NULL;
 }
 
 /* ===== HELPER FUNCTION ===== */
 
-static int wc_file(const char *filename, int show_lines, int show_words, int show_bytes,
-                   long *total_lines, long *total_words, long *total_bytes)
+#define WC_BLOCK (256 * 1024)
+#define WC_CHUNK (16 * 1024 * 1024)   /* Range per task when a file is split */
+#define WC_MAX_WORKERS 64
+#define WC_BYTES 0x100   /* Alongside the TEXT_COUNT_* flags */
+#define WC_DECOMPRESS 0x200
+
+typedef struct {
+    uint64_t lines;
+    uint64_t words;
+    uint64_t chars;
+    uint64_t bytes;
+    uint64_t max_width;
+} wc_counts_t;
+
+typedef struct wc_job wc_job_t;
+
+/* A pool task: a whole file operand, or one byte range of a split file */
+typedef struct {
+    wc_job_t *job;
+    off_t start;
+    off_t len;            /* < 0: up to end of file */
+    wc_counts_t c;
+    int err;              /* errno of a failure, 0 if none */
+} wc_part_t;
+
+/* A file operand counted on the pool */
+struct wc_job {
+    const char *name;
+    wc_part_t whole;
+    wc_part_t *parts;     /* Its ranges, if the file was split */
+    size_t nparts;
+    int fd;
+    atomic_size_t running;   /* Ranges not counted yet; the last closes fd */
+};
+
+typedef struct {
+    int what;
+    char *bufs[WC_MAX_WORKERS];   /* One read buffer per worker */
+} wc_pool_t;
+
+static int wc_is_stdin(const char *filename)
 {
-    FILE *fp;
-    int ch;
-    long lines = 0;
-    long words = 0;
-    long bytes = 0;
-    int in_word = 0;
-    int using_stdin = 0;
+    return filename == NULL || strcmp(filename, "-") == 0;
+}
 
-    if (filename == NULL || strcmp(filename, "-") == 0) {
-        fp = stdin;
-        using_stdin = 1;
+/*
+ * Only line width depends on where the previous range left off, and
+ * compressed input can only be read from the start
+ */
+static int wc_splittable(int what)
+{
+    return !(what & (TEXT_COUNT_WIDTH | WC_DECOMPRESS)) && what != WC_BYTES;
+}
+
+/* With -z, a regular file that is not compressed is counted as without it */
+static int wc_plain_file(int fd, int what)
+{
+    if ((what & WC_DECOMPRESS) && decompress_fd_format(fd) == DECOMPRESS_NONE) {
+        what &= ~WC_DECOMPRESS;
+    }
+    return what;
+}
+
+/* Page-aligned, so reads of regular files stay on page boundaries */
+static char *wc_alloc_block(void)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    void *buf;
+
+    if (posix_memalign(&buf, page > 0 ? (size_t)page : 4096, WC_BLOCK) != 0) {
+        return NULL;
+    }
+    return buf;
+}
+
+static void wc_add(wc_counts_t *total, const wc_counts_t *c)
+{
+    total->lines += c->lines;
+    total->words += c->words;
+    total->chars += c->chars;
+    total->bytes += c->bytes;
+    if (c->max_width > total->max_width) {
+        total->max_width = c->max_width;
+    }
+}
+
+static void wc_print(pb_out_t *out, const wc_counts_t *c, int what, const char *name)
+{
+    if (what & TEXT_COUNT_LINES) { pb_out_putc(out, ' '); pb_out_uint(out, c->lines, 7); }
+    if (what & TEXT_COUNT_WORDS) { pb_out_putc(out, ' '); pb_out_uint(out, c->words, 7); }
+    if (what & TEXT_COUNT_CHARS) { pb_out_putc(out, ' '); pb_out_uint(out, c->chars, 7); }
+    if (what & WC_BYTES) { pb_out_putc(out, ' '); pb_out_uint(out, c->bytes, 7); }
+    if (what & TEXT_COUNT_WIDTH) { pb_out_putc(out, ' '); pb_out_uint(out, c->max_width, 7); }
+    if (name) {
+        pb_out_putc(out, ' ');
+        pb_out_str(out, name);
+    }
+    pb_out_putc(out, '\n');
+}
+
+static void wc_report(const char *filename, int err)
+{
+    fprintf(stderr, "%s: %s\n", filename ? filename : "stdin", strerror(err));
+}
+
+/*
+ * Read up to len bytes from fd, or from fp if fd is -1
+ * Returns: the byte count, 0 at end of input, -1 on a read error
+ */
+static ssize_t wc_read(FILE *fp, int fd, char *buf, size_t len)
+{
+    ssize_t n;
+
+    if (fd >= 0) {
+        do {
+            n = read(fd, buf, len);
+            IO_STATS_READ(n);
+        } while (n < 0 && errno == EINTR);
     } else {
-        fp = fopen(filename, "r");
-        if (!fp) {
-            perror(filename);
-            return EXIT_ERROR;
+        n = (ssize_t)fread(buf, 1, len, fp);
+        if (n == 0 && ferror(fp)) {
+            n = -1;
         }
     }
+    return n;
+}
 
-    while ((ch = fgetc(fp)) != EOF) {
-        bytes++;
+/*
+ * Count fp block by block into c
+ *
+ * fd: fp's descriptor to read() directly, or -1 to go through stdio
+ * (the shell's stdin may hold buffered input; pipeline stages have no fd)
+ * With WC_DECOMPRESS in what, the first block says whether the rest is
+ * to be decompressed.
+ * Returns: 0, or -1 on a read error
+ */
+static int wc_count(FILE *fp, int fd, char *buf, int what, wc_counts_t *c)
+{
+    text_count_t tc;
+    decoder_t *dec = NULL;
+    int ret = 0;
+
+    text_count_init(&tc);
 
-        if (ch == '\n') {
-            lines++;
+    for (;;) {
+        ssize_t n = dec ? decoder_read(dec, buf, WC_BLOCK) : wc_read(fp, fd, buf, WC_BLOCK);
+
+        if (n < 0) {
+            ret = -1;
+            break;
+        }
+        if (n == 0) {
+            break;
         }
 
-        if (isspace(ch)) {
-            in_word = 0;
-        } else if (!in_word) {
-            in_word = 1;
-            words++;
+        if (what & WC_DECOMPRESS) {
+            ssize_t more = 1;
+            int format;
+
+            /* A short first read (a pipe) may not hold the magic yet */
+            while (n < DECOMPRESS_MAGIC && more > 0) {
+                more = wc_read(fp, fd, buf + n, WC_BLOCK - (size_t)n);
+                n += more > 0 ? more : 0;
+            }
+            what &= ~WC_DECOMPRESS;
+            format = decompress_format(buf, (size_t)n);
+            if (format != DECOMPRESS_NONE) {
+                dec = decoder_open(format, fd, fp, buf, (size_t)n);
+                if (!dec) {
+                    ret = -1;
+                    break;
+                }
+                continue;
+            }
         }
+
+        c->bytes += (uint64_t)n;
+        text_count_block(&tc, buf, (size_t)n, what);
     }
+    text_count_end(&tc);
 
-    if (ferror(fp)) {
-        perror(filename ? filename : "stdin");
-        if (!using_stdin) fclose(fp);
-        return EXIT_ERROR;
+    if (dec) {
+        int err = errno;
+
+        decoder_close(dec);
+        errno = err;
+    }
+    if (ret != 0) {
+        return ret;
+    }
+
+    c->lines = tc.lines;
+    c->words = tc.words;
+    c->chars = tc.chars;
+    c->max_width = tc.max_width;
+    return 0;
+}
+
+/*
+ * Count an open file; -c alone on a regular file needs only fstat()
+ * Returns: 0, or an errno value
+ */
+static int wc_count_fd(int fd, int what, char *buf, wc_counts_t *c)
+{
+    struct stat st;
+
+    what = wc_plain_file(fd, what);
+    if (what == WC_BYTES && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        c->bytes = (uint64_t)st.st_size;
+        return 0;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return wc_count(NULL, fd, buf, what, c) == 0 ? 0 : errno;
+}
+
+/*
+ * Count one operand (NULL or "-" for standard input)
+ * Returns: 0, or an errno value
+ */
+static int wc_count_file(const char *filename, int what, char *buf, wc_counts_t *c)
+{
+    int fd;
+    int err;
+
+    if (wc_is_stdin(filename)) {
+        return wc_count(cmd_stdin(), -1, buf, what, c) == 0 ? 0 : errno;
     }
 
-    /* Print results */
-    if (show_lines) printf(" %7ld", lines);
-    if (show_words) printf(" %7ld", words);
-    if (show_bytes) printf(" %7ld", bytes);
-    if (filename && strcmp(filename, "-") != 0) {
-        printf(" %s", filename);
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return errno;
     }
-    printf("\n");
+    err = wc_count_fd(fd, what, buf, c);
+    close(fd);
+    return err;
+}
 
-    /* Update totals */
-    *total_lines += lines;
-    *total_words += words;
-    *total_bytes += bytes;
+static int wc_file(pb_out_t *out, const char *filename, int what, char *buf, wc_counts_t *total)
+{
+    wc_counts_t c = { 0, 0, 0, 0, 0 };
+    int err = wc_count_file(filename, what, buf, &c);
 
-    if (!using_stdin) {
-        fclose(fp);
+    if (err) {
+        wc_report(filename, err);
+        return EXIT_ERROR;
     }
 
+    wc_print(out, &c, what, wc_is_stdin(filename) ? NULL : filename);
+    wc_add(total, &c);
     return EXIT_OK;
 }
 
+/* ===== PARALLEL COUNTING ===== */
+
+/*
+ * Count one range of a split file. The range's first byte is seeded
+ * with the byte before it, so a word crossing the boundary is counted
+ * by the range it starts in, as in a serial pass.
+ */
+static void wc_count_range(wc_part_t *part, int what, char *buf)
+{
+    wc_job_t *job = part->job;
+    text_count_t tc;
+    off_t off = part->start;
+    unsigned char prev;
+
+    text_count_init(&tc);
+    if (off > 0 && pread(job->fd, &prev, 1, off - 1) == 1) {
+        text_count_after(&tc, prev);
+    }
+
+    while (part->len < 0 || off < part->start + part->len) {
+        size_t want = WC_BLOCK;
+        ssize_t n;
+
+        if (part->len >= 0 && part->start + part->len - off < (off_t)want) {
+            want = (size_t)(part->start + part->len - off);
+        }
+        n = pread(job->fd, buf, want, off);
+        IO_STATS_READ(n);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            part->err = errno;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        part->c.bytes += (uint64_t)n;
+        text_count_block(&tc, buf, (size_t)n, what);
+        off += n;
+    }
+    text_count_end(&tc);
+
+    part->c.lines = tc.lines;
+    part->c.words = tc.words;
+    part->c.chars = tc.chars;
+    part->c.max_width = tc.max_width;
+
+    if (atomic_fetch_sub(&job->running, 1) == 1) {
+        close(job->fd);
+    }
+}
+
+/*
+ * Count a whole file operand, or split a large regular file into
+ * WC_CHUNK ranges and queue those instead
+ */
+static void wc_count_job(work_pool_t *pool, int worker, wc_job_t *job, int what, char *buf)
+{
+    struct stat st;
+
+    job->fd = open(job->name, O_RDONLY);
+    if (job->fd < 0) {
+        job->whole.err = errno;
+        return;
+    }
+    what = wc_plain_file(job->fd, what);
+
+    if (wc_splittable(what) && fstat(job->fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size >= 2 * (off_t)WC_CHUNK) {
+        size_t n = (size_t)((st.st_size + WC_CHUNK - 1) / WC_CHUNK);
+
+        job->parts = calloc(n, sizeof(wc_part_t));
+        if (job->parts) {
+            job->nparts = n;
+            atomic_store(&job->running, n);
+            for (size_t i = 0; i < n; i++) {
+                wc_part_t *part = &job->parts[i];
+
+                part->job = job;
+                part->start = (off_t)i * WC_CHUNK;
+                part->len = i + 1 < n ? WC_CHUNK : -1;
+                if (work_pool_push(pool, worker, part) != 0) {
+                    wc_count_range(part, what, buf);
+                }
+            }
+            return;
+        }
+    }
+
+    job->whole.err = wc_count_fd(job->fd, what, buf, &job->whole.c);
+    close(job->fd);
+}
+
+static void wc_visit(work_pool_t *pool, int worker, void *item, void *arg)
+{
+    wc_pool_t *p = arg;
+    wc_part_t *part = item;
+
+    if (part == &part->job->whole) {
+        wc_count_job(pool, worker, part->job, p->what, p->bufs[worker]);
+    } else {
+        wc_count_range(part, p->what, p->bufs[worker]);
+    }
+}
+
+/*
+ * Tasks the operands would make (files, or ranges of large ones), to
+ * size the pool; stat() only, nothing is opened
+ */
+static size_t wc_plan(char **names, int n, int what)
+{
+    size_t tasks = 0;
+    struct stat st;
+
+    for (int i = 0; i < n; i++) {
+        if (wc_is_stdin(names[i])) {
+            continue;
+        }
+        if (wc_splittable(what) && stat(names[i], &st) == 0 && S_ISREG(st.st_mode) &&
+            st.st_size >= 2 * (off_t)WC_CHUNK) {
+            tasks += (size_t)((st.st_size + WC_CHUNK - 1) / WC_CHUNK);
+        } else {
+            tasks++;
+        }
+    }
+    return tasks;
+}
+
+/*
+ * Count names[0..n) on nworkers threads, then print them in order with
+ * the same results a serial pass gives. Standard input is read here,
+ * before the pool starts, since its stream belongs to this thread.
+ * Returns: EXIT_OK, or EXIT_ERROR if any operand failed
+ */
+static int wc_parallel(pb_out_t *out, char **names, int n, int what, int nworkers,
+                       char *buf, wc_counts_t *total)
+{
+    wc_pool_t p;
+    wc_job_t *jobs;
+    work_pool_t *pool = NULL;
+    int ready;
+    int counted = 0;
+    int ret = EXIT_OK;
+    int i;
+
+    jobs = calloc((size_t)n, sizeof(wc_job_t));
+    if (!jobs) {
+        goto serial;
+    }
+
+    memset(&p, 0, sizeof(p));
+    p.what = what;
+    p.bufs[0] = buf;
+    for (ready = 1; ready < nworkers; ready++) {
+        p.bufs[ready] = wc_alloc_block();
+        if (!p.bufs[ready]) {
+            break;
+        }
+    }
+
+    pool = work_pool_create(ready, wc_visit, &p);
+    if (!pool) {
+        goto out;
+    }
+    counted = 1;
+
+    for (i = 0; i < n; i++) {
+        wc_job_t *job = &jobs[i];
+
+        job->name = names[i];
+        job->whole.job = job;
+        if (wc_is_stdin(names[i])) {
+            job->whole.err = wc_count_file(names[i], what, buf, &job->whole.c);
+        } else if (work_pool_push(pool, i % ready, &job->whole) != 0) {
+            job->whole.err = wc_count_file(names[i], what, buf, &job->whole.c);
+        }
+    }
+    work_pool_run(pool);
+
+    for (i = 0; i < n; i++) {
+        wc_job_t *job = &jobs[i];
+        int err = job->whole.err;
+
+        for (size_t k = 0; k < job->nparts; k++) {
+            wc_add(&job->whole.c, &job->parts[k].c);
+            if (!err) {
+                err = job->parts[k].err;
+            }
+        }
+        if (err) {
+            wc_report(job->name, err);
+            ret = EXIT_ERROR;
+            continue;
+        }
+        wc_print(out, &job->whole.c, what, wc_is_stdin(job->name) ? NULL : job->name);
+        wc_add(total, &job->whole.c);
+    }
+
+out:
+    work_pool_destroy(pool);
+    for (i = 1; i < ready; i++) {
+        free(p.bufs[i]);
+    }
+    for (i = 0; i < n; i++) {
+        free(jobs[i].parts);
+    }
+    free(jobs);
+    if (counted) {
+        return ret;
+    }
+
+serial:
+    for (i = 0; i < n; i++) {
+        if (wc_file(out, names[i], what, buf, total) != EXIT_OK) {
+            ret = EXIT_ERROR;
+        }
+    }
+    return ret;
+}
+
 /* ===== SECTION 3: RUN FUNCTION ===== */
 
 int wc_run(int argc, char **argv)
 {
     int nerrors;
-    int show_lines, show_words, show_bytes;
-    long total_lines = 0, total_words = 0, total_bytes = 0;
+    int what = 0;
+    wc_counts_t total = { 0, 0, 0, 0, 0 };
+    char *buf;
+    int nworkers;
+    size_t tasks;
     int i;
     int ret = EXIT_OK;
+    pb_out_t out;
 
     build_wc_argtable();
-    nerrors = arg_parse(argc, argv, wc_argtable);
+    nerrors = cmd_arg_parse(argc, argv, wc_argtable);
 
     /* Handle --help */
     if (wc_help->count > 0) {
-        wc_print_usage(stdout);
-        arg_freetable(wc_argtable, 6);
+        wc_print_usage(cmd_stdout());
         return EXIT_OK;
     }
 
@@ -143,47 +604,76 @@ int wc_run(int argc, char **argv)
     if (nerrors > 0) {
         arg_print_errors(stderr, wc_end, "wc");
         fprintf(stderr, "Try 'wc --help' for more information.\n");
-        arg_freetable(wc_argtable, 6);
         return EXIT_ERROR;
     }
 
     /* ===== ACTUAL COMMAND LOGIC ===== */
 
     /* Determine what to show */
-    show_lines = (wc_lines->count > 0);
-    show_words = (wc_words->count > 0);
-    show_bytes = (wc_bytes->count > 0);
+    if (wc_lines->count > 0) what |= TEXT_COUNT_LINES;
+    if (wc_words->count > 0) what |= TEXT_COUNT_WORDS;
+    if (wc_chars->count > 0) what |= TEXT_COUNT_CHARS;
+    if (wc_bytes->count > 0) what |= WC_BYTES;
+    if (wc_max_line->count > 0) what |= TEXT_COUNT_WIDTH;
+
+    /* If no options specified, show lines, words and bytes */
+    if (what == 0) {
+        what = TEXT_COUNT_LINES | TEXT_COUNT_WORDS | WC_BYTES;
+    }
+    if (wc_decompress->count > 0) {
+        what |= WC_DECOMPRESS;
+    }
 
-    /* If no options specified, show all */
-    if (!show_lines && !show_words && !show_bytes) {
-        show_lines = 1;
-        show_words = 1;
-        show_bytes = 1;
+    buf = wc_alloc_block();
+    if (!buf) {
+        fprintf(stderr, "wc: out of memory\n");
+        return EXIT_ERROR;
+    }
+
+    if (pb_out_init(&out, cmd_stdout()) != 0) {
+        fprintf(stderr, "wc: out of memory\n");
+        free(buf);
+        return EXIT_ERROR;
     }
 
     /* If no files specified, read from stdin */
     if (wc_files->count == 0) {
-        ret = wc_file(NULL, show_lines, show_words, show_bytes,
-                      &total_lines, &total_words, &total_bytes);
+        ret = wc_file(&out, NULL, what, buf, &total);
     } else {
-        /* Process each file */
-        for (i = 0; i < wc_files->count; i++) {
-            if (wc_file(wc_files->filename[i], show_lines, show_words, show_bytes,
-                       &total_lines, &total_words, &total_bytes) != EXIT_OK) {
-                ret = EXIT_ERROR;
+        /* Several files, or one large one: spread them over threads */
+        nworkers = work_pool_default_workers();
+        tasks = wc_plan((char **)wc_files->filename, wc_files->count, what);
+        if ((size_t)nworkers > tasks) {
+            nworkers = (int)tasks;
+        }
+        if (nworkers > WC_MAX_WORKERS) {
+            nworkers = WC_MAX_WORKERS;
+        }
+
+        if (nworkers > 1) {
+            ret = wc_parallel(&out, (char **)wc_files->filename, wc_files->count, what,
+                              nworkers, buf, &total);
+        } else {
+            /* Process each file */
+            for (i = 0; i < wc_files->count; i++) {
+                if (wc_file(&out, wc_files->filename[i], what, buf, &total) != EXIT_OK) {
+                    ret = EXIT_ERROR;
+                }
             }
         }
 
         /* Print totals if more than one file */
         if (wc_files->count > 1) {
-            if (show_lines) printf(" %7ld", total_lines);
-            if (show_words) printf(" %7ld", total_words);
-            if (show_bytes) printf(" %7ld", total_bytes);
-            printf(" total\n");
+            wc_print(&out, &total, what, "total");
         }
     }
 
-    arg_freetable(wc_argtable, 6);
+    if (pb_out_close(&out) != 0 && errno != EPIPE) {
+        perror("wc: write error");
+        ret = EXIT_ERROR;
+    }
+
+    free(buf);
     return ret;
 }
 
@@ -204,8 +694,8 @@ void wc_print_usage(FILE *out)
     fprintf(out, "  wc file.txt               Count lines, words, bytes in file.txt\n");
     fprintf(out, "  wc -l file.txt            Count only lines\n");
     fprintf(out, "  wc -w file1 file2         Count only words in two files\n");
-
-    arg_freetable(wc_argtable, 6);
+    fprintf(out, "  wc -m -L file.txt         Count characters and the widest line\n");
+    fprintf(out, "  wc -lz app.log.gz         Count the lines of app.log.gz decompressed\n");
 }
 
 /* ===== SECTION 5: COMMAND SPECIFICATION ===== */
@@ -216,7 +706,8 @@ cmd_spec_t cmd_wc_spec = {
     .long_help = "Print newline, word, and byte counts for each FILE, "
                  "and a total line if more than one FILE is specified.",
     .run = wc_run,
-    .print_usage = wc_print_usage
+    .print_usage = wc_print_usage,
+    .flags = CMD_FLAG_STREAMS | CMD_FLAG_PURE
 };
 
 /* ===== SECTION 6: REGISTRATION FUNCTION ===== */
@@ -0,0 +1,715 @@
+/*
+ * cmd_xargs.c - Build and run command lines from standard input
+ *
+ * Follows the standard command anatomy for PicoBox (argtable3).
+ *
+ * Usage: xargs [OPTIONS] [COMMAND [INITIAL-ARGS...]]
+ * Options:
+ *   -n, --max-args=NUM    Use at most NUM input arguments per command
+ *   -0, --null            Input items are separated by NUL, not blanks
+ *   -I REPLACE            Run COMMAND once per input line, replacing
+ *                         REPLACE in INITIAL-ARGS with the line
+ *   -P, --max-procs=NUM   Run up to NUM commands at a time (0 = one per CPU)
+ *   -h, --help            Display help message
+ *
+ * Each batch of arguments is one invocation. A registry command runs
+ * directly in this process when batches run one at a time; with -P it
+ * runs in a forked child per batch (commands keep their parsed
+ * arguments in file-scope argtables, so two batches of the same command
+ * cannot share a process). Anything else is started with
+ * spawn_external(). Running children are tracked by the reaper, so
+ * a free slot is refilled as soon as any batch finishes.
+ *
+ * With -0 the input is taken a large block at a time (line_reader_t)
+ * and a batch's arguments point into the block, so find -print0 can
+ * hand over millions of paths without one being copied.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* getdelim(), strdup(), fileno() and O_CLOEXEC */
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#if defined(__GLIBC__)
+#include <stdio_ext.h>
+#endif
+#include "argtable3.h"
+#include "cmd_spec.h"
+#include "picobox.h"
+#include "exec_helpers.h"
+#include "reaper.h"
+#include "time_stats.h"
+#include "utils.h"
+
+/* Batch limits when -n is not given (well inside ARG_MAX) */
+#define XARGS_MAX_ARGS  4096
+#define XARGS_MAX_BYTES (128 * 1024)
+
+/*
+ * A registry command takes at most this many operands (the limit its
+ * argtable sets), so without -n its batches stop there
+ */
+#define XARGS_REGISTRY_MAX_ARGS 100
+
+/* Upper bound for -P */
+#define XARGS_MAX_PROCS 256
+
+/* Exit status when any invocation failed (GNU/BSD xargs) */
+#define XARGS_EXIT_FAILED 123
+
+/* Forward declarations */
+int xargs_run(int argc, char **argv);
+void xargs_print_usage(FILE *out);
+
+/* ===== SECTION 1: ARGTABLE STRUCTURES ===== */
+
+static struct arg_lit *xargs_help;
+static struct arg_int *xargs_max_args;
+static struct arg_lit *xargs_null;
+static struct arg_str *xargs_replace;
+static struct arg_int *xargs_max_procs;
+static struct arg_end *xargs_end;
+static void *xargs_argtable[7];
+
+/* ===== SECTION 2: ARGTABLE BUILDER ===== */
+
+static void build_xargs_argtable(void)
+{
+    if (xargs_argtable[0] != NULL) {
+        return;
+    }
+
+    xargs_help = arg_lit0("h", "help", "display this help and exit");
+    xargs_max_args = arg_int0("n", "max-args", "NUM", "use at most NUM arguments per command");
+    xargs_null = arg_lit0("0", "null", "items are terminated by NUL, not whitespace");
+    xargs_replace = arg_str0("I", NULL, "REPLACE", "replace REPLACE in INITIAL-ARGS with each input line");
+    xargs_max_procs = arg_int0("P", "max-procs", "NUM", "run up to NUM commands at a time (0 = one per CPU)");
+    xargs_end = arg_end(20);
+
+    xargs_argtable[0] = xargs_help;
+    xargs_argtable[1] = xargs_max_args;
+    xargs_argtable[2] = xargs_null;
+    xargs_argtable[3] = xargs_replace;
+    xargs_argtable[4] = xargs_max_procs;
+    xargs_argtable[5] = xargs_end;
+    xargs_argtable[6] = NULL;
+}
+
+/* ===== HELPER FUNCTIONS ===== */
+
+/* Options and running state for one xargs invocation */
+typedef struct xargs_state {
+    char **initial;          /* COMMAND and INITIAL-ARGS */
+    int ninitial;
+    const char *replace;     /* -I string, or NULL */
+    int max_args;            /* Input arguments per batch */
+    int max_procs;           /* Concurrent invocations */
+    const cmd_spec_t *spec;  /* Registry command, or NULL for external */
+    int devnull;             /* stdin for the commands */
+    pid_t *running;          /* Live children, max_procs slots (0 = free) */
+    int nrunning;
+    int status;              /* Combined exit status */
+} xargs_state_t;
+
+/*
+ * Index of the first argument that is not an xargs option
+ * (-n, -I and -P take the following word unless it is attached)
+ */
+static int command_index(int argc, char **argv)
+{
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if (strcmp(arg, "--") == 0) {
+            return i + 1;
+        }
+        if (arg[0] != '-' || arg[1] == '\0') {
+            break;
+        }
+        if (strcmp(arg, "-n") == 0 || strcmp(arg, "-I") == 0 ||
+            strcmp(arg, "-P") == 0 || strcmp(arg, "--max-args") == 0 ||
+            strcmp(arg, "--max-procs") == 0) {
+            i++;
+        }
+    }
+
+    return i < argc ? i : argc;
+}
+
+/*
+ * Read the next input item into *buf
+ *
+ * Items are NUL-terminated with -0, lines with -I, and otherwise runs
+ * of non-blank characters.
+ * Returns: item length, or -1 at end of input
+ */
+static ssize_t read_item(FILE *in, int delim, char **buf, size_t *cap)
+{
+    ssize_t len;
+    int c;
+
+    if (delim != ' ') {
+        do {
+            len = getdelim(buf, cap, delim, in);
+            if (len < 0) {
+                return -1;
+            }
+            if (len > 0 && (*buf)[len - 1] == delim) {
+                (*buf)[--len] = '\0';
+            }
+        } while (len == 0 && delim == '\n');   /* -I skips blank lines */
+        return len;
+    }
+
+    do {
+        c = getc(in);
+    } while (c == ' ' || c == '\t' || c == '\n');
+
+    if (c == EOF) {
+        return -1;
+    }
+
+    len = 0;
+    do {
+        if ((size_t)len + 1 >= *cap) {
+            size_t ncap = *cap ? *cap * 2 : 256;
+            char *nbuf = realloc(*buf, ncap);
+
+            if (!nbuf) {
+                return -1;
+            }
+            *buf = nbuf;
+            *cap = ncap;
+        }
+        (*buf)[len++] = (char)c;
+        c = getc(in);
+    } while (c != EOF && c != ' ' && c != '\t' && c != '\n');
+    (*buf)[len] = '\0';
+
+    return len;
+}
+
+/*
+ * Copy s with every occurrence of pattern replaced by item
+ * Returns: malloc'd string, or NULL on allocation failure
+ */
+static char *replace_all(const char *s, const char *pattern, const char *item)
+{
+    size_t plen = strlen(pattern);
+    size_t ilen = strlen(item);
+    size_t count = 0;
+    const char *p;
+    char *out;
+    char *o;
+
+    if (plen == 0) {
+        return strdup(s);
+    }
+
+    for (p = strstr(s, pattern); p; p = strstr(p + plen, pattern)) {
+        count++;
+    }
+
+    out = malloc(strlen(s) + count * ilen + 1);
+    if (!out) {
+        return NULL;
+    }
+
+    for (o = out; (p = strstr(s, pattern)) != NULL; s = p + plen) {
+        memcpy(o, s, (size_t)(p - s));
+        o += p - s;
+        memcpy(o, item, ilen);
+        o += ilen;
+    }
+    strcpy(o, s);
+
+    return out;
+}
+
+/* Fold one invocation's exit code into the overall status */
+static void record_status(xargs_state_t *st, int code)
+{
+    if (code == 126 || code == 127) {
+        if (st->status == EXIT_OK || st->status == XARGS_EXIT_FAILED) {
+            st->status = code;
+        }
+    } else if (code != 0 && st->status == EXIT_OK) {
+        st->status = XARGS_EXIT_FAILED;
+    }
+}
+
+/* Exit code for a reaped child, as wait_for_child() would report it */
+static int child_exit_code(int status, const char *name)
+{
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr, "%s: terminated by signal %d\n", name, WTERMSIG(status));
+        return 128 + WTERMSIG(status);
+    }
+    return EXIT_ERROR;
+}
+
+/*
+ * Reap at least one running child (all that have exited)
+ * Returns: 0 on success, -1 on error
+ */
+static int reap_some(xargs_state_t *st)
+{
+    int reaped = 0;
+
+    while (!reaped) {
+        if (reaper_collect(-1) < 0) {
+            perror("xargs: wait");
+            return -1;
+        }
+
+        for (int i = 0; i < st->max_procs; i++) {
+            struct rusage usage;
+            int status;
+
+            if (st->running[i] == 0 ||
+                reaper_take(st->running[i], &status, &usage) != 1) {
+                continue;
+            }
+            time_stats_child(&usage);
+            record_status(st, child_exit_code(status, st->initial[0]));
+            st->running[i] = 0;
+            st->nrunning--;
+            reaped = 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Fork a child that runs a registry command (does not exec) */
+static pid_t fork_registry(xargs_state_t *st, int argc, char **argv)
+{
+    pid_t pid;
+
+    /* Output buffered so far must not be written twice */
+    fflush(stdout);
+
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0) {
+        int code;
+
+        /* The reaper entries are the parent's children */
+        reaper_forget_all();
+        if (dup2(st->devnull, STDIN_FILENO) < 0) {
+            _exit(EXIT_ERROR);
+        }
+        /* Input items we buffered are not the command's */
+#if defined(__GLIBC__)
+        __fpurge(stdin);
+#elif defined(__APPLE__)
+        fpurge(stdin);
+#endif
+        code = st->spec->run(argc, argv);
+        fflush(stdout);
+        _exit(code);
+    }
+
+    return pid;
+}
+
+/*
+ * Run one batch: argv is COMMAND, its initial arguments and the batch
+ * Waits for a free slot first when max_procs are already running.
+ */
+static void run_batch(xargs_state_t *st, int argc, char **argv)
+{
+    pid_t pid;
+    int slot;
+
+    /* One at a time: a registry command runs right here */
+    if (st->max_procs == 1 && st->spec && !(st->spec->flags & CMD_FLAG_FORK)) {
+        record_status(st, st->spec->run(argc, argv));
+        fflush(cmd_stdout());
+        return;
+    }
+
+    while (st->nrunning >= st->max_procs) {
+        if (reap_some(st) != 0) {
+            record_status(st, EXIT_ERROR);
+            return;
+        }
+    }
+
+    if (st->spec) {
+        pid = fork_registry(st, argc, argv);
+    } else {
+        pid = spawn_external(argv, NULL, st->devnull, -1, NULL, 0);
+        if (pid < 0) {
+            /* spawn_external() has already said why */
+            record_status(st, 127);
+            return;
+        }
+    }
+    if (pid < 0) {
+        record_status(st, EXIT_ERROR);
+        return;
+    }
+
+    if (reaper_watch(pid) != 0) {
+        record_status(st, wait_for_child(pid, argv[0]));
+        return;
+    }
+
+    for (slot = 0; st->running[slot] != 0; slot++) {
+        ;
+    }
+    st->running[slot] = pid;
+    st->nrunning++;
+}
+
+/*
+ * Run COMMAND with the items in argv[ninitial..argc), then free the
+ * first nowned of them (the rest are not the batch's own)
+ */
+static void run_items(xargs_state_t *st, char **argv, int argc, int nowned)
+{
+    memcpy(argv, st->initial, (size_t)st->ninitial * sizeof(char *));
+    argv[argc] = NULL;
+    run_batch(st, argc, argv);
+    for (int i = st->ninitial; i < st->ninitial + nowned; i++) {
+        free(argv[i]);
+    }
+}
+
+/* Wait for every batch still running */
+static void reap_all(xargs_state_t *st)
+{
+    while (st->nrunning > 0) {
+        if (reap_some(st) != 0) {
+            record_status(st, EXIT_ERROR);
+            break;
+        }
+    }
+}
+
+/*
+ * Read items from in and run the command on them in batches
+ * Returns: exit status (0, 123 if a command failed, 126/127 if one
+ *          could not be run)
+ */
+static int xargs_loop(xargs_state_t *st, FILE *in, int delim)
+{
+    char **argv;
+    int argc;
+    int batch_max = st->replace ? 1 : st->max_args;
+    size_t bytes = 0;
+    char *item = NULL;
+    size_t cap = 0;
+    ssize_t len;
+
+    argv = calloc((size_t)st->ninitial + (size_t)batch_max + 1, sizeof(char *));
+    if (!argv) {
+        perror("xargs");
+        return EXIT_ERROR;
+    }
+    argc = st->ninitial;
+
+    while ((len = read_item(in, delim, &item, &cap)) >= 0) {
+        if (st->replace) {
+            /* -I: the item goes into the initial arguments instead */
+            int ok = 1;
+
+            for (int i = 0; i < st->ninitial; i++) {
+                argv[i] = replace_all(st->initial[i], st->replace, item);
+                ok = ok && argv[i] != NULL;
+            }
+            argv[st->ninitial] = NULL;
+            if (ok) {
+                run_batch(st, st->ninitial, argv);
+            } else {
+                perror("xargs");
+                record_status(st, EXIT_ERROR);
+            }
+            for (int i = 0; i < st->ninitial; i++) {
+                free(argv[i]);
+            }
+            continue;
+        }
+
+        argv[argc] = strdup(item);
+        if (!argv[argc]) {
+            perror("xargs");
+            record_status(st, EXIT_ERROR);
+            break;
+        }
+        argc++;
+        bytes += (size_t)len + 1;
+
+        if (argc - st->ninitial == batch_max || bytes >= XARGS_MAX_BYTES) {
+            run_items(st, argv, argc, argc - st->ninitial);
+            argc = st->ninitial;
+            bytes = 0;
+        }
+    }
+
+    /* Partial last batch (nothing at all on empty input) */
+    if (argc > st->ninitial) {
+        run_items(st, argv, argc, argc - st->ninitial);
+    }
+    reap_all(st);
+
+    free(item);
+    free(argv);
+    return st->status;
+}
+
+/*
+ * xargs_loop() for -0 without -I: the line reader hands over blocks of
+ * NUL-terminated items and the batch's arguments point straight into
+ * them. Only a batch still unfinished at the end of a block is copied,
+ * since the next block is read over it.
+ * Returns: exit status, as xargs_loop()
+ */
+static int xargs_loop_null(xargs_state_t *st, FILE *in)
+{
+    line_reader_t lr;
+    const char *data;
+    size_t len;
+    char **argv;
+    int argc;
+    int nowned = 0;          /* argv[ninitial..ninitial+nowned) are copies */
+    char *last = NULL;       /* A last item with no NUL, copied to end it */
+    size_t bytes = 0;
+    int failed = 0;
+    int r;
+
+    argv = calloc((size_t)st->ninitial + (size_t)st->max_args + 1, sizeof(char *));
+    if (!argv || (fileno(in) >= 0 ? line_reader_init_fd(&lr, fileno(in))
+                                  : line_reader_init_stream(&lr, in)) != 0) {
+        perror("xargs");
+        free(argv);
+        return EXIT_ERROR;
+    }
+    line_reader_set_delim(&lr, '\0');
+    argc = st->ninitial;
+
+    while ((r = line_reader_lines(&lr, &data, &len)) > 0) {
+        const char *p = data;
+        const char *end = data + len;
+
+        while (p < end) {
+            const char *nul = memchr(p, '\0', (size_t)(end - p));
+            size_t n = nul ? (size_t)(nul - p) : (size_t)(end - p);
+
+            if (!nul && (last = strndup(p, n)) == NULL) {
+                failed = 1;
+                break;
+            }
+            argv[argc++] = nul ? (char *)p : last;
+            bytes += n + 1;
+            p += n + 1;
+
+            if (argc - st->ninitial == st->max_args || bytes >= XARGS_MAX_BYTES) {
+                run_items(st, argv, argc, nowned);
+                argc = st->ninitial;
+                nowned = 0;
+                bytes = 0;
+            }
+        }
+
+        /* Keep what the next block would overwrite (none follows a last item) */
+        while (!last && !failed && st->ninitial + nowned < argc) {
+            char **item = &argv[st->ninitial + nowned];
+
+            if ((*item = strdup(*item)) == NULL) {
+                failed = 1;
+                argc = st->ninitial + nowned;
+                break;
+            }
+            nowned++;
+        }
+        if (failed) {
+            perror("xargs");
+            record_status(st, EXIT_ERROR);
+            break;
+        }
+    }
+    if (r < 0) {
+        perror("xargs: read error");
+        record_status(st, EXIT_ERROR);
+    }
+
+    /* Partial last batch (nothing at all on empty input) */
+    if (argc > st->ninitial) {
+        run_items(st, argv, argc, nowned);
+    }
+    reap_all(st);
+
+    free(last);
+    line_reader_free(&lr);
+    free(argv);
+    return st->status;
+}
+
+/* ===== SECTION 3: RUN FUNCTION ===== */
+
+int xargs_run(int argc, char **argv)
+{
+    static char *default_command[] = { "echo", NULL };
+    xargs_state_t st;
+    int nerrors;
+    int cmd_start;
+    int delim;
+    int max_args_given;
+    int ret;
+
+    /* Options end at COMMAND, whose own options are left alone */
+    cmd_start = command_index(argc, argv);
+
+    build_xargs_argtable();
+    nerrors = cmd_arg_parse(cmd_start, argv, xargs_argtable);
+
+    /* Handle --help */
+    if (xargs_help->count > 0) {
+        xargs_print_usage(stdout);
+        return EXIT_OK;
+    }
+
+    /* Handle parsing errors */
+    if (nerrors > 0) {
+        arg_print_errors(stderr, xargs_end, "xargs");
+        fprintf(stderr, "Try 'xargs --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
+    /* ===== ACTUAL COMMAND LOGIC ===== */
+
+    memset(&st, 0, sizeof(st));
+    st.max_args = XARGS_MAX_ARGS;
+    st.max_procs = 1;
+
+    max_args_given = xargs_max_args->count > 0;
+    if (max_args_given) {
+        st.max_args = xargs_max_args->ival[0];
+        if (st.max_args < 1 || st.max_args > XARGS_MAX_ARGS) {
+            fprintf(stderr, "xargs: invalid number of arguments: '%d'\n", st.max_args);
+            return EXIT_ERROR;
+        }
+    }
+
+    if (xargs_max_procs->count > 0) {
+        st.max_procs = xargs_max_procs->ival[0];
+        if (st.max_procs == 0) {
+            long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+            st.max_procs = ncpu > 0 ? (int)ncpu : 1;
+        }
+        if (st.max_procs < 1 || st.max_procs > XARGS_MAX_PROCS) {
+            fprintf(stderr, "xargs: invalid number of processes: '%d'\n", st.max_procs);
+            return EXIT_ERROR;
+        }
+    }
+
+    delim = xargs_null->count > 0 ? '\0' : ' ';
+    if (xargs_replace->count > 0) {
+        st.replace = strdup(xargs_replace->sval[0]);
+        if (delim == ' ') {
+            delim = '\n';
+        }
+    }
+
+    /* Nothing below reads the argtable: a batch may be xargs itself */
+
+    if (cmd_start < argc) {
+        st.initial = argv + cmd_start;
+        st.ninitial = argc - cmd_start;
+    } else {
+        st.initial = default_command;
+        st.ninitial = 1;
+    }
+    st.spec = find_command(st.initial[0]);
+    if (st.spec && !max_args_given && st.max_args > XARGS_REGISTRY_MAX_ARGS) {
+        st.max_args = XARGS_REGISTRY_MAX_ARGS;
+    }
+
+    st.devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    st.running = calloc((size_t)st.max_procs, sizeof(pid_t));
+    if (st.devnull < 0 || !st.running) {
+        perror("xargs");
+        if (st.devnull >= 0) {
+            close(st.devnull);
+        }
+        free(st.running);
+        free((char *)st.replace);
+        return EXIT_ERROR;
+    }
+
+    if (delim == '\0' && !st.replace) {
+        ret = xargs_loop_null(&st, cmd_stdin());
+    } else {
+        ret = xargs_loop(&st, cmd_stdin(), delim);
+    }
+
+    close(st.devnull);
+    free(st.running);
+    free((char *)st.replace);
+    return ret;
+}
+
+/* ===== SECTION 4: PRINT USAGE FUNCTION ===== */
+
+void xargs_print_usage(FILE *out)
+{
+    build_xargs_argtable();
+
+    fprintf(out, "Usage: xargs ");
+    arg_print_syntax(out, xargs_argtable, " [COMMAND [INITIAL-ARGS...]]\n");
+    fprintf(out, "Run COMMAND with INITIAL-ARGS followed by items read from standard input.\n");
+    fprintf(out, "Items are separated by blanks or newlines; COMMAND defaults to echo.\n");
+    fprintf(out, "Nothing is run if the input is empty.\n\n");
+    fprintf(out, "Options:\n");
+    arg_print_glossary(out, xargs_argtable, "  %-25s %s\n");
+    fprintf(out, "\n");
+    fprintf(out, "Exit status is 123 if any invocation failed, 126 or 127 if COMMAND\n");
+    fprintf(out, "could not be run.\n\n");
+    fprintf(out, "Examples:\n");
+    fprintf(out, "  find . -name *.c | xargs -P8 grep main      Search files on 8 CPUs\n");
+    fprintf(out, "  ls | xargs -n 1 echo                         One file per line\n");
+    fprintf(out, "  ls | xargs -I F cp F /tmp                    Copy each file\n");
+    fprintf(out, "  find -name *.o -print0 | xargs -0 rm         Paths with blanks stay whole\n");
+}
+
+/* ===== SECTION 5: COMMAND SPECIFICATION ===== */
+
+cmd_spec_t cmd_xargs_spec = {
+    .name = "xargs",
+    .summary = "build and execute command lines from standard input",
+    .long_help = "Run COMMAND with INITIAL-ARGS followed by items read from standard "
+                 "input, in batches, optionally several batches at a time.",
+    .run = xargs_run,
+    .print_usage = xargs_print_usage
+};
+
+/* ===== SECTION 6: REGISTRATION FUNCTION ===== */
+
+void register_xargs_command(void)
+{
+    register_command(&cmd_xargs_spec);
+}
+
+/* ===== SECTION 7: STANDALONE MAIN ===== */
+
+#ifndef BUILTIN_ONLY
+int main(int argc, char **argv)
+{
+    return cmd_xargs_spec.run(argc, argv);
+}
+#endif
@@ -0,0 +1,73 @@
+/*
+ * cmd_io.c - Per-thread command streams
+ *
+ * Normally every command writes to stdout and reads from stdin. When a
+ * pipeline runs its stages as threads in the shell process, each thread
+ * gets its own pair of streams connected to the neighbouring stages.
+ *
+ * Implementation notes:
+ *   - Streams are thread-local (C11 _Thread_local)
+ *   - NULL means "use the process-wide stdin/stdout"
+ *   - cmd_stdin_done() runs a hook set by the pipeline that owns the
+ *     input stream (closing the reading end of its ring)
+ *   - arg_parse() is not reentrant, so it is wrapped in a mutex
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include "argtable3.h"
+#include "cmd_spec.h"
+
+/* Streams for the command running on this thread (NULL = stdio default) */
+static _Thread_local FILE *thread_in = NULL;
+static _Thread_local FILE *thread_out = NULL;
+
+/* What cmd_stdin_done() runs on this thread */
+static _Thread_local void (*thread_in_done)(void *) = NULL;
+static _Thread_local void *thread_in_done_arg = NULL;
+
+/* Serializes argtable3's getopt state between pipeline threads */
+static pthread_mutex_t parse_lock = PTHREAD_MUTEX_INITIALIZER;
+
+FILE *cmd_stdin(void)
+{
+    return thread_in ? thread_in : stdin;
+}
+
+FILE *cmd_stdout(void)
+{
+    return thread_out ? thread_out : stdout;
+}
+
+void cmd_set_streams(FILE *in, FILE *out)
+{
+    thread_in = in;
+    thread_out = out;
+}
+
+void cmd_set_stdin_done(void (*fn)(void *), void *arg)
+{
+    thread_in_done = fn;
+    thread_in_done_arg = arg;
+}
+
+void cmd_stdin_done(void)
+{
+    void (*fn)(void *) = thread_in_done;
+
+    thread_in_done = NULL;
+    if (fn) {
+        fn(thread_in_done_arg);
+    }
+}
+
+int cmd_arg_parse(int argc, char **argv, void **argtable)
+{
+    int nerrors;
+
+    pthread_mutex_lock(&parse_lock);
+    nerrors = arg_parse(argc, argv, argtable);
+    pthread_mutex_unlock(&parse_lock);
+
+    return nerrors;
+}
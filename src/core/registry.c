@@ -2,66 +2,154 @@
  * registry.c - Command Registry Implementation
  *
  * This file implements a simple global registry for commands.
- * Commands register themselves at startup, and the shell can
- * look them up by name at runtime.
+ * The built-in commands come as one table generated at build time;
+ * more commands can register themselves at runtime, and the shell can
+ * look them up by name.
  *
  * Implementation notes:
- *   - Uses a static array (simple, no dynamic allocation)
- *   - Max 64 commands (more than enough for this project)
- *   - Linear search (fast enough for small number of commands)
- *   - Thread-unsafe (not needed for single-threaded shell)
+ *   - Built-in table: sorted by name by scripts/gen_builtin_table.sh and
+ *     used in place, so startup does no registration work at all
+ *   - Runtime registrations: array of spec pointers kept sorted by name,
+ *     grown with realloc() (no fixed limit, so pkg-installed commands
+ *     always fit)
+ *   - Binary search: find_command() runs for nearly every word the
+ *     shell executes, so lookups are O(log n); registering pays for
+ *     keeping the order
+ *   - The first command registered under a name wins, and the built-in
+ *     table comes first
+ *   - Thread-unsafe registration (done before any pipeline threads start);
+ *     lookups only read
  */
 
-#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include "cmd_spec.h"
 
-/* Maximum number of commands that can be registered */
-#define MAX_COMMANDS 64
+/* Initial registry capacity (doubles when full) */
+#define REGISTRY_INITIAL_CAPACITY 32
 
-/* Global command registry - static array */
-static const cmd_spec_t *command_registry[MAX_COMMANDS]; // Array of pointers for each command
+/* Built-in commands - sorted by name, not owned */
+static const cmd_spec_t *const *builtin_table = NULL;
+static size_t builtin_count = 0;
+
+/* Runtime command registry - sorted by name */
+static const cmd_spec_t **command_registry = NULL;
 static size_t command_count = 0;
+static size_t command_capacity = 0;
+
+/* Bumped by every change to the set of commands */
+static unsigned long generation = 0;
+
+/*
+ * Index of the first command in table whose name is >= name
+ * (count if there is none)
+ */
+static size_t lower_bound(const cmd_spec_t *const *table, size_t count, const char *name)
+{
+    size_t lo = 0;
+    size_t hi = count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (strcmp(table[mid]->name, name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/*
+ * Binary search one sorted table
+ * Returns: the matching spec, or NULL
+ */
+static const cmd_spec_t *search(const cmd_spec_t *const *table, size_t count,
+                                const char *name)
+{
+    size_t pos = lower_bound(table, count, name);
+
+    if (pos < count && strcmp(table[pos]->name, name) == 0) {
+        return table[pos];
+    }
+    return NULL;
+}
+
+/**
+ * Install the table of built-in commands
+ *
+ * Called once from main(). The table is not copied or checked.
+ *
+ * @param table Sorted array of command specs (must remain valid)
+ * @param count Number of entries in table
+ */
+void register_command_table(const cmd_spec_t *const *table, size_t count)
+{
+    builtin_table = table;
+    builtin_count = table ? count : 0;
+    generation++;
+}
 
 /**
  * Register a command in the global registry
  *
- * This function is called during shell initialization.
- * Each command calls register_command(&cmd_NAME_spec) to
- * add itself to the registry.
+ * For commands that are not in the built-in table (e.g. installed with
+ * pkg). Each command calls register_command(&cmd_NAME_spec) to add
+ * itself to the registry.
  *
  * @param spec Pointer to command specification (must remain valid)
  */
 void register_command(const cmd_spec_t *spec)
 {
+    size_t pos;
+
     /* Validate input */
-    if (spec == NULL) {
+    if (spec == NULL || spec->name == NULL) {
         return;
     }
 
-    /* Check if registry is full */
-    if (command_count >= MAX_COMMANDS) {
-        fprintf(stderr, "Warning: Command registry full, cannot register '%s'\n",
-                spec->name ? spec->name : "(null)");
+    /* Already registered under this name: keep the first one */
+    if (search(builtin_table, builtin_count, spec->name) != NULL) {
+        return;
+    }
+    pos = lower_bound(command_registry, command_count, spec->name);
+    if (pos < command_count && strcmp(command_registry[pos]->name, spec->name) == 0) {
         return;
     }
 
-    /* Add to registry */
-    command_registry[command_count++] = spec;
+    /* Grow the registry if it is full */
+    if (command_count == command_capacity) {
+        size_t capacity = command_capacity ? command_capacity * 2 : REGISTRY_INITIAL_CAPACITY;
+        const cmd_spec_t **grown = realloc(command_registry, capacity * sizeof(*grown));
+
+        if (grown == NULL) {
+            fprintf(stderr, "Warning: Out of memory, cannot register '%s'\n", spec->name);
+            return;
+        }
+        command_registry = grown;
+        command_capacity = capacity;
+    }
+
+    /* Insert in name order */
+    memmove(&command_registry[pos + 1], &command_registry[pos],
+            (command_count - pos) * sizeof(*command_registry));
+    command_registry[pos] = spec;
+    command_count++;
+    generation++;
 }
 
 /**
  * Find a command by name
  *
- * Performs linear search through the registry.
- * This is O(n) but fast enough for small n (< 64 commands).
+ * Binary search over the built-in table, then the runtime registry.
  *
  * @param name Command name to search for
  * @return Pointer to command spec, or NULL if not found
  */
 const cmd_spec_t *find_command(const char *name)
 {
-    size_t i;
     const cmd_spec_t *spec;
 
     /* Validate input */
@@ -69,30 +157,20 @@ const cmd_spec_t *find_command(const char *name)
         return NULL;
     }
 
-    /* Linear search */
-    for (i = 0; i < command_count; i++) {
-        spec = command_registry[i];
-
-        /* Skip NULL entries (shouldn't happen, but be defensive) */
-        if (spec == NULL || spec->name == NULL) {
-            continue;
-        }
-
-        /* Compare names */
-        if (strcmp(spec->name, name) == 0) {
-            return spec;
-        }
+    spec = search(builtin_table, builtin_count, name);
+    if (spec == NULL) {
+        spec = search(command_registry, command_count, name);
     }
 
-    /* Not found */
-    return NULL;
+    return spec;
 }
 
 /**
  * Iterate over all registered commands
  *
- * Calls the provided callback function for each registered command.
- * Useful for implementing the "help" command that lists all commands.
+ * Calls the provided callback function for each registered command,
+ * in name order. Useful for implementing the "help" command that lists
+ * all commands.
  *
  * @param callback Function to call for each command
  * @param userdata User-provided data passed to callback
@@ -100,17 +178,35 @@ const cmd_spec_t *find_command(const char *name)
 void for_each_command(void (*callback)(const cmd_spec_t *spec, void *userdata),
                       void *userdata)
 {
-    size_t i;
+    size_t b = 0;
+    size_t r = 0;
 
     /* Validate callback */
     if (callback == NULL) {
         return;
     }
 
-    /* Call callback for each command */
-    for (i = 0; i < command_count; i++) {
-        if (command_registry[i] != NULL) {
-            callback(command_registry[i], userdata);
+    /* Merge the two sorted tables */
+    while (b < builtin_count || r < command_count) {
+        if (r == command_count ||
+            (b < builtin_count &&
+             strcmp(builtin_table[b]->name, command_registry[r]->name) < 0)) {
+            callback(builtin_table[b++], userdata);
+        } else {
+            callback(command_registry[r++], userdata);
         }
     }
 }
+
+/**
+ * Registry generation
+ *
+ * Lets anything derived from the commands (such as the @-query search
+ * index) tell when it is out of date.
+ *
+ * @return A number that changes whenever a command is registered
+ */
+unsigned long registry_generation(void)
+{
+    return generation;
+}
@@ -0,0 +1,672 @@
+/*
+ * walk.c - Directory tree walker
+ *
+ * A walk_dir_t is an open directory. refs counts what is still to come
+ * inside it: one for its own listing, one per entry queued on the pool
+ * and one per subdirectory opened from it. Whoever drops the last
+ * reference makes the WALK_POST visit, closes the directory and drops
+ * the reference it held on its parent; serially that is simply the
+ * way back out of the recursion.
+ *
+ * A listing is read whole before any of its entries is visited, so a
+ * directory is never read from while its subdirectories are walked.
+ * On Linux it is read with getdents64() straight into a buffer that
+ * grows as needed, holding the kernel's records as they are; readdir()
+ * fills the same record layout elsewhere.
+ *
+ * Entry paths are built in a per-thread buffer; only directories keep
+ * a copy of theirs, for the entries inside them.
+ *
+ * With WALK_STAT and an io_uring to be had (batch_io.h), each worker
+ * has a ring, and a listing's entries are stat'ed WALK_RUN at a time
+ * on it before they are visited, rather than one fstatat() each.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* openat(), fdopendir(), syscall() */
+#endif
+
+#include "walk.h"
+#include "work_pool.h"
+#include "batch_io.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+/* A listing buffer starts at this size and doubles */
+#define WALK_LIST_SIZE (64 * 1024)
+
+/* Entries of a listing stat'ed together on a ring */
+#define WALK_RUN 128
+
+/* Layout of struct linux_dirent64, which getdents64() fills */
+typedef struct walk_dirent {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} walk_dirent_t;
+
+typedef struct walk_dir {
+    struct walk_dir *parent;  /* NULL for a root */
+    int fd;
+    int depth;
+    int has_st;
+    struct stat st;
+    atomic_int refs;
+    size_t path_len;
+    char *path;               /* Stored after the data */
+    const char *name;         /* In path */
+    void *data;               /* walk_opts_t.data_size bytes, zeroed */
+} walk_dir_t;
+
+/* An entry queued on the pool (parent NULL: a root) */
+typedef struct walk_item {
+    walk_dir_t *parent;
+    int type;
+    int has_st;
+    struct stat st;
+    char name[];
+} walk_item_t;
+
+typedef struct walk_worker {
+    char *path;               /* Path of the entry being visited */
+    size_t path_cap;
+    char *list;               /* Listing buffer (pool workers only) */
+    size_t list_cap;
+    batch_io_t *io;           /* With WALK_STAT, if there is a ring */
+} walk_worker_t;
+
+/* A run of entries from one listing, stat'ed in one batch */
+typedef struct walk_run {
+    size_t n;
+    const char *names[WALK_RUN];
+    int types[WALK_RUN];
+    int err[WALK_RUN];
+    struct stat st[WALK_RUN];
+} walk_run_t;
+
+typedef struct walk_state {
+    int dirfd;
+    int flags;
+    size_t data_size;
+    walk_fn_t fn;
+    walk_filter_t filter;
+    void *arg;
+    work_pool_t *pool;        /* NULL when serial */
+    walk_worker_t *workers;
+    atomic_int stop;
+} walk_t;
+
+static void walk_enter(walk_t *w, int worker, walk_dir_t *parent, const char *name,
+                       const struct stat *st);
+
+static int walk_grow(char **buf, size_t *cap, size_t need)
+{
+    size_t n = *cap ? *cap : WALK_LIST_SIZE;
+    char *bigger;
+
+    while (n < need) {
+        n *= 2;
+    }
+    if (n == *cap) {
+        return 0;
+    }
+    bigger = realloc(*buf, n);
+    if (!bigger) {
+        return -1;
+    }
+    *buf = bigger;
+    *cap = n;
+    return 0;
+}
+
+/*
+ * Read the whole of directory fd into *buf as walk_dirent_t records
+ * Returns: bytes read, or -1 with errno set
+ */
+static ssize_t walk_read(int fd, char **buf, size_t *cap)
+{
+    size_t len = 0;
+
+#ifdef SYS_getdents64
+    for (;;) {
+        long n;
+
+        if (walk_grow(buf, cap, len + WALK_LIST_SIZE / 2) != 0) {
+            return -1;
+        }
+        n = syscall(SYS_getdents64, fd, *buf + len, *cap - len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            return (ssize_t)len;
+        }
+        len += (size_t)n;
+    }
+#else
+    int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    DIR *dir = dup_fd >= 0 ? fdopendir(dup_fd) : NULL;
+    struct dirent *ent;
+
+    if (!dir) {
+        int err = errno;
+
+        if (dup_fd >= 0) {
+            close(dup_fd);
+        }
+        errno = err;
+        return -1;
+    }
+
+    while ((ent = readdir(dir)) != NULL) {
+        size_t nlen = strlen(ent->d_name);
+        size_t reclen = (offsetof(walk_dirent_t, d_name) + nlen + 1 + 7) & ~(size_t)7;
+        walk_dirent_t *rec;
+
+        if (walk_grow(buf, cap, len + reclen) != 0) {
+            closedir(dir);
+            errno = ENOMEM;
+            return -1;
+        }
+        rec = (walk_dirent_t *)(*buf + len);
+        rec->d_ino = 0;
+        rec->d_off = 0;
+        rec->d_reclen = (unsigned short)reclen;
+#ifdef DT_UNKNOWN
+        rec->d_type = ent->d_type;
+#else
+        rec->d_type = 0;
+#endif
+        memcpy(rec->d_name, ent->d_name, nlen + 1);
+        len += reclen;
+    }
+    closedir(dir);
+    return (ssize_t)len;
+#endif
+}
+
+/* WALK_T_* for a d_type, -1 if it does not say */
+static int walk_dtype(unsigned char t)
+{
+#ifdef DT_DIR
+    switch (t) {
+    case DT_DIR:
+        return WALK_T_DIR;
+    case DT_REG:
+        return WALK_T_REG;
+    case DT_LNK:
+        return WALK_T_LNK;
+    case DT_UNKNOWN:
+        return -1;
+    default:
+        return WALK_T_OTHER;
+    }
+#else
+    (void)t;
+    return -1;
+#endif
+}
+
+static int walk_mode_type(mode_t mode)
+{
+    if (S_ISDIR(mode)) {
+        return WALK_T_DIR;
+    }
+    if (S_ISREG(mode)) {
+        return WALK_T_REG;
+    }
+    if (S_ISLNK(mode)) {
+        return WALK_T_LNK;
+    }
+    return WALK_T_OTHER;
+}
+
+/*
+ * Path of name in parent, in the worker's buffer (a root is its own path)
+ * Returns: the path, or NULL if out of memory
+ */
+static const char *walk_path(walk_t *w, int worker, const walk_dir_t *parent, const char *name,
+                             size_t *len)
+{
+    walk_worker_t *wk = &w->workers[worker];
+    size_t nlen = strlen(name);
+    size_t plen;
+    int slash;
+
+    if (!parent) {
+        *len = nlen;
+        return name;
+    }
+
+    plen = parent->path_len;
+    slash = plen > 0 && parent->path[plen - 1] != '/';
+    if (walk_grow(&wk->path, &wk->path_cap, plen + slash + nlen + 1) != 0) {
+        return NULL;
+    }
+    memcpy(wk->path, parent->path, plen);
+    if (slash) {
+        wk->path[plen] = '/';
+    }
+    memcpy(wk->path + plen + slash, name, nlen + 1);
+    *len = plen + slash + nlen;
+    return wk->path;
+}
+
+static int walk_call(walk_t *w, const walk_entry_t *e)
+{
+    int ret = w->fn(e, w->arg);
+
+    if (ret == WALK_STOP) {
+        atomic_store(&w->stop, 1);
+    }
+    return ret;
+}
+
+/* Start an entry's visit: everything but path, fd and data */
+static void walk_entry_init(walk_t *w, walk_entry_t *e, int worker, int visit, int type,
+                            const walk_dir_t *parent, const char *name)
+{
+    memset(e, 0, sizeof(*e));
+    e->visit = visit;
+    e->type = type;
+    e->name = name;
+    e->dirfd = parent ? parent->fd : w->dirfd;
+    e->fd = -1;
+    e->depth = parent ? parent->depth + 1 : 0;
+    e->worker = worker;
+    e->parent_data = parent ? parent->data : NULL;
+}
+
+static void walk_error(walk_t *w, int worker, const walk_dir_t *parent, const char *name,
+                       int type, int err)
+{
+    walk_entry_t e;
+
+    walk_entry_init(w, &e, worker, WALK_ERROR, type, parent, name);
+    e.error = err;
+    e.path = walk_path(w, worker, parent, name, &e.path_len);
+    if (!e.path) {
+        e.path = name;
+        e.path_len = strlen(name);
+    }
+    walk_call(w, &e);
+}
+
+static void walk_leaf(walk_t *w, int worker, walk_dir_t *parent, const char *name, int type,
+                      const struct stat *st)
+{
+    walk_entry_t e;
+
+    walk_entry_init(w, &e, worker, WALK_LEAF, type, parent, name);
+    e.st = st;
+    e.path = walk_path(w, worker, parent, name, &e.path_len);
+    if (!e.path) {
+        walk_error(w, worker, parent, name, type, ENOMEM);
+        return;
+    }
+    walk_call(w, &e);
+}
+
+/* Drop a reference to d; on the last, visit it in post-order and close it */
+static void walk_dir_put(walk_t *w, int worker, walk_dir_t *d)
+{
+    while (d && atomic_fetch_sub(&d->refs, 1) == 1) {
+        walk_dir_t *parent = d->parent;
+
+        if (!atomic_load(&w->stop)) {
+            walk_entry_t e;
+
+            walk_entry_init(w, &e, worker, WALK_POST, WALK_T_DIR, parent, d->name);
+            e.path = d->path;
+            e.path_len = d->path_len;
+            e.fd = d->fd;
+            e.st = d->has_st ? &d->st : NULL;
+            e.data = d->data;
+            walk_call(w, &e);
+        }
+        close(d->fd);
+        free(d);
+        d = parent;
+    }
+}
+
+/* Queue an entry of parent (NULL: a root) on the pool */
+static void walk_push(walk_t *w, int worker, walk_dir_t *parent, const char *name, int type,
+                      const struct stat *st)
+{
+    size_t nlen = strlen(name);
+    walk_item_t *it = malloc(sizeof(walk_item_t) + nlen + 1);
+
+    if (!it) {
+        walk_error(w, worker, parent, name, type, ENOMEM);
+        return;
+    }
+    it->parent = parent;
+    it->type = type;
+    it->has_st = st != NULL;
+    if (st) {
+        it->st = *st;
+    }
+    memcpy(it->name, name, nlen + 1);
+
+    if (parent) {
+        atomic_fetch_add(&parent->refs, 1);
+    }
+    if (work_pool_push(w->pool, worker, it) != 0) {
+        walk_error(w, worker, parent, name, type, ENOMEM);
+        if (parent) {
+            atomic_fetch_sub(&parent->refs, 1);
+        }
+        free(it);
+    }
+}
+
+/* Visit an entry of parent whose type (and stat, if any) is known */
+static void walk_dispatch(walk_t *w, int worker, walk_dir_t *parent, const char *name, int type,
+                          const struct stat *st)
+{
+    if (type != WALK_T_DIR && w->filter && !w->filter(name, type, w->arg)) {
+        return;
+    }
+
+    if (w->pool && (type == WALK_T_DIR || (w->flags & WALK_SPREAD))) {
+        walk_push(w, worker, parent, name, type, st);
+    } else if (type == WALK_T_DIR) {
+        walk_enter(w, worker, parent, name, st);
+    } else {
+        walk_leaf(w, worker, parent, name, type, st);
+    }
+}
+
+/* An entry of parent from its listing: stat it if need be, then visit it */
+static void walk_entry(walk_t *w, int worker, walk_dir_t *parent, const char *name, int type)
+{
+    int follow = (w->flags & WALK_FOLLOW) != 0;
+    struct stat st;
+    int has_st = 0;
+
+    if ((w->flags & WALK_STAT) || type < 0 || (follow && type == WALK_T_LNK)) {
+        if (fstatat(parent->fd, name, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW) != 0 &&
+            (!follow || fstatat(parent->fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)) {
+            walk_error(w, worker, parent, name, type < 0 ? WALK_T_OTHER : type, errno);
+            return;
+        }
+        has_st = 1;
+        type = walk_mode_type(st.st_mode);
+    }
+
+    walk_dispatch(w, worker, parent, name, type, has_st ? &st : NULL);
+}
+
+/* Stat the entries of parent in r in one batch, visit them and empty r */
+static void walk_run(walk_t *w, int worker, walk_dir_t *parent, walk_run_t *r)
+{
+    int follow = (w->flags & WALK_FOLLOW) != 0;
+    size_t i;
+
+    batch_io_stat(w->workers[worker].io, parent->fd, r->names, r->n,
+                  follow ? 0 : AT_SYMLINK_NOFOLLOW, r->st, r->err);
+
+    for (i = 0; i < r->n && !atomic_load(&w->stop); i++) {
+        /* As walk_entry(): a link that leads nowhere is visited as a link */
+        if (r->err[i] != 0 &&
+            (!follow || fstatat(parent->fd, r->names[i], &r->st[i], AT_SYMLINK_NOFOLLOW) != 0)) {
+            walk_error(w, worker, parent, r->names[i],
+                       r->types[i] < 0 ? WALK_T_OTHER : r->types[i], follow ? errno : r->err[i]);
+            continue;
+        }
+        walk_dispatch(w, worker, parent, r->names[i], walk_mode_type(r->st[i].st_mode),
+                      &r->st[i]);
+    }
+    r->n = 0;
+}
+
+/* Visit every entry of d; drops the listing's reference */
+static void walk_list(walk_t *w, int worker, walk_dir_t *d)
+{
+    walk_worker_t *wk = &w->workers[worker];
+    char *local = NULL;
+    size_t local_cap = 0;
+    char **buf = w->pool ? &wk->list : &local;
+    size_t *cap = w->pool ? &wk->list_cap : &local_cap;
+    ssize_t n = walk_read(d->fd, buf, cap);
+    walk_run_t *run = NULL;
+
+    if (wk->io && n > 0) {
+        run = malloc(sizeof(walk_run_t));
+        if (run) {
+            run->n = 0;
+        }
+    }
+
+    /* Unreadable after opening: its WALK_POST still follows */
+    if (n < 0) {
+        walk_entry_t e;
+
+        walk_entry_init(w, &e, worker, WALK_ERROR, WALK_T_DIR, d->parent, d->name);
+        e.error = errno;
+        e.path = d->path;
+        e.path_len = d->path_len;
+        e.fd = d->fd;
+        e.st = d->has_st ? &d->st : NULL;
+        e.data = d->data;
+        walk_call(w, &e);
+    }
+    for (ssize_t off = 0; off < n && !atomic_load(&w->stop);) {
+        walk_dirent_t *rec = (walk_dirent_t *)(*buf + off);
+        const char *name = rec->d_name;
+
+        off += rec->d_reclen;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        if (!run) {
+            walk_entry(w, worker, d, name, walk_dtype(rec->d_type));
+            continue;
+        }
+        run->names[run->n] = name;
+        run->types[run->n++] = walk_dtype(rec->d_type);
+        if (run->n == WALK_RUN) {
+            walk_run(w, worker, d, run);
+        }
+    }
+    if (run) {
+        walk_run(w, worker, d, run);
+        free(run);
+    }
+
+    free(local);
+    walk_dir_put(w, worker, d);
+}
+
+/* Open directory name in parent (NULL: a root), visit it and what is in it */
+static void walk_enter(walk_t *w, int worker, walk_dir_t *parent, const char *name,
+                       const struct stat *st)
+{
+    int follow = (w->flags & WALK_FOLLOW) ||
+                 (!parent && (w->flags & WALK_FOLLOW_ROOTS));
+    size_t data_size = (w->data_size + 15) & ~(size_t)15;
+    size_t len;
+    const char *path = walk_path(w, worker, parent, name, &len);
+    walk_entry_t e;
+    walk_dir_t *d;
+    int fd;
+    int ret;
+
+    if (!path) {
+        walk_error(w, worker, parent, name, WALK_T_DIR, ENOMEM);
+        return;
+    }
+    fd = openat(parent ? parent->fd : w->dirfd, name,
+                O_RDONLY | O_DIRECTORY | O_CLOEXEC | (follow ? 0 : O_NOFOLLOW));
+    if (fd < 0) {
+        walk_error(w, worker, parent, name, WALK_T_DIR, errno);
+        return;
+    }
+
+    d = malloc(sizeof(walk_dir_t) + data_size + len + 1);
+    if (!d) {
+        close(fd);
+        walk_error(w, worker, parent, name, WALK_T_DIR, ENOMEM);
+        return;
+    }
+    d->parent = parent;
+    d->fd = fd;
+    d->depth = parent ? parent->depth + 1 : 0;
+    d->has_st = st != NULL;
+    if (st) {
+        d->st = *st;
+    }
+    atomic_init(&d->refs, 1);
+    d->data = d + 1;
+    memset(d->data, 0, data_size);
+    d->path = (char *)d->data + data_size;
+    memcpy(d->path, path, len + 1);
+    d->path_len = len;
+    d->name = parent ? d->path + len - strlen(name) : d->path;
+
+    /* A directory that is its own ancestor is a symlink loop */
+    if (w->flags & WALK_FOLLOW) {
+        if (!d->has_st && fstat(fd, &d->st) == 0) {
+            d->has_st = 1;
+        }
+        for (const walk_dir_t *a = parent; a && d->has_st; a = a->parent) {
+            if (a->st.st_dev == d->st.st_dev && a->st.st_ino == d->st.st_ino) {
+                close(fd);
+                free(d);
+                walk_error(w, worker, parent, name, WALK_T_DIR, ELOOP);
+                return;
+            }
+        }
+    }
+
+    walk_entry_init(w, &e, worker, WALK_PRE, WALK_T_DIR, parent, d->name);
+    e.path = d->path;
+    e.path_len = d->path_len;
+    e.fd = fd;
+    e.st = d->has_st ? &d->st : NULL;
+    e.data = d->data;
+    ret = walk_call(w, &e);
+    if (ret != WALK_CONTINUE) {
+        close(fd);
+        free(d);
+        return;
+    }
+
+    if (parent) {
+        atomic_fetch_add(&parent->refs, 1);
+    }
+    walk_list(w, worker, d);
+}
+
+/* Stat a root and visit it */
+static void walk_root(walk_t *w, int worker, const char *root)
+{
+    int follow = (w->flags & (WALK_FOLLOW | WALK_FOLLOW_ROOTS)) != 0;
+    struct stat st;
+
+    if (fstatat(w->dirfd, root, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW) != 0 &&
+        (!follow || fstatat(w->dirfd, root, &st, AT_SYMLINK_NOFOLLOW) != 0)) {
+        walk_error(w, worker, NULL, root, WALK_T_OTHER, errno);
+        return;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        walk_enter(w, worker, NULL, root, &st);
+    } else {
+        walk_leaf(w, worker, NULL, root, walk_mode_type(st.st_mode), &st);
+    }
+}
+
+static void walk_visit(work_pool_t *pool, int worker, void *item, void *arg)
+{
+    walk_t *w = arg;
+    walk_item_t *it = item;
+    const struct stat *st = it->has_st ? &it->st : NULL;
+
+    (void)pool;
+    if (!atomic_load(&w->stop)) {
+        if (!it->parent) {
+            walk_root(w, worker, it->name);
+        } else if (it->type == WALK_T_DIR) {
+            walk_enter(w, worker, it->parent, it->name, st);
+        } else {
+            walk_leaf(w, worker, it->parent, it->name, it->type, st);
+        }
+    }
+    walk_dir_put(w, worker, it->parent);
+    free(it);
+}
+
+int walk(int dirfd, const char *const *roots, int nroots, const walk_opts_t *opts,
+         walk_fn_t fn, void *arg)
+{
+    walk_t w;
+    int nworkers = 1;
+    int i;
+
+    memset(&w, 0, sizeof(w));
+    w.dirfd = dirfd;
+    w.flags = opts->flags;
+    w.data_size = opts->data_size;
+    w.fn = fn;
+    w.filter = opts->filter;
+    w.arg = arg;
+    atomic_init(&w.stop, 0);
+
+    if (w.flags & WALK_PARALLEL) {
+        nworkers = opts->nworkers > 0 ? opts->nworkers : work_pool_default_workers();
+    }
+    w.workers = calloc((size_t)nworkers, sizeof(walk_worker_t));
+    if (!w.workers) {
+        return -1;
+    }
+    if (w.flags & WALK_STAT) {
+        for (i = 0; i < nworkers && (i == 0 || w.workers[0].io); i++) {
+            w.workers[i].io = batch_io_create();
+        }
+    }
+
+    if (w.flags & WALK_PARALLEL) {
+        w.pool = work_pool_create(nworkers, walk_visit, &w);
+        if (!w.pool) {
+            for (i = 0; i < nworkers; i++) {
+                batch_io_destroy(w.workers[i].io);
+            }
+            free(w.workers);
+            errno = ENOMEM;
+            return -1;
+        }
+        for (i = 0; i < nroots; i++) {
+            walk_push(&w, i % nworkers, NULL, roots[i], WALK_T_OTHER, NULL);
+        }
+        work_pool_run(w.pool);
+        work_pool_destroy(w.pool);
+    } else {
+        for (i = 0; i < nroots && !atomic_load(&w.stop); i++) {
+            walk_root(&w, 0, roots[i]);
+        }
+    }
+
+    for (i = 0; i < nworkers; i++) {
+        free(w.workers[i].path);
+        free(w.workers[i].list);
+        batch_io_destroy(w.workers[i].io);
+    }
+    free(w.workers);
+    return atomic_load(&w.stop) ? WALK_STOP : 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * crc32c.c - CRC-32C with hardware CRC instructions
+ *
+ * The reflected polynomial 0x82f63b78, initial value and final XOR
+ * 0xffffffff. The table version looks up eight bytes per step in eight
+ * tables of 256 entries, built on first use.
+ */
+
+#include "crc32c.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_SSE42_KERNEL 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define HAVE_ARMV8_KERNEL 1
+#endif
+
+#define CRC32C_POLY 0x82f63b78u
+
+static uint32_t table[8][256];
+
+static void build_table(void)
+{
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+        uint32_t c = (uint32_t)i;
+
+        for (j = 0; j < 8; j++) {
+            c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        table[0][i] = c;
+    }
+    for (i = 0; i < 256; i++) {
+        for (j = 1; j < 8; j++) {
+            table[j][i] = (table[j - 1][i] >> 8) ^ table[0][table[j - 1][i] & 0xff];
+        }
+    }
+}
+
+static uint32_t crc_scalar(uint32_t crc, const unsigned char *p, size_t len)
+{
+    while (len >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                             (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+
+        crc = table[7][lo & 0xff] ^ table[6][(lo >> 8) & 0xff] ^
+              table[5][(lo >> 16) & 0xff] ^ table[4][lo >> 24] ^
+              table[3][p[4]] ^ table[2][p[5]] ^ table[1][p[6]] ^ table[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xff];
+    }
+    return crc;
+}
+
+#ifdef HAVE_SSE42_KERNEL
+__attribute__((target("sse4.2")))
+static uint32_t crc_sse42(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint64_t c = crc;
+
+    while (len >= 8) {
+        uint64_t w;
+
+        memcpy(&w, p, 8);
+        c = _mm_crc32_u64(c, w);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)c;
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+#ifdef HAVE_ARMV8_KERNEL
+static uint32_t crc_armv8(uint32_t crc, const unsigned char *p, size_t len)
+{
+    while (len >= 8) {
+        uint64_t w;
+
+        memcpy(&w, p, 8);
+        crc = __crc32cd(crc, w);
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = __crc32cb(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+static uint32_t (*crc_fn)(uint32_t, const unsigned char *, size_t);
+static const char *crc_name;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void pick_crc(void)
+{
+    const char *want = getenv("PICOBOX_SIMD");
+    int scalar = want && strcmp(want, "scalar") == 0;
+
+    crc_fn = crc_scalar;
+    crc_name = "scalar";
+#ifdef HAVE_SSE42_KERNEL
+    if (!scalar && __builtin_cpu_supports("sse4.2")) {
+        crc_fn = crc_sse42;
+        crc_name = "sse4.2";
+    }
+#endif
+#ifdef HAVE_ARMV8_KERNEL
+    if (!scalar) {
+        crc_fn = crc_armv8;
+        crc_name = "armv8";
+    }
+#endif
+    (void)scalar;
+    if (crc_fn == crc_scalar) {
+        build_table();
+    }
+}
+
+uint32_t crc32c_update(uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&crc_once, pick_crc);
+    return ~crc_fn(~crc, buf, len);
+}
+
+const char *crc32c_kernel(void)
+{
+    pthread_once(&crc_once, pick_crc);
+    return crc_name;
+}
@@ -0,0 +1,738 @@
+/*
+ * decompress.c - Streaming gzip and zstd decompression for command input
+ *
+ * Input is cut into frames, each decompressed by one thread into a ring
+ * of its own (ring_buffer.h), and the reader drains the rings in frame
+ * order. A mapped file of independent frames has one frame per zstd
+ * frame or BGZF block and up to DECODER_MAX_THREADS threads; frame i
+ * goes in slot i % nslots, so a thread that gets ahead waits for the
+ * reader to be done with the frame nslots before its own. Anything else
+ * is one frame, the whole input, decompressed as it is read.
+ *
+ * A frame's ring holds at most DECODER_RING bytes (less when the frame
+ * says how much it decompresses to), which bounds the memory a file of
+ * large frames takes whatever its size.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* pread(), posix_madvise(), ELIBACC */
+#endif
+
+#include "decompress.h"
+#include "io_stats.h"
+#include "ring_buffer.h"
+#include "work_pool.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#ifndef ELIBACC
+#define ELIBACC ENOSYS
+#endif
+
+#define DECODER_MAX_THREADS 8
+#define DECODER_RING (4 * 1024 * 1024)
+#define DECODER_MIN_RING (64 * 1024)
+#define DECODER_BLOCK (128 * 1024)   /* Compressed read, decompressed write */
+
+/* ===== Libraries ===== */
+
+#ifdef __APPLE__
+#define ZLIB_SONAME "libz.1.dylib"
+#define ZSTD_SONAME "libzstd.1.dylib"
+#else
+#define ZLIB_SONAME "libz.so.1"
+#define ZSTD_SONAME "libzstd.so.1"
+#endif
+
+/* zlib.h gives the types; the functions come from dlsym() */
+static struct {
+    int (*inflate_init2)(z_streamp strm, int window_bits, const char *version, int size);
+    int (*inflate)(z_streamp strm, int flush);
+    int (*inflate_reset)(z_streamp strm);
+    int (*inflate_end)(z_streamp strm);
+} zlib;
+
+/* What is used of zstd.h, declared here so the header is not needed */
+typedef struct {
+    const void *src;
+    size_t size;
+    size_t pos;
+} zstd_in_t;
+
+typedef struct {
+    void *dst;
+    size_t size;
+    size_t pos;
+} zstd_out_t;
+
+static struct {
+    void *(*create)(void);
+    size_t (*free)(void *ds);
+    size_t (*init)(void *ds);
+    size_t (*decompress)(void *ds, zstd_out_t *out, zstd_in_t *in);
+    unsigned (*is_error)(size_t code);
+    size_t (*frame_size)(const void *src, size_t len);
+    unsigned long long (*content_size)(const void *src, size_t len);
+} zstd;
+
+static pthread_once_t zlib_once = PTHREAD_ONCE_INIT;
+static pthread_once_t zstd_once = PTHREAD_ONCE_INIT;
+static int zlib_loaded;
+static int zstd_loaded;
+
+/* Set the function pointer at fn (size bytes) to lib's symbol name */
+static int lookup(void *lib, const char *name, void *fn, size_t size)
+{
+    void *sym = dlsym(lib, name);
+
+    if (!sym) {
+        return 0;
+    }
+    memcpy(fn, &sym, size);
+    return 1;
+}
+
+#define LOOKUP(lib, fn, name) lookup((lib), (name), &(fn), sizeof(fn))
+
+static void load_zlib(void)
+{
+    void *lib = dlopen(ZLIB_SONAME, RTLD_NOW | RTLD_LOCAL);
+
+    zlib_loaded = lib &&
+                  LOOKUP(lib, zlib.inflate_init2, "inflateInit2_") &&
+                  LOOKUP(lib, zlib.inflate, "inflate") &&
+                  LOOKUP(lib, zlib.inflate_reset, "inflateReset") &&
+                  LOOKUP(lib, zlib.inflate_end, "inflateEnd");
+}
+
+static void load_zstd(void)
+{
+    void *lib = dlopen(ZSTD_SONAME, RTLD_NOW | RTLD_LOCAL);
+
+    zstd_loaded = lib &&
+                  LOOKUP(lib, zstd.create, "ZSTD_createDStream") &&
+                  LOOKUP(lib, zstd.free, "ZSTD_freeDStream") &&
+                  LOOKUP(lib, zstd.init, "ZSTD_initDStream") &&
+                  LOOKUP(lib, zstd.decompress, "ZSTD_decompressStream") &&
+                  LOOKUP(lib, zstd.is_error, "ZSTD_isError") &&
+                  LOOKUP(lib, zstd.frame_size, "ZSTD_findFrameCompressedSize") &&
+                  LOOKUP(lib, zstd.content_size, "ZSTD_getFrameContentSize");
+}
+
+/* Load the library for format, once; nonzero if it is there */
+static int library_ready(int format)
+{
+    if (format == DECOMPRESS_GZIP) {
+        pthread_once(&zlib_once, load_zlib);
+        return zlib_loaded;
+    }
+    pthread_once(&zstd_once, load_zstd);
+    return zstd_loaded;
+}
+
+/* ===== Formats ===== */
+
+int decompress_format(const void *head, size_t len)
+{
+    const unsigned char *p = head;
+
+    if (len >= 3 && p[0] == 0x1f && p[1] == 0x8b && p[2] == 8) {
+        return DECOMPRESS_GZIP;
+    }
+    if (len >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd) {
+        return DECOMPRESS_ZSTD;
+    }
+    return DECOMPRESS_NONE;
+}
+
+int decompress_fd_format(int fd)
+{
+    unsigned char head[DECOMPRESS_MAGIC];
+    struct stat st;
+    off_t pos;
+    ssize_t n;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return -1;
+    }
+    pos = lseek(fd, 0, SEEK_CUR);
+    if (pos < 0) {
+        return -1;
+    }
+    n = pread(fd, head, sizeof(head), pos);
+    return n > 0 ? decompress_format(head, (size_t)n) : DECOMPRESS_NONE;
+}
+
+/*
+ * Length of the BGZF block (a gzip member whose extra field gives its
+ * size, as bgzip writes) at p, or 0 if it is not one
+ */
+static size_t bgzf_block(const unsigned char *p, size_t left)
+{
+    size_t xlen;
+    size_t i = 12;
+
+    if (left < 18 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || !(p[3] & 4)) {
+        return 0;
+    }
+    xlen = (size_t)p[10] | (size_t)p[11] << 8;
+    if (12 + xlen > left) {
+        return 0;
+    }
+    while (i + 4 <= 12 + xlen) {
+        size_t slen = (size_t)p[i + 2] | (size_t)p[i + 3] << 8;
+
+        if (p[i] == 'B' && p[i + 1] == 'C' && slen == 2 && i + 6 <= 12 + xlen) {
+            size_t bsize = ((size_t)p[i + 4] | (size_t)p[i + 5] << 8) + 1;
+
+            return bsize <= left ? bsize : 0;
+        }
+        i += 4 + slen;
+    }
+    return 0;
+}
+
+/* ===== Decoder ===== */
+
+typedef struct {
+    ring_buffer_t *ring;
+    int ready;              /* A thread has taken the frame (ring may be NULL) */
+    int done;               /* ... and is finished with ring */
+    int err;                /* errno the frame failed with, 0 if none */
+} decoder_slot_t;
+
+struct decoder {
+    int format;
+
+    /* Streamed: the bytes read ahead, then fd (or fp) */
+    unsigned char *head;
+    size_t head_len;
+    size_t head_pos;
+    int fd;
+    FILE *fp;
+
+    /* Mapped: frame i is data[off[i]..off[i + 1]) */
+    void *map;
+    size_t map_size;
+    const unsigned char *data;
+    size_t *off;
+    size_t whole[2];        /* off for a single frame */
+    size_t nframes;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    decoder_slot_t slots[DECODER_MAX_THREADS + 1];
+    int nslots;
+    size_t next;            /* Next frame for a thread to take */
+    size_t reading;         /* Frame the reader is on */
+    int stop;
+    pthread_t threads[DECODER_MAX_THREADS];
+    int nthreads;
+};
+
+/* One frame's input, as the decompressors take it */
+typedef struct {
+    decoder_t *d;
+    const unsigned char *next;  /* Mapped input not handed out yet */
+    size_t left;
+    unsigned char *buf;         /* Streamed input is read into this */
+} decoder_input_t;
+
+/*
+ * Next block of input: from the mapping (in pieces zlib's counts can
+ * hold), else the bytes read ahead, then a read of the source
+ * Returns: its length (0 at end of input), or -1 on a read error
+ */
+static ssize_t input_next(decoder_input_t *in, const unsigned char **p)
+{
+    decoder_t *d = in->d;
+    ssize_t n;
+
+    if (d->map) {
+        n = (ssize_t)(in->left < (1u << 30) ? in->left : (1u << 30));
+        *p = in->next;
+        in->next += n;
+        in->left -= (size_t)n;
+        return n;
+    }
+    if (d->head_pos < d->head_len) {
+        *p = d->head + d->head_pos;
+        n = (ssize_t)(d->head_len - d->head_pos);
+        d->head_pos = d->head_len;
+        return n;
+    }
+
+    *p = in->buf;
+    if (d->fd >= 0) {
+        do {
+            n = read(d->fd, in->buf, DECODER_BLOCK);
+            IO_STATS_READ(n);
+        } while (n < 0 && errno == EINTR);
+    } else {
+        n = (ssize_t)fread(in->buf, 1, DECODER_BLOCK, d->fp);
+        if (n == 0 && ferror(d->fp)) {
+            n = -1;
+        }
+    }
+    return n;
+}
+
+/*
+ * Decompress gzip members (one may follow another) until the input
+ * ends; anything after a member that is not another is ignored, as
+ * gzip does with a warning
+ * Returns: 0, or an errno value
+ */
+static int gunzip(decoder_input_t *in, ring_buffer_t *out, char *obuf)
+{
+    z_stream zs;
+    const unsigned char *p;
+    int r = Z_OK;
+    int full = 0;           /* The last call filled obuf: more may be pending */
+    int err = 0;
+
+    memset(&zs, 0, sizeof(zs));
+    if (zlib.inflate_init2(&zs, 15 + 16, ZLIB_VERSION, (int)sizeof(z_stream)) != Z_OK) {
+        return ENOMEM;
+    }
+
+    for (;;) {
+        if (zs.avail_in == 0 && !full) {
+            ssize_t n = input_next(in, &p);
+
+            if (n < 0) {
+                err = errno;
+                break;
+            }
+            if (n == 0) {
+                if (r != Z_STREAM_END) {
+                    err = EBADMSG;  /* Truncated */
+                }
+                break;
+            }
+            zs.next_in = (Bytef *)p;
+            zs.avail_in = (uInt)n;
+        }
+        if (r == Z_STREAM_END) {
+            if (zs.next_in[0] != 0x1f) {
+                break;
+            }
+            zlib.inflate_reset(&zs);
+        }
+
+        zs.next_out = (Bytef *)obuf;
+        zs.avail_out = DECODER_BLOCK;
+        r = zlib.inflate(&zs, Z_NO_FLUSH);
+        if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) {
+            err = r == Z_MEM_ERROR ? ENOMEM : EBADMSG;
+            break;
+        }
+        full = zs.avail_out == 0 && r != Z_STREAM_END;
+        if (!full && r == Z_BUF_ERROR && zs.avail_in > 0) {
+            err = EBADMSG;
+            break;
+        }
+        if (zs.avail_out < DECODER_BLOCK &&
+            ring_buffer_write(out, obuf, DECODER_BLOCK - zs.avail_out) < 0) {
+            err = EPIPE;
+            break;
+        }
+    }
+
+    zlib.inflate_end(&zs);
+    return err;
+}
+
+/*
+ * Decompress zstd frames until the input ends
+ * Returns: 0, or an errno value
+ */
+static int unzstd(decoder_input_t *in, ring_buffer_t *out, char *obuf)
+{
+    void *ds = zstd.create();
+    zstd_in_t zin = { NULL, 0, 0 };
+    size_t r = 0;           /* 0 at the end of a frame */
+    int full = 0;
+    int err = 0;
+
+    if (!ds) {
+        return ENOMEM;
+    }
+    zstd.init(ds);
+
+    for (;;) {
+        zstd_out_t zout = { obuf, DECODER_BLOCK, 0 };
+
+        if (zin.pos == zin.size && !full) {
+            const unsigned char *p;
+            ssize_t n = input_next(in, &p);
+
+            if (n < 0) {
+                err = errno;
+                break;
+            }
+            if (n == 0) {
+                if (r != 0) {
+                    err = EBADMSG;  /* Truncated */
+                }
+                break;
+            }
+            zin.src = p;
+            zin.size = (size_t)n;
+            zin.pos = 0;
+        }
+
+        r = zstd.decompress(ds, &zout, &zin);
+        if (zstd.is_error(r)) {
+            err = EBADMSG;
+            break;
+        }
+        full = zout.pos == zout.size;
+        if (zout.pos > 0 && ring_buffer_write(out, obuf, zout.pos) < 0) {
+            err = EPIPE;
+            break;
+        }
+    }
+
+    zstd.free(ds);
+    return err;
+}
+
+/*
+ * Ring size for frame i: what it says it decompresses to (a zstd
+ * frame's content size, a gzip member's ISIZE), within limits
+ */
+static size_t frame_ring_size(decoder_t *d, size_t i)
+{
+    size_t size = DECODER_RING;
+
+    if (d->map && d->nframes > 1) {
+        const unsigned char *p = d->data + d->off[i];
+        size_t len = d->off[i + 1] - d->off[i];
+        unsigned long long known = DECODER_RING;
+
+        if (d->format == DECOMPRESS_ZSTD) {
+            known = zstd.content_size(p, len);   /* Unknown and errors are huge */
+        } else if (len >= 4) {
+            p += len - 4;
+            known = (unsigned long long)p[0] | (unsigned long long)p[1] << 8 |
+                    (unsigned long long)p[2] << 16 | (unsigned long long)p[3] << 24;
+        }
+        if (known < size) {
+            size = (size_t)known;
+        }
+    }
+    return size < DECODER_MIN_RING ? DECODER_MIN_RING : size;
+}
+
+static void *decoder_main(void *arg)
+{
+    decoder_t *d = arg;
+    char *obuf = malloc(DECODER_BLOCK);
+    decoder_input_t in;
+
+    in.d = d;
+    in.buf = d->map ? NULL : malloc(DECODER_BLOCK);
+
+    pthread_mutex_lock(&d->lock);
+    while (!d->stop && d->next < d->nframes) {
+        size_t i = d->next++;
+        decoder_slot_t *s = &d->slots[i % (size_t)d->nslots];
+        ring_buffer_t *ring = NULL;
+        int err = ENOMEM;
+
+        /* The slot is free once the reader is past frame i - nslots */
+        while (!d->stop && i >= d->reading + (size_t)d->nslots) {
+            pthread_cond_wait(&d->cond, &d->lock);
+        }
+        if (d->stop) {
+            break;
+        }
+        pthread_mutex_unlock(&d->lock);
+
+        if (obuf && (in.buf || d->map)) {
+            ring = ring_buffer_create(frame_ring_size(d, i));
+        }
+
+        pthread_mutex_lock(&d->lock);
+        if (d->stop) {
+            ring_buffer_destroy(ring);   /* decoder_close() did not see it */
+            break;
+        }
+        s->ring = ring;
+        s->ready = 1;
+        pthread_cond_broadcast(&d->cond);
+        pthread_mutex_unlock(&d->lock);
+
+        if (ring) {
+            if (d->map) {
+                in.next = d->data + d->off[i];
+                in.left = d->off[i + 1] - d->off[i];
+            }
+            err = d->format == DECOMPRESS_GZIP ? gunzip(&in, ring, obuf)
+                                               : unzstd(&in, ring, obuf);
+        }
+
+        pthread_mutex_lock(&d->lock);
+        s->err = err == EPIPE ? 0 : err;   /* EPIPE: the reader stopped */
+        pthread_mutex_unlock(&d->lock);
+        if (ring) {
+            ring_buffer_close_write(ring);
+        }
+        pthread_mutex_lock(&d->lock);
+        s->done = 1;
+        pthread_cond_broadcast(&d->cond);
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    free(in.buf);
+    free(obuf);
+    return NULL;
+}
+
+/*
+ * Map a regular file source and split what is left of it (from before
+ * the consumed bytes read ahead) into independent frames, if it has them
+ * Returns: nonzero if mapped
+ */
+static int decoder_map(decoder_t *d, size_t consumed)
+{
+    struct stat st;
+    off_t pos;
+    size_t start, len, at, cap = 0;
+
+    if (d->fd < 0 || fstat(d->fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        (uintmax_t)st.st_size > SIZE_MAX) {
+        return 0;
+    }
+    pos = lseek(d->fd, 0, SEEK_CUR);
+    if (pos < (off_t)consumed || pos > st.st_size) {
+        return 0;
+    }
+    start = (size_t)pos - consumed;
+    d->map_size = (size_t)st.st_size;
+    d->map = mmap(NULL, d->map_size, PROT_READ, MAP_PRIVATE, d->fd, 0);
+    if (d->map == MAP_FAILED) {
+        d->map = NULL;
+        return 0;
+    }
+    IO_STATS_READ((ssize_t)(d->map_size - start));   /* Mapped: one read of it all */
+    posix_madvise(d->map, d->map_size, POSIX_MADV_SEQUENTIAL);
+    d->data = (const unsigned char *)d->map + start;
+    len = d->map_size - start;
+
+    /* Frame boundaries, or one frame if any of it is not made of them */
+    for (at = 0; at < len; ) {
+        size_t n;
+
+        if (d->format == DECOMPRESS_ZSTD) {
+            n = zstd.frame_size(d->data + at, len - at);
+            if (zstd.is_error(n)) {
+                n = 0;
+            }
+        } else {
+            n = bgzf_block(d->data + at, len - at);
+        }
+        if (n == 0) {
+            break;
+        }
+        if (d->nframes + 2 > cap) {
+            size_t *bigger = realloc(d->off, (cap ? cap * 2 : 256) * sizeof(size_t));
+
+            if (!bigger) {
+                break;
+            }
+            d->off = bigger;
+            cap = cap ? cap * 2 : 256;
+        }
+        d->off[d->nframes++] = at;
+        at += n;
+    }
+    if (at == len && d->nframes > 1) {
+        d->off[d->nframes] = len;
+    } else {
+        free(d->off);
+        d->off = d->whole;
+        d->whole[0] = 0;
+        d->whole[1] = len;
+        d->nframes = 1;
+    }
+    return 1;
+}
+
+decoder_t *decoder_open(int format, int fd, FILE *fp, const void *head, size_t len)
+{
+    decoder_t *d;
+    int want;
+
+    if (format != DECOMPRESS_GZIP && format != DECOMPRESS_ZSTD) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!library_ready(format)) {
+        errno = ELIBACC;
+        return NULL;
+    }
+
+    d = calloc(1, sizeof(*d));
+    if (!d) {
+        return NULL;
+    }
+    d->format = format;
+    d->fd = fd;
+    d->fp = fp;
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->cond, NULL);
+
+    if (!decoder_map(d, len)) {
+        d->head = malloc(len ? len : 1);
+        if (!d->head) {
+            decoder_close(d);
+            return NULL;
+        }
+        memcpy(d->head, head, len);
+        d->head_len = len;
+        d->off = d->whole;
+        d->nframes = 1;
+    }
+
+    want = work_pool_default_workers();
+    if (want > DECODER_MAX_THREADS) {
+        want = DECODER_MAX_THREADS;
+    }
+    if ((size_t)want > d->nframes) {
+        want = (int)d->nframes;
+    }
+    d->nslots = want + 1;
+    for (int i = 0; i < want; i++) {
+        if (pthread_create(&d->threads[d->nthreads], NULL, decoder_main, d) != 0) {
+            break;
+        }
+        d->nthreads++;
+    }
+    if (d->nthreads == 0) {
+        decoder_close(d);
+        errno = EAGAIN;
+        return NULL;
+    }
+    return d;
+}
+
+ssize_t decoder_read(decoder_t *d, char *buf, size_t len)
+{
+    while (d->reading < d->nframes) {
+        decoder_slot_t *s = &d->slots[d->reading % (size_t)d->nslots];
+        ssize_t n;
+        int err;
+
+        pthread_mutex_lock(&d->lock);
+        while (!s->ready) {
+            pthread_cond_wait(&d->cond, &d->lock);
+        }
+        pthread_mutex_unlock(&d->lock);
+
+        if (s->ring) {
+            n = ring_buffer_read(s->ring, buf, len);
+            if (n > 0) {
+                return n;
+            }
+        }
+
+        /* End of the frame: wait until its thread lets go of the ring */
+        pthread_mutex_lock(&d->lock);
+        while (!s->done) {
+            pthread_cond_wait(&d->cond, &d->lock);
+        }
+        err = s->err;
+        pthread_mutex_unlock(&d->lock);
+        if (err) {
+            errno = err;
+            return -1;
+        }
+
+        ring_buffer_destroy(s->ring);
+        pthread_mutex_lock(&d->lock);
+        memset(s, 0, sizeof(*s));
+        d->reading++;
+        pthread_cond_broadcast(&d->cond);
+        pthread_mutex_unlock(&d->lock);
+    }
+    return 0;
+}
+
+static ssize_t decoder_source_read(void *d, char *buf, size_t len)
+{
+    return decoder_read(d, buf, len);
+}
+
+static void decoder_source_close(void *d)
+{
+    decoder_close(d);
+}
+
+int line_reader_decompress(line_reader_t *lr)
+{
+    const char *head;
+    ssize_t len = line_reader_peek(lr, DECOMPRESS_MAGIC, &head);
+    decoder_t *d;
+    int format;
+
+    if (len < 0) {
+        return -1;
+    }
+    format = decompress_format(head, (size_t)len);
+    if (format == DECOMPRESS_NONE) {
+        return 0;
+    }
+    d = decoder_open(format, lr->fd, lr->fp, head, (size_t)len);
+    if (!d) {
+        return -1;
+    }
+    line_reader_set_source(lr, d, decoder_source_read, decoder_source_close);
+    return 1;
+}
+
+void decoder_close(decoder_t *d)
+{
+    if (!d) {
+        return;
+    }
+
+    pthread_mutex_lock(&d->lock);
+    d->stop = 1;
+    for (int i = 0; i < d->nslots; i++) {
+        if (d->slots[i].ring) {
+            ring_buffer_close_read(d->slots[i].ring);
+        }
+    }
+    pthread_cond_broadcast(&d->cond);
+    pthread_mutex_unlock(&d->lock);
+
+    for (int i = 0; i < d->nthreads; i++) {
+        pthread_join(d->threads[i], NULL);
+    }
+    for (int i = 0; i < d->nslots; i++) {
+        ring_buffer_destroy(d->slots[i].ring);
+    }
+
+    if (d->map) {
+        munmap(d->map, d->map_size);
+    }
+    if (d->off != d->whole) {
+        free(d->off);
+    }
+    free(d->head);
+    pthread_cond_destroy(&d->cond);
+    pthread_mutex_destroy(&d->lock);
+    free(d);
+}
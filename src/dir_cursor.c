@@ -0,0 +1,191 @@
+/*
+ * dir_cursor.c - Open directories kept from one path to the next
+ *
+ * The cursor holds one descriptor per component of the directory it
+ * last opened. A new directory is split into components the same way,
+ * and the components whose prefix is byte for byte the one before keep
+ * their descriptors; the rest are closed, and the new ones opened (or
+ * made) one at a time relative to the one above. Directories are
+ * opened O_PATH where that exists: nothing is read from them, and it
+ * works without read permission.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* O_PATH, openat() and mkdirat() */
+#endif
+
+#include "dir_cursor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef O_PATH
+#define DC_OPEN_FLAGS (O_PATH | O_DIRECTORY | O_CLOEXEC)
+#else
+#define DC_OPEN_FLAGS (O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+#endif
+
+void dir_cursor_init(dir_cursor_t *c)
+{
+    memset(c, 0, sizeof(*c));
+}
+
+/*
+ * Next component of dir[0..len) from *pos: a leading "/" is one of its
+ * own, then runs between slashes
+ * Returns: 1 with [*start, *end) set, or 0 at the end
+ */
+static int dc_next(const char *dir, size_t len, size_t *pos, size_t *start, size_t *end)
+{
+    size_t p = *pos;
+
+    if (p == 0 && len > 0 && dir[0] == '/') {
+        *start = 0;
+        *end = 1;
+        *pos = 1;
+        return 1;
+    }
+    while (p < len && dir[p] == '/') {
+        p++;
+    }
+    if (p == len) {
+        *pos = p;
+        return 0;
+    }
+    *start = p;
+    while (p < len && dir[p] != '/') {
+        p++;
+    }
+    *end = p;
+    *pos = p;
+    return 1;
+}
+
+/* Forget the components from depth on */
+static void dc_truncate(dir_cursor_t *c, size_t depth)
+{
+    while (c->depth > depth) {
+        close(c->fds[--c->depth]);
+    }
+}
+
+static int dc_push(dir_cursor_t *c, int fd, size_t end)
+{
+    if (c->depth == c->cap) {
+        size_t cap = c->cap ? c->cap * 2 : 16;
+        int *fds = realloc(c->fds, cap * sizeof(int));
+        size_t *ends;
+
+        if (!fds) {
+            return -1;
+        }
+        c->fds = fds;
+        ends = realloc(c->ends, cap * sizeof(size_t));
+        if (!ends) {
+            return -1;
+        }
+        c->ends = ends;
+        c->cap = cap;
+    }
+    c->fds[c->depth] = fd;
+    c->ends[c->depth] = end;
+    c->depth++;
+    return 0;
+}
+
+int dir_cursor_open(dir_cursor_t *c, const char *dir, size_t len, int create, mode_t mode)
+{
+    size_t pos = 0;
+    size_t start = 0;
+    size_t end = 0;
+    size_t keep = 0;
+    int more;
+    char *path;
+
+    /* The components this directory shares with the last one */
+    while ((more = dc_next(dir, len, &pos, &start, &end)) != 0 && keep < c->depth) {
+        if (end != c->ends[keep] || end > c->len || memcmp(dir, c->path, end) != 0) {
+            break;
+        }
+        keep++;
+    }
+    dc_truncate(c, keep);
+
+    path = realloc(c->path, len + 1);
+    if (!path) {
+        return -1;
+    }
+    memcpy(path, dir, len);
+    path[len] = '\0';
+    c->path = path;
+    c->len = len;
+
+    /* The rest, each relative to the one before */
+    while (more) {
+        int parent = c->depth > 0 ? c->fds[c->depth - 1] : AT_FDCWD;
+        char save = path[end];
+        int fd;
+
+        path[end] = '\0';
+        fd = openat(parent, path + start, DC_OPEN_FLAGS);
+        if (fd < 0 && errno == ENOENT && create) {
+            if (mkdirat(parent, path + start, mode) == 0 || errno == EEXIST) {
+                fd = openat(parent, path + start, DC_OPEN_FLAGS);
+            }
+        }
+        path[end] = save;
+        if (fd < 0) {
+            return -1;
+        }
+        if (dc_push(c, fd, end) != 0) {
+            close(fd);
+            return -1;
+        }
+        more = dc_next(dir, len, &pos, &start, &end);
+    }
+
+    return c->depth > 0 ? c->fds[c->depth - 1] : AT_FDCWD;
+}
+
+void dir_cursor_free(dir_cursor_t *c)
+{
+    dc_truncate(c, 0);
+    free(c->fds);
+    free(c->ends);
+    free(c->path);
+    dir_cursor_init(c);
+}
+
+void dir_cursor_split(const char *path, size_t *dir_len, const char **name, size_t *name_len)
+{
+    size_t end = strlen(path);
+    size_t slash;
+
+    while (end > 1 && path[end - 1] == '/') {
+        end--;
+    }
+    slash = end;
+    while (slash > 0 && path[slash - 1] != '/') {
+        slash--;
+    }
+
+    if (slash == 0 || end == 1) {
+        /* "name" or "/" */
+        *dir_len = 0;
+        *name = path;
+        *name_len = end;
+        return;
+    }
+
+    *name = path + slash;
+    *name_len = end - slash;
+    slash--;
+    while (slash > 1 && path[slash - 1] == '/') {
+        slash--;
+    }
+    *dir_len = slash == 0 ? 1 : slash;
+}
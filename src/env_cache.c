@@ -0,0 +1,216 @@
+/*
+ * env_cache.c - Exported variables and the environment given to children
+ *
+ * Without this every launch handed children the process environ, and
+ * a change had to go through setenv() with no record of which shell
+ * variables were exported. Now:
+ *
+ *   - exported names and values live in a var_table_t, seeded from
+ *     environ the first time they are needed
+ *   - the envp array is built from that table in one allocation
+ *     (pointers followed by the "NAME=VALUE" strings) and reused until
+ *     an exported variable changes; a change builds a new array rather
+ *     than editing the old one
+ *   - per-command prefixes (FOO=bar cmd) copy just the pointer array
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* setenv() and strndup() */
+#endif
+
+#include "env_cache.h"
+#include "var_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern char **environ;
+
+static var_table_t *exported = NULL;
+static char **envp_cache = NULL;   /* NULL until built or after a change */
+
+/* Sizes gathered by the first pass over the exported variables */
+typedef struct {
+    size_t count;
+    size_t bytes;
+} env_size_t;
+
+/* Cursor for the second pass */
+typedef struct {
+    char **slot;
+    char *text;
+} env_fill_t;
+
+/*
+ * Load the inherited environment into the exported table
+ */
+static int env_init(void)
+{
+    if (exported) {
+        return 0;
+    }
+
+    exported = var_table_create(0);
+    if (!exported) {
+        return -1;
+    }
+
+    for (char **ep = environ; ep && *ep; ep++) {
+        const char *equals = strchr(*ep, '=');
+        char *name;
+
+        if (!equals || equals == *ep) {
+            continue;
+        }
+
+        name = strndup(*ep, equals - *ep);
+        if (!name) {
+            perror("strndup");
+            continue;
+        }
+        var_table_set(exported, name, equals + 1);
+        free(name);
+    }
+
+    return 0;
+}
+
+int env_export(const char *name, const char *value)
+{
+    if (!name || !value || env_init() < 0) {
+        return -1;
+    }
+
+    if (var_table_set(exported, name, value) < 0) {
+        return -1;
+    }
+
+    /* In-shell readers (getenv, the env command) see the same value */
+    if (setenv(name, value, 1) != 0) {
+        perror("setenv");
+        return -1;
+    }
+
+    /* Children launched from now on need a new array */
+    free(envp_cache);
+    envp_cache = NULL;
+    return 0;
+}
+
+int env_is_exported(const char *name)
+{
+    if (!name || env_init() < 0) {
+        return 0;
+    }
+    return var_table_get(exported, name) != NULL;
+}
+
+static void size_entry(const char *name, const char *value, void *userdata)
+{
+    env_size_t *size = userdata;
+
+    size->count++;
+    size->bytes += strlen(name) + 1 + strlen(value) + 1;
+}
+
+static void fill_entry(const char *name, const char *value, void *userdata)
+{
+    env_fill_t *fill = userdata;
+    size_t name_len = strlen(name);
+    size_t value_len = strlen(value);
+
+    *fill->slot++ = fill->text;
+    memcpy(fill->text, name, name_len);
+    fill->text[name_len] = '=';
+    memcpy(fill->text + name_len + 1, value, value_len + 1);
+    fill->text += name_len + 1 + value_len + 1;
+}
+
+char **env_vector(void)
+{
+    env_size_t size = {0, 0};
+    env_fill_t fill;
+
+    if (envp_cache) {
+        return envp_cache;
+    }
+
+    if (env_init() < 0) {
+        return environ;
+    }
+
+    var_table_foreach(exported, size_entry, &size);
+
+    envp_cache = malloc((size.count + 1) * sizeof(char *) + size.bytes);
+    if (!envp_cache) {
+        perror("malloc");
+        return environ;
+    }
+
+    fill.slot = envp_cache;
+    fill.text = (char *)(envp_cache + size.count + 1);
+    var_table_foreach(exported, fill_entry, &fill);
+    *fill.slot = NULL;
+
+    return envp_cache;
+}
+
+/* Does entry ("NAME=VALUE") set the same name as assign? */
+static int same_name(const char *entry, const char *assign)
+{
+    size_t len = strcspn(assign, "=");
+    return strncmp(entry, assign, len) == 0 && entry[len] == '=';
+}
+
+char **env_vector_with(char *const *assigns, int count)
+{
+    char **base = env_vector();
+    char **envp;
+    char *text;
+    size_t base_count = 0;
+    size_t bytes = 0;
+    size_t n = 0;
+
+    for (char **ep = base; *ep; ep++) {
+        base_count++;
+    }
+    for (int i = 0; i < count; i++) {
+        bytes += strlen(assigns[i]) + 1;
+    }
+
+    envp = malloc((base_count + count + 1) * sizeof(char *) + bytes);
+    if (!envp) {
+        perror("malloc");
+        return NULL;
+    }
+    text = (char *)(envp + base_count + count + 1);
+
+    /* Inherited entries not overridden by this command */
+    for (char **ep = base; *ep; ep++) {
+        int overridden = 0;
+        for (int i = 0; i < count && !overridden; i++) {
+            overridden = same_name(*ep, assigns[i]);
+        }
+        if (!overridden) {
+            envp[n++] = *ep;
+        }
+    }
+
+    /* The prefixes; for a repeated name the last one wins */
+    for (int i = 0; i < count; i++) {
+        int repeated = 0;
+        for (int j = i + 1; j < count && !repeated; j++) {
+            repeated = same_name(assigns[j], assigns[i]);
+        }
+        if (!repeated) {
+            size_t len = strlen(assigns[i]) + 1;
+            memcpy(text, assigns[i], len);
+            envp[n++] = text;
+            text += len;
+        }
+    }
+    envp[n] = NULL;
+
+    return envp;
+}
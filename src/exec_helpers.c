@@ -2,13 +2,329 @@
  * exec_helpers.c - Process execution helpers for fork/exec
  *
  * This file implements proper process isolation for command execution.
- * Commands run in separate child processes via fork/exec.
+ * External commands run in separate child processes via fork/exec.
+ * Registry commands run directly in the shell process when it is safe
+ * to do so, which saves a fork+exec per command.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* wait4() */
+#endif
+
 #include "picobox.h"
+#include "cmd_spec.h"
+#include "exec_helpers.h"
 #include "redirect_helpers.h"
+#include "path_cache.h"
+#include "env_cache.h"
+#include "zygote.h"
+#include "time_stats.h"
+#include "trace.h"
+#include <spawn.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 
+extern char **environ;
+
+/* Selected launch backend (-1 = not yet read from PICOBOX_SPAWN) */
+static int spawn_backend = -1;
+
+/*
+ * Get the backend used to launch external commands
+ *
+ * Defaults to SPAWN_BACKEND_SPAWN; PICOBOX_SPAWN=fork selects the
+ * classic fork+execvp path, PICOBOX_SPAWN=zygote the pre-forked helper.
+ */
+int get_spawn_backend(void)
+{
+    if (spawn_backend < 0) {
+        const char *env = getenv("PICOBOX_SPAWN");
+        if (env && strcmp(env, "fork") == 0) {
+            spawn_backend = SPAWN_BACKEND_FORK;
+        } else if (env && strcmp(env, "zygote") == 0) {
+            spawn_backend = SPAWN_BACKEND_ZYGOTE;
+        } else {
+            spawn_backend = SPAWN_BACKEND_SPAWN;
+        }
+    }
+    return spawn_backend;
+}
+
+/*
+ * Override the launch backend (used by the spawn benchmark)
+ */
+void set_spawn_backend(int backend)
+{
+    spawn_backend = backend;
+}
+
+/*
+ * Add a close action unless that fd is already being closed
+ */
+static int add_close_once(posix_spawn_file_actions_t *fa, int fd, int *closed, int *nclosed)
+{
+    if (fd <= STDERR_FILENO) {
+        return 0;
+    }
+
+    for (int i = 0; i < *nclosed; i++) {
+        if (closed[i] == fd) {
+            return 0;
+        }
+    }
+
+    closed[(*nclosed)++] = fd;
+    return posix_spawn_file_actions_addclose(fa, fd);
+}
+
+/*
+ * Start path through the zygote, or with posix_spawn() if the backend
+ * is not SPAWN_BACKEND_ZYGOTE or the zygote is not running
+ * Returns: 0 with *pid set, or an errno value
+ */
+static int launch_path(pid_t *pid, const char *path, const posix_spawn_file_actions_t *fa,
+                       char **argv, char **envp, int stdin_fd, int stdout_fd)
+{
+    if (get_spawn_backend() == SPAWN_BACKEND_ZYGOTE) {
+        pid_t child = zygote_spawn(path, argv, envp, stdin_fd, stdout_fd);
+
+        if (child >= 0) {
+            *pid = child;
+            return 0;
+        }
+        if (child == -2) {
+            return errno;
+        }
+    }
+
+    return posix_spawn(pid, path, fa, NULL, argv, envp);
+}
+
+/*
+ * Launch an external command with posix_spawn() (no wait)
+ *
+ * The dup2/close work a forked child would do is expressed as spawn
+ * file actions, so the kernel never has to copy the shell's page
+ * tables (glibc implements this with CLONE_VFORK; macOS natively).
+ * With SPAWN_BACKEND_ZYGOTE the zygote starts the program instead,
+ * falling back to posix_spawn() if it is not available.
+ * The program is resolved through the PATH cache.
+ *
+ * envp: environment for the child, NULL for env_vector()
+ * stdin_fd/stdout_fd: -1 to inherit, otherwise fd to install as 0/1
+ * close_fds: extra fds the child must not inherit (e.g. pipe ends)
+ *
+ * Returns: Child pid, or -1 on error (message already printed)
+ */
+pid_t spawn_external(char **argv, char **envp, int stdin_fd, int stdout_fd,
+                     const int *close_fds, int nclose)
+{
+    posix_spawn_file_actions_t fa;
+    int closed[8];
+    int nclosed = 0;
+    pid_t pid;
+    int err = 0;
+
+    if (!argv || !argv[0]) {
+        fprintf(stderr, "exec: null command\n");
+        return -1;
+    }
+
+    if (nclose > 6) {
+        fprintf(stderr, "spawn: too many fds to close\n");
+        return -1;
+    }
+
+    if (posix_spawn_file_actions_init(&fa) != 0) {
+        perror("posix_spawn_file_actions_init");
+        return -1;
+    }
+
+    if (stdin_fd != -1 && stdin_fd != STDIN_FILENO) {
+        err = err ? err : posix_spawn_file_actions_adddup2(&fa, stdin_fd, STDIN_FILENO);
+    }
+    if (stdout_fd != -1 && stdout_fd != STDOUT_FILENO) {
+        err = err ? err : posix_spawn_file_actions_adddup2(&fa, stdout_fd, STDOUT_FILENO);
+    }
+
+    /* The originals are not needed once duplicated onto 0/1 */
+    err = err ? err : add_close_once(&fa, stdin_fd, closed, &nclosed);
+    err = err ? err : add_close_once(&fa, stdout_fd, closed, &nclosed);
+    for (int i = 0; i < nclose; i++) {
+        err = err ? err : add_close_once(&fa, close_fds[i], closed, &nclosed);
+    }
+
+    if (!envp) {
+        envp = env_vector();
+    }
+
+    TRACE_BEGIN("spawn", argv[0]);
+    if (err == 0) {
+        const char *path = path_cache_lookup(argv[0]);
+
+        if (!path) {
+            err = errno;
+        } else {
+            err = launch_path(&pid, path, &fa, argv, envp, stdin_fd, stdout_fd);
+
+            /* Remembered path went stale (binary moved/removed): search again */
+            if (err != 0 && path != argv[0]) {
+                path_cache_forget(argv[0]);
+                path = path_cache_lookup(argv[0]);
+                err = path ? launch_path(&pid, path, &fa, argv, envp, stdin_fd, stdout_fd)
+                           : errno;
+            }
+        }
+    }
+    posix_spawn_file_actions_destroy(&fa);
+    TRACE_END("spawn");
+
+    if (err != 0) {
+        /* Exec failures are reported here instead of by the child */
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+        return -1;
+    }
+
+    return pid;
+}
+
+/*
+ * Wait for a child and convert its status to a shell exit code
+ *
+ * Its resource usage goes to time_stats_child() (for `time`).
+ * Returns: Exit code, 128+signal if killed, or EXIT_ERROR on error
+ */
+int wait_for_child(pid_t pid, const char *name)
+{
+    struct rusage usage;
+    int status;
+
+    TRACE_BEGIN("wait", name);
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("waitpid");
+        TRACE_END("wait");
+        return EXIT_ERROR;
+    }
+    TRACE_END("wait");
+    time_stats_child(&usage);
+
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+
+    if (WIFSIGNALED(status)) {
+        int signal = WTERMSIG(status);
+        fprintf(stderr, "%s: terminated by signal %d\n", name, signal);
+        return 128 + signal;
+    }
+
+    return EXIT_ERROR;
+}
+
+/*
+ * Exec an external command in a forked child (does not return)
+ *
+ * Uses the PATH cache entry inherited from the parent; if that path has
+ * gone stale, falls back to a normal execvp() search.
+ * envp: environment for the program, NULL for env_vector()
+ */
+void exec_child(char **argv, char **envp)
+{
+    const char *path = path_cache_lookup(argv[0]);
+
+    TRACE_INSTANT("exec", argv[0]);
+    if (path) {
+        /* This process is about to be replaced: execvp() may use it too */
+        environ = envp ? envp : env_vector();
+        execve(path, argv, environ);
+        if (path != argv[0]) {
+            execvp(argv[0], argv);
+        }
+    }
+
+    perror(argv[0]);
+    _exit(127);  /* Use _exit() in child, not exit() */
+}
+
+/*
+ * Check if a registry command can run inside the shell process
+ *
+ * In-process execution is skipped when:
+ * - The command is flagged CMD_FLAG_FORK
+ * - stdin is redirected: the shell reads its own input through the
+ *   stdin FILE buffer, so a command reading a redirected fd 0 through
+ *   that same buffer could consume shell input or leave file data behind
+ *
+ * Returns 1 if the command may run in-process, 0 if it must fork
+ */
+int can_run_inprocess(const cmd_spec_t *spec, int stdin_redirected)
+{
+    if (!spec || !spec->run) {
+        return 0;
+    }
+
+    if (spec->flags & CMD_FLAG_FORK) {
+        return 0;
+    }
+
+    return !stdin_redirected;
+}
+
+/*
+ * Run a registry command in the shell process (no fork)
+ *
+ * stdout_fd: -1 to keep the current stdout, otherwise the fd to write to.
+ * stdout is redirected for the duration of the command with a
+ * redirection scope, so the caller still owns (and must close) stdout_fd.
+ *
+ * Returns: Exit status of the command
+ */
+int exec_registry_inprocess(const cmd_spec_t *spec, int argc, char **argv, int stdout_fd)
+{
+    redir_scope_t scope;
+    int status;
+
+    if (redir_scope_apply(&scope, -1, stdout_fd) < 0) {
+        return EXIT_ERROR;
+    }
+
+    status = spec->run(argc, argv);
+
+    /* Flushes to the redirect target; the command may also have read
+     * the terminal to EOF (e.g. cat with no args) */
+    redir_scope_restore(&scope);
+
+    return status;
+}
+
+/*
+ * Run a registry command in-process with a redirection array
+ *
+ * Same as exec_registry_inprocess(), with the targets opened by
+ * redir_scope_open(): if one cannot be opened the command does not run.
+ * Only output redirections are expected here (see can_run_inprocess()).
+ */
+static int exec_registry_with_redirects(const cmd_spec_t *spec, char **argv,
+                                        struct redirection *redirs, int redir_count)
+{
+    redir_scope_t scope;
+    int argc = 0;
+    int status;
+
+    while (argv[argc] != NULL) {
+        argc++;
+    }
+
+    if (redir_scope_open(&scope, redirs, redir_count) < 0) {
+        return EXIT_ERROR;
+    }
+
+    status = spec->run(argc, argv);
+    redir_scope_restore(&scope);
+
+    return status;
+}
+
 /*
  * Execute command in child process using fork/exec
  *
@@ -22,13 +338,24 @@
 int exec_command_external(char **argv)
 {
     pid_t pid;
-    int status;
 
     if (!argv || !argv[0]) {
         fprintf(stderr, "exec: null command\n");
         return EXIT_ERROR;
     }
 
+    /* Spawn/zygote backends: no fork, nothing to set up in the child */
+    if (get_spawn_backend() != SPAWN_BACKEND_FORK) {
+        pid = spawn_external(argv, NULL, -1, -1, NULL, 0);
+        if (pid < 0) {
+            return 127;
+        }
+        return wait_for_child(pid, argv[0]);
+    }
+
+    /* Resolve before forking so the cache entry outlives the child */
+    path_cache_lookup(argv[0]);
+
     /* Fork a child process */
     pid = fork();
 
@@ -42,37 +369,13 @@ int exec_command_external(char **argv)
         /* === CHILD PROCESS === */
 
         /* Replace child process with the command */
-        execvp(argv[0], argv);
-
-        /* If execvp returns, it failed */
-        perror(argv[0]);
-        _exit(127);  /* Use _exit() in child, not exit() */
+        exec_child(argv, NULL);
     }
 
     /* === PARENT PROCESS === */
 
     /* Wait for child to complete */
-    if (waitpid(pid, &status, 0) < 0) {
-        perror("waitpid");
-        return EXIT_ERROR;
-    }
-
-    /* Check how child exited */
-    if (WIFEXITED(status)) {
-        /* Child exited normally */
-        int exit_code = WEXITSTATUS(status);
-        return exit_code;
-    }
-
-    if (WIFSIGNALED(status)) {
-        /* Child was killed by signal */
-        int signal = WTERMSIG(status);
-        fprintf(stderr, "%s: terminated by signal %d\n", argv[0], signal);
-        return 128 + signal;
-    }
-
-    /* Shouldn't get here */
-    return EXIT_ERROR;
+    return wait_for_child(pid, argv[0]);
 }
 
 /*
@@ -87,24 +390,82 @@ int is_builtin(const char *cmd)
 {
     return (strcmp(cmd, "cd") == 0 ||
             strcmp(cmd, "exit") == 0 ||
-            strcmp(cmd, "help") == 0);
+            strcmp(cmd, "export") == 0 ||
+            strcmp(cmd, "help") == 0 ||
+            strcmp(cmd, "hash") == 0 ||
+            strcmp(cmd, "set") == 0 ||
+            strcmp(cmd, "jobs") == 0 ||
+            strcmp(cmd, "wait") == 0 ||
+            strcmp(cmd, "time") == 0 ||
+            strcmp(cmd, "echo") == 0 ||
+            strcmp(cmd, "printf") == 0);
 }
 
 /*
  * Execute command with redirections (Phase 6)
  *
- * Redirections are applied in the child process before exec.
+ * Registry commands run in-process when can_run_inprocess() allows it.
+ * Everything else forks; redirections are applied in the child before exec.
  */
 int exec_command_with_redirects(char **argv, struct redirection *redirs, int redir_count)
 {
     pid_t pid;
-    int status;
+    const cmd_spec_t *spec;
+    int stdin_redirected = 0;
 
     if (!argv || !argv[0]) {
         fprintf(stderr, "exec: null command\n");
         return EXIT_ERROR;
     }
 
+    /* In-process fast path for registry commands */
+    spec = find_command(argv[0]);
+    if (spec) {
+        for (int i = 0; i < redir_count && redirs; i++) {
+            if (redirs[i].type == REDIR_INPUT || redirs[i].type == REDIR_HEREDOC ||
+                redirs[i].type == REDIR_HERESTRING) {
+                stdin_redirected = 1;
+            }
+        }
+
+        if (can_run_inprocess(spec, stdin_redirected)) {
+            return exec_registry_with_redirects(spec, argv, redirs, redir_count);
+        }
+    }
+
+    /* Spawn/zygote backends: open the targets here, the child only dup2()s them */
+    if (get_spawn_backend() != SPAWN_BACKEND_FORK) {
+        int fds[2] = {-1, -1};   /* final stdin / stdout targets */
+
+        for (int i = 0; i < redir_count && redirs; i++) {
+            int target;
+            int fd = open_redirection(redirs[i].type, redirs[i].filename, &target);
+            if (fd < 0) {
+                if (fds[0] != -1) close(fds[0]);
+                if (fds[1] != -1) close(fds[1]);
+                return EXIT_ERROR;
+            }
+            /* Later redirections of the same stream win */
+            if (fds[target] != -1) {
+                close(fds[target]);
+            }
+            fds[target] = fd;
+        }
+
+        pid = spawn_external(argv, NULL, fds[0], fds[1], NULL, 0);
+
+        if (fds[0] != -1) close(fds[0]);
+        if (fds[1] != -1) close(fds[1]);
+
+        if (pid < 0) {
+            return 127;
+        }
+        return wait_for_child(pid, argv[0]);
+    }
+
+    /* Resolve before forking so the cache entry outlives the child */
+    path_cache_lookup(argv[0]);
+
     /* Fork a child process */
     pid = fork();
 
@@ -124,29 +485,10 @@ int exec_command_with_redirects(char **argv, struct redirection *redirs, int red
         }
 
         /* Replace child process with the command */
-        execvp(argv[0], argv);
-
-        /* If execvp returns, it failed */
-        perror(argv[0]);
-        _exit(127);
+        exec_child(argv, NULL);
     }
 
     /* === PARENT PROCESS === */
 
-    if (waitpid(pid, &status, 0) < 0) {
-        perror("waitpid");
-        return EXIT_ERROR;
-    }
-
-    if (WIFEXITED(status)) {
-        return WEXITSTATUS(status);
-    }
-
-    if (WIFSIGNALED(status)) {
-        int signal = WTERMSIG(status);
-        fprintf(stderr, "%s: terminated by signal %d\n", argv[0], signal);
-        return 128 + signal;
-    }
-
-    return EXIT_ERROR;
+    return wait_for_child(pid, argv[0]);
 }
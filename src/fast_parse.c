@@ -0,0 +1,131 @@
+/*
+ * fast_parse.c - Parser fast path for simple command lines
+ *
+ * A word is what the lexer's Word rule (bnfc_shell/Shell.l) matches: a
+ * run of letters, digits and $ = ? ! % : - + . / _ ~ * [ ] \. A line
+ * qualifies when it is nothing but such words and blanks, and no word is
+ * one the lexer would read as something else:
+ *
+ *   "AI"     the keyword (the rule for it comes first, and ties win)
+ *   "//..."  may start a comment, so leave it to the lexer
+ *   if, for, while, do... as the first word, where the parser reads
+ *            them as keywords (see keyword_lex() in Shell.y)
+ *
+ * Any other character (|, <, >, ;, &, #, quotes, a newline...) sends
+ * the line to the parser. So does a line with no words, or more than
+ * FAST_PARSE_WORDS of them.
+ */
+
+#include "fast_parse.h"
+#include "../bnfc_shell/Parser.h"
+
+#include <string.h>
+
+#define FAST_PARSE_WORDS 64
+
+/* Bytes the Word token is made of */
+static const unsigned char word_char[256] = {
+    ['$'] = 1, ['='] = 1, ['?'] = 1, ['!'] = 1, ['%'] = 1, [':'] = 1,
+    ['-'] = 1, ['+'] = 1, ['.'] = 1, ['/'] = 1, ['_'] = 1, ['~'] = 1,
+    ['*'] = 1, ['['] = 1, [']'] = 1, ['\\'] = 1,
+    ['0'] = 1, ['1'] = 1, ['2'] = 1, ['3'] = 1, ['4'] = 1,
+    ['5'] = 1, ['6'] = 1, ['7'] = 1, ['8'] = 1, ['9'] = 1,
+    ['A'] = 1, ['B'] = 1, ['C'] = 1, ['D'] = 1, ['E'] = 1, ['F'] = 1, ['G'] = 1,
+    ['H'] = 1, ['I'] = 1, ['J'] = 1, ['K'] = 1, ['L'] = 1, ['M'] = 1, ['N'] = 1,
+    ['O'] = 1, ['P'] = 1, ['Q'] = 1, ['R'] = 1, ['S'] = 1, ['T'] = 1, ['U'] = 1,
+    ['V'] = 1, ['W'] = 1, ['X'] = 1, ['Y'] = 1, ['Z'] = 1,
+    ['a'] = 1, ['b'] = 1, ['c'] = 1, ['d'] = 1, ['e'] = 1, ['f'] = 1, ['g'] = 1,
+    ['h'] = 1, ['i'] = 1, ['j'] = 1, ['k'] = 1, ['l'] = 1, ['m'] = 1, ['n'] = 1,
+    ['o'] = 1, ['p'] = 1, ['q'] = 1, ['r'] = 1, ['s'] = 1, ['t'] = 1, ['u'] = 1,
+    ['v'] = 1, ['w'] = 1, ['x'] = 1, ['y'] = 1, ['z'] = 1,
+};
+
+/* Is the word at start a keyword when it begins a command? */
+static int is_keyword(const char *start, size_t len)
+{
+    static const char *const keywords[] = {
+        "if", "then", "else", "elif", "fi", "while", "for", "do", "done",
+    };
+
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        if (strlen(keywords[i]) == len && memcmp(keywords[i], start, len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* A copy of the len bytes at start, in the AST arena */
+static Word arena_word(const char *start, size_t len)
+{
+    char *word = ast_alloc(len + 1);
+
+    if (word) {
+        memcpy(word, start, len);
+        word[len] = '\0';
+    }
+    return word;
+}
+
+Input fast_parse_simple(const char *line)
+{
+    const char *start[FAST_PARSE_WORDS];
+    size_t len[FAST_PARSE_WORDS];
+    int count = 0;
+    const char *p = line;
+    ListWord args = NULL;
+    Word name;
+
+    /* Split into words, giving up at the first thing that is not simple */
+    for (;;) {
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (!*p) {
+            break;
+        }
+        if (!word_char[(unsigned char)*p] || count == FAST_PARSE_WORDS) {
+            return NULL;
+        }
+        start[count] = p;
+        while (word_char[(unsigned char)*p]) {
+            p++;
+        }
+        len[count] = (size_t)(p - start[count]);
+        if (*p && *p != ' ' && *p != '\t') {
+            return NULL;
+        }
+        if ((len[count] == 2 && start[count][0] == 'A' && start[count][1] == 'I') ||
+            (len[count] >= 2 && start[count][0] == '/' && start[count][1] == '/') ||
+            (count == 0 && is_keyword(start[0], len[0]))) {
+            return NULL;
+        }
+        count++;
+    }
+    if (count == 0) {
+        return NULL;
+    }
+
+    /* The argument list is built back to front, as a cons list */
+    for (int i = count - 1; i >= 1; i--) {
+        Word arg = arena_word(start[i], len[i]);
+
+        if (!arg) {
+            return NULL;
+        }
+        args = make_ListWord(arg, args);
+    }
+    name = arena_word(start[0], len[0]);
+    if (!name) {
+        return NULL;
+    }
+
+    return make_StartInput(make_ListCommand(make_SimpleCmd(make_Cmd(name, args, NULL)), NULL));
+}
+
+Input fast_parse_line(const char *line)
+{
+    Input tree = fast_parse_simple(line);
+
+    return tree ? tree : psInput(line);
+}
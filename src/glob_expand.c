@@ -0,0 +1,327 @@
+/*
+ * glob_expand.c - Pathname expansion (*, ? and [...]) for the shell
+ *
+ * The pattern is walked one component at a time with the path so far in
+ * a buffer: components without glob characters are appended as they
+ * are, a component with them is matched against the listing of the
+ * directory built so far, and each match is walked further. Listings,
+ * the matched paths and the final sorted array all come from one arena,
+ * released in one go by glob_cache_reset().
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* DT_* d_type constants */
+#endif
+
+#include "glob_expand.h"
+#include "arena.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define GLOB_ARENA_BLOCK 16384
+
+typedef struct {
+    const char *name;
+    unsigned char type;         /* d_type: DT_UNKNOWN if not reported */
+} dir_name_t;
+
+typedef struct dir_listing {
+    struct dir_listing *next;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    size_t count;
+    dir_name_t names[];
+} dir_listing_t;
+
+static arena_t *glob_arena = NULL;
+static dir_listing_t *listings = NULL;
+
+/* Reused between calls: entries of the directory being read, and matches */
+static dir_name_t *scratch = NULL;
+static size_t scratch_cap = 0;
+static char **found = NULL;
+static size_t found_count = 0;
+static size_t found_cap = 0;
+static int out_of_memory = 0;
+
+static char path[PATH_MAX];
+
+int glob_has_magic(const char *word)
+{
+    return strpbrk(word, "*?[") != NULL;
+}
+
+/* Does the component (len bytes at start) contain a glob character? */
+static int component_has_magic(const char *start, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (start[i] == '*' || start[i] == '?' || start[i] == '[') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * The listing of the directory at path ("" is the current one)
+ * Returns: the cached listing if the directory has not changed since it
+ *          was read, else a fresh one; NULL if it cannot be read
+ */
+static const dir_listing_t *read_listing(const char *dir)
+{
+    struct stat st;
+    dir_listing_t *listing;
+    struct dirent *entry;
+    size_t count = 0;
+    DIR *d;
+    int fd;
+
+    fd = open(dir[0] ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+    for (listing = listings; listing; listing = listing->next) {
+        if (listing->dev == st.st_dev && listing->ino == st.st_ino &&
+            listing->mtime.tv_sec == st.st_mtim.tv_sec &&
+            listing->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            close(fd);
+            return listing;
+        }
+    }
+
+    d = fdopendir(fd);
+    if (!d) {
+        close(fd);
+        return NULL;
+    }
+    while ((entry = readdir(d)) != NULL) {
+        const char *name = entry->d_name;
+
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        if (count == scratch_cap) {
+            size_t cap = scratch_cap ? scratch_cap * 2 : 64;
+            dir_name_t *grown = realloc(scratch, cap * sizeof(dir_name_t));
+
+            if (!grown) {
+                closedir(d);
+                out_of_memory = 1;
+                return NULL;
+            }
+            scratch = grown;
+            scratch_cap = cap;
+        }
+        scratch[count].name = arena_strdup(glob_arena, name);
+        scratch[count].type = entry->d_type;
+        if (!scratch[count].name) {
+            closedir(d);
+            out_of_memory = 1;
+            return NULL;
+        }
+        count++;
+    }
+    closedir(d);
+
+    listing = arena_alloc(glob_arena, sizeof(dir_listing_t) + count * sizeof(dir_name_t));
+    if (!listing) {
+        out_of_memory = 1;
+        return NULL;
+    }
+    listing->dev = st.st_dev;
+    listing->ino = st.st_ino;
+    listing->mtime = st.st_mtim;
+    listing->count = count;
+    memcpy(listing->names, scratch, count * sizeof(dir_name_t));
+    listing->next = listings;
+    listings = listing;
+    return listing;
+}
+
+/* Record path as a match */
+static void add_match(void)
+{
+    char *copy;
+
+    if (found_count == found_cap) {
+        size_t cap = found_cap ? found_cap * 2 : 64;
+        char **grown = realloc(found, cap * sizeof(char *));
+
+        if (!grown) {
+            out_of_memory = 1;
+            return;
+        }
+        found = grown;
+        found_cap = cap;
+    }
+    copy = arena_strdup(glob_arena, path);
+    if (!copy) {
+        out_of_memory = 1;
+        return;
+    }
+    found[found_count++] = copy;
+}
+
+/* Append len bytes to path at *len_at; 0 if they do not fit */
+static int path_append(size_t *len_at, const char *start, size_t len)
+{
+    if (*len_at + len >= sizeof(path)) {
+        return 0;
+    }
+    memcpy(path + *len_at, start, len);
+    *len_at += len;
+    path[*len_at] = '\0';
+    return 1;
+}
+
+/* Is the match that path now names a directory? (stat only if d_type cannot tell) */
+static int is_directory(unsigned char type)
+{
+    struct stat st;
+
+    if (type == DT_DIR) {
+        return 1;
+    }
+    if (type != DT_UNKNOWN && type != DT_LNK) {
+        return 0;
+    }
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/*
+ * Match rest (what is left of the pattern) below the first len bytes
+ * of path, which are empty or end in a slash
+ */
+static void expand_from(size_t len, const char *rest)
+{
+    const dir_listing_t *listing;
+    const char *end;
+    const char *next;
+    size_t slashes;
+    char *pattern;
+
+    /* Components without glob characters are taken as they are */
+    for (;;) {
+        end = strchr(rest, '/');
+        if (!end) {
+            end = rest + strlen(rest);
+        }
+        if (component_has_magic(rest, (size_t)(end - rest))) {
+            break;
+        }
+        slashes = strspn(end, "/");
+        if (!path_append(&len, rest, (size_t)(end - rest) + slashes)) {
+            return;
+        }
+        rest = end + slashes;
+        if (!*rest) {
+            /* A literal tail after a match (lib?/Makefile): keep it if it exists */
+            struct stat st;
+
+            if (lstat(path, &st) == 0) {
+                add_match();
+            }
+            return;
+        }
+    }
+
+    pattern = arena_alloc(glob_arena, (size_t)(end - rest) + 1);
+    if (!pattern) {
+        out_of_memory = 1;
+        return;
+    }
+    memcpy(pattern, rest, (size_t)(end - rest));
+    pattern[end - rest] = '\0';
+    slashes = strspn(end, "/");
+    next = end + slashes;
+
+    listing = read_listing(path);
+    if (!listing) {
+        return;
+    }
+
+    for (size_t i = 0; i < listing->count && !out_of_memory; i++) {
+        const dir_name_t *entry = &listing->names[i];
+        size_t name_len = len;
+
+        if (fnmatch(pattern, entry->name, FNM_PERIOD) != 0) {
+            continue;
+        }
+        if (!path_append(&name_len, entry->name, strlen(entry->name))) {
+            continue;
+        }
+
+        if (*next) {
+            /* More to match below: a directory, or something that may be one */
+            if (entry->type != DT_DIR && entry->type != DT_UNKNOWN && entry->type != DT_LNK) {
+                continue;
+            }
+            if (path_append(&name_len, end, slashes)) {
+                expand_from(name_len, next);
+            }
+        } else if (slashes) {
+            /* A trailing slash asks for directories */
+            if (is_directory(entry->type) && path_append(&name_len, end, slashes)) {
+                add_match();
+            }
+        } else {
+            add_match();
+        }
+    }
+    path[len] = '\0';
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+size_t glob_expand(const char *pattern, char ***matches)
+{
+    char **sorted;
+
+    if (!glob_arena) {
+        glob_arena = arena_create(GLOB_ARENA_BLOCK);
+        if (!glob_arena) {
+            return 0;
+        }
+    }
+
+    found_count = 0;
+    out_of_memory = 0;
+    path[0] = '\0';
+    expand_from(0, pattern);
+    if (found_count == 0 || out_of_memory) {
+        return 0;
+    }
+
+    qsort(found, found_count, sizeof(char *), compare_paths);
+    sorted = arena_alloc(glob_arena, (found_count + 1) * sizeof(char *));
+    if (!sorted) {
+        return 0;
+    }
+    memcpy(sorted, found, found_count * sizeof(char *));
+    sorted[found_count] = NULL;
+    *matches = sorted;
+    return found_count;
+}
+
+void glob_cache_reset(void)
+{
+    listings = NULL;
+    if (glob_arena) {
+        arena_reset(glob_arena);
+    }
+}
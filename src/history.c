@@ -0,0 +1,484 @@
+/*
+ * history.c - Command history shared by every shell
+ *
+ * See history.h for the two files. The history is mapped read-only and
+ * each query first checks its size, so lines other shells append show
+ * up without reading anything. New lines go through writev() on the
+ * same O_APPEND descriptor: one call per line, never torn.
+ *
+ * The index's records are mapped too. It never shrinks: a rebuild
+ * overwrites the records from the start, so a shell still holding the
+ * old mapping reads stale filters rather than faulting past the end of
+ * the file.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* memmem() */
+#endif
+
+#include "history.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/* A search extends the index first once this much is past it */
+#define HISTORY_TAIL_MAX (16 * HISTORY_BLOCK)
+
+static int hist_state = 0;              /* 0 = not opened yet, 1 = open, -1 = failed */
+static int hist_fd = -1;
+static const char *hist_map = NULL;
+static uint64_t hist_size = 0;          /* Of the mapping */
+
+static int idx_fd = -1;
+static void *idx_map = NULL;
+static size_t idx_map_len = 0;
+static const history_idx_block_t *idx_blocks = NULL;
+static uint64_t idx_nblocks = 0;
+static uint64_t idx_covered = 0;
+
+static uint64_t fnv1a(const char *p, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Bloom filter bit of the trigram at s */
+static unsigned bloom_bit(const char *s)
+{
+    uint32_t tri = (uint32_t)(unsigned char)s[0] << 16 | (uint32_t)(unsigned char)s[1] << 8 |
+                   (uint32_t)(unsigned char)s[2];
+
+    return (unsigned)((tri * 2654435761u) >> 20) % HISTORY_BLOOM_BITS;
+}
+
+/*
+ * $HISTFILE, or ~/.mysh/history (creating ~/.mysh), into path
+ * Returns: 0, or -1 if there is neither
+ */
+static int history_path(char *path, size_t size)
+{
+    const char *env = getenv("HISTFILE");
+    const char *home = getenv("HOME");
+    int len;
+
+    if (env && *env) {
+        len = snprintf(path, size, "%s", env);
+        return len > 0 && (size_t)len < size ? 0 : -1;
+    }
+    if (!home || !*home) {
+        return -1;
+    }
+    len = snprintf(path, size, "%s/.mysh", home);
+    if (len <= 0 || (size_t)len >= size || (mkdir(path, 0755) != 0 && errno != EEXIST)) {
+        return -1;
+    }
+    len = snprintf(path, size, "%s/.mysh/history", home);
+    return len > 0 && (size_t)len < size ? 0 : -1;
+}
+
+/* Map the history again if its size changed */
+static void hist_remap(void)
+{
+    struct stat st;
+    void *map;
+
+    if (fstat(hist_fd, &st) != 0 || (uint64_t)st.st_size == hist_size) {
+        return;
+    }
+    if (hist_map) {
+        munmap((void *)hist_map, hist_size);
+        hist_map = NULL;
+        hist_size = 0;
+    }
+    if (st.st_size == 0) {
+        return;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, hist_fd, 0);
+    if (map != MAP_FAILED) {
+        hist_map = map;
+        hist_size = (uint64_t)st.st_size;
+    }
+}
+
+/* Add the lines in [start, end) to block's filter */
+static void bloom_fill(history_idx_block_t *block, const char *start, const char *end)
+{
+    memset(block->bloom, 0, sizeof(block->bloom));
+    for (const char *p = start; p + 2 < end; p++) {
+        if (p[0] != '\n' && p[1] != '\n' && p[2] != '\n') {
+            unsigned bit = bloom_bit(p);
+
+            block->bloom[bit / 64] |= (uint64_t)1 << (bit % 64);
+        }
+    }
+}
+
+/*
+ * Index the whole blocks of history past what the index covers, and
+ * map its records again
+ */
+static void idx_update(void)
+{
+    history_idx_hdr_t hdr;
+    struct stat st;
+    uint64_t pos;
+    size_t len;
+    void *map;
+
+    if (idx_fd < 0 || flock(idx_fd, LOCK_EX) != 0) {
+        return;
+    }
+
+    if (pread(idx_fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) || fstat(idx_fd, &st) != 0 ||
+        hdr.magic != HISTORY_IDX_MAGIC || hdr.version != HISTORY_IDX_VERSION ||
+        hdr.block_bytes != HISTORY_BLOCK || hdr.bloom_bits != HISTORY_BLOOM_BITS ||
+        hdr.covered > hist_size ||
+        (uint64_t)st.st_size < sizeof(hdr) + hdr.nblocks * sizeof(history_idx_block_t) ||
+        hdr.check != fnv1a(hist_map, hdr.covered < HISTORY_BLOCK ? hdr.covered : HISTORY_BLOCK)) {
+        /* Missing, of another build, or of a history since replaced */
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.magic = HISTORY_IDX_MAGIC;
+        hdr.version = HISTORY_IDX_VERSION;
+        hdr.block_bytes = HISTORY_BLOCK;
+        hdr.bloom_bits = HISTORY_BLOOM_BITS;
+    }
+
+    /* Blocks end at the first line end HISTORY_BLOCK bytes in */
+    pos = hdr.covered;
+    while (hist_size - pos >= HISTORY_BLOCK) {
+        const char *nl = memchr(hist_map + pos + HISTORY_BLOCK - 1, '\n',
+                                hist_size - pos - HISTORY_BLOCK + 1);
+        history_idx_block_t block;
+
+        if (!nl) {
+            break;
+        }
+        block.start = pos;
+        block.end = (uint64_t)(nl - hist_map) + 1;
+        bloom_fill(&block, hist_map + block.start, hist_map + block.end);
+        if (pwrite(idx_fd, &block, sizeof(block),
+                   (off_t)(sizeof(hdr) + hdr.nblocks * sizeof(block))) != (ssize_t)sizeof(block)) {
+            break;
+        }
+        hdr.nblocks++;
+        pos = block.end;
+    }
+    if (pos != hdr.covered || hdr.check == 0) {
+        hdr.covered = pos;
+        hdr.check = fnv1a(hist_map, pos < HISTORY_BLOCK ? pos : HISTORY_BLOCK);
+        if (pwrite(idx_fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+            hdr.nblocks = 0;
+            hdr.covered = 0;
+        }
+    }
+    flock(idx_fd, LOCK_UN);
+
+    if (idx_map) {
+        munmap(idx_map, idx_map_len);
+        idx_map = NULL;
+        idx_blocks = NULL;
+        idx_nblocks = 0;
+        idx_covered = 0;
+    }
+    len = sizeof(hdr) + hdr.nblocks * sizeof(history_idx_block_t);
+    if (hdr.nblocks == 0) {
+        return;
+    }
+    map = mmap(NULL, len, PROT_READ, MAP_SHARED, idx_fd, 0);
+    if (map != MAP_FAILED) {
+        idx_map = map;
+        idx_map_len = len;
+        idx_blocks = (const history_idx_block_t *)((const char *)map + sizeof(hdr));
+        idx_nblocks = hdr.nblocks;
+        idx_covered = hdr.covered;
+    }
+}
+
+int history_open(void)
+{
+    char path[PATH_MAX];
+    char idx_path[PATH_MAX + 8];
+
+    if (hist_state != 0) {
+        return hist_state > 0 ? 0 : -1;
+    }
+    hist_state = -1;
+    if (history_path(path, sizeof(path)) != 0) {
+        return -1;
+    }
+    hist_fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (hist_fd < 0) {
+        return -1;
+    }
+    hist_state = 1;
+    hist_remap();
+
+    snprintf(idx_path, sizeof(idx_path), "%s.idx", path);
+    idx_fd = open(idx_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    idx_update();
+    return 0;
+}
+
+void history_close(void)
+{
+    if (idx_map) {
+        munmap(idx_map, idx_map_len);
+    }
+    if (hist_map) {
+        munmap((void *)hist_map, hist_size);
+    }
+    if (idx_fd >= 0) {
+        close(idx_fd);
+    }
+    if (hist_fd >= 0) {
+        close(hist_fd);
+    }
+    hist_map = NULL;
+    hist_size = 0;
+    idx_map = NULL;
+    idx_blocks = NULL;
+    idx_nblocks = 0;
+    idx_covered = 0;
+    idx_fd = -1;
+    hist_fd = -1;
+    hist_state = 0;
+}
+
+uint64_t history_end(void)
+{
+    if (history_open() != 0) {
+        return 0;
+    }
+    hist_remap();
+    return hist_size;
+}
+
+/* The line in [start, end), without its line end, into entry */
+static void entry_at(uint64_t start, uint64_t end, history_entry_t *entry)
+{
+    if (end > start && hist_map[end - 1] == '\n') {
+        end--;
+    }
+    entry->text = hist_map + start;
+    entry->len = (size_t)(end - start);
+    entry->off = start;
+}
+
+/* Where the line ending before off (and not before floor) starts */
+static uint64_t line_start(uint64_t floor, uint64_t off)
+{
+    const char *nl;
+
+    if (off > floor && hist_map[off - 1] == '\n') {
+        off--;
+    }
+    nl = off > floor ? mem_rchr(hist_map + floor, '\n', (size_t)(off - floor)) : NULL;
+    return nl ? (uint64_t)(nl - hist_map) + 1 : floor;
+}
+
+int history_before(uint64_t off, history_entry_t *entry)
+{
+    uint64_t start;
+
+    history_end();
+    if (off > hist_size) {
+        off = hist_size;
+    }
+    if (off == 0) {
+        return -1;
+    }
+    start = line_start(0, off);
+    entry_at(start, off, entry);
+    return 0;
+}
+
+int history_after(uint64_t off, history_entry_t *entry)
+{
+    const char *nl;
+    const char *next;
+
+    history_end();
+    if (off >= hist_size) {
+        return -1;
+    }
+    nl = memchr(hist_map + off, '\n', (size_t)(hist_size - off));
+    if (!nl || (uint64_t)(nl + 1 - hist_map) >= hist_size) {
+        return -1;
+    }
+    next = memchr(nl + 1, '\n', (size_t)(hist_map + hist_size - (nl + 1)));
+    entry_at((uint64_t)(nl + 1 - hist_map),
+             next ? (uint64_t)(next + 1 - hist_map) : hist_size, entry);
+    return 0;
+}
+
+/*
+ * The newest line in [start, end) containing needle
+ * Returns: 0, or -1 if none does
+ */
+static int search_range(uint64_t start, uint64_t end, const char *needle, size_t n,
+                        history_entry_t *entry)
+{
+    while (end > start) {
+        uint64_t from = line_start(start, end);
+
+        entry_at(from, end, entry);
+        if (entry->len >= n && memmem(entry->text, entry->len, needle, n)) {
+            return 0;
+        }
+        end = from;
+    }
+    return -1;
+}
+
+int history_search(const char *needle, uint64_t off, history_entry_t *entry)
+{
+    unsigned bits[64];
+    size_t nbits = 0;
+    size_t n = strlen(needle);
+
+    history_end();
+    if (hist_size - idx_covered > HISTORY_TAIL_MAX) {
+        idx_update();
+    }
+    if (off > hist_size) {
+        off = hist_size;
+    }
+
+    /* Past the index, every line is looked at */
+    if (off > idx_covered &&
+        search_range(idx_covered, off, needle, n, entry) == 0) {
+        return 0;
+    }
+
+    /* A few trigrams from along the needle are plenty to skip blocks by */
+    for (size_t i = 0; i + 2 < n && nbits < sizeof(bits) / sizeof(bits[0]); i++) {
+        bits[nbits++] = bloom_bit(needle + i);
+    }
+    for (uint64_t b = idx_nblocks; b-- > 0; ) {
+        const history_idx_block_t *block = &idx_blocks[b];
+        size_t i;
+
+        if (block->start >= off) {
+            continue;
+        }
+        for (i = 0; i < nbits; i++) {
+            if (!(block->bloom[bits[i] / 64] & (uint64_t)1 << (bits[i] % 64))) {
+                break;
+            }
+        }
+        if (i == nbits &&
+            search_range(block->start, block->end < off ? block->end : off, needle, n, entry) == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void history_add(const char *line)
+{
+    history_entry_t newest;
+    struct iovec iov[2];
+    size_t len = strcspn(line, "\n");
+    size_t blank = strspn(line, " \t");
+
+    if (blank >= len || history_open() != 0) {
+        return;
+    }
+    if (history_before(history_end(), &newest) == 0 &&
+        newest.len == len && memcmp(newest.text, line, len) == 0) {
+        return;
+    }
+
+    iov[0].iov_base = (void *)line;
+    iov[0].iov_len = len;
+    iov[1].iov_base = "\n";
+    iov[1].iov_len = 1;
+    while (writev(hist_fd, iov, 2) < 0 && errno == EINTR) {
+    }
+}
+
+typedef struct freq_slot {
+    uint64_t hash;
+    uint64_t off;               /* Of its newest occurrence */
+    size_t len;
+    size_t count;               /* 0 = empty slot */
+} freq_slot_t;
+
+static int freq_cmp(const void *a, const void *b)
+{
+    const freq_slot_t *x = a;
+    const freq_slot_t *y = b;
+
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    return x->off < y->off ? 1 : (x->off > y->off ? -1 : 0);
+}
+
+size_t history_frequent(char **lines, size_t max, size_t window)
+{
+    history_entry_t entry;
+    freq_slot_t *slots;
+    size_t nslots = 16;
+    size_t found = 0;
+    uint64_t off;
+
+    if (max == 0 || window == 0) {
+        return 0;
+    }
+    while (nslots < window * 2) {
+        nslots *= 2;
+    }
+    slots = calloc(nslots, sizeof(*slots));
+    if (!slots) {
+        return 0;
+    }
+
+    /* Count each distinct line, newest first */
+    off = history_end();
+    for (size_t seen = 0; seen < window && history_before(off, &entry) == 0; seen++) {
+        uint64_t hash = fnv1a(entry.text, entry.len);
+        size_t i = (size_t)hash & (nslots - 1);
+
+        while (slots[i].count > 0 &&
+               !(slots[i].hash == hash && slots[i].len == entry.len &&
+                 memcmp(hist_map + slots[i].off, entry.text, entry.len) == 0)) {
+            i = (i + 1) & (nslots - 1);
+        }
+        if (slots[i].count++ == 0) {
+            slots[i].hash = hash;
+            slots[i].off = entry.off;
+            slots[i].len = entry.len;
+        }
+        off = entry.off;
+    }
+
+    qsort(slots, nslots, sizeof(*slots), freq_cmp);
+    for (size_t i = 0; i < nslots && found < max && slots[i].count > 1; i++) {
+        char *line = malloc(slots[i].len + 1);
+
+        if (!line) {
+            break;
+        }
+        memcpy(line, hist_map + slots[i].off, slots[i].len);
+        line[slots[i].len] = '\0';
+        lines[found++] = line;
+    }
+    free(slots);
+    return found;
+}
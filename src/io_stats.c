@@ -0,0 +1,239 @@
+/*
+ * io_stats.c - Per-command I/O and allocation counts (PICOBOX_STATS, --stats)
+ *
+ * The counters are plain 64-bit integers updated with relaxed atomic
+ * adds: pipeline threads count into the same totals, and nothing reads
+ * them while a command runs.
+ *
+ * Built with -DPICOBOX_MALLOC_STATS (make MALLOC_STATS=1) on glibc,
+ * malloc() and friends are defined here and hand on to __libc_malloc()
+ * and friends, which glibc exports for exactly this. Being in the
+ * executable, they take every allocation in the process, libc's and
+ * the plugins' included, so this is a profiling build, not the
+ * default. Every entry point glibc's manual lists for replacing malloc
+ * is here, and reallocarray() as well, so each block free() sees was
+ * counted when it was handed out. When counting is off they cost one
+ * test.
+ *
+ * The heap is measured in malloc_usable_size() bytes. A command's peak
+ * is the largest growth over its start; freeing a block allocated
+ * before the command started lowers the heap too, so a command that
+ * does so shows less growth than it had.
+ */
+
+#include "io_stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GLIBC__) && defined(PICOBOX_MALLOC_STATS)
+#define IO_STATS_HEAP 1
+#include <errno.h>
+#include <malloc.h>
+#endif
+
+int io_stats_on = 0;
+
+static io_stats_t totals;
+
+#define COUNT(field, n) __atomic_fetch_add(&totals.field, (n), __ATOMIC_RELAXED)
+
+void io_stats_init(void)
+{
+    const char *env = getenv("PICOBOX_STATS");
+
+    io_stats_on = env && env[0] && strcmp(env, "0") != 0;
+}
+
+void io_stats_read(ssize_t n)
+{
+    COUNT(read_calls, 1);
+    if (n > 0) {
+        COUNT(read_bytes, (uint64_t)n);
+    }
+}
+
+void io_stats_write(ssize_t n)
+{
+    COUNT(write_calls, 1);
+    if (n > 0) {
+        COUNT(write_bytes, (uint64_t)n);
+    }
+}
+
+void io_stats_open(void)
+{
+    COUNT(opens, 1);
+}
+
+#ifdef IO_STATS_HEAP
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void *__libc_pvalloc(size_t size);
+extern void __libc_free(void *ptr);
+
+/* Heap grew (or shrank) by delta bytes */
+static void heap_add(int64_t delta)
+{
+    int64_t now = __atomic_add_fetch(&totals.heap, delta, __ATOMIC_RELAXED);
+    int64_t peak = __atomic_load_n(&totals.peak_heap, __ATOMIC_RELAXED);
+
+    while (now > peak &&
+           !__atomic_compare_exchange_n(&totals.peak_heap, &peak, now, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void *counted(void *p)
+{
+    if (p && io_stats_on) {
+        COUNT(allocs, 1);
+        heap_add((int64_t)malloc_usable_size(p));
+    }
+    return p;
+}
+
+void *malloc(size_t size)
+{
+    return counted(__libc_malloc(size));
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    return counted(__libc_calloc(nmemb, size));
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    size_t old;
+    void *p;
+
+    if (!io_stats_on) {
+        return __libc_realloc(ptr, size);
+    }
+    old = ptr ? malloc_usable_size(ptr) : 0;
+    p = __libc_realloc(ptr, size);
+    if (p) {
+        COUNT(allocs, 1);
+        heap_add((int64_t)malloc_usable_size(p) - (int64_t)old);
+    } else if (ptr && size == 0) {
+        heap_add(-(int64_t)old);
+    }
+    return p;
+}
+
+/* glibc's own would call __libc_realloc(), past the count */
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, nmemb * size);
+}
+
+void free(void *ptr)
+{
+    if (ptr && io_stats_on) {
+        heap_add(-(int64_t)malloc_usable_size(ptr));
+    }
+    __libc_free(ptr);
+}
+
+/* The aligned allocators too, so free() never sees memory it did not count */
+void *memalign(size_t alignment, size_t size)
+{
+    return counted(__libc_memalign(alignment, size));
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return counted(__libc_memalign(alignment, size));
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    p = counted(__libc_memalign(alignment, size));
+    if (!p && size != 0) {
+        return ENOMEM;
+    }
+    *memptr = p;
+    return 0;
+}
+
+void *valloc(size_t size)
+{
+    return counted(__libc_valloc(size));
+}
+
+void *pvalloc(size_t size)
+{
+    return counted(__libc_pvalloc(size));
+}
+
+#endif /* IO_STATS_HEAP */
+
+void io_stats_begin(io_stats_t *mark)
+{
+    mark->read_bytes = __atomic_load_n(&totals.read_bytes, __ATOMIC_RELAXED);
+    mark->read_calls = __atomic_load_n(&totals.read_calls, __ATOMIC_RELAXED);
+    mark->write_bytes = __atomic_load_n(&totals.write_bytes, __ATOMIC_RELAXED);
+    mark->write_calls = __atomic_load_n(&totals.write_calls, __ATOMIC_RELAXED);
+    mark->opens = __atomic_load_n(&totals.opens, __ATOMIC_RELAXED);
+    mark->allocs = __atomic_load_n(&totals.allocs, __ATOMIC_RELAXED);
+    mark->heap = __atomic_load_n(&totals.heap, __ATOMIC_RELAXED);
+    mark->peak_heap = 0;
+    __atomic_store_n(&totals.peak_heap, mark->heap, __ATOMIC_RELAXED);
+}
+
+void io_stats_end(const io_stats_t *mark, io_stats_t *out)
+{
+    io_stats_t now;
+    int64_t peak = __atomic_load_n(&totals.peak_heap, __ATOMIC_RELAXED);
+
+    /* Read before io_stats_begin() restarts it */
+    io_stats_begin(&now);
+    out->read_bytes = now.read_bytes - mark->read_bytes;
+    out->read_calls = now.read_calls - mark->read_calls;
+    out->write_bytes = now.write_bytes - mark->write_bytes;
+    out->write_calls = now.write_calls - mark->write_calls;
+    out->opens = now.opens - mark->opens;
+    out->allocs = now.allocs - mark->allocs;
+    out->heap = now.heap - mark->heap;
+    out->peak_heap = peak - mark->heap;
+    if (out->peak_heap < 0) {
+        out->peak_heap = 0;
+    }
+}
+
+static const char *plural(uint64_t n)
+{
+    return n == 1 ? "" : "s";
+}
+
+void io_stats_print(FILE *out, const char *command, const io_stats_t *stats, double real_ms)
+{
+    fprintf(out, "stats: %s: %.2f ms, read %llu B in %llu call%s, wrote %llu B in %llu call%s, "
+            "%llu file%s opened",
+            command ? command : "", real_ms,
+            (unsigned long long)stats->read_bytes, (unsigned long long)stats->read_calls,
+            plural(stats->read_calls),
+            (unsigned long long)stats->write_bytes, (unsigned long long)stats->write_calls,
+            plural(stats->write_calls),
+            (unsigned long long)stats->opens, plural(stats->opens));
+#ifdef IO_STATS_HEAP
+    fprintf(out, ", %llu alloc%s, peak heap %lld KB",
+            (unsigned long long)stats->allocs, plural(stats->allocs),
+            (long long)((stats->peak_heap + 1023) / 1024));
+#endif
+    fputc('\n', out);
+}
@@ -0,0 +1,496 @@
+/*
+ * line_edit.c - Interactive line input with history
+ *
+ * A single-line editor in the manner of linenoise: the terminal is put
+ * in raw mode for the one line, and after every key the line is drawn
+ * again in one write() (carriage return, prompt, text, clear to the end
+ * of the line, cursor moved back to its column). Lines longer than the
+ * terminal is wide are not scrolled.
+ *
+ * Up/Down walk the history by file offset (history_before() and
+ * history_after()), so lines other shells add while this one waits
+ * show up the next time Up is pressed. What was being typed before the
+ * first Up comes back below the newest entry.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* strndup() under -std=c11 */
+#endif
+
+#include "line_edit.h"
+#include "history.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define KEY_CTRL(c) ((c) & 0x1f)
+#define KEY_ESC 27
+#define KEY_BACKSPACE 127
+#define LINE_EDIT_INITIAL 256   /* Line buffer size to start with */
+
+/* Keys decoded from escape sequences, outside the byte range */
+enum {
+    KEY_UP = 256,
+    KEY_DOWN,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_HOME,
+    KEY_END,
+    KEY_DELETE,
+    KEY_EOF,
+    KEY_ACCEPT                  /* Enter in search: run the line found */
+};
+
+typedef struct line_state {
+    char *buf;                  /* The caller's buffer, grown as needed */
+    size_t size;
+    size_t len;
+    size_t pos;                 /* Cursor, as a byte offset into buf */
+    const char *prompt;
+    uint64_t hist_off;          /* Entry shown by Up/Down; UINT64_MAX = the typed line */
+    char *typed;                /* The typed line while browsing */
+} line_state_t;
+
+static void write_all(const char *p, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, p, len);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+}
+
+/*
+ * The next key: a byte, or KEY_* for an escape sequence or end of input
+ */
+static int read_key(void)
+{
+    unsigned char c;
+    unsigned char seq[3];
+    ssize_t n;
+
+    while ((n = read(STDIN_FILENO, &c, 1)) < 0 && errno == EINTR) {
+    }
+    if (n <= 0) {
+        return KEY_EOF;
+    }
+    if (c != KEY_ESC) {
+        return c;
+    }
+
+    /* ESC [ X, ESC [ N ~ and ESC O X */
+    if (read(STDIN_FILENO, &seq[0], 1) != 1 || read(STDIN_FILENO, &seq[1], 1) != 1) {
+        return KEY_ESC;
+    }
+    if (seq[0] == '[' && seq[1] >= '0' && seq[1] <= '9') {
+        if (read(STDIN_FILENO, &seq[2], 1) != 1 || seq[2] != '~') {
+            return KEY_ESC;
+        }
+        switch (seq[1]) {
+        case '1': case '7': return KEY_HOME;
+        case '3': return KEY_DELETE;
+        case '4': case '8': return KEY_END;
+        default: return KEY_ESC;
+        }
+    }
+    if (seq[0] == '[' || seq[0] == 'O') {
+        switch (seq[1]) {
+        case 'A': return KEY_UP;
+        case 'B': return KEY_DOWN;
+        case 'C': return KEY_RIGHT;
+        case 'D': return KEY_LEFT;
+        case 'H': return KEY_HOME;
+        case 'F': return KEY_END;
+        default: break;
+        }
+    }
+    return KEY_ESC;
+}
+
+/* Draw prefix and text, with the cursor cursor bytes into text */
+static void draw(const char *prefix, const char *text, size_t len, size_t cursor)
+{
+    size_t plen = strlen(prefix);
+    char *out = malloc(plen + len + 32);
+    size_t n = 0;
+
+    if (!out) {
+        return;
+    }
+    out[n++] = '\r';
+    memcpy(out + n, prefix, plen);
+    n += plen;
+    memcpy(out + n, text, len);
+    n += len;
+    memcpy(out + n, "\x1b[K\r", 4);
+    n += 4;
+    if (plen + cursor > 0) {
+        n += (size_t)snprintf(out + n, 28, "\x1b[%zuC", plen + cursor);
+    }
+    write_all(out, n);
+    free(out);
+}
+
+static void refresh(line_state_t *ls)
+{
+    draw(ls->prompt, ls->buf, ls->len, ls->pos);
+}
+
+/*
+ * Make room for a line of len bytes
+ * Returns: 0, or -1 if out of memory (the line is left as it was)
+ */
+static int reserve(line_state_t *ls, size_t len)
+{
+    size_t size = ls->size;
+    char *bigger;
+
+    if (len < size) {
+        return 0;
+    }
+    while (size <= len) {
+        size *= 2;
+    }
+    bigger = realloc(ls->buf, size);
+    if (!bigger) {
+        return -1;
+    }
+    ls->buf = bigger;
+    ls->size = size;
+    return 0;
+}
+
+/* Replace the line with text, cursor at its end */
+static void set_line(line_state_t *ls, const char *text, size_t len)
+{
+    if (reserve(ls, len) != 0) {
+        return;
+    }
+    memmove(ls->buf, text, len);
+    ls->buf[len] = '\0';
+    ls->len = len;
+    ls->pos = len;
+}
+
+static void insert_char(line_state_t *ls, char c)
+{
+    if (reserve(ls, ls->len + 1) != 0) {
+        return;
+    }
+    memmove(ls->buf + ls->pos + 1, ls->buf + ls->pos, ls->len - ls->pos);
+    ls->buf[ls->pos++] = c;
+    ls->buf[++ls->len] = '\0';
+}
+
+/* Remove the bytes in [from, to) */
+static void delete_range(line_state_t *ls, size_t from, size_t to)
+{
+    memmove(ls->buf + from, ls->buf + to, ls->len - to);
+    ls->len -= to - from;
+    ls->buf[ls->len] = '\0';
+    ls->pos = from;
+}
+
+/* Up (older) or Down (newer) through the history */
+static void browse(line_state_t *ls, int older)
+{
+    history_entry_t entry;
+    int found;
+
+    if (older) {
+        found = history_before(ls->hist_off == UINT64_MAX ? history_end() : ls->hist_off,
+                               &entry) == 0;
+    } else {
+        found = ls->hist_off != UINT64_MAX && history_after(ls->hist_off, &entry) == 0;
+    }
+
+    if (found) {
+        if (ls->hist_off == UINT64_MAX) {
+            free(ls->typed);
+            ls->typed = strndup(ls->buf, ls->len);
+        }
+        ls->hist_off = entry.off;
+        set_line(ls, entry.text, entry.len);
+    } else if (!older && ls->hist_off != UINT64_MAX) {
+        /* Below the newest: back to the typed line */
+        ls->hist_off = UINT64_MAX;
+        set_line(ls, ls->typed ? ls->typed : "", ls->typed ? strlen(ls->typed) : 0);
+    }
+}
+
+/*
+ * Ctrl-R: search the history as the query is typed
+ * Returns: the key that ended the search, to be handled as an edit
+ *          (0 if there is none, KEY_ACCEPT for Enter)
+ */
+static int reverse_search(line_state_t *ls)
+{
+    char query[256];
+    char prefix[320];
+    size_t qlen = 0;
+    char *shown = NULL;         /* Copy of the line found: the mapping may move */
+    size_t shown_len = 0;
+    uint64_t shown_off = 0;
+    int failing = 0;
+    char *orig = strndup(ls->buf, ls->len);
+    size_t orig_pos = ls->pos;
+    int key;
+
+    query[0] = '\0';
+    for (;;) {
+        history_entry_t found;
+        uint64_t off;
+        int hit;
+
+        snprintf(prefix, sizeof(prefix), "(%sreverse-i-search)`%s': ",
+                 failing ? "failing " : "", query);
+        draw(prefix, shown ? shown : "", shown_len, shown_len);
+
+        key = read_key();
+        if ((key == KEY_BACKSPACE || key == KEY_CTRL('h')) && qlen > 0) {
+            query[--qlen] = '\0';
+            off = history_end();
+        } else if (key >= 32 && key < 127 && qlen + 1 < sizeof(query)) {
+            query[qlen++] = (char)key;
+            query[qlen] = '\0';
+            off = history_end();
+        } else if (key == KEY_CTRL('r')) {
+            off = shown ? shown_off : history_end();
+        } else if (key == KEY_CTRL('g') || key == KEY_CTRL('c')) {
+            set_line(ls, orig ? orig : "", orig ? strlen(orig) : 0);
+            ls->pos = orig_pos < ls->len ? orig_pos : ls->len;
+            free(orig);
+            free(shown);
+            return 0;
+        } else if (key == KEY_BACKSPACE || key == KEY_CTRL('h')) {
+            continue;
+        } else {
+            break;
+        }
+
+        /* Ctrl-R goes past lines equal to the one shown */
+        while ((hit = history_search(query, off, &found) == 0) && key == KEY_CTRL('r') &&
+               found.len == shown_len && memcmp(found.text, shown, shown_len) == 0) {
+            off = found.off;
+        }
+        failing = !hit;
+        if (hit) {
+            free(shown);
+            shown = strndup(found.text, found.len);
+            shown_len = shown ? found.len : 0;
+            shown_off = found.off;
+        }
+    }
+
+    /* Done: the line found is the line */
+    if (shown) {
+        set_line(ls, shown, shown_len);
+        ls->hist_off = UINT64_MAX;
+    }
+    free(orig);
+    free(shown);
+    if (key == '\r' || key == '\n') {
+        return KEY_ACCEPT;
+    }
+    return key == KEY_ESC ? 0 : key;
+}
+
+/*
+ * Edit a line in raw mode
+ * Returns: its length, or -1 at end of input
+ */
+static ssize_t edit(line_state_t *ls)
+{
+    write_all(ls->prompt, strlen(ls->prompt));
+    for (;;) {
+        int key = read_key();
+
+        if (key == KEY_CTRL('r')) {
+            key = reverse_search(ls);
+            if (key == KEY_ACCEPT) {
+                refresh(ls);
+                write_all("\r\n", 2);
+                return (ssize_t)ls->len;
+            }
+        }
+
+        switch (key) {
+        case 0:
+            break;
+        case '\r':
+        case '\n':
+            write_all("\r\n", 2);
+            return (ssize_t)ls->len;
+        case KEY_EOF:
+            return -1;
+        case KEY_CTRL('d'):
+            if (ls->len == 0) {
+                return -1;
+            }
+            if (ls->pos < ls->len) {
+                delete_range(ls, ls->pos, ls->pos + 1);
+            }
+            break;
+        case KEY_DELETE:
+            if (ls->pos < ls->len) {
+                delete_range(ls, ls->pos, ls->pos + 1);
+            }
+            break;
+        case KEY_CTRL('c'):
+            write_all("^C\r\n", 4);
+            ls->len = ls->pos = 0;
+            ls->buf[0] = '\0';
+            ls->hist_off = UINT64_MAX;
+            write_all(ls->prompt, strlen(ls->prompt));
+            continue;
+        case KEY_BACKSPACE:
+        case KEY_CTRL('h'):
+            if (ls->pos > 0) {
+                delete_range(ls, ls->pos - 1, ls->pos);
+            }
+            break;
+        case KEY_LEFT:
+        case KEY_CTRL('b'):
+            if (ls->pos > 0) {
+                ls->pos--;
+            }
+            break;
+        case KEY_RIGHT:
+        case KEY_CTRL('f'):
+            if (ls->pos < ls->len) {
+                ls->pos++;
+            }
+            break;
+        case KEY_HOME:
+        case KEY_CTRL('a'):
+            ls->pos = 0;
+            break;
+        case KEY_END:
+        case KEY_CTRL('e'):
+            ls->pos = ls->len;
+            break;
+        case KEY_CTRL('k'):
+            delete_range(ls, ls->pos, ls->len);
+            break;
+        case KEY_CTRL('u'):
+            delete_range(ls, 0, ls->pos);
+            break;
+        case KEY_CTRL('w'): {
+            size_t from = ls->pos;
+
+            while (from > 0 && ls->buf[from - 1] == ' ') {
+                from--;
+            }
+            while (from > 0 && ls->buf[from - 1] != ' ') {
+                from--;
+            }
+            delete_range(ls, from, ls->pos);
+            break;
+        }
+        case KEY_CTRL('l'):
+            write_all("\x1b[H\x1b[2J", 7);
+            break;
+        case KEY_UP:
+        case KEY_CTRL('p'):
+            browse(ls, 1);
+            break;
+        case KEY_DOWN:
+        case KEY_CTRL('n'):
+            browse(ls, 0);
+            break;
+        default:
+            if (key >= 32 && key < 256 && key != KEY_BACKSPACE) {
+                insert_char(ls, (char)key);
+            }
+            break;
+        }
+        refresh(ls);
+    }
+}
+
+/* Print the prompt and read with getline(): not a terminal */
+static ssize_t read_plain(const char *prompt, char **line, size_t *size)
+{
+    ssize_t len;
+
+    printf("%s", prompt);
+    fflush(stdout);
+    len = getline(line, size, stdin);
+    if (len > 0 && (*line)[len - 1] == '\n') {
+        (*line)[--len] = '\0';
+    }
+    return len;
+}
+
+int line_edit_terminal(void)
+{
+    const char *term = getenv("TERM");
+
+    return isatty(STDIN_FILENO) && isatty(STDOUT_FILENO) && !(term && strcmp(term, "dumb") == 0);
+}
+
+int line_edit_pending(void)
+{
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+
+    return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+}
+
+ssize_t line_edit_read(const char *prompt, char **line, size_t *size)
+{
+    struct termios orig;
+    struct termios raw;
+    line_state_t ls;
+    ssize_t len;
+
+    if (!line_edit_terminal() || tcgetattr(STDIN_FILENO, &orig) != 0) {
+        return read_plain(prompt, line, size);
+    }
+
+    raw = orig;
+    raw.c_iflag &= ~(tcflag_t)(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(tcflag_t)(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    fflush(stdout);
+    memset(&ls, 0, sizeof(ls));
+    ls.buf = *line;
+    ls.size = *size;
+    ls.prompt = prompt;
+    ls.hist_off = UINT64_MAX;
+    if (!ls.buf || ls.size == 0) {
+        ls.size = LINE_EDIT_INITIAL;
+        ls.buf = malloc(ls.size);
+        if (!ls.buf) {
+            return -1;
+        }
+        *line = ls.buf;
+        *size = ls.size;
+    }
+    ls.buf[0] = '\0';
+    if (tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) != 0) {
+        return read_plain(prompt, line, size);
+    }
+
+    len = edit(&ls);
+
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &orig);
+    free(ls.typed);
+    *line = ls.buf;
+    *size = ls.size;
+    return len;
+}
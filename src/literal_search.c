@@ -0,0 +1,559 @@
+/*
+ * literal_search.c - SIMD fixed-string search
+ *
+ * For each block of candidate start positions j, the kernels load the
+ * haystack at j + rare1 and j + rare2, compare both against the
+ * corresponding needle bytes and AND the results; a set bit is a
+ * position worth a full comparison. Picking rare bytes (instead of,
+ * say, the first and last) keeps those false candidates few.
+ *
+ * Case folding is ASCII only, as everywhere else in the shell (which
+ * runs in the C locale): a letter compares as (byte | 0x20), which is
+ * its lower-case form and matches no other byte.
+ *
+ * Byte counting adds the compare results (-1 per hit) into per-lane
+ * byte counters, emptied every 255 blocks before they can overflow.
+ * Finding either of two bytes ORs two compares and stops at the first
+ * block with a bit set.
+ */
+
+#include "literal_search.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define HAVE_NEON_KERNEL 1
+#endif
+
+static int is_alpha(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static unsigned char fold(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c | 0x20) : c;
+}
+
+/*
+ * How common a byte is in text and logs (higher = more common)
+ */
+static int byte_rank(unsigned char c, int icase)
+{
+    /* Lower-case letters, most frequent first */
+    static const char letters[] = "etaoinsrhldcumfpgwybvkxjqz";
+
+    if (c == ' ') {
+        return 255;
+    }
+    if (c >= 'a' && c <= 'z') {
+        return 250 - 4 * (int)(strchr(letters, c) - letters);
+    }
+    if (c >= 'A' && c <= 'Z') {
+        int rank = byte_rank((unsigned char)(c | 0x20), icase);
+
+        /* Folded, a capital is as common as the lower-case letter */
+        return icase ? rank : rank - 100;
+    }
+    if (c >= '0' && c <= '9') {
+        return 140;
+    }
+    if (strchr("\t,.-_/:=\"()", c)) {
+        return 120;
+    }
+    if (c >= 0x20 && c < 0x7f) {
+        return 60;
+    }
+    return 10;
+}
+
+/* Compare a candidate position with the whole needle */
+static int verify(const literal_search_t *ls, const unsigned char *p)
+{
+    if (!ls->icase) {
+        return memcmp(p, ls->needle, ls->len) == 0;
+    }
+    for (size_t i = 0; i < ls->len; i++) {
+        if (fold(p[i]) != ls->needle[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* OR mask that folds needle byte c for comparison */
+static unsigned char fold_mask(const literal_search_t *ls, unsigned char c)
+{
+    return (ls->icase && is_alpha(c)) ? 0x20 : 0;
+}
+
+/*
+ * Scalar search from start position j
+ *
+ * When the rarest byte compares exactly, memchr() finds the candidates.
+ */
+static const char *find_from(const literal_search_t *ls, const char *hay,
+                             size_t len, size_t j)
+{
+    const unsigned char *h = (const unsigned char *)hay;
+    unsigned char c1 = ls->needle[ls->rare1];
+    unsigned char m1 = fold_mask(ls, c1);
+    size_t last;
+
+    if (ls->len == 0) {
+        return hay;
+    }
+    if (len < ls->len) {
+        return NULL;
+    }
+    last = len - ls->len;   /* Last possible start */
+
+    if (m1 == 0) {
+        while (j <= last) {
+            const unsigned char *p = memchr(h + j + ls->rare1, c1, last - j + 1);
+
+            if (!p) {
+                return NULL;
+            }
+            j = (size_t)(p - h) - ls->rare1;
+            if (verify(ls, h + j)) {
+                return hay + j;
+            }
+            j++;
+        }
+        return NULL;
+    }
+
+    for (; j <= last; j++) {
+        if ((h[j + ls->rare1] | m1) == c1 && verify(ls, h + j)) {
+            return hay + j;
+        }
+    }
+    return NULL;
+}
+
+static const char *find_scalar(const literal_search_t *ls, const char *hay, size_t len)
+{
+    return find_from(ls, hay, len, 0);
+}
+
+static size_t count_from(const char *buf, size_t len, unsigned char c, size_t i)
+{
+    size_t total = 0;
+
+    for (; i < len; i++) {
+        total += (unsigned char)buf[i] == c;
+    }
+    return total;
+}
+
+static size_t count_scalar(const char *buf, size_t len, unsigned char c)
+{
+    const char *p = buf;
+    const char *end = buf + len;
+    size_t total = 0;
+
+    while ((p = memchr(p, c, (size_t)(end - p))) != NULL) {
+        total++;
+        p++;
+    }
+    return total;
+}
+
+static const char *either_from(const char *buf, size_t len, unsigned char a, unsigned char b,
+                               size_t i)
+{
+    for (; i < len; i++) {
+        unsigned char c = (unsigned char)buf[i];
+
+        if (c == a || c == b) {
+            return buf + i;
+        }
+    }
+    return NULL;
+}
+
+static const char *either_scalar(const char *buf, size_t len, unsigned char a, unsigned char b)
+{
+    return either_from(buf, len, a, b, 0);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+#ifdef __SSE2__
+static const char *find_sse2(const literal_search_t *ls, const char *hay, size_t len)
+{
+    const unsigned char *h = (const unsigned char *)hay;
+    size_t r1 = ls->rare1, r2 = ls->rare2;
+    size_t reach = (r1 > r2 ? r1 : r2) + 16;
+    unsigned char c1 = ls->needle[r1], c2 = ls->needle[r2];
+    const __m128i b1 = _mm_set1_epi8((char)c1);
+    const __m128i b2 = _mm_set1_epi8((char)c2);
+    const __m128i m1 = _mm_set1_epi8((char)fold_mask(ls, c1));
+    const __m128i m2 = _mm_set1_epi8((char)fold_mask(ls, c2));
+    size_t j = 0;
+
+    if (ls->len == 0 || len < ls->len) {
+        return find_from(ls, hay, len, 0);
+    }
+
+    for (; j + reach <= len; j += 16) {
+        __m128i v1 = _mm_or_si128(_mm_loadu_si128((const __m128i *)(h + j + r1)), m1);
+        __m128i v2 = _mm_or_si128(_mm_loadu_si128((const __m128i *)(h + j + r2)), m2);
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(v1, b1), _mm_cmpeq_epi8(v2, b2)));
+
+        while (mask) {
+            size_t k = j + (size_t)__builtin_ctz(mask);
+
+            if (k + ls->len <= len && verify(ls, h + k)) {
+                return hay + k;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    return find_from(ls, hay, len, j);
+}
+
+static size_t count_sse2(const char *buf, size_t len, unsigned char c)
+{
+    const __m128i b = _mm_set1_epi8((char)c);
+    const __m128i zero = _mm_setzero_si128();
+    size_t total = 0;
+    size_t i = 0;
+
+    while (i + 16 <= len) {
+        size_t stop = len - i > 255 * 16 ? i + 255 * 16 : len;
+        __m128i acc = zero;
+        __m128i sums;
+
+        for (; i + 16 <= stop; i += 16) {
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *)(buf + i)), b));
+        }
+        sums = _mm_sad_epu8(acc, zero);
+        total += (size_t)_mm_extract_epi16(sums, 0) + (size_t)_mm_extract_epi16(sums, 4);
+    }
+
+    return total + count_from(buf, len, c, i);
+}
+
+static const char *either_sse2(const char *buf, size_t len, unsigned char a, unsigned char b)
+{
+    const __m128i va = _mm_set1_epi8((char)a);
+    const __m128i vb = _mm_set1_epi8((char)b);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+
+        if (mask) {
+            return buf + i + __builtin_ctz(mask);
+        }
+    }
+
+    return either_from(buf, len, a, b, i);
+}
+#endif
+
+__attribute__((target("avx2")))
+static const char *find_avx2(const literal_search_t *ls, const char *hay, size_t len)
+{
+    const unsigned char *h = (const unsigned char *)hay;
+    size_t r1 = ls->rare1, r2 = ls->rare2;
+    size_t reach = (r1 > r2 ? r1 : r2) + 32;
+    unsigned char c1 = ls->needle[r1], c2 = ls->needle[r2];
+    const __m256i b1 = _mm256_set1_epi8((char)c1);
+    const __m256i b2 = _mm256_set1_epi8((char)c2);
+    const __m256i m1 = _mm256_set1_epi8((char)fold_mask(ls, c1));
+    const __m256i m2 = _mm256_set1_epi8((char)fold_mask(ls, c2));
+    size_t j = 0;
+
+    if (ls->len == 0 || len < ls->len) {
+        return find_from(ls, hay, len, 0);
+    }
+
+    for (; j + reach <= len; j += 32) {
+        __m256i v1 = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(h + j + r1)), m1);
+        __m256i v2 = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(h + j + r2)), m2);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(v1, b1), _mm256_cmpeq_epi8(v2, b2)));
+
+        while (mask) {
+            size_t k = j + (size_t)__builtin_ctz(mask);
+
+            if (k + ls->len <= len && verify(ls, h + k)) {
+                return hay + k;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    return find_from(ls, hay, len, j);
+}
+
+__attribute__((target("avx2")))
+static size_t count_avx2(const char *buf, size_t len, unsigned char c)
+{
+    const __m256i b = _mm256_set1_epi8((char)c);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t total = 0;
+    size_t i = 0;
+
+    while (i + 32 <= len) {
+        size_t stop = len - i > 255 * 32 ? i + 255 * 32 : len;
+        __m256i acc = zero;
+        uint64_t sums[4];
+
+        for (; i + 32 <= stop; i += 32) {
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(
+                _mm256_loadu_si256((const __m256i *)(buf + i)), b));
+        }
+        _mm256_storeu_si256((__m256i *)sums, _mm256_sad_epu8(acc, zero));
+        total += (size_t)(sums[0] + sums[1] + sums[2] + sums[3]);
+    }
+
+    return total + count_from(buf, len, c, i);
+}
+
+__attribute__((target("avx2")))
+static const char *either_avx2(const char *buf, size_t len, unsigned char a, unsigned char b)
+{
+    const __m256i va = _mm256_set1_epi8((char)a);
+    const __m256i vb = _mm256_set1_epi8((char)b);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+
+        if (mask) {
+            return buf + i + __builtin_ctz(mask);
+        }
+    }
+
+    return either_from(buf, len, a, b, i);
+}
+
+#endif /* HAVE_X86_KERNELS */
+
+#ifdef HAVE_NEON_KERNEL
+static const char *find_neon(const literal_search_t *ls, const char *hay, size_t len)
+{
+    const uint8_t *h = (const uint8_t *)hay;
+    size_t r1 = ls->rare1, r2 = ls->rare2;
+    size_t reach = (r1 > r2 ? r1 : r2) + 16;
+    unsigned char c1 = ls->needle[r1], c2 = ls->needle[r2];
+    const uint8x16_t b1 = vdupq_n_u8(c1);
+    const uint8x16_t b2 = vdupq_n_u8(c2);
+    const uint8x16_t m1 = vdupq_n_u8(fold_mask(ls, c1));
+    const uint8x16_t m2 = vdupq_n_u8(fold_mask(ls, c2));
+    size_t j = 0;
+
+    if (ls->len == 0 || len < ls->len) {
+        return find_from(ls, hay, len, 0);
+    }
+
+    for (; j + reach <= len; j += 16) {
+        uint8x16_t v1 = vorrq_u8(vld1q_u8(h + j + r1), m1);
+        uint8x16_t v2 = vorrq_u8(vld1q_u8(h + j + r2), m2);
+        uint8x16_t eq = vandq_u8(vceqq_u8(v1, b1), vceqq_u8(v2, b2));
+        /* No movemask on NEON: narrow to one nibble per byte */
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+            vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+
+        while (mask) {
+            int bit = __builtin_ctzll(mask);
+            size_t k = j + (size_t)(bit >> 2);
+
+            if (k + ls->len <= len && verify(ls, h + k)) {
+                return hay + k;
+            }
+            mask &= ~(0xfULL << (bit & ~3));
+        }
+    }
+
+    return find_from(ls, hay, len, j);
+}
+
+static size_t count_neon(const char *buf, size_t len, unsigned char c)
+{
+    const uint8x16_t b = vdupq_n_u8(c);
+    size_t total = 0;
+    size_t i = 0;
+
+    while (i + 16 <= len) {
+        size_t stop = len - i > 255 * 16 ? i + 255 * 16 : len;
+        uint8x16_t acc = vdupq_n_u8(0);
+
+        for (; i + 16 <= stop; i += 16) {
+            acc = vsubq_u8(acc, vceqq_u8(vld1q_u8((const uint8_t *)buf + i), b));
+        }
+        total += vaddlvq_u8(acc);
+    }
+
+    return total + count_from(buf, len, c, i);
+}
+
+static const char *either_neon(const char *buf, size_t len, unsigned char a, unsigned char b)
+{
+    const uint8x16_t va = vdupq_n_u8(a);
+    const uint8x16_t vb = vdupq_n_u8(b);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)buf + i);
+        uint8x16_t eq = vorrq_u8(vceqq_u8(v, va), vceqq_u8(v, vb));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+            vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+
+        if (mask) {
+            return buf + i + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+
+    return either_from(buf, len, a, b, i);
+}
+#endif /* HAVE_NEON_KERNEL */
+
+static const struct {
+    const char *name;
+    const char *(*find)(const literal_search_t *, const char *, size_t);
+    size_t (*count)(const char *, size_t, unsigned char);
+    const char *(*either)(const char *, size_t, unsigned char, unsigned char);
+} kernels[] = {
+#ifdef HAVE_X86_KERNELS
+    { "avx2", find_avx2, count_avx2, either_avx2 },
+#ifdef __SSE2__
+    { "sse2", find_sse2, count_sse2, either_sse2 },
+#endif
+#endif
+#ifdef HAVE_NEON_KERNEL
+    { "neon", find_neon, count_neon, either_neon },
+#endif
+    { "scalar", find_scalar, count_scalar, either_scalar }
+};
+
+#define NKERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static int kernel_supported(size_t i)
+{
+#ifdef HAVE_X86_KERNELS
+    if (kernels[i].find == find_avx2) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    (void)i;
+    return 1;
+}
+
+/* Best supported kernel, or the one named by PICOBOX_SIMD */
+static size_t pick_kernel(void)
+{
+    const char *want = getenv("PICOBOX_SIMD");
+
+    if (want && want[0]) {
+        for (size_t i = 0; i < NKERNELS; i++) {
+            if (strcmp(kernels[i].name, want) == 0 && kernel_supported(i)) {
+                return i;
+            }
+        }
+    }
+    for (size_t i = 0; i < NKERNELS; i++) {
+        if (kernel_supported(i)) {
+            return i;
+        }
+    }
+    return NKERNELS - 1;
+}
+
+static size_t (*count_kernel)(const char *, size_t, unsigned char);
+static const char *(*either_kernel)(const char *, size_t, unsigned char, unsigned char);
+static pthread_once_t byte_once = PTHREAD_ONCE_INIT;
+
+static void pick_byte_kernels(void)
+{
+    size_t k = pick_kernel();
+
+    count_kernel = kernels[k].count;
+    either_kernel = kernels[k].either;
+}
+
+size_t literal_count_byte(const char *buf, size_t len, unsigned char c)
+{
+    pthread_once(&byte_once, pick_byte_kernels);
+    return count_kernel(buf, len, c);
+}
+
+const char *literal_find_either(const char *buf, size_t len, unsigned char a, unsigned char b)
+{
+    pthread_once(&byte_once, pick_byte_kernels);
+    return either_kernel(buf, len, a, b);
+}
+
+int literal_search_init(literal_search_t *ls, const char *needle, size_t len, int icase)
+{
+    int best = 256, second = 256;
+
+    memset(ls, 0, sizeof(*ls));
+    ls->needle = malloc(len + 1);
+    if (!ls->needle) {
+        return -1;
+    }
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)needle[i];
+
+        ls->needle[i] = icase ? fold(c) : c;
+    }
+    ls->needle[len] = '\0';
+    ls->len = len;
+    ls->icase = icase;
+
+    /* Two rarest positions (the same one for a single byte) */
+    for (size_t i = 0; i < len; i++) {
+        int rank = byte_rank(ls->needle[i], icase);
+
+        if (rank < best) {
+            second = best;
+            ls->rare2 = ls->rare1;
+            best = rank;
+            ls->rare1 = i;
+        } else if (rank < second) {
+            second = rank;
+            ls->rare2 = i;
+        }
+    }
+    if (len < 2) {
+        ls->rare2 = ls->rare1;
+    }
+
+    ls->find = kernels[pick_kernel()].find;
+    return 0;
+}
+
+const char *literal_search_kernel(const literal_search_t *ls)
+{
+    for (size_t i = 0; i < NKERNELS; i++) {
+        if (kernels[i].find == ls->find) {
+            return kernels[i].name;
+        }
+    }
+    return "scalar";
+}
+
+void literal_search_free(literal_search_t *ls)
+{
+    free(ls->needle);
+    ls->needle = NULL;
+}
@@ -0,0 +1,263 @@
+/*
+ * literal_set.c - Aho-Corasick multi-string search
+ *
+ * Built in two passes over a dense table of nstates x nclasses entries:
+ * the strings are inserted as a trie (0 marks a missing edge, since no
+ * trie edge leads back to the root), then a breadth-first walk sets each
+ * state's failure link and replaces every missing edge with the edge
+ * its failure state takes. The result is a DFA. Entries hold the target
+ * state already multiplied by nclasses, with LITERAL_SET_HIT set when
+ * the target (or anything on its failure chain) ends a string, so the
+ * scan loop is one load, one add and one test per byte.
+ *
+ * The skip search looks at windows of minlen bytes. skip[c] is how far
+ * the window can move when its last byte is c without stepping over a
+ * place where c sits inside some string's first minlen bytes; 0 means
+ * c ends such a prefix, and a string may start at the window. That is
+ * checked by following trie edges (LITERAL_SET_TRIE) from the root
+ * until one is missing or a whole string (LITERAL_SET_END) is found.
+ * Windows are tried left to right, so the match found starts first.
+ */
+
+#include "literal_set.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define STATE_MASK (~(LITERAL_SET_HIT | LITERAL_SET_TRIE | LITERAL_SET_END))
+
+/* Below this the scan is faster than skipping */
+#define LITERAL_SET_MIN_SKIP 4
+
+static unsigned char fold(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c | 0x20) : c;
+}
+
+/* Column 0 is for bytes in no string; the others are numbered as seen */
+static void build_classes(literal_set_t *ls, const char *const *strings, const size_t *lens,
+                          size_t n, int icase)
+{
+    memset(ls->classmap, 0, sizeof(ls->classmap));
+    ls->nclasses = 1;
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < lens[i]; j++) {
+            unsigned char c = (unsigned char)strings[i][j];
+
+            if (icase) {
+                c = fold(c);
+            }
+            if (ls->classmap[c] == 0) {
+                ls->classmap[c] = (unsigned char)ls->nclasses++;
+            }
+        }
+    }
+
+    if (icase) {
+        for (int c = 'a'; c <= 'z'; c++) {
+            ls->classmap[c - 'a' + 'A'] = ls->classmap[c];
+        }
+    }
+}
+
+int literal_set_init(literal_set_t *ls, const char *const *strings, const size_t *lens,
+                     size_t n, int icase)
+{
+    size_t total = 1;
+    uint32_t nc;
+    uint32_t *fail = NULL;
+    uint32_t *queue = NULL;
+    unsigned char *hit = NULL;
+    unsigned char *end = NULL;
+    uint32_t skip[256];
+    size_t head = 0, tail = 0;
+
+    memset(ls, 0, sizeof(*ls));
+    build_classes(ls, strings, lens, n, icase);
+    nc = ls->nclasses;
+
+    for (size_t i = 0; i < n; i++) {
+        total += lens[i];
+        if (lens[i] == 0) {
+            ls->has_empty = 1;
+        }
+        if (i == 0 || lens[i] < ls->minlen) {
+            ls->minlen = lens[i];
+        }
+    }
+    if (total > STATE_MASK / nc) {
+        return -1;
+    }
+
+    ls->trans = calloc(total * nc, sizeof(uint32_t));
+    hit = calloc(total, 1);
+    end = calloc(total, 1);
+    if (!ls->trans || !hit || !end) {
+        goto fail;
+    }
+
+    /* Trie */
+    ls->nstates = 1;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t s = 0;
+
+        for (size_t j = 0; j < lens[i]; j++) {
+            uint32_t *edge = &ls->trans[s * nc + ls->classmap[(unsigned char)strings[i][j]]];
+
+            if (*edge == 0) {
+                *edge = ls->nstates++;
+            }
+            s = *edge;
+        }
+        end[s] = 1;
+    }
+
+    /* Failure links, breadth first so a state's link is done before it */
+    fail = calloc(ls->nstates, sizeof(uint32_t));
+    queue = malloc(ls->nstates * sizeof(uint32_t));
+    if (!fail || !queue) {
+        goto fail;
+    }
+    queue[tail++] = 0;
+    while (head < tail) {
+        uint32_t s = queue[head++];
+
+        for (uint32_t k = 0; k < nc; k++) {
+            uint32_t *edge = &ls->trans[s * nc + k];
+            uint32_t via_fail = s == 0 ? 0 : ls->trans[fail[s] * nc + k] & STATE_MASK;
+
+            if (*edge == 0) {
+                *edge = via_fail;
+                continue;
+            }
+            fail[*edge] = via_fail;
+            hit[*edge] = end[*edge] | hit[via_fail];
+            queue[tail++] = *edge;
+            *edge |= LITERAL_SET_TRIE;
+        }
+    }
+
+    /* Premultiply and flag the entries that complete a string */
+    for (size_t e = 0; e < (size_t)ls->nstates * nc; e++) {
+        uint32_t t = ls->trans[e] & STATE_MASK;
+
+        ls->trans[e] = t * nc | (ls->trans[e] & LITERAL_SET_TRIE) |
+                       (hit[t] ? LITERAL_SET_HIT : 0) | (end[t] ? LITERAL_SET_END : 0);
+    }
+
+    /* Skip distances, per class and then per byte */
+    if (ls->minlen >= LITERAL_SET_MIN_SKIP) {
+        for (uint32_t k = 0; k < nc; k++) {
+            skip[k] = (uint32_t)ls->minlen;
+        }
+        for (size_t i = 0; i < n; i++) {
+            for (size_t q = 0; q < ls->minlen; q++) {
+                unsigned char k = ls->classmap[(unsigned char)strings[i][q]];
+
+                if (ls->minlen - 1 - q < skip[k]) {
+                    skip[k] = (uint32_t)(ls->minlen - 1 - q);
+                }
+            }
+        }
+        for (int c = 0; c < 256; c++) {
+            ls->skip[c] = skip[ls->classmap[c]];
+        }
+    }
+
+    if (ls->nstates < total) {
+        uint32_t *shrunk = realloc(ls->trans, (size_t)ls->nstates * nc * sizeof(uint32_t));
+
+        if (shrunk) {
+            ls->trans = shrunk;
+        }
+    }
+
+    free(fail);
+    free(queue);
+    free(hit);
+    free(end);
+    return 0;
+
+fail:
+    free(fail);
+    free(queue);
+    free(hit);
+    free(end);
+    literal_set_free(ls);
+    return -1;
+}
+
+/* Does one of the strings start at p? */
+static int starts_here(const literal_set_t *ls, const unsigned char *p, size_t len)
+{
+    uint32_t s = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        uint32_t t = ls->trans[s + ls->classmap[p[i]]];
+
+        if (!(t & LITERAL_SET_TRIE)) {
+            return 0;
+        }
+        if (t & LITERAL_SET_END) {
+            return 1;
+        }
+        s = t & STATE_MASK;
+    }
+    return 0;
+}
+
+static const char *find_skip(const literal_set_t *ls, const char *hay, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)hay;
+    const size_t m = ls->minlen;
+    size_t e = m - 1;
+
+    while (e < len) {
+        uint32_t shift = ls->skip[p[e]];
+
+        if (shift) {
+            e += shift;
+            continue;
+        }
+        if (starts_here(ls, p + e - (m - 1), len - (e - (m - 1)))) {
+            return hay + e - (m - 1);
+        }
+        e++;
+    }
+    return NULL;
+}
+
+const char *literal_set_find(const literal_set_t *ls, const char *hay, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)hay;
+    const uint32_t *trans = ls->trans;
+    uint32_t s = 0;
+
+    if (ls->has_empty) {
+        return hay;
+    }
+    if (ls->nstates <= 1) {
+        return NULL;
+    }
+    if (ls->minlen >= LITERAL_SET_MIN_SKIP) {
+        return find_skip(ls, hay, len);
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        uint32_t t = trans[s + ls->classmap[p[i]]];
+
+        if (t & LITERAL_SET_HIT) {
+            return hay + i;
+        }
+        s = t & STATE_MASK;
+    }
+    return NULL;
+}
+
+void literal_set_free(literal_set_t *ls)
+{
+    free(ls->trans);
+    ls->trans = NULL;
+    ls->nstates = 0;
+}
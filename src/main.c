@@ -1,214 +1,50 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* setenv() */
+#endif
+
 #include "picobox.h"
 #include "cmd_spec.h"
 #include "utils.h"
+#include "serve.h"
+#include "trace.h"
+#include "io_stats.h"
+#include "time_stats.h"
+#include "command_catalog.h"
 #include <string.h>
 #include <libgen.h>
-
-/* External declarations for refactored commands */
-extern void register_echo_command(void);
-extern void register_pwd_command(void);
-extern void register_true_command(void);
-extern void register_false_command(void);
-extern void register_basename_command(void);
-extern void register_dirname_command(void);
-extern void register_sleep_command(void);
-extern void register_env_command(void);
-extern void register_cat_command(void);
-extern void register_wc_command(void);
-extern void register_head_command(void);
-extern void register_tail_command(void);
-extern void register_touch_command(void);
-extern void register_mkdir_command(void);
-extern void register_cp_command(void);
-extern void register_mv_command(void);
-extern void register_rm_command(void);
-extern void register_ln_command(void);
-extern void register_chmod_command(void);
-extern void register_stat_command(void);
-extern void register_df_command(void);
-extern void register_du_command(void);
-extern void register_grep_command(void);
-extern void register_find_command(void);
-extern void register_ls_command(void);
-extern void register_pkg_command(void);
-extern void register_ai_command(void);
-
-/* Initialize command registry */
-static void init_commands(void)
-{
-    register_echo_command();
-    register_pwd_command();
-    register_true_command();
-    register_false_command();
-    register_basename_command();
-    register_dirname_command();
-    register_sleep_command();
-    register_env_command();
-    register_cat_command();
-    register_wc_command();
-    register_head_command();
-    register_tail_command();
-    register_touch_command();
-    register_mkdir_command();
-    register_cp_command();
-    register_mv_command();
-    register_rm_command();
-    register_ln_command();
-    register_chmod_command();
-    register_stat_command();
-    register_df_command();
-    register_du_command();
-    register_grep_command();
-    register_find_command();
-    register_ls_command();
-    register_pkg_command();
-    register_ai_command();
-}
-
-/*
- * Command dispatch table
- * Maps command names to their implementation functions, simple by assigning the adress of
- * a function to the function ptr cmd_func_t cmd_func using the main c params all functions follow
- * same format so this is possible
- */
-const struct command commands[] = {
-    /* Day 2-3: First 5 commands */
-    {"echo", cmd_echo},
-    {"pwd", cmd_pwd},
-    {"cat", cmd_cat},
-    {"mkdir", cmd_mkdir},
-    {"touch", cmd_touch},
-
-    /* Day 4-5: File operations */
-    {"ls", cmd_ls},
-    {"cp", cmd_cp},
-    {"rm", cmd_rm},
-    {"mv", cmd_mv},
-
-    /* Day 6-7: Text processing */
-    {"head", cmd_head},
-    {"tail", cmd_tail},
-    {"wc", cmd_wc},
-    {"ln", cmd_ln},
-
-    /* Day 8-9: Search utilities */
-    {"grep", cmd_grep},
-    {"find", cmd_find},
-    {"basename", cmd_basename},
-    {"dirname", cmd_dirname},
-
-    /* Day 10-11: File permissions & system info */
-    {"chmod", cmd_chmod},
-    {"stat", cmd_stat},
-    {"du", cmd_du},
-    {"df", cmd_df},
-
-    /* Day 12-13: Process & environment */
-    {"env", cmd_env},
-    {"sleep", cmd_sleep},
-    {"true", cmd_true},
-    {"false", cmd_false},
-
-    /* Package manager */
-    {"pkg", cmd_pkg},
-
-    /* Sentinel - end of array */
-    {NULL, NULL}
-};
+#include <sys/stat.h>
 
 /*
- * All 25 commands are now implemented in separate cmd_*.c files!
- */
-
-/*
- * Find command by name in the OLD dispatch table
- * NOTE: This is the legacy lookup. New refactored commands use the registry.
+ * Print all commands in JSON format for AI helper
+ * (format in command_catalog.h)
  */
-static cmd_func_t find_legacy_command(const char *name)
+static int print_commands_json(void)
 {
-    for (int i = 0; commands[i].name != NULL; i++) {
-        if (strcmp(commands[i].name, name) == 0) {
-            return commands[i].func;
-        }
+    size_t len;
+    const char *json = command_catalog_json(&len);
+
+    if (!json || fwrite(json, 1, len, stdout) != len) {
+        fprintf(stderr, "picobox: cannot write the command catalog\n");
+        return EXIT_ERROR;
     }
-    return NULL;
+    return EXIT_OK;
 }
 
 /*
- * Print all commands in JSON format for AI helper
- *
- * Output format:
- * {
- *   "commands": [
- *     {
- *       "name": "echo",
- *       "summary": "print text to stdout",
- *       "description": "Echo the STRING(s) to standard output...",
- *       "usage": "echo [OPTION]... [STRING]..."
- *     },
- *     ...
- *   ]
- * }
+ * Is this argument a script to run (picobox FILE)?
+ * Command names win: only called when no command has this name.
  */
-static void print_commands_json(void)
+static int is_script_file(const char *path)
 {
-    int first = 1;
-
-    printf("{\n");
-    printf("  \"commands\": [\n");
-
-    /* Iterate through command dispatch table */
-    for (int i = 0; commands[i].name != NULL; i++) {
-        /* Add comma before all but first command */
-        if (!first) {
-            printf(",\n");
-        }
-        first = 0;
-
-        printf("    {\n");
-        printf("      \"name\": \"%s\",\n", commands[i].name);
-
-        /* Get command spec from registry for detailed info */
-        const cmd_spec_t *spec = find_command(commands[i].name);
-
-        if (spec) {
-            /* Use detailed info from spec */
-            printf("      \"summary\": \"%s\",\n",
-                   spec->summary ? spec->summary : "");
-
-            /* Escape quotes and newlines in description */
-            if (spec->long_help) {
-                printf("      \"description\": \"");
-                for (const char *p = spec->long_help; *p; p++) {
-                    if (*p == '"' || *p == '\\') {
-                        putchar('\\');
-                    }
-                    if (*p == '\n') {
-                        printf("\\n");
-                    } else {
-                        putchar(*p);
-                    }
-                }
-                printf("\",\n");
-            } else {
-                printf("      \"description\": \"\",\n");
-            }
-
-            /* Usage string */
-            printf("      \"usage\": \"%s [OPTIONS]...\"\n", commands[i].name);
-        } else {
-            /* Fallback if no spec found */
-            printf("      \"summary\": \"Unix utility\",\n");
-            printf("      \"description\": \"See '%s --help' for details\",\n",
-                   commands[i].name);
-            printf("      \"usage\": \"%s [OPTIONS]...\"\n", commands[i].name);
-        }
-
-        printf("    }");
-    }
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
 
-    printf("\n  ]\n");
-    printf("}\n");
+/* for_each_command() callback for the usage listing */
+static void print_command_name(const cmd_spec_t *spec, void *userdata)
+{
+    (void)userdata;
+    printf("  %s\n", spec->name);
 }
 
 /*
@@ -218,16 +54,50 @@ static void print_usage(void)
 {
     printf("PicoBox v%s - BusyBox-style Unix utilities\n\n", PICOBOX_VERSION);
     printf("Usage: picobox <command> [arguments...]\n");
-    printf("   or: <command> [arguments...]  (when invoked via symlink)\n\n");
+    printf("   or: <command> [arguments...]  (when invoked via symlink)\n");
+    printf("   or: picobox -c STRING         (run shell commands, no prompt)\n");
+    printf("   or: picobox SCRIPT            (run a shell script file)\n");
+    printf("   or: picobox --serve [SOCKET]  (serve commands to picobox-client)\n");
+    printf("   or: picobox --stats ...       (report I/O and allocations per command)\n\n");
     printf("Available commands:\n");
 
-    for (int i = 0; commands[i].name != NULL; i++) {
-        printf("  %s\n", commands[i].name);
-    }
+    for_each_command(print_command_name, NULL);
 
     printf("\nFor help on a specific command, use: <command> --help\n");
 }
 
+/*
+ * Run a command and print its stats line (PICOBOX_STATS)
+ */
+static int run_with_stats(const cmd_spec_t *spec, int argc, char **argv)
+{
+    char command[256];
+    size_t len = 0;
+    time_mark_t mark;
+    time_stats_t times;
+    io_stats_t io_mark;
+    io_stats_t io;
+    int status;
+
+    command[0] = '\0';
+    for (int i = 0; i < argc && len < sizeof(command) - 1; i++) {
+        int n = snprintf(command + len, sizeof(command) - len, "%s%s", i ? " " : "", argv[i]);
+
+        len = n < 0 ? len : len + (size_t)n;
+    }
+
+    fflush(stdout);
+    time_stats_begin(&mark);
+    io_stats_begin(&io_mark);
+    status = spec->run(argc, argv);
+    fflush(stdout);
+    io_stats_end(&io_mark, &io);
+    time_stats_end(&mark, &times);
+
+    io_stats_print(stderr, command, &io, times.real_ms);
+    return status;
+}
+
 /*
  * Main entry point
  * Determines which command to run based on argv[0]
@@ -236,15 +106,29 @@ int main(int argc, char **argv)
 {
     char *program_name;
     char *command_name;
-    cmd_func_t cmd_func;
+    const cmd_spec_t *spec;
 
-    /* Initialize command registry */
-    init_commands();
+    /* Built-in commands: a table generated at build time, nothing to register */
+    register_command_table(builtin_commands, builtin_command_count);
+    trace_init();
+
+    /* picobox --stats ...: every command reports, here and in the picobox processes it starts */
+    if (argc >= 2 && strcmp(argv[1], "--stats") == 0) {
+        setenv("PICOBOX_STATS", "1", 1);
+        argv[1] = argv[0];
+        argc--;
+        argv++;
+    }
+    io_stats_init();
 
     /* Handle --commands-json flag for AI integration */
     if (argc >= 2 && strcmp(argv[1], "--commands-json") == 0) {
-        print_commands_json();
-        return EXIT_OK;
+        return print_commands_json();
+    }
+
+    /* Handle --serve flag (resident server for picobox-client) */
+    if (argc >= 2 && strcmp(argv[1], "--serve") == 0) {
+        return serve_main(argc > 2 ? argv[2] : NULL);
     }
 
     /* Handle empty arguments */
@@ -278,6 +162,20 @@ int main(int argc, char **argv)
             return EXIT_OK;
         }
 
+        /* Batch mode: picobox -c STRING */
+        if (strcmp(command_name, "-c") == 0) {
+            if (argc < 3) {
+                fprintf(stderr, "picobox: -c: option requires an argument\n");
+                return 2;
+            }
+            return shell_bnfc_run_string(argv[2]);
+        }
+
+        /* Batch mode: picobox SCRIPT */
+        if (find_command(command_name) == NULL && is_script_file(command_name)) {
+            return shell_bnfc_run_file(command_name);
+        }
+
         /* Shift arguments so command sees itself as argv[0] */
         argc--;
         argv++;
@@ -287,13 +185,16 @@ int main(int argc, char **argv)
     }
 
     /* Find and execute the command */
-    cmd_func = find_legacy_command(command_name);
-    if (cmd_func == NULL) {
+    spec = find_command(command_name);
+    if (spec == NULL || spec->run == NULL) {
         fprintf(stderr, "picobox: unknown command '%s'\n", command_name);
         fprintf(stderr, "Try 'picobox --help' for a list of available commands.\n");
         return EXIT_ERROR;
     }
 
     /* Execute the command - NEVER use exit() inside commands, always return */
-    return cmd_func(argc, argv);
+    if (io_stats_on) {
+        return run_with_stats(spec, argc, argv);
+    }
+    return spec->run(argc, argv);
 }
@@ -0,0 +1,160 @@
+/*
+ * path_cache.c - Cached PATH lookup for external commands
+ *
+ * Works like bash's `hash`: the first time a command is run its full
+ * path is found by scanning PATH, and later runs reuse the result instead
+ * of letting execvp() stat every PATH entry again. On slow (e.g. NFS)
+ * PATH entries this search is a noticeable part of every launch.
+ *
+ * The cache is a var_table_t mapping command name -> resolved path.
+ * It is dropped whenever the PATH value changes, and single entries are
+ * dropped when executing the remembered path fails.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* strdup() */
+#endif
+
+#include "path_cache.h"
+#include "var_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Search path used when PATH is unset (same as execvp's default) */
+#define DEFAULT_PATH "/bin:/usr/bin"
+
+static var_table_t *cache = NULL;
+static char *cache_path_env = NULL;  /* PATH value the cache was built for */
+
+/*
+ * Make sure the cache exists and matches the current PATH
+ */
+static int cache_sync(const char *path_env)
+{
+    if (cache && cache_path_env && strcmp(cache_path_env, path_env) == 0) {
+        return 0;
+    }
+
+    path_cache_clear();
+
+    cache = var_table_create(64);
+    cache_path_env = strdup(path_env);
+    if (!cache || !cache_path_env) {
+        path_cache_clear();
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Check if path is an executable regular file
+ */
+static int is_executable(const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+
+    return access(path, X_OK) == 0;
+}
+
+const char *path_cache_lookup(const char *name)
+{
+    const char *path_env;
+    const char *dir;
+    const char *hit;
+    size_t name_len;
+
+    if (!name || name[0] == '\0') {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    /* Explicit paths are never searched */
+    if (strchr(name, '/')) {
+        return name;
+    }
+
+    path_env = getenv("PATH");
+    if (!path_env) {
+        path_env = DEFAULT_PATH;
+    }
+
+    if (cache_sync(path_env) != 0) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    hit = var_table_get(cache, name);
+    if (hit) {
+        return hit;
+    }
+
+    /* Scan PATH entries in order; an empty entry means "." */
+    name_len = strlen(name);
+    dir = path_env;
+    while (1) {
+        const char *end = strchr(dir, ':');
+        size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+        char full[4096];
+
+        if (dir_len == 0) {
+            snprintf(full, sizeof(full), "./%s", name);
+        } else if (dir_len + 1 + name_len < sizeof(full)) {
+            memcpy(full, dir, dir_len);
+            full[dir_len] = '/';
+            memcpy(full + dir_len + 1, name, name_len + 1);
+        } else {
+            full[0] = '\0';
+        }
+
+        if (full[0] != '\0' && is_executable(full)) {
+            if (var_table_set(cache, name, full) != 0) {
+                errno = ENOMEM;
+                return NULL;
+            }
+            return var_table_get(cache, name);
+        }
+
+        if (!end) {
+            break;
+        }
+        dir = end + 1;
+    }
+
+    /* Misses are not remembered: the command may show up later */
+    errno = ENOENT;
+    return NULL;
+}
+
+void path_cache_forget(const char *name)
+{
+    if (cache && name) {
+        var_table_unset(cache, name);
+    }
+}
+
+void path_cache_clear(void)
+{
+    var_table_destroy(cache);
+    cache = NULL;
+
+    free(cache_path_env);
+    cache_path_env = NULL;
+}
+
+void path_cache_foreach(void (*callback)(const char *name, const char *path, void *userdata),
+                        void *userdata)
+{
+    if (cache) {
+        var_table_foreach(cache, callback, userdata);
+    }
+}
@@ -0,0 +1,274 @@
+/*
+ * pb_out.c - Buffered command output
+ *
+ * One buffer per writer. Direct output to a descriptor uses writev()
+ * with up to two pieces (the buffer and the caller's data) and loops
+ * over short writes; stdio output is fwrite(); memory output grows the
+ * buffer by doubling.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* fileno() */
+#endif
+
+#include "pb_out.h"
+#include "utils.h"
+#include "io_stats.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+/* Buffer size: what is written out at a time */
+#define PB_OUT_SIZE (64 * 1024)
+
+int pb_out_init(pb_out_t *o, FILE *fp)
+{
+    memset(o, 0, sizeof(*o));
+    o->fp = fp;
+    o->fd = -1;
+    if (fp) {
+        fflush(fp);
+        o->fd = fileno(fp);
+    }
+    o->cap = PB_OUT_SIZE;
+    o->buf = malloc(o->cap);
+    if (!o->buf) {
+        o->cap = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Write iov[0..n) to the descriptor in full
+ * Returns: 0, or -1 with o->error set
+ */
+static int pb_out_writev(pb_out_t *o, struct iovec *iov, int n)
+{
+    while (n > 0) {
+        ssize_t w = writev(o->fd, iov, n);
+
+        IO_STATS_WRITE(w);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            o->error = errno;
+            return -1;
+        }
+        while (n > 0 && (size_t)w >= iov->iov_len) {
+            w -= (ssize_t)iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= (size_t)w;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Write out the buffer followed by data[0..len) (which may be empty)
+ */
+static void pb_out_emit(pb_out_t *o, const void *data, size_t len)
+{
+    if (o->error) {
+        o->len = 0;
+        return;
+    }
+
+    if (o->fd >= 0) {
+        struct iovec iov[2];
+        int n = 0;
+
+        if (o->len > 0) {
+            iov[n].iov_base = o->buf;
+            iov[n++].iov_len = o->len;
+        }
+        if (len > 0) {
+            iov[n].iov_base = (void *)data;
+            iov[n++].iov_len = len;
+        }
+        pb_out_writev(o, iov, n);
+    } else {
+        if ((o->len > 0 && fwrite(o->buf, 1, o->len, o->fp) != o->len) ||
+            (len > 0 && fwrite(data, 1, len, o->fp) != len)) {
+            o->error = errno ? errno : EIO;
+        }
+    }
+    o->len = 0;
+}
+
+/* Memory writer: grow to hold n more bytes */
+static int pb_out_grow(pb_out_t *o, size_t n)
+{
+    size_t cap = o->cap ? o->cap : PB_OUT_SIZE;
+    char *bigger;
+
+    while (cap - o->len < n) {
+        cap *= 2;
+    }
+    bigger = realloc(o->buf, cap);
+    if (!bigger) {
+        o->error = ENOMEM;
+        return -1;
+    }
+    o->buf = bigger;
+    o->cap = cap;
+    return 0;
+}
+
+void pb_out_reserve(pb_out_t *o, size_t n)
+{
+    if (o->cap - o->len >= n) {
+        return;
+    }
+    if (o->fp) {
+        pb_out_emit(o, NULL, 0);
+    } else {
+        pb_out_grow(o, n);
+    }
+}
+
+void pb_out_write(pb_out_t *o, const void *data, size_t len)
+{
+    if (o->cap - o->len >= len) {
+        memcpy(o->buf + o->len, data, len);
+        o->len += len;
+        return;
+    }
+
+    if (!o->fp) {
+        if (pb_out_grow(o, len) == 0) {
+            memcpy(o->buf + o->len, data, len);
+            o->len += len;
+        }
+        return;
+    }
+
+    /* Buffer is full: send it, with data along if data is large */
+    if (len >= o->cap / 2) {
+        pb_out_emit(o, data, len);
+        return;
+    }
+    pb_out_emit(o, NULL, 0);
+    if (o->cap >= len) {
+        memcpy(o->buf, data, len);
+        o->len = len;
+    }
+}
+
+void pb_out_str(pb_out_t *o, const char *s)
+{
+    pb_out_write(o, s, strlen(s));
+}
+
+static void pb_out_spaces(pb_out_t *o, size_t n)
+{
+    while (n > 0) {
+        size_t chunk = n < 64 ? n : 64;
+
+        pb_out_reserve(o, chunk);
+        if (o->cap - o->len < chunk) {
+            return;
+        }
+        memset(o->buf + o->len, ' ', chunk);
+        o->len += chunk;
+        n -= chunk;
+    }
+}
+
+void pb_out_pad(pb_out_t *o, const char *s, int width)
+{
+    size_t len = strlen(s);
+    size_t w = (size_t)(width < 0 ? -width : width);
+    size_t fill = w > len ? w - len : 0;
+
+    if (width > 0) {
+        pb_out_spaces(o, fill);
+    }
+    pb_out_write(o, s, len);
+    if (width < 0) {
+        pb_out_spaces(o, fill);
+    }
+}
+
+/* Digits of v, written backwards ending at end; returns the first */
+static char *pb_out_digits(char *end, uintmax_t v)
+{
+    char *p = end;
+
+    do {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    return p;
+}
+
+void pb_out_uint(pb_out_t *o, uintmax_t v, int width)
+{
+    char tmp[24];
+    char *p = pb_out_digits(tmp + sizeof(tmp), v);
+    size_t len = (size_t)(tmp + sizeof(tmp) - p);
+
+    if (width > 0 && (size_t)width > len) {
+        pb_out_spaces(o, (size_t)width - len);
+    }
+    pb_out_write(o, p, len);
+}
+
+void pb_out_int(pb_out_t *o, intmax_t v, int width)
+{
+    char tmp[24];
+    uintmax_t mag = v < 0 ? -(uintmax_t)v : (uintmax_t)v;
+    char *p = pb_out_digits(tmp + sizeof(tmp), mag);
+    size_t len;
+
+    if (v < 0) {
+        *--p = '-';
+    }
+    len = (size_t)(tmp + sizeof(tmp) - p);
+    if (width > 0 && (size_t)width > len) {
+        pb_out_spaces(o, (size_t)width - len);
+    }
+    pb_out_write(o, p, len);
+}
+
+void pb_out_size(pb_out_t *o, off_t size, int width)
+{
+    char tmp[32];
+
+    pb_out_pad(o, format_size(size, tmp, sizeof(tmp)), width);
+}
+
+int pb_out_flush(pb_out_t *o)
+{
+    if (o->fp) {
+        pb_out_emit(o, NULL, 0);
+        if (o->fd < 0 && !o->error && fflush(o->fp) != 0) {
+            o->error = errno ? errno : EIO;
+        }
+    }
+    if (o->error) {
+        errno = o->error;
+        return -1;
+    }
+    return 0;
+}
+
+int pb_out_close(pb_out_t *o)
+{
+    int ret = pb_out_flush(o);
+    int saved = errno;
+
+    free(o->buf);
+    o->buf = NULL;
+    o->len = o->cap = 0;
+    errno = saved;
+    return ret;
+}
@@ -0,0 +1,188 @@
+/*
+ * picobox_client.c - Minimal client for the resident picobox server
+ *
+ * Usage: picobox-client COMMAND [ARGS...]
+ *    or: COMMAND [ARGS...]   (when invoked via a symlink named COMMAND)
+ *
+ * Sends argv, the current directory, the environment and our stdin,
+ * stdout and stderr to `picobox --serve` (protocol in serve.h) and
+ * exits with the command's status. Links against libc only, so its own
+ * startup stays cheap. If no server is listening, it execs
+ * `picobox COMMAND ARGS...` instead.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* stpcpy() and PATH_MAX */
+#endif
+
+#include "serve.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <libgen.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+extern char **environ;
+
+/* Write all of buf; returns 0, or -1 on error */
+static int write_full(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int connect_server(void)
+{
+    struct sockaddr_un addr = {0};
+    int fd;
+
+    addr.sun_family = AF_UNIX;
+    serve_socket_path(addr.sun_path, sizeof(addr.sun_path));
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Send the header with fds 0-2 attached */
+static int send_header(int fd, const serve_request_t *req)
+{
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+    } control;
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    struct iovec iov = { (void *)req, sizeof(*req) };
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    return sendmsg(fd, &msg, 0) == (ssize_t)sizeof(*req) ? 0 : -1;
+}
+
+/*
+ * Run argv through the server
+ * Returns: the command's exit status, or -1 if there is no server
+ */
+static int run_remote(int argc, char **argv)
+{
+    serve_request_t req = { SERVE_MAGIC, (uint32_t)argc, 0, 0 };
+    char cwd[PATH_MAX];
+    char *payload, *p;
+    size_t len;
+    int32_t status;
+    int fd;
+
+    if (!getcwd(cwd, sizeof(cwd))) {
+        perror("picobox: getcwd");
+        return -1;
+    }
+
+    len = strlen(cwd) + 1;
+    for (int i = 0; i < argc; i++) {
+        len += strlen(argv[i]) + 1;
+    }
+    for (char **ep = environ; *ep; ep++) {
+        len += strlen(*ep) + 1;
+        req.envc++;
+    }
+    if (len > SERVE_MAX_PAYLOAD) {
+        return -1;
+    }
+    req.payload_len = (uint32_t)len;
+
+    payload = p = malloc(len);
+    if (!payload) {
+        return -1;
+    }
+    p = stpcpy(p, cwd) + 1;
+    for (int i = 0; i < argc; i++) {
+        p = stpcpy(p, argv[i]) + 1;
+    }
+    for (char **ep = environ; *ep; ep++) {
+        p = stpcpy(p, *ep) + 1;
+    }
+
+    fd = connect_server();
+    if (fd < 0) {
+        free(payload);
+        return -1;
+    }
+
+    if (send_header(fd, &req) < 0 || write_full(fd, payload, len) < 0) {
+        fprintf(stderr, "picobox: request to server failed\n");
+        status = EXIT_FAILURE;
+    } else if (read(fd, &status, sizeof(status)) != (ssize_t)sizeof(status)) {
+        fprintf(stderr, "picobox: server closed the connection\n");
+        status = EXIT_FAILURE;
+    }
+
+    free(payload);
+    close(fd);
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    char *name = basename(argv[0]);
+    int status;
+
+    /* picobox-client COMMAND ARGS... vs. a symlink named COMMAND */
+    if (strcmp(name, "picobox-client") == 0) {
+        if (argc < 2) {
+            fprintf(stderr, "Usage: picobox-client COMMAND [ARGS...]\n");
+            return EXIT_FAILURE;
+        }
+        argc--;
+        argv++;
+    } else {
+        argv[0] = name;
+    }
+
+    status = run_remote(argc, argv);
+    if (status >= 0) {
+        return status;
+    }
+
+    /* No server: run it the normal way */
+    {
+        char *fallback[argc + 2];
+
+        fallback[0] = "picobox";
+        memcpy(&fallback[1], argv, (argc + 1) * sizeof(char *));
+        execvp("picobox", fallback);
+        perror("picobox");
+        return 127;
+    }
+}
@@ -7,195 +7,489 @@
  * Example: cat file | grep test | wc -l
  *   - cat's stdout → grep's stdin
  *   - grep's stdout → wc's stdin
+ *
+ * Both shells go through run_pipeline(): the BNFC visitor prepares
+ * its stages (argv + redirections) and passes a hook for stages that
+ * must run shell code; exec_pipeline() wraps plain argv lists.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* F_SETPIPE_SZ */
+#endif
+
 #include "picobox.h"
 #include "pipe_helpers.h"
+#include "exec_helpers.h"
+#include "path_cache.h"
+#include "thread_pipeline.h"
+#include "reaper.h"
+#include "time_stats.h"
+#include "trace.h"
+#include <fcntl.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 #include <sys/wait.h>
+#if defined(__GLIBC__)
+#include <stdio_ext.h>
+#endif
+
+extern char **environ;
+
+/* Option state; -1 = not read from the environment yet */
+static int pipefail_enabled = 0;
+static int pipe_size = -1;
+static int pipe_stats = -1;
+
+int get_pipefail(void)
+{
+    return pipefail_enabled;
+}
+
+void set_pipefail(int enabled)
+{
+    pipefail_enabled = enabled ? 1 : 0;
+}
 
 /*
- * Execute a pipeline of commands
- *
- * Algorithm:
- * 1. For each command in the pipeline:
- *    - Create a pipe (except for last command)
- *    - Fork a child process
- *    - Child: Connect stdin/stdout to pipes, exec command
- *    - Parent: Close used pipe ends, save pipe for next iteration
- * 2. Close all pipes in parent
- * 3. Wait for all children to complete
+ * Requested pipe capacity in bytes (PICOBOX_PIPE_SIZE), 0 for default
+ */
+int get_pipe_size(void)
+{
+    if (pipe_size < 0) {
+        const char *env = getenv("PICOBOX_PIPE_SIZE");
+        pipe_size = env ? atoi(env) : 0;
+        if (pipe_size < 0) {
+            pipe_size = 0;
+        }
+    }
+    return pipe_size;
+}
+
+void set_pipe_size(int bytes)
+{
+    pipe_size = bytes > 0 ? bytes : 0;
+}
+
+/*
+ * Whether to print per-stage timings (PICOBOX_PIPE_STATS=1)
+ */
+int get_pipe_stats(void)
+{
+    if (pipe_stats < 0) {
+        const char *env = getenv("PICOBOX_PIPE_STATS");
+        pipe_stats = (env && strcmp(env, "0") != 0) ? 1 : 0;
+    }
+    return pipe_stats;
+}
+
+void set_pipe_stats(int enabled)
+{
+    pipe_stats = enabled ? 1 : 0;
+}
+
+/* Milliseconds on the monotonic clock */
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static double timeval_ms(const struct timeval *tv)
+{
+    return tv->tv_sec * 1000.0 + tv->tv_usec / 1000.0;
+}
+
+/*
+ * Create the pipe between two stages, grown to the requested size
  *
- * argv_list: Array of argv arrays (one per command in pipeline)
- * count: Number of commands in pipeline
+ * F_SETPIPE_SZ is Linux-only; elsewhere (and if the kernel refuses,
+ * e.g. above /proc/sys/fs/pipe-max-size) the default capacity is kept.
+ */
+static int make_stage_pipe(int fds[2])
+{
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        return -1;
+    }
+
+#ifdef F_SETPIPE_SZ
+    if (get_pipe_size() > 0) {
+        (void)fcntl(fds[1], F_SETPIPE_SZ, get_pipe_size());
+    }
+#endif
+
+    return 0;
+}
+
+static void close_if_open(int *fd)
+{
+    if (*fd != -1) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+/*
+ * Fork a stage: connect stdin/stdout, then run shell code or exec
  *
- * Returns: Exit status of last command in pipeline
+ * in_fd/out_fd: what the stage reads/writes (-1 = inherit)
+ * pipe_fds: every pipe end still open in the shell, closed in the child
  */
-int exec_pipeline(char ***argv_list, int count)
+static pid_t fork_stage(pipe_stage_t *stage, int in_fd, int out_fd,
+                        const int *pipe_fds, int npipe_fds,
+                        pipe_child_fn child_fn, void *data)
 {
-    int i;
-    int status = 0;
-    
-    /* prev_pipe holds the pipe from the previous iteration
-     *  prev_pipe[0] = read end
-     *  prev_pipe[1] = write end
-     *
-     * Initially -1 because there's no "previous" pipe for the first command.
-     */
-    int prev_pipe[2] = {-1, -1};  
+    pid_t pid;
 
-    /* curr_pipe is the pipe we create for the CURRENT command,
-     * except for the last command (which writes to stdout).
-     */
-    int curr_pipe[2];
+    /* Resolve in the parent so the PATH cache keeps the result */
+    if (!stage->run_in_shell) {
+        path_cache_lookup(stage->argv[0]);
+    }
 
-    /* We'll store ALL children PIDs so the parent can wait for them. */
-    pid_t *pids;
+    TRACE_BEGIN("fork", stage->argv[0]);
+    pid = fork();
+    if (pid != 0) {
+        TRACE_END("fork");
+        return pid;
+    }
 
-    /* Basic argument validation */
-    if (count <= 0 || !argv_list) {
-        fprintf(stderr, "exec_pipeline: invalid arguments\n");
-        return EXIT_ERROR;
+    /* ========= CHILD PROCESS ========= */
+    if (in_fd != -1) {
+        if (dup2(in_fd, STDIN_FILENO) < 0) {
+            perror("dup2");
+            _exit(EXIT_ERROR);
+        }
+        /* Lines the shell buffered from its own stdin are not ours */
+#if defined(__GLIBC__)
+        __fpurge(stdin);
+#elif defined(__APPLE__)
+        fpurge(stdin);
+#endif
+    }
+    if (out_fd != -1 && dup2(out_fd, STDOUT_FILENO) < 0) {
+        perror("dup2");
+        _exit(EXIT_ERROR);
     }
 
-    /* Allocate PID array */
-    pids = malloc(count * sizeof(pid_t));
-    if (!pids) {
-        perror("malloc");
-        return EXIT_ERROR;
+    /* Only 0/1/2 stay open: a leftover write end would keep a reader
+     * waiting for EOF forever */
+    for (int i = 0; i < npipe_fds; i++) {
+        if (pipe_fds[i] > STDERR_FILENO) {
+            close(pipe_fds[i]);
+        }
+    }
+    if (stage->stdin_fd > STDERR_FILENO) {
+        close(stage->stdin_fd);
+    }
+    if (stage->stdout_fd > STDERR_FILENO) {
+        close(stage->stdout_fd);
     }
 
-    /* ======================================================
-     *  MAIN LOOP: FOR EACH COMMAND IN THE PIPELINE
-     *  Example pipeline with 3 commands:
-     *      cmd1 | cmd2 | cmd3
-     *
-     *  This loop runs 3 times.
-     * ====================================================== */
+    if (stage->run_in_shell) {
+        int status;
+
+        /* Shell code in this child sees the stage's environment */
+        if (stage->envp) {
+            environ = stage->envp;
+        }
+
+        if (child_fn) {
+            status = child_fn(stage, data);
+        } else {
+            status = stage->spec->run(stage->argc, stage->argv);
+        }
+        fflush(stdout);
+        fflush(stderr);
+        _exit(status);
+    }
+
+    exec_child(stage->argv, stage->envp);   /* exits 127 if command not found */
+    _exit(127);
+}
+
+/*
+ * Process-based pipeline
+ *
+ * Algorithm:
+ * 1. For each stage:
+ *    - Create a pipe (except for the last stage)
+ *    - Start the stage with its stdin on the previous pipe and its
+ *      stdout on the current one (a stage's own redirections win)
+ *    - Parent: close the previous pipe, keep the current one
+ * 2. Collect every stage as it exits (reaper.c), with its rusage
+ *
+ * With the spawn backend, external stages are started with
+ * posix_spawn() and the child-side dup2/close steps become file
+ * actions. Stages that run shell code are always forked.
+ */
+static void run_process_pipeline(pipe_stage_t *stages, int count,
+                                 pipe_child_fn child_fn, void *data)
+{
+    /* prev_pipe feeds the current stage, curr_pipe is its output */
+    int prev_pipe[2] = {-1, -1};
+    int curr_pipe[2];
+    double *started = calloc(count, sizeof(double));
+    int i;
+
     for (i = 0; i < count; i++) {
+        pipe_stage_t *stage = &stages[i];
+        int in_fd, out_fd;
+
+        curr_pipe[0] = -1;
+        curr_pipe[1] = -1;
+        stage->pid = -1;
 
-        /* ------------------------------------------------------
-         * If this is NOT the last command, create a pipe.
-         * The pipe connects THIS command to the NEXT one.
-         *
-         * Example for 3 commands:
-         *   Iteration 0 → make pipe0
-         *   Iteration 1 → make pipe1
-         *   Iteration 2 → no pipe (last command)
-         * ------------------------------------------------------ */
-        if (i < count - 1) {
-            if (pipe(curr_pipe) < 0) {
-                perror("pipe");
-                free(pids);
-                return EXIT_ERROR;
+        if (i < count - 1 && make_stage_pipe(curr_pipe) < 0) {
+            /* Later stages can't be connected: treat them as never started */
+            for (int j = i; j < count; j++) {
+                if (stages[j].argv) {
+                    stages[j].status = EXIT_ERROR;
+                }
+                close_if_open(&stages[j].stdin_fd);
+                close_if_open(&stages[j].stdout_fd);
             }
+            break;
         }
 
-        /* Fork a child to run this command */
-        pids[i] = fork(); // remeber this returns diffrent kind of pids error 0 or a actual pid 
+        in_fd = stage->stdin_fd != -1 ? stage->stdin_fd : prev_pipe[0];
+        out_fd = stage->stdout_fd != -1 ? stage->stdout_fd : curr_pipe[1];
 
-        if (pids[i] < 0) {
-            perror("fork");
-            free(pids);
-            return EXIT_ERROR;
+        if (started) {
+            started[i] = now_ms();
         }
 
-        /* ========= CHILD PROCESS ========= */
-        if (pids[i] == 0) {
-
-            /* -----------------------------------------------------
-             * If NOT the first command:
-             *   Connect stdin to previous pipe's READ end.
-             *
-             * Example for "A | B | C":
-             *   B gets stdin from pipe0[0]
-             *   C gets stdin from pipe1[0]
-             * ----------------------------------------------------- */
-            if (prev_pipe[0] != -1) {
-                if (dup2(prev_pipe[0], STDIN_FILENO) < 0) {
-                    perror("dup2");
-                    _exit(EXIT_ERROR);
-                }
+        if (!stage->argv) {
+            /* Stage could not be set up (status preset by caller) */
+        } else if (!stage->run_in_shell && get_spawn_backend() != SPAWN_BACKEND_FORK) {
+            int close_fds[4] = { prev_pipe[0], prev_pipe[1], curr_pipe[0], curr_pipe[1] };
 
-                /* Child doesn't need the previous pipe fds anymore */
-                close(prev_pipe[0]);
-                close(prev_pipe[1]);
+            /* A failed spawn leaves pid == -1: the stage counts as 127 */
+            stage->pid = spawn_external(stage->argv, stage->envp, in_fd, out_fd, close_fds, 4);
+            if (stage->pid < 0) {
+                stage->status = 127;
             }
+        } else {
+            int pipe_fds[4] = { prev_pipe[0], prev_pipe[1], curr_pipe[0], curr_pipe[1] };
 
-            /* -----------------------------------------------------
-             * If NOT the last command:
-             *   Connect stdout to current pipe's WRITE end.
-             *
-             * Example for "A | B | C":
-             *   A → stdout → pipe0[1]
-             *   B → stdout → pipe1[1]
-             *   C → stdout → normal stdout
-             * ----------------------------------------------------- */
-            if (i < count - 1) {
-                if (dup2(curr_pipe[1], STDOUT_FILENO) < 0) { // simple file descripter redirect
-                    perror("dup2");
-                    _exit(EXIT_ERROR);
-                }
-
-                /* Child doesn't need both ends open */
-                close(curr_pipe[0]);
-                close(curr_pipe[1]);
+            stage->pid = fork_stage(stage, in_fd, out_fd, pipe_fds, 4, child_fn, data);
+            if (stage->pid < 0) {
+                perror("fork");
+                stage->status = EXIT_ERROR;
             }
-
-            /* -----------------------------------------------------
-             * EXECUTE THE COMMAND
-             *
-             * This replaces the child with the program.
-             * If execvp returns, it failed.
-             * ----------------------------------------------------- */
-            execvp(argv_list[i][0], argv_list[i]); // exec
-
-            perror(argv_list[i][0]);
-            _exit(127);   // command not found
         }
 
         /* ========= PARENT PROCESS ========= */
 
-        /* Close the previous pipe ends —
-         * Parent is done with them after forking the child.
-         */
-        if (prev_pipe[0] != -1) {
-            close(prev_pipe[0]);
-            close(prev_pipe[1]);
+        /* Status -1 = still running, filled in by the wait loop below */
+        if (stage->pid > 0) {
+            stage->status = -1;
+            reaper_watch(stage->pid);
         }
 
-        /* Save current pipe as previous for next loop iteration */
-        if (i < count - 1) {
-            prev_pipe[0] = curr_pipe[0];  // this pipe’s read side
-            prev_pipe[1] = curr_pipe[1];  // this pipe’s write side
-        }
+        /* Redirection fds belong to the child now */
+        close_if_open(&stage->stdin_fd);
+        close_if_open(&stage->stdout_fd);
+
+        /* Parent is done with the previous pipe */
+        close_if_open(&prev_pipe[0]);
+        close_if_open(&prev_pipe[1]);
+
+        /* Current pipe feeds the next stage */
+        prev_pipe[0] = curr_pipe[0];
+        prev_pipe[1] = curr_pipe[1];
     }
 
     /* After the loop, close any pipe still open */
-    if (prev_pipe[0] != -1) {
-        close(prev_pipe[0]);
-        close(prev_pipe[1]);
-    }
+    close_if_open(&prev_pipe[0]);
+    close_if_open(&prev_pipe[1]);
 
     /* ===========================================================
      * WAIT FOR ALL CHILDREN
+     *
+     * Collected in the order they exit, so each stage's wall time
+     * ends when it really finished, whatever its neighbours do.
      * =========================================================== */
-    for (i = 0; i < count; i++) {
-        int child_status;
+    TRACE_BEGIN("wait", "pipeline");
+    for (;;) {
+        int running = 0;
 
-        if (waitpid(pids[i], &child_status, 0) < 0) { 
-            perror("waitpid");
-        } else {
-            /* Status of LAST command defines the pipeline's exit code */
-            if (i == count - 1) {
-                if (WIFEXITED(child_status))
-                    status = WEXITSTATUS(child_status);
-                else if (WIFSIGNALED(child_status))
-                    status = 128 + WTERMSIG(child_status);
+        for (i = 0; i < count; i++) {
+            pipe_stage_t *stage = &stages[i];
+            struct rusage usage;
+            int child_status;
+            int r;
+
+            if (stage->pid < 0 || stage->status != -1) {
+                continue;
+            }
+
+            r = reaper_take(stage->pid, &child_status, &usage);
+            if (r == 0) {
+                running++;
+                continue;
+            }
+            if (r < 0) {
+                /* Never watched (reaper_watch failed): wait directly */
+                if (wait4(stage->pid, &child_status, 0, &usage) < 0) {
+                    perror("waitpid");
+                    stage->status = EXIT_ERROR;
+                    continue;
+                }
+            }
+
+            if (started) {
+                stage->wall_ms = now_ms() - started[i];
+            }
+            stage->user_ms = timeval_ms(&usage.ru_utime);
+            stage->sys_ms = timeval_ms(&usage.ru_stime);
+            time_stats_child(&usage);
+
+            if (WIFEXITED(child_status)) {
+                stage->status = WEXITSTATUS(child_status);
+            } else if (WIFSIGNALED(child_status)) {
+                stage->status = 128 + WTERMSIG(child_status);
+            } else {
+                stage->status = EXIT_ERROR;
+            }
+        }
+
+        if (running == 0 || reaper_collect(-1) < 0) {
+            break;
+        }
+    }
+    TRACE_END("wait");
+
+    free(started);
+}
+
+int pipeline_exit_status(const pipe_stage_t *stages, int count)
+{
+    if (count <= 0) {
+        return EXIT_OK;
+    }
+
+    /* pipefail: the rightmost stage that failed decides */
+    if (get_pipefail()) {
+        for (int i = count - 1; i >= 0; i--) {
+            if (stages[i].status != 0) {
+                return stages[i].status;
             }
         }
+        return EXIT_OK;
+    }
+
+    /* Status of LAST command defines the pipeline's exit code */
+    return stages[count - 1].status;
+}
+
+void pipeline_print_stats(FILE *out, const pipe_stage_t *stages, int count)
+{
+    for (int i = 0; i < count; i++) {
+        const char *name = (stages[i].argv && stages[i].argv[0]) ? stages[i].argv[0] : "-";
+
+        fprintf(out, "pipeline: stage %d (%s): status %d, wall %.3f ms, "
+                "user %.3f ms, sys %.3f ms\n",
+                i + 1, name, stages[i].status,
+                stages[i].wall_ms, stages[i].user_ms, stages[i].sys_ms);
+    }
+}
+
+/*
+ * Execute a pipeline of stages
+ *
+ * stages: Prepared stages (argv, redirections, how to run each one)
+ * count: Number of stages
+ * child_fn: Hook for run_in_shell stages, called in the forked child
+ *
+ * Returns: Exit status of the pipeline (last stage, or pipefail rule)
+ */
+int run_pipeline(pipe_stage_t *stages, int count, pipe_child_fn child_fn, void *data)
+{
+    const cmd_spec_t **specs;
+    int threaded = 0;
+    int status;
+
+    /* Basic argument validation */
+    if (count <= 0 || !stages) {
+        fprintf(stderr, "run_pipeline: invalid arguments\n");
+        return EXIT_ERROR;
+    }
+
+    for (int i = 0; i < count; i++) {
+        stages[i].pid = -1;
+        stages[i].wall_ms = 0;
+        stages[i].user_ms = 0;
+        stages[i].sys_ms = 0;
+    }
+
+    /* All-builtin pipelines run as threads, without pipe() or fork();
+     * a stage with its own environment needs a process of its own */
+    specs = calloc(count, sizeof(cmd_spec_t *));
+    if (specs && count > 1) {
+        for (int i = 0; i < count; i++) {
+            specs[i] = stages[i].argv && !stages[i].envp ? stages[i].spec : NULL;
+        }
+        threaded = thread_pipeline_supported(specs, count);
+    }
+    free(specs);
+
+    /* Anything the shell buffered must come out before the stages' output */
+    fflush(stdout);
+
+    if (threaded) {
+        run_thread_pipeline(stages, count);
+    } else {
+        run_process_pipeline(stages, count, child_fn, data);
+    }
+
+    status = pipeline_exit_status(stages, count);
+
+    if (get_pipe_stats()) {
+        pipeline_print_stats(stderr, stages, count);
+    }
+
+    return status;
+}
+
+/*
+ * Execute a pipeline of external commands
+ *
+ * argv_list: Array of argv arrays (one per command in pipeline)
+ * count: Number of commands in pipeline
+ *
+ * Returns: Exit status of the pipeline
+ */
+int exec_pipeline(char ***argv_list, int count)
+{
+    pipe_stage_t *stages;
+    int status;
+
+    /* Basic argument validation */
+    if (count <= 0 || !argv_list) {
+        fprintf(stderr, "exec_pipeline: invalid arguments\n");
+        return EXIT_ERROR;
+    }
+
+    stages = calloc(count, sizeof(pipe_stage_t));
+    if (!stages) {
+        perror("calloc");
+        return EXIT_ERROR;
+    }
+
+    for (int i = 0; i < count; i++) {
+        stages[i].argv = argv_list[i];
+        while (argv_list[i][stages[i].argc]) {
+            stages[i].argc++;
+        }
+        stages[i].stdin_fd = -1;
+        stages[i].stdout_fd = -1;
     }
 
-    free(pids);
+    status = run_pipeline(stages, count, NULL, NULL);
+    free(stages);
 
     return status;
-}
\ No newline at end of file
+}
@@ -0,0 +1,235 @@
+/*
+ * pkg_fetch.c - Concurrent package downloads on a libcurl multi handle
+ *
+ * One thread drives every transfer: curl_multi_perform() moves them
+ * all along, curl_multi_poll() sleeps until one of their sockets is
+ * ready, and curl_multi_info_read() hands back the ones that ended.
+ * The write callback runs on that thread too, so a reader slow to
+ * drain its pipe holds the others back rather than letting data pile
+ * up in memory.
+ */
+
+#include "pkg_fetch.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <curl/curl.h>
+
+/* Give up on a transfer that moves less than this for this long */
+#define FETCH_LOW_SPEED 1L              /* bytes/s */
+#define FETCH_LOW_SPEED_TIME 60L        /* s */
+#define FETCH_CONNECT_TIMEOUT 30L       /* s */
+
+/* What the callback and the loop keep per job */
+typedef struct {
+    pkg_fetch_t *job;
+    CURL *easy;
+    sha256_ctx_t sha;
+    int write_err;                      /* errno from writing to fd, or 0 */
+    struct curl_slist *headers;         /* Conditional request headers */
+    char errbuf[CURL_ERROR_SIZE];
+} fetch_state_t;
+
+/* Copy header line's value, if it is name, into dst */
+static void header_value(const char *line, size_t len, const char *name,
+                         char *dst, size_t size)
+{
+    size_t n = strlen(name);
+
+    if (len <= n || strncasecmp(line, name, n) != 0 || line[n] != ':') {
+        return;
+    }
+    line += n + 1;
+    len -= n + 1;
+    while (len > 0 && (*line == ' ' || *line == '\t')) {
+        line++;
+        len--;
+    }
+    while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == '\n' || line[len - 1] == ' ')) {
+        len--;
+    }
+    if (len < size) {
+        memcpy(dst, line, len);
+        dst[len] = '\0';
+    }
+}
+
+static size_t fetch_header(char *line, size_t size, size_t nitems, void *arg)
+{
+    pkg_fetch_t *job = ((fetch_state_t *)arg)->job;
+    size_t len = size * nitems;
+
+    /* A status line starts another reply (after a redirect) */
+    if (len >= 5 && strncmp(line, "HTTP/", 5) == 0) {
+        job->etag[0] = '\0';
+        job->last_modified[0] = '\0';
+    }
+    header_value(line, len, "ETag", job->etag, sizeof(job->etag));
+    header_value(line, len, "Last-Modified", job->last_modified, sizeof(job->last_modified));
+    return len;
+}
+
+static size_t fetch_write(char *data, size_t size, size_t nmemb, void *arg)
+{
+    fetch_state_t *st = arg;
+    size_t len = size * nmemb;
+    size_t done = 0;
+
+    sha256_update(&st->sha, data, len);
+    while (done < len) {
+        ssize_t n = write(st->job->fd, data + done, len - done);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            st->write_err = errno;
+            return 0;                   /* Ends the transfer with CURLE_WRITE_ERROR */
+        }
+        done += (size_t)n;
+    }
+    return len;
+}
+
+/* Record how the transfer of st ended and close its fd */
+static void fetch_finish(fetch_state_t *st, CURLcode result, const char *prog)
+{
+    pkg_fetch_t *job = st->job;
+
+    if (result != CURLE_OK) {
+        fprintf(stderr, "%s: %s: %s\n", prog, job->url,
+                st->write_err ? strerror(st->write_err) :
+                st->errbuf[0] ? st->errbuf : curl_easy_strerror(result));
+        job->failed = 1;
+    }
+    if (st->easy) {
+        curl_easy_getinfo(st->easy, CURLINFO_RESPONSE_CODE, &job->status);
+    }
+    sha256_final(&st->sha, job->digest);
+    curl_slist_free_all(st->headers);
+    st->headers = NULL;
+    if (job->fd >= 0) {
+        close(job->fd);
+        job->fd = -1;
+    }
+}
+
+int pkg_fetch_all(pkg_fetch_t *jobs, size_t n, const char *prog)
+{
+    fetch_state_t *states = calloc(n ? n : 1, sizeof(*states));
+    CURLM *multi = NULL;
+    int running = 0;
+    int ret = 0;
+
+    if (!states || curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK ||
+        !(multi = curl_multi_init())) {
+        fprintf(stderr, "%s: cannot start downloads\n", prog);
+        for (size_t i = 0; i < n; i++) {
+            jobs[i].failed = 1;
+            close(jobs[i].fd);
+            jobs[i].fd = -1;
+        }
+        free(states);
+        return -1;
+    }
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)PKG_FETCH_CONNECTIONS);
+
+    for (size_t i = 0; i < n; i++) {
+        fetch_state_t *st = &states[i];
+        CURL *easy = curl_easy_init();
+
+        st->job = &jobs[i];
+        jobs[i].failed = 0;
+        jobs[i].status = 0;
+        jobs[i].etag[0] = '\0';
+        jobs[i].last_modified[0] = '\0';
+        sha256_init(&st->sha);
+        if (!easy) {
+            fetch_finish(st, CURLE_FAILED_INIT, prog);
+            continue;
+        }
+        curl_easy_setopt(easy, CURLOPT_URL, jobs[i].url);
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, fetch_write);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, (void *)st);
+        curl_easy_setopt(easy, CURLOPT_PRIVATE, (void *)st);
+        curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, st->errbuf);
+        curl_easy_setopt(easy, CURLOPT_FAILONERROR, 1L);
+        curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+        curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT, FETCH_CONNECT_TIMEOUT);
+        curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, FETCH_LOW_SPEED);
+        curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME, FETCH_LOW_SPEED_TIME);
+        curl_easy_setopt(easy, CURLOPT_USERAGENT, "picobox-pkg");
+        curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, fetch_header);
+        curl_easy_setopt(easy, CURLOPT_HEADERDATA, (void *)st);
+        if (jobs[i].if_none_match && *jobs[i].if_none_match) {
+            char h[160];
+
+            snprintf(h, sizeof(h), "If-None-Match: %s", jobs[i].if_none_match);
+            st->headers = curl_slist_append(st->headers, h);
+        }
+        if (jobs[i].if_modified_since && *jobs[i].if_modified_since) {
+            char h[96];
+
+            snprintf(h, sizeof(h), "If-Modified-Since: %s", jobs[i].if_modified_since);
+            st->headers = curl_slist_append(st->headers, h);
+        }
+        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, st->headers);
+        if (curl_multi_add_handle(multi, easy) != CURLM_OK) {
+            curl_easy_cleanup(easy);
+            fetch_finish(st, CURLE_FAILED_INIT, prog);
+            continue;
+        }
+        st->easy = easy;
+    }
+
+    do {
+        CURLMsg *msg;
+        int left;
+        CURLMcode mc = curl_multi_perform(multi, &running);
+
+        if (mc != CURLM_OK) {
+            fprintf(stderr, "%s: %s\n", prog, curl_multi_strerror(mc));
+            break;
+        }
+        while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+            fetch_state_t *st = NULL;
+
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&st);
+            fetch_finish(st, msg->data.result, prog);
+            curl_multi_remove_handle(multi, st->easy);
+            curl_easy_cleanup(st->easy);
+            st->easy = NULL;
+        }
+        if (running > 0) {
+            curl_multi_poll(multi, NULL, 0, 1000, NULL);
+        }
+    } while (running > 0);
+
+    /* Only a failing multi handle leaves transfers unfinished */
+    for (size_t i = 0; i < n; i++) {
+        if (states[i].easy) {
+            fetch_finish(&states[i], CURLE_FAILED_INIT, prog);
+            curl_multi_remove_handle(multi, states[i].easy);
+            curl_easy_cleanup(states[i].easy);
+        }
+        if (jobs[i].failed) {
+            ret = -1;
+        }
+    }
+
+    curl_multi_cleanup(multi);
+    curl_global_cleanup();
+    free(states);
+    return ret;
+}
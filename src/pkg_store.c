@@ -0,0 +1,198 @@
+/*
+ * pkg_store.c - Content-addressed file store shared by installed packages
+ *
+ * Linking a package in is three passes: walk() lists its regular files,
+ * checksum_files() hashes them all on the work pool, and each is then
+ * either linked into the store as a new object or replaced by a link
+ * to the object already there. The replacement is a link to a
+ * temporary name beside the file renamed over it, so the file's path
+ * always names a whole file.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* AT_FDCWD, fchmodat() */
+#endif
+
+#include "pkg_store.h"
+#include "checksum.h"
+#include "walk.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* The regular files of a tree */
+typedef struct {
+    char **paths;
+    mode_t *modes;
+    size_t len, cap;
+    int failed;                 /* Out of memory, or part of the tree unreadable */
+} store_files_t;
+
+static int collect_file(const walk_entry_t *e, void *arg)
+{
+    store_files_t *f = arg;
+
+    if (e->visit == WALK_ERROR) {
+        f->failed = 1;
+        return WALK_CONTINUE;
+    }
+    if (e->visit != WALK_LEAF || e->type != WALK_T_REG) {
+        return WALK_CONTINUE;
+    }
+    if (f->len == f->cap) {
+        size_t cap = f->cap ? f->cap * 2 : 256;
+        char **paths = realloc(f->paths, cap * sizeof(*paths));
+        mode_t *modes = paths ? realloc(f->modes, cap * sizeof(*modes)) : NULL;
+
+        if (paths) {
+            f->paths = paths;
+        }
+        if (!modes) {
+            f->failed = 1;
+            return WALK_STOP;
+        }
+        f->modes = modes;
+        f->cap = cap;
+    }
+    f->paths[f->len] = strdup(e->path);
+    if (!f->paths[f->len]) {
+        f->failed = 1;
+        return WALK_STOP;
+    }
+    f->modes[f->len++] = e->st->st_mode & 07777 & ~(mode_t)0222;
+    return WALK_CONTINUE;
+}
+
+/*
+ * Make path a link to the object obj (created from path if the store
+ * lacks it)
+ * Returns: 0, or -1 (errno set)
+ */
+static int share_file(const char *path, const char *obj)
+{
+    char tmp[4200];
+
+    if (link(path, obj) == 0) {
+        return 0;
+    }
+    if (errno != EEXIST) {
+        return -1;
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.pkgstore%d", path, (int)getpid());
+    if (link(obj, tmp) != 0) {
+        return -1;
+    }
+    if (rename(tmp, path) != 0) {
+        int err = errno;
+
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int pkg_store_link(const char *store, const char *dir, const char *prog)
+{
+    store_files_t files = { NULL, NULL, 0, 0, 0 };
+    walk_opts_t opts = { WALK_STAT, 0, 0, NULL };
+    checksum_result_t *sums;
+    const char *roots[1] = { dir };
+    int ret = 0;
+
+    if (mkdir(store, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "%s: %s: %s\n", prog, store, strerror(errno));
+        return -1;
+    }
+    if (walk(AT_FDCWD, roots, 1, &opts, collect_file, &files) < 0 || files.failed) {
+        fprintf(stderr, "%s: %s: cannot list the package's files\n", prog, dir);
+        ret = -1;
+        goto out;
+    }
+
+    sums = calloc(files.len ? files.len : 1, sizeof(*sums));
+    if (!sums) {
+        fprintf(stderr, "%s: %s\n", prog, strerror(ENOMEM));
+        ret = -1;
+        goto out;
+    }
+    checksum_files(CHECKSUM_BLAKE3, AT_FDCWD, stdin, files.paths, files.len, sums);
+
+    for (size_t i = 0; i < files.len; i++) {
+        const char *path = files.paths[i];
+        char obj[4200];
+
+        if (sums[i].err) {
+            fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(sums[i].err));
+            ret = -1;
+            continue;
+        }
+
+        /* The fan-out directory, then the object */
+        snprintf(obj, sizeof(obj), "%s/%.2s", store, sums[i].hex);
+        if (mkdir(obj, 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "%s: %s: %s\n", prog, obj, strerror(errno));
+            ret = -1;
+            continue;
+        }
+        snprintf(obj, sizeof(obj), "%s/%.2s/%s.%03o", store, sums[i].hex, sums[i].hex + 2,
+                 (unsigned)files.modes[i]);
+
+        if (chmod(path, files.modes[i]) != 0 || share_file(path, obj) != 0) {
+            fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+            ret = -1;
+        }
+    }
+    free(sums);
+
+out:
+    for (size_t i = 0; i < files.len; i++) {
+        free(files.paths[i]);
+    }
+    free(files.paths);
+    free(files.modes);
+    return ret;
+}
+
+/* Counts what pkg_store_gc() removed */
+typedef struct {
+    int removed;
+    const char *prog;
+} store_gc_t;
+
+static int gc_object(const walk_entry_t *e, void *arg)
+{
+    store_gc_t *gc = arg;
+
+    if (e->visit == WALK_LEAF && e->type == WALK_T_REG && e->st->st_nlink == 1) {
+        if (unlinkat(e->dirfd, e->name, 0) == 0) {
+            gc->removed++;
+        } else {
+            fprintf(stderr, "%s: %s: %s\n", gc->prog, e->path, strerror(errno));
+        }
+    }
+    return WALK_CONTINUE;
+}
+
+int pkg_store_gc(const char *store, const char *prog)
+{
+    walk_opts_t opts = { WALK_STAT, 0, 0, NULL };
+    store_gc_t gc = { 0, prog };
+    const char *roots[1] = { store };
+    struct stat st;
+
+    if (stat(store, &st) != 0) {
+        return errno == ENOENT ? 0 : -1;    /* Nothing was ever shared */
+    }
+    if (walk(AT_FDCWD, roots, 1, &opts, gc_object, &gc) < 0) {
+        fprintf(stderr, "%s: %s: %s\n", prog, store, strerror(errno));
+        return -1;
+    }
+    return gc.removed;
+}
@@ -0,0 +1,198 @@
+/*
+ * plugin.c - Commands loaded from shared objects on first use
+ *
+ * AI and pkg are the only commands that need libcurl, json-c and zlib.
+ * They are built as plugins (src/plugins/ -> build/plugins/ai.so and
+ * pkg.so) instead of into picobox, so starting picobox maps and
+ * relocates none of those libraries. Their entries in the built-in
+ * table are the stubs below: what the shell needs before running a
+ * command (name, summary, flags), and run/print_usage functions that
+ * dlopen() the plugin the first time and hand over to its own spec.
+ *
+ * Plugins are looked for in $PICOBOX_PLUGIN_DIR, then in plugins/
+ * beside the picobox executable (the build tree), then in
+ * PICOBOX_PLUGIN_DIR (where make install puts them). They call back
+ * into picobox for everything else (register_command(), cmd_stdout(),
+ * utils.c...), which is why picobox is linked with -rdynamic.
+ *
+ * A loaded plugin stays loaded: AI keeps its connection between
+ * queries. Loading is not thread-safe, like registration; neither
+ * command runs on a pipeline thread.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* readlink() under -std=c11 */
+#endif
+
+#include "picobox.h"
+#include "cmd_spec.h"
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+#ifndef PICOBOX_PLUGIN_DIR
+#define PICOBOX_PLUGIN_DIR "/usr/local/lib/picobox"
+#endif
+
+typedef struct plugin {
+    const char *file;           /* Shared object, e.g. "pkg.so" */
+    const char *symbol;         /* Its cmd_spec_t */
+    const cmd_spec_t *spec;     /* Once loaded */
+} plugin_t;
+
+/*
+ * Directory of the running executable, into dir
+ * Returns: 0, or -1 if it cannot be found
+ */
+static int exe_dir(char *dir, size_t size)
+{
+    char *slash;
+
+#ifdef __APPLE__
+    uint32_t len = (uint32_t)size;
+
+    if (_NSGetExecutablePath(dir, &len) != 0) {
+        return -1;
+    }
+#else
+    ssize_t len = readlink("/proc/self/exe", dir, size - 1);
+
+    if (len < 0) {
+        return -1;
+    }
+    dir[len] = '\0';
+#endif
+    slash = strrchr(dir, '/');
+    if (!slash) {
+        return -1;
+    }
+    *slash = '\0';
+    return 0;
+}
+
+/*
+ * dir/file into path
+ * Returns: nonzero if it fits and can be read
+ */
+static int plugin_in(const char *dir, const char *file, char *path, size_t size)
+{
+    int len = snprintf(path, size, "%s/%s", dir, file);
+
+    return len > 0 && (size_t)len < size && access(path, R_OK) == 0;
+}
+
+/*
+ * Path of plugin file into path: the first of the three places that
+ * has it, else the installed one (so that is what an error names)
+ */
+static void plugin_path(const char *file, char *path, size_t size)
+{
+    const char *env = getenv("PICOBOX_PLUGIN_DIR");
+    char dir[PATH_MAX];
+
+    if (env && *env && plugin_in(env, file, path, size)) {
+        return;
+    }
+    if (exe_dir(dir, sizeof(dir) - sizeof("/plugins")) == 0) {
+        strcat(dir, "/plugins");
+        if (plugin_in(dir, file, path, size)) {
+            return;
+        }
+    }
+    plugin_in(PICOBOX_PLUGIN_DIR, file, path, size);
+}
+
+/*
+ * The plugin's own spec, loading it the first time
+ * Returns: the spec, or NULL (reported) if it cannot be loaded
+ */
+static const cmd_spec_t *plugin_load(plugin_t *p, const char *name)
+{
+    char path[PATH_MAX];
+    void *handle;
+
+    if (p->spec) {
+        return p->spec;
+    }
+
+    plugin_path(p->file, path, sizeof(path));
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        fprintf(stderr, "%s: cannot load plugin: %s\n", name, dlerror());
+        return NULL;
+    }
+    p->spec = dlsym(handle, p->symbol);
+    if (!p->spec) {
+        fprintf(stderr, "%s: %s has no %s\n", name, path, p->symbol);
+        dlclose(handle);
+    }
+    return p->spec;
+}
+
+static int plugin_run(plugin_t *p, const char *name, int argc, char **argv)
+{
+    const cmd_spec_t *spec = plugin_load(p, name);
+
+    return spec ? spec->run(argc, argv) : EXIT_ERROR;
+}
+
+static void plugin_print_usage(plugin_t *p, const char *name, FILE *out)
+{
+    const cmd_spec_t *spec = plugin_load(p, name);
+
+    if (spec) {
+        spec->print_usage(out);
+    }
+}
+
+/*
+ * AI (src/plugins/cmd_ai.c)
+ */
+static plugin_t ai_plugin = { "ai.so", "cmd_ai_spec", NULL };
+
+static int ai_run(int argc, char **argv)
+{
+    return plugin_run(&ai_plugin, "AI", argc, argv);
+}
+
+static void ai_print_usage(FILE *out)
+{
+    plugin_print_usage(&ai_plugin, "AI", out);
+}
+
+cmd_spec_t plugin_ai_spec = {
+    .name = "AI",
+    .summary = "Ask AI assistant for shell command help",
+    .long_help = NULL,
+    .run = ai_run,
+    .print_usage = ai_print_usage
+};
+
+/*
+ * pkg (src/plugins/cmd_pkg.c)
+ */
+static plugin_t pkg_plugin = { "pkg.so", "cmd_pkg_spec", NULL };
+
+static int pkg_run(int argc, char **argv)
+{
+    return plugin_run(&pkg_plugin, "pkg", argc, argv);
+}
+
+static void pkg_print_usage(FILE *out)
+{
+    plugin_print_usage(&pkg_plugin, "pkg", out);
+}
+
+cmd_spec_t plugin_pkg_spec = {
+    .name = "pkg",
+    .summary = "package manager for PicoBox",
+    .long_help = "Install, list, remove, and query packages in ~/.mysh/",
+    .run = pkg_run,
+    .print_usage = pkg_print_usage,
+    .flags = CMD_FLAG_FORK
+};
@@ -0,0 +1,513 @@
+/*
+ * cmd_ai.c - AI assistant for shell commands (REFACTORED)
+ *
+ * Makes HTTP requests to OpenAI API to get shell command suggestions
+ *
+ * AI runs in the shell process, so one curl handle serves every query
+ * of the session: its connection to the API stays open between
+ * queries, and a share handle keeps the DNS answers and TLS session,
+ * so a connection the server has since closed is resumed rather than
+ * renegotiated from scratch.
+ *
+ * The reply is requested as a stream of server-sent events, each a
+ * "data: {json}" line carrying the next piece of the text; every piece
+ * is printed as soon as its line is complete, so the answer appears as
+ * the model writes it rather than when it has finished.
+ *
+ * Answers are kept in the AI cache (ai_cache.h), so a question asked
+ * before is answered from disk without a request.
+ *
+ * The request is driven through a multi handle, polled every
+ * AI_POLL_MS, with SIGINT caught meanwhile: Ctrl-C cancels the request
+ * (and closes its connection) instead of killing the shell. Lines typed
+ * while it runs wait in the terminal for the next prompt, and
+ * "AI ... &" runs it as a background job.
+ *
+ * Built as a plugin (build/plugins/ai.so) that picobox loads the first
+ * time AI runs (see plugin.c), so nothing else links libcurl or json-c.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* sigaction() and strdup() */
+#endif
+
+#include "picobox.h"
+#include "cmd_spec.h"
+#include "ai_cache.h"
+#include <curl/curl.h>
+#include <json-c/json.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define OPENAI_API_URL "https://api.openai.com/v1/chat/completions"
+#define OPENAI_MODEL "gpt-3.5-turbo"
+#define MAX_RESPONSE_SIZE 4096
+#define AI_POLL_MS 100          /* Longest a Ctrl-C waits to be noticed */
+
+/* Sent with every query, and part of its cache key */
+static const char SYSTEM_PROMPT[] =
+    "You are a helpful Unix shell assistant for PicoBox, a BNFC-powered shell implementation.\n\n"
+    "Shell Capabilities:\n"
+    "- Simple commands: echo hello, ls, pwd, cat file.txt\n"
+    "- Pipelines: cat file | grep pattern | wc -l\n"
+    "- Redirections: echo test > file.txt, cat < input.txt, cmd >> append.txt\n"
+    "- Built-in commands: cd, exit, help, plus 27+ Unix utilities\n"
+    "- Command sequences: cmd1 ; cmd2 ; cmd3\n\n"
+    "Important Limitations:\n"
+    "- When a command in a pipeline has output redirection (>), it breaks the pipe chain\n"
+    "  Example: 'ls | grep test > file.txt | wc' - wc gets empty input because grep writes to file\n"
+    "- Use full paths for external commands in pipelines for reliability\n"
+    "- No background jobs (&), job control, or command substitution yet\n\n"
+    "Response Format:\n"
+    "- For 'how do I' questions: Provide ONLY the command, no explanation\n"
+    "- For 'what is' or 'explain' questions: Brief, friendly explanation\n"
+    "- No markdown formatting, no code blocks, just plain text\n"
+    "- Be concise and beginner-friendly\n\n"
+    "Examples:\n"
+    "Q: how do I list all files\n"
+    "A: ls -la\n\n"
+    "Q: what does grep do\n"
+    "A: grep searches for text patterns in files. Use: grep 'pattern' filename";
+
+/*
+ * Structure to hold HTTP response data
+ */
+struct response_buffer {
+    char *data;
+    size_t size;
+};
+
+/*
+ * A streamed reply being received
+ */
+struct ai_stream {
+    struct response_buffer body;    /* Everything received so far */
+    size_t pos;                     /* Start of the first line not yet handled */
+    struct response_buffer text;    /* The reply's text so far */
+    json_tokener *tok;
+    int events;                     /* "data:" lines seen */
+};
+
+/* The session's handles, and the process they belong to */
+static CURL *ai_curl;
+static CURLM *ai_multi;
+static CURLSH *ai_share;
+static pid_t ai_pid;
+
+/* Set by SIGINT while a request runs */
+static volatile sig_atomic_t ai_interrupted;
+
+/*
+ * Append len bytes to a buffer, keeping it NUL-terminated
+ */
+static int buffer_append(struct response_buffer *mem, const char *data, size_t len)
+{
+    char *ptr = realloc(mem->data, mem->size + len + 1);
+    if (!ptr) {
+        fprintf(stderr, "Not enough memory for response\n");
+        return -1;
+    }
+
+    mem->data = ptr;
+    memcpy(&(mem->data[mem->size]), data, len);
+    mem->size += len;
+    mem->data[mem->size] = 0;
+
+    return 0;
+}
+
+/*
+ * Print an "error" object's message, if obj has one
+ * Returns: 1 if it did
+ */
+static int print_api_error(json_object *obj)
+{
+    json_object *error_obj = json_object_object_get(obj, "error");
+    if (!error_obj) {
+        return 0;
+    }
+    json_object *error_msg = json_object_object_get(error_obj, "message");
+    if (error_msg) {
+        fprintf(stderr, "API Error: %s\n", json_object_get_string(error_msg));
+    }
+    return 1;
+}
+
+/*
+ * Handle one line of the event stream: print the piece of text a
+ * "data:" line carries and add it to the reply
+ */
+static void handle_event_line(struct ai_stream *st, const char *line, size_t len)
+{
+    if (len > 0 && line[len - 1] == '\r') {
+        len--;
+    }
+    if (len < 5 || strncmp(line, "data:", 5) != 0) {
+        return;                         /* Blank separator, comment or other field */
+    }
+    line += 5;
+    len -= 5;
+    while (len > 0 && *line == ' ') {
+        line++;
+        len--;
+    }
+    st->events++;
+    if (len == 6 && strncmp(line, "[DONE]", 6) == 0) {
+        return;
+    }
+
+    json_tokener_reset(st->tok);
+    json_object *event = json_tokener_parse_ex(st->tok, line, (int)len);
+    if (!event) {
+        return;
+    }
+    if (!print_api_error(event)) {
+        /* choices[0].delta.content, absent from the first and last events */
+        json_object *choices = json_object_object_get(event, "choices");
+        json_object *first_choice = choices && json_object_get_type(choices) == json_type_array ?
+                                    json_object_array_get_idx(choices, 0) : NULL;
+        json_object *delta = first_choice ? json_object_object_get(first_choice, "delta") : NULL;
+        json_object *content = delta ? json_object_object_get(delta, "content") : NULL;
+        const char *piece = content ? json_object_get_string(content) : NULL;
+
+        if (piece && *piece) {
+            if (st->text.size == 0) {
+                printf("✨ ");
+            }
+            fputs(piece, stdout);
+            fflush(stdout);
+            buffer_append(&st->text, piece, strlen(piece));
+        }
+    }
+    json_object_put(event);
+}
+
+/*
+ * Callback for curl to write response data: keep it, and handle each
+ * line of the event stream it completes
+ */
+static size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    size_t realsize = size * nmemb;
+    struct ai_stream *st = (struct ai_stream *)userp;
+    char *nl;
+
+    if (buffer_append(&st->body, contents, realsize) != 0) {
+        return 0;
+    }
+    while ((nl = memchr(st->body.data + st->pos, '\n', st->body.size - st->pos)) != NULL) {
+        size_t end = (size_t)(nl - st->body.data);
+
+        handle_event_line(st, st->body.data + st->pos, end - st->pos);
+        st->pos = end + 1;
+    }
+
+    return realsize;
+}
+
+/*
+ * Get the session's curl handle, creating it on first use. A forked
+ * child does not touch the parent's (its connection is the parent's
+ * too) and makes its own.
+ */
+static CURL *ai_handle(void)
+{
+    if (ai_curl && ai_pid == getpid()) {
+        return ai_curl;
+    }
+
+    if (!ai_pid) {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+    }
+    ai_share = curl_share_init();
+    if (ai_share) {
+        curl_share_setopt(ai_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(ai_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+    ai_curl = curl_easy_init();
+    ai_multi = curl_multi_init();
+    ai_pid = getpid();
+    if (!ai_curl) {
+        return NULL;
+    }
+
+    curl_easy_setopt(ai_curl, CURLOPT_SHARE, ai_share);
+    curl_easy_setopt(ai_curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(ai_curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(ai_curl, CURLOPT_NOSIGNAL, 1L);
+    return ai_curl;
+}
+
+static void on_sigint(int sig)
+{
+    (void)sig;
+    ai_interrupted = 1;
+}
+
+/*
+ * Run the transfer set up on curl until it ends or Ctrl-C is pressed
+ * (ai_interrupted is then set, and the transfer abandoned)
+ * Returns: its result
+ */
+static CURLcode ai_perform(CURL *curl)
+{
+    struct sigaction sa = {0};
+    struct sigaction old_sa;
+    CURLcode res = CURLE_OK;
+    CURLMsg *msg;
+    int running = 1;
+    int left;
+
+    if (!ai_multi) {
+        return curl_easy_perform(curl);
+    }
+
+    /* No SA_RESTART: curl_multi_poll() must return at once */
+    ai_interrupted = 0;
+    sa.sa_handler = on_sigint;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, &old_sa);
+
+    curl_multi_add_handle(ai_multi, curl);
+    while (running && !ai_interrupted) {
+        CURLMcode mc = curl_multi_perform(ai_multi, &running);
+
+        if (mc == CURLM_OK && running) {
+            mc = curl_multi_poll(ai_multi, NULL, 0, AI_POLL_MS, NULL);
+        }
+        if (mc != CURLM_OK) {
+            fprintf(stderr, "Error: %s\n", curl_multi_strerror(mc));
+            res = CURLE_FAILED_INIT;
+            break;
+        }
+    }
+    while ((msg = curl_multi_info_read(ai_multi, &left))) {
+        if (msg->msg == CURLMSG_DONE && msg->easy_handle == curl) {
+            res = msg->data.result;
+        }
+    }
+    if (ai_interrupted) {
+        res = CURLE_ABORTED_BY_CALLBACK;
+    }
+    curl_multi_remove_handle(ai_multi, curl);
+
+    sigaction(SIGINT, &old_sa, NULL);
+    return res;
+}
+
+/*
+ * Make OpenAI API request and return the response
+ */
+static char *make_openai_request(const char *query)
+{
+    CURL *curl;
+    CURLcode res;
+    struct ai_stream response = {0};
+    char *api_key;
+    char auth_header[512];
+    struct curl_slist *headers = NULL;
+    char *json_request;
+    char *result = NULL;
+    ai_cache_key_t key;
+
+    /* An answer to the same question is served from the cache */
+    ai_cache_key(&key, OPENAI_MODEL, SYSTEM_PROMPT, query);
+    result = ai_cache_get(&key);
+    if (result) {
+        printf("✨ %s\n", result);
+        return result;
+    }
+
+    /* Get API key from environment */
+    api_key = getenv("AI_SHELL");
+    if (!api_key) {
+        fprintf(stderr, "Error: AI_SHELL environment variable not set\n");
+        fprintf(stderr, "Set it with: export AI_SHELL='your-api-key'\n");
+        return NULL;
+    }
+
+    /* The session's handle; its connection may already be open */
+    curl = ai_handle();
+    if (!curl) {
+        fprintf(stderr, "Failed to initialize curl\n");
+        return NULL;
+    }
+
+    /* Build JSON request */
+    json_object *root = json_object_new_object();
+    json_object *messages = json_object_new_array();
+    json_object *system_msg = json_object_new_object();
+    json_object *user_msg = json_object_new_object();
+
+    json_object_object_add(system_msg, "role", json_object_new_string("system"));
+    json_object_object_add(system_msg, "content", json_object_new_string(SYSTEM_PROMPT));
+
+    json_object_object_add(user_msg, "role", json_object_new_string("user"));
+    json_object_object_add(user_msg, "content", json_object_new_string(query));
+
+    json_object_array_add(messages, system_msg);
+    json_object_array_add(messages, user_msg);
+
+    json_object_object_add(root, "model", json_object_new_string(OPENAI_MODEL));
+    json_object_object_add(root, "messages", messages);
+    json_object_object_add(root, "temperature", json_object_new_double(0.3));
+    json_object_object_add(root, "max_tokens", json_object_new_int(150));
+    json_object_object_add(root, "stream", json_object_new_boolean(1));
+
+    json_request = strdup(json_object_to_json_string(root));
+
+    /* Set up headers */
+    snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", api_key);
+    headers = curl_slist_append(headers, auth_header);
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+
+    /* Configure curl */
+    curl_easy_setopt(curl, CURLOPT_URL, OPENAI_API_URL);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_request);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&response);
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
+
+    response.tok = json_tokener_new();
+    if (!response.tok) {
+        fprintf(stderr, "Not enough memory for response\n");
+        goto cleanup;
+    }
+
+    /* Make the request; the text is printed as it arrives */
+    res = ai_perform(curl);
+    if (response.text.data) {
+        printf("\n");
+    }
+
+    if (ai_interrupted) {
+        fflush(stdout);
+        fprintf(stderr, "AI: cancelled\n");
+    } else if (res != CURLE_OK) {
+        fprintf(stderr, "Error: %s\n", curl_easy_strerror(res));
+    } else if (response.events == 0 && response.body.data) {
+        /* Not a stream: a plain JSON reply, such as an error */
+        json_object *response_obj = json_tokener_parse(response.body.data);
+        if (response_obj) {
+            print_api_error(response_obj);
+            json_object_put(response_obj);
+        }
+    }
+    if (res == CURLE_OK && response.text.data) {
+        result = response.text.data;
+        response.text.data = NULL;
+        ai_cache_put(&key, result);
+    }
+
+cleanup:
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, NULL);
+    curl_slist_free_all(headers);
+    free(response.body.data);
+    free(response.text.data);
+    if (response.tok) {
+        json_tokener_free(response.tok);
+    }
+    free(json_request);
+    json_object_put(root);
+
+    return result;
+}
+
+/*
+ * AI command implementation - run function
+ */
+static int cmd_ai_run(int argc, char **argv)
+{
+    char query[2048] = "";
+    size_t len = 0;
+    char *response;
+    int i;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: AI <question>\n");
+        fprintf(stderr, "Example: AI how do I list all files\n");
+        return EXIT_ERROR;
+    }
+
+    /* Combine all arguments into a single query string */
+    for (i = 1; i < argc; i++) {
+        if (len > 0 && len < sizeof(query) - 1) {
+            query[len++] = ' ';
+        }
+        size_t word_len = strlen(argv[i]);
+        if (len + word_len < sizeof(query) - 1) {
+            strcpy(query + len, argv[i]);
+            len += word_len;
+        }
+    }
+    query[len] = '\0';
+
+    printf("🤔 Thinking...\n");
+    fflush(stdout);
+
+    /* Make API request */
+    response = make_openai_request(query);
+
+    if (!response) {
+        if (ai_interrupted) {
+            return 128 + SIGINT;
+        }
+        fprintf(stderr, "Failed to get AI response\n");
+        return EXIT_ERROR;
+    }
+
+    /* The response was printed as it arrived */
+    free(response);
+    return EXIT_OK;
+}
+
+/*
+ * Print usage information
+ */
+static void cmd_ai_print_usage(FILE *out)
+{
+    fprintf(out, "Usage: AI <question>\n");
+    fprintf(out, "\n");
+    fprintf(out, "Ask the AI assistant for help with shell commands.\n");
+    fprintf(out, "\n");
+    fprintf(out, "Examples:\n");
+    fprintf(out, "  AI how do I list all files\n");
+    fprintf(out, "  AI what command shows disk usage\n");
+    fprintf(out, "  AI explain the grep command\n");
+    fprintf(out, "  AI what does tar -x do &   (answer in the background)\n");
+    fprintf(out, "\n");
+    fprintf(out, "Ctrl-C cancels a request.\n");
+    fprintf(out, "\n");
+    fprintf(out, "Note: Requires AI_SHELL environment variable to be set with OpenAI API key.\n");
+}
+
+/*
+ * Command specification
+ */
+cmd_spec_t cmd_ai_spec = {
+    .name = "AI",
+    .summary = "Ask AI assistant for shell command help",
+    .long_help = NULL,
+    .run = cmd_ai_run,
+    .print_usage = cmd_ai_print_usage
+};
+
+/*
+ * Registration function (called from main)
+ */
+#ifdef BUILTIN_ONLY
+void register_ai_command(void)
+{
+    register_command(&cmd_ai_spec);
+}
+#else
+/*
+ * Standalone mode - for testing
+ */
+int main(int argc, char **argv)
+{
+    return cmd_ai_run(argc, argv);
+}
+#endif
@@ -0,0 +1,2013 @@
+/*
+ * cmd_pkg.c - Package manager for PicoBox
+ *
+ * Manages installation of packages to ~/.mysh/
+ * Package format: .tar.gz with pkg.json metadata
+ *
+ * The archive is extracted in process, straight into a staging
+ * directory beside the installed packages, which is renamed into place
+ * once pkg.json has named it: every file is written once, and a package
+ * directory is never seen half-populated. Upgrades stage the new
+ * version the same way and then swap it in (see publish_staged()).
+ *
+ * Integrity: a "<package>.tar.gz.sha256" next to the tarball (as
+ * written by sha256sum) is checked before anything is extracted, and a
+ * SHA256SUMS manifest inside the package is checked, in parallel,
+ * before anything is installed. A mismatch aborts the install.
+ *
+ * Packages named rather than given as files come from a repository
+ * ($PKG_REPO, or ~/.mysh/repo) whose INDEX lists each one's version,
+ * archive and SHA-256. All the archives needed are downloaded at once
+ * (pkg_fetch.h), each streamed through a pipe into an extracting
+ * thread, so unpacking keeps pace with the network. The INDEX is
+ * cached as repo.db, in the same format as pkgdb.db, and revalidated
+ * with a conditional request once it is PKG_INDEX_TTL old.
+ *
+ * Regular files are hard links into a content-addressed store
+ * (pkg_store.h), so identical files across packages and versions take
+ * their space once; removing or upgrading a package collects the
+ * objects nothing links to any more.
+ *
+ * Installed packages are recorded in pkgdb.db (pkg_db.h), mapped and
+ * looked up by name through its hash table; pkgdb.json is kept as an
+ * export of it.
+ *
+ * Built as a plugin (build/plugins/pkg.so, with tar_extract.c,
+ * pkg_fetch.c and pkg_store.c) that picobox loads the first time pkg
+ * runs (see plugin.c), so nothing else links libcurl or zlib.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* openat(), O_DIRECTORY, fdopen(), renameat2(), pipe2() */
+#endif
+
+#include "picobox.h"
+#include "cmd_spec.h"
+#include "checksum.h"
+#include "tar_extract.h"
+#include "pkg_db.h"
+#include "pkg_fetch.h"
+#include "pkg_store.h"
+#include "tree_remove.h"
+#include <argtable3.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <pthread.h>
+#include <time.h>
+
+// Seconds a cached repository index is used without asking the server
+#define PKG_INDEX_TTL 300
+
+// === PACKAGE STRUCTURE ===
+
+// Package metadata from pkg.json
+typedef struct {
+    char name[64];
+    char version[32];
+    char description[256];
+    char **binaries;      // Array of binary names to symlink
+    int binary_count;
+} PkgInfo;
+
+
+// Installed package record
+typedef struct {
+    char name[64];
+    char version[32];
+    char description[256];
+    char install_date[32];
+    char path[512];       // Full path to package directory
+} InstalledPkg;
+
+// The package database, mapped (format in pkg_db.h)
+typedef struct {
+    const unsigned char *map;
+    size_t size;
+    const pkg_db_hdr_t *hdr;
+    const uint32_t *buckets;
+    const uint32_t *by_name;
+    const pkg_db_rec_t *recs;
+    const char *strings;
+    size_t strings_len;
+} PkgDb;
+
+// A package in the repository index
+typedef struct {
+    char name[64];
+    char version[32];
+    char description[256];
+    char sha256[65];
+    char url[1024];
+} RepoPkg;
+
+// A download being extracted as it arrives
+typedef struct {
+    const RepoPkg *pkg;
+    char staging[512];
+    int dirfd;
+    int rfd;              // Read end of the pipe the download is written to
+    int result;           // tar_extract_fd()'s
+    pthread_t thread;
+} Download;
+
+// One record of a database being written (fields as in pkg_db_rec_t)
+typedef struct {
+    const char *name;
+    const char *version;
+    const char *description;
+    const char *install_date;
+    const char *path;
+    const char *sha256;
+    const char *url;
+} PkgDbEntry;
+
+// The string pool of a database being written
+typedef struct {
+    char *p;
+    size_t len;
+    size_t cap;
+} PkgDbStrings;
+
+// A name to sort, with its record
+typedef struct {
+    const char *name;
+    uint32_t rec;
+} PkgDbName;
+
+// === GLOBALS ===
+static char mysh_home[512];     // ~/.mysh/
+static char pkg_dir[512];       // ~/.mysh/packages/
+static char bin_dir[512];       // ~/.mysh/bin/
+static char pkgdb_path[512];    // ~/.mysh/pkgdb.json
+static char pkgdb_bin_path[512];    // ~/.mysh/pkgdb.db
+static char store_dir[512];     // ~/.mysh/store/
+static char repo_cache_path[512];   // ~/.mysh/repo.db
+
+// === HELPER FUNCTIONS ===
+
+/* Initialize package manager paths */
+// Flow: Sets up global paths used throughout the package manager
+static int init_pkg_paths(void) {
+    const char *home = getenv("HOME");
+    if (!home) {
+        fprintf(stderr, "pkg: HOME environment variable not set\n");
+        return -1;
+    }
+
+    // Every path under ~/.mysh must fit its buffer
+    if (snprintf(mysh_home, sizeof(mysh_home), "%s/.mysh", home) >= (int)sizeof(mysh_home) ||
+        snprintf(pkg_dir, sizeof(pkg_dir), "%s/packages", mysh_home) >= (int)sizeof(pkg_dir) ||
+        snprintf(bin_dir, sizeof(bin_dir), "%s/bin", mysh_home) >= (int)sizeof(bin_dir) ||
+        snprintf(pkgdb_path, sizeof(pkgdb_path), "%s/pkgdb.json",
+                 mysh_home) >= (int)sizeof(pkgdb_path) ||
+        snprintf(pkgdb_bin_path, sizeof(pkgdb_bin_path), "%s/pkgdb.db",
+                 mysh_home) >= (int)sizeof(pkgdb_bin_path) ||
+        snprintf(store_dir, sizeof(store_dir), "%s/store", mysh_home) >= (int)sizeof(store_dir) ||
+        snprintf(repo_cache_path, sizeof(repo_cache_path), "%s/repo.db",
+                 mysh_home) >= (int)sizeof(repo_cache_path)) {
+        fprintf(stderr, "pkg: %s: %s\n", home, strerror(ENAMETOOLONG));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Create directory structure if it doesn't exist */
+static int ensure_directories(void) {
+    struct stat st;
+
+    // Create ~/.mysh
+    if (stat(mysh_home, &st) != 0) {
+        if (mkdir(mysh_home, 0755) != 0) {
+            perror(mysh_home);
+            return -1;
+        }
+    }
+
+    // Create ~/.mysh/packages
+    if (stat(pkg_dir, &st) != 0) {
+        if (mkdir(pkg_dir, 0755) != 0) {
+            perror(pkg_dir);
+            return -1;
+        }
+    }
+
+    // Create ~/.mysh/bin
+    if (stat(bin_dir, &st) != 0) {
+        if (mkdir(bin_dir, 0755) != 0) {
+            perror(bin_dir);
+            return -1;
+        }
+    }
+
+    // Create empty pkgdb.json if it doesn't exist
+    if (stat(pkgdb_path, &st) != 0) {
+        FILE *fp = fopen(pkgdb_path, "w");
+        if (!fp) {
+            perror(pkgdb_path);
+            return -1;
+        }
+        fprintf(fp, "{\"installed\":[]}\n");
+        fclose(fp);
+    }
+
+    return 0;
+}
+
+/* Simple JSON parser for pkg.json uses string searches instead of external libs
+ * Looks for "name": "value" patterns
+ */
+static int parse_pkg_json(const char *path, PkgInfo *info) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    char line[512];
+    info->binary_count = 0;
+    info->binaries = NULL;
+
+    while (fgets(line, sizeof(line), fp)) {
+        // Parse "name": "value"
+        char *key = strstr(line, "\"name\"");
+        if (key && !strstr(line, "binaries")) {
+            char *val_start = strchr(key + 6, '"');
+            if (val_start) {
+                val_start++;  // Skip opening quote
+                char *val_end = strchr(val_start, '"');
+                if (val_end) {
+                    size_t len = val_end - val_start;
+                    if (len < sizeof(info->name)) {
+                        strncpy(info->name, val_start, len);
+                        info->name[len] = '\0';
+                    }
+                }
+            }
+        }
+
+        // Parse "version"
+        key = strstr(line, "\"version\"");
+        if (key) {
+            char *val_start = strchr(key + 9, '"');
+            if (val_start) {
+                val_start++;
+                char *val_end = strchr(val_start, '"');
+                if (val_end) {
+                    size_t len = val_end - val_start;
+                    if (len < sizeof(info->version)) {
+                        strncpy(info->version, val_start, len);
+                        info->version[len] = '\0';
+                    }
+                }
+            }
+        }
+
+        // Parse "description"
+        key = strstr(line, "\"description\"");
+        if (key) {
+            char *val_start = strchr(key + 13, '"');
+            if (val_start) {
+                val_start++;
+                char *val_end = strchr(val_start, '"');
+                if (val_end) {
+                    size_t len = val_end - val_start;
+                    if (len < sizeof(info->description)) {
+                        strncpy(info->description, val_start, len);
+                        info->description[len] = '\0';
+                    }
+                }
+            }
+        }
+
+        // Parse "binaries" array - simple approach, expects ["bin1", "bin2"]
+        key = strstr(line, "\"binaries\"");
+        if (key) {
+            char *array_start = strchr(key, '[');
+            if (array_start) {
+                // Count binaries
+                char *p = array_start;
+                int count = 0;
+                while ((p = strchr(p, '"')) != NULL && p < strchr(array_start, ']')) {
+                    count++;
+                    p++;
+                }
+
+                info->binary_count = count / 2;  // Each binary has 2 quotes
+                if (info->binary_count > 0) {
+                    info->binaries = malloc(info->binary_count * sizeof(char *));
+
+                    // Extract binary names
+                    p = array_start;
+                    for (int i = 0; i < info->binary_count; i++) {
+                        p = strchr(p, '"');
+                        if (p) {
+                            p++;  // Skip opening quote
+                            char *end = strchr(p, '"');
+                            if (end) {
+                                size_t len = end - p;
+                                info->binaries[i] = malloc(len + 1);
+                                strncpy(info->binaries[i], p, len);
+                                info->binaries[i][len] = '\0';
+                                p = end + 1;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    fclose(fp);
+
+    // Validate required fields
+    if (info->name[0] == '\0' || info->version[0] == '\0') {
+        fprintf(stderr, "pkg: Invalid pkg.json - missing name or version\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Free PkgInfo resources */
+static void free_pkg_info(PkgInfo *info) {
+    if (info->binaries) {
+        for (int i = 0; i < info->binary_count; i++) {
+            free(info->binaries[i]);
+        }
+        free(info->binaries);
+        info->binaries = NULL;
+    }
+}
+
+/* Extract tar.gz file to destination directory, in process (tar_extract.h) */
+static int extract_tar(const char *tarfile, const char *dest_dir) {
+    int dirfd = open(dest_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int ret;
+
+    if (dirfd < 0) {
+        perror(dest_dir);
+        return -1;
+    }
+    ret = tar_extract_at(tarfile, dirfd, "pkg install");
+    close(dirfd);
+
+    if (ret != 0) {
+        fprintf(stderr, "pkg: tar extraction failed\n");
+    }
+    return ret;
+}
+
+/*
+ * Check the tarball against "<tarfile>.sha256" beside it, if there is one
+ * Returns: 0 if it matches or there is none, -1 otherwise
+ */
+static int verify_tarball(const char *tarfile) {
+    char sidecar[1024];
+    char expected[CHECKSUM_HEX_MAX];
+    char *names[1] = { (char *)tarfile };
+    checksum_result_t res;
+    FILE *fp;
+
+    snprintf(sidecar, sizeof(sidecar), "%s.sha256", tarfile);
+    fp = fopen(sidecar, "r");
+    if (!fp) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        perror(sidecar);
+        return -1;
+    }
+
+    // First field of a sha256sum line is the digest
+    if (fscanf(fp, "%64s", expected) != 1 ||
+        strlen(expected) != checksum_hex_len(CHECKSUM_SHA256)) {
+        fprintf(stderr, "pkg install: %s: no SHA-256 checksum found\n", sidecar);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    checksum_files(CHECKSUM_SHA256, AT_FDCWD, stdin, names, 1, &res);
+    if (res.err) {
+        fprintf(stderr, "pkg install: %s: %s\n", tarfile, strerror(res.err));
+        return -1;
+    }
+    if (strcasecmp(res.hex, expected) != 0) {
+        fprintf(stderr, "pkg install: %s: checksum does not match %s\n", tarfile, sidecar);
+        return -1;
+    }
+    printf("Checksum OK (%s)\n", sidecar);
+    return 0;
+}
+
+/*
+ * Check the extracted files against the package's SHA256SUMS, if it has
+ * one; names in it are relative to the package root
+ * Returns: 0 if every file matches or there is no manifest, -1 otherwise
+ */
+static int verify_contents(const char *dir) {
+    int dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int fd;
+    FILE *fp;
+    int ret;
+
+    if (dirfd < 0) {
+        perror(dir);
+        return -1;
+    }
+    fd = openat(dirfd, "SHA256SUMS", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ret = errno == ENOENT ? 0 : -1;
+        if (ret != 0) {
+            perror("SHA256SUMS");
+        }
+        close(dirfd);
+        return ret;
+    }
+    fp = fdopen(fd, "r");
+    if (!fp) {
+        perror("SHA256SUMS");
+        close(fd);
+        close(dirfd);
+        return -1;
+    }
+
+    printf("Verifying package contents...\n");
+    fflush(stdout);
+    ret = checksum_check(CHECKSUM_SHA256, dirfd, stdin, fp, "SHA256SUMS", stdout,
+                         CHECKSUM_QUIET, "pkg install");
+    fclose(fp);
+    close(dirfd);
+    return ret;
+}
+
+/* Today's date as recorded in the database */
+static void pkgdb_date(char *date, size_t size) {
+    time_t now = time(NULL);
+    strftime(date, size, "%Y-%m-%d", localtime(&now));
+}
+
+/*
+ * The database files are never rewritten in place: the new contents go
+ * to a temporary file beside one, which is renamed over it, so a reader
+ * sees the old database or the new one and never half of either.
+ */
+static FILE *pkgdb_begin(const char *path, char *tmp, size_t size) {
+    snprintf(tmp, size, "%s.tmp%d", path, getpid());
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        perror(tmp);
+    }
+    return fp;
+}
+
+/* Put the file from pkgdb_begin() in place of path */
+static int pkgdb_commit(FILE *fp, const char *tmp, const char *path) {
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+        perror(path);
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/* Export packages[0..count), leaving out skip if given, to pkgdb.json */
+static int export_pkgdb_json(const InstalledPkg *packages, int count, const char *skip) {
+    char tmp[600];
+    FILE *fp = pkgdb_begin(pkgdb_path, tmp, sizeof(tmp));
+    if (!fp) {
+        return -1;
+    }
+
+    fprintf(fp, "{\"installed\":[");
+    int first = 1;
+    for (int i = 0; i < count; i++) {
+        if (!skip || strcmp(packages[i].name, skip) != 0) {
+            if (!first) fprintf(fp, ",");
+            fprintf(fp, "{\"name\":\"%s\",\"version\":\"%s\",\"description\":\"%s\",\"date\":\"%s\",\"path\":\"%s\"}",
+                    packages[i].name, packages[i].version, packages[i].description,
+                    packages[i].install_date, packages[i].path);
+            first = 0;
+        }
+    }
+    fprintf(fp, "]}\n");
+    return pkgdb_commit(fp, tmp, pkgdb_path);
+}
+
+/*
+ * Append str to the pool; every empty string (or NULL) is the one at
+ * offset 0, which the first call puts there
+ * Returns: its offset, or UINT32_MAX when out of memory
+ */
+static uint32_t pkg_db_intern(PkgDbStrings *pool, const char *str) {
+    if (!str) {
+        str = "";
+    }
+    if (!*str && pool->len > 0) {
+        return 0;
+    }
+
+    size_t n = strlen(str) + 1;
+    uint32_t off = (uint32_t)pool->len;
+
+    if (pool->len + n > pool->cap) {
+        size_t cap = pool->cap ? pool->cap * 2 : 4096;
+        while (cap < pool->len + n) {
+            cap *= 2;
+        }
+        char *p = realloc(pool->p, cap);
+        if (!p || cap > UINT32_MAX) {
+            free(p);
+            pool->p = NULL;
+            return UINT32_MAX;
+        }
+        pool->p = p;
+        pool->cap = cap;
+    }
+    memcpy(pool->p + pool->len, str, n);
+    pool->len += n;
+    return off;
+}
+
+static int pkg_db_name_cmp(const void *a, const void *b) {
+    return strcmp(((const PkgDbName *)a)->name, ((const PkgDbName *)b)->name);
+}
+
+/*
+ * Write entries[0..n) as the database at path (format in pkg_db.h),
+ * with origin, etag and last_modified (each may be NULL) in its header
+ */
+static int write_db(const char *path, const PkgDbEntry *entries, uint32_t n,
+                    const char *origin, const char *etag, const char *last_modified) {
+    pkg_db_hdr_t hdr;
+    pkg_db_rec_t *recs = malloc((n ? n : 1) * sizeof(*recs));
+    PkgDbName *names = malloc((n ? n : 1) * sizeof(*names));
+    uint32_t *by_name = malloc((n ? n : 1) * sizeof(*by_name));
+    PkgDbStrings pool = { NULL, 0, 0 };
+    uint32_t nbuckets = 8;
+    uint32_t *buckets;
+    char tmp[600];
+    FILE *fp;
+    int ok;
+
+    while (nbuckets < 2 * n) {
+        nbuckets *= 2;
+    }
+    buckets = calloc(nbuckets, sizeof(*buckets));
+
+    memset(&hdr, 0, sizeof(hdr));
+    ok = recs && names && by_name && buckets && pkg_db_intern(&pool, "") == 0;
+    hdr.origin = pkg_db_intern(&pool, origin);
+    hdr.etag = pkg_db_intern(&pool, etag);
+    hdr.last_modified = pkg_db_intern(&pool, last_modified);
+    ok = ok && hdr.origin != UINT32_MAX && hdr.etag != UINT32_MAX &&
+         hdr.last_modified != UINT32_MAX;
+
+    // Chain each record to the front of its bucket
+    for (uint32_t i = 0; ok && i < n; i++) {
+        const PkgDbEntry *e = &entries[i];
+        uint32_t b = pkg_db_hash(e->name) & (nbuckets - 1);
+        pkg_db_rec_t *rec = &recs[i];
+
+        rec->name = pkg_db_intern(&pool, e->name);
+        rec->version = pkg_db_intern(&pool, e->version);
+        rec->description = pkg_db_intern(&pool, e->description);
+        rec->install_date = pkg_db_intern(&pool, e->install_date);
+        rec->path = pkg_db_intern(&pool, e->path);
+        rec->sha256 = pkg_db_intern(&pool, e->sha256);
+        rec->url = pkg_db_intern(&pool, e->url);
+        ok = rec->name != UINT32_MAX && rec->version != UINT32_MAX &&
+             rec->description != UINT32_MAX && rec->install_date != UINT32_MAX &&
+             rec->path != UINT32_MAX && rec->sha256 != UINT32_MAX && rec->url != UINT32_MAX;
+        rec->next = buckets[b];
+        buckets[b] = i + 1;
+        names[i].name = e->name;
+        names[i].rec = i;
+    }
+    if (!ok) {
+        fprintf(stderr, "pkg: %s\n", strerror(ENOMEM));
+        goto out;
+    }
+
+    qsort(names, n, sizeof(*names), pkg_db_name_cmp);
+    for (uint32_t i = 0; i < n; i++) {
+        by_name[i] = names[i].rec;
+    }
+
+    hdr.magic = PKG_DB_MAGIC;
+    hdr.version = PKG_DB_VERSION;
+    hdr.nrecs = n;
+    hdr.nbuckets = nbuckets;
+    hdr.size = sizeof(hdr) + (uint64_t)nbuckets * sizeof(*buckets) +
+               (uint64_t)n * (sizeof(*by_name) + sizeof(*recs)) + pool.len;
+
+    fp = pkgdb_begin(path, tmp, sizeof(tmp));
+    ok = fp != NULL &&
+         fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+         fwrite(buckets, sizeof(*buckets), nbuckets, fp) == nbuckets &&
+         fwrite(by_name, sizeof(*by_name), n, fp) == n &&
+         fwrite(recs, sizeof(*recs), n, fp) == n &&
+         fwrite(pool.p, 1, pool.len, fp) == pool.len;
+    if (fp && !ok) {
+        perror(tmp);
+        fclose(fp);
+        unlink(tmp);
+    }
+    ok = ok && pkgdb_commit(fp, tmp, path) == 0;
+
+out:
+    free(recs);
+    free(names);
+    free(by_name);
+    free(buckets);
+    free(pool.p);
+    return ok ? 0 : -1;
+}
+
+/*
+ * Write packages[0..count), leaving out skip if given, as pkgdb.db,
+ * then export them to pkgdb.json
+ */
+static int write_pkgdb(const InstalledPkg *packages, int count, const char *skip) {
+    PkgDbEntry *entries = malloc((count > 0 ? count : 1) * sizeof(*entries));
+    uint32_t n = 0;
+    int ret;
+
+    if (!entries) {
+        fprintf(stderr, "pkg: %s\n", strerror(ENOMEM));
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        const InstalledPkg *pkg = &packages[i];
+
+        if (!skip || strcmp(pkg->name, skip) != 0) {
+            PkgDbEntry e = { pkg->name, pkg->version, pkg->description, pkg->install_date,
+                             pkg->path, NULL, NULL };
+            entries[n++] = e;
+        }
+    }
+
+    ret = write_db(pkgdb_bin_path, entries, n, NULL, NULL, NULL) == 0 &&
+          export_pkgdb_json(packages, count, skip) == 0 ? 0 : -1;
+    free(entries);
+    return ret;
+}
+
+/* Read pkgdb.json, the database before pkgdb.db, into a new array */
+static int read_pkgdb_json(InstalledPkg **packages, int *count) {
+    FILE *fp = fopen(pkgdb_path, "r");
+    if (!fp) {
+        *count = 0;
+        *packages = NULL;
+        return 0;  // Empty is OK
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    char *content = malloc(size + 1);
+    fread(content, 1, size, fp);
+    content[size] = '\0';
+    fclose(fp);
+
+    // Count packages (count occurrences of "name":")
+    int pkg_count = 0;
+    char *p = content;
+    while ((p = strstr(p, "\"name\":")) != NULL) {
+        pkg_count++;
+        p += 7;
+    }
+
+    if (pkg_count == 0) {
+        free(content);
+        *count = 0;
+        *packages = NULL;
+        return 0;
+    }
+
+    *packages = malloc(pkg_count * sizeof(InstalledPkg));
+    *count = pkg_count;
+
+    // Parse each package
+    p = content;
+    for (int i = 0; i < pkg_count; i++) {
+        InstalledPkg *pkg = &(*packages)[i];
+        memset(pkg, 0, sizeof(InstalledPkg));
+
+        // Find name
+        p = strstr(p, "\"name\":\"");
+        if (p) {
+            p += 8;
+            char *end = strchr(p, '"');
+            if (end) {
+                size_t len = end - p;
+                if (len < sizeof(pkg->name)) {
+                    strncpy(pkg->name, p, len);
+                    pkg->name[len] = '\0';
+                }
+            }
+        }
+
+        // Find version
+        p = strstr(p, "\"version\":\"");
+        if (p) {
+            p += 11;
+            char *end = strchr(p, '"');
+            if (end) {
+                size_t len = end - p;
+                if (len < sizeof(pkg->version)) {
+                    strncpy(pkg->version, p, len);
+                    pkg->version[len] = '\0';
+                }
+            }
+        }
+
+        // Find description
+        p = strstr(p, "\"description\":\"");
+        if (p) {
+            p += 15;
+            char *end = strchr(p, '"');
+            if (end) {
+                size_t len = end - p;
+                if (len < sizeof(pkg->description)) {
+                    strncpy(pkg->description, p, len);
+                    pkg->description[len] = '\0';
+                }
+            }
+        }
+
+        // Find install date
+        p = strstr(p, "\"date\":\"");
+        if (p) {
+            p += 8;
+            char *end = strchr(p, '"');
+            if (end) {
+                size_t len = end - p;
+                if (len < sizeof(pkg->install_date)) {
+                    strncpy(pkg->install_date, p, len);
+                    pkg->install_date[len] = '\0';
+                }
+            }
+        }
+
+        // Find path
+        p = strstr(p, "\"path\":\"");
+        if (p) {
+            p += 8;
+            char *end = strchr(p, '"');
+            if (end) {
+                size_t len = end - p;
+                if (len < sizeof(pkg->path)) {
+                    strncpy(pkg->path, p, len);
+                    pkg->path[len] = '\0';
+                }
+            }
+        }
+    }
+
+    free(content);
+    return 0;
+}
+
+/*
+ * Map the database at path
+ * Returns: 0; -1 if it could not be read (errno set); -2 if it is not
+ * a database, or not of this version
+ */
+static int pkg_db_map(PkgDb *db, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    const pkg_db_hdr_t *h;
+    void *map;
+
+    memset(db, 0, sizeof(*db));
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        int err = errno;
+
+        if (fd >= 0) {
+            close(fd);
+        }
+        errno = err;
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(pkg_db_hdr_t)) {
+        close(fd);
+        return -2;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    db->map = map;
+    db->size = (size_t)st.st_size;
+
+    // Every string ends inside the pool, since its last byte is a NUL
+    h = map;
+    uint64_t strings_off = sizeof(*h) + (uint64_t)h->nbuckets * sizeof(uint32_t) +
+                           (uint64_t)h->nrecs * (sizeof(uint32_t) + sizeof(pkg_db_rec_t));
+    if (h->magic != PKG_DB_MAGIC || h->version != PKG_DB_VERSION ||
+        h->size != db->size || h->nbuckets == 0 ||
+        (h->nbuckets & (h->nbuckets - 1)) != 0 || strings_off >= h->size ||
+        db->map[h->size - 1] != '\0') {
+        munmap(map, db->size);
+        db->map = NULL;
+        return -2;
+    }
+    db->hdr = h;
+    db->buckets = (const uint32_t *)(db->map + sizeof(*h));
+    db->by_name = db->buckets + h->nbuckets;
+    db->recs = (const pkg_db_rec_t *)(db->by_name + h->nrecs);
+    db->strings = (const char *)db->map + strings_off;
+    db->strings_len = (size_t)(h->size - strings_off);
+    return 0;
+}
+
+/*
+ * Map pkgdb.db, first importing pkgdb.json (kept up to date beside it)
+ * if there is none or it is of an older format
+ * Returns: 0, or -1 with a message printed
+ */
+static int pkg_db_open(PkgDb *db) {
+    int r = pkg_db_map(db, pkgdb_bin_path);
+
+    if (r == -2 || (r == -1 && errno == ENOENT)) {
+        InstalledPkg *packages = NULL;
+        int count = 0;
+
+        read_pkgdb_json(&packages, &count);
+        r = write_pkgdb(packages, count, NULL) == 0 ? pkg_db_map(db, pkgdb_bin_path) : -3;
+        free(packages);
+    }
+    if (r != 0) {
+        if (r != -3) {
+            fprintf(stderr, "pkg: %s: %s\n", pkgdb_bin_path,
+                    r == -1 ? strerror(errno) : "not a package database");
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static void pkg_db_close(PkgDb *db) {
+    if (db->map) {
+        munmap((void *)db->map, db->size);
+    }
+}
+
+/* A field of a record */
+static const char *pkg_db_str(const PkgDb *db, uint32_t off) {
+    return off < db->strings_len ? db->strings + off : "";
+}
+
+/* Unpack record i */
+static void pkg_db_get(const PkgDb *db, uint32_t i, InstalledPkg *pkg) {
+    const pkg_db_rec_t *rec = &db->recs[i];
+
+    snprintf(pkg->name, sizeof(pkg->name), "%s", pkg_db_str(db, rec->name));
+    snprintf(pkg->version, sizeof(pkg->version), "%s", pkg_db_str(db, rec->version));
+    snprintf(pkg->description, sizeof(pkg->description), "%s", pkg_db_str(db, rec->description));
+    snprintf(pkg->install_date, sizeof(pkg->install_date), "%s", pkg_db_str(db, rec->install_date));
+    snprintf(pkg->path, sizeof(pkg->path), "%s", pkg_db_str(db, rec->path));
+}
+
+/* The record number of the package called name, or -1 */
+static long pkg_db_find(const PkgDb *db, const char *name) {
+    uint32_t i = db->buckets[pkg_db_hash(name) & (db->hdr->nbuckets - 1)];
+
+    // A chain is never longer than the table; stop a damaged one there
+    for (uint32_t steps = 0; i != 0 && i <= db->hdr->nrecs && steps < db->hdr->nrecs; steps++) {
+        const pkg_db_rec_t *rec = &db->recs[i - 1];
+
+        if (strcmp(pkg_db_str(db, rec->name), name) == 0) {
+            return (long)i - 1;
+        }
+        i = rec->next;
+    }
+    return -1;
+}
+
+/* The name of the k-th record in name order */
+static const char *pkg_db_name_at(const PkgDb *db, uint32_t k) {
+    uint32_t i = db->by_name[k];
+    return i < db->hdr->nrecs ? pkg_db_str(db, db->recs[i].name) : "";
+}
+
+/*
+ * The records whose names start with prefix are those numbered
+ * by_name[*first .. *first + count)
+ * Returns: count
+ */
+static uint32_t pkg_db_prefix(const PkgDb *db, const char *prefix, uint32_t *first) {
+    size_t len = strlen(prefix);
+    uint32_t lo = 0;
+    uint32_t hi = db->hdr->nrecs;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (strcmp(pkg_db_name_at(db, mid), prefix) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (hi = lo; hi < db->hdr->nrecs && strncmp(pkg_db_name_at(db, hi), prefix, len) == 0; hi++) {
+    }
+    *first = lo;
+    return hi - lo;
+}
+
+/* Copy the installed packages into a new array, with room for one more */
+static int read_pkgdb(InstalledPkg **packages, int *count) {
+    PkgDb db;
+
+    if (pkg_db_open(&db) != 0) {
+        return -1;
+    }
+    *count = (int)db.hdr->nrecs;
+    *packages = malloc((*count + 1) * sizeof(InstalledPkg));
+    if (!*packages) {
+        fprintf(stderr, "pkg: %s\n", strerror(ENOMEM));
+        pkg_db_close(&db);
+        return -1;
+    }
+    for (int i = 0; i < *count; i++) {
+        pkg_db_get(&db, (uint32_t)i, &(*packages)[i]);
+    }
+    pkg_db_close(&db);
+    return 0;
+}
+
+/* Add package to the database */
+static int add_to_pkgdb(const PkgInfo *info, const char *install_path) {
+    InstalledPkg *packages = NULL;
+    int count = 0;
+    int ret;
+
+    if (read_pkgdb(&packages, &count) != 0) {
+        return -1;
+    }
+
+    InstalledPkg *pkg = &packages[count];
+    memset(pkg, 0, sizeof(*pkg));
+    snprintf(pkg->name, sizeof(pkg->name), "%s", info->name);
+    snprintf(pkg->version, sizeof(pkg->version), "%s", info->version);
+    snprintf(pkg->description, sizeof(pkg->description), "%s", info->description);
+    snprintf(pkg->path, sizeof(pkg->path), "%s", install_path);
+    pkgdb_date(pkg->install_date, sizeof(pkg->install_date));
+
+    ret = write_pkgdb(packages, count + 1, NULL);
+    free(packages);
+    return ret;
+}
+
+/* Check if package is already installed, and where (path may be NULL) */
+static int is_installed(const char *name, char *path, size_t size) {
+    PkgDb db;
+    long i;
+
+    if (pkg_db_open(&db) != 0) {
+        return 0;
+    }
+
+    i = pkg_db_find(&db, name);
+    if (i >= 0 && path) {
+        snprintf(path, size, "%s", pkg_db_str(&db, db.recs[i].path));
+    }
+    pkg_db_close(&db);
+    return i >= 0;
+}
+
+/* Point the database entry for info->name at a new version */
+static int update_pkgdb(const PkgInfo *info, const char *install_path) {
+    InstalledPkg *packages = NULL;
+    int count = 0;
+    int ret;
+
+    if (read_pkgdb(&packages, &count) != 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (strcmp(packages[i].name, info->name) == 0) {
+            snprintf(packages[i].version, sizeof(packages[i].version), "%s", info->version);
+            snprintf(packages[i].description, sizeof(packages[i].description), "%s", info->description);
+            snprintf(packages[i].path, sizeof(packages[i].path), "%s", install_path);
+            pkgdb_date(packages[i].install_date, sizeof(packages[i].install_date));
+        }
+    }
+
+    ret = write_pkgdb(packages, count, NULL);
+    free(packages);
+    return ret;
+}
+
+/*
+ * Put the staged tree at install_path with one rename(). When
+ * install_path is already there (the same version, upgraded over
+ * itself) the two are exchanged with renameat2(RENAME_EXCHANGE), which
+ * leaves the old tree at staging for the caller to remove; where the
+ * kernel can't exchange, the old tree is moved to staging first and
+ * there is a moment with neither in place.
+ * Returns: 0, or -1
+ */
+static int publish_staged(const char *staging, const char *install_path) {
+    char aside[600];
+
+    if (rename(staging, install_path) == 0) {
+        return 0;
+    }
+    if (errno != EEXIST && errno != ENOTEMPTY) {
+        fprintf(stderr, "pkg install: %s: %s\n", install_path, strerror(errno));
+        return -1;
+    }
+
+#ifdef RENAME_EXCHANGE
+    if (renameat2(AT_FDCWD, staging, AT_FDCWD, install_path, RENAME_EXCHANGE) == 0) {
+        return 0;
+    }
+    if (errno != EINVAL && errno != ENOSYS) {
+        fprintf(stderr, "pkg install: %s: %s\n", install_path, strerror(errno));
+        return -1;
+    }
+#endif
+
+    snprintf(aside, sizeof(aside), "%s.old", staging);
+    if (rename(install_path, aside) != 0) {
+        fprintf(stderr, "pkg install: %s: %s\n", install_path, strerror(errno));
+        return -1;
+    }
+    if (rename(staging, install_path) != 0) {
+        fprintf(stderr, "pkg install: %s: %s\n", install_path, strerror(errno));
+        rename(aside, install_path);
+        return -1;
+    }
+    if (rename(aside, staging) != 0) {
+        tree_remove_at(AT_FDCWD, aside, "pkg install");
+    }
+    return 0;
+}
+
+/* Point link_path at target, replacing an existing link in one step */
+static int replace_symlink(const char *target, const char *link_path) {
+    char tmp[600];
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp%d", link_path, getpid()) >= (int)sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    unlink(tmp);
+    if (symlink(target, tmp) != 0) {
+        return -1;
+    }
+    if (rename(tmp, link_path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// === SUBCOMMAND IMPLEMENTATIONS ===
+
+/*
+ * Install the package extracted into temp_dir, which is gone afterwards
+ * (renamed into place or removed); tarfile names it in messages. Does
+ * pkg upgrade when upgrade is set.
+ */
+static int install_staged(const char *temp_dir, const char *tarfile, int upgrade) {
+    char pkg_json_path[512];
+    char install_path[512];
+    char old_path[512];
+    PkgInfo info;
+    int ret = EXIT_ERROR;
+
+    if (verify_contents(temp_dir) != 0) {
+        fprintf(stderr, "pkg install: %s: integrity check failed, not installing\n", tarfile);
+        goto cleanup_temp;
+    }
+
+    // Read pkg.json
+    snprintf(pkg_json_path, sizeof(pkg_json_path), "%s/pkg.json", temp_dir);
+    if (parse_pkg_json(pkg_json_path, &info) != 0) {
+        fprintf(stderr, "pkg install: Failed to parse pkg.json\n");
+        goto cleanup_temp;
+    }
+
+    printf("Package: %s version %s\n", info.name, info.version);
+    printf("Description: %s\n", info.description);
+
+    // Check if already installed
+    int upgrading = is_installed(info.name, old_path, sizeof(old_path));
+    if (upgrading && !upgrade) {
+        fprintf(stderr, "pkg install: Package '%s' is already installed\n", info.name);
+        fprintf(stderr, "             Use 'pkg upgrade %s' to replace it\n", tarfile);
+        free_pkg_info(&info);
+        goto cleanup_temp;
+    }
+
+    if (snprintf(install_path, sizeof(install_path), "%s/%s-%s",
+                 pkg_dir, info.name, info.version) >= (int)sizeof(install_path)) {
+        fprintf(stderr, "pkg install: %s: %s\n", info.name, strerror(ENAMETOOLONG));
+        free_pkg_info(&info);
+        goto cleanup_temp;
+    }
+    int same_path = upgrading && strcmp(old_path, install_path) == 0;
+
+    // Make binaries executable while nobody can see them yet
+    for (int i = 0; i < info.binary_count; i++) {
+        char target[1024];
+
+        snprintf(target, sizeof(target), "%s/%s", temp_dir, info.binaries[i]);
+        chmod(target, 0755);
+    }
+
+    // Share every file with the packages that already have it
+    if (pkg_store_link(store_dir, temp_dir, "pkg install") != 0) {
+        fprintf(stderr, "pkg install: %s: some files are not shared with other packages\n", tarfile);
+    }
+
+    // Rename the staged tree into place: install_path appears complete or
+    // not at all. A different version goes beside the old one, which
+    // stays in use until the symlinks and database have moved over.
+    printf("Installing to %s...\n", install_path);
+    if (same_path ? publish_staged(temp_dir, install_path) != 0
+                  : rename(temp_dir, install_path) != 0) {
+        if (!same_path) {
+            fprintf(stderr, "pkg install: %s: %s\n", install_path, strerror(errno));
+        }
+        free_pkg_info(&info);
+        goto cleanup_temp;
+    }
+
+    // Create symlinks for binaries, each replacing any old one atomically
+    if (info.binary_count > 0) {
+        printf("Creating symlinks for binaries:\n");
+        for (int i = 0; i < info.binary_count; i++) {
+            char target[1024];
+            char link_path[1024];
+
+            snprintf(target, sizeof(target), "%s/%s",
+                     install_path, info.binaries[i]);
+            snprintf(link_path, sizeof(link_path), "%s/%s",
+                     bin_dir, info.binaries[i]);
+
+            if (replace_symlink(target, link_path) != 0) {
+                fprintf(stderr, "  Warning: Failed to create symlink for %s\n",
+                        info.binaries[i]);
+            } else {
+                printf("  %s -> %s\n", info.binaries[i], target);
+            }
+        }
+    }
+
+    // Add to database
+    if ((upgrading ? update_pkgdb(&info, install_path)
+                   : add_to_pkgdb(&info, install_path)) != 0) {
+        fprintf(stderr, "pkg install: Failed to update package database\n");
+        free_pkg_info(&info);
+        if (same_path) {
+            goto cleanup_temp;
+        }
+        goto cleanup_install;
+    }
+
+    // The old version is no longer referenced
+    if (upgrading && !same_path) {
+        tree_remove_at(AT_FDCWD, old_path, "pkg upgrade");
+    }
+    if (same_path) {
+        tree_remove_at(AT_FDCWD, temp_dir, "pkg upgrade");
+    }
+    if (upgrading) {
+        pkg_store_gc(store_dir, "pkg upgrade");
+    }
+
+    printf("\nPackage '%s' %s successfully!\n", info.name, upgrading ? "upgraded" : "installed");
+    if (info.binary_count > 0) {
+        printf("Binaries are available in %s/\n", bin_dir);
+        printf("Make sure %s is in your PATH\n", bin_dir);
+    }
+
+    free_pkg_info(&info);
+    ret = EXIT_OK;
+    goto cleanup_temp;
+
+
+// Key Design Decision 
+// goto for cleanup: The install function uses goto cleanup_temp 
+// for error handling. This ensures temp directory is always cleaned up:
+
+cleanup_install:
+    // Remove installation directory on failure
+    tree_remove_at(AT_FDCWD, install_path, "pkg install");
+
+cleanup_temp:
+    // Remove temp directory, unless it was renamed into place; after an
+    // exchange it holds the version that was replaced
+    if (access(temp_dir, F_OK) == 0) {
+        tree_remove_at(AT_FDCWD, temp_dir, "pkg install");
+    }
+
+    return ret;
+}
+
+/* pkg install <package.tar.gz>, or pkg upgrade when upgrade is set */
+static int pkg_install(const char *tarfile, int upgrade) {
+    struct stat st;
+    char temp_dir[512];
+
+    // Validate tar file exists
+    if (stat(tarfile, &st) != 0) {
+        fprintf(stderr, "pkg install: %s: ", tarfile);
+        perror("");
+        return EXIT_ERROR;
+    }
+
+    // Create temp directory beside the packages, so it can be renamed into place
+    if (snprintf(temp_dir, sizeof(temp_dir), "%s/.pkg_install_%d",
+                 pkg_dir, getpid()) >= (int)sizeof(temp_dir)) {
+        fprintf(stderr, "pkg install: %s: %s\n", pkg_dir, strerror(ENAMETOOLONG));
+        return EXIT_ERROR;
+    }
+    if (mkdir(temp_dir, 0755) != 0) {
+        perror(temp_dir);
+        return EXIT_ERROR;
+    }
+
+    // Verify, then extract to temp; install_staged() verifies what came out
+    if (verify_tarball(tarfile) != 0) {
+        fprintf(stderr, "pkg install: %s: integrity check failed, not installing\n", tarfile);
+        tree_remove_at(AT_FDCWD, temp_dir, "pkg install");
+        return EXIT_ERROR;
+    }
+
+    printf("Extracting package...\n");
+    if (extract_tar(tarfile, temp_dir) != 0) {
+        tree_remove_at(AT_FDCWD, temp_dir, "pkg install");
+        return EXIT_ERROR;
+    }
+
+    return install_staged(temp_dir, tarfile, upgrade);
+}
+
+/*
+ * The repository's base URL, without a trailing "/": $PKG_REPO, or
+ * else the first line of ~/.mysh/repo
+ */
+static int repo_url(char *url, size_t size) {
+    const char *env = getenv("PKG_REPO");
+    char path[600];
+
+    if (env && *env) {
+        snprintf(url, size, "%s", env);
+    } else {
+        snprintf(path, sizeof(path), "%s/repo", mysh_home);
+        FILE *fp = fopen(path, "r");
+        if (!fp || !fgets(url, (int)size, fp)) {
+            fprintf(stderr, "pkg: no repository: set PKG_REPO or write its URL to %s\n", path);
+            if (fp) {
+                fclose(fp);
+            }
+            return -1;
+        }
+        fclose(fp);
+        url[strcspn(url, " \t\r\n")] = '\0';
+    }
+
+    size_t len = strlen(url);
+    while (len > 0 && url[len - 1] == '/') {
+        url[--len] = '\0';
+    }
+    return len > 0 ? 0 : -1;
+}
+
+/*
+ * Read an INDEX downloaded from base into entries: per line, a
+ * package's name, version, the SHA-256 of its archive, the archive's
+ * URL (relative to the repository unless it has a scheme), and
+ * optionally a description running to the end of the line; "#" starts
+ * a comment line
+ * Returns: the number read, with *pkgs to free
+ */
+static uint32_t parse_repo_index(FILE *fp, const char *base, RepoPkg **pkgs) {
+    char line[2048];
+    uint32_t count = 0;
+    uint32_t cap = 0;
+
+    *pkgs = NULL;
+    while (fgets(line, sizeof(line), fp)) {
+        RepoPkg pkg;
+        char archive[1024];
+        int off = 0;
+
+        if (line[0] == '#' ||
+            sscanf(line, "%63s %31s %64s %1023s %n", pkg.name, pkg.version, pkg.sha256,
+                   archive, &off) != 4) {
+            continue;
+        }
+        if (strlen(pkg.sha256) != 64 || strspn(pkg.sha256, "0123456789abcdefABCDEF") != 64) {
+            fprintf(stderr, "pkg: INDEX: %s: bad checksum, ignored\n", pkg.name);
+            continue;
+        }
+        if ((strstr(archive, "://") ? snprintf(pkg.url, sizeof(pkg.url), "%s", archive)
+                                    : snprintf(pkg.url, sizeof(pkg.url), "%s/%s", base, archive))
+            >= (int)sizeof(pkg.url)) {
+            fprintf(stderr, "pkg: INDEX: %s: URL too long, ignored\n", pkg.name);
+            continue;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        snprintf(pkg.description, sizeof(pkg.description), "%s", line + off);
+
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            RepoPkg *p = realloc(*pkgs, cap * sizeof(**pkgs));
+            if (!p) {
+                fprintf(stderr, "pkg: %s\n", strerror(ENOMEM));
+                break;
+            }
+            *pkgs = p;
+        }
+        (*pkgs)[count++] = pkg;
+    }
+    return count;
+}
+
+/*
+ * Download the repository's INDEX (conditionally, if the validators
+ * are given) and cache it as repo.db
+ * Returns: 0 if repo.db was rewritten, 1 if the server says the cache
+ * is current, -1 if the download failed
+ */
+static int fetch_repo_index(const char *base, const char *url,
+                            const char *etag, const char *last_modified) {
+    pkg_fetch_t job;
+    RepoPkg *pkgs;
+    PkgDbEntry *entries;
+    uint32_t count;
+    FILE *tmp = tmpfile();
+    int ret;
+
+    if (!tmp) {
+        perror("pkg: tmpfile");
+        return -1;
+    }
+    memset(&job, 0, sizeof(job));
+    job.url = url;
+    job.fd = dup(fileno(tmp));
+    job.if_none_match = etag;
+    job.if_modified_since = last_modified;
+    if (job.fd < 0 || pkg_fetch_all(&job, 1, "pkg") != 0) {
+        fclose(tmp);
+        return -1;
+    }
+    if (job.status == 304) {
+        fclose(tmp);
+        return 1;
+    }
+
+    rewind(tmp);
+    count = parse_repo_index(tmp, base, &pkgs);
+    fclose(tmp);
+    entries = malloc((count ? count : 1) * sizeof(*entries));
+    if (!entries) {
+        fprintf(stderr, "pkg: %s\n", strerror(ENOMEM));
+        free(pkgs);
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        PkgDbEntry e = { pkgs[i].name, pkgs[i].version, pkgs[i].description, NULL, NULL,
+                         pkgs[i].sha256, pkgs[i].url };
+        entries[i] = e;
+    }
+    ret = write_db(repo_cache_path, entries, count, url, job.etag, job.last_modified);
+    free(entries);
+    free(pkgs);
+    return ret;
+}
+
+/*
+ * Map the repository's index, as cached in repo.db. A cache of the
+ * same repository younger than PKG_INDEX_TTL is used as it is, unless
+ * refresh is set; otherwise it is revalidated with its ETag and
+ * Last-Modified, so an unchanged index costs a round trip and no
+ * transfer. If the repository cannot be reached, the cache is used.
+ * Returns: 0, or -1 with a message printed
+ */
+static int open_repo_index(PkgDb *db, int refresh) {
+    char base[1024];
+    char url[1100];
+    struct stat st;
+    int cached;
+    int r;
+
+    if (repo_url(base, sizeof(base)) != 0) {
+        return -1;
+    }
+    snprintf(url, sizeof(url), "%s/INDEX", base);
+
+    r = pkg_db_map(db, repo_cache_path);
+    cached = r == 0 && strcmp(pkg_db_str(db, db->hdr->origin), url) == 0;
+    if (r == 0 && !cached) {
+        pkg_db_close(db);
+    }
+    if (cached && !refresh && stat(repo_cache_path, &st) == 0 &&
+        time(NULL) - st.st_mtime < PKG_INDEX_TTL) {
+        return 0;
+    }
+
+    r = fetch_repo_index(base, url, cached ? pkg_db_str(db, db->hdr->etag) : NULL,
+                         cached ? pkg_db_str(db, db->hdr->last_modified) : NULL);
+    if (cached) {
+        if (r < 0) {
+            fprintf(stderr, "pkg: using the cached index\n");
+        } else if (r == 1) {
+            utimensat(AT_FDCWD, repo_cache_path, NULL, 0);  // Current for another PKG_INDEX_TTL
+        }
+        if (r != 0) {
+            return 0;
+        }
+        pkg_db_close(db);
+    } else if (r != 0) {
+        return -1;
+    }
+
+    r = pkg_db_map(db, repo_cache_path);
+    if (r != 0) {
+        fprintf(stderr, "pkg: %s: %s\n", repo_cache_path,
+                r == -1 ? strerror(errno) : "not a package database");
+        return -1;
+    }
+    return 0;
+}
+
+/* Copy record i of the repository index out */
+static void repo_get(const PkgDb *db, uint32_t i, RepoPkg *pkg) {
+    const pkg_db_rec_t *rec = &db->recs[i];
+
+    snprintf(pkg->name, sizeof(pkg->name), "%s", pkg_db_str(db, rec->name));
+    snprintf(pkg->version, sizeof(pkg->version), "%s", pkg_db_str(db, rec->version));
+    snprintf(pkg->description, sizeof(pkg->description), "%s", pkg_db_str(db, rec->description));
+    snprintf(pkg->sha256, sizeof(pkg->sha256), "%s", pkg_db_str(db, rec->sha256));
+    snprintf(pkg->url, sizeof(pkg->url), "%s", pkg_db_str(db, rec->url));
+}
+
+/* pipe() with both ends close-on-exec: 0, or -1 with errno set */
+static int pipe_cloexec(int p[2]) {
+#ifdef __linux__
+    return pipe2(p, O_CLOEXEC);
+#else
+    if (pipe(p) != 0) {
+        return -1;
+    }
+    fcntl(p[0], F_SETFD, FD_CLOEXEC);
+    fcntl(p[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
+}
+
+/* Extract a download as it arrives, on its own thread */
+static void *download_extract(void *arg) {
+    Download *d = arg;
+    char buf[4096];
+
+    d->result = tar_extract_fd(d->rfd, d->pkg->name, d->dirfd, "pkg install");
+
+    // Read whatever follows the end of the archive, so the transfer completes
+    for (;;) {
+        ssize_t n = read(d->rfd, buf, sizeof(buf));
+        if (n > 0 || (n < 0 && errno == EINTR)) {
+            continue;
+        }
+        break;
+    }
+    close(d->rfd);
+    return NULL;
+}
+
+/*
+ * pkg install/upgrade <name>...: look the names up in the repository
+ * index, download every archive needed at once (pkg_fetch.h), each
+ * streamed into its own staging directory as it arrives, then check
+ * each against the index's SHA-256 and install it
+ */
+static int pkg_install_remote(const char **names, int n, int upgrade) {
+    PkgDb index;
+    RepoPkg *wanted = calloc(n, sizeof(*wanted));
+    Download *downloads = calloc(n, sizeof(*downloads));
+    pkg_fetch_t *jobs = calloc(n, sizeof(*jobs));
+    size_t nwanted = 0;
+    size_t ndownloads = 0;
+    int ret = EXIT_OK;
+
+    if (!wanted || !downloads || !jobs) {
+        fprintf(stderr, "pkg: %s\n", strerror(ENOMEM));
+        ret = EXIT_ERROR;
+        goto out;
+    }
+    if (open_repo_index(&index, 0) != 0) {
+        ret = EXIT_ERROR;
+        goto out;
+    }
+
+    // Resolve the names, leaving out what is already there
+    for (int i = 0; i < n; i++) {
+        RepoPkg *pkg = &wanted[nwanted];
+        long rec = pkg_db_find(&index, names[i]);
+        char installed[512];
+        size_t j;
+
+        if (rec < 0) {
+            fprintf(stderr, "pkg install: %s: not in the repository\n", names[i]);
+            ret = EXIT_ERROR;
+            continue;
+        }
+        for (j = 0; j < nwanted && strcmp(wanted[j].name, names[i]) != 0; j++) {
+        }
+        if (j < nwanted) {
+            continue;
+        }
+        repo_get(&index, (uint32_t)rec, pkg);
+        if (is_installed(pkg->name, installed, sizeof(installed))) {
+            char latest[600];
+
+            if (snprintf(latest, sizeof(latest), "%s/%s-%s", pkg_dir, pkg->name,
+                         pkg->version) >= (int)sizeof(latest)) {
+                fprintf(stderr, "pkg install: %s: %s\n", pkg->name, strerror(ENAMETOOLONG));
+                ret = EXIT_ERROR;
+                continue;
+            }
+            if (!upgrade) {
+                printf("%s is already installed\n", pkg->name);
+                continue;
+            }
+            if (strcmp(installed, latest) == 0) {
+                printf("%s is up to date (%s)\n", pkg->name, pkg->version);
+                continue;
+            }
+        }
+        nwanted++;
+    }
+    pkg_db_close(&index);
+
+    // A staging directory, a pipe and an extracting thread per download
+    for (size_t i = 0; i < nwanted; i++) {
+        Download *d = &downloads[ndownloads];
+        int p[2];
+
+        d->pkg = &wanted[i];
+        if (snprintf(d->staging, sizeof(d->staging), "%s/.pkg_install_%d_%zu",
+                     pkg_dir, getpid(), i) >= (int)sizeof(d->staging)) {
+            fprintf(stderr, "pkg install: %s: %s\n", pkg_dir, strerror(ENAMETOOLONG));
+            ret = EXIT_ERROR;
+            continue;
+        }
+        if (mkdir(d->staging, 0755) != 0) {
+            perror(d->staging);
+            ret = EXIT_ERROR;
+            continue;
+        }
+        d->dirfd = open(d->staging, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (d->dirfd < 0 || pipe_cloexec(p) != 0) {
+            perror(d->staging);
+            if (d->dirfd >= 0) {
+                close(d->dirfd);
+            }
+            tree_remove_at(AT_FDCWD, d->staging, "pkg install");
+            ret = EXIT_ERROR;
+            continue;
+        }
+        d->rfd = p[0];
+        if (pthread_create(&d->thread, NULL, download_extract, d) != 0) {
+            fprintf(stderr, "pkg install: %s: cannot start extraction\n", d->pkg->name);
+            close(p[0]);
+            close(p[1]);
+            close(d->dirfd);
+            tree_remove_at(AT_FDCWD, d->staging, "pkg install");
+            ret = EXIT_ERROR;
+            continue;
+        }
+        jobs[ndownloads].url = d->pkg->url;
+        jobs[ndownloads].fd = p[1];
+        ndownloads++;
+    }
+
+    if (ndownloads > 0) {
+        printf("Downloading %zu package%s...\n", ndownloads, ndownloads == 1 ? "" : "s");
+        fflush(stdout);
+        pkg_fetch_all(jobs, ndownloads, "pkg install");
+    }
+
+    // Install, one at a time, each that arrived whole
+    for (size_t i = 0; i < ndownloads; i++) {
+        Download *d = &downloads[i];
+        char hex[2 * SHA256_DIGEST_LEN + 1];
+
+        pthread_join(d->thread, NULL);
+        close(d->dirfd);
+        for (int k = 0; k < SHA256_DIGEST_LEN; k++) {
+            snprintf(hex + 2 * k, 3, "%02x", jobs[i].digest[k]);
+        }
+
+        if (jobs[i].failed || d->result != 0) {
+            fprintf(stderr, "pkg install: %s: download failed, not installing\n", d->pkg->name);
+        } else if (strcasecmp(hex, d->pkg->sha256) != 0) {
+            fprintf(stderr, "pkg install: %s: archive does not match the index's SHA-256, not installing\n",
+                    d->pkg->name);
+        } else {
+            printf("\n");
+            if (install_staged(d->staging, d->pkg->name, upgrade) != EXIT_OK) {
+                ret = EXIT_ERROR;
+            }
+            continue;
+        }
+        tree_remove_at(AT_FDCWD, d->staging, "pkg install");
+        ret = EXIT_ERROR;
+    }
+
+out:
+    free(wanted);
+    free(downloads);
+    free(jobs);
+    return ret;
+}
+
+/*
+ * pkg install/upgrade ARG...: archives (anything naming an existing
+ * file, or with a "/" or an archive suffix) are installed in order,
+ * then every other argument is fetched from the repository by name
+ */
+static int pkg_install_args(const char **args, int n, int upgrade) {
+    const char **names = calloc(n, sizeof(*names));
+    int nnames = 0;
+    int ret = EXIT_OK;
+
+    if (!names) {
+        fprintf(stderr, "pkg: %s\n", strerror(ENOMEM));
+        return EXIT_ERROR;
+    }
+
+    for (int i = 0; i < n; i++) {
+        struct stat st;
+        size_t len = strlen(args[i]);
+        int local = stat(args[i], &st) == 0 || strchr(args[i], '/') ||
+                    (len > 7 && strcmp(args[i] + len - 7, ".tar.gz") == 0) ||
+                    (len > 4 && (strcmp(args[i] + len - 4, ".tgz") == 0 ||
+                                 strcmp(args[i] + len - 4, ".tar") == 0));
+
+        if (!local) {
+            names[nnames++] = args[i];
+        } else if (pkg_install(args[i], upgrade) != EXIT_OK) {
+            ret = EXIT_ERROR;
+        }
+    }
+
+    if (nnames > 0 && pkg_install_remote(names, nnames, upgrade) != EXIT_OK) {
+        ret = EXIT_ERROR;
+    }
+    free(names);
+    return ret;
+}
+
+/* pkg list */
+static int pkg_list(void) {
+    PkgDb db;
+
+    if (pkg_db_open(&db) != 0) {
+        return EXIT_ERROR;
+    }
+
+    int count = (int)db.hdr->nrecs;
+
+    if (count == 0) {
+        printf("No packages installed.\n");
+        pkg_db_close(&db);
+        return EXIT_OK;
+    }
+
+    printf("Installed packages:\n");
+    printf("%-20s %-12s %s\n", "NAME", "VERSION", "DESCRIPTION");
+    printf("%-20s %-12s %s\n", "----", "-------", "-----------");
+
+    //print package info
+    for (int i = 0; i < count; i++) {
+        const pkg_db_rec_t *rec = &db.recs[i];
+
+        printf("%-20s %-12s %s\n",
+               pkg_db_str(&db, rec->name),
+               pkg_db_str(&db, rec->version),
+               pkg_db_str(&db, rec->description));
+    }
+
+    printf("\nTotal: %d package%s\n", count, count == 1 ? "" : "s");
+
+    pkg_db_close(&db);
+    return EXIT_OK;
+}
+
+/* pkg search [prefix]: the repository's packages whose names start with prefix */
+static int pkg_search(const char *prefix) {
+    PkgDb db;
+    uint32_t first;
+    uint32_t count;
+
+    if (open_repo_index(&db, 0) != 0) {
+        return EXIT_ERROR;
+    }
+
+    count = pkg_db_prefix(&db, prefix, &first);
+    if (count == 0) {
+        printf("No packages match '%s'.\n", prefix);
+        pkg_db_close(&db);
+        return EXIT_ERROR;
+    }
+
+    printf("%-20s %-12s %s\n", "NAME", "VERSION", "DESCRIPTION");
+    printf("%-20s %-12s %s\n", "----", "-------", "-----------");
+    for (uint32_t k = first; k < first + count; k++) {
+        uint32_t i = db.by_name[k];
+        const pkg_db_rec_t *rec = &db.recs[i < db.hdr->nrecs ? i : 0];
+
+        printf("%-20s %-12s %s\n",
+               pkg_db_str(&db, rec->name),
+               pkg_db_str(&db, rec->version),
+               pkg_db_str(&db, rec->description));
+    }
+
+    pkg_db_close(&db);
+    return EXIT_OK;
+}
+
+/* pkg update: refresh the cached repository index now */
+static int pkg_update(void) {
+    PkgDb db;
+
+    if (open_repo_index(&db, 1) != 0) {
+        return EXIT_ERROR;
+    }
+    printf("Repository index: %u package%s\n", db.hdr->nrecs, db.hdr->nrecs == 1 ? "" : "s");
+    pkg_db_close(&db);
+    return EXIT_OK;
+}
+
+/* pkg info <package-name> */
+static int pkg_info(const char *name) {
+    PkgDb db;
+    InstalledPkg info;
+    const InstalledPkg *pkg = &info;
+    long i;
+
+    if (pkg_db_open(&db) != 0) {
+        return EXIT_ERROR;
+    }
+
+    i = pkg_db_find(&db, name);
+    if (i < 0) {
+        fprintf(stderr, "pkg info: Package '%s' is not installed\n", name);
+        pkg_db_close(&db);
+        return EXIT_ERROR;
+    }
+    pkg_db_get(&db, (uint32_t)i, &info);
+    pkg_db_close(&db);
+
+    printf("Package: %s\n", pkg->name);
+    printf("Version: %s\n", pkg->version);
+    printf("Description: %s\n", pkg->description);
+    printf("Installed: %s\n", pkg->install_date);
+    printf("Location: %s\n", pkg->path);
+
+    // List files in package directory
+    DIR *dir = opendir(pkg->path);
+    if (dir) {
+        printf("\nFiles:\n");
+        struct dirent *entry;
+        // gets path
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") != 0 &&
+                strcmp(entry->d_name, "..") != 0) {
+                printf("  %s\n", entry->d_name);
+            }
+        }
+        closedir(dir);
+    }
+
+    return EXIT_OK;
+}
+
+/* pkg remove <package-name> */
+static int pkg_remove(const char *name) {
+    InstalledPkg *packages = NULL;
+    int count = 0;
+    char *found_path = NULL;
+
+    if (read_pkgdb(&packages, &count) != 0) {
+        return EXIT_ERROR;
+    }
+
+    // Find package
+    for (int i = 0; i < count; i++) {
+        if (strcmp(packages[i].name, name) == 0) {
+            found_path = strdup(packages[i].path);
+            break;
+        }
+    }
+
+    if (!found_path) {
+        fprintf(stderr, "pkg remove: Package '%s' is not installed\n", name);
+        free(packages);
+        return EXIT_ERROR;
+    }
+
+    printf("Removing package '%s'...\n", name);
+
+    // Remove package directory
+    if (tree_remove_at(AT_FDCWD, found_path, "pkg remove") != 0) {
+        fprintf(stderr, "pkg remove: Failed to remove package files\n");
+        free(found_path);
+        free(packages);
+        return EXIT_ERROR;
+    }
+
+    // Drop the shared files only this package was using
+    int freed = pkg_store_gc(store_dir, "pkg remove");
+    if (freed > 0) {
+        printf("Freed %d unshared file%s from the store\n", freed, freed == 1 ? "" : "s");
+    }
+
+    // Remove symlinks from bin directory
+    // For simplicity, we'll just warn that they should be removed manually
+    printf("Note: Symlinks in %s may need to be removed manually\n", bin_dir);
+
+    // Update pkgdb - remove this package
+    if (write_pkgdb(packages, count, name) != 0) {
+        free(found_path);
+        free(packages);
+        return EXIT_ERROR;
+    }
+
+    printf("Package '%s' removed successfully\n", name);
+
+    free(found_path);
+    free(packages);
+    return EXIT_OK;
+}
+
+// === ARGTABLE STRUCTURES ===
+static struct arg_lit *pkg_help;
+static struct arg_str *pkg_subcommand;
+static struct arg_str *pkg_args;
+static struct arg_end *pkg_end;
+static void *pkg_argtable[5];
+
+// === ARGTABLE BUILDER ===
+static void build_pkg_argtable(void) {
+    if (pkg_argtable[0] != NULL) {
+        return;
+    }
+
+    pkg_help = arg_lit0("h", "help", "display this help and exit");
+    pkg_subcommand = arg_str1(NULL, NULL, "COMMAND", "subcommand: install, upgrade, search, update, list, remove, info");
+    pkg_args = arg_strn(NULL, NULL, "ARG", 0, 1000, "arguments for subcommand");
+    pkg_end = arg_end(20);
+
+    pkg_argtable[0] = pkg_help;
+    pkg_argtable[1] = pkg_subcommand;
+    pkg_argtable[2] = pkg_args;
+    pkg_argtable[3] = pkg_end;
+    pkg_argtable[4] = NULL;
+}
+
+// === PRINT USAGE ===
+void pkg_print_usage(FILE *out) {
+    build_pkg_argtable();
+
+    fprintf(out, "Usage: pkg ");
+    arg_print_syntax(out, pkg_argtable, "\n");
+    fprintf(out, "\nPackage manager for PicoBox\n\n");
+
+    fprintf(out, "Subcommands:\n");
+    fprintf(out, "  install <file.tar.gz>   Install a package\n");
+    fprintf(out, "  install <name>...       Download and install packages from the repository\n");
+    fprintf(out, "  upgrade <file.tar.gz>   Replace an installed package with this one\n");
+    fprintf(out, "  upgrade <name>...       Upgrade packages to the repository's versions\n");
+    fprintf(out, "  search [prefix]         List repository packages whose names start with prefix\n");
+    fprintf(out, "  update                  Refresh the cached repository index\n");
+    fprintf(out, "  list                    List installed packages\n");
+    fprintf(out, "  remove <name>           Remove an installed package\n");
+    fprintf(out, "  info <name>             Show package information\n");
+    fprintf(out, "\nOptions:\n");
+    arg_print_glossary(out, pkg_argtable, "  %-25s %s\n");
+
+    fprintf(out, "\nExample:\n");
+    fprintf(out, "  pkg install hello-1.0.0.tar.gz\n");
+    fprintf(out, "  pkg upgrade hello-1.1.0.tar.gz\n");
+    fprintf(out, "  PKG_REPO=https://pkgs.example.org pkg install hello jq ripgrep\n");
+    fprintf(out, "  pkg search rip\n");
+    fprintf(out, "  pkg list\n");
+    fprintf(out, "  pkg info hello\n");
+    fprintf(out, "  pkg remove hello\n");
+}
+
+// === RUN FUNCTION ===
+int pkg_run(int argc, char **argv) {
+    int nerrors;
+    int exit_code = EXIT_OK;
+
+    // Initialize paths
+    if (init_pkg_paths() != 0) {
+        return EXIT_ERROR;
+    }
+
+    // Ensure directories exist
+    if (ensure_directories() != 0) {
+        return EXIT_ERROR;
+    }
+
+    // Build argtable
+    build_pkg_argtable();
+
+    // Parse arguments
+    nerrors = arg_parse(argc, argv, pkg_argtable);
+
+    // Handle --help
+    if (pkg_help->count > 0) {
+        pkg_print_usage(stdout);
+        return EXIT_OK;
+    }
+
+    // Handle parsing errors
+    if (nerrors > 0) {
+        arg_print_errors(stderr, pkg_end, "pkg");
+        pkg_print_usage(stderr);
+        return EXIT_ERROR;
+    }
+
+    // Dispatch to subcommand
+    const char *subcmd = pkg_subcommand->sval[0];
+
+    if (strcmp(subcmd, "install") == 0 || strcmp(subcmd, "upgrade") == 0) {
+        if (pkg_args->count == 0) {
+            fprintf(stderr, "pkg %s: missing package argument\n", subcmd);
+            pkg_print_usage(stderr);
+            exit_code = EXIT_ERROR;
+        } else {
+            exit_code = pkg_install_args(pkg_args->sval, pkg_args->count,
+                                         strcmp(subcmd, "upgrade") == 0);
+        }
+    } else if (strcmp(subcmd, "search") == 0) {
+        exit_code = pkg_search(pkg_args->count > 0 ? pkg_args->sval[0] : "");
+    } else if (strcmp(subcmd, "update") == 0) {
+        exit_code = pkg_update();
+    } else if (strcmp(subcmd, "list") == 0) {
+        exit_code = pkg_list();
+    } else if (strcmp(subcmd, "info") == 0) {
+        if (pkg_args->count == 0) {
+            fprintf(stderr, "pkg info: missing package name argument\n");
+            pkg_print_usage(stderr);
+            exit_code = EXIT_ERROR;
+        } else {
+            exit_code = pkg_info(pkg_args->sval[0]);
+        }
+    } else if (strcmp(subcmd, "remove") == 0 || strcmp(subcmd, "rm") == 0) {
+        if (pkg_args->count == 0) {
+            fprintf(stderr, "pkg remove: missing package name argument\n");
+            pkg_print_usage(stderr);
+            exit_code = EXIT_ERROR;
+        } else {
+            exit_code = pkg_remove(pkg_args->sval[0]);
+        }
+    } else {
+        fprintf(stderr, "pkg: unknown subcommand '%s'\n", subcmd);
+        pkg_print_usage(stderr);
+        exit_code = EXIT_ERROR;
+    }
+
+    return exit_code;
+}
+
+// === COMMAND SPECIFICATION ===
+cmd_spec_t cmd_pkg_spec = {
+    .name = "pkg",
+    .summary = "package manager for PicoBox",
+    .long_help = "Install, list, remove, and query packages in ~/.mysh/",
+    .run = pkg_run,
+    .print_usage = pkg_print_usage,
+    .flags = CMD_FLAG_FORK  /* Ctrl-C during a download must stop pkg, not the shell */
+};
+
+// === REGISTRATION ===
+void register_pkg_command(void) {
+    register_command(&cmd_pkg_spec);
+}
+
+// === STANDALONE MAIN ===
+#ifndef BUILTIN_ONLY
+int main(int argc, char **argv) {
+    return cmd_pkg_spec.run(argc, argv);
+}
+#endif
@@ -0,0 +1,543 @@
+/*
+ * printf_format.c - Compiled formats for the printf command and builtin
+ *
+ * printf_format_get() turns a format into a list of items: runs of text,
+ * escapes resolved, and conversions with the C format that prints them
+ * ("%-*.*jd": width and precision are always passed as arguments, -1
+ * precision meaning none, so one C format serves every width). The last
+ * PRINTF_FORMAT_CACHE formats are kept, so a loop compiles its format
+ * once. One printf runs at a time (a command appears once in a threaded
+ * pipeline, and find -exec runs its command under a lock), so the cache
+ * needs no lock.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* strdup() */
+#endif
+
+#include "printf_format.h"
+#include "picobox.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PRINTF_FORMAT_CACHE 8
+
+#define PRINTF_NONE (-1)       /* No precision given */
+#define PRINTF_ARG (-2)        /* Width or precision is * */
+
+/* One piece of a compiled format: text, or a conversion */
+typedef struct printf_item {
+    char conv;                  /* 0 for text */
+    char cfmt[16];              /* C format for a number conversion */
+    int left;                   /* - flag */
+    int width;                  /* PRINTF_ARG or the width (0: none) */
+    int precision;              /* PRINTF_NONE, PRINTF_ARG or the precision */
+    const char *text;           /* Text items: into the format's text */
+    size_t len;
+} printf_item_t;
+
+struct printf_format {
+    char *source;               /* The format as given (the cache key) */
+    char *text;                 /* Text items, escapes resolved */
+    printf_item_t *items;
+    size_t count;
+    int takes_args;             /* Some conversion reads an argument */
+    int stops;                  /* Ends in \c: nothing after one pass */
+};
+
+/* An argument converted for a number conversion */
+typedef union printf_value {
+    intmax_t i;
+    uintmax_t u;
+    double d;
+} printf_value_t;
+
+static printf_format_t *cache[PRINTF_FORMAT_CACHE];
+static unsigned int cache_next = 0;
+
+static void printf_format_free(printf_format_t *f)
+{
+    if (f) {
+        free(f->source);
+        free(f->text);
+        free(f->items);
+        free(f);
+    }
+}
+
+/* Value of a hex digit */
+static int printf_hex(char c)
+{
+    return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+/*
+ * Resolve the escape after a backslash at *pp into out (at most 2
+ * bytes: an unknown escape is kept as it is)
+ * in_b: %b's argument, where octal is \0NNN rather than \NNN
+ * Returns: bytes written, or -1 for \c
+ */
+static int printf_escape(const char **pp, char *out, int in_b)
+{
+    static const char from[] = "abfnrtv\\\"'";
+    static const char to[] = "\a\b\f\n\r\t\v\\\"'";
+    const char *p = *pp;
+    const char *hit;
+    int value = 0;
+    int digits = 0;
+
+    if (*p == 'c') {
+        *pp = p + 1;
+        return -1;
+    }
+    if (*p != '\0' && (hit = strchr(from, *p)) != NULL) {
+        *out = to[hit - from];
+        *pp = p + 1;
+        return 1;
+    }
+    if (*p == 'x' && isxdigit((unsigned char)p[1])) {
+        p++;
+        while (digits < 2 && isxdigit((unsigned char)*p)) {
+            value = value * 16 + printf_hex(*p++);
+            digits++;
+        }
+        *out = (char)value;
+        *pp = p;
+        return 1;
+    }
+    if (in_b ? *p == '0' : (*p >= '0' && *p <= '7')) {
+        if (in_b) {
+            p++;
+        }
+        while (digits < 3 && *p >= '0' && *p <= '7') {
+            value = value * 8 + (*p++ - '0');
+            digits++;
+        }
+        *out = (char)value;
+        *pp = p;
+        return 1;
+    }
+
+    /* Anything else, and a backslash at the end, stays as it is */
+    out[0] = '\\';
+    if (*p == '\0') {
+        *pp = p;
+        return 1;
+    }
+    out[1] = *p;
+    *pp = p + 1;
+    return 2;
+}
+
+/*
+ * Split format into items
+ * Returns: the compiled format, or NULL (*bad set if it is invalid)
+ */
+static printf_format_t *printf_compile(const char *format, const char **bad)
+{
+    printf_format_t *f = calloc(1, sizeof(printf_format_t));
+    size_t cap = 1;
+    const char *p;
+    char *text_end;
+    char *text_start;
+
+    if (!f) {
+        return NULL;
+    }
+    for (p = format; *p; p++) {
+        cap += *p == '%' ? 2 : 0;
+    }
+    f->source = strdup(format);
+    f->text = malloc(strlen(format) + 1);
+    f->items = calloc(cap, sizeof(printf_item_t));
+    if (!f->source || !f->text || !f->items) {
+        printf_format_free(f);
+        return NULL;
+    }
+
+    text_start = text_end = f->text;
+    p = format;
+    while (*p) {
+        printf_item_t *it;
+        size_t flags_len;
+        char *c;
+
+        if (*p == '\\') {
+            int n;
+
+            p++;
+            n = printf_escape(&p, text_end, 0);
+            if (n < 0) {
+                f->stops = 1;
+                break;
+            }
+            text_end += n;
+            continue;
+        }
+        if (*p != '%') {
+            *text_end++ = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            *text_end++ = '%';
+            p += 2;
+            continue;
+        }
+
+        /* A conversion: the text before it becomes an item first */
+        if (text_end > text_start) {
+            it = &f->items[f->count++];
+            it->text = text_start;
+            it->len = (size_t)(text_end - text_start);
+            text_start = text_end;
+        }
+
+        it = &f->items[f->count++];
+        *bad = p;
+        p++;
+        flags_len = strspn(p, "-+ #0");
+        it->left = memchr(p, '-', flags_len) != NULL;
+        c = it->cfmt;
+        *c++ = '%';
+        for (const char *flag = "-+ #0"; *flag; flag++) {
+            if (memchr(p, *flag, flags_len)) {
+                *c++ = *flag;
+            }
+        }
+        p += flags_len;
+
+        if (*p == '*') {
+            it->width = PRINTF_ARG;
+            p++;
+        } else if (*p >= '0' && *p <= '9') {
+            it->width = 0;
+            while (*p >= '0' && *p <= '9' && it->width < 100000) {
+                it->width = it->width * 10 + (*p++ - '0');
+            }
+        }
+        it->precision = PRINTF_NONE;
+        if (*p == '.') {
+            p++;
+            it->precision = 0;
+            if (*p == '*') {
+                it->precision = PRINTF_ARG;
+                p++;
+            } else {
+                while (*p >= '0' && *p <= '9' && it->precision < 100000) {
+                    it->precision = it->precision * 10 + (*p++ - '0');
+                }
+            }
+        }
+        if (*p == '\0' || !strchr("diouxXcsbeEfFgGaA", *p)) {
+            printf_format_free(f);
+            return NULL;
+        }
+        it->conv = *p++;
+        memcpy(c, "*.*", 3);
+        c += 3;
+        if (strchr("diouxX", it->conv)) {
+            *c++ = 'j';
+        }
+        *c++ = it->conv;
+        *c = '\0';
+        f->takes_args = 1;
+    }
+
+    if (text_end > text_start) {
+        printf_item_t *it = &f->items[f->count++];
+
+        it->text = text_start;
+        it->len = (size_t)(text_end - text_start);
+    }
+    *bad = NULL;
+    return f;
+}
+
+const printf_format_t *printf_format_get(const char *format, const char **bad)
+{
+    printf_format_t *f;
+
+    *bad = NULL;
+    for (int i = 0; i < PRINTF_FORMAT_CACHE; i++) {
+        if (cache[i] && strcmp(cache[i]->source, format) == 0) {
+            return cache[i];
+        }
+    }
+
+    f = printf_compile(format, bad);
+    if (!f) {
+        return NULL;
+    }
+    printf_format_free(cache[cache_next]);
+    cache[cache_next] = f;
+    cache_next = (cache_next + 1) % PRINTF_FORMAT_CACHE;
+    return f;
+}
+
+/*
+ * The number in arg for conversion conv ("" or no argument is 0; 'C is
+ * the value of C)
+ * Returns: 0, or 1 if arg is not (all) a number
+ */
+static int printf_number(const char *arg, char conv, printf_value_t *v)
+{
+    char *end;
+
+    memset(v, 0, sizeof(*v));
+    if (!arg || !*arg) {
+        return 0;
+    }
+    if (arg[0] == '\'' || arg[0] == '"') {
+        unsigned char c = (unsigned char)arg[1];
+
+        if (strchr("di", conv)) {
+            v->i = c;
+        } else if (strchr("ouxX", conv)) {
+            v->u = c;
+        } else {
+            v->d = c;
+        }
+        return 0;
+    }
+
+    errno = 0;
+    if (strchr("di", conv)) {
+        v->i = strtoimax(arg, &end, 0);
+    } else if (strchr("ouxX", conv)) {
+        v->u = strtoumax(arg, &end, 0);
+    } else {
+        v->d = strtod(arg, &end);
+    }
+    if (end == arg || *end) {
+        fprintf(stderr, "printf: '%s': expected a numeric value\n", arg);
+        return 1;
+    }
+    if (errno == ERANGE) {
+        fprintf(stderr, "printf: '%s': %s\n", arg, strerror(ERANGE));
+        return 1;
+    }
+    return 0;
+}
+
+/* s[0..len) padded with spaces to width, as %-*s or %*s */
+static void printf_put_padded(pb_out_t *out, const char *s, size_t len, int width, int left)
+{
+    size_t pad = width > 0 && (size_t)width > len ? (size_t)width - len : 0;
+
+    if (!left) {
+        for (size_t i = 0; i < pad; i++) {
+            pb_out_putc(out, ' ');
+        }
+    }
+    pb_out_write(out, s, len);
+    if (left) {
+        for (size_t i = 0; i < pad; i++) {
+            pb_out_putc(out, ' ');
+        }
+    }
+}
+
+static int printf_snprintf(char *buf, size_t size, const printf_item_t *it,
+                           int width, int precision, const printf_value_t *v)
+{
+    if (strchr("di", it->conv)) {
+        return snprintf(buf, size, it->cfmt, width, precision, v->i);
+    }
+    if (strchr("ouxX", it->conv)) {
+        return snprintf(buf, size, it->cfmt, width, precision, v->u);
+    }
+    return snprintf(buf, size, it->cfmt, width, precision, v->d);
+}
+
+/* A number conversion through its C format */
+static void printf_put_number(pb_out_t *out, const printf_item_t *it,
+                              int width, int precision, const printf_value_t *v)
+{
+    char buf[128];
+    int n = printf_snprintf(buf, sizeof(buf), it, width, precision, v);
+
+    if (n < 0) {
+        return;
+    }
+    if ((size_t)n < sizeof(buf)) {
+        pb_out_write(out, buf, (size_t)n);
+        return;
+    }
+
+    /* A large width or precision */
+    char *big = malloc((size_t)n + 1);
+    if (big) {
+        printf_snprintf(big, (size_t)n + 1, it, width, precision, v);
+        pb_out_write(out, big, (size_t)n);
+        free(big);
+    }
+}
+
+/*
+ * %b: arg with its escapes resolved
+ * Returns: 1 if it held \c (output ends after it), else 0
+ */
+static int printf_put_b(pb_out_t *out, const char *arg, int width, int precision, int left)
+{
+    char *buf = malloc(strlen(arg) + 1);
+    const char *p = arg;
+    size_t len = 0;
+    int stop = 0;
+
+    if (!buf) {
+        return 0;
+    }
+    while (*p) {
+        int n;
+
+        if (*p != '\\') {
+            buf[len++] = *p++;
+            continue;
+        }
+        p++;
+        n = printf_escape(&p, buf + len, 1);
+        if (n < 0) {
+            stop = 1;
+            break;
+        }
+        len += (size_t)n;
+    }
+    if (precision >= 0 && (size_t)precision < len) {
+        len = (size_t)precision;
+    }
+    printf_put_padded(out, buf, len, width, left);
+    free(buf);
+    return stop;
+}
+
+/* The width or precision a * asks for, from the next argument */
+static int printf_star(char **args, int nargs, int *next, int *status)
+{
+    printf_value_t v;
+
+    if (printf_number(*next < nargs ? args[(*next)++] : NULL, 'd', &v) != 0) {
+        *status = EXIT_ERROR;
+    }
+    if (v.i > 100000) {
+        return 100000;
+    }
+    if (v.i < -100000) {
+        return -100000;
+    }
+    return (int)v.i;
+}
+
+int printf_format_write(pb_out_t *out, const printf_format_t *f, char **args, int nargs)
+{
+    int next = 0;
+    int status = EXIT_OK;
+
+    do {
+        for (size_t i = 0; i < f->count; i++) {
+            const printf_item_t *it = &f->items[i];
+            int width = it->width;
+            int precision = it->precision;
+            int left = it->left;
+            const char *arg;
+
+            if (it->conv == 0) {
+                pb_out_write(out, it->text, it->len);
+                continue;
+            }
+            /* A negative * width means - (C's printf takes it the same way) */
+            if (width == PRINTF_ARG) {
+                width = printf_star(args, nargs, &next, &status);
+            }
+            if (precision == PRINTF_ARG) {
+                precision = printf_star(args, nargs, &next, &status);
+                if (precision < 0) {
+                    precision = PRINTF_NONE;
+                }
+            }
+            if (width < 0) {
+                left = 1;
+            }
+            arg = next < nargs ? args[next++] : NULL;
+
+            switch (it->conv) {
+            case 's': {
+                size_t len = arg ? strlen(arg) : 0;
+
+                if (precision >= 0 && (size_t)precision < len) {
+                    len = (size_t)precision;
+                }
+                printf_put_padded(out, arg ? arg : "", len, abs(width), left);
+                break;
+            }
+            case 'c':
+                printf_put_padded(out, arg ? arg : "", arg && *arg ? 1 : 0, abs(width), left);
+                break;
+            case 'b':
+                if (printf_put_b(out, arg ? arg : "", abs(width), precision, left)) {
+                    return status;
+                }
+                break;
+            default: {
+                printf_value_t v;
+
+                if (printf_number(arg, it->conv, &v) != 0) {
+                    status = EXIT_ERROR;
+                }
+                printf_put_number(out, it, width, precision, &v);
+                break;
+            }
+            }
+        }
+    } while (!f->stops && f->takes_args && next < nargs);
+
+    return status;
+}
+
+int printf_format_run(int argc, char **argv, FILE *fp)
+{
+    const printf_format_t *f;
+    const char *bad;
+    pb_out_t out;
+    int i = 1;
+    int status;
+
+    if (i < argc && strcmp(argv[i], "--") == 0) {
+        i++;
+    }
+    if (i >= argc) {
+        fprintf(stderr, "printf: missing operand\n");
+        fprintf(stderr, "Try 'printf --help' for more information.\n");
+        return EXIT_ERROR;
+    }
+
+    f = printf_format_get(argv[i], &bad);
+    if (!f) {
+        if (bad) {
+            size_t len = 1 + strspn(bad + 1, "-+ #0123456789.*");
+
+            if (bad[len]) {
+                len++;
+            }
+            fprintf(stderr, "printf: %.*s: invalid conversion specification\n", (int)len, bad);
+        } else {
+            perror("printf");
+        }
+        return EXIT_ERROR;
+    }
+    if (pb_out_init(&out, fp) != 0) {
+        perror("printf");
+        return EXIT_ERROR;
+    }
+
+    status = printf_format_write(&out, f, argv + i + 1, argc - i - 1);
+    if (pb_out_close(&out) != 0) {
+        perror("printf");
+        status = EXIT_ERROR;
+    }
+    return status;
+}
@@ -0,0 +1,310 @@
+/*
+ * reaper.c - Event-driven child reaping
+ *
+ * Waiting with waitpid() on each pid in turn means a slow first stage
+ * hides a last stage that failed long ago. Instead every watched child
+ * gets a wake-up source and whichever exits first is reaped first:
+ *
+ *   - Linux 5.3+: a pidfd per child (pidfd_open), all poll()ed together
+ *   - elsewhere, or if pidfd_open is unavailable: a SIGCHLD handler
+ *     writing to a self-pipe; on wake-up each watched pid is tried with
+ *     wait4(WNOHANG)
+ *
+ * Reaped results wait in the table until reaper_take() claims them.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* sigaction(), wait4() and syscall() under -std=c11 */
+#endif
+
+#include "reaper.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+/* One watched child */
+typedef struct reaper_entry {
+    pid_t pid;
+    int pidfd;              /* -1 in self-pipe mode */
+    int exited;             /* Reaped; status/usage valid */
+    int status;
+    struct rusage usage;
+} reaper_entry_t;
+
+static reaper_entry_t *entries = NULL;
+static int entry_count = 0;
+static int entry_capacity = 0;
+
+/* -1 = not yet decided, 0 = self-pipe, 1 = pidfd */
+static int use_pidfd = -1;
+static int sigchld_pipe[2] = {-1, -1};
+
+static void sigchld_handler(int sig)
+{
+    int saved_errno = errno;
+    char byte = 0;
+
+    (void)sig;
+    /* Pipe is non-blocking: if it is full a wake-up is already pending */
+    (void)!write(sigchld_pipe[1], &byte, 1);
+    errno = saved_errno;
+}
+
+/*
+ * Set up the SIGCHLD self-pipe (fallback mode)
+ */
+static int setup_self_pipe(void)
+{
+    struct sigaction sa;
+
+    if (sigchld_pipe[0] != -1) {
+        return 0;
+    }
+
+    if (pipe(sigchld_pipe) < 0) {
+        perror("pipe");
+        return -1;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        fcntl(sigchld_pipe[i], F_SETFL, fcntl(sigchld_pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(sigchld_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    if (sigaction(SIGCHLD, &sa, NULL) < 0) {
+        perror("sigaction");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Open a pidfd for pid, or -1 if the kernel/libc can't
+ */
+static int open_pidfd(pid_t pid)
+{
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    int fd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (fd >= 0) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        return fd;
+    }
+#else
+    (void)pid;
+#endif
+    return -1;
+}
+
+static reaper_entry_t *find_entry(pid_t pid)
+{
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i].pid == pid) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+int reaper_watch(pid_t pid)
+{
+    reaper_entry_t *entry;
+
+    if (pid <= 0) {
+        return -1;
+    }
+
+    if (entry_count == entry_capacity) {
+        int capacity = entry_capacity ? entry_capacity * 2 : 16;
+        reaper_entry_t *grown = realloc(entries, capacity * sizeof(reaper_entry_t));
+        if (!grown) {
+            perror("realloc");
+            return -1;
+        }
+        entries = grown;
+        entry_capacity = capacity;
+    }
+
+    entry = &entries[entry_count];
+    memset(entry, 0, sizeof(*entry));
+    entry->pid = pid;
+    entry->pidfd = -1;
+
+    /* First child decides the mode: pidfd if the kernel supports it */
+    if (use_pidfd != 0) {
+        entry->pidfd = open_pidfd(pid);
+        if (entry->pidfd >= 0) {
+            use_pidfd = 1;
+        } else if (use_pidfd == -1) {
+            use_pidfd = 0;
+        }
+    }
+    if (entry->pidfd < 0 && setup_self_pipe() < 0) {
+        return -1;
+    }
+
+    entry_count++;
+    return 0;
+}
+
+/*
+ * Try to reap one entry without blocking
+ * Returns: 1 if reaped, 0 if still running
+ */
+static int reap_entry(reaper_entry_t *entry)
+{
+    pid_t r;
+
+    do {
+        r = wait4(entry->pid, &entry->status, WNOHANG, &entry->usage);
+    } while (r < 0 && errno == EINTR);
+
+    if (r == 0) {
+        return 0;
+    }
+
+    if (r < 0) {
+        /* Already reaped elsewhere: report it as a failure */
+        entry->status = 0xff00;   /* exit status 255 */
+        memset(&entry->usage, 0, sizeof(entry->usage));
+    }
+
+    entry->exited = 1;
+    if (entry->pidfd >= 0) {
+        close(entry->pidfd);
+        entry->pidfd = -1;
+    }
+    return 1;
+}
+
+/* Reap every entry that is ready; returns how many were reaped */
+static int reap_ready(void)
+{
+    int reaped = 0;
+
+    for (int i = 0; i < entry_count; i++) {
+        if (!entries[i].exited) {
+            reaped += reap_entry(&entries[i]);
+        }
+    }
+    return reaped;
+}
+
+static void drain_self_pipe(void)
+{
+    char buf[64];
+
+    if (sigchld_pipe[0] == -1) {
+        return;
+    }
+    while (read(sigchld_pipe[0], buf, sizeof(buf)) > 0) {
+        /* discard */
+    }
+}
+
+int reaper_collect(int timeout_ms)
+{
+    struct pollfd *fds;
+    int running = 0;
+    int nfds = 0;
+    int reaped;
+    int r;
+
+    /* Anything that already exited needs no sleep */
+    drain_self_pipe();
+    reaped = reap_ready();
+    if (reaped > 0 || timeout_ms == 0) {
+        return reaped;
+    }
+
+    for (int i = 0; i < entry_count; i++) {
+        running += !entries[i].exited;
+    }
+    if (running == 0) {
+        return 0;
+    }
+
+    /* One slot per pidfd, plus the self-pipe */
+    fds = malloc((running + 1) * sizeof(struct pollfd));
+    if (!fds) {
+        perror("malloc");
+        return -1;
+    }
+
+    for (int i = 0; i < entry_count; i++) {
+        if (!entries[i].exited && entries[i].pidfd >= 0) {
+            fds[nfds].fd = entries[i].pidfd;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+    }
+    if (sigchld_pipe[0] != -1) {
+        fds[nfds].fd = sigchld_pipe[0];
+        fds[nfds].events = POLLIN;
+        nfds++;
+    }
+
+    do {
+        r = poll(fds, nfds, timeout_ms);
+    } while (r < 0 && errno == EINTR);
+
+    free(fds);
+
+    if (r < 0) {
+        perror("poll");
+        return -1;
+    }
+    if (r == 0) {
+        return 0;
+    }
+
+    drain_self_pipe();
+    return reap_ready();
+}
+
+int reaper_take(pid_t pid, int *status, struct rusage *usage)
+{
+    reaper_entry_t *entry = find_entry(pid);
+
+    if (!entry) {
+        return -1;
+    }
+    if (!entry->exited) {
+        return 0;
+    }
+
+    if (status) {
+        *status = entry->status;
+    }
+    if (usage) {
+        *usage = entry->usage;
+    }
+
+    /* Drop the entry (order doesn't matter) */
+    *entry = entries[--entry_count];
+    return 1;
+}
+
+void reaper_forget_all(void)
+{
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i].pidfd >= 0) {
+            close(entries[i].pidfd);
+        }
+    }
+    entry_count = 0;
+}
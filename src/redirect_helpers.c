@@ -8,21 +8,102 @@
  *   < file   - Read stdin from file
  *   > file   - Write stdout to file (truncate)
  *   >> file  - Append stdout to file
+ *   <<EOF    - Read stdin from the here-document's text
+ *   <<< word - Read stdin from word and a newline
+ *
+ * Here-documents and here-strings are written to a memory file (memfd),
+ * not a temporary file on disk or a pipe fed by a helper process.
+ *
+ * A forked child just applies them with apply_redirections(). Code that
+ * runs in the shell process itself (built-ins, in-process registry
+ * commands) uses a redirection scope instead, which puts the shell's
+ * own stdin/stdout back afterwards.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* memfd_create() */
+#endif
+
 #include "picobox.h"
 #include "redirect_helpers.h"
+#include "trace.h"
 #include <fcntl.h>
+#include <limits.h>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+int open_memory_file(const char *name)
+{
+    const char *dir = getenv("TMPDIR");
+    char template[PATH_MAX];
+    int fd;
+
+#if defined(__linux__)
+    fd = memfd_create(name, MFD_CLOEXEC);
+    if (fd >= 0) {
+        return fd;
+    }
+#else
+    (void)name;
+#endif
+    if (!dir || !dir[0] ||
+        snprintf(template, sizeof(template), "%s/picoboxXXXXXX", dir) >= (int)sizeof(template)) {
+        strcpy(template, "/tmp/picoboxXXXXXX");
+    }
+    fd = mkstemp(template);
+    if (fd >= 0) {
+        unlink(template);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+}
+
+/* Write all len bytes at p: 0, or -1 on error */
+static int write_text(int fd, const char *p, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int open_here_document(const char *text, size_t len, int newline)
+{
+    int fd = open_memory_file("picobox-heredoc");
+
+    if (fd < 0) {
+        perror("here-document");
+        return -1;
+    }
+    if (write_text(fd, text, len) < 0 || (newline && write_text(fd, "\n", 1) < 0) ||
+        lseek(fd, 0, SEEK_SET) < 0) {
+        perror("here-document");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
 
 /*
- * Apply a single redirection
+ * Open the target of a redirection without applying it
  *
- * Returns: 0 on success, -1 on error
+ * target_fd: set to the fd the result should replace (stdin or stdout)
+ *
+ * Returns: Open file descriptor, or -1 on error
  */
-int apply_redirection(int type, const char *filename)
+int open_redirection(int type, const char *filename, int *target_fd)
 {
     int fd;
-    int target_fd;
 
     if (!filename) {
         fprintf(stderr, "Error: NULL filename for redirection\n");
@@ -32,39 +113,56 @@ int apply_redirection(int type, const char *filename)
     switch (type) {
         case REDIR_INPUT:
             /* Open file for reading, redirect to stdin */
-            fd = open(filename, O_RDONLY);
-            if (fd < 0) {
-                perror(filename);
-                return -1;
-            }
-            target_fd = STDIN_FILENO;
+            fd = open(filename, O_RDONLY | O_CLOEXEC);
+            *target_fd = STDIN_FILENO;
             break;
 
         case REDIR_OUTPUT:
             /* Open file for writing (truncate), redirect to stdout */
-            fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fd < 0) {
-                perror(filename);
-                return -1;
-            }
-            target_fd = STDOUT_FILENO;
+            fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            *target_fd = STDOUT_FILENO;
             break;
 
         case REDIR_APPEND:
             /* Open file for appending, redirect to stdout */
-            fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
-            if (fd < 0) {
-                perror(filename);
-                return -1;
-            }
-            target_fd = STDOUT_FILENO;
+            fd = open(filename, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            *target_fd = STDOUT_FILENO;
             break;
 
+        case REDIR_HEREDOC:
+        case REDIR_HERESTRING:
+            /* The text itself, in a memory file, to stdin */
+            *target_fd = STDIN_FILENO;
+            return open_here_document(filename, strlen(filename), type == REDIR_HERESTRING);
+
         default:
             fprintf(stderr, "Error: Unknown redirection type %d\n", type);
             return -1;
     }
 
+    if (fd < 0) {
+        perror(filename);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * Apply a single redirection
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int apply_redirection(int type, const char *filename)
+{
+    int fd;
+    int target_fd;
+
+    fd = open_redirection(type, filename, &target_fd);
+    if (fd < 0) {
+        return -1;
+    }
+
     /* Duplicate fd to target (stdin/stdout) */
     if (dup2(fd, target_fd) < 0) {
         perror("dup2");
@@ -88,6 +186,7 @@ int apply_redirection(int type, const char *filename)
  */
 int apply_redirections(struct redirection *redirections, int count)
 {
+    int status = 0;
     int i;
 
 
@@ -96,11 +195,140 @@ int apply_redirections(struct redirection *redirections, int count)
         return -1;
     }
 
+    TRACE_BEGIN("redirect", NULL);
     for (i = 0; i < count; i++) {
         if (apply_redirection(redirections[i].type, redirections[i].filename) < 0) {
+            status = -1;
+            break;
+        }
+    }
+    TRACE_END("redirect");
+
+    return status;
+}
+
+/* Saved copies live above the fds commands normally use */
+#define SCOPE_SAVE_MIN_FD 10
+
+/* saved[] marker: the stream was closed before the scope */
+#define SCOPE_WAS_CLOSED (-2)
+
+/*
+ * Put back the streams a scope has replaced so far
+ */
+static void scope_restore_streams(redir_scope_t *scope)
+{
+    for (int i = 0; i < 2; i++) {
+        if (scope->saved[i] == SCOPE_WAS_CLOSED) {
+            close(i);
+        } else if (scope->saved[i] >= 0) {
+            if (dup2(scope->saved[i], i) < 0) {
+                perror("dup2");
+            }
+            close(scope->saved[i]);
+        }
+        scope->saved[i] = -1;
+    }
+}
+
+/*
+ * Redirect stdin/stdout of the shell process to already open fds
+ *
+ * The originals are saved with F_DUPFD_CLOEXEC, so commands started
+ * inside the scope do not inherit the copies. The caller still owns
+ * stdin_fd/stdout_fd (-1 = leave that stream alone).
+ *
+ * Returns: 0 on success; -1 on error, with the streams unchanged
+ */
+int redir_scope_apply(redir_scope_t *scope, int stdin_fd, int stdout_fd)
+{
+    int fds[2] = { stdin_fd, stdout_fd };
+
+    scope->saved[0] = scope->saved[1] = -1;
+
+    /* Output buffered so far belongs to the old stdout */
+    fflush(stdout);
+
+    for (int i = 0; i < 2; i++) {
+        if (fds[i] == -1 || fds[i] == i) {
+            continue;
+        }
+
+        scope->saved[i] = fcntl(i, F_DUPFD_CLOEXEC, SCOPE_SAVE_MIN_FD);
+        if (scope->saved[i] < 0) {
+            if (errno != EBADF) {
+                perror("fcntl");
+                scope_restore_streams(scope);
+                return -1;
+            }
+            scope->saved[i] = SCOPE_WAS_CLOSED;
+        }
+
+        if (dup2(fds[i], i) < 0) {
+            perror("dup2");
+            scope_restore_streams(scope);
             return -1;
         }
     }
 
     return 0;
 }
+
+/*
+ * Open redirection targets and redirect the shell process to them
+ *
+ * All targets are opened (O_CLOEXEC) before anything is redirected, and
+ * a later redirection of the same stream wins. If any open fails, the
+ * error is printed, nothing is redirected, and no file stays open.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int redir_scope_open(redir_scope_t *scope, struct redirection *redirs, int count)
+{
+    int fds[2] = { -1, -1 };
+    int status;
+
+    scope->saved[0] = scope->saved[1] = -1;
+
+    for (int i = 0; i < count && redirs; i++) {
+        int target;
+        int fd = open_redirection(redirs[i].type, redirs[i].filename, &target);
+
+        if (fd < 0) {
+            for (int j = 0; j < 2; j++) {
+                if (fds[j] != -1) {
+                    close(fds[j]);
+                }
+            }
+            return -1;
+        }
+        if (fds[target] != -1) {
+            close(fds[target]);
+        }
+        fds[target] = fd;
+    }
+
+    status = redir_scope_apply(scope, fds[0], fds[1]);
+
+    /* stdin/stdout hold their own copies now */
+    for (int j = 0; j < 2; j++) {
+        if (fds[j] != -1) {
+            close(fds[j]);
+        }
+    }
+
+    return status;
+}
+
+/*
+ * End a scope: flush what was written to the redirected stdout, then
+ * restore the original stdin/stdout
+ *
+ * clearerr(stdin) as well: the command may have read stdin to EOF.
+ */
+void redir_scope_restore(redir_scope_t *scope)
+{
+    fflush(stdout);
+    scope_restore_streams(scope);
+    clearerr(stdin);
+}
@@ -0,0 +1,1413 @@
+/*
+ * regex_dfa.c - Regular expression compiler and lazy DFA matcher
+ *
+ * Pipeline: pattern -> syntax tree -> Thompson NFA -> DFA states built
+ * on demand.
+ *
+ * A DFA state is the set of NFA states the automaton can be in, and
+ * every state also contains the NFA start (the search is unanchored),
+ * so one pass over a line finds a match starting anywhere in it. Bytes
+ * that no part of the pattern tells apart share a byte class, which
+ * keeps the transition tables small. States live in a cache bounded
+ * by REGEX_DFA_CACHE_BYTES: when it fills up, it is emptied and
+ * rebuilt from where the scan is.
+ *
+ * ^ and $ are NFA assertion nodes: ^ is only followed from the start
+ * state of a line, and $ when the line ends, which the state records
+ * as accept_eol.
+ */
+
+#include "regex_dfa.h"
+#include "literal_search.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Largest count allowed in {m,n} (POSIX RE_DUP_MAX) */
+#define REGEX_DUP_MAX 255
+
+/* Limits on what a pattern may compile to */
+#define REGEX_MAX_NFA   (64 * 1024)
+#define REGEX_MAX_DEPTH 100
+
+/* Memory the DFA state cache may use before it is emptied */
+#define REGEX_DFA_CACHE_BYTES (8 * 1024 * 1024)
+#define REGEX_DFA_BUCKETS 4096
+
+/* Longest required literal tracked by the prefilter analysis */
+#define REGEX_MUST_MAX 32
+
+/* ===== Byte sets ===== */
+
+typedef struct byte_set {
+    uint32_t bits[8];
+} byte_set_t;
+
+static void set_add(byte_set_t *s, int c)
+{
+    s->bits[c >> 5] |= 1u << (c & 31);
+}
+
+static int set_has(const byte_set_t *s, int c)
+{
+    return (s->bits[c >> 5] >> (c & 31)) & 1;
+}
+
+/* ===== Syntax tree ===== */
+
+enum {
+    AST_EMPTY,
+    AST_SET,      /* One byte from sets[set] */
+    AST_CAT,      /* Children a, a->next, ... in order */
+    AST_ALT,      /* Any one of the children */
+    AST_REPEAT,   /* Child a, min..max times (max -1 = unbounded) */
+    AST_BOL,
+    AST_EOL
+};
+
+typedef struct ast_node {
+    int type;
+    int a;        /* First child */
+    int next;     /* Next sibling in a CAT/ALT */
+    int set;
+    int min, max;
+} ast_node_t;
+
+/* ===== NFA ===== */
+
+enum {
+    NFA_SET,      /* Consume a byte in sets[set], go to out */
+    NFA_SPLIT,    /* Go to out and out1 */
+    NFA_BOL,      /* Go to out at the start of a line */
+    NFA_EOL,      /* Go to out at the end of a line */
+    NFA_MATCH
+};
+
+typedef struct nfa_node {
+    int type;
+    int out, out1;
+    int set;
+} nfa_node_t;
+
+/* ===== DFA ===== */
+
+typedef struct dfa_state {
+    int *nodes;              /* Sorted NFA states (SET, EOL and MATCH only) */
+    int nnodes;
+    unsigned hash;
+    int hnext;               /* Next state in the same hash bucket */
+    unsigned char accept;    /* A match has been seen */
+    unsigned char accept_eol;/* A match if the line ends here */
+    int trans[];             /* Next state per byte class, -1 = not built */
+} dfa_state_t;
+
+struct regex_dfa {
+    /* Compiled pattern */
+    byte_set_t *sets;
+    int nsets, sets_cap;
+    nfa_node_t *nfa;
+    int nnfa, nfa_cap;
+    int start;
+
+    /* Required literal (must.len == 0 if none) */
+    literal_search_t must;
+
+    /* Byte classes */
+    unsigned char classmap[256];
+    unsigned char classrep[256];
+    int nclasses;
+
+    /* State cache */
+    dfa_state_t **states;
+    int nstates, states_cap;
+    int buckets[REGEX_DFA_BUCKETS];
+    size_t cache_bytes;
+    int start_state;         /* -1 = rebuild at the next line */
+    unsigned flushes;
+
+    /* Scratch for subset construction */
+    unsigned *mark;
+    unsigned gen;
+    int *stack;
+    int *list;
+    int *eol_list;
+};
+
+/* ===== Parser ===== */
+
+enum {
+    TK_END,
+    TK_CHAR,
+    TK_SET,
+    TK_LPAREN,
+    TK_RPAREN,
+    TK_ALT,
+    TK_REPEAT,
+    TK_BOL,
+    TK_EOL
+};
+
+typedef struct re_token {
+    int kind;
+    int c;           /* TK_CHAR */
+    int set;         /* TK_SET */
+    int min, max;    /* TK_REPEAT */
+} re_token_t;
+
+typedef struct re_parser {
+    regex_dfa_t *re;
+    const char *pat;
+    size_t pos, len;
+    int extended;
+    int icase;
+    int at_start;    /* Next token starts an expression */
+    int depth;
+    re_token_t tok;
+    ast_node_t *ast;
+    int nast, ast_cap;
+    const char *error;
+} re_parser_t;
+
+static int new_set(re_parser_t *P)
+{
+    regex_dfa_t *re = P->re;
+
+    if (re->nsets == re->sets_cap) {
+        int cap = re->sets_cap ? re->sets_cap * 2 : 16;
+        byte_set_t *sets = realloc(re->sets, (size_t)cap * sizeof(byte_set_t));
+
+        if (!sets) {
+            P->error = "out of memory";
+            return -1;
+        }
+        re->sets = sets;
+        re->sets_cap = cap;
+    }
+    memset(&re->sets[re->nsets], 0, sizeof(byte_set_t));
+    return re->nsets++;
+}
+
+/* Finish a set: fold case, never match '\n' */
+static void close_set(re_parser_t *P, byte_set_t *s, int negate)
+{
+    if (P->icase) {
+        for (int c = 0; c < 256; c++) {
+            if (set_has(s, c)) {
+                set_add(s, tolower(c));
+                set_add(s, toupper(c));
+            }
+        }
+    }
+    if (negate) {
+        for (int i = 0; i < 8; i++) {
+            s->bits[i] = ~s->bits[i];
+        }
+    }
+    s->bits['\n' >> 5] &= ~(1u << ('\n' & 31));
+}
+
+static int ast_new(re_parser_t *P, int type)
+{
+    if (P->nast == P->ast_cap) {
+        int cap = P->ast_cap ? P->ast_cap * 2 : 64;
+        ast_node_t *ast = realloc(P->ast, (size_t)cap * sizeof(ast_node_t));
+
+        if (!ast) {
+            P->error = "out of memory";
+            return -1;
+        }
+        P->ast = ast;
+        P->ast_cap = cap;
+    }
+    memset(&P->ast[P->nast], 0, sizeof(ast_node_t));
+    P->ast[P->nast].type = type;
+    P->ast[P->nast].a = -1;
+    P->ast[P->nast].next = -1;
+    return P->nast++;
+}
+
+/* Add the bytes of a [:name:] class */
+static int add_named_class(byte_set_t *s, const char *name, size_t len)
+{
+    static const struct {
+        const char *name;
+        int (*test)(int);
+    } classes[] = {
+        { "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank },
+        { "cntrl", iscntrl }, { "digit", isdigit }, { "graph", isgraph },
+        { "lower", islower }, { "print", isprint }, { "punct", ispunct },
+        { "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit }
+    };
+
+    for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+        if (strlen(classes[i].name) == len && memcmp(classes[i].name, name, len) == 0) {
+            for (int c = 0; c < 256; c++) {
+                if (classes[i].test(c)) {
+                    set_add(s, c);
+                }
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Parse a bracket expression; P->pos is just past the '[' */
+static int parse_bracket(re_parser_t *P)
+{
+    const char *pat = P->pat;
+    int set = new_set(P);
+    byte_set_t s;
+    int negate = 0;
+    int first = 1;
+
+    if (set < 0) {
+        return -1;
+    }
+    memset(&s, 0, sizeof(s));
+
+    if (P->pos < P->len && pat[P->pos] == '^') {
+        negate = 1;
+        P->pos++;
+    }
+
+    for (;;) {
+        int lo, hi;
+
+        if (P->pos >= P->len) {
+            P->error = "unmatched [";
+            return -1;
+        }
+        if (pat[P->pos] == ']' && !first) {
+            P->pos++;
+            break;
+        }
+        first = 0;
+
+        if (pat[P->pos] == '[' && P->pos + 1 < P->len &&
+            (pat[P->pos + 1] == ':' || pat[P->pos + 1] == '=' || pat[P->pos + 1] == '.')) {
+            char kind = pat[P->pos + 1];
+            size_t name = P->pos + 2;
+            size_t end = name;
+
+            while (end + 1 < P->len && !(pat[end] == kind && pat[end + 1] == ']')) {
+                end++;
+            }
+            if (end + 1 >= P->len) {
+                P->error = "unmatched [";
+                return -1;
+            }
+            P->pos = end + 2;
+
+            if (kind == ':') {
+                if (add_named_class(&s, pat + name, end - name) < 0) {
+                    P->error = "invalid character class";
+                    return -1;
+                }
+                continue;
+            }
+            /* [=c=] and [.c.]: only single characters */
+            if (end - name != 1) {
+                P->error = "invalid collation character";
+                return -1;
+            }
+            lo = (unsigned char)pat[name];
+        } else {
+            lo = (unsigned char)pat[P->pos++];
+        }
+
+        hi = lo;
+        if (P->pos + 1 < P->len && pat[P->pos] == '-' && pat[P->pos + 1] != ']') {
+            hi = (unsigned char)pat[P->pos + 1];
+            P->pos += 2;
+            if (hi < lo) {
+                P->error = "invalid range end";
+                return -1;
+            }
+        }
+        for (int c = lo; c <= hi; c++) {
+            set_add(&s, c);
+        }
+    }
+
+    close_set(P, &s, negate);
+    P->re->sets[set] = s;
+    return set;
+}
+
+/* Set for \w \W \s \S */
+static int escape_class(re_parser_t *P, int c)
+{
+    int set = new_set(P);
+    byte_set_t s;
+
+    if (set < 0) {
+        return -1;
+    }
+    memset(&s, 0, sizeof(s));
+    for (int b = 0; b < 256; b++) {
+        int in = (c == 'w' || c == 'W') ? (isalnum(b) || b == '_') : isspace(b);
+
+        if (in) {
+            set_add(&s, b);
+        }
+    }
+    close_set(P, &s, c == 'W' || c == 'S');
+    P->re->sets[set] = s;
+    return set;
+}
+
+/*
+ * Parse "m}", "m,}", ",n}" or "m,n}" after a '{' (BRE: "\}")
+ * Returns: 0 on success, -1 if it is not an interval
+ */
+static int parse_interval(re_parser_t *P, re_token_t *t)
+{
+    size_t pos = P->pos;
+    int min = -1, max = -1;
+    int comma = 0;
+
+    while (pos < P->len && isdigit((unsigned char)P->pat[pos])) {
+        min = (min < 0 ? 0 : min * 10) + (P->pat[pos++] - '0');
+        if (min > REGEX_DUP_MAX) {
+            return -1;
+        }
+    }
+    if (pos < P->len && P->pat[pos] == ',') {
+        comma = 1;
+        pos++;
+        while (pos < P->len && isdigit((unsigned char)P->pat[pos])) {
+            max = (max < 0 ? 0 : max * 10) + (P->pat[pos++] - '0');
+            if (max > REGEX_DUP_MAX) {
+                return -1;
+            }
+        }
+    }
+    if (!P->extended) {
+        if (pos >= P->len || P->pat[pos] != '\\') {
+            return -1;
+        }
+        pos++;
+    }
+    if (pos >= P->len || P->pat[pos] != '}' || (min < 0 && max < 0)) {
+        return -1;
+    }
+
+    t->kind = TK_REPEAT;
+    t->min = min < 0 ? 0 : min;
+    t->max = comma ? max : t->min;
+    if (t->max >= 0 && t->max < t->min) {
+        return -1;
+    }
+    P->pos = pos + 1;
+    return 0;
+}
+
+/* Read the next token into P->tok */
+static void lex(re_parser_t *P)
+{
+    re_token_t *t = &P->tok;
+    int c;
+
+    memset(t, 0, sizeof(*t));
+    if (P->error || P->pos >= P->len) {
+        t->kind = TK_END;
+        return;
+    }
+
+    c = (unsigned char)P->pat[P->pos++];
+    t->kind = TK_CHAR;
+    t->c = c;
+
+    if (c == '\\') {
+        if (P->pos >= P->len) {
+            P->error = "trailing backslash";
+            t->kind = TK_END;
+            return;
+        }
+        c = (unsigned char)P->pat[P->pos++];
+        t->c = c;
+
+        if (!P->extended) {
+            switch (c) {
+            case '(': t->kind = TK_LPAREN; return;
+            case ')': t->kind = TK_RPAREN; return;
+            case '|': t->kind = TK_ALT; return;
+            case '+': t->kind = TK_REPEAT; t->min = 1; t->max = -1; break;
+            case '?': t->kind = TK_REPEAT; t->min = 0; t->max = 1; break;
+            case '{':
+                if (parse_interval(P, t) < 0) {
+                    P->error = "invalid interval";
+                    t->kind = TK_END;
+                    return;
+                }
+                break;
+            }
+            if (t->kind == TK_REPEAT) {
+                if (P->at_start) {
+                    t->kind = TK_CHAR;
+                }
+                return;
+            }
+        }
+
+        if (c >= '1' && c <= '9') {
+            P->error = "back-references are not supported";
+            t->kind = TK_END;
+        } else if (c == '<' || c == '>' || c == 'b' || c == 'B' || c == '`' || c == '\'') {
+            P->error = "word and buffer boundaries are not supported";
+            t->kind = TK_END;
+        } else if (c == 'w' || c == 'W' || c == 's' || c == 'S') {
+            t->kind = TK_SET;
+            t->set = escape_class(P, c);
+        }
+        return;
+    }
+
+    switch (c) {
+    case '[':
+        t->kind = TK_SET;
+        t->set = parse_bracket(P);
+        return;
+
+    case '.': {
+        byte_set_t any;
+
+        t->kind = TK_SET;
+        t->set = new_set(P);
+        if (t->set >= 0) {
+            memset(&any, 0xff, sizeof(any));
+            close_set(P, &any, 0);
+            P->re->sets[t->set] = any;
+        }
+        return;
+    }
+
+    case '*':
+        if (!P->at_start) {
+            t->kind = TK_REPEAT;
+            t->min = 0;
+            t->max = -1;
+        }
+        return;
+
+    case '^':
+        if (P->extended || P->at_start) {
+            t->kind = TK_BOL;
+        }
+        return;
+
+    case '$':
+        /* BRE: an anchor only at the end of an expression */
+        if (P->extended || P->pos == P->len ||
+            (P->pos + 1 < P->len && P->pat[P->pos] == '\\' &&
+             (P->pat[P->pos + 1] == ')' || P->pat[P->pos + 1] == '|'))) {
+            t->kind = TK_EOL;
+        }
+        return;
+    }
+
+    if (!P->extended) {
+        return;
+    }
+
+    switch (c) {
+    case '(': t->kind = TK_LPAREN; break;
+    case ')': t->kind = TK_RPAREN; break;
+    case '|': t->kind = TK_ALT; break;
+    case '+':
+    case '?':
+        if (!P->at_start) {
+            t->kind = TK_REPEAT;
+            t->min = c == '+' ? 1 : 0;
+            t->max = c == '+' ? -1 : 1;
+        }
+        break;
+    case '{':
+        /* Not an interval: a literal '{', as GNU grep -E */
+        if (!P->at_start && parse_interval(P, t) < 0) {
+            t->kind = TK_CHAR;
+        }
+        break;
+    }
+}
+
+/* Consume the current token */
+static void advance(re_parser_t *P)
+{
+    int kind = P->tok.kind;
+
+    P->at_start = (kind == TK_LPAREN || kind == TK_ALT || kind == TK_BOL);
+    lex(P);
+}
+
+static int parse_alt(re_parser_t *P);
+
+static int parse_atom(re_parser_t *P)
+{
+    re_token_t *t = &P->tok;
+    int node;
+
+    switch (t->kind) {
+    case TK_LPAREN:
+        if (++P->depth > REGEX_MAX_DEPTH) {
+            P->error = "pattern nested too deeply";
+            return -1;
+        }
+        advance(P);
+        node = parse_alt(P);
+        if (node < 0) {
+            return -1;
+        }
+        if (P->tok.kind != TK_RPAREN) {
+            P->error = "unmatched (";
+            return -1;
+        }
+        P->depth--;
+        break;
+
+    case TK_BOL:
+        node = ast_new(P, AST_BOL);
+        break;
+
+    case TK_EOL:
+        node = ast_new(P, AST_EOL);
+        break;
+
+    case TK_SET:
+        if (t->set < 0) {
+            return -1;
+        }
+        node = ast_new(P, AST_SET);
+        if (node >= 0) {
+            P->ast[node].set = t->set;
+        }
+        break;
+
+    default: {
+        /* TK_CHAR, or an operator that stands for itself here */
+        byte_set_t s;
+        int set = new_set(P);
+
+        if (set < 0) {
+            return -1;
+        }
+        memset(&s, 0, sizeof(s));
+        set_add(&s, t->c);
+        close_set(P, &s, 0);
+        P->re->sets[set] = s;
+        node = ast_new(P, AST_SET);
+        if (node >= 0) {
+            P->ast[node].set = set;
+        }
+        break;
+    }
+    }
+
+    advance(P);
+    return node;
+}
+
+static int parse_repeat(re_parser_t *P)
+{
+    int node = parse_atom(P);
+    int count = 0;
+
+    while (node >= 0 && P->tok.kind == TK_REPEAT) {
+        int rep;
+
+        if (++count > REGEX_MAX_DEPTH) {
+            P->error = "pattern nested too deeply";
+            return -1;
+        }
+        rep = ast_new(P, AST_REPEAT);
+        if (rep < 0) {
+            return -1;
+        }
+        P->ast[rep].a = node;
+        P->ast[rep].min = P->tok.min;
+        P->ast[rep].max = P->tok.max;
+        node = rep;
+        advance(P);
+    }
+
+    return node;
+}
+
+static int parse_concat(re_parser_t *P)
+{
+    int cat = -1;
+    int last = -1;
+
+    while (P->tok.kind != TK_END && P->tok.kind != TK_ALT && P->tok.kind != TK_RPAREN) {
+        int node = parse_repeat(P);
+
+        if (node < 0) {
+            return -1;
+        }
+        if (cat < 0) {
+            cat = ast_new(P, AST_CAT);
+            if (cat < 0) {
+                return -1;
+            }
+            P->ast[cat].a = node;
+        } else {
+            P->ast[last].next = node;
+        }
+        last = node;
+    }
+
+    return cat < 0 ? ast_new(P, AST_EMPTY) : cat;
+}
+
+static int parse_alt(re_parser_t *P)
+{
+    int first = parse_concat(P);
+    int alt, last;
+
+    if (first < 0 || P->tok.kind != TK_ALT) {
+        return first;
+    }
+
+    alt = ast_new(P, AST_ALT);
+    if (alt < 0) {
+        return -1;
+    }
+    P->ast[alt].a = first;
+    last = first;
+
+    while (P->tok.kind == TK_ALT) {
+        int node;
+
+        advance(P);
+        node = parse_concat(P);
+        if (node < 0) {
+            return -1;
+        }
+        P->ast[last].next = node;
+        last = node;
+    }
+
+    return alt;
+}
+
+/* ===== Required literal ===== */
+
+/*
+ * What is known about the strings a subexpression matches: each one
+ * starts with prefix, ends with suffix and contains must; if exact,
+ * it matches exactly one string.
+ */
+typedef struct must_info {
+    int exact;
+    char prefix[REGEX_MUST_MAX + 1];
+    char suffix[REGEX_MUST_MAX + 1];
+    char must[REGEX_MUST_MAX + 1];
+} must_info_t;
+
+/* dst = a + b, keeping the head (keep_tail = 0) or the tail */
+static void must_join(char *dst, const char *a, const char *b, int keep_tail)
+{
+    char joined[2 * REGEX_MUST_MAX + 1];
+    size_t len;
+
+    snprintf(joined, sizeof(joined), "%s%s", a, b);
+    len = strlen(joined);
+    if (keep_tail && len > REGEX_MUST_MAX) {
+        memmove(joined, joined + len - REGEX_MUST_MAX, REGEX_MUST_MAX + 1);
+    }
+    joined[REGEX_MUST_MAX] = '\0';
+    strcpy(dst, joined);
+}
+
+static void must_longest(char *dst, const char *candidate)
+{
+    if (strlen(candidate) > strlen(dst)) {
+        strcpy(dst, candidate);
+    }
+}
+
+static void must_analyze(re_parser_t *P, int node, must_info_t *info)
+{
+    ast_node_t *n = &P->ast[node];
+
+    memset(info, 0, sizeof(*info));
+
+    switch (n->type) {
+    case AST_EMPTY:
+    case AST_BOL:
+    case AST_EOL:
+        info->exact = 1;
+        break;
+
+    case AST_SET: {
+        const byte_set_t *s = &P->re->sets[n->set];
+        int only = -1;
+
+        /* One byte, or with -i one letter in both cases */
+        for (int c = 0; c < 256; c++) {
+            if (set_has(s, c)) {
+                int f = P->icase ? tolower(c) : c;
+
+                if (only >= 0 && only != f) {
+                    return;
+                }
+                only = f;
+            }
+        }
+        if (only > 0) {
+            info->exact = 1;
+            info->prefix[0] = info->suffix[0] = info->must[0] = (char)only;
+        }
+        break;
+    }
+
+    case AST_CAT: {
+        must_info_t child;
+
+        info->exact = 1;
+        for (int c = n->a; c >= 0; c = P->ast[c].next) {
+            char joined[REGEX_MUST_MAX + 1];
+
+            must_analyze(P, c, &child);
+
+            must_join(joined, info->suffix, child.prefix, 0);
+            must_longest(info->must, joined);
+            must_longest(info->must, child.must);
+
+            if (info->exact) {
+                must_join(info->prefix, info->prefix, child.prefix, 0);
+            }
+            if (child.exact) {
+                must_join(info->suffix, info->suffix, child.suffix, 1);
+            } else {
+                strcpy(info->suffix, child.suffix);
+            }
+            info->exact = info->exact && child.exact &&
+                          strlen(info->prefix) < REGEX_MUST_MAX;
+        }
+        break;
+    }
+
+    case AST_ALT: {
+        must_info_t first, other;
+        int same = 1;
+
+        must_analyze(P, n->a, &first);
+        for (int c = P->ast[n->a].next; c >= 0; c = P->ast[c].next) {
+            must_analyze(P, c, &other);
+            same = same && other.exact && first.exact &&
+                   strcmp(other.must, first.must) == 0;
+        }
+        if (same) {
+            *info = first;
+        }
+        break;
+    }
+
+    case AST_REPEAT: {
+        must_info_t child;
+
+        if (n->min == 0) {
+            break;
+        }
+        must_analyze(P, n->a, &child);
+        strcpy(info->prefix, child.prefix);
+        strcpy(info->suffix, child.suffix);
+        strcpy(info->must, child.must);
+        break;
+    }
+    }
+}
+
+/* ===== NFA construction ===== */
+
+static int nfa_new(regex_dfa_t *re, int type, int out, int out1, const char **error)
+{
+    if (re->nnfa >= REGEX_MAX_NFA) {
+        *error = "regular expression too big";
+        return -1;
+    }
+    if (re->nnfa == re->nfa_cap) {
+        int cap = re->nfa_cap ? re->nfa_cap * 2 : 64;
+        nfa_node_t *nfa = realloc(re->nfa, (size_t)cap * sizeof(nfa_node_t));
+
+        if (!nfa) {
+            *error = "out of memory";
+            return -1;
+        }
+        re->nfa = nfa;
+        re->nfa_cap = cap;
+    }
+    re->nfa[re->nnfa].type = type;
+    re->nfa[re->nnfa].out = out;
+    re->nfa[re->nnfa].out1 = out1;
+    re->nfa[re->nnfa].set = -1;
+    return re->nnfa++;
+}
+
+/*
+ * Emit NFA nodes for a subexpression that continues at next
+ * Returns: its entry node, or -1 on error (P->error set)
+ */
+static int nfa_build(re_parser_t *P, int node, int next)
+{
+    regex_dfa_t *re = P->re;
+    ast_node_t *n = &P->ast[node];
+    int entry;
+
+    switch (n->type) {
+    case AST_EMPTY:
+        return next;
+
+    case AST_SET:
+        entry = nfa_new(re, NFA_SET, next, -1, &P->error);
+        if (entry >= 0) {
+            re->nfa[entry].set = n->set;
+        }
+        return entry;
+
+    case AST_BOL:
+        return nfa_new(re, NFA_BOL, next, -1, &P->error);
+
+    case AST_EOL:
+        return nfa_new(re, NFA_EOL, next, -1, &P->error);
+
+    case AST_CAT: {
+        int children[64];
+        int *kids = children;
+        int count = 0;
+
+        for (int c = n->a; c >= 0; c = P->ast[c].next) {
+            count++;
+        }
+        if (count > 64) {
+            kids = malloc((size_t)count * sizeof(int));
+            if (!kids) {
+                P->error = "out of memory";
+                return -1;
+            }
+        }
+        count = 0;
+        for (int c = n->a; c >= 0; c = P->ast[c].next) {
+            kids[count++] = c;
+        }
+
+        /* Built back to front: each child continues at the next one */
+        entry = next;
+        while (count > 0 && entry >= 0) {
+            entry = nfa_build(P, kids[--count], entry);
+        }
+        if (kids != children) {
+            free(kids);
+        }
+        return entry;
+    }
+
+    case AST_ALT: {
+        int branch = nfa_build(P, n->a, next);
+
+        entry = branch;
+        for (int c = P->ast[n->a].next; c >= 0 && entry >= 0; c = P->ast[c].next) {
+            int other = nfa_build(P, c, next);
+
+            if (other < 0) {
+                return -1;
+            }
+            entry = nfa_new(re, NFA_SPLIT, entry, other, &P->error);
+        }
+        return entry;
+    }
+
+    case AST_REPEAT: {
+        int child = n->a;
+        int copies = n->min;
+
+        entry = next;
+        if (n->max < 0) {
+            /* Loop: SPLIT -> child -> SPLIT, or on to next */
+            int loop = nfa_new(re, NFA_SPLIT, -1, next, &P->error);
+            int body;
+
+            if (loop < 0) {
+                return -1;
+            }
+            body = nfa_build(P, child, loop);
+            if (body < 0) {
+                return -1;
+            }
+            re->nfa[loop].out = body;
+
+            /* x{m,} is x{m-1} followed by x+, which enters the body */
+            entry = n->min > 0 ? body : loop;
+            copies = n->min > 0 ? n->min - 1 : 0;
+        } else {
+            /* Optional copies, nested: x{0,2} is (x(x)?)? */
+            for (int i = n->min; i < n->max && entry >= 0; i++) {
+                int body = nfa_build(P, child, entry);
+
+                if (body < 0) {
+                    return -1;
+                }
+                entry = nfa_new(re, NFA_SPLIT, body, next, &P->error);
+            }
+        }
+        for (int i = 0; i < copies && entry >= 0; i++) {
+            entry = nfa_build(P, child, entry);
+        }
+        return entry;
+    }
+    }
+
+    P->error = "internal error";
+    return -1;
+}
+
+/* ===== Byte classes ===== */
+
+/* Split bytes into classes that every set treats alike */
+static void build_classes(regex_dfa_t *re)
+{
+    int map[256][2];
+    int nclasses = 1;
+
+    memset(re->classmap, 0, sizeof(re->classmap));
+    for (int s = 0; s < re->nsets; s++) {
+        int next = 0;
+
+        for (int k = 0; k < nclasses; k++) {
+            map[k][0] = map[k][1] = -1;
+        }
+        for (int c = 0; c < 256; c++) {
+            int in = set_has(&re->sets[s], c);
+            int *slot = &map[re->classmap[c]][in];
+
+            if (*slot < 0) {
+                *slot = next++;
+            }
+            re->classmap[c] = (unsigned char)*slot;
+        }
+        nclasses = next;
+    }
+
+    for (int c = 255; c >= 0; c--) {
+        re->classrep[re->classmap[c]] = (unsigned char)c;
+    }
+    re->nclasses = nclasses;
+}
+
+/* ===== DFA states ===== */
+
+#define CTX_BOL 0x01
+#define CTX_EOL 0x02
+
+/*
+ * Add the closure of node to out[]: follow SPLIT (and ^ / $ where ctx
+ * allows), collect the nodes that consume a byte, $ and MATCH. Nodes
+ * already marked with re->gen are skipped.
+ */
+static void closure_add(regex_dfa_t *re, int node, int ctx, int *out, int *nout)
+{
+    int sp = 0;
+
+    re->stack[sp++] = node;
+    while (sp > 0) {
+        int n = re->stack[--sp];
+        nfa_node_t *nn;
+
+        if (n < 0 || re->mark[n] == re->gen) {
+            continue;
+        }
+        re->mark[n] = re->gen;
+        nn = &re->nfa[n];
+
+        switch (nn->type) {
+        case NFA_SPLIT:
+            re->stack[sp++] = nn->out1;
+            re->stack[sp++] = nn->out;
+            break;
+        case NFA_BOL:
+            if (ctx & CTX_BOL) {
+                re->stack[sp++] = nn->out;
+            }
+            break;
+        case NFA_EOL:
+            if (ctx & CTX_EOL) {
+                re->stack[sp++] = nn->out;
+            } else {
+                out[(*nout)++] = n;
+            }
+            break;
+        default:
+            out[(*nout)++] = n;
+            break;
+        }
+    }
+}
+
+static void next_gen(regex_dfa_t *re)
+{
+    if (++re->gen == 0) {
+        memset(re->mark, 0, (size_t)re->nnfa * sizeof(unsigned));
+        re->gen = 1;
+    }
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Drop every cached state */
+static void cache_flush(regex_dfa_t *re)
+{
+    for (int i = 0; i < re->nstates; i++) {
+        free(re->states[i]);
+    }
+    re->nstates = 0;
+    re->cache_bytes = 0;
+    re->start_state = -1;
+    re->flushes++;
+    for (int i = 0; i < REGEX_DFA_BUCKETS; i++) {
+        re->buckets[i] = -1;
+    }
+}
+
+/*
+ * Find or create the state for the NFA states in list[0..n)
+ * Returns: state index, or -1 if out of memory
+ */
+static int intern_state(regex_dfa_t *re, int *list, int n)
+{
+    unsigned hash = 2166136261u;
+    size_t size;
+    dfa_state_t *st;
+    int id;
+
+    qsort(list, (size_t)n, sizeof(int), cmp_int);
+    for (int i = 0; i < n; i++) {
+        hash = (hash ^ (unsigned)list[i]) * 16777619u;
+    }
+
+    for (id = re->buckets[hash % REGEX_DFA_BUCKETS]; id >= 0; id = re->states[id]->hnext) {
+        st = re->states[id];
+        if (st->hash == hash && st->nnodes == n &&
+            memcmp(st->nodes, list, (size_t)n * sizeof(int)) == 0) {
+            return id;
+        }
+    }
+
+    size = sizeof(dfa_state_t) + (size_t)(re->nclasses + n) * sizeof(int);
+    if (re->cache_bytes + size > REGEX_DFA_CACHE_BYTES) {
+        cache_flush(re);
+    }
+    if (re->nstates == re->states_cap) {
+        int cap = re->states_cap ? re->states_cap * 2 : 64;
+        dfa_state_t **states = realloc(re->states, (size_t)cap * sizeof(dfa_state_t *));
+
+        if (!states) {
+            return -1;
+        }
+        re->states = states;
+        re->states_cap = cap;
+    }
+
+    st = malloc(size);
+    if (!st) {
+        return -1;
+    }
+    st->nodes = st->trans + re->nclasses;
+    st->nnodes = n;
+    memcpy(st->nodes, list, (size_t)n * sizeof(int));
+    for (int k = 0; k < re->nclasses; k++) {
+        st->trans[k] = -1;
+    }
+    st->hash = hash;
+    st->accept = 0;
+    st->accept_eol = 0;
+
+    /* Accepting now, or once $ holds */
+    next_gen(re);
+    for (int i = 0; i < n; i++) {
+        nfa_node_t *nn = &re->nfa[list[i]];
+
+        if (nn->type == NFA_MATCH) {
+            st->accept = st->accept_eol = 1;
+        } else if (nn->type == NFA_EOL && !st->accept_eol) {
+            int neol = 0;
+
+            closure_add(re, nn->out, CTX_EOL, re->eol_list, &neol);
+            for (int j = 0; j < neol; j++) {
+                if (re->nfa[re->eol_list[j]].type == NFA_MATCH) {
+                    st->accept_eol = 1;
+                }
+            }
+        }
+    }
+
+    id = re->nstates++;
+    re->states[id] = st;
+    st->hnext = re->buckets[hash % REGEX_DFA_BUCKETS];
+    re->buckets[hash % REGEX_DFA_BUCKETS] = id;
+    re->cache_bytes += size;
+
+    return id;
+}
+
+/* Start state for a new line */
+static int start_state(regex_dfa_t *re)
+{
+    int n = 0;
+
+    if (re->start_state >= 0) {
+        return re->start_state;
+    }
+    next_gen(re);
+    closure_add(re, re->start, CTX_BOL, re->list, &n);
+    re->start_state = intern_state(re, re->list, n);
+    return re->start_state;
+}
+
+/*
+ * Build the transition of state id on byte class k
+ * Returns: next state, or -1 if out of memory
+ */
+static int dfa_step(regex_dfa_t *re, int id, int k)
+{
+    dfa_state_t *st = re->states[id];
+    int c = re->classrep[k];
+    unsigned flushes = re->flushes;
+    int n = 0;
+    int next;
+
+    next_gen(re);
+    for (int i = 0; i < st->nnodes; i++) {
+        nfa_node_t *nn = &re->nfa[st->nodes[i]];
+
+        if (nn->type == NFA_SET && set_has(&re->sets[nn->set], c)) {
+            closure_add(re, nn->out, 0, re->list, &n);
+        }
+    }
+    /* A match may also start at the next byte */
+    closure_add(re, re->start, 0, re->list, &n);
+
+    next = intern_state(re, re->list, n);
+    if (next >= 0 && re->flushes == flushes) {
+        re->states[id]->trans[k] = next;
+    }
+    return next;
+}
+
+/*
+ * Run the DFA over one line (no '\n' inside)
+ * Returns: 1 if it matches, 0 if not
+ */
+static int dfa_match_line(regex_dfa_t *re, const unsigned char *p, const unsigned char *end)
+{
+    int id = start_state(re);
+    dfa_state_t *st;
+
+    if (id < 0) {
+        goto oom;
+    }
+    st = re->states[id];
+
+    for (; p < end; p++) {
+        int next;
+
+        if (st->accept) {
+            return 1;
+        }
+        if (st->nnodes == 0) {
+            return 0;   /* Anchored pattern that cannot match any more */
+        }
+        next = st->trans[re->classmap[*p]];
+        if (next < 0) {
+            next = dfa_step(re, id, re->classmap[*p]);
+            if (next < 0) {
+                goto oom;
+            }
+        }
+        id = next;
+        st = re->states[id];
+    }
+
+    return st->accept_eol;
+
+oom:
+    fprintf(stderr, "regex: out of memory\n");
+    return 0;
+}
+
+/* ===== Public interface ===== */
+
+regex_dfa_t *regex_dfa_compile(const char *pattern, int flags,
+                               char *errbuf, size_t errlen)
+{
+    return regex_dfa_compile_set(&pattern, 1, flags, errbuf, errlen);
+}
+
+regex_dfa_t *regex_dfa_compile_set(const char *const *patterns, size_t n, int flags,
+                                   char *errbuf, size_t errlen)
+{
+    re_parser_t P;
+    regex_dfa_t *re;
+    must_info_t must;
+    int root = -1;
+    int last = -1;
+    int match;
+
+    re = calloc(1, sizeof(regex_dfa_t));
+    if (!re) {
+        snprintf(errbuf, errlen, "out of memory");
+        return NULL;
+    }
+
+    memset(&P, 0, sizeof(P));
+    P.re = re;
+    P.extended = (flags & REGEX_EXTENDED) != 0;
+    P.icase = (flags & REGEX_ICASE) != 0;
+
+    /* Several patterns are alternatives under one ALT node */
+    if (n != 1) {
+        root = ast_new(&P, AST_ALT);
+    }
+
+    for (size_t i = 0; i < n && !P.error; i++) {
+        int node;
+
+        P.pat = patterns[i];
+        P.pos = 0;
+        P.len = strlen(patterns[i]);
+        P.at_start = 1;
+        P.depth = 0;
+
+        lex(&P);
+        node = parse_alt(&P);
+        if (!P.error && P.tok.kind == TK_RPAREN) {
+            P.error = "unmatched )";
+        }
+        if (node < 0) {
+            if (!P.error) {
+                P.error = "invalid pattern";
+            }
+            break;
+        }
+
+        if (n == 1) {
+            root = node;
+        } else if (last < 0) {
+            P.ast[root].a = node;
+        } else {
+            P.ast[last].next = node;
+        }
+        last = node;
+    }
+
+    /* No patterns at all: a set that can never match */
+    if (!P.error && n == 0) {
+        int set = new_set(&P);
+
+        if (set >= 0) {
+            P.ast[root].type = AST_SET;
+            P.ast[root].set = set;
+        }
+    }
+
+    if (!P.error && root >= 0) {
+        must_analyze(&P, root, &must);
+        if (literal_search_init(&re->must, must.must, strlen(must.must), P.icase) != 0) {
+            P.error = "out of memory";
+        }
+
+        match = P.error ? -1 : nfa_new(re, NFA_MATCH, -1, -1, &P.error);
+        if (match >= 0) {
+            re->start = nfa_build(&P, root, match);
+        }
+    }
+
+    free(P.ast);
+
+    if (P.error || root < 0) {
+        snprintf(errbuf, errlen, "%s", P.error ? P.error : "invalid pattern");
+        regex_dfa_free(re);
+        return NULL;
+    }
+
+    build_classes(re);
+
+    re->mark = calloc((size_t)re->nnfa, sizeof(unsigned));
+    re->stack = malloc((size_t)(2 * re->nnfa + 2) * sizeof(int));
+    re->list = malloc((size_t)re->nnfa * sizeof(int));
+    re->eol_list = malloc((size_t)re->nnfa * sizeof(int));
+    if (!re->mark || !re->stack || !re->list || !re->eol_list) {
+        snprintf(errbuf, errlen, "out of memory");
+        regex_dfa_free(re);
+        return NULL;
+    }
+
+    cache_flush(re);
+    re->flushes = 0;
+    return re;
+}
+
+const char *regex_dfa_search(regex_dfa_t *re, const char *buf, size_t len)
+{
+    const char *p = buf;
+    const char *end = buf + len;
+
+    for (;;) {
+        const char *line = p;
+        const char *eol;
+
+        if (re->must.len > 0) {
+            /* Skip straight to the next line containing the literal */
+            const char *hit = literal_search_find(&re->must, p, (size_t)(end - p));
+
+            if (!hit) {
+                return NULL;
+            }
+            for (line = hit; line > p && line[-1] != '\n'; line--) {
+                ;
+            }
+        }
+
+        eol = memchr(line, '\n', (size_t)(end - line));
+        if (!eol) {
+            eol = end;
+        }
+
+        if (dfa_match_line(re, (const unsigned char *)line, (const unsigned char *)eol)) {
+            return line;
+        }
+        if (eol == end) {
+            return NULL;
+        }
+        p = eol + 1;
+    }
+}
+
+void regex_dfa_free(regex_dfa_t *re)
+{
+    if (!re) {
+        return;
+    }
+    for (int i = 0; i < re->nstates; i++) {
+        free(re->states[i]);
+    }
+    free(re->states);
+    free(re->sets);
+    free(re->nfa);
+    free(re->mark);
+    free(re->stack);
+    free(re->list);
+    free(re->eol_list);
+    literal_search_free(&re->must);
+    free(re);
+}
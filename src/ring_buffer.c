@@ -0,0 +1,198 @@
+#include "ring_buffer.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * head is only advanced by the writer and tail only by the reader, so
+ * each index has a single owner. Both run freely (no wrap-around state);
+ * head - tail is the number of buffered bytes.
+ *
+ * Sleeping: a side that can't make progress counts itself in `sleepers`
+ * and waits on `cond`. The other side checks `sleepers` after publishing
+ * an index and only then takes the mutex to wake it, so the fast path is
+ * lock-free. (A count, not a flag: one side can still be on its way out
+ * of ring_sleep() when the other goes to sleep.)
+ */
+struct ring_buffer {
+    char *data;
+    size_t capacity;            /* Power of 2 */
+    size_t mask;                /* capacity - 1 */
+
+    atomic_size_t head;         /* Next byte to write (writer-owned) */
+    atomic_size_t tail;         /* Next byte to read (reader-owned) */
+    atomic_int writer_closed;
+    atomic_int reader_closed;
+
+    atomic_int sleepers;        /* Threads in (or entering) ring_sleep() */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+ring_buffer_t *ring_buffer_create(size_t capacity)
+{
+    size_t size = 1;
+
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    ring_buffer_t *rb = calloc(1, sizeof(ring_buffer_t));
+    if (!rb) {
+        perror("calloc");
+        return NULL;
+    }
+
+    rb->data = malloc(size);
+    if (!rb->data) {
+        perror("malloc");
+        free(rb);
+        return NULL;
+    }
+
+    rb->capacity = size;
+    rb->mask = size - 1;
+    atomic_init(&rb->head, 0);
+    atomic_init(&rb->tail, 0);
+    atomic_init(&rb->writer_closed, 0);
+    atomic_init(&rb->reader_closed, 0);
+    atomic_init(&rb->sleepers, 0);
+    pthread_mutex_init(&rb->lock, NULL);
+    pthread_cond_init(&rb->cond, NULL);
+
+    return rb;
+}
+
+void ring_buffer_destroy(ring_buffer_t *rb)
+{
+    if (!rb) {
+        return;
+    }
+
+    pthread_cond_destroy(&rb->cond);
+    pthread_mutex_destroy(&rb->lock);
+    free(rb->data);
+    free(rb);
+}
+
+/* Writer may proceed: there is space, or nobody is reading any more */
+static int ring_writable(ring_buffer_t *rb)
+{
+    return atomic_load(&rb->reader_closed) ||
+           atomic_load(&rb->head) - atomic_load(&rb->tail) < rb->capacity;
+}
+
+/* Reader may proceed: there is data, or nothing more will be written */
+static int ring_readable(ring_buffer_t *rb)
+{
+    return atomic_load(&rb->writer_closed) ||
+           atomic_load(&rb->head) != atomic_load(&rb->tail);
+}
+
+/* Block until ready(rb) holds. Pairs with ring_wake() on the other side. */
+static void ring_sleep(ring_buffer_t *rb, int (*ready)(ring_buffer_t *))
+{
+    pthread_mutex_lock(&rb->lock);
+    atomic_fetch_add(&rb->sleepers, 1);
+    while (!ready(rb)) {
+        pthread_cond_wait(&rb->cond, &rb->lock);
+    }
+    atomic_fetch_sub(&rb->sleepers, 1);
+    pthread_mutex_unlock(&rb->lock);
+}
+
+/* Call after publishing an index or a close flag */
+static void ring_wake(ring_buffer_t *rb)
+{
+    if (atomic_load(&rb->sleepers) > 0) {
+        pthread_mutex_lock(&rb->lock);
+        pthread_cond_broadcast(&rb->cond);
+        pthread_mutex_unlock(&rb->lock);
+    }
+}
+
+ssize_t ring_buffer_write(ring_buffer_t *rb, const char *data, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        if (atomic_load(&rb->reader_closed)) {
+            errno = EPIPE;
+            return -1;
+        }
+
+        size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+        size_t space = rb->capacity - (head - tail);
+
+        if (space == 0) {
+            ring_sleep(rb, ring_writable);
+            continue;
+        }
+
+        size_t n = len - done < space ? len - done : space;
+        size_t offset = head & rb->mask;
+        size_t first = n < rb->capacity - offset ? n : rb->capacity - offset;
+
+        memcpy(rb->data + offset, data + done, first);
+        memcpy(rb->data, data + done + first, n - first);
+
+        atomic_store(&rb->head, head + n);
+        ring_wake(rb);
+        done += n;
+    }
+
+    return (ssize_t)done;
+}
+
+ssize_t ring_buffer_read(ring_buffer_t *rb, char *data, size_t len)
+{
+    for (;;) {
+        if (atomic_load(&rb->reader_closed)) {
+            return 0;
+        }
+
+        size_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+        size_t avail = head - tail;
+
+        if (avail == 0) {
+            if (atomic_load(&rb->writer_closed)) {
+                /* Re-check: the last write may have landed before close */
+                if (atomic_load(&rb->head) == tail) {
+                    return 0;
+                }
+                continue;
+            }
+            ring_sleep(rb, ring_readable);
+            continue;
+        }
+
+        size_t n = len < avail ? len : avail;
+        size_t offset = tail & rb->mask;
+        size_t first = n < rb->capacity - offset ? n : rb->capacity - offset;
+
+        memcpy(data, rb->data + offset, first);
+        memcpy(data + first, rb->data, n - first);
+
+        atomic_store(&rb->tail, tail + n);
+        ring_wake(rb);
+        return (ssize_t)n;
+    }
+}
+
+void ring_buffer_close_write(ring_buffer_t *rb)
+{
+    atomic_store(&rb->writer_closed, 1);
+    ring_wake(rb);
+}
+
+void ring_buffer_close_read(ring_buffer_t *rb)
+{
+    atomic_store(&rb->reader_closed, 1);
+    ring_wake(rb);
+}
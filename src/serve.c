@@ -0,0 +1,390 @@
+/*
+ * serve.c - Resident picobox server (picobox --serve)
+ *
+ * Process layout:
+ *
+ *   master        binds the socket, pre-forks the workers, restarts any
+ *     |           that die, and cleans up on SIGINT/SIGTERM
+ *     +- worker   accept() on the shared listening socket, read one
+ *          |      request (see serve.h), answer with the exit status
+ *          +- child  installs the client's fds, cwd and environment,
+ *                    runs the registry command, _exit()s
+ *
+ * Forking a worker that is already linked and initialised is cheap
+ * compared to exec'ing picobox, and it keeps each command's globals,
+ * cwd and environment out of the next request.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* sigaction() and kill() */
+#endif
+
+#include "picobox.h"
+#include "cmd_spec.h"
+#include "serve.h"
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+#define SERVE_DEFAULT_WORKERS 4
+#define SERVE_MAX_WORKERS 64
+
+static volatile sig_atomic_t stop_requested = 0;
+static int server_fd = -1;        /* Listening socket (closed in command children) */
+
+static void on_stop_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+/* Read exactly len bytes; returns 0, or -1 on error/EOF */
+static int read_full(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/*
+ * Receive the request header and the client's three stdio fds
+ * Returns: 0 on success, -1 on a malformed request
+ */
+static int recv_header(int conn, serve_request_t *req, int fds[3])
+{
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+    } control;
+    struct iovec iov = { req, sizeof(*req) };
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    do {
+        n = recvmsg(conn, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+
+    fds[0] = fds[1] = fds[2] = -1;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(3 * sizeof(int))) {
+            memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+        }
+    }
+
+    /* The rest of the header may follow the fds in a second segment */
+    if (n > 0 && (size_t)n < sizeof(*req) &&
+        read_full(conn, (char *)req + n, sizeof(*req) - (size_t)n) == 0) {
+        n = sizeof(*req);
+    }
+
+    if (n != (ssize_t)sizeof(*req) || fds[0] < 0 || (msg.msg_flags & MSG_CTRUNC) ||
+        req->magic != SERVE_MAGIC || req->argc == 0 ||
+        req->payload_len > SERVE_MAX_PAYLOAD ||
+        req->argc + req->envc > req->payload_len) {
+        for (int i = 0; i < 3; i++) {
+            if (fds[i] >= 0) {
+                close(fds[i]);
+            }
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Split the payload into cwd, argv and envp (pointers into payload)
+ * Returns: 0 on success, -1 if the string count does not match
+ */
+static int split_payload(char *payload, const serve_request_t *req,
+                         char **cwd, char **argv, char **envp)
+{
+    char *p = payload;
+    char *end = payload + req->payload_len;
+    uint32_t total = 1 + req->argc + req->envc;
+
+    for (uint32_t i = 0; i < total; i++) {
+        char *nul = memchr(p, '\0', end - p);
+        if (!nul) {
+            return -1;
+        }
+        if (i == 0) {
+            *cwd = p;
+        } else if (i <= req->argc) {
+            argv[i - 1] = p;
+        } else {
+            envp[i - 1 - req->argc] = p;
+        }
+        p = nul + 1;
+    }
+
+    argv[req->argc] = NULL;
+    envp[req->envc] = NULL;
+    return 0;
+}
+
+/*
+ * Run one request in a fresh child of this worker (does not return)
+ */
+static void run_request(const char *cwd, char **argv, char **envp, const int fds[3])
+{
+    const cmd_spec_t *spec;
+    int argc = 0;
+
+    for (int i = 0; i < 3; i++) {
+        if (dup2(fds[i], i) < 0) {
+            _exit(EXIT_ERROR);
+        }
+    }
+
+    environ = envp;
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    if (chdir(cwd) != 0) {
+        fprintf(stderr, "picobox: %s: %s\n", cwd, strerror(errno));
+        _exit(EXIT_ERROR);
+    }
+
+    while (argv[argc]) {
+        argc++;
+    }
+
+    spec = find_command(argv[0]);
+    if (!spec || !spec->run) {
+        fprintf(stderr, "picobox: unknown command '%s'\n", argv[0]);
+        _exit(127);
+    }
+
+    int status = spec->run(argc, argv);
+    fflush(stdout);
+    fflush(stderr);
+    _exit(status);
+}
+
+/*
+ * Handle one connection: read the request, run it, send the status
+ */
+static void handle_connection(int conn)
+{
+    serve_request_t req;
+    int fds[3];
+    char *payload = NULL;
+    char **argv = NULL;
+    char **envp = NULL;
+    char *cwd = NULL;
+    int32_t status = EXIT_ERROR;
+    pid_t pid;
+
+    if (recv_header(conn, &req, fds) < 0) {
+        return;
+    }
+
+    payload = malloc(req.payload_len);
+    argv = malloc((req.argc + 1) * sizeof(char *));
+    envp = malloc((req.envc + 1) * sizeof(char *));
+    if (!payload || !argv || !envp ||
+        read_full(conn, payload, req.payload_len) < 0 ||
+        split_payload(payload, &req, &cwd, argv, envp) < 0) {
+        goto done;
+    }
+
+    pid = fork();
+    if (pid == 0) {
+        close(conn);
+        close(server_fd);
+        run_request(cwd, argv, envp, fds);
+    }
+
+    if (pid < 0) {
+        perror("fork");
+    } else {
+        int wstatus;
+
+        while (waitpid(pid, &wstatus, 0) < 0 && errno == EINTR) {
+        }
+        if (WIFEXITED(wstatus)) {
+            status = WEXITSTATUS(wstatus);
+        } else if (WIFSIGNALED(wstatus)) {
+            status = 128 + WTERMSIG(wstatus);
+        }
+    }
+
+    if (write(conn, &status, sizeof(status)) != (ssize_t)sizeof(status)) {
+        /* Client went away: nothing to report to */
+    }
+
+done:
+    for (int i = 0; i < 3; i++) {
+        close(fds[i]);
+    }
+    free(payload);
+    free(argv);
+    free(envp);
+}
+
+/* Worker process: serve connections until told to stop */
+static void worker_loop(int listen_fd)
+{
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    for (;;) {
+        int conn = accept(listen_fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("accept");
+            _exit(EXIT_ERROR);
+        }
+        handle_connection(conn);
+        close(conn);
+    }
+}
+
+static pid_t start_worker(int listen_fd)
+{
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        worker_loop(listen_fd);
+        _exit(EXIT_OK);
+    }
+    if (pid < 0) {
+        perror("fork");
+    }
+    return pid;
+}
+
+/*
+ * Bind the listening socket (only the owner may connect)
+ * A socket file left behind by a server that is gone is replaced.
+ */
+static int bind_socket(const char *path)
+{
+    struct sockaddr_un addr = {0};
+    mode_t old_mask;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "picobox: socket path too long: %s\n", path);
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "picobox: a server is already listening on %s\n", path);
+        close(fd);
+        return -1;
+    }
+    unlink(path);
+
+    old_mask = umask(077);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+        fprintf(stderr, "picobox: %s: %s\n", path, strerror(errno));
+        umask(old_mask);
+        close(fd);
+        return -1;
+    }
+    umask(old_mask);
+
+    return fd;
+}
+
+int serve_main(const char *socket_path)
+{
+    char path[108];
+    pid_t workers[SERVE_MAX_WORKERS];
+    const char *env = getenv("PICOBOX_SERVE_WORKERS");
+    int nworkers = env ? atoi(env) : SERVE_DEFAULT_WORKERS;
+    struct sigaction sa = {0};
+    int listen_fd;
+
+    if (nworkers < 1) {
+        nworkers = 1;
+    } else if (nworkers > SERVE_MAX_WORKERS) {
+        nworkers = SERVE_MAX_WORKERS;
+    }
+
+    if (socket_path) {
+        snprintf(path, sizeof(path), "%s", socket_path);
+    } else {
+        serve_socket_path(path, sizeof(path));
+    }
+
+    listen_fd = bind_socket(path);
+    if (listen_fd < 0) {
+        return EXIT_ERROR;
+    }
+    server_fd = listen_fd;
+
+    /* No SA_RESTART: waitpid() below must return when we are told to stop */
+    sa.sa_handler = on_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < nworkers; i++) {
+        workers[i] = start_worker(listen_fd);
+    }
+    fprintf(stderr, "picobox: serving on %s with %d workers\n", path, nworkers);
+
+    /* Keep the pool full until SIGINT/SIGTERM */
+    while (!stop_requested) {
+        pid_t pid = waitpid(-1, NULL, 0);
+
+        if (pid < 0) {
+            if (errno == ECHILD) {
+                break;
+            }
+            continue;
+        }
+        for (int i = 0; i < nworkers; i++) {
+            if (workers[i] == pid && !stop_requested) {
+                workers[i] = start_worker(listen_fd);
+            }
+        }
+    }
+
+    for (int i = 0; i < nworkers; i++) {
+        if (workers[i] > 0) {
+            kill(workers[i], SIGTERM);
+        }
+    }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR) {
+    }
+
+    close(listen_fd);
+    unlink(path);
+    return EXIT_OK;
+}
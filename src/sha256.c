@@ -0,0 +1,266 @@
+/*
+ * sha256.c - SHA-256 with SHA-NI and ARMv8 block functions
+ *
+ * The hardware kernels work on the state in the order the instructions
+ * want it (ABEF/CDGH on x86) and keep the message schedule in four
+ * vectors of four words: the schedule for rounds t..t+3 is computed
+ * from the four before it as those are consumed.
+ */
+
+#include "sha256.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_SHANI_KERNEL 1
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#include <arm_neon.h>
+#define HAVE_ARMV8_KERNEL 1
+#endif
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static uint32_t ror(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static uint32_t load_be32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void blocks_scalar(uint32_t state[8], const unsigned char *data, size_t nblocks)
+{
+    while (nblocks--) {
+        uint32_t w[64];
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        int t;
+
+        for (t = 0; t < 16; t++) {
+            w[t] = load_be32(data + 4 * t);
+        }
+        for (; t < 64; t++) {
+            uint32_t s0 = ror(w[t - 15], 7) ^ ror(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            uint32_t s1 = ror(w[t - 2], 17) ^ ror(w[t - 2], 19) ^ (w[t - 2] >> 10);
+
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+        for (t = 0; t < 64; t++) {
+            uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + K[t] + w[t];
+            uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+        data += 64;
+    }
+}
+
+#ifdef HAVE_SHANI_KERNEL
+__attribute__((target("sha,sse4.1")))
+static void blocks_shani(uint32_t state[8], const unsigned char *data, size_t nblocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xb1); /* CDAB */
+    __m128i s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1b);  /* EFGH */
+    __m128i s0 = _mm_alignr_epi8(tmp, s1, 8);                                           /* ABEF */
+
+    s1 = _mm_blend_epi16(s1, tmp, 0xf0);                                                /* CDGH */
+
+    while (nblocks--) {
+        __m128i abef = s0;
+        __m128i cdgh = s1;
+        __m128i m[4];
+        int t;
+
+        for (t = 0; t < 16; t++) {
+            __m128i msg;
+
+            if (t < 4) {
+                m[t] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * t)), bswap);
+            } else {
+                /* W[t..] from W[t-16..], W[t-15..], W[t-7..] and W[t-2..] */
+                m[t & 3] = _mm_sha256msg2_epu32(
+                    _mm_add_epi32(_mm_sha256msg1_epu32(m[t & 3], m[(t + 1) & 3]),
+                                  _mm_alignr_epi8(m[(t + 3) & 3], m[(t + 2) & 3], 4)),
+                    m[(t + 3) & 3]);
+            }
+            msg = _mm_add_epi32(m[t & 3], _mm_loadu_si128((const __m128i *)&K[4 * t]));
+            s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+            s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(msg, 0x0e));
+        }
+        s0 = _mm_add_epi32(s0, abef);
+        s1 = _mm_add_epi32(s1, cdgh);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(s0, 0x1b);                                      /* FEBA */
+    s1 = _mm_shuffle_epi32(s1, 0xb1);                                       /* DCHG */
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, s1, 0xf0)); /* DCBA */
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(s1, tmp, 8));    /* HGFE */
+}
+#endif
+
+#ifdef HAVE_ARMV8_KERNEL
+static void blocks_armv8(uint32_t state[8], const unsigned char *data, size_t nblocks)
+{
+    uint32x4_t s0 = vld1q_u32(&state[0]);
+    uint32x4_t s1 = vld1q_u32(&state[4]);
+
+    while (nblocks--) {
+        uint32x4_t abcd = s0;
+        uint32x4_t efgh = s1;
+        uint32x4_t m[4];
+        int t;
+
+        for (t = 0; t < 4; t++) {
+            m[t] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * t)));
+        }
+        for (t = 0; t < 16; t++) {
+            uint32x4_t msg = vaddq_u32(m[t & 3], vld1q_u32(&K[4 * t]));
+            uint32x4_t prev = s0;
+
+            if (t < 12) {
+                /* W[t+4..] from the four vectors before it */
+                m[t & 3] = vsha256su1q_u32(vsha256su0q_u32(m[t & 3], m[(t + 1) & 3]),
+                                           m[(t + 2) & 3], m[(t + 3) & 3]);
+            }
+            s0 = vsha256hq_u32(s0, s1, msg);
+            s1 = vsha256h2q_u32(s1, prev, msg);
+        }
+        s0 = vaddq_u32(s0, abcd);
+        s1 = vaddq_u32(s1, efgh);
+        data += 64;
+    }
+
+    vst1q_u32(&state[0], s0);
+    vst1q_u32(&state[4], s1);
+}
+#endif
+
+typedef void (*blocks_fn_t)(uint32_t state[8], const unsigned char *data, size_t nblocks);
+
+static blocks_fn_t blocks;
+static const char *blocks_name;
+static pthread_once_t blocks_once = PTHREAD_ONCE_INIT;
+
+static void pick_blocks(void)
+{
+    const char *want = getenv("PICOBOX_SIMD");
+    int scalar = want && strcmp(want, "scalar") == 0;
+
+    blocks = blocks_scalar;
+    blocks_name = "scalar";
+#ifdef HAVE_SHANI_KERNEL
+    if (!scalar && __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1")) {
+        blocks = blocks_shani;
+        blocks_name = "sha-ni";
+    }
+#endif
+#ifdef HAVE_ARMV8_KERNEL
+    if (!scalar) {
+        blocks = blocks_armv8;
+        blocks_name = "armv8";
+    }
+#endif
+    (void)scalar;
+}
+
+void sha256_init(sha256_ctx_t *ctx)
+{
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    pthread_once(&blocks_once, pick_blocks);
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->len = 0;
+    ctx->buffered = 0;
+}
+
+void sha256_update(sha256_ctx_t *ctx, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    ctx->len += len;
+    if (ctx->buffered > 0) {
+        size_t take = 64 - ctx->buffered < len ? 64 - ctx->buffered : len;
+
+        memcpy(ctx->buf + ctx->buffered, p, take);
+        ctx->buffered += take;
+        p += take;
+        len -= take;
+        if (ctx->buffered < 64) {
+            return;
+        }
+        blocks(ctx->state, ctx->buf, 1);
+        ctx->buffered = 0;
+    }
+    if (len >= 64) {
+        blocks(ctx->state, p, len / 64);
+        p += len & ~(size_t)63;
+        len &= 63;
+    }
+    memcpy(ctx->buf, p, len);
+    ctx->buffered = len;
+}
+
+void sha256_final(sha256_ctx_t *ctx, unsigned char digest[SHA256_DIGEST_LEN])
+{
+    uint64_t bits = ctx->len * 8;
+    int i;
+
+    /* 0x80, zeros to 56 mod 64, then the length in bits, big-endian */
+    ctx->buf[ctx->buffered++] = 0x80;
+    if (ctx->buffered > 56) {
+        memset(ctx->buf + ctx->buffered, 0, 64 - ctx->buffered);
+        blocks(ctx->state, ctx->buf, 1);
+        ctx->buffered = 0;
+    }
+    memset(ctx->buf + ctx->buffered, 0, 56 - ctx->buffered);
+    for (i = 0; i < 8; i++) {
+        ctx->buf[56 + i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    blocks(ctx->state, ctx->buf, 1);
+
+    for (i = 0; i < 8; i++) {
+        digest[4 * i] = (unsigned char)(ctx->state[i] >> 24);
+        digest[4 * i + 1] = (unsigned char)(ctx->state[i] >> 16);
+        digest[4 * i + 2] = (unsigned char)(ctx->state[i] >> 8);
+        digest[4 * i + 3] = (unsigned char)ctx->state[i];
+    }
+}
+
+const char *sha256_kernel(void)
+{
+    pthread_once(&blocks_once, pick_blocks);
+    return blocks_name;
+}
@@ -1,5 +1,6 @@
 #include "picobox.h"
 #include "utils.h"
+#include "cmd_spec.h"
 #include <string.h>
 #include <ctype.h>
 
@@ -7,20 +8,20 @@
 #define MAX_ARGS 64
 #define PROMPT "$ "
 
-/* External command table from main.c */
-extern const struct command commands[];
-
 /*
- * Find command function by name
+ * Find command function by name (in the shared command registry)
  */
-static cmd_func_t find_command(const char *name)
+static cmd_func_t find_command_func(const char *name)
 {
-    for (int i = 0; commands[i].name != NULL; i++) {
-        if (strcmp(commands[i].name, name) == 0) {
-            return commands[i].func;
-        }
-    }
-    return NULL;
+    const cmd_spec_t *spec = find_command(name);
+    return spec ? spec->run : NULL;
+}
+
+/* for_each_command() callback for the help listing */
+static void print_command_name(const cmd_spec_t *spec, void *userdata)
+{
+    (void)userdata;
+    printf("  %s\n", spec->name);
 }
 
 /*
@@ -113,9 +114,7 @@ static int builtin_help(int argc, char **argv)
     printf("  cd [DIR]   - Change directory\n\n");
     printf("Available utility commands:\n");
 
-    for (int i = 0; commands[i].name != NULL; i++) {
-        printf("  %s\n", commands[i].name);
-    }
+    for_each_command(print_command_name, NULL);
 
     printf("\nFor help on a specific command, use: <command> --help\n");
     return EXIT_OK;
@@ -172,7 +171,7 @@ static int execute_command(int argc, char **argv)
     }
 
     /* Find and execute regular command */
-    cmd_func = find_command(cmd_name);
+    cmd_func = find_command_func(cmd_name);
     if (cmd_func == NULL) {
         fprintf(stderr, "shell: command not found: %s\n", cmd_name);
         return EXIT_ERROR;
@@ -5,52 +5,54 @@
  * Phase 3: Grammar-based parsing with in-process execution
  * Phase 4: Fork/exec for proper process isolation
  * Phase 5: Pipes (cmd1 | cmd2 | cmd3)
- * Phase 6: Redirections (cmd < input.txt > output.txt) (CURRENT)
- * Future phases will add background jobs and job control.
+ * Phase 6: Redirections (cmd < input.txt > output.txt)
+ * Phase 7: AI assistant (AI ..., @query)
+ * Phase 8: Background jobs (cmd &, jobs, wait) (CURRENT)
+ * Future phases will add job control (fg/bg, stopped jobs).
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* sigaction(), kill(), strdup() and O_CLOEXEC */
+#endif
+
 #include "picobox.h"
 #include "cmd_spec.h"
 #include "exec_helpers.h"
 #include "pipe_helpers.h"
 #include "redirect_helpers.h"
+#include "ast_cache.h"
+#include "ai_cache.h"
+#include "history.h"
+#include "line_edit.h"
+#include "command_index.h"
+#include "command_catalog.h"
+#include "trace.h"
+#include "utils.h"
 #include "../bnfc_shell/Parser.h"
 #include "../bnfc_shell/Absyn.h"
 #include "../bnfc_shell/Printer.h"
 #include "../bnfc_shell/Skeleton.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
 
-/* External declarations for refactored commands */
-extern void register_echo_command(void);
-extern void register_pwd_command(void);
-extern void register_true_command(void);
-extern void register_false_command(void);
-extern void register_basename_command(void);
-extern void register_dirname_command(void);
-extern void register_sleep_command(void);
-extern void register_env_command(void);
-extern void register_cat_command(void);
-extern void register_wc_command(void);
-extern void register_head_command(void);
-extern void register_tail_command(void);
-extern void register_touch_command(void);
-extern void register_mkdir_command(void);
-extern void register_cp_command(void);
-extern void register_mv_command(void);
-extern void register_rm_command(void);
-extern void register_ln_command(void);
-extern void register_chmod_command(void);
-extern void register_stat_command(void);
-extern void register_df_command(void);
-extern void register_du_command(void);
-extern void register_grep_command(void);
-extern void register_find_command(void);
-extern void register_ls_command(void);
-extern void register_pkg_command(void);
-extern void register_ai_command(void);
-#define MAX_LINE_LENGTH 1024
+#define LLM_LINE_MAX 1024            /* An @-query as sent to the helper */
 #define PROMPT "$ "
+#define PROMPT2 "> "                /* Continuation lines */
+#define LLM_RELEVANT 5              /* Commands an @-query's prompt describes */
+#define HISTORY_WARM 32             /* Frequent history lines the caches are primed with */
+#define HISTORY_WINDOW 2000         /* Newest history lines they are picked from */
+
+/* A helper that has died must not kill the shell with SIGPIPE */
+#ifdef MSG_NOSIGNAL
+#define LLM_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define LLM_SEND_FLAGS 0            /* SO_NOSIGPIPE is set on the socket instead */
+#endif
 
 /* No longer need command table - using fork/exec instead */
 
@@ -98,7 +100,10 @@ static int builtin_help(int argc, char **argv)
     printf("  cmd < file       - Input redirection\n");
     printf("  cmd > file       - Output redirection\n");
     printf("  cmd >> file      - Append output\n");
-    printf("  cmd1 ; cmd2      - Command sequence\n\n");
+    printf("  cmd <<EOF        - Here-document: the lines up to EOF are stdin\n");
+    printf("  cmd <<< word     - Here-string: word and a newline are stdin\n");
+    printf("  cmd1 ; cmd2      - Command sequence\n");
+    printf("  cmd &            - Run in background (see jobs, wait)\n\n");
 
     printf("For help on a specific command, use: <command> --help\n");
     return EXIT_OK;
@@ -130,25 +135,266 @@ static int builtin_cd(int argc, char **argv)
     return EXIT_OK;
 }
 
+/*
+ * The session's @-query helper: "<MYSH_LLM_SCRIPT> --serve", started on
+ * the first query and kept until the shell exits. It loads the command
+ * catalog once, then answers each query line on its stdin with one
+ * suggestion line on its stdout; both are one end of a socket pair, so
+ * a helper that has died fails the send (MSG_NOSIGNAL) instead of
+ * raising SIGPIPE in the shell. It reads the catalog from the file
+ * named by $MYSH_CATALOG_FILE (command_catalog.h) rather than running
+ * picobox --commands-json; if that file changes (new commands), the
+ * helper is restarted to load it.
+ *
+ * An interactive shell that has a model to ask starts the helper
+ * before the first prompt, so it loads while the first query is being
+ * typed. The helper ignores SIGINT; Ctrl-C while the shell waits for
+ * it cancels the query by stopping the helper (SIGTERM), and the next
+ * query starts a new one.
+ */
+static pid_t llm_pid = 0;
+static int llm_fd = -1;
+static char llm_catalog[600];       /* The helper's catalog file, or "" */
+static volatile sig_atomic_t llm_interrupted;
+
+static void on_llm_sigint(int sig)
+{
+    (void)sig;
+    llm_interrupted = 1;
+}
+
+/*
+ * The helper's command: $MYSH_LLM_SCRIPT, or python3 mysh_llm.py if an
+ * API key is set; NULL if there is no model to ask
+ */
+static const char *llm_script_command(void)
+{
+    const char *llm_script = getenv("MYSH_LLM_SCRIPT");
+
+    if (llm_script) {
+        return llm_script;
+    }
+    if (getenv("OPENAI_API_KEY") || getenv("AI_SHELL")) {
+        return "python3 mysh_llm.py";
+    }
+    return NULL;
+}
+
+static void llm_helper_stop(void)
+{
+    if (llm_fd >= 0) {
+        close(llm_fd);              /* EOF on its stdin: it exits */
+        llm_fd = -1;
+    }
+    if (llm_pid > 0) {
+        waitpid(llm_pid, NULL, 0);
+        llm_pid = 0;
+    }
+}
+
+static int llm_helper_start(const char *llm_script, const char *catalog)
+{
+    char cmd[1200];
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        perror("socketpair");
+        return -1;
+    }
+    fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+    fcntl(sv[1], F_SETFD, FD_CLOEXEC);
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+    {
+        int on = 1;
+        setsockopt(sv[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    }
+#endif
+    /* The file name is $1, so it needs no quoting */
+    snprintf(cmd, sizeof(cmd), "%sexec %s --serve",
+             catalog ? "MYSH_CATALOG_FILE=$1; export MYSH_CATALOG_FILE; " : "", llm_script);
+
+    llm_pid = fork();
+    if (llm_pid < 0) {
+        perror("fork");
+        close(sv[0]);
+        close(sv[1]);
+        llm_pid = 0;
+        return -1;
+    }
+    if (llm_pid == 0) {
+        /* Ctrl-C is the shell's to handle (an ignored signal stays ignored across exec) */
+        signal(SIGINT, SIG_IGN);
+        dup2(sv[1], STDIN_FILENO);
+        dup2(sv[1], STDOUT_FILENO);
+        execl("/bin/sh", "sh", "-c", cmd, "sh", catalog ? catalog : "", (char *)NULL);
+        _exit(127);
+    }
+
+    close(sv[1]);
+    llm_fd = sv[0];
+    snprintf(llm_catalog, sizeof(llm_catalog), "%s", catalog ? catalog : "");
+    return 0;
+}
+
+/*
+ * Ask the helper about query, starting it if need be (and once more if
+ * it has gone away). The line sent is the query, a tab, and the names
+ * of the relevant commands (command_index_search()), blank-separated,
+ * for the prompt to describe.
+ * Returns: 0 with the suggestion line in out, -1, or -2 if Ctrl-C
+ *          cancelled it
+ */
+static int llm_helper_ask(const char *llm_script, const char *query,
+                          const cmd_spec_t *const *relevant, size_t nrelevant,
+                          char *out, size_t size)
+{
+    char line[LLM_LINE_MAX + 1];
+    size_t line_len;
+    const char *catalog = command_catalog_file();
+    struct sigaction sa = {0};
+    struct sigaction old_sa;
+    int ret = -1;
+
+    /* A helper started with another catalog does not know every command */
+    if (llm_fd >= 0 && strcmp(catalog ? catalog : "", llm_catalog) != 0) {
+        llm_helper_stop();
+    }
+
+    /* The query as one line, without tabs */
+    snprintf(line, sizeof(line) - 1, "%s", query);
+    for (char *p = line; *p; p++) {
+        if (*p == '\n' || *p == '\r' || *p == '\t') {
+            *p = ' ';
+        }
+    }
+    line_len = strlen(line);
+    for (size_t i = 0; i < nrelevant; i++) {
+        int n = snprintf(line + line_len, sizeof(line) - 1 - line_len, "%c%s",
+                         i == 0 ? '\t' : ' ', relevant[i]->name);
+
+        if (n < 0 || (size_t)n >= sizeof(line) - 1 - line_len) {
+            break;
+        }
+        line_len += (size_t)n;
+    }
+    line[line_len++] = '\n';
+
+    /* No SA_RESTART: read() below must return on Ctrl-C */
+    llm_interrupted = 0;
+    sa.sa_handler = on_llm_sigint;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, &old_sa);
+
+    for (int attempt = 0; attempt < 2 && ret == -1; attempt++) {
+        size_t len = 0;
+        int ok;
+
+        if (llm_fd < 0 && llm_helper_start(llm_script, catalog) != 0) {
+            sigaction(SIGINT, &old_sa, NULL);
+            return -1;
+        }
+        ok = send(llm_fd, line, line_len, LLM_SEND_FLAGS) == (ssize_t)line_len;
+
+        /* Its answer, up to the newline */
+        while (ok) {
+            char ch;
+            ssize_t n = read(llm_fd, &ch, 1);
+
+            if (n < 0 && errno == EINTR && !llm_interrupted) {
+                continue;
+            }
+            if (n <= 0) {
+                ok = 0;
+            } else if (ch == '\n') {
+                out[len] = '\0';
+                ret = 0;
+                break;
+            } else if (len + 1 < size) {
+                out[len++] = ch;
+            }
+        }
+        if (llm_interrupted) {
+            kill(llm_pid, SIGTERM);
+            llm_helper_stop();
+            ret = -2;
+        } else if (ret != 0) {
+            llm_helper_stop();
+        }
+    }
+
+    sigaction(SIGINT, &old_sa, NULL);
+    if (ret == -2) {
+        fprintf(stderr, "\n@: cancelled\n");
+    } else if (ret == -1) {
+        fprintf(stderr, "Error: AI helper (%s --serve) stopped without answering.\n", llm_script);
+    }
+    return ret;
+}
+
+/* Whether the lower-cased query contains word */
+static int query_has(const char *lower, const char *word)
+{
+    return strstr(lower, word) != NULL;
+}
+
+/*
+ * Suggest a command without a model: a few keyword rules, else the
+ * best match in the command index (the rules mysh_llm.py falls back on)
+ */
+static void heuristic_suggestion(const char *query, const cmd_spec_t *best,
+                                 char *out, size_t size)
+{
+    char lower[LLM_LINE_MAX];
+    size_t i;
+
+    for (i = 0; query[i] && i < sizeof(lower) - 1; i++) {
+        lower[i] = (char)tolower((unsigned char)query[i]);
+    }
+    lower[i] = '\0';
+
+    if (query_has(lower, "list") || query_has(lower, "show") ||
+        query_has(lower, "files") || query_has(lower, "directory")) {
+        snprintf(out, size, "%s",
+                 query_has(lower, "all") || query_has(lower, "hidden") ? "ls -la" : "ls");
+    } else if (query_has(lower, "find")) {
+        snprintf(out, size, "find .");
+    } else if (query_has(lower, "count") || query_has(lower, "lines")) {
+        snprintf(out, size, "wc -l");
+    } else if (query_has(lower, "search") || query_has(lower, "grep")) {
+        snprintf(out, size, "grep");
+    } else {
+        snprintf(out, size, "%s", best ? best->name : "help");
+    }
+}
+
 /*
  * Handle AI query (lines starting with @)
  *
  * This is called when user types: @show me all files
  *
  * Process:
- * 1. Call Python script: python3 mysh_llm.py "show me all files"
- * 2. Read suggestion from script output
- * 3. Display suggestion to user with formatting
- * 4. Get y/n confirmation
- * 5. If yes: parse and execute suggestion via BNFC
+ * 1. Pick the relevant commands from the command index
+ *    (command_index.h)
+ * 2. With no model to ask (no OPENAI_API_KEY, AI_SHELL or
+ *    MYSH_LLM_SCRIPT), suggest one by heuristic, in-process
+ * 3. Else look the query up in the AI cache (ai_cache.h); on a miss,
+ *    send it with the relevant commands to the session's helper
+ *    (python3 mysh_llm.py --serve), read its suggestion line and cache
+ *    it; the heuristic stands in if the helper fails
+ * 4. Display suggestion to user with formatting
+ * 5. Get y/n confirmation
+ * 6. If yes: parse and execute suggestion via BNFC
  */
 static void handle_llm_query(const char *query, ExecContext *ctx)
 {
-    char cmd[2048];
     char suggestion[1024];
-    FILE *fp;
     char answer;
     int c;
+    ai_cache_key_t key;
+    char *cached;
+    const cmd_spec_t *relevant[LLM_RELEVANT];
+    size_t nrelevant;
+    int ret;
 
     /* Validate input */
     if (!query || query[0] == '\0') {
@@ -156,38 +402,35 @@ static void handle_llm_query(const char *query, ExecContext *ctx)
         return;
     }
 
-    /* Build command to call Python helper */
-    const char *llm_script = getenv("MYSH_LLM_SCRIPT");
+    nrelevant = command_index_search(query, relevant, LLM_RELEVANT);
+
+    /* The helper's command; without one there is no model to ask */
+    const char *llm_script = llm_script_command();
     if (!llm_script) {
-        llm_script = "python3 mysh_llm.py";
+        heuristic_suggestion(query, nrelevant > 0 ? relevant[0] : NULL,
+                             suggestion, sizeof(suggestion));
+        goto suggest;
     }
 
-    /* Build command - basic escaping (assumes query doesn't contain quotes) */
-    snprintf(cmd, sizeof(cmd), "%s \"%s\" 2>&1", llm_script, query);
-
-    /* Call Python helper and capture output */
-    fp = popen(cmd, "r");
-    if (!fp) {
-        perror("popen");
-        fprintf(stderr, "Error: Failed to run AI helper script.\n");
-        fprintf(stderr, "Make sure mysh_llm.py is in your current directory.\n");
-        return;
+    /* The same question again gets the suggestion it got before */
+    ai_cache_key(&key, getenv("MYSH_LLM_MODEL"), llm_script, query);
+    cached = ai_cache_get(&key);
+    if (cached) {
+        snprintf(suggestion, sizeof(suggestion), "%s", cached);
+        free(cached);
+        goto suggest;
     }
 
-    /* Read suggestion from Python script */
-    if (fgets(suggestion, sizeof(suggestion), fp) == NULL) {
-        fprintf(stderr, "Error: AI helper returned no suggestion.\n");
-        pclose(fp);
+    /* Ask the helper (it is started on the first query) */
+    ret = llm_helper_ask(llm_script, query, relevant, nrelevant, suggestion, sizeof(suggestion));
+    if (ret == -2) {
         return;
     }
-
-    /* Remove trailing newline from suggestion */
-    suggestion[strcspn(suggestion, "\n")] = '\0';
-
-    /* Close pipe and check exit status */
-    int status = pclose(fp);
-    if (status != 0) {
-        fprintf(stderr, "Warning: AI helper exited with status %d\n", status);
+    if (ret != 0) {
+        fprintf(stderr, "Make sure mysh_llm.py is in your current directory.\n");
+        heuristic_suggestion(query, nrelevant > 0 ? relevant[0] : NULL,
+                             suggestion, sizeof(suggestion));
+        goto suggest;
     }
 
     /* Skip if suggestion is empty */
@@ -195,7 +438,9 @@ static void handle_llm_query(const char *query, ExecContext *ctx)
         fprintf(stderr, "Error: AI helper returned empty suggestion.\n");
         return;
     }
+    ai_cache_put(&key, suggestion);
 
+suggest:
     /* Display suggestion to user with nice formatting */
     printf("\n");
     printf("💡 AI Suggested Command:\n");
@@ -249,7 +494,424 @@ static void handle_llm_query(const char *query, ExecContext *ctx)
     }
 
     /* Cleanup */
-    free_Input(ast);
+    ast_reset();
+}
+
+/*
+ * Prime the caches with what is run most often here: the trees of the
+ * most frequent history lines go into the AST cache, and the cached
+ * answers to the most frequent @-queries are looked up, which marks
+ * them used so a full AI cache evicts other answers first. Lines that
+ * no longer parse are skipped without a word.
+ */
+static void warm_caches(void)
+{
+    char *lines[HISTORY_WARM];
+    const char *llm_script = llm_script_command();
+    size_t n = history_frequent(lines, HISTORY_WARM, HISTORY_WINDOW);
+    int saved_err = -1;
+    int null_fd;
+
+    if (n == 0) {
+        return;
+    }
+    null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (null_fd >= 0) {
+        fflush(stderr);
+        saved_err = dup(STDERR_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        close(null_fd);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (lines[i][0] == '@') {
+            if (llm_script) {
+                ai_cache_key_t key;
+
+                ai_cache_key(&key, getenv("MYSH_LLM_MODEL"), llm_script, lines[i] + 1);
+                free(ai_cache_get(&key));
+            }
+        } else if (get_ast_cache_size() > 0) {
+            ast_cache_parse(lines[i]);
+            ast_reset();
+        }
+        free(lines[i]);
+    }
+
+    if (saved_err >= 0) {
+        dup2(saved_err, STDERR_FILENO);
+        close(saved_err);
+    }
+}
+
+/*
+ * Here-documents still reading their lines: a line with <<WORD (or
+ * <<-WORD) makes the lines after it, up to WORD, part of the command,
+ * so the shell reads on before it parses (the lexer takes the text out,
+ * see here_document() in Shell.l). Lines of a document are text: they
+ * are not commands, @-queries or here-documents.
+ */
+#define HERE_PENDING_MAX 8
+#define HERE_DELIM_MAX 64
+
+typedef struct here_state {
+    char delim[HERE_PENDING_MAX][HERE_DELIM_MAX];
+    int strip[HERE_PENDING_MAX];    /* <<-: leading tabs do not count */
+    int count;                      /* Documents waiting for their end */
+} here_state_t;
+
+/*
+ * Take in one line (len bytes, no line end)
+ * Returns: 1 if it was a line of a here-document, else 0
+ */
+static int here_scan_line(here_state_t *hs, const char *line, size_t len)
+{
+    const char *end = line + len;
+    const char *p;
+
+    if (hs->count > 0) {
+        size_t dlen = strlen(hs->delim[0]);
+
+        if (hs->strip[0]) {
+            while (line < end && *line == '\t') {
+                line++;
+            }
+        }
+        if ((size_t)(end - line) == dlen && memcmp(line, hs->delim[0], dlen) == 0) {
+            hs->count--;
+            memmove(hs->delim[0], hs->delim[1], (size_t)hs->count * sizeof(hs->delim[0]));
+            memmove(&hs->strip[0], &hs->strip[1], (size_t)hs->count * sizeof(hs->strip[0]));
+        }
+        return 1;
+    }
+
+    /* A command line: each <<WORD on it starts a document */
+    for (p = line; p + 1 < end && hs->count < HERE_PENDING_MAX; p++) {
+        const char *word;
+        size_t wlen = 0;
+        int strip = 0;
+
+        if (p[0] != '<' || p[1] != '<') {
+            continue;
+        }
+        p += 2;
+        if (p < end && *p == '<') {
+            /* <<< is a here-string */
+            while (p < end && *p == '<') {
+                p++;
+            }
+            continue;
+        }
+        if (p < end && *p == '-') {
+            strip = 1;
+            p++;
+        }
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        for (word = p; p < end && wlen + 1 < HERE_DELIM_MAX &&
+                       !strchr(" \t;&|<>#", *p); p++) {
+            wlen++;
+        }
+        if (wlen > 0) {
+            memcpy(hs->delim[hs->count], word, wlen);
+            hs->delim[hs->count][wlen] = '\0';
+            hs->strip[hs->count] = strip;
+            hs->count++;
+        }
+        p--;
+    }
+    return 0;
+}
+
+/*
+ * The interactive shell's input, with no limit on line length. A line
+ * ending in a backslash goes on with the next one, and a line with a
+ * here-document with the document's lines.
+ *
+ * On a terminal, lines come from the line editor, and the lines of a
+ * paste still waiting after Enter join the first in one block, parsed
+ * in one pass. Anywhere else, stdin is read a large block at a time
+ * and a line is handed out in place in the reader's buffer, one per
+ * prompt, so a script's output comes after the prompt for its line.
+ */
+typedef struct shell_input {
+    int terminal;               /* Lines come from line_edit_read() */
+    line_reader_t reader;       /* Otherwise stdin, in blocks */
+    char *block;                /* A block assembled here (terminal, continued lines) */
+    size_t block_len;
+    size_t block_cap;
+    char *line;                 /* The line editor's buffer */
+    size_t line_cap;
+    here_state_t here;          /* Here-documents the block is reading */
+} shell_input_t;
+
+static int shell_input_open(shell_input_t *in)
+{
+    memset(in, 0, sizeof(*in));
+    in->terminal = line_edit_terminal();
+    if (!in->terminal && line_reader_init_fd(&in->reader, STDIN_FILENO) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static void shell_input_close(shell_input_t *in)
+{
+    if (!in->terminal) {
+        line_reader_free(&in->reader);
+    }
+    free(in->block);
+    free(in->line);
+}
+
+/* Append len bytes to the assembled block */
+static int block_append(shell_input_t *in, const char *text, size_t len)
+{
+    if (in->block_len + len + 1 > in->block_cap) {
+        size_t cap = in->block_cap ? in->block_cap : 256;
+        char *bigger;
+
+        while (cap < in->block_len + len + 1) {
+            cap *= 2;
+        }
+        bigger = realloc(in->block, cap);
+        if (!bigger) {
+            return -1;
+        }
+        in->block = bigger;
+        in->block_cap = cap;
+    }
+    memcpy(in->block + in->block_len, text, len);
+    in->block_len += len;
+    in->block[in->block_len] = '\0';
+    return 0;
+}
+
+/* Whether the line ending at text[len] goes on with the next one */
+static int continues(const char *text, size_t len)
+{
+    return len > 0 && text[len - 1] == '\\';
+}
+
+/* The next block from the line editor */
+static char *read_terminal_block(shell_input_t *in)
+{
+    size_t start = 0;           /* Where the line read last starts */
+    ssize_t len = line_edit_read(PROMPT, &in->line, &in->line_cap);
+
+    if (len < 0) {
+        return NULL;
+    }
+    in->block_len = 0;
+    memset(&in->here, 0, sizeof(in->here));
+    if (block_append(in, in->line, (size_t)len) != 0) {
+        return NULL;
+    }
+
+    /* Continued lines, here-documents, then the rest of a paste */
+    for (;;) {
+        if (continues(in->block, in->block_len)) {
+            in->block[--in->block_len] = '\0';
+        } else {
+            here_scan_line(&in->here, in->block + start, in->block_len - start);
+            if (in->here.count == 0 && !line_edit_pending()) {
+                break;
+            }
+            if (block_append(in, "\n", 1) != 0) {
+                return NULL;
+            }
+            start = in->block_len;
+        }
+        len = line_edit_read(PROMPT2, &in->line, &in->line_cap);
+        if (len < 0) {
+            break;          /* End of input: run what there is */
+        }
+        if (block_append(in, in->line, (size_t)len) != 0) {
+            return NULL;
+        }
+    }
+    return in->block;
+}
+
+/* The next line from stdin, read in blocks, with its here-documents */
+static char *read_stream_line(shell_input_t *in)
+{
+    const char *data;
+    size_t len;
+    size_t start = 0;
+    char *text;
+    int ret;
+
+    printf("%s", PROMPT);
+    fflush(stdout);
+    ret = line_reader_next(&in->reader, &data, &len);
+    if (ret <= 0) {
+        if (ret < 0) {
+            perror("picobox: stdin");
+        }
+        return NULL;
+    }
+    memset(&in->here, 0, sizeof(in->here));
+
+    /* The line is in the reader's buffer, which the shell may edit */
+    text = in->reader.buf + (data - in->reader.buf);
+    if (text[len - 1] == '\n' && !continues(text, len - 1) &&
+        (here_scan_line(&in->here, text, len - 1), in->here.count == 0)) {
+        text[len - 1] = '\0';
+        return text;
+    }
+    memset(&in->here, 0, sizeof(in->here));
+
+    /* Continued, with a here-document, or the last line without a newline: build it up */
+    in->block_len = 0;
+    for (;;) {
+        if (data[len - 1] == '\n') {
+            len--;
+        }
+        if (block_append(in, data, len) != 0) {
+            return NULL;
+        }
+        if (continues(in->block, in->block_len)) {
+            in->block[--in->block_len] = '\0';
+        } else {
+            here_scan_line(&in->here, in->block + start, in->block_len - start);
+            if (in->here.count == 0) {
+                break;
+            }
+            if (block_append(in, "\n", 1) != 0) {
+                return NULL;
+            }
+            start = in->block_len;
+        }
+        if (line_reader_next(&in->reader, &data, &len) <= 0) {
+            break;
+        }
+    }
+    return in->block;
+}
+
+/*
+ * The next block: one or more lines, '\n'-separated, with no final
+ * line end and continued lines joined
+ * Returns: the block (valid until the next call), or NULL at end of input
+ */
+static char *shell_input_read(shell_input_t *in)
+{
+    return in->terminal ? read_terminal_block(in) : read_stream_line(in);
+}
+
+/*
+ * Parse and run lines, '\n'-separated, in one pass. If they do not
+ * parse together, each is tried on its own, so one bad line does not
+ * keep the others from running.
+ */
+static void run_lines(char *text, ExecContext *ctx)
+{
+    Input ast;
+    char *nl;
+
+    /* Parse the lines using BNFC parser (or reuse the tree for a repeated line) */
+    TRACE_BEGIN("parse", NULL);
+    ast = ast_cache_parse(text);
+    TRACE_END("parse");
+
+    if (ast != NULL) {
+        /* Execute using visitor pattern - ONE CALL! */
+        /* The visitor automatically traverses the entire AST */
+        visitInput(ast, ctx);
+
+        /* Release what was parsed for this block (cached trees stay) */
+        ast_reset();
+        return;
+    }
+    ast_reset();   /* words lexed before the error */
+
+    /* One line, or lines whose here-documents are not commands */
+    if (strchr(text, '\n') == NULL || strstr(text, "<<") != NULL) {
+        fprintf(stderr, "Parse error: invalid syntax\n");
+        return;
+    }
+    for (char *line = text; line && !ctx->should_exit; line = nl ? nl + 1 : NULL) {
+        nl = strchr(line, '\n');
+        if (nl) {
+            *nl = '\0';
+        }
+        if (line[strspn(line, " \t")] != '\0') {
+            run_lines(line, ctx);
+        }
+        if (nl) {
+            *nl = '\n';
+        }
+    }
+}
+
+/*
+ * Run a block: the shell's lines in one parse pass, with each @-query
+ * line (not a line of a here-document) taken out and handed to the AI
+ * helper in its place. On a
+ * terminal each line also goes into the history.
+ */
+static void run_block(char *block, ExecContext *ctx)
+{
+    char *run = NULL;           /* First line of the lines not run yet */
+    char *line = block;
+    here_state_t here = {0};
+
+    while (line && !ctx->should_exit) {
+        char *nl = strchr(line, '\n');
+        char *next = nl ? nl + 1 : NULL;
+        int document;
+
+        if (nl) {
+            *nl = '\0';
+        }
+        document = here_scan_line(&here, line, strlen(line));
+
+        /* Typed lines go into the history, shared with other shells */
+        if (ctx->interactive && line[0] != '\0') {
+            history_add(line);
+        }
+
+        /* Check for AI query (@ prefix) - BEFORE BNFC parsing
+         *
+         * If line starts with @, it's an AI query.
+         * We handle this BEFORE calling psInput() so the grammar
+         * never sees the @ character.
+         *
+         * This keeps our existing AICmd grammar rule completely
+         * independent - "AI how do I..." still works via BNFC.
+         *
+         * Examples:
+         *   @show all files      → AI helper
+         *   AI how do I list     → BNFC parser → AICmd
+         *   ls -la               → BNFC parser → SimpleCmd
+         */
+        if (line[0] == '@' && !document) {
+            if (run) {
+                line[-1] = '\0';
+                run_lines(run, ctx);
+                run = NULL;
+            }
+            if (!ctx->should_exit) {
+                /* Skip the @ and pass rest to AI helper */
+                handle_llm_query(line + 1, ctx);
+            }
+        } else {
+            if (!run) {
+                run = line;
+            }
+            if (nl) {
+                *nl = '\n';
+            }
+        }
+        line = next;
+    }
+
+    /* Skip empty lines */
+    if (run && run[strspn(run, " \t\n")] != '\0' && !ctx->should_exit) {
+        run_lines(run, ctx);
+    }
 }
 
 /*
@@ -427,6 +1089,16 @@ static struct redirection *extract_redirections(SimpleCommand sc, int *count_out
                 redirs[i].filename = r->u.redirAppend_.word_;
                 break;
 
+            case is_RedirHereDoc:
+                redirs[i].type = REDIR_HEREDOC;
+                redirs[i].filename = r->u.redirHereDoc_.word_;
+                break;
+
+            case is_RedirHereStr:
+                redirs[i].type = REDIR_HERESTRING;
+                redirs[i].filename = r->u.redirHereStr_.word_;
+                break;
+
             default:
                 fprintf(stderr, "Error: Unknown redirection type\n");
                 free(redirs);
@@ -713,54 +1385,15 @@ static int execute_input(Input input)
  * ====================================================================================
  */
 
-/*
- * Initialize shell - register all refactored commands
- */
-static void init_shell_commands(void)
-{
-    /* Register refactored commands using the new infrastructure */
-    register_echo_command();
-    register_pwd_command();
-    register_true_command();
-    register_false_command();
-    register_basename_command();
-    register_dirname_command();
-    register_sleep_command();
-    register_env_command();
-    register_cat_command();
-    register_wc_command();
-    register_head_command();
-    register_tail_command();
-    register_touch_command();
-    register_mkdir_command();
-    register_cp_command();
-    register_mv_command();
-    register_rm_command();
-    register_ln_command();
-    register_chmod_command();
-    register_stat_command();
-    register_df_command();
-    register_du_command();
-    register_grep_command();
-    register_find_command();
-    register_ls_command();
-    register_pkg_command();
-    register_ai_command();
-    /* All 27 commands including package manager and AI! */
-}
-
 /*
  * Main BNFC shell loop - VISITOR PATTERN VERSION
  * This version uses the visitor pattern for AST traversal
  */
 int shell_bnfc_main_visitor(void)
 {
-    char line[MAX_LINE_LENGTH];
-    Input ast;
+    shell_input_t input;
     ExecContext *ctx;
-
-    /* Initialize command registry */
-    init_shell_commands();
+    char *block;
 
     /* Create execution context */
     ctx = exec_context_new();
@@ -768,6 +1401,12 @@ int shell_bnfc_main_visitor(void)
         fprintf(stderr, "Failed to create execution context\n");
         return EXIT_ERROR;
     }
+    ctx->interactive = isatty(STDIN_FILENO);
+    if (shell_input_open(&input) != 0) {
+        fprintf(stderr, "Failed to allocate the input buffer\n");
+        exec_context_free(ctx);
+        return EXIT_ERROR;
+    }
 
     printf("PicoBox BNFC Shell v%s (Visitor Pattern + Registry + AI)\n", PICOBOX_VERSION);
     printf("Type 'help' for available commands, 'exit' to quit.\n");
@@ -778,72 +1417,142 @@ int shell_bnfc_main_visitor(void)
     printf("   AI how do I list files    (Legacy: cmd_ai.c)\n");
     printf("\n");
 
+    /* Have the @-query helper load while the first line is typed */
+    if (ctx->interactive && llm_script_command()) {
+        llm_helper_start(llm_script_command(), command_catalog_file());
+    }
+
+    /* Map the history and prime the caches from it */
+    if (ctx->interactive && history_open() == 0) {
+        warm_caches();
+    }
+
     while (1) {
-        /* Print prompt */
-        printf("%s", PROMPT);
-        fflush(stdout);
+        /* Report background jobs that finished since the last prompt */
+        exec_context_notify_jobs(ctx);
 
-        /* Read line */
-        if (fgets(line, sizeof(line), stdin) == NULL) {
+        /* Print prompt and read the lines that have arrived (edited, with history, on a terminal) */
+        block = shell_input_read(&input);
+        if (block == NULL) {
             /* EOF (Ctrl+D) */
             printf("\n");
             break;
         }
 
-        /* Remove newline */
-        size_t len = strlen(line);
-        if (len > 0 && line[len - 1] == '\n') {
-            line[len - 1] = '\0';
-        }
+        run_block(block, ctx);
 
-        /* Skip empty lines */
-        if (line[0] == '\0') {
-            continue;
+        /* Check for exit signal */
+        if (ctx->should_exit) {
+            break;
         }
+    }
 
-        /* Check for AI query (@ prefix) - BEFORE BNFC parsing
-         *
-         * If line starts with @, it's an AI query.
-         * We handle this BEFORE calling psInput() so the grammar
-         * never sees the @ character.
-         *
-         * This keeps our existing AICmd grammar rule completely
-         * independent - "AI how do I..." still works via BNFC.
-         *
-         * Examples:
-         *   @show all files      → AI helper
-         *   AI how do I list     → BNFC parser → AICmd
-         *   ls -la               → BNFC parser → SimpleCmd
-         */
-        if (line[0] == '@') {
-            /* Skip the @ and pass rest to AI helper */
-            handle_llm_query(line + 1, ctx);
-            continue;  /* Go back to prompt, don't parse with BNFC */
-        }
+    shell_input_close(&input);
+    history_close();
+    exec_context_free(ctx);
+    return EXIT_OK;
+}
 
-        /* Parse the line using BNFC parser */
-        ast = psInput(line);
+/*
+ * Run a parsed script in a fresh context, with no banner or prompt
+ * Returns the status of the last command (or of `exit N`)
+ */
+static int run_script(Input ast)
+{
+    ExecContext *ctx;
+    int status;
 
-        if (ast == NULL) {
-            fprintf(stderr, "Parse error: invalid syntax\n");
-            continue;
-        }
+    ctx = exec_context_new();
+    if (!ctx) {
+        fprintf(stderr, "Failed to create execution context\n");
+        ast_reset();
+        return EXIT_ERROR;
+    }
 
-        /* Execute using visitor pattern - ONE CALL! */
-        /* The visitor automatically traverses the entire AST */
-        visitInput(ast, ctx);
+    visitInput(ast, ctx);
+    ast_reset();
 
-        /* Free AST */
-        free_Input(ast);
+    status = ctx->exit_status;
+    fflush(stdout);
+    exec_context_free(ctx);
+    return status;
+}
 
-        /* Check for exit signal */
-        if (ctx->should_exit) {
-            break;
+/*
+ * Batch mode: picobox -c STRING
+ *
+ * The whole string is parsed by one psInput() call (newlines separate
+ * commands like ';'), so a syntax error anywhere means nothing runs.
+ */
+int shell_bnfc_run_string(const char *script)
+{
+    Input ast;
+
+    TRACE_BEGIN("parse", NULL);
+    ast = ast_cache_parse(script);
+    TRACE_END("parse");
+
+    if (ast == NULL) {
+        fprintf(stderr, "picobox: -c: syntax error\n");
+        return 2;
+    }
+    return run_script(ast);
+}
+
+/*
+ * Batch mode: picobox FILE
+ *
+ * Same as shell_bnfc_run_string(), with the script read whole first:
+ * the lexer finds a here-document's lines in its buffer, which with
+ * pInput() would hold only the first block of the file.
+ * Commands keep the shell's stdin, since the script comes from FILE.
+ */
+int shell_bnfc_run_file(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char *script = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    Input ast;
+
+    if (!fp) {
+        perror(path);
+        return 127;
+    }
+    do {
+        if (cap - len < 4096) {
+            char *bigger = realloc(script, cap ? cap * 2 : 16384);
+
+            if (!bigger) {
+                perror(path);
+                free(script);
+                fclose(fp);
+                return 127;
+            }
+            script = bigger;
+            cap = cap ? cap * 2 : 16384;
         }
+        len += fread(script + len, 1, cap - len - 1, fp);
+    } while (!feof(fp) && !ferror(fp));
+    if (ferror(fp)) {
+        perror(path);
+        free(script);
+        fclose(fp);
+        return 127;
     }
+    fclose(fp);
+    script[len] = '\0';
 
-    exec_context_free(ctx);
-    return EXIT_OK;
+    TRACE_BEGIN("parse", path);
+    ast = psInput(script);
+    TRACE_END("parse");
+    free(script);
+
+    if (ast == NULL) {
+        fprintf(stderr, "picobox: %s: syntax error\n", path);
+        return 2;
+    }
+    return run_script(ast);
 }
 
 /*
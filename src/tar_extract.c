@@ -0,0 +1,819 @@
+/*
+ * tar_extract.c - Streaming tar reader
+ *
+ * The archive is a sequence of 512-byte blocks: a header, then the
+ * member's data padded to a whole block. The source below hands out
+ * the decompressed stream from one buffer, refilled by inflate() (or
+ * read() for an uncompressed archive); headers are copied out of it,
+ * file data is written to the file straight from it. A gzip file of
+ * several members is inflated member after member. Reading stops at
+ * the end-of-archive marker (a zero block), so padding after it is
+ * never looked at.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* The *at() calls, fallocate() */
+#endif
+
+#include "tar_extract.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#define TAR_BLOCK 512
+#define TAR_BUF (256 * 1024)
+
+/* ===== DECOMPRESSED STREAM ===== */
+
+typedef struct {
+    int fd;
+    int gz;                     /* Input is gzip */
+    int member_done;            /* inflate() finished a gzip member */
+    z_stream zs;
+    unsigned char *in;
+    unsigned char *out;
+    size_t pos, end;            /* Unread part of out */
+    const char *why;            /* What went wrong, when -1 is returned */
+} tar_src_t;
+
+/*
+ * Refill the buffer
+ * Returns: 1 if there is more data, 0 at the end, -1 on error
+ */
+static int src_fill(tar_src_t *s)
+{
+    s->pos = s->end = 0;
+
+    if (!s->gz) {
+        for (;;) {
+            ssize_t n = read(s->fd, s->out, TAR_BUF);
+
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                s->why = strerror(errno);
+                return -1;
+            }
+            s->end = (size_t)n;
+            return n > 0;
+        }
+    }
+
+    s->zs.next_out = s->out;
+    s->zs.avail_out = TAR_BUF;
+    while (s->zs.avail_out == TAR_BUF) {
+        int r;
+
+        if (s->zs.avail_in == 0) {
+            ssize_t n = read(s->fd, s->in, TAR_BUF);
+
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                s->why = strerror(errno);
+                return -1;
+            }
+            if (n == 0) {
+                if (s->member_done) {
+                    return 0;
+                }
+                s->why = "unexpected end of compressed data";
+                return -1;
+            }
+            s->zs.next_in = s->in;
+            s->zs.avail_in = (uInt)n;
+        }
+        if (s->member_done) {
+            inflateReset(&s->zs);   /* Another gzip member follows */
+            s->member_done = 0;
+        }
+
+        r = inflate(&s->zs, Z_NO_FLUSH);
+        if (r == Z_STREAM_END) {
+            s->member_done = 1;
+        } else if (r != Z_OK && r != Z_BUF_ERROR) {
+            s->why = s->zs.msg ? s->zs.msg : "invalid compressed data";
+            return -1;
+        }
+    }
+    s->end = TAR_BUF - s->zs.avail_out;
+    return 1;
+}
+
+/*
+ * Point *data at up to want bytes of the stream and consume them
+ * Returns: number of bytes (0 at the end), or -1 on error
+ */
+static ssize_t src_next(tar_src_t *s, const unsigned char **data, size_t want)
+{
+    size_t n;
+
+    if (s->pos == s->end) {
+        int r = src_fill(s);
+
+        if (r <= 0) {
+            return r;
+        }
+    }
+    n = s->end - s->pos < want ? s->end - s->pos : want;
+    *data = s->out + s->pos;
+    s->pos += n;
+    return (ssize_t)n;
+}
+
+/* Copy exactly len bytes, or skip them if dst is NULL. Returns: 0, or -1 */
+static int src_read(tar_src_t *s, void *dst, size_t len)
+{
+    unsigned char *d = dst;
+
+    while (len > 0) {
+        const unsigned char *p;
+        ssize_t n = src_next(s, &p, len);
+
+        if (n <= 0) {
+            if (n == 0) {
+                s->why = "unexpected end of archive";
+            }
+            return -1;
+        }
+        if (d) {
+            memcpy(d, p, (size_t)n);
+            d += n;
+        }
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static size_t padding(uint64_t size)
+{
+    return (size_t)((TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK);
+}
+
+/* ===== HEADERS ===== */
+
+/* One member's header, with any GNU or pax overrides applied */
+typedef struct {
+    char *path;
+    char *linkpath;
+    uint64_t size;
+    mode_t mode;
+    struct timespec mtime;
+    char type;
+} tar_entry_t;
+
+/* Overrides from a GNU 'L'/'K' or pax 'x' header, for the next member */
+typedef struct {
+    char *path;
+    char *linkpath;
+    uint64_t size;
+    int have_size;
+    struct timespec mtime;
+    int have_mtime;
+} tar_next_t;
+
+/* Octal, space or NUL terminated, or base-256 when the top bit is set */
+static uint64_t parse_number(const unsigned char *p, size_t len)
+{
+    uint64_t v = 0;
+    size_t i = 0;
+
+    if (len > 0 && (p[0] & 0x80)) {
+        v = p[0] & 0x3f;
+        for (i = 1; i < len; i++) {
+            v = v << 8 | p[i];
+        }
+        return v;
+    }
+    while (i < len && p[i] == ' ') {
+        i++;
+    }
+    for (; i < len && p[i] >= '0' && p[i] <= '7'; i++) {
+        v = v * 8 + (uint64_t)(p[i] - '0');
+    }
+    return v;
+}
+
+static int checksum_ok(const unsigned char *h)
+{
+    uint64_t want = parse_number(h + 148, 8);
+    uint64_t sum = 0;
+    int64_t ssum = 0;
+    int i;
+
+    for (i = 0; i < TAR_BLOCK; i++) {
+        unsigned char c = i >= 148 && i < 156 ? ' ' : h[i];
+
+        sum += c;
+        ssum += (signed char)c;     /* Some old tars summed signed bytes */
+    }
+    return sum == want || (uint64_t)ssum == want;
+}
+
+static int is_zero_block(const unsigned char *h)
+{
+    int i;
+
+    for (i = 0; i < TAR_BLOCK; i++) {
+        if (h[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static char *field_dup(const unsigned char *p, size_t len)
+{
+    size_t n = strnlen((const char *)p, len);
+    char *s = malloc(n + 1);
+
+    if (s) {
+        memcpy(s, p, n);
+        s[n] = '\0';
+    }
+    return s;
+}
+
+/* POSIX ustar splits a long name into prefix "/" name (old GNU headers have no prefix) */
+static char *header_path(const unsigned char *h)
+{
+    char *name;
+    char *prefix;
+    char *path;
+
+    if (memcmp(h + 257, "ustar", 6) != 0 || h[345] == '\0') {
+        return field_dup(h, 100);
+    }
+    name = field_dup(h, 100);
+    prefix = field_dup(h + 345, 155);
+    path = name && prefix ? malloc(strlen(prefix) + strlen(name) + 2) : NULL;
+    if (path) {
+        sprintf(path, "%s/%s", prefix, name);
+    }
+    free(name);
+    free(prefix);
+    return path;
+}
+
+/* Read a member's data (a long name or pax records) into a string */
+static char *read_data(tar_src_t *s, uint64_t size)
+{
+    char *buf;
+
+    if (size > 16 * 1024 * 1024) {
+        s->why = "extended header too large";
+        return NULL;
+    }
+    buf = malloc((size_t)size + 1);
+    if (!buf) {
+        s->why = strerror(ENOMEM);
+        return NULL;
+    }
+    if (src_read(s, buf, (size_t)size) != 0 || src_read(s, NULL, padding(size)) != 0) {
+        free(buf);
+        return NULL;
+    }
+    buf[size] = '\0';
+    return buf;
+}
+
+static void replace(char **dst, char *src)
+{
+    free(*dst);
+    *dst = src;
+}
+
+/* Take the records "LEN key=value\n" this reader understands */
+static void parse_pax(char *rec, size_t len, tar_next_t *next)
+{
+    char *end = rec + len;
+
+    while (rec < end) {
+        char *sp;
+        char *eq;
+        unsigned long n = strtoul(rec, &sp, 10);
+
+        if (n == 0 || *sp != ' ' || n > (size_t)(end - rec) || rec[n - 1] != '\n') {
+            return;
+        }
+        rec[n - 1] = '\0';
+        eq = strchr(sp + 1, '=');
+        if (eq) {
+            *eq = '\0';
+            if (strcmp(sp + 1, "path") == 0) {
+                replace(&next->path, strdup(eq + 1));
+            } else if (strcmp(sp + 1, "linkpath") == 0) {
+                replace(&next->linkpath, strdup(eq + 1));
+            } else if (strcmp(sp + 1, "size") == 0) {
+                next->size = strtoull(eq + 1, NULL, 10);
+                next->have_size = 1;
+            } else if (strcmp(sp + 1, "mtime") == 0 && eq[1] != '-') {
+                /* Seconds, with a fraction down to nanoseconds */
+                char *frac;
+                long ns = 0;
+                int digits = 0;
+
+                next->mtime.tv_sec = (time_t)strtoll(eq + 1, &frac, 10);
+                if (*frac == '.') {
+                    for (frac++; digits < 9; digits++) {
+                        ns = ns * 10 + (*frac >= '0' && *frac <= '9' ? *frac++ - '0' : 0);
+                    }
+                }
+                next->mtime.tv_nsec = ns;
+                next->have_mtime = 1;
+            }
+        }
+        rec += n;
+    }
+}
+
+/*
+ * Read headers up to the next member that is extracted, folding in
+ * the GNU and pax headers before it
+ * Returns: 1 with *e filled in, 0 at the end of the archive, -1 on error
+ */
+static int next_entry(tar_src_t *s, tar_entry_t *e)
+{
+    tar_next_t next = { NULL, NULL, 0, 0, { 0, 0 }, 0 };
+    unsigned char h[TAR_BLOCK];
+
+    for (;;) {
+        uint64_t size;
+        char *data;
+
+        /* An archive that stops at a header without the zero blocks just ends */
+        if (s->pos == s->end) {
+            int r = src_fill(s);
+
+            if (r <= 0) {
+                free(next.path);
+                free(next.linkpath);
+                return r;
+            }
+        }
+        if (src_read(s, h, TAR_BLOCK) != 0) {
+            goto fail;
+        }
+        if (is_zero_block(h)) {
+            free(next.path);
+            free(next.linkpath);
+            return 0;
+        }
+        if (!checksum_ok(h)) {
+            s->why = "bad header checksum";
+            goto fail;
+        }
+
+        size = parse_number(h + 124, 12);
+        switch (h[156]) {
+        case 'L':
+        case 'K':
+            data = read_data(s, size);
+            if (!data) {
+                goto fail;
+            }
+            replace(h[156] == 'L' ? &next.path : &next.linkpath, data);
+            continue;
+        case 'x':
+            data = read_data(s, size);
+            if (!data) {
+                goto fail;
+            }
+            parse_pax(data, (size_t)size, &next);
+            free(data);
+            continue;
+        case 'g':
+            if (src_read(s, NULL, (size_t)size + padding(size)) != 0) {
+                goto fail;
+            }
+            continue;
+        }
+
+        e->type = h[156] == '\0' || h[156] == '7' ? '0' : (char)h[156];
+        e->size = next.have_size ? next.size : size;
+        e->mode = (mode_t)(parse_number(h + 100, 8) & 0777);
+        e->mtime.tv_sec = (time_t)parse_number(h + 136, 12);
+        e->mtime.tv_nsec = 0;
+        if (next.have_mtime) {
+            e->mtime = next.mtime;
+        }
+        e->path = next.path ? next.path : header_path(h);
+        e->linkpath = next.linkpath ? next.linkpath : field_dup(h + 157, 100);
+        if (!e->path || !e->linkpath) {
+            free(e->path);
+            free(e->linkpath);
+            s->why = strerror(ENOMEM);
+            return -1;
+        }
+        /* Only files carry data; a size on a link or directory is skipped */
+        if (e->type != '0' && e->size > 0) {
+            if (src_read(s, NULL, (size_t)e->size + padding(e->size)) != 0) {
+                free(e->path);
+                free(e->linkpath);
+                return -1;
+            }
+            e->size = 0;
+        }
+        return 1;
+    }
+
+fail:
+    free(next.path);
+    free(next.linkpath);
+    return -1;
+}
+
+/* ===== WRITING MEMBERS ===== */
+
+/*
+ * Make a member name relative and safe: drop leading "/" and "./"
+ * Returns: the name (inside path), "" for the archive root, or NULL if
+ * it has a ".." component
+ */
+static const char *clean_path(char *path)
+{
+    char *p = path;
+    char *c;
+    size_t len;
+
+    for (;;) {
+        if (*p == '/') {
+            p++;
+        } else if (p[0] == '.' && (p[1] == '/' || p[1] == '\0')) {
+            p += p[1] ? 2 : 1;
+        } else {
+            break;
+        }
+    }
+    len = strlen(p);
+    while (len > 0 && p[len - 1] == '/') {
+        p[--len] = '\0';
+    }
+    for (c = p; *c; ) {
+        size_t n = strcspn(c, "/");
+
+        if (n == 2 && c[0] == '.' && c[1] == '.') {
+            return NULL;
+        }
+        c += n;
+        c += *c == '/';
+    }
+    return p;
+}
+
+/* Create the directories leading to path. Returns: 0, or -1 */
+static int make_parents(int dirfd, const char *path)
+{
+    char buf[PATH_MAX];
+    char *slash;
+
+    if (strlen(path) >= sizeof(buf)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(buf, path);
+    for (slash = strchr(buf, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdirat(dirfd, buf, 0755) != 0 && errno != EEXIST) {
+            return -1;
+        }
+        *slash = '/';
+    }
+    return 0;
+}
+
+/* Write all of buf to fd. Returns: 0, or -1 */
+static int write_all(int fd, const unsigned char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t w = write(fd, buf, len);
+
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+/*
+ * Create a file and fill it from the stream. A file that cannot be
+ * written still has its data consumed.
+ * Returns: 0, 1 if the file failed (errno set), -1 if the stream did
+ */
+static int extract_file(tar_src_t *s, int dirfd, const char *path, const tar_entry_t *e)
+{
+    uint64_t left = e->size;
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC;
+    int fd = openat(dirfd, path, flags, e->mode);
+    int err = 0;
+
+    if (fd < 0 && errno == ENOENT && make_parents(dirfd, path) == 0) {
+        fd = openat(dirfd, path, flags, e->mode);
+    }
+    if (fd < 0) {
+        err = errno;
+    }
+#ifdef __linux__
+    /* One extent for the whole file, where the filesystem can */
+    if (fd >= 0 && e->size > 0) {
+        fallocate(fd, 0, 0, (off_t)e->size);
+    }
+#endif
+
+    while (left > 0) {
+        const unsigned char *p;
+        ssize_t n = src_next(s, &p, left < TAR_BUF ? (size_t)left : TAR_BUF);
+
+        if (n <= 0) {
+            if (n == 0) {
+                s->why = "unexpected end of archive";
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+        if (fd >= 0 && write_all(fd, p, (size_t)n) != 0) {
+            err = errno;
+            close(fd);
+            fd = -1;
+        }
+        left -= (uint64_t)n;
+    }
+    if (src_read(s, NULL, padding(e->size)) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    if (fd >= 0) {
+        struct timespec times[2];
+
+        times[0] = times[1] = e->mtime;
+        futimens(fd, times);
+        if (close(fd) != 0) {
+            err = errno;
+        }
+    }
+    errno = err;
+    return err ? 1 : 0;
+}
+
+/*
+ * Create a directory, hard link or FIFO
+ * Returns: 0, or -1 (errno set)
+ */
+static int extract_other(int dirfd, const char *path, char *linkpath, const tar_entry_t *e)
+{
+    int r;
+    int tries;
+
+    for (tries = 0; tries < 2; tries++) {
+        switch (e->type) {
+        case '5':
+            r = mkdirat(dirfd, path, e->mode | 0700);
+            if (r != 0 && errno == EEXIST) {
+                r = 0;
+            }
+            break;
+        case '1': {
+            const char *target = clean_path(linkpath);
+
+            if (!target || !*target) {
+                errno = EINVAL;
+                return -1;
+            }
+            unlinkat(dirfd, path, 0);
+            r = linkat(dirfd, target, dirfd, path, 0);
+            break;
+        }
+        case '6':
+            r = mkfifoat(dirfd, path, e->mode);
+            break;
+        default:
+            return 0;
+        }
+        if (r == 0 || errno != ENOENT || make_parents(dirfd, path) != 0) {
+            return r;
+        }
+    }
+    return r;
+}
+
+/* Left for the end: a symbolic link, or a directory's modification time */
+typedef struct {
+    char *path;                 /* As read; clean_path() gives the same name again */
+    char *target;               /* Link target, or NULL for a directory */
+    struct timespec mtime;
+} tar_later_t;
+
+typedef struct {
+    tar_later_t *v;
+    size_t n, cap;
+} tar_deferred_t;
+
+/* Take path and target (owned from here on). Returns: 0, or -1 */
+static int defer(tar_deferred_t *d, char *path, char *target, struct timespec mtime)
+{
+    if (d->n == d->cap) {
+        size_t cap = d->cap ? 2 * d->cap : 16;
+        tar_later_t *v = realloc(d->v, cap * sizeof(*v));
+
+        if (!v) {
+            return -1;
+        }
+        d->v = v;
+        d->cap = cap;
+    }
+    d->v[d->n].path = path;
+    d->v[d->n].target = target;
+    d->v[d->n].mtime = mtime;
+    d->n++;
+    return 0;
+}
+
+/*
+ * Create the symbolic links, then set the directories' times, which
+ * everything created in them has changed
+ * Returns: 0, or -1 if a link failed
+ */
+static int finish_deferred(tar_deferred_t *d, int dirfd, const char *prog)
+{
+    int ret = 0;
+    size_t i;
+
+    for (i = 0; i < d->n; i++) {
+        tar_later_t *l = &d->v[i];
+        const char *path = clean_path(l->path);
+        struct timespec times[2];
+
+        times[0] = times[1] = l->mtime;
+        if (!l->target) {
+            continue;
+        }
+        unlinkat(dirfd, path, 0);
+        if (symlinkat(l->target, dirfd, path) != 0 &&
+            (errno != ENOENT || make_parents(dirfd, path) != 0 ||
+             symlinkat(l->target, dirfd, path) != 0)) {
+            fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+            ret = -1;
+            continue;
+        }
+        utimensat(dirfd, path, times, AT_SYMLINK_NOFOLLOW);
+    }
+    for (i = 0; i < d->n; i++) {
+        tar_later_t *l = &d->v[i];
+
+        if (!l->target) {
+            struct timespec times[2];
+
+            times[0] = times[1] = l->mtime;
+            utimensat(dirfd, clean_path(l->path), times, AT_SYMLINK_NOFOLLOW);
+        }
+        free(l->path);
+        free(l->target);
+    }
+    free(d->v);
+    return ret;
+}
+
+int tar_extract_at(const char *archive, int dirfd, const char *prog)
+{
+    int fd = open(archive, O_RDONLY | O_CLOEXEC);
+    int ret;
+
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s: %s\n", prog, archive, strerror(errno));
+        return -1;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    ret = tar_extract_fd(fd, archive, dirfd, prog);
+    close(fd);
+    return ret;
+}
+
+int tar_extract_fd(int fd, const char *archive, int dirfd, const char *prog)
+{
+    tar_src_t s;
+    tar_deferred_t later = { NULL, 0, 0 };
+    tar_entry_t e;
+    size_t got = 0;
+    int ret = 0;
+    int r;
+
+    memset(&s, 0, sizeof(s));
+    s.fd = fd;
+    s.out = malloc(TAR_BUF);
+    s.in = malloc(TAR_BUF);
+    if (!s.out || !s.in) {
+        fprintf(stderr, "%s: %s\n", prog, strerror(ENOMEM));
+        ret = -1;
+        goto out;
+    }
+
+    /*
+     * gzip starts 1f 8b; anything else is read as a plain archive. The
+     * first bytes are read, not peeked at, so that fd can be a pipe:
+     * they become inflate()'s first input, or the first plain data.
+     */
+    while (got < 2) {
+        ssize_t n = read(fd, s.in + got, TAR_BUF - got);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            fprintf(stderr, "%s: %s: %s\n", prog, archive, strerror(errno));
+            ret = -1;
+            goto out;
+        }
+        if (n == 0) {
+            break;
+        }
+        got += (size_t)n;
+    }
+    s.gz = got >= 2 && s.in[0] == 0x1f && s.in[1] == 0x8b;
+    if (s.gz) {
+        if (inflateInit2(&s.zs, 15 + 16) != Z_OK) {
+            fprintf(stderr, "%s: %s: cannot start decompression\n", prog, archive);
+            s.gz = 0;
+            ret = -1;
+            goto out;
+        }
+        s.zs.next_in = s.in;
+        s.zs.avail_in = (uInt)got;
+    } else {
+        memcpy(s.out, s.in, got);
+        s.end = got;
+    }
+
+    while ((r = next_entry(&s, &e)) > 0) {
+        const char *path = clean_path(e.path);
+        int failed = 0;
+
+        if (!path) {
+            fprintf(stderr, "%s: %s: member name contains '..', skipped\n", prog, e.path);
+            ret = -1;
+            failed = -2;
+        } else if (e.type == '0') {
+            failed = extract_file(&s, dirfd, path, &e);
+        } else if (e.type == '2') {
+            if (defer(&later, e.path, e.linkpath, e.mtime) == 0) {
+                continue;           /* The list owns both now */
+            }
+            failed = 1;
+        } else if (*path) {
+            failed = extract_other(dirfd, path, e.linkpath, &e) != 0;
+            if (!failed && e.type == '5' && defer(&later, e.path, NULL, e.mtime) == 0) {
+                e.path = NULL;
+            }
+        }
+
+        if (failed == -2 && e.type == '0' && src_read(&s, NULL, (size_t)e.size + padding(e.size)) != 0) {
+            failed = -1;
+        }
+        if (failed == 1) {
+            fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+            ret = -1;
+        }
+        free(e.path);
+        free(e.linkpath);
+        if (failed == -1) {
+            r = -1;
+            break;
+        }
+    }
+    if (r < 0) {
+        fprintf(stderr, "%s: %s: %s\n", prog, archive, s.why ? s.why : "read error");
+        ret = -1;
+    }
+    if (finish_deferred(&later, dirfd, prog) != 0) {
+        ret = -1;
+    }
+
+out:
+    if (s.gz) {
+        inflateEnd(&s.zs);
+    }
+    free(s.in);
+    free(s.out);
+    return ret;
+}
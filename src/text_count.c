@@ -0,0 +1,445 @@
+/*
+ * text_count.c - SIMD line, word and character counts
+ *
+ * Per block the kernels build three masks, one bit per byte:
+ *   nl    byte == '\n'
+ *   ws    byte is ' ' or in '\t'..'\r' (one unsigned compare: byte - 9 < 5)
+ *   lead  byte is not 10xxxxxx, i.e. (signed char)byte > (signed char)0xbf
+ * and add popcount(nl), popcount(lead) and popcount(~ws & (ws << 1 | carry))
+ * (word starts), where carry is set when the byte before the block was
+ * whitespace. NEON has no movemask; its masks carry four bits per byte.
+ *
+ * Line width scans spans of one-column bytes with the same lead mask
+ * and stops at the first control byte (< 0x20 or 0x7f) or start of a
+ * three- or four-byte sequence (>= 0xe0), which are handled one at a
+ * time: the sequence is decoded to tell East Asian wide characters
+ * (two columns) from the rest. ASCII and Latin text stays on the fast
+ * path.
+ */
+
+#include "text_count.h"
+#include "literal_search.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define HAVE_NEON_KERNEL 1
+#endif
+
+typedef struct {
+    uint64_t lines, words, chars;
+    int in_word;
+} scan_t;
+
+static int is_space(unsigned char c)
+{
+    return c == ' ' || (unsigned char)(c - '\t') < 5;
+}
+
+/* Ends a span of one-column characters */
+static int is_special(unsigned char c)
+{
+    return c < 0x20 || c == 0x7f || c >= 0xe0;
+}
+
+static int is_lead(unsigned char c)
+{
+    return (c & 0xc0) != 0x80;
+}
+
+static void scan_from(scan_t *s, const unsigned char *p, size_t len, size_t i)
+{
+    for (; i < len; i++) {
+        int space = is_space(p[i]);
+
+        s->lines += p[i] == '\n';
+        s->chars += is_lead(p[i]);
+        s->words += !space && !s->in_word;
+        s->in_word = !space;
+    }
+}
+
+static void scan_scalar(scan_t *s, const unsigned char *p, size_t len)
+{
+    scan_from(s, p, len, 0);
+}
+
+static size_t plain_from(const unsigned char *p, size_t len, uint64_t *leads, size_t i)
+{
+    for (; i < len && !is_special(p[i]); i++) {
+        *leads += is_lead(p[i]);
+    }
+    return i;
+}
+
+static size_t plain_scalar(const unsigned char *p, size_t len, uint64_t *leads)
+{
+    return plain_from(p, len, leads, 0);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+#ifdef __SSE2__
+static void scan_sse2(scan_t *s, const unsigned char *p, size_t len)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i four = _mm_set1_epi8(4);
+    const __m128i cont = _mm_set1_epi8((char)0xbf);
+    unsigned carry = s->in_word ? 0 : 1;
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i t = _mm_sub_epi8(v, tab);
+        unsigned ws = (unsigned)_mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(_mm_min_epu8(t, four), t)));
+
+        s->lines += (unsigned)__builtin_popcount(
+            (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+        s->chars += (unsigned)__builtin_popcount(
+            (unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(v, cont)));
+        s->words += (unsigned)__builtin_popcount(~ws & ((ws << 1) | carry) & 0xffff);
+        carry = ws >> 15;
+    }
+    s->in_word = !carry;
+
+    scan_from(s, p, len, i);
+}
+
+static size_t plain_sse2(const unsigned char *p, size_t len, uint64_t *leads)
+{
+    const __m128i low = _mm_set1_epi8(0x1f);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i high = _mm_set1_epi8((char)0xe0);
+    const __m128i cont = _mm_set1_epi8((char)0xbf);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        unsigned ctl = (unsigned)_mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, low), v), _mm_cmpeq_epi8(v, del)),
+            _mm_cmpeq_epi8(_mm_max_epu8(v, high), v)));
+        unsigned lead = (unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(v, cont));
+
+        if (ctl) {
+            int k = __builtin_ctz(ctl);
+
+            *leads += (unsigned)__builtin_popcount(lead & ((1u << k) - 1));
+            return i + (size_t)k;
+        }
+        *leads += (unsigned)__builtin_popcount(lead);
+    }
+
+    return plain_from(p, len, leads, i);
+}
+#endif
+
+__attribute__((target("avx2,popcnt")))
+static void scan_avx2(scan_t *s, const unsigned char *p, size_t len)
+{
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i four = _mm256_set1_epi8(4);
+    const __m256i cont = _mm256_set1_epi8((char)0xbf);
+    uint32_t carry = s->in_word ? 0 : 1;
+    uint64_t lines = 0, words = 0, chars = 0;
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i t = _mm256_sub_epi8(v, tab);
+        uint32_t ws = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(_mm256_min_epu8(t, four), t)));
+
+        lines += (uint64_t)__builtin_popcount(
+            (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+        chars += (uint64_t)__builtin_popcount(
+            (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, cont)));
+        words += (uint64_t)__builtin_popcount(~ws & ((ws << 1) | carry));
+        carry = ws >> 31;
+    }
+    s->lines += lines;
+    s->words += words;
+    s->chars += chars;
+    s->in_word = !carry;
+
+    scan_from(s, p, len, i);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t plain_avx2(const unsigned char *p, size_t len, uint64_t *leads)
+{
+    const __m256i low = _mm256_set1_epi8(0x1f);
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    const __m256i high = _mm256_set1_epi8((char)0xe0);
+    const __m256i cont = _mm256_set1_epi8((char)0xbf);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        uint32_t ctl = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(v, low), v),
+                            _mm256_cmpeq_epi8(v, del)),
+            _mm256_cmpeq_epi8(_mm256_max_epu8(v, high), v)));
+        uint32_t lead = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, cont));
+
+        if (ctl) {
+            int k = __builtin_ctz(ctl);
+
+            *leads += (uint64_t)__builtin_popcount(lead & ((1u << k) - 1));
+            return i + (size_t)k;
+        }
+        *leads += (uint64_t)__builtin_popcount(lead);
+    }
+
+    return plain_from(p, len, leads, i);
+}
+
+#endif /* HAVE_X86_KERNELS */
+
+#ifdef HAVE_NEON_KERNEL
+/* Four bits per byte: 0xf where eq is set */
+static uint64_t nibble_mask(uint8x16_t eq)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(
+        vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+}
+
+static void scan_neon(scan_t *s, const unsigned char *p, size_t len)
+{
+    const uint8x16_t nl = vdupq_n_u8('\n');
+    const uint8x16_t sp = vdupq_n_u8(' ');
+    const uint8x16_t tab = vdupq_n_u8('\t');
+    const uint8x16_t five = vdupq_n_u8(5);
+    const int8x16_t cont = vdupq_n_s8((int8_t)0xbf);
+    uint64_t carry = s->in_word ? 0 : 0xf;
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        uint64_t ws = nibble_mask(vorrq_u8(vceqq_u8(v, sp),
+                                           vcltq_u8(vsubq_u8(v, tab), five)));
+
+        s->lines += (uint64_t)__builtin_popcountll(nibble_mask(vceqq_u8(v, nl))) / 4;
+        s->chars += (uint64_t)__builtin_popcountll(
+            nibble_mask(vcgtq_s8(vreinterpretq_s8_u8(v), cont))) / 4;
+        s->words += (uint64_t)__builtin_popcountll(~ws & ((ws << 4) | carry)) / 4;
+        carry = ws >> 60;
+    }
+    s->in_word = !carry;
+
+    scan_from(s, p, len, i);
+}
+
+static size_t plain_neon(const unsigned char *p, size_t len, uint64_t *leads)
+{
+    const uint8x16_t space = vdupq_n_u8(0x20);
+    const uint8x16_t del = vdupq_n_u8(0x7f);
+    const uint8x16_t high = vdupq_n_u8(0xe0);
+    const int8x16_t cont = vdupq_n_s8((int8_t)0xbf);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        uint64_t ctl = nibble_mask(vorrq_u8(vorrq_u8(vcltq_u8(v, space), vceqq_u8(v, del)),
+                                            vcgeq_u8(v, high)));
+        uint64_t lead = nibble_mask(vcgtq_s8(vreinterpretq_s8_u8(v), cont));
+
+        if (ctl) {
+            int k = __builtin_ctzll(ctl);
+
+            *leads += (uint64_t)__builtin_popcountll(lead & ((1ULL << k) - 1)) / 4;
+            return i + (size_t)(k / 4);
+        }
+        *leads += (uint64_t)__builtin_popcountll(lead) / 4;
+    }
+
+    return plain_from(p, len, leads, i);
+}
+#endif /* HAVE_NEON_KERNEL */
+
+static const struct {
+    const char *name;
+    void (*scan)(scan_t *, const unsigned char *, size_t);
+    size_t (*plain)(const unsigned char *, size_t, uint64_t *);
+} kernels[] = {
+#ifdef HAVE_X86_KERNELS
+    { "avx2", scan_avx2, plain_avx2 },
+#ifdef __SSE2__
+    { "sse2", scan_sse2, plain_sse2 },
+#endif
+#endif
+#ifdef HAVE_NEON_KERNEL
+    { "neon", scan_neon, plain_neon },
+#endif
+    { "scalar", scan_scalar, plain_scalar }
+};
+
+#define NKERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static size_t kernel;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static int kernel_supported(size_t i)
+{
+#ifdef HAVE_X86_KERNELS
+    if (kernels[i].scan == scan_avx2) {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    }
+#endif
+    (void)i;
+    return 1;
+}
+
+/* Best supported kernel, or the one named by PICOBOX_SIMD */
+static void pick_kernel(void)
+{
+    const char *want = getenv("PICOBOX_SIMD");
+
+    kernel = NKERNELS - 1;
+    if (want && want[0]) {
+        for (size_t i = 0; i < NKERNELS; i++) {
+            if (strcmp(kernels[i].name, want) == 0 && kernel_supported(i)) {
+                kernel = i;
+                return;
+            }
+        }
+    }
+    for (size_t i = 0; i < NKERNELS; i++) {
+        if (kernel_supported(i)) {
+            kernel = i;
+            return;
+        }
+    }
+}
+
+static void end_line(text_count_t *tc)
+{
+    if (tc->width > tc->max_width) {
+        tc->max_width = tc->width;
+    }
+    tc->width = 0;
+}
+
+/* Columns taken by code point cp (from a three- or four-byte sequence) */
+static int columns(uint32_t cp)
+{
+    static const uint32_t wide[][2] = {
+        { 0x2e80, 0x303e }, { 0x3041, 0x33ff }, { 0x3400, 0x4dbf },
+        { 0x4e00, 0x9fff }, { 0xa000, 0xa4cf }, { 0xac00, 0xd7a3 },
+        { 0xf900, 0xfaff }, { 0xfe30, 0xfe4f }, { 0xff00, 0xff60 },
+        { 0xffe0, 0xffe6 }, { 0x1f300, 0x1f64f }, { 0x1f900, 0x1f9ff },
+        { 0x20000, 0x2fffd }, { 0x30000, 0x3fffd }
+    };
+
+    if (cp >= 0x1100 && cp <= 0x115f) {
+        return 2;
+    }
+    for (size_t i = 0; i < sizeof(wide) / sizeof(wide[0]); i++) {
+        if (cp >= wide[i][0] && cp <= wide[i][1]) {
+            return 2;
+        }
+    }
+    return 1;
+}
+
+static void measure(text_count_t *tc, const unsigned char *p, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len) {
+        unsigned char c;
+
+        /* Rest of a multibyte sequence, possibly begun in the last block */
+        if (tc->need) {
+            if ((p[i] & 0xc0) != 0x80) {
+                tc->width++;   /* Truncated: count it as one column */
+                tc->need = 0;
+                continue;
+            }
+            tc->cp = (tc->cp << 6) | (p[i++] & 0x3f);
+            if (--tc->need == 0) {
+                tc->width += (uint64_t)columns(tc->cp);
+            }
+            continue;
+        }
+
+        i += kernels[kernel].plain(p + i, len - i, &tc->width);
+        if (i == len) {
+            break;
+        }
+        c = p[i++];
+        switch (c) {
+        case '\n':
+        case '\r':
+        case '\f':
+            end_line(tc);
+            break;
+        case '\t':
+            tc->width = (tc->width | 7) + 1;
+            break;
+        default:
+            if (c >= 0xe0) {
+                tc->need = c >= 0xf0 ? 3 : 2;
+                tc->cp = c & (c >= 0xf0 ? 0x07 : 0x0f);
+            }
+            break;
+        }
+    }
+}
+
+void text_count_init(text_count_t *tc)
+{
+    memset(tc, 0, sizeof(*tc));
+    pthread_once(&kernel_once, pick_kernel);
+}
+
+void text_count_after(text_count_t *tc, unsigned char prev)
+{
+    tc->in_word = !is_space(prev);
+}
+
+void text_count_block(text_count_t *tc, const char *buf, size_t len, int what)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+
+    if (what & (TEXT_COUNT_WORDS | TEXT_COUNT_CHARS)) {
+        scan_t s = { tc->lines, tc->words, tc->chars, tc->in_word };
+
+        kernels[kernel].scan(&s, p, len);
+        tc->lines = s.lines;
+        tc->words = s.words;
+        tc->chars = s.chars;
+        tc->in_word = s.in_word;
+    } else if (what & TEXT_COUNT_LINES) {
+        tc->lines += literal_count_byte(buf, len, '\n');
+    }
+
+    if (what & TEXT_COUNT_WIDTH) {
+        measure(tc, p, len);
+    }
+}
+
+void text_count_end(text_count_t *tc)
+{
+    if (tc->need) {
+        tc->width++;
+        tc->need = 0;
+    }
+    end_line(tc);
+}
+
+const char *text_count_kernel(void)
+{
+    pthread_once(&kernel_once, pick_kernel);
+    return kernels[kernel].name;
+}
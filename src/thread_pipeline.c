@@ -0,0 +1,351 @@
+/*
+ * thread_pipeline.c - Threaded in-memory pipelines
+ *
+ * Each stage runs spec->run() on its own thread. Stages are connected by
+ * ring buffers wrapped in stdio streams (fopencookie/funopen), which the
+ * commands see through cmd_stdin()/cmd_stdout(). This saves a fork per
+ * stage and the kernel copies in and out of a pipe.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* fopencookie() */
+#endif
+
+#include "thread_pipeline.h"
+#include "ring_buffer.h"
+#include "picobox.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+/* Bytes buffered between two stages */
+#define THREAD_PIPE_RING_SIZE (64 * 1024)
+
+/* Per-stage thread stack (commands keep 8K line buffers on the stack) */
+#define THREAD_PIPE_STACK_SIZE (1024 * 1024)
+
+/* Thread state for one stage */
+typedef struct stage_thread {
+    pipe_stage_t *stage;
+    FILE *in;                /* NULL = shell stdin */
+    ring_buffer_t *in_ring;  /* Ring behind in, or NULL */
+    FILE *out;               /* NULL = shell stdout */
+    pthread_t thread;
+    int started;
+} stage_thread_t;
+
+int thread_stage_supported(const cmd_spec_t *spec)
+{
+    return spec != NULL && (spec->flags & CMD_FLAG_STREAMS) != 0;
+}
+
+int thread_pipeline_supported(const cmd_spec_t **specs, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (!thread_stage_supported(specs[i])) {
+            return 0;
+        }
+        for (int j = 0; j < i; j++) {
+            if (specs[j] == specs[i]) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/* ===== Ring buffer streams ===== */
+
+#ifdef __APPLE__
+static int ring_read_fn(void *cookie, char *buf, int size)
+{
+    return (int)ring_buffer_read(cookie, buf, (size_t)size);
+}
+
+static int ring_write_fn(void *cookie, const char *buf, int size)
+{
+    return (int)ring_buffer_write(cookie, buf, (size_t)size);
+}
+#else
+static ssize_t ring_read_fn(void *cookie, char *buf, size_t size)
+{
+    return ring_buffer_read(cookie, buf, size);
+}
+
+static ssize_t ring_write_fn(void *cookie, const char *buf, size_t size)
+{
+    ssize_t n = ring_buffer_write(cookie, buf, size);
+
+    /* Report errors as a short write (errno stays EPIPE): glibc's stdio
+     * mishandles -1 from a cookie write on large fwrite() calls */
+    return n < 0 ? 0 : n;
+}
+#endif
+
+static int ring_close_read_fn(void *cookie)
+{
+    ring_buffer_close_read(cookie);
+    return 0;
+}
+
+static int ring_close_write_fn(void *cookie)
+{
+    ring_buffer_close_write(cookie);
+    return 0;
+}
+
+/* Open the reading or writing end of a ring as a stdio stream */
+static FILE *ring_open(ring_buffer_t *rb, int for_write)
+{
+#ifdef __APPLE__
+    if (for_write) {
+        return funopen(rb, NULL, ring_write_fn, NULL, ring_close_write_fn);
+    }
+    return funopen(rb, ring_read_fn, NULL, NULL, ring_close_read_fn);
+#else
+    cookie_io_functions_t io;
+
+    memset(&io, 0, sizeof(io));
+    if (for_write) {
+        io.write = ring_write_fn;
+        io.close = ring_close_write_fn;
+        return fopencookie(rb, "w", io);
+    }
+    io.read = ring_read_fn;
+    io.close = ring_close_read_fn;
+    return fopencookie(rb, "r", io);
+#endif
+}
+
+/* cmd_stdin_done() for a stage reading a ring: the writer gets EPIPE */
+static void ring_stdin_done(void *rb)
+{
+    ring_buffer_close_read(rb);
+}
+
+/* ===== Stage threads ===== */
+
+static double clock_ms(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void *stage_main(void *arg)
+{
+    stage_thread_t *st = arg;
+    pipe_stage_t *stage = st->stage;
+    double wall = clock_ms(CLOCK_MONOTONIC);
+
+    cmd_set_streams(st->in, st->out);
+    cmd_set_stdin_done(st->in_ring ? ring_stdin_done : NULL, st->in_ring);
+    stage->status = stage->spec->run(stage->argc, stage->argv);
+    fflush(cmd_stdout());
+    cmd_set_streams(NULL, NULL);
+    cmd_set_stdin_done(NULL, NULL);
+
+    /* Per-thread CPU time; only Linux splits it into user/system */
+    stage->wall_ms = clock_ms(CLOCK_MONOTONIC) - wall;
+#ifdef RUSAGE_THREAD
+    {
+        struct rusage usage;
+
+        if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+            stage->user_ms = usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0;
+            stage->sys_ms = usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+        }
+    }
+#else
+    stage->user_ms = clock_ms(CLOCK_THREAD_CPUTIME_ID);
+#endif
+
+    /* Closing our ends lets the neighbouring stages see EOF / EPIPE */
+    if (st->in) {
+        fclose(st->in);
+    }
+    if (st->out) {
+        fclose(st->out);
+    }
+
+    return NULL;
+}
+
+/* Close everything a stage would have closed, for stages that never ran */
+static void stage_abandon(stage_thread_t *st)
+{
+    if (st->in) {
+        fclose(st->in);
+        st->in = NULL;
+    }
+    if (st->out) {
+        fclose(st->out);
+        st->out = NULL;
+    }
+}
+
+/*
+ * Give each stage its input and output streams. A stage's own
+ * redirections win over the ring; the ring end it would have used is
+ * closed, so the neighbour sees EOF or EPIPE (as with a real pipe).
+ */
+static int open_stage_streams(stage_thread_t *threads, ring_buffer_t **rings,
+                              int count)
+{
+    for (int i = 0; i < count; i++) {
+        pipe_stage_t *stage = threads[i].stage;
+
+        if (stage->stdin_fd != -1) {
+            threads[i].in = fdopen(stage->stdin_fd, "r");
+            if (!threads[i].in) {
+                perror("fdopen");
+                return -1;
+            }
+            stage->stdin_fd = -1;
+            if (i > 0) {
+                ring_buffer_close_read(rings[i - 1]);
+            }
+        } else if (i > 0) {
+            threads[i].in = ring_open(rings[i - 1], 0);
+            if (!threads[i].in) {
+                perror("fopencookie");
+                return -1;
+            }
+            threads[i].in_ring = rings[i - 1];
+        }
+
+        if (stage->stdout_fd != -1) {
+            threads[i].out = fdopen(stage->stdout_fd, "w");
+            if (!threads[i].out) {
+                perror("fdopen");
+                return -1;
+            }
+            stage->stdout_fd = -1;
+            if (i < count - 1) {
+                ring_buffer_close_write(rings[i]);
+            }
+        } else if (i < count - 1) {
+            threads[i].out = ring_open(rings[i], 1);
+            if (!threads[i].out) {
+                perror("fopencookie");
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+void run_thread_pipeline(pipe_stage_t *stages, int count)
+{
+    stage_thread_t *threads;
+    ring_buffer_t **rings;
+    pthread_attr_t attr;
+    int i;
+
+    threads = calloc(count, sizeof(stage_thread_t));
+    rings = calloc(count, sizeof(ring_buffer_t *));
+    if (!threads || !rings) {
+        perror("calloc");
+        free(threads);
+        free(rings);
+        for (i = 0; i < count; i++) {
+            if (stages[i].argv) {
+                stages[i].status = EXIT_ERROR;
+            }
+            if (stages[i].stdin_fd != -1) {
+                close(stages[i].stdin_fd);
+                stages[i].stdin_fd = -1;
+            }
+            if (stages[i].stdout_fd != -1) {
+                close(stages[i].stdout_fd);
+                stages[i].stdout_fd = -1;
+            }
+        }
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        threads[i].stage = &stages[i];
+    }
+
+    for (i = 0; i < count - 1; i++) {
+        rings[i] = ring_buffer_create(THREAD_PIPE_RING_SIZE);
+        if (!rings[i]) {
+            goto failed;
+        }
+    }
+
+    if (open_stage_streams(threads, rings, count) != 0) {
+        goto failed;
+    }
+
+    /* Anything the shell buffered must reach stdout before the last stage */
+    fflush(stdout);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, THREAD_PIPE_STACK_SIZE);
+
+    for (i = 0; i < count; i++) {
+        if (stages[i].argv == NULL) {
+            /* Stage could not be prepared: just close its ends */
+            stage_abandon(&threads[i]);
+            continue;
+        }
+        if (pthread_create(&threads[i].thread, &attr, stage_main, &threads[i]) != 0) {
+            fprintf(stderr, "%s: cannot start pipeline thread\n",
+                    stages[i].argv[0]);
+            stage_abandon(&threads[i]);
+            stages[i].status = EXIT_ERROR;
+            continue;
+        }
+        threads[i].started = 1;
+    }
+
+    pthread_attr_destroy(&attr);
+
+    for (i = 0; i < count; i++) {
+        if (threads[i].started) {
+            pthread_join(threads[i].thread, NULL);
+        }
+    }
+
+    fflush(stdout);
+    clearerr(stdin);   /* first stage may have read the terminal to EOF */
+    goto cleanup;
+
+failed:
+    /* Set-up failed before any thread started */
+    for (i = 0; i < count; i++) {
+        if (stages[i].argv) {
+            stages[i].status = EXIT_ERROR;
+        }
+    }
+
+cleanup:
+    for (i = 0; i < count; i++) {
+        if (!threads[i].started) {
+            stage_abandon(&threads[i]);
+        }
+        if (stages[i].stdin_fd != -1) {
+            close(stages[i].stdin_fd);
+            stages[i].stdin_fd = -1;
+        }
+        if (stages[i].stdout_fd != -1) {
+            close(stages[i].stdout_fd);
+            stages[i].stdout_fd = -1;
+        }
+    }
+    for (i = 0; i < count - 1; i++) {
+        ring_buffer_destroy(rings[i]);
+    }
+    free(rings);
+    free(threads);
+}
@@ -0,0 +1,128 @@
+/*
+ * time_stats.c - Resource usage of shell commands
+ *
+ * getrusage(RUSAGE_CHILDREN) would also count background jobs reaped in
+ * the meantime, and its ru_maxrss is the largest child the shell ever
+ * had. So children are counted one by one as they are reaped, from the
+ * rusage wait4() returns for them.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* clock_gettime() and CLOCK_MONOTONIC */
+#endif
+
+#include "time_stats.h"
+
+#include <stdlib.h>
+
+/* Sum of every command child reaped so far (maxrss: largest since the
+ * innermost time_stats_begin()) */
+static time_stats_t child_totals;
+static unsigned long children_reaped = 0;
+
+/* -1 = PICOBOX_TIME_LOG not read yet */
+static int log_enabled = -1;
+static FILE *log_file = NULL;
+
+static double timeval_ms(const struct timeval *tv)
+{
+    return tv->tv_sec * 1000.0 + tv->tv_usec / 1000.0;
+}
+
+/* ru_maxrss is in kilobytes on Linux, bytes on macOS */
+static long maxrss_kb(const struct rusage *usage)
+{
+#ifdef __APPLE__
+    return usage->ru_maxrss / 1024;
+#else
+    return usage->ru_maxrss;
+#endif
+}
+
+void time_stats_child(const struct rusage *usage)
+{
+    child_totals.user_ms += timeval_ms(&usage->ru_utime);
+    child_totals.sys_ms += timeval_ms(&usage->ru_stime);
+    child_totals.nvcsw += usage->ru_nvcsw;
+    child_totals.nivcsw += usage->ru_nivcsw;
+    if (maxrss_kb(usage) > child_totals.maxrss_kb) {
+        child_totals.maxrss_kb = maxrss_kb(usage);
+    }
+    children_reaped++;
+}
+
+void time_stats_begin(time_mark_t *mark)
+{
+    mark->children = child_totals;
+    mark->saved_maxrss = child_totals.maxrss_kb;
+    mark->reaped = children_reaped;
+    child_totals.maxrss_kb = 0;
+
+    getrusage(RUSAGE_SELF, &mark->self);
+    clock_gettime(CLOCK_MONOTONIC, &mark->start);
+}
+
+void time_stats_end(const time_mark_t *mark, time_stats_t *out)
+{
+    struct timespec now;
+    struct rusage self;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    getrusage(RUSAGE_SELF, &self);
+
+    out->real_ms = (now.tv_sec - mark->start.tv_sec) * 1000.0 +
+                   (now.tv_nsec - mark->start.tv_nsec) / 1e6;
+    out->user_ms = timeval_ms(&self.ru_utime) - timeval_ms(&mark->self.ru_utime) +
+                   child_totals.user_ms - mark->children.user_ms;
+    out->sys_ms = timeval_ms(&self.ru_stime) - timeval_ms(&mark->self.ru_stime) +
+                  child_totals.sys_ms - mark->children.sys_ms;
+    out->nvcsw = self.ru_nvcsw - mark->self.ru_nvcsw +
+                 child_totals.nvcsw - mark->children.nvcsw;
+    out->nivcsw = self.ru_nivcsw - mark->self.ru_nivcsw +
+                  child_totals.nivcsw - mark->children.nivcsw;
+    out->maxrss_kb = children_reaped > mark->reaped ? child_totals.maxrss_kb : maxrss_kb(&self);
+
+    /* The enclosing measurement still sees the children of this one */
+    if (mark->saved_maxrss > child_totals.maxrss_kb) {
+        child_totals.maxrss_kb = mark->saved_maxrss;
+    }
+}
+
+void time_stats_print(FILE *out, const time_stats_t *stats)
+{
+    fprintf(out, "real\t%.3fs\n", stats->real_ms / 1000.0);
+    fprintf(out, "user\t%.3fs\n", stats->user_ms / 1000.0);
+    fprintf(out, "sys\t%.3fs\n", stats->sys_ms / 1000.0);
+    fprintf(out, "maxrss\t%ld KB\n", stats->maxrss_kb);
+    fprintf(out, "ctxsw\t%ld voluntary, %ld involuntary\n", stats->nvcsw, stats->nivcsw);
+}
+
+int time_stats_log_enabled(void)
+{
+    if (log_enabled < 0) {
+        const char *path = getenv("PICOBOX_TIME_LOG");
+
+        log_enabled = 0;
+        if (path && path[0]) {
+            log_file = fopen(path, "a");
+            if (log_file) {
+                log_enabled = 1;
+            } else {
+                perror(path);
+            }
+        }
+    }
+    return log_enabled;
+}
+
+void time_stats_log(const time_stats_t *stats, int status, const char *command)
+{
+    if (!time_stats_log_enabled()) {
+        return;
+    }
+
+    fprintf(log_file, "%.3f %.3f %.3f %ld %ld %ld %d %s\n",
+            stats->real_ms, stats->user_ms, stats->sys_ms, stats->maxrss_kb,
+            stats->nvcsw, stats->nivcsw, status, command ? command : "");
+    fflush(log_file);
+}
@@ -0,0 +1,118 @@
+/*
+ * trace.c - Trace Event Format output (PICOBOX_TRACE)
+ *
+ * Events look like
+ *   {"name":"spawn","ph":"B","ts":1234.567,"pid":42,"tid":42,"args":{"detail":"ls"}},
+ * with ts in microseconds of CLOCK_MONOTONIC, so events written by
+ * different processes line up.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* clock_gettime(), O_CLOEXEC and syscall() */
+#endif
+
+#include "trace.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+int trace_fd = -1;
+
+void trace_init(void)
+{
+    const char *path = getenv("PICOBOX_TRACE");
+    int fd;
+
+    if (trace_fd >= 0 || !path || !path[0]) {
+        return;
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return;
+    }
+    if (write(fd, "[\n", 2) != 2) {
+        close(fd);
+        return;
+    }
+    trace_fd = fd;
+}
+
+static long thread_id(void)
+{
+#ifdef __linux__
+    return (long)syscall(SYS_gettid);
+#elif defined(__APPLE__)
+    uint64_t tid;
+    pthread_threadid_np(NULL, &tid);
+    return (long)tid;
+#else
+    return (long)getpid();
+#endif
+}
+
+/*
+ * Append s to buf as a JSON string body (quotes and control characters
+ * escaped, truncated to fit)
+ */
+static size_t json_escape(char *buf, size_t size, const char *s)
+{
+    size_t len = 0;
+
+    for (; *s && len + 7 < size; s++) {
+        unsigned char c = (unsigned char)*s;
+
+        if (c == '"' || c == '\\') {
+            buf[len++] = '\\';
+            buf[len++] = (char)c;
+        } else if (c < 0x20) {
+            len += (size_t)snprintf(buf + len, size - len, "\\u%04x", c);
+        } else {
+            buf[len++] = (char)c;
+        }
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+void trace_event(const char *name, char phase, const char *detail)
+{
+    char line[512];         /* Fits any event: name is a literal, detail <= 255 */
+    char escaped[256];
+    struct timespec now;
+    int len;
+
+    if (trace_fd < 0) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    len = snprintf(line, sizeof(line),
+                   "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%ld,\"tid\":%ld",
+                   name, phase, now.tv_sec * 1e6 + now.tv_nsec / 1e3,
+                   (long)getpid(), thread_id());
+    if (phase == 'i') {
+        len += snprintf(line + len, sizeof(line) - len, ",\"s\":\"t\"");
+    }
+    if (detail) {
+        json_escape(escaped, sizeof(escaped), detail);
+        len += snprintf(line + len, sizeof(line) - len,
+                        ",\"args\":{\"detail\":\"%s\"}", escaped);
+    }
+    len += snprintf(line + len, sizeof(line) - len, "},\n");
+
+    /* One write per event: O_APPEND keeps concurrent writers' lines whole */
+    (void)!write(trace_fd, line, (size_t)len);
+}
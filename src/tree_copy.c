@@ -0,0 +1,243 @@
+/*
+ * tree_copy.c - Parallel recursive copy
+ *
+ * The source is walked in parallel (walk.h) with files handed out too,
+ * since each is real work. A directory's walk data holds its
+ * destination: created and opened at the pre-order visit, before any
+ * entry of it is visited, and given its final permissions and closed
+ * at the post-order one, once everything in it has been copied.
+ * Destination paths are only put together to report an error.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* The *at() calls */
+#endif
+
+#include "tree_copy.h"
+#include "utils.h"
+#include "walk.h"
+#include "work_pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+/*
+ * Copying waits on the disk more than on the CPU: use at least
+ * TC_MIN_WORKERS threads, but not so many that a slow disk thrashes
+ */
+#define TC_MIN_WORKERS 4
+#define TC_MAX_WORKERS 16
+
+/* Walk data of a source directory */
+typedef struct tc_dir {
+    int dest_fd;
+    int restore;              /* Created without owner rwx: put mode back */
+    mode_t mode;
+} tc_dir_t;
+
+typedef struct tree_copy {
+    const char *prog;
+    size_t src_len;           /* Of the source root */
+    int dest_dirfd;
+    const char *dest_root;
+    dev_t dest_dev;           /* The top destination, never to be copied */
+    ino_t dest_ino;
+    atomic_int failed;
+} tree_copy_t;
+
+static void tc_report(tree_copy_t *t, const char *path, const char *msg)
+{
+    fprintf(stderr, "%s: %s: %s\n", t->prog, path, msg);
+    atomic_store(&t->failed, 1);
+}
+
+/* Report err on e's source path */
+static void tc_error(tree_copy_t *t, const walk_entry_t *e, int err)
+{
+    tc_report(t, e->path, strerror(err));
+}
+
+/* Report err on e's destination path */
+static void tc_dest_error(tree_copy_t *t, const walk_entry_t *e, int err)
+{
+    char path[PATH_MAX];
+    const char *rest = e->path + t->src_len;
+    size_t dlen = strlen(t->dest_root);
+    int slash = *rest && *rest != '/' && dlen > 0 && t->dest_root[dlen - 1] != '/';
+
+    snprintf(path, sizeof(path), "%s%s%s", t->dest_root, slash ? "/" : "", rest);
+    tc_report(t, path, strerror(err));
+}
+
+/* Create (or open) the destination of directory e */
+static int tc_dir_enter(tree_copy_t *t, const walk_entry_t *e)
+{
+    const tc_dir_t *parent = e->parent_data;
+    tc_dir_t *d = e->data;
+    int dest_dirfd = parent ? parent->dest_fd : t->dest_dirfd;
+    const char *dest = parent ? e->name : t->dest_root;
+    int nofollow = parent ? O_NOFOLLOW : 0;
+    struct stat st;
+    int made;
+
+    if (e->st) {
+        st = *e->st;
+    } else if (fstat(e->fd, &st) != 0) {
+        tc_error(t, e, errno);
+        return WALK_SKIP;
+    }
+    if (parent && st.st_dev == t->dest_dev && st.st_ino == t->dest_ino) {
+        tc_report(t, e->path, "cannot copy a directory into itself");
+        return WALK_SKIP;
+    }
+
+    made = mkdirat(dest_dirfd, dest, st.st_mode & 07777) == 0;
+    if (!made && errno != EEXIST) {
+        tc_dest_error(t, e, errno);
+        return WALK_SKIP;
+    }
+    d->dest_fd = openat(dest_dirfd, dest, O_RDONLY | O_DIRECTORY | O_CLOEXEC | nofollow);
+    if (d->dest_fd < 0) {
+        tc_dest_error(t, e, errno);
+        return WALK_SKIP;
+    }
+
+    /* Keep a new directory writable until its entries are in */
+    if (made && fstat(d->dest_fd, &st) == 0 && (st.st_mode & S_IRWXU) != S_IRWXU &&
+        fchmod(d->dest_fd, (st.st_mode & 07777) | S_IRWXU) == 0) {
+        d->mode = st.st_mode & 07777;
+        d->restore = 1;
+    }
+    if (!parent && fstat(d->dest_fd, &st) == 0) {
+        t->dest_dev = st.st_dev;
+        t->dest_ino = st.st_ino;
+    }
+    return WALK_CONTINUE;
+}
+
+static void tc_copy_link(tree_copy_t *t, const walk_entry_t *e, int dest_fd)
+{
+    char target[PATH_MAX];
+    ssize_t n = readlinkat(e->dirfd, e->name, target, sizeof(target) - 1);
+
+    if (n < 0) {
+        tc_error(t, e, errno);
+        return;
+    }
+    target[n] = '\0';
+
+    /* Replace whatever is there, as a file copy would */
+    if (symlinkat(target, dest_fd, e->name) != 0 &&
+        (errno != EEXIST || unlinkat(dest_fd, e->name, 0) != 0 ||
+         symlinkat(target, dest_fd, e->name) != 0)) {
+        tc_dest_error(t, e, errno);
+    }
+}
+
+static void tc_copy_leaf(tree_copy_t *t, const walk_entry_t *e)
+{
+    const tc_dir_t *parent = e->parent_data;
+    struct stat st;
+
+    /* A top that is not a directory: a link here is one that dangles */
+    if (!parent) {
+        if (e->type == WALK_T_LNK) {
+            tc_error(t, e, ENOENT);
+        } else if (copy_file_at(e->dirfd, e->name, t->dest_dirfd, t->dest_root,
+                                (mode_t)-1) < 0) {
+            tc_dest_error(t, e, errno);
+        }
+        return;
+    }
+
+    if (e->type == WALK_T_REG) {
+        if (copy_file_at(e->dirfd, e->name, parent->dest_fd, e->name, (mode_t)-1) < 0) {
+            tc_dest_error(t, e, errno);
+        }
+        return;
+    }
+    if (e->type == WALK_T_LNK) {
+        tc_copy_link(t, e, parent->dest_fd);
+        return;
+    }
+
+    if (e->st) {
+        st = *e->st;
+    } else if (fstatat(e->dirfd, e->name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        tc_error(t, e, errno);
+        return;
+    }
+    if (S_ISFIFO(st.st_mode)) {
+        if (mkfifoat(parent->dest_fd, e->name, st.st_mode & 07777) != 0 && errno != EEXIST) {
+            tc_dest_error(t, e, errno);
+        }
+    } else {
+        tc_report(t, e->path, "special file not copied");
+    }
+}
+
+static int tc_visit(const walk_entry_t *e, void *arg)
+{
+    tree_copy_t *t = arg;
+    tc_dir_t *d = e->data;
+
+    switch (e->visit) {
+    case WALK_PRE:
+        return tc_dir_enter(t, e);
+    case WALK_POST:
+        if (d->restore && fchmod(d->dest_fd, d->mode) != 0) {
+            tc_dest_error(t, e, errno);
+        }
+        close(d->dest_fd);
+        break;
+    case WALK_LEAF:
+        tc_copy_leaf(t, e);
+        break;
+    default:
+        tc_error(t, e, e->error);
+        break;
+    }
+    return WALK_CONTINUE;
+}
+
+int tree_copy_at(int src_dirfd, const char *src, int dest_dirfd, const char *dest,
+                 const char *prog)
+{
+    tree_copy_t t;
+    walk_opts_t opts = {
+        WALK_PARALLEL | WALK_SPREAD | WALK_FOLLOW_ROOTS,
+        work_pool_default_workers(),
+        sizeof(tc_dir_t),
+        NULL
+    };
+
+    memset(&t, 0, sizeof(t));
+    t.prog = prog;
+    t.src_len = strlen(src);
+    t.dest_dirfd = dest_dirfd;
+    t.dest_root = dest;
+    atomic_init(&t.failed, 0);
+
+    if (opts.nworkers < TC_MIN_WORKERS) {
+        opts.nworkers = TC_MIN_WORKERS;
+    } else if (opts.nworkers > TC_MAX_WORKERS) {
+        opts.nworkers = TC_MAX_WORKERS;
+    }
+
+    if (walk(src_dirfd, &src, 1, &opts, tc_visit, &t) < 0) {
+        tc_report(&t, src, strerror(errno));
+        return -1;
+    }
+    return atomic_load(&t.failed) ? -1 : 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * tree_remove.c - Parallel recursive removal
+ *
+ * The walk (walk.h) lists directories in parallel; the thread listing
+ * a directory unlinks its files itself, since unlinks in one directory
+ * serialize on that directory in the kernel anyway. A directory is
+ * removed at its post-order visit, by whichever thread finishes the
+ * last thing in it. A failure below a directory marks it (its walk
+ * data), so the directories above are left in place quietly instead
+ * of each reporting "Directory not empty".
+ *
+ * With an io_uring to be had (batch_io.h) a directory's files are not
+ * unlinked one at a time: their names are kept in its walk data and
+ * unlinked TR_BATCH at a time on the worker's ring, the last of them
+ * at the post-order visit, just before the directory itself.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* unlinkat() */
+#endif
+
+#include "tree_remove.h"
+#include "batch_io.h"
+#include "walk.h"
+#include "work_pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Removal waits on the filesystem, not the CPU (as in tree_copy.c) */
+#define TR_MIN_WORKERS 4
+#define TR_MAX_WORKERS 16
+
+/* Files of a directory unlinked in one batch */
+#define TR_BATCH 128
+
+/* Files of a directory waiting to be unlinked */
+typedef struct tr_batch {
+    size_t n;
+    size_t len;
+    size_t cap;
+    char *buf;                /* The names, each NUL-terminated */
+    size_t off[TR_BATCH];     /* Where each starts in buf */
+} tr_batch_t;
+
+/* Walk data of a directory */
+typedef struct tr_dir {
+    atomic_int failed;        /* Something below stays: keep the directory */
+    const char *path;         /* The walker's copy, from its WALK_PRE */
+    tr_batch_t *batch;        /* Only with rings */
+} tr_dir_t;
+
+typedef struct tree_remove {
+    const char *prog;
+    batch_io_t **io;          /* One ring per worker, or NULL */
+    atomic_int failed;
+} tree_remove_t;
+
+/* Report err on path and keep directory d (and so its parents) */
+static void tr_report(tree_remove_t *t, tr_dir_t *d, const char *path, int err)
+{
+    fprintf(stderr, "%s: %s: %s\n", t->prog, path, strerror(err));
+    atomic_store(&t->failed, 1);
+    if (d) {
+        atomic_store(&d->failed, 1);
+    }
+}
+
+/* Report err for e and keep the directory it is in (and so its parents) */
+static void tr_error(tree_remove_t *t, const walk_entry_t *e, int err)
+{
+    tr_report(t, e->parent_data, e->path, err);
+}
+
+/* Unlink the files waiting in d, whose descriptor is dirfd */
+static void tr_flush(tree_remove_t *t, int worker, tr_dir_t *d, int dirfd)
+{
+    tr_batch_t *b = d->batch;
+    const char *names[TR_BATCH];
+    int err[TR_BATCH];
+    size_t i;
+
+    for (i = 0; i < b->n; i++) {
+        names[i] = b->buf + b->off[i];
+    }
+    batch_io_unlink(t->io[worker], dirfd, names, b->n, 0, err);
+
+    for (i = 0; i < b->n; i++) {
+        if (err[i] != 0 && err[i] != ENOENT) {
+            size_t plen = strlen(d->path);
+            int slash = plen > 0 && d->path[plen - 1] != '/';
+
+            fprintf(stderr, "%s: %s%s%s: %s\n", t->prog, d->path, slash ? "/" : "", names[i],
+                    strerror(err[i]));
+            atomic_store(&t->failed, 1);
+            atomic_store(&d->failed, 1);
+        }
+    }
+    b->n = 0;
+    b->len = 0;
+}
+
+/*
+ * Put file e in its directory's batch, unlinking the batch when full
+ * Returns: 0, or -1 if it has to be unlinked on its own
+ */
+static int tr_queue(tree_remove_t *t, const walk_entry_t *e)
+{
+    tr_dir_t *d = e->parent_data;
+    tr_batch_t *b = d->batch;
+    size_t nlen = strlen(e->name) + 1;
+
+    if (!b) {
+        b = d->batch = calloc(1, sizeof(tr_batch_t));
+        if (!b) {
+            return -1;
+        }
+    }
+    if (b->len + nlen > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 4096;
+        char *buf;
+
+        while (cap < b->len + nlen) {
+            cap *= 2;
+        }
+        buf = realloc(b->buf, cap);
+        if (!buf) {
+            return -1;
+        }
+        b->buf = buf;
+        b->cap = cap;
+    }
+    memcpy(b->buf + b->len, e->name, nlen);
+    b->off[b->n++] = b->len;
+    b->len += nlen;
+
+    if (b->n == TR_BATCH) {
+        tr_flush(t, e->worker, d, e->dirfd);
+    }
+    return 0;
+}
+
+static int tr_visit(const walk_entry_t *e, void *arg)
+{
+    tree_remove_t *t = arg;
+    tr_dir_t *d = e->data;
+    tr_dir_t *parent = e->parent_data;
+
+    switch (e->visit) {
+    case WALK_ERROR:
+        /* Gone already is as good as removed, below the top */
+        if (e->error != ENOENT || e->depth == 0) {
+            tr_error(t, e, e->error);
+            if (d) {
+                atomic_store(&d->failed, 1);
+            }
+        }
+        break;
+    case WALK_PRE:
+        d->path = e->path;
+        break;
+    case WALK_LEAF:
+        if (t->io && parent && tr_queue(t, e) == 0) {
+            break;
+        }
+        if (unlinkat(e->dirfd, e->name, 0) != 0 && errno != ENOENT) {
+            tr_error(t, e, errno);
+        }
+        break;
+    case WALK_POST:
+        if (d->batch) {
+            tr_flush(t, e->worker, d, e->fd);
+            free(d->batch->buf);
+            free(d->batch);
+        }
+        if (atomic_load(&d->failed)) {
+            if (parent) {
+                atomic_store(&parent->failed, 1);
+            }
+        } else if (unlinkat(e->dirfd, e->name, AT_REMOVEDIR) != 0) {
+            tr_error(t, e, errno);
+        }
+        break;
+    default:
+        break;
+    }
+    return WALK_CONTINUE;
+}
+
+int tree_remove_at(int dirfd, const char *path, const char *prog)
+{
+    tree_remove_t t;
+    walk_opts_t opts = { WALK_PARALLEL, work_pool_default_workers(), sizeof(tr_dir_t), NULL };
+    int ret;
+    int i;
+
+    t.prog = prog;
+    t.io = NULL;
+    atomic_init(&t.failed, 0);
+
+    if (opts.nworkers < TR_MIN_WORKERS) {
+        opts.nworkers = TR_MIN_WORKERS;
+    } else if (opts.nworkers > TR_MAX_WORKERS) {
+        opts.nworkers = TR_MAX_WORKERS;
+    }
+
+    /* Rings for every worker, or none */
+    t.io = calloc((size_t)opts.nworkers, sizeof(batch_io_t *));
+    for (i = 0; t.io && i < opts.nworkers; i++) {
+        t.io[i] = batch_io_create();
+        if (!t.io[i]) {
+            while (i-- > 0) {
+                batch_io_destroy(t.io[i]);
+            }
+            free(t.io);
+            t.io = NULL;
+        }
+    }
+
+    ret = walk(dirfd, &path, 1, &opts, tr_visit, &t);
+    if (ret < 0) {
+        fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+    }
+    for (i = 0; t.io && i < opts.nworkers; i++) {
+        batch_io_destroy(t.io[i]);
+    }
+    free(t.io);
+    if (ret < 0) {
+        return -1;
+    }
+    return atomic_load(&t.failed) ? -1 : 0;
+}
@@ -1,4 +1,9 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* copy_file_range(), SEEK_DATA/SEEK_HOLE, strdup(), memrchr() */
+#endif
+
 #include "utils.h"
+#include "io_stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,6 +13,13 @@
 #include <errno.h>
 #include <ctype.h>
 #include <libgen.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>      /* FICLONE */
+#endif
+#ifdef __APPLE__
+#include <sys/clonefile.h>
+#endif
 
 /* ===== Error Handling Functions ===== */
 
@@ -88,6 +100,22 @@ char *trim_whitespace(char *str)
     return str;
 }
 
+void *mem_rchr(const void *s, int c, size_t n)
+{
+#if defined(__GLIBC__)
+    return memrchr(s, c, n);
+#else
+    const unsigned char *p = (const unsigned char *)s + n;
+
+    while (p > (const unsigned char *)s) {
+        if (*--p == (unsigned char)c) {
+            return (void *)p;
+        }
+    }
+    return NULL;
+#endif
+}
+
 
 /* ===== Path Manipulation ===== */
 
@@ -187,49 +215,440 @@ int file_exists(const char *path)
     return access(path, F_OK) == 0;
 }
 
-// copy data loop is not correct
-ssize_t copy_file(const char *src, const char *dest)
+int stream_input_pending(FILE *fp)
+{
+#if defined(__GLIBC__)
+    return fp->_IO_read_ptr < fp->_IO_read_end;
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    return fp->_r > 0;
+#else
+    (void)fp;
+    return 1;
+#endif
+}
+
+/* Size of each copy_file_range() request and of the fallback buffer */
+#define COPY_CHUNK (1024 * 1024)
+
+/*
+ * Copy bytes [off, end) from src_fd to the same offsets of dest_fd:
+ * copy_file_range() while the kernel takes it, then pread()/pwrite()
+ * Returns: 0, or -1 on error
+ */
+static int copy_range(int src_fd, int dest_fd, off_t off, off_t end, char **buf)
+{
+#ifdef __linux__
+    while (off < end && *buf == NULL) {
+        off_t in = off, out = off;
+        size_t want = end - off < COPY_CHUNK ? (size_t)(end - off) : COPY_CHUNK;
+        ssize_t n = copy_file_range(src_fd, &in, dest_fd, &out, want, 0);
+
+        IO_STATS_READ(n);
+        IO_STATS_WRITE(n);
+        if (n > 0) {
+            off += n;
+            continue;
+        }
+        if (n == 0) {
+            return 0;   /* Source shrank */
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        /* Not for this pair (EXDEV on old kernels, EINVAL, ENOSYS, ...) */
+        if (errno != EXDEV && errno != EINVAL && errno != ENOSYS &&
+            errno != EOPNOTSUPP && errno != ETXTBSY) {
+            return -1;
+        }
+        break;
+    }
+#endif
+
+    while (off < end) {
+        size_t want = end - off < COPY_CHUNK ? (size_t)(end - off) : COPY_CHUNK;
+        ssize_t n;
+        ssize_t w;
+
+        if (*buf == NULL && (*buf = malloc(COPY_CHUNK)) == NULL) {
+            return -1;
+        }
+        n = pread(src_fd, *buf, want, off);
+        IO_STATS_READ(n);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n < 0 ? -1 : 0;
+        }
+        for (w = 0; w < n; ) {
+            ssize_t k = pwrite(dest_fd, *buf + w, (size_t)(n - w), off + w);
+
+            IO_STATS_WRITE(k);
+            if (k < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            w += k;
+        }
+        off += n;
+    }
+    return 0;
+}
+
+/*
+ * Copy a regular file of size bytes, data segments only: holes found
+ * with SEEK_DATA/SEEK_HOLE are left unwritten and stay holes, and the
+ * final ftruncate() restores a hole at the end
+ * Returns: 0, or -1 on error
+ */
+static int copy_regular(int src_fd, int dest_fd, off_t size)
+{
+    char *buf = NULL;
+    off_t off = 0;
+    int ret = 0;
+
+    while (off < size && ret == 0) {
+        off_t data = off, hole = size;
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+        data = lseek(src_fd, off, SEEK_DATA);
+        if (data < 0) {
+            if (errno == ENXIO) {
+                break;          /* Only a hole is left */
+            }
+            data = off;         /* Not supported: all data */
+        } else {
+            hole = lseek(src_fd, data, SEEK_HOLE);
+            if (hole < 0 || hole > size) {
+                hole = size;
+            }
+        }
+#endif
+        ret = copy_range(src_fd, dest_fd, data, hole, &buf);
+        off = hole;
+    }
+
+    if (ret == 0 && ftruncate(dest_fd, size) != 0) {
+        ret = -1;
+    }
+    free(buf);
+    return ret;
+}
+
+/*
+ * Anything else (a FIFO, a device): read() until end of input
+ * Returns: bytes copied, or -1 on error
+ */
+static ssize_t copy_stream(int src_fd, int dest_fd)
+{
+    char *buf = malloc(COPY_CHUNK);
+    ssize_t total = 0;
+    ssize_t n;
+
+    if (!buf) {
+        return -1;
+    }
+    while ((n = read(src_fd, buf, COPY_CHUNK)) != 0) {
+        ssize_t w;
+
+        IO_STATS_READ(n);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            total = -1;
+            break;
+        }
+        for (w = 0; w < n; ) {
+            ssize_t k = write(dest_fd, buf + w, (size_t)(n - w));
+
+            IO_STATS_WRITE(k);
+            if (k < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                free(buf);
+                return -1;
+            }
+            w += k;
+        }
+        total += n;
+    }
+    free(buf);
+    return total;
+}
+
+/*
+ * Fastest first: a reflink sharing the source's blocks (FICLONE on
+ * btrfs/XFS, clonefile() on APFS), then an in-kernel copy, then a
+ * buffer; the last two skip holes
+ */
+ssize_t copy_file_at(int src_dirfd, const char *src, int dest_dirfd, const char *dest,
+                     mode_t mode)
 {
     int src_fd = -1;
     int dest_fd = -1;
-    ssize_t total_bytes = 0;
-    ssize_t bytes_read;
-    char buffer[8192];
+    struct stat st;
+    ssize_t total;
+    int saved;
 
     /* Open source file */
-    src_fd = open(src, O_RDONLY);
+    src_fd = openat(src_dirfd, src, O_RDONLY | O_CLOEXEC);
+    IO_STATS_OPEN();
     if (src_fd < 0) {
         return -1;
     }
+    if (fstat(src_fd, &st) != 0) {
+        close(src_fd);
+        return -1;
+    }
+    if (mode == (mode_t)-1) {
+        mode = st.st_mode & 07777;
+    }
+
+#ifdef __APPLE__
+    /* Only creates: an existing dest is overwritten by the copy below */
+    if (S_ISREG(st.st_mode) && clonefileat(src_dirfd, src, dest_dirfd, dest, 0) == 0) {
+        close(src_fd);
+        return (ssize_t)st.st_size;
+    }
+#endif
 
     /* Open destination file */
-    dest_fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dest_fd = openat(dest_dirfd, dest, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    IO_STATS_OPEN();
     if (dest_fd < 0) {
         close(src_fd);
         return -1;
     }
 
-    /* Copy data */
-    while ((bytes_read = read(src_fd, buffer, sizeof(buffer))) > 0) {
-        ssize_t bytes_written = write(dest_fd, buffer, bytes_read);
-        if (bytes_written != bytes_read) {
-            close(src_fd);
-            close(dest_fd);
-            return -1;
+    if (S_ISREG(st.st_mode)) {
+        total = (ssize_t)st.st_size;
+#ifdef FICLONE
+        if (ioctl(dest_fd, FICLONE, src_fd) == 0) {
+            goto done;
+        }
+#endif
+        if (copy_regular(src_fd, dest_fd, st.st_size) != 0) {
+            total = -1;
         }
-        total_bytes += bytes_written;
+    } else {
+        total = copy_stream(src_fd, dest_fd);
     }
 
-    if (bytes_read < 0) {
-        close(src_fd);
-        close(dest_fd);
+#ifdef FICLONE
+done:
+#endif
+    saved = errno;
+    close(src_fd);
+    if (close(dest_fd) != 0 && total >= 0) {
         return -1;
     }
+    errno = saved;
+    return total;
+}
 
-    close(src_fd);
-    close(dest_fd);
+ssize_t copy_file(const char *src, const char *dest)
+{
+    return copy_file_at(AT_FDCWD, src, AT_FDCWD, dest, 0644);
+}
+
+/* ===== Line Reading ===== */
+
+/* Initial buffer size and the least free space a fill asks for */
+#define LINE_READER_BLOCK (128 * 1024)
+
+static int line_reader_init(line_reader_t *lr, int fd, FILE *fp)
+{
+    memset(lr, 0, sizeof(*lr));
+    lr->fd = fd;
+    lr->fp = fp;
+    lr->delim = '\n';
+    lr->cap = LINE_READER_BLOCK;
+    lr->buf = malloc(lr->cap);
+    return lr->buf ? 0 : -1;
+}
+
+int line_reader_init_fd(line_reader_t *lr, int fd)
+{
+    return line_reader_init(lr, fd, NULL);
+}
+
+int line_reader_init_stream(line_reader_t *lr, FILE *fp)
+{
+    return line_reader_init(lr, -1, fp);
+}
+
+void line_reader_set_delim(line_reader_t *lr, int delim)
+{
+    lr->delim = (unsigned char)delim;
+}
+
+/*
+ * Read more input after buf[end], first making room: move what is
+ * left to the front, or grow the buffer if a partial line fills it
+ * Returns: bytes read (0 at end of input), or -1 on error
+ */
+static ssize_t line_reader_fill(line_reader_t *lr)
+{
+    ssize_t n;
+
+    if (lr->cap - lr->end < LINE_READER_BLOCK) {
+        if (lr->start > 0) {
+            memmove(lr->buf, lr->buf + lr->start, lr->end - lr->start);
+            lr->end -= lr->start;
+            lr->scanned -= lr->start;
+            lr->start = 0;
+        }
+        if (lr->cap - lr->end < LINE_READER_BLOCK) {
+            char *bigger = realloc(lr->buf, lr->cap * 2);
+
+            if (!bigger) {
+                return -1;
+            }
+            lr->buf = bigger;
+            lr->cap *= 2;
+        }
+    }
+
+    if (lr->src_read) {
+        n = lr->src_read(lr->src, lr->buf + lr->end, lr->cap - lr->end);
+    } else if (lr->fd >= 0) {
+        do {
+            n = read(lr->fd, lr->buf + lr->end, lr->cap - lr->end);
+            IO_STATS_READ(n);
+        } while (n < 0 && errno == EINTR);
+    } else if (lr->delim != '\n') {
+        /* A block: NUL-separated input is written by programs, not typed */
+        n = (ssize_t)fread(lr->buf + lr->end, 1, lr->cap - lr->end, lr->fp);
+        if (n == 0 && ferror(lr->fp)) {
+            n = -1;
+        }
+    } else {
+        /* One line, taking the stream's lock once */
+        char *p = lr->buf + lr->end;
+        char *limit = lr->buf + lr->cap;
+        int c = 0;
+
+        flockfile(lr->fp);
+        while (p < limit && (c = getc_unlocked(lr->fp)) != EOF) {
+            *p++ = (char)c;
+            if (c == '\n') {
+                break;
+            }
+        }
+        n = p - (lr->buf + lr->end);
+        if (n == 0 && ferror(lr->fp)) {
+            n = -1;
+        }
+        funlockfile(lr->fp);
+    }
+
+    if (n > 0) {
+        lr->end += (size_t)n;
+    } else if (n == 0) {
+        lr->eof = 1;
+    }
+    return n;
+}
+
+ssize_t line_reader_peek(line_reader_t *lr, size_t n, const char **data)
+{
+    /* A stream fill stops at a newline, and the next line is not taken */
+    while (lr->end - lr->start < n && !lr->eof &&
+           !memchr(lr->buf + lr->start, '\n', lr->end - lr->start)) {
+        if (line_reader_fill(lr) < 0) {
+            return -1;
+        }
+    }
+    *data = lr->buf + lr->start;
+    return (ssize_t)(lr->end - lr->start);
+}
 
-    return total_bytes;
+void line_reader_set_source(line_reader_t *lr, void *src,
+                            ssize_t (*read_fn)(void *src, char *buf, size_t len),
+                            void (*close_fn)(void *src))
+{
+    lr->src = src;
+    lr->src_read = read_fn;
+    lr->src_close = close_fn;
+    lr->start = lr->end = lr->scanned = 0;
+    lr->eof = 0;
+}
+
+int line_reader_next(line_reader_t *lr, const char **line, size_t *len)
+{
+    for (;;) {
+        char *nl = memchr(lr->buf + lr->scanned, lr->delim, lr->end - lr->scanned);
+
+        if (nl) {
+            *line = lr->buf + lr->start;
+            *len = (size_t)(nl + 1 - *line);
+            lr->start += *len;
+            lr->scanned = lr->start;
+            return 1;
+        }
+        lr->scanned = lr->end;
+
+        if (lr->eof) {
+            if (lr->end == lr->start) {
+                return 0;
+            }
+            /* Last line, without a newline */
+            *line = lr->buf + lr->start;
+            *len = lr->end - lr->start;
+            lr->start = lr->scanned = lr->end;
+            return 1;
+        }
+        if (line_reader_fill(lr) < 0) {
+            return -1;
+        }
+    }
+}
+
+int line_reader_lines(line_reader_t *lr, const char **data, size_t *len)
+{
+    for (;;) {
+        size_t i;
+
+        /* Only bytes not yet scanned can hold the last line end */
+        for (i = lr->end; i > lr->scanned; i--) {
+            if ((unsigned char)lr->buf[i - 1] == lr->delim) {
+                *data = lr->buf + lr->start;
+                *len = i - lr->start;
+                lr->start = lr->scanned = i;
+                return 1;
+            }
+        }
+        lr->scanned = lr->end;
+
+        if (lr->eof) {
+            if (lr->end == lr->start) {
+                return 0;
+            }
+            *data = lr->buf + lr->start;
+            *len = lr->end - lr->start;
+            lr->start = lr->scanned = lr->end;
+            return 1;
+        }
+        if (line_reader_fill(lr) < 0) {
+            return -1;
+        }
+    }
+}
+
+void line_reader_free(line_reader_t *lr)
+{
+    if (lr->src_close) {
+        lr->src_close(lr->src);
+    }
+    lr->src = NULL;
+    lr->src_read = NULL;
+    lr->src_close = NULL;
+    free(lr->buf);
+    lr->buf = NULL;
 }
 
 
@@ -1,13 +1,64 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* strdup() */
+#endif
+
 #include "var_table.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/*
+ * Both the variable tables and the name pool below are chained hash
+ * tables with incremental rehash. When a table's load factor passes 1,
+ * a bucket array twice as big becomes current and the old one is
+ * drained REHASH_STEPS buckets at a time by later writes. Until it is
+ * empty, lookups check the old bucket as well. Reads never move
+ * entries, so concurrent readers stay safe.
+ */
+
+#define VAR_TABLE_DEFAULT_SIZE 16
+#define REHASH_STEPS 4            /* Old buckets moved per write */
+
+/* Chain link shared by name-pool and variable entries */
+typedef struct hnode {
+    struct hnode *next;
+    size_t hash;
+} hnode_t;
+
+typedef struct htab {
+    hnode_t **buckets;            /* Current array (size is a power of 2) */
+    size_t size;
+    hnode_t **old_buckets;        /* Array being drained, or NULL */
+    size_t old_size;
+    size_t rehash_pos;            /* Next old bucket to move */
+    size_t count;
+} htab_t;
+
+/* An interned name; the string is stored only once for all tables */
+typedef struct intern_name {
+    hnode_t node;
+    char name[];
+} intern_name_t;
+
+/* Variable entry in hash table (linked list for collision resolution) */
+typedef struct var_entry {
+    hnode_t node;
+    const char *name;             /* Interned */
+    char *value;
+} var_entry_t;
+
+struct var_table {
+    htab_t tab;
+};
+
+/* Pool of interned names (never shrinks: names are tiny and reused) */
+static htab_t name_pool;
+
 /* djb2 hash function */
-static unsigned long hash(const char *str)
+static size_t hash(const char *str)
 {
-    unsigned long h = 5381;
+    size_t h = 5381;
     int c;
 
     while ((c = *str++)) {
@@ -17,6 +68,165 @@ static unsigned long hash(const char *str)
     return h;
 }
 
+/* ---- Incremental-rehash hash table ---- */
+
+static int htab_init(htab_t *t, size_t size)
+{
+    size_t n = VAR_TABLE_DEFAULT_SIZE;
+
+    while (n < size) {
+        n *= 2;
+    }
+
+    memset(t, 0, sizeof(*t));
+    t->buckets = calloc(n, sizeof(hnode_t *));
+    if (!t->buckets) {
+        perror("calloc");
+        return -1;
+    }
+    t->size = n;
+    return 0;
+}
+
+/* Move up to `steps` non-empty old buckets into the current array */
+static void htab_rehash_step(htab_t *t, size_t steps)
+{
+    while (t->old_buckets && steps > 0) {
+        hnode_t *node = t->old_buckets[t->rehash_pos];
+
+        while (node) {
+            hnode_t *next = node->next;
+            size_t index = node->hash & (t->size - 1);
+            node->next = t->buckets[index];
+            t->buckets[index] = node;
+            node = next;
+        }
+        t->old_buckets[t->rehash_pos] = NULL;
+
+        if (++t->rehash_pos == t->old_size) {
+            free(t->old_buckets);
+            t->old_buckets = NULL;
+        }
+        steps--;
+    }
+}
+
+/* Start moving to a bigger array once the table is full */
+static void htab_maybe_grow(htab_t *t)
+{
+    hnode_t **bigger;
+
+    if (t->count <= t->size) {
+        return;
+    }
+
+    /* Growing faster than we drain: finish the previous move first */
+    htab_rehash_step(t, t->old_buckets ? t->old_size : 0);
+
+    bigger = calloc(t->size * 2, sizeof(hnode_t *));
+    if (!bigger) {
+        return;  /* Keep working at a higher load factor */
+    }
+
+    t->old_buckets = t->buckets;
+    t->old_size = t->size;
+    t->rehash_pos = 0;
+    t->buckets = bigger;
+    t->size *= 2;
+}
+
+/*
+ * Find the link pointing at the node matching (hash, key)
+ * Returns: pointer to that link (so the caller can unlink), or NULL
+ */
+static hnode_t **htab_find(htab_t *t, size_t h,
+                           int (*match)(const hnode_t *node, const void *key),
+                           const void *key)
+{
+    hnode_t **link;
+
+    if (t->old_buckets) {
+        for (link = &t->old_buckets[h & (t->old_size - 1)]; *link; link = &(*link)->next) {
+            if ((*link)->hash == h && match(*link, key)) {
+                return link;
+            }
+        }
+    }
+
+    for (link = &t->buckets[h & (t->size - 1)]; *link; link = &(*link)->next) {
+        if ((*link)->hash == h && match(*link, key)) {
+            return link;
+        }
+    }
+
+    return NULL;
+}
+
+static void htab_insert(htab_t *t, hnode_t *node)
+{
+    size_t index = node->hash & (t->size - 1);
+
+    node->next = t->buckets[index];
+    t->buckets[index] = node;
+    t->count++;
+    htab_maybe_grow(t);
+}
+
+/* ---- Interned names ---- */
+
+static int match_name(const hnode_t *node, const void *key)
+{
+    return strcmp(((const intern_name_t *)node)->name, key) == 0;
+}
+
+/* Interned copy of name if it exists, else NULL */
+static const intern_name_t *intern_find(const char *name, size_t h)
+{
+    hnode_t **link;
+
+    if (!name_pool.buckets) {
+        return NULL;
+    }
+    link = htab_find(&name_pool, h, match_name, name);
+    return link ? (const intern_name_t *)*link : NULL;
+}
+
+/* Interned copy of name, adding it to the pool if needed */
+static const intern_name_t *intern(const char *name, size_t h)
+{
+    const intern_name_t *found = intern_find(name, h);
+    intern_name_t *entry;
+    size_t len;
+
+    if (found) {
+        return found;
+    }
+
+    if (!name_pool.buckets && htab_init(&name_pool, 0) < 0) {
+        return NULL;
+    }
+
+    len = strlen(name) + 1;
+    entry = malloc(sizeof(intern_name_t) + len);
+    if (!entry) {
+        perror("malloc");
+        return NULL;
+    }
+    memcpy(entry->name, name, len);
+    entry->node.hash = h;
+
+    htab_rehash_step(&name_pool, REHASH_STEPS);
+    htab_insert(&name_pool, &entry->node);
+    return entry;
+}
+
+/* ---- Variable tables ---- */
+
+static int match_interned(const hnode_t *node, const void *key)
+{
+    return ((const var_entry_t *)node)->name == key;
+}
+
 var_table_t *var_table_create(size_t size)
 {
     var_table_t *table = malloc(sizeof(var_table_t));
@@ -25,11 +235,7 @@ var_table_t *var_table_create(size_t size)
         return NULL;
     }
 
-    table->size = size;
-    table->count = 0;
-    table->buckets = calloc(size, sizeof(var_entry_t *));
-    if (!table->buckets) {
-        perror("calloc");
+    if (htab_init(&table->tab, size) < 0) {
         free(table);
         return NULL;
     }
@@ -37,74 +243,83 @@ var_table_t *var_table_create(size_t size)
     return table;
 }
 
+static void free_chain(hnode_t *node)
+{
+    while (node) {
+        hnode_t *next = node->next;
+        free(((var_entry_t *)node)->value);
+        free(node);
+        node = next;
+    }
+}
+
 void var_table_destroy(var_table_t *table)
 {
     if (!table) {
         return;
     }
 
-    for (size_t i = 0; i < table->size; i++) {
-        var_entry_t *entry = table->buckets[i];
-        while (entry) {
-            var_entry_t *next = entry->next;
-            free(entry->name);
-            free(entry->value);
-            free(entry);
-            entry = next;
+    for (size_t i = 0; i < table->tab.size; i++) {
+        free_chain(table->tab.buckets[i]);
+    }
+    if (table->tab.old_buckets) {
+        for (size_t i = table->tab.rehash_pos; i < table->tab.old_size; i++) {
+            free_chain(table->tab.old_buckets[i]);
         }
+        free(table->tab.old_buckets);
     }
 
-    free(table->buckets);
+    free(table->tab.buckets);
     free(table);
 }
 
+/* Entry for an interned name, or NULL */
+static var_entry_t *find_entry(var_table_t *table, const intern_name_t *iname)
+{
+    hnode_t **link = htab_find(&table->tab, iname->node.hash, match_interned, iname->name);
+    return link ? (var_entry_t *)*link : NULL;
+}
+
 int var_table_set(var_table_t *table, const char *name, const char *value)
 {
     if (!table || !name || !value) {
         return -1;
     }
 
-    unsigned long h = hash(name);
-    size_t index = h % table->size;
+    const intern_name_t *iname = intern(name, hash(name));
+    if (!iname) {
+        return -1;
+    }
+
+    char *new_value = strdup(value);
+    if (!new_value) {
+        perror("strdup");
+        return -1;
+    }
+
+    htab_rehash_step(&table->tab, REHASH_STEPS);
 
     /* Check if variable already exists */
-    var_entry_t *entry = table->buckets[index];
-    while (entry) {
-        if (strcmp(entry->name, name) == 0) {
-            /* Update existing value */
-            char *new_value = strdup(value);
-            if (!new_value) {
-                perror("strdup");
-                return -1;
-            }
-            free(entry->value);
-            entry->value = new_value;
-            return 0;
-        }
-        entry = entry->next;
+    var_entry_t *entry = find_entry(table, iname);
+    if (entry) {
+        /* Update existing value */
+        free(entry->value);
+        entry->value = new_value;
+        return 0;
     }
 
     /* Create new entry */
     entry = malloc(sizeof(var_entry_t));
     if (!entry) {
         perror("malloc");
+        free(new_value);
         return -1;
     }
 
-    entry->name = strdup(name);
-    entry->value = strdup(value);
-    if (!entry->name || !entry->value) {
-        perror("strdup");
-        free(entry->name);
-        free(entry->value);
-        free(entry);
-        return -1;
-    }
-
-    /* Insert at head of bucket */
-    entry->next = table->buckets[index];
-    table->buckets[index] = entry;
-    table->count++;
+    entry->node.hash = iname->node.hash;
+    entry->name = iname->name;
+    entry->value = new_value;
+    htab_insert(&table->tab, &entry->node);
     return 0;
 }
 
@@ -114,18 +329,14 @@ const char *var_table_get(var_table_t *table, const char *name)
         return NULL;
     }
 
-    unsigned long h = hash(name);
-    size_t index = h % table->size;
-
-    var_entry_t *entry = table->buckets[index];
-    while (entry) {
-        if (strcmp(entry->name, name) == 0) {
-            return entry->value;
-        }
-        entry = entry->next;
+    /* A name that was never interned was never set anywhere */
+    const intern_name_t *iname = intern_find(name, hash(name));
+    if (!iname) {
+        return NULL;
     }
 
-    return NULL;
+    var_entry_t *entry = find_entry(table, iname);
+    return entry ? entry->value : NULL;
 }
 
 int var_table_unset(var_table_t *table, const char *name)
@@ -134,22 +345,50 @@ int var_table_unset(var_table_t *table, const char *name)
         return -1;
     }
 
-    unsigned long h = hash(name);
-    size_t index = h % table->size;
+    const intern_name_t *iname = intern_find(name, hash(name));
+    if (!iname) {
+        return -1;
+    }
+
+    htab_rehash_step(&table->tab, REHASH_STEPS);
 
-    var_entry_t **ptr = &table->buckets[index];
-    while (*ptr) {
-        var_entry_t *entry = *ptr;
-        if (strcmp(entry->name, name) == 0) {
-            *ptr = entry->next;
-            free(entry->name);
-            free(entry->value);
-            free(entry);
-            table->count--;
-            return 0;
+    hnode_t **link = htab_find(&table->tab, iname->node.hash, match_interned, iname->name);
+    if (!link) {
+        return -1;
+    }
+
+    var_entry_t *entry = (var_entry_t *)*link;
+    *link = entry->node.next;
+    free(entry->value);
+    free(entry);
+    table->tab.count--;
+    return 0;
+}
+
+size_t var_table_count(const var_table_t *table)
+{
+    return table ? table->tab.count : 0;
+}
+
+void var_table_foreach(var_table_t *table,
+                       void (*callback)(const char *name, const char *value, void *userdata),
+                       void *userdata)
+{
+    if (!table || !callback) {
+        return;
+    }
+
+    if (table->tab.old_buckets) {
+        for (size_t i = table->tab.rehash_pos; i < table->tab.old_size; i++) {
+            for (hnode_t *node = table->tab.old_buckets[i]; node; node = node->next) {
+                callback(((var_entry_t *)node)->name, ((var_entry_t *)node)->value, userdata);
+            }
         }
-        ptr = &entry->next;
     }
 
-    return -1;
+    for (size_t i = 0; i < table->tab.size; i++) {
+        for (hnode_t *node = table->tab.buckets[i]; node; node = node->next) {
+            callback(((var_entry_t *)node)->name, ((var_entry_t *)node)->value, userdata);
+        }
+    }
 }
@@ -0,0 +1,228 @@
+/*
+ * work_pool.c - Work-stealing thread pool
+ *
+ * Queues are arrays guarded by their own mutex: the owner pushes and
+ * pops at the top, thieves take from the bottom. Contention is low
+ * because a worker only touches another's queue when its own is empty.
+ *
+ * queued counts items sitting in queues, pending those plus the ones
+ * being handled. A worker that finds nothing to steal sleeps on
+ * idle_cv until queued rises or pending reaches zero. It checks queued
+ * under idle_lock after announcing itself in sleepers, and a pusher
+ * raises queued before looking at sleepers, so a wakeup cannot be lost.
+ */
+
+#include "work_pool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct work_queue {
+    pthread_mutex_t lock;
+    void **items;
+    size_t head, tail, cap;   /* Items are items[head..tail) */
+} work_queue_t;
+
+struct work_pool {
+    int nworkers;
+    work_fn_t fn;
+    void *arg;
+    work_queue_t *queues;
+
+    atomic_size_t queued;
+    atomic_size_t pending;
+    atomic_int sleepers;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cv;
+};
+
+typedef struct worker_start {
+    work_pool_t *pool;
+    int worker;
+} worker_start_t;
+
+work_pool_t *work_pool_create(int nworkers, work_fn_t fn, void *arg)
+{
+    work_pool_t *pool;
+
+    if (nworkers < 1) {
+        nworkers = 1;
+    }
+
+    pool = calloc(1, sizeof(work_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+    pool->queues = calloc((size_t)nworkers, sizeof(work_queue_t));
+    if (!pool->queues) {
+        free(pool);
+        return NULL;
+    }
+
+    pool->nworkers = nworkers;
+    pool->fn = fn;
+    pool->arg = arg;
+    for (int i = 0; i < nworkers; i++) {
+        pthread_mutex_init(&pool->queues[i].lock, NULL);
+    }
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->sleepers, 0);
+    pthread_mutex_init(&pool->idle_lock, NULL);
+    pthread_cond_init(&pool->idle_cv, NULL);
+    return pool;
+}
+
+int work_pool_push(work_pool_t *pool, int worker, void *item)
+{
+    work_queue_t *q = &pool->queues[worker < 0 ? 0 : worker % pool->nworkers];
+
+    pthread_mutex_lock(&q->lock);
+    if (q->tail == q->cap) {
+        if (q->head > 0) {
+            /* Reuse the room thieves left at the bottom */
+            for (size_t i = q->head; i < q->tail; i++) {
+                q->items[i - q->head] = q->items[i];
+            }
+            q->tail -= q->head;
+            q->head = 0;
+        } else {
+            size_t cap = q->cap ? q->cap * 2 : 64;
+            void **items = realloc(q->items, cap * sizeof(void *));
+
+            if (!items) {
+                pthread_mutex_unlock(&q->lock);
+                return -1;
+            }
+            q->items = items;
+            q->cap = cap;
+        }
+    }
+    q->items[q->tail++] = item;
+    pthread_mutex_unlock(&q->lock);
+
+    atomic_fetch_add(&pool->pending, 1);
+    atomic_fetch_add(&pool->queued, 1);
+    if (atomic_load(&pool->sleepers) > 0) {
+        pthread_mutex_lock(&pool->idle_lock);
+        pthread_cond_signal(&pool->idle_cv);
+        pthread_mutex_unlock(&pool->idle_lock);
+    }
+    return 0;
+}
+
+/* Newest item of our own queue, or oldest of someone else's */
+static void *take(work_pool_t *pool, int worker)
+{
+    for (int k = 0; k < pool->nworkers; k++) {
+        work_queue_t *q = &pool->queues[(worker + k) % pool->nworkers];
+        void *item = NULL;
+
+        pthread_mutex_lock(&q->lock);
+        if (q->head < q->tail) {
+            item = k == 0 ? q->items[--q->tail] : q->items[q->head++];
+            if (q->head == q->tail) {
+                q->head = q->tail = 0;
+            }
+        }
+        pthread_mutex_unlock(&q->lock);
+
+        if (item) {
+            atomic_fetch_sub(&pool->queued, 1);
+            return item;
+        }
+    }
+    return NULL;
+}
+
+static void worker_loop(work_pool_t *pool, int worker)
+{
+    for (;;) {
+        void *item = take(pool, worker);
+
+        if (item) {
+            pool->fn(pool, worker, item, pool->arg);
+            if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+                /* That was the last one: wake everybody to finish */
+                pthread_mutex_lock(&pool->idle_lock);
+                pthread_cond_broadcast(&pool->idle_cv);
+                pthread_mutex_unlock(&pool->idle_lock);
+            }
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->idle_lock);
+        atomic_fetch_add(&pool->sleepers, 1);
+        while (atomic_load(&pool->queued) == 0 && atomic_load(&pool->pending) > 0) {
+            pthread_cond_wait(&pool->idle_cv, &pool->idle_lock);
+        }
+        atomic_fetch_sub(&pool->sleepers, 1);
+        pthread_mutex_unlock(&pool->idle_lock);
+
+        if (atomic_load(&pool->pending) == 0) {
+            return;
+        }
+    }
+}
+
+static void *worker_main(void *p)
+{
+    worker_start_t *start = p;
+
+    worker_loop(start->pool, start->worker);
+    return NULL;
+}
+
+void work_pool_run(work_pool_t *pool)
+{
+    pthread_t *threads = NULL;
+    worker_start_t *starts = NULL;
+    int started = 0;
+
+    if (pool->nworkers > 1) {
+        threads = malloc((size_t)pool->nworkers * sizeof(pthread_t));
+        starts = malloc((size_t)pool->nworkers * sizeof(worker_start_t));
+    }
+    if (threads && starts) {
+        for (int i = 1; i < pool->nworkers; i++) {
+            starts[i].pool = pool;
+            starts[i].worker = i;
+            if (pthread_create(&threads[started + 1], NULL, worker_main, &starts[i]) != 0) {
+                break;
+            }
+            started++;
+        }
+    }
+
+    worker_loop(pool, 0);
+
+    for (int i = 1; i <= started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    free(starts);
+}
+
+int work_pool_default_workers(void)
+{
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return ncpu > 0 ? (int)ncpu : 1;
+}
+
+void work_pool_destroy(work_pool_t *pool)
+{
+    if (!pool) {
+        return;
+    }
+    for (int i = 0; i < pool->nworkers; i++) {
+        pthread_mutex_destroy(&pool->queues[i].lock);
+        free(pool->queues[i].items);
+    }
+    pthread_mutex_destroy(&pool->idle_lock);
+    pthread_cond_destroy(&pool->idle_cv);
+    free(pool->queues);
+    free(pool);
+}
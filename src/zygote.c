@@ -0,0 +1,406 @@
+/*
+ * zygote.c - Pre-forked helper that launches external commands
+ *
+ *   shell ----- socketpair ----- zygote (forked at start-up, small heap)
+ *     ^                             |
+ *     |  waitpid()                  | clone(CLONE_PARENT)
+ *     +------------------------- command
+ *
+ * Each request is a zygote_req_t sent with SCM_RIGHTS carrying the
+ * command's stdin, stdout and stderr, followed by len bytes of
+ * NUL-terminated strings: cwd, program path, argc argv strings, envc
+ * environment strings. The zygote answers with a zygote_reply_t once
+ * the command has exec'd (or failed to).
+ *
+ * Only the process that started the zygote may use it: for anyone else
+ * (e.g. a forked subshell) the command would not be its own child.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* pipe2(), stpcpy(), CLONE_PARENT and syscall() */
+#endif
+
+#include "zygote.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+#define ZYGOTE_MAX_PAYLOAD (1u << 20)
+
+typedef struct zygote_req {
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t len;
+} zygote_req_t;
+
+typedef struct zygote_reply {
+    int32_t pid;            /* -1 if clone() failed */
+    int32_t err;            /* errno from exec (0 = running) */
+} zygote_reply_t;
+
+#ifdef __linux__
+
+static int zygote_fd = -1;       /* Shell's end of the socketpair */
+static pid_t zygote_owner = -1;  /* Process that started the zygote */
+
+/* Read exactly len bytes; returns 0, or -1 on error/EOF */
+static int read_full(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/*
+ * Receive one request header and its three fds (close-on-exec)
+ * Returns: 0 on success, -1 on EOF or a malformed request
+ */
+static int recv_req(int sock, zygote_req_t *req, int fds[3])
+{
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+    } control;
+    struct iovec iov = { req, sizeof(*req) };
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+
+    fds[0] = fds[1] = fds[2] = -1;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(3 * sizeof(int))) {
+            memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+        }
+    }
+
+    if (n > 0 && (size_t)n < sizeof(*req) &&
+        read_full(sock, (char *)req + n, sizeof(*req) - (size_t)n) == 0) {
+        n = sizeof(*req);
+    }
+
+    if (n != (ssize_t)sizeof(*req) || fds[0] < 0 || req->argc == 0 ||
+        req->len > ZYGOTE_MAX_PAYLOAD) {
+        for (int i = 0; i < 3; i++) {
+            if (fds[i] >= 0) {
+                close(fds[i]);
+            }
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Split the payload into cwd, path, argv and envp (pointers into it)
+ * Returns: 0 on success, -1 if the string count does not match
+ */
+static int split_payload(char *payload, const zygote_req_t *req, char **strs)
+{
+    char *p = payload;
+    char *end = payload + req->len;
+    uint32_t total = 2 + req->argc + req->envc;
+
+    for (uint32_t i = 0; i < total; i++) {
+        char *nul = memchr(p, '\0', end - p);
+        if (!nul) {
+            return -1;
+        }
+        strs[i] = p;
+        p = nul + 1;
+    }
+    return 0;
+}
+
+/*
+ * Start one command as a child of the shell
+ * strs: cwd, path, argv..., NULL, envp..., NULL
+ */
+static zygote_reply_t launch(char **strs, const zygote_req_t *req, const int fds[3])
+{
+    zygote_reply_t reply = { -1, 0 };
+    char **argv = &strs[2];
+    char **envp = &strs[3 + req->argc];
+    int errpipe[2];
+    pid_t pid;
+
+    if (pipe2(errpipe, O_CLOEXEC) < 0) {
+        reply.err = errno;
+        return reply;
+    }
+
+    /* fork(), except the new process's parent is the shell */
+    pid = (pid_t)syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0);
+
+    if (pid == 0) {
+        int err;
+
+        for (int i = 0; i < 3; i++) {
+            if (dup2(fds[i], i) < 0) {
+                goto fail;
+            }
+        }
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+
+        if (chdir(strs[0]) == 0) {
+            execve(strs[1], argv, envp);
+        }
+fail:
+        err = errno;
+        (void)!write(errpipe[1], &err, sizeof(err));
+        _exit(127);
+    }
+
+    close(errpipe[1]);
+    if (pid < 0) {
+        reply.err = errno;
+    } else {
+        reply.pid = pid;
+        /* EOF: execve() succeeded and closed the pipe */
+        if (read_full(errpipe[0], &reply.err, sizeof(reply.err)) < 0) {
+            reply.err = 0;
+        }
+    }
+    close(errpipe[0]);
+    return reply;
+}
+
+/* Zygote process: serve requests until the shell closes its end */
+static void zygote_loop(int sock)
+{
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGCHLD, SIG_DFL);
+
+    for (;;) {
+        zygote_req_t req;
+        zygote_reply_t reply = { -1, EINVAL };
+        char *payload = NULL;
+        char **strs = NULL;
+        int fds[3];
+
+        if (recv_req(sock, &req, fds) < 0) {
+            _exit(0);
+        }
+
+        payload = malloc(req.len);
+        strs = malloc((req.argc + req.envc + 4) * sizeof(char *));
+        if (!payload || !strs || read_full(sock, payload, req.len) < 0) {
+            _exit(0);
+        }
+
+        if (split_payload(payload, &req, strs) == 0) {
+            /* NULL-terminate argv and envp in place */
+            memmove(&strs[3 + req.argc], &strs[2 + req.argc], req.envc * sizeof(char *));
+            strs[2 + req.argc] = NULL;
+            strs[3 + req.argc + req.envc] = NULL;
+            reply = launch(strs, &req, fds);
+        }
+
+        for (int i = 0; i < 3; i++) {
+            close(fds[i]);
+        }
+        free(payload);
+        free(strs);
+
+        if (write(sock, &reply, sizeof(reply)) != (ssize_t)sizeof(reply)) {
+            _exit(0);
+        }
+    }
+}
+
+int zygote_start(void)
+{
+    int sv[2];
+    pid_t pid;
+
+    if (zygote_fd >= 0) {
+        return 0;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        perror("socketpair");
+        return -1;
+    }
+
+    fflush(NULL);
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        close(sv[0]);
+        zygote_loop(sv[1]);
+    }
+
+    close(sv[1]);
+    zygote_fd = sv[0];
+    zygote_owner = getpid();
+    return 0;
+}
+
+/* The zygote went away: stop using it */
+static void zygote_lost(void)
+{
+    close(zygote_fd);
+    zygote_fd = -1;
+}
+
+pid_t zygote_spawn(const char *path, char **argv, char **envp,
+                   int stdin_fd, int stdout_fd)
+{
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+    } control;
+    int fds[3] = { stdin_fd != -1 ? stdin_fd : STDIN_FILENO,
+                   stdout_fd != -1 ? stdout_fd : STDOUT_FILENO,
+                   STDERR_FILENO };
+    zygote_req_t req = {0};
+    zygote_reply_t reply;
+    struct iovec iov[2];
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    char cwd[PATH_MAX];
+    char *payload, *p;
+    size_t len, sent;
+    ssize_t n;
+
+    if (zygote_fd < 0 || getpid() != zygote_owner || !getcwd(cwd, sizeof(cwd))) {
+        return -1;
+    }
+
+    len = strlen(cwd) + 1 + strlen(path) + 1;
+    for (char **ap = argv; *ap; ap++) {
+        len += strlen(*ap) + 1;
+        req.argc++;
+    }
+    for (char **ep = envp; *ep; ep++) {
+        len += strlen(*ep) + 1;
+        req.envc++;
+    }
+    if (len > ZYGOTE_MAX_PAYLOAD || !(payload = malloc(len))) {
+        return -1;
+    }
+    req.len = (uint32_t)len;
+
+    p = stpcpy(payload, cwd) + 1;
+    p = stpcpy(p, path) + 1;
+    for (char **ap = argv; *ap; ap++) {
+        p = stpcpy(p, *ap) + 1;
+    }
+    for (char **ep = envp; *ep; ep++) {
+        p = stpcpy(p, *ep) + 1;
+    }
+
+    /* Header, fds and payload in one message */
+    memset(&control, 0, sizeof(control));
+    iov[0].iov_base = &req;
+    iov[0].iov_len = sizeof(req);
+    iov[1].iov_base = payload;
+    iov[1].iov_len = len;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    do {
+        n = sendmsg(zygote_fd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+
+    /* A large environment may not go out in one piece */
+    sent = n > 0 ? (size_t)n : 0;
+    while (n > 0 && sent < sizeof(req) + len) {
+        size_t off = sent - sizeof(req);   /* the header always fits */
+
+        n = send(zygote_fd, payload + off, len - off, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            n = 1;   /* retry */
+        }
+    }
+    free(payload);
+
+    if (n <= 0 || read_full(zygote_fd, &reply, sizeof(reply)) < 0) {
+        zygote_lost();
+        return -1;
+    }
+
+    if (reply.pid < 0 || reply.err != 0) {
+        /* The failed child is ours to reap */
+        if (reply.pid > 0) {
+            while (waitpid(reply.pid, NULL, 0) < 0 && errno == EINTR) {
+            }
+        }
+        errno = reply.err ? reply.err : EAGAIN;
+        return -2;
+    }
+
+    return reply.pid;
+}
+
+#else /* !__linux__ */
+
+int zygote_start(void)
+{
+    return -1;
+}
+
+pid_t zygote_spawn(const char *path, char **argv, char **envp,
+                   int stdin_fd, int stdout_fd)
+{
+    (void)path;
+    (void)argv;
+    (void)envp;
+    (void)stdin_fd;
+    (void)stdout_fd;
+    return -1;
+}
+
+#endif /* __linux__ */
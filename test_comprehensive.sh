@@ -115,8 +115,240 @@ run_test "Multiple exports" "export A=1\nexport B=2\nenv | grep A=1" "A=1"
 # Test 25: Cat command
 run_test "Cat with stdin" "echo content | cat" "content"
 
-# Test 26: Head command (skip multiline test - not supported without echo -e)
-# Test 27: Grep command (skip multiline test - not supported without echo -e)
+# Test 26: Redirected output from an in-process registry command
+run_test "In-process redirect" "echo redirected > /tmp/picobox_redir_test.txt\ncat /tmp/picobox_redir_test.txt" "redirected"
+
+# Test 27: hash builtin remembers resolved command paths
+run_test "hash builtin" "hash sh\nhash" "/sh"
+
+# Test 28: All-builtin pipeline (runs on threads)
+run_test "Threaded pipeline" "echo hello world | grep hello | wc -w" "2"
+
+# Test 29: pipefail reports a failing stage
+run_test "pipefail" "set -o pipefail\nfalse | true\necho status=\$?" "status=1"
+
+# Test 30: Background job and wait for its status
+run_test "Background wait" "false &\nwait \$!\necho status=\$?" "status=1"
+
+# Test 31: Batch mode runs a multi-line script with no prompt or banner
+echo -n "Testing: Batch mode (-c)... "
+output=$($PICOBOX -c "$(printf 'echo one\necho two')" 2>&1 | tr '\n' ' ')
+if [ "$output" = "one two " ]; then
+    echo -e "${GREEN}PASSED${NC}"
+    ((PASSED++))
+else
+    echo -e "${RED}FAILED${NC}"
+    echo "  Expected: one two "
+    echo "  Got: $output"
+    ((FAILED++))
+fi
+
+# Test 32: A repeated line reuses its cached tree but expands variables again
+run_test "AST cache expansion" "X=1\necho v=\$X\nX=2\necho v=\$X" "v=2"
+
+# Test 33: Enough variables to grow the variable table while it is in use
+vars=""
+for i in $(seq 1 40); do vars="${vars}V$i=$i\n"; done
+run_test "Variable table growth" "${vars}echo \$V1-\$V17-\$V40" "1-17-40"
+
+# Test 34: NAME=value before a command only sets that command's environment
+run_test "Environment prefix" "PBX_ONE=prefixed env | grep PBX_ONE" "PBX_ONE=prefixed"
+
+# Test 35: Assigning an exported variable updates what children see
+run_test "Exported reassignment" "PBX_TWO=1\nexport PBX_TWO\nPBX_TWO=2\nenv | grep PBX_TWO" "PBX_TWO=2"
+
+# Test 36: picobox-client runs a command in the resident server
+CLIENT="$(dirname "$PICOBOX")/picobox-client"
+if [ -x "$CLIENT" ]; then
+    echo -n "Testing: Server mode... "
+    export PICOBOX_SOCKET="/tmp/picobox-test-$$.sock"
+    $PICOBOX --serve 2>/dev/null &
+    server_pid=$!
+    for i in 1 2 3 4 5 6 7 8 9 10; do
+        [ -S "$PICOBOX_SOCKET" ] && break
+        sleep 0.1
+    done
+    output=$(echo a b c | "$CLIENT" wc -w 2>&1 | tr -d ' ')
+    kill $server_pid
+    wait $server_pid 2>/dev/null
+    unset PICOBOX_SOCKET
+    if [ "$output" = "3" ]; then
+        echo -e "${GREEN}PASSED${NC}"
+        ((PASSED++))
+    else
+        echo -e "${RED}FAILED${NC}"
+        echo "  Expected: 3"
+        echo "  Got: $output"
+        ((FAILED++))
+    fi
+fi
+
+# Test 37: time reports the resource usage of a pipeline
+run_test "time builtin" "time echo a b | wc -w" "ctxsw"
+
+# Test 38: Redirected output of a shell built-in goes to the file
+run_test "Redirected built-in" "help > /tmp/picobox_help_test.txt\ngrep directory /tmp/picobox_help_test.txt" "Change directory"
+
+# Test 39: A redirection that cannot be opened fails the command
+run_test "Redirection failure" "echo x > /nonexistent_dir/file\necho status=\$?" "status=1"
+
+# Test 40: xargs runs batches of input items, several at a time with -P
+run_test "xargs batches" "echo a b c d | xargs -n 1 echo | wc -l" "4"
+run_test "xargs parallel" "echo 1 1 1 1 | xargs -P 4 -n 1 sleep\necho status=\$?" "status=0"
+
+# Test 41: grep patterns are regular expressions unless -F is given
+run_test "grep regex" "echo xabbbcy | grep -E ab+c." "xabbbcy"
+run_test "grep fixed string" "echo axc | grep -F a.c\necho status=\$?" "status=1"
+run_test "grep ignore case" "echo HeLLo.World | grep -F -i lo.wor" "HeLLo.World"
+
+# Test 42: grep numbers lines in mapped files and in piped input
+run_test "grep line numbers" "help > /tmp/picobox_grep_test.txt\ngrep -n directory /tmp/picobox_grep_test.txt" " [0-9][0-9]*:  cd"
+run_test "grep inverted line numbers" "echo abc | grep -v -n xyz" " 1:abc"
+
+# Test 43: grep -e and -f search for several patterns in one pass
+run_test "grep repeated -e" "echo abc | grep -e zz -e bc" "abc"
+run_test "grep pattern file" "echo foo > /tmp/picobox_grep_pats.txt\necho xfooy | grep -f /tmp/picobox_grep_pats.txt" "xfooy"
+
+# Test 44: grep -r searches a tree, naming the file of each line
+run_test "grep recursive" "mkdir -p /tmp/picobox_grep_tree/sub\necho needle > /tmp/picobox_grep_tree/sub/a.txt\ngrep -r needle /tmp/picobox_grep_tree" "/tmp/picobox_grep_tree/sub/a.txt:needle"
+
+# Test 45: grep -c, -q and -l answer without printing the lines
+run_test "grep count" "echo abc | grep -c b" " 1$"
+run_test "grep quiet" "echo abc | grep -q b\necho status=\$?" "status=0"
+run_test "grep files with matches" "mkdir -p /tmp/picobox_grep_tree/sub\necho needle > /tmp/picobox_grep_tree/sub/a.txt\ngrep -rl needle /tmp/picobox_grep_tree" "/tmp/picobox_grep_tree/sub/a.txt$"
+
+# Test 46: cat copies files to a file and to a pipe in the kernel
+run_test "cat file to file" "echo copied > /tmp/picobox_cat_a.txt\ncat /tmp/picobox_cat_a.txt /tmp/picobox_cat_a.txt > /tmp/picobox_cat_b.txt\nwc -l /tmp/picobox_cat_b.txt" "2"
+run_test "cat file to pipe" "echo piped > /tmp/picobox_cat_a.txt\ncat /tmp/picobox_cat_a.txt | grep -c piped" " 1$"
+
+# Test 47: wc counts characters and the widest line
+run_test "wc -m" "echo hello world | wc -m" " 12$"
+run_test "wc -L" "echo ab cd | wc -L" " 5$"
+run_test "wc -lwc" "echo one two three | wc" "1 *3 *14$"
+
+# Test 48: wc over several files totals them in operand order
+run_test "wc several files" "echo a b > /tmp/picobox_wc_a.txt\necho c > /tmp/picobox_wc_b.txt\nwc -w /tmp/picobox_wc_a.txt /tmp/picobox_wc_b.txt" "3 total"
+run_test "wc missing file" "wc -l /tmp/picobox_wc_a.txt /tmp/picobox_wc_none.txt" "No such file"
+
+# Test 49: head byte mode and early exit in a pipeline
+run_test "head -c file" "echo abcdef > /tmp/picobox_head.txt\nhead -c 3 /tmp/picobox_head.txt | wc -c" " 3$"
+run_test "head -c stdin" "cat /tmp/picobox_head.txt | head -c 4 | wc -c" " 4$"
+run_test "head -n pipeline" "cat /tmp/picobox_head.txt /tmp/picobox_head.txt | head -n 1 | wc -l" " 1$"
+run_test "cat -n" "cat -n /tmp/picobox_head.txt /tmp/picobox_head.txt" "2  abcdef"
+run_test "cat -n pipeline" "cat /tmp/picobox_head.txt | cat -n" "1  abcdef"
+
+# Test 50: tail reads files from the end and streams through a window
+run_test "tail file" "echo first > /tmp/picobox_tail.txt\necho last >> /tmp/picobox_tail.txt\ntail -n 1 /tmp/picobox_tail.txt" "last"
+run_test "tail -n 0" "tail -n 0 /tmp/picobox_tail.txt | wc -c" " 0$"
+run_test "tail stdin" "cat /tmp/picobox_tail.txt | tail -n 2 | wc -l" " 2$"
+run_test "tail -f nothing to follow" "rm -f /tmp/picobox_tail_gone.txt\ntail -f /tmp/picobox_tail_gone.txt\necho follow done" "follow done"
+
+# Test 51: cp -r copies a tree in parallel, relative to directory fds
+run_test "cp -r nested tree" "rm -rf /tmp/picobox_cp_dst\nmkdir -p /tmp/picobox_cp_src/sub/deeper\necho nested > /tmp/picobox_cp_src/sub/deeper/f.txt\ncp -r /tmp/picobox_cp_src /tmp/picobox_cp_dst\ncat /tmp/picobox_cp_dst/sub/deeper/f.txt" "nested"
+run_test "cp -r missing source" "cp -r /tmp/picobox_cp_none /tmp/picobox_cp_dst2\necho status=\$?" "status=1"
+
+# Test 52: mv moves several sources into a directory
+run_test "mv into directory" "rm -rf /tmp/picobox_mv_dir\nmkdir -p /tmp/picobox_mv_dir\necho one > /tmp/picobox_mv_a.txt\necho two > /tmp/picobox_mv_b.txt\nmv /tmp/picobox_mv_a.txt /tmp/picobox_mv_b.txt /tmp/picobox_mv_dir\ncat /tmp/picobox_mv_dir/picobox_mv_b.txt" "two"
+run_test "mv many to non-directory" "mv /tmp/picobox_mv_x /tmp/picobox_mv_y /tmp/picobox_mv_dir/picobox_mv_b.txt\necho status=\$?" "status=1"
+
+# Test 53: rm -r removes sibling subtrees in parallel with unlinkat()
+run_test "rm -r tree" "mkdir -p /tmp/picobox_rm_tree/a/b /tmp/picobox_rm_tree/c\necho x > /tmp/picobox_rm_tree/a/b/f.txt\nln -s /tmp /tmp/picobox_rm_tree/c/lnk\nrm -r /tmp/picobox_rm_tree\necho status=\$?" "status=0"
+run_test "rm -rf missing" "rm -rf /tmp/picobox_rm_none\necho status=\$?" "status=0"
+
+# Test 54: ls collects, stats relative to the directory and sorts
+run_test "ls sorted by name" "rm -rf /tmp/picobox_ls_dir\nmkdir -p /tmp/picobox_ls_dir\necho bb > /tmp/picobox_ls_dir/b\necho a > /tmp/picobox_ls_dir/a\necho cccc > /tmp/picobox_ls_dir/c\nls /tmp/picobox_ls_dir | head -n 1" " a$"
+run_test "ls -S" "ls -S /tmp/picobox_ls_dir | head -n 1" " c$"
+run_test "ls -l owner" "ls -l /tmp/picobox_ls_dir/c" " 5 .*c$"
+
+# Test 55: ls -R walks depth first; -C lays names out in columns
+run_test "ls -R" "mkdir -p /tmp/picobox_ls_dir/sub\necho deep > /tmp/picobox_ls_dir/sub/d\nls -R /tmp/picobox_ls_dir" "/tmp/picobox_ls_dir/sub:"
+run_test "ls -C" "ls -C /tmp/picobox_ls_dir" "a  b  c  sub"
+
+# Test 56: find and du go through the shared directory walker
+run_test "find --name in tree" "rm -rf /tmp/picobox_walk\nmkdir -p /tmp/picobox_walk/a/b\necho x > /tmp/picobox_walk/a/b/deep.txt\nfind /tmp/picobox_walk --name deep.txt" "/tmp/picobox_walk/a/b/deep.txt"
+run_test "du tree total" "du -s /tmp/picobox_walk" "[0-9][0-9]*.*/tmp/picobox_walk$"
+
+# Test 57: du counts a hard-linked file once, under the first operand
+run_test "du hard links once" "rm -rf /tmp/picobox_du_hl\nmkdir -p /tmp/picobox_du_hl/a /tmp/picobox_du_hl/b\nhead -c 65536 /dev/zero > /tmp/picobox_du_hl/a/f\nln /tmp/picobox_du_hl/a/f /tmp/picobox_du_hl/b/f\ndu -s /tmp/picobox_du_hl/a /tmp/picobox_du_hl/b" "^[0-9].\/tmp/picobox_du_hl/b$"
+
+# Test 58: du --cache still sees a file added below an unchanged directory
+run_test "du --cache nested change" "rm -rf /tmp/picobox_du_cache /tmp/picobox_du.db\nmkdir -p /tmp/picobox_du_cache/a/b\ndu -s --cache=/tmp/picobox_du.db /tmp/picobox_du_cache > /dev/null\nhead -c 65536 /dev/zero > /tmp/picobox_du_cache/a/b/f\ndu -s --cache=/tmp/picobox_du.db /tmp/picobox_du_cache" "[6-9][0-9].\/tmp/picobox_du_cache$"
+
+# Test 59: find answers --type and --name from the directory listing
+run_test "find --type d --name" "rm -rf /tmp/picobox_find_dt\nmkdir -p /tmp/picobox_find_dt/x.o\necho x > /tmp/picobox_find_dt/y.o\nfind /tmp/picobox_find_dt --type d --name x.o" "/tmp/picobox_find_dt/x.o$"
+
+# Test 60: find -j walks on threads; output is sorted per directory
+run_test "find -j ordered" "rm -rf /tmp/picobox_find_j\nmkdir -p /tmp/picobox_find_j/b/y /tmp/picobox_find_j/a/x\nfind -j 4 /tmp/picobox_find_j | head -n 2" "/tmp/picobox_find_j/a/x$"
+run_test "find -j --unordered" "find -j 4 --unordered /tmp/picobox_find_j --name y" "/tmp/picobox_find_j/b/y$"
+
+# Test 61: updatedb indexes a tree; locate answers from the database alone
+run_test "locate substring" "rm -rf /tmp/picobox_loc\nmkdir -p /tmp/picobox_loc/src/lib\necho x > /tmp/picobox_loc/src/lib/needle.c\nupdatedb -o /tmp/picobox_loc.db /tmp/picobox_loc\nrm -rf /tmp/picobox_loc\nlocate -d /tmp/picobox_loc.db needle" "/tmp/picobox_loc/src/lib/needle.c$"
+run_test "locate -b -c" "locate -d /tmp/picobox_loc.db -b -c lib" " 1$"
+
+# Test 62: stat -c prints a compiled format per file
+run_test "stat -c format" "rm -rf /tmp/picobox_stat\nmkdir -p /tmp/picobox_stat\nhead -c 100 /dev/zero > /tmp/picobox_stat/f\nstat -c %%s:%%F:%%n /tmp/picobox_stat/f" "100:regular file:/tmp/picobox_stat/f$"
+
+# Test 63: df with no FILE reports every mount, the root among them
+run_test "df all mounts" "df --timeout=5" "% /$"
+
+# Test 64: mkdir -p and touch take paths from a file, made relative to their parent
+run_test "mkdir/touch --from-file" "rm -rf /tmp/picobox_mt\necho /tmp/picobox_mt/x/y/z > /tmp/picobox_mt.list\nmkdir -p --from-file=/tmp/picobox_mt.list\necho /tmp/picobox_mt/x/y/z/f > /tmp/picobox_mt.list\ntouch --from-file=/tmp/picobox_mt.list\nstat -c %%F /tmp/picobox_mt/x/y/z/f" "regular empty file$"
+
+# Test 65: chmod -R applies a symbolic mode to a whole tree
+run_test "chmod -R symbolic" "rm -rf /tmp/picobox_chmod\nmkdir -p /tmp/picobox_chmod/a/b\ntouch /tmp/picobox_chmod/a/b/f\nchmod 600 /tmp/picobox_chmod/a/b/f\nchmod -R u+rwX,go=rX /tmp/picobox_chmod\nstat -c %%a:%%n /tmp/picobox_chmod/a/b/f /tmp/picobox_chmod/a/b" "755:/tmp/picobox_chmod/a/b$"
+
+# Test 66: sort orders by a numeric key field, spilling to runs under a small -S
+run_test "sort -k numeric" "echo b:10 > /tmp/picobox_sort.txt\necho a:9 >> /tmp/picobox_sort.txt\necho c:100 >> /tmp/picobox_sort.txt\nsort -S 64K -t : -k 2n /tmp/picobox_sort.txt" "\$ a:9$"
+
+# Test 67: uniq --hash counts equal lines that are not adjacent
+run_test "uniq --hash -c" "echo a > /tmp/picobox_uniq.txt\necho b >> /tmp/picobox_uniq.txt\necho a >> /tmp/picobox_uniq.txt\nuniq --hash -c /tmp/picobox_uniq.txt" "      2 a$"
+
+# Test 68: cut selects fields and joins them with the output delimiter
+run_test "cut -f --output-delimiter" "echo a:b:c:d > /tmp/picobox_cut.txt\ncut -d : -f 2- --output-delimiter=+ /tmp/picobox_cut.txt" "b+c+d$"
+
+# Test 69: tee copies a pipeline's data to a file as it passes it on
+run_test "tee in a pipeline" "echo teed > /tmp/picobox_tee.txt\ncat /tmp/picobox_tee.txt | tee /tmp/picobox_tee2.txt | wc -c\ncat /tmp/picobox_tee2.txt" "\$ teed$"
+
+# Test 70: sha256sum hashes a file, and -c checks it against the listing
+run_test "sha256sum -c" "echo abc > /tmp/picobox_sum.txt\nsha256sum /tmp/picobox_sum.txt > /tmp/picobox_sums\nsha256sum -c /tmp/picobox_sums" "picobox_sum.txt: OK$"
+
+# Test 71: Head command (skip multiline test - not supported without echo -e)
+# Test 72: Grep command (skip multiline test - not supported without echo -e)
+
+# Test 73: $(...) captures a command's output (dirname runs without a fork)
+run_test "Command substitution" "d=\$(dirname /usr/lib/libfoo.so)\necho \$d/\$(basename /x/libfoo.so)" "\$ /usr/lib/libfoo.so$"
+
+# Test 74: for, if and && / || run from the AST
+run_test "Loops and conditionals" "for x in a b c; do if test \$x = b; then y=\$y\$x; else false || y=\$y+; fi; done\ntrue && echo got \$y" "got +b+$"
+
+# Test 75: printf builtin, reusing its format for each pair of arguments
+run_test "Printf builtin" "printf %%-3s=%%03d\\\\n a 7 b 8" "^b  =008$"
+
+# Test 76: -z reads gzip input decompressed, in grep and through a pipe into wc
+printf 'one\nneedle two\nthree\n' | gzip > /tmp/picobox_z.gz
+run_test "grep -z and wc -z" "grep -z needle /tmp/picobox_z.gz\ncat /tmp/picobox_z.gz | wc -lz" "\$ *3$"
+
+# Test 77: find -print0 | xargs -0 keeps a path with a blank in it whole
+rm -rf /tmp/picobox_p0 && mkdir -p /tmp/picobox_p0 && touch "/tmp/picobox_p0/a b" /tmp/picobox_p0/c
+run_test "find -print0 | xargs -0" "find /tmp/picobox_p0 --type f -print0 | xargs -0 rm\nfind /tmp/picobox_p0 --type f | wc -l" "\$ *0$"
+
+# Test 78: a here-document's body has its variables expanded
+run_test "Here-document" "name=world\ncat <<EOF\nhello \$name\nEOF" "\$ hello world$"
+
+# Test 79: <<- strips the leading tabs of the body and the delimiter line
+run_test "Here-document <<-" "cat <<-END\n\t\tindented\n\tEND" "\$ indented$"
+
+# Test 80: a here-string is the expanded word and a newline
+run_test "Here-string" "name=world\nwc -c <<< \$name" "\$ *6$"
+
+# Test 81: cache -t replays a hit even though the command would now print something else
+run_test "cache replays a hit" "rm -rf /tmp/picobox_cache_home\nmkdir -p /tmp/picobox_cache_home\nexport HOME=/tmp/picobox_cache_home\nexport CACHEPROBE=one\ncache -t 300 env > /tmp/picobox_cache.a\nexport CACHEPROBE=two\ncache -t 300 env > /tmp/picobox_cache.b\ngrep CACHEPROBE /tmp/picobox_cache.b" "CACHEPROBE=one$"
+
+# Test 82: changing a file argument invalidates the cached result
+run_test "cache invalidation" "rm -rf /tmp/picobox_cache_home\nmkdir -p /tmp/picobox_cache_home\nexport HOME=/tmp/picobox_cache_home\necho one > /tmp/picobox_cache.txt\ncache cat /tmp/picobox_cache.txt\necho three > /tmp/picobox_cache.txt\ncache cat /tmp/picobox_cache.txt" "\$ three$"
+
+# Test 83: history lists, numbered, what earlier shells left in $HISTFILE
+run_test "history lists saved lines" "export HISTFILE=/tmp/picobox_hist\necho histprobe_one > /tmp/picobox_hist\necho histprobe_two >> /tmp/picobox_hist\nhistory" "^ *2  histprobe_two$"
 
 echo ""
 echo "========================================"
@@ -0,0 +1,143 @@
+/*
+ * Differential tests for the parser fast path: every line the fast path
+ * accepts must give the tree the BNFC parser gives
+ * Compile: gcc -o test_fast_parse test_fast_parse.c ../src/fast_parse.c ../src/arena.c \
+ *              ../bnfc_shell/Absyn.c ../bnfc_shell/Shell.tab.c ../bnfc_shell/lex.yy.c \
+ *              ../bnfc_shell/Printer.c ../bnfc_shell/Buffer.c ../bnfc_shell/shell_compat.c \
+ *              -I../include -I../bnfc_shell
+ * Run: ./test_fast_parse
+ */
+
+#include "fast_parse.h"
+#include "../bnfc_shell/Parser.h"
+#include "../bnfc_shell/Printer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Test counter */
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) \
+    do { \
+        printf("Testing %s... ", name); \
+        tests_run++; \
+    } while(0)
+
+#define PASS() \
+    do { \
+        printf("PASSED\n"); \
+        tests_passed++; \
+    } while(0)
+
+/*
+ * Parse line both ways
+ * Returns: 1 if the fast path took it, 0 if it left it to the parser;
+ *          asserts that a tree it built is the parser's
+ */
+static int same_tree(const char *line)
+{
+    Input fast = fast_parse_simple(line);
+    char *fast_text;
+    Input slow;
+
+    if (!fast) {
+        ast_reset();
+        return 0;
+    }
+    fast_text = strdup(showInput(fast));
+    slow = psInput(line);
+    if (!slow || strcmp(fast_text, showInput(slow)) != 0) {
+        printf("\n  line:   [%s]\n  fast:   %s\n  parser: %s\n",
+               line, fast_text, slow ? showInput(slow) : "(syntax error)");
+        assert(0);
+    }
+    free(fast_text);
+    ast_reset();
+    return 1;
+}
+
+/* Lines the fast path must take */
+void test_simple_lines(void)
+{
+    static const char *lines[] = {
+        "ls", "ls -la", "  ls   -l  -a  ", "\tcat\tfile.txt",
+        "echo $HOME", "x=1", "echo a=b c?d e!f 10%", "ls ~/src/../include",
+        ":a b:c", "AIx xAI", "a//b", "cp -r dir/ /tmp/", "wc -l --bytes",
+        "find . -name x.c", "echo A I", "echo +1 -1 _x",
+        "ls *.c", "echo /* x */", "cp [ab]*.o ?.a dest/",
+        "echo if then done", "iff", "done2 x", "printf %s\\n\\t a\\",
+    };
+
+    TEST("simple lines");
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        assert(same_tree(lines[i]) == 1);
+    }
+    PASS();
+}
+
+/* Lines it must leave to the parser */
+void test_other_lines(void)
+{
+    static const char *lines[] = {
+        "", "   ", "ls | wc", "ls > out", "cat < in", "ls >> out", "ls ; pwd",
+        "sleep 1 &", "AI how do I list files", "echo AI", "ls # comment",
+        "// comment", "//x y", "echo 'quoted'", "echo \"q\"",
+        "ls\n", "ls\r", "echo caf\xc3\xa9", "done", "if x", "true && ls",
+        "false || ls",
+    };
+
+    TEST("other lines");
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        assert(same_tree(lines[i]) == 0);
+    }
+    PASS();
+}
+
+/* Random lines over word characters, blanks and a few operators */
+void test_random_lines(void)
+{
+    static const char alphabet[] = "aAI/ /-$=:.~ \t|;#*[]<&";
+    char line[40];
+    int taken = 0;
+
+    TEST("random lines");
+    srand(1);
+    for (int n = 0; n < 20000; n++) {
+        size_t len = (size_t)(rand() % (int)(sizeof(line) - 1));
+
+        for (size_t i = 0; i < len; i++) {
+            line[i] = alphabet[rand() % (int)(sizeof(alphabet) - 1)];
+        }
+        line[len] = '\0';
+        taken += same_tree(line);
+    }
+    assert(taken > 0);
+    PASS();
+}
+
+/* Main test runner */
+int main(void)
+{
+    printf("=== PicoBox Parser Fast Path Tests ===\n\n");
+
+    test_simple_lines();
+    test_other_lines();
+    test_random_lines();
+
+    /* Print summary */
+    printf("\n=== Test Summary ===\n");
+    printf("Tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("\nAll tests PASSED! ✓\n");
+        return 0;
+    } else {
+        printf("\nSome tests FAILED! ✗\n");
+        return 1;
+    }
+}
@@ -0,0 +1,192 @@
+/*
+ * Unit tests for pathname expansion
+ * Compile: gcc -o test_glob_expand test_glob_expand.c ../src/glob_expand.c ../src/arena.c -I../include
+ * Run: ./test_glob_expand
+ */
+
+#define _GNU_SOURCE
+#include "glob_expand.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Test counter */
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) \
+    do { \
+        printf("Testing %s... ", name); \
+        tests_run++; \
+    } while(0)
+
+#define PASS() \
+    do { \
+        printf("PASSED\n"); \
+        tests_passed++; \
+    } while(0)
+
+static char root[] = "/tmp/test_glob_XXXXXX";
+
+static void make_file(const char *name)
+{
+    char path[512];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    fd = open(path, O_WRONLY | O_CREAT, 0644);
+    assert(fd >= 0);
+    close(fd);
+}
+
+static void make_dir(const char *name)
+{
+    char path[512];
+
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    assert(mkdir(path, 0755) == 0);
+}
+
+/* The matches of pattern, space-separated ("" if none) */
+static const char *expand(const char *pattern)
+{
+    static char text[1024];
+    char **matches;
+    size_t count = glob_expand(pattern, &matches);
+
+    text[0] = '\0';
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) {
+            strcat(text, " ");
+        }
+        strcat(text, matches[i]);
+    }
+    assert(count == 0 || matches[count] == NULL);
+    return text;
+}
+
+void test_has_magic(void)
+{
+    TEST("glob_has_magic");
+    assert(glob_has_magic("*.c"));
+    assert(glob_has_magic("a?"));
+    assert(glob_has_magic("[ab]"));
+    assert(!glob_has_magic("plain.c"));
+    assert(!glob_has_magic("a=b"));
+    PASS();
+}
+
+void test_patterns(void)
+{
+    TEST("*, ? and [...] in one directory, sorted");
+    assert(strcmp(expand("*.o"), "a.o b.o") == 0);
+    assert(strcmp(expand("?.c"), "x.c y.c") == 0);
+    assert(strcmp(expand("[ab].o"), "a.o b.o") == 0);
+    assert(strcmp(expand("[!a].o"), "b.o") == 0);
+    assert(strcmp(expand("*"), "a.o b.o c.a lib1 lib2 sub x.c y.c") == 0);
+    PASS();
+
+    TEST("leading dot and no match");
+    assert(strcmp(expand(".*"), ".hid") == 0);
+    assert(strcmp(expand("*.none"), "") == 0);
+    assert(strcmp(expand("nodir/*"), "") == 0);
+    PASS();
+
+    TEST("several components");
+    assert(strcmp(expand("sub/*/*.c"), "sub/a/f.c") == 0);
+    assert(strcmp(expand("lib?/Makefile"), "lib1/Makefile") == 0);
+    assert(strcmp(expand("*/"), "lib1/ lib2/ sub/") == 0);
+    assert(strcmp(expand("sub//*"), "sub//a sub//b") == 0);
+    PASS();
+}
+
+void test_absolute(void)
+{
+    char pattern[512];
+    char expected[512];
+
+    TEST("absolute pattern");
+    snprintf(pattern, sizeof(pattern), "%s/*.a", root);
+    snprintf(expected, sizeof(expected), "%s/c.a", root);
+    assert(strcmp(expand(pattern), expected) == 0);
+    PASS();
+}
+
+void test_cache(void)
+{
+    struct stat st;
+    struct timespec times[2];
+
+    TEST("listing cached until the directory changes");
+    glob_cache_reset();
+    assert(strcmp(expand("*.o"), "a.o b.o") == 0);
+
+    /* A new file, with the directory's mtime put back: still the old listing */
+    assert(stat(".", &st) == 0);
+    make_file("d.o");
+    times[0] = st.st_atim;
+    times[1] = st.st_mtim;
+    assert(utimensat(AT_FDCWD, ".", times, 0) == 0);
+    assert(strcmp(expand("*.o"), "a.o b.o") == 0);
+
+    /* After a reset the directory is read again */
+    glob_cache_reset();
+    assert(strcmp(expand("*.o"), "a.o b.o d.o") == 0);
+
+    /* A changed mtime is noticed without a reset */
+    make_file("e.o");
+    times[1].tv_nsec = (times[1].tv_nsec + 1) % 1000000000;
+    assert(utimensat(AT_FDCWD, ".", times, 0) == 0);
+    assert(strcmp(expand("*.o"), "a.o b.o d.o e.o") == 0);
+    PASS();
+}
+
+/* Main test runner */
+int main(void)
+{
+    char cmd[600];
+
+    printf("=== PicoBox Glob Expansion Tests ===\n\n");
+
+    assert(mkdtemp(root) != NULL);
+    make_file("a.o");
+    make_file("b.o");
+    make_file("c.a");
+    make_file("x.c");
+    make_file("y.c");
+    make_file(".hid");
+    make_dir("sub");
+    make_dir("sub/a");
+    make_dir("sub/b");
+    make_file("sub/a/f.c");
+    make_dir("lib1");
+    make_dir("lib2");
+    make_file("lib1/Makefile");
+    assert(chdir(root) == 0);
+
+    test_has_magic();
+    test_patterns();
+    test_absolute();
+    test_cache();
+
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    assert(system(cmd) == 0);
+
+    /* Print summary */
+    printf("\n=== Test Summary ===\n");
+    printf("Tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("\nAll tests PASSED! ✓\n");
+        return 0;
+    } else {
+        printf("\nSome tests FAILED! ✗\n");
+        return 1;
+    }
+}
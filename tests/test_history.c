@@ -0,0 +1,170 @@
+/*
+ * Unit tests for the shared command history
+ * Compile: gcc -o test_history test_history.c ../src/history.c ../src/utils.c \
+ *              ../src/io_stats.c -I../include
+ * Run: ./test_history
+ */
+
+#define _DEFAULT_SOURCE   /* mkdtemp(), setenv() */
+
+#include "history.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+
+/* Test counter */
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) \
+    do { \
+        printf("Testing %s... ", name); \
+        tests_run++; \
+    } while(0)
+
+#define PASS() \
+    do { \
+        printf("PASSED\n"); \
+        tests_passed++; \
+    } while(0)
+
+static char dir[] = "/tmp/test_history.XXXXXX";
+static char histfile[64];
+
+/* Is entry the line text? */
+static int entry_is(const history_entry_t *entry, const char *text)
+{
+    return entry->len == strlen(text) && memcmp(entry->text, text, entry->len) == 0;
+}
+
+/* Start over with an empty history, as a new shell would find it */
+static void fresh_history(void)
+{
+    char idx[80];
+
+    history_close();
+    snprintf(idx, sizeof(idx), "%s.idx", histfile);
+    unlink(histfile);
+    unlink(idx);
+    assert(history_open() == 0);
+}
+
+void test_survives_restart(void)
+{
+    history_entry_t e;
+
+    TEST("entries survive a restart");
+    fresh_history();
+    history_add("echo one");
+    history_add("echo two");
+    history_add("echo two");            /* a repeat of the newest is dropped */
+    history_add("");
+    history_add("ls -l");
+    history_close();
+
+    /* The next shell maps the file again */
+    assert(history_open() == 0);
+    assert(history_before(history_end(), &e) == 0 && entry_is(&e, "ls -l"));
+    assert(history_before(e.off, &e) == 0 && entry_is(&e, "echo two"));
+    assert(history_before(e.off, &e) == 0 && entry_is(&e, "echo one"));
+    assert(e.off == 0);
+    assert(history_before(e.off, &e) == -1);
+
+    /* And walks forward the same way */
+    assert(history_after(0, &e) == 0 && entry_is(&e, "echo two"));
+    assert(history_after(e.off, &e) == 0 && entry_is(&e, "ls -l"));
+    assert(history_after(e.off, &e) == -1);
+
+    PASS();
+}
+
+void test_search_after_restart(void)
+{
+    history_entry_t e;
+    char line[64];
+
+    TEST("search through the index after a restart");
+    fresh_history();
+    history_add("grep needle old.log");
+    /* Enough lines that the first ones are in index blocks */
+    for (int i = 0; i < 400; i++) {
+        snprintf(line, sizeof(line), "echo filler %d end", i);
+        history_add(line);
+    }
+    history_add("wc -l new.log");
+    history_close();
+
+    assert(history_open() == 0);
+    assert(history_search("needle", history_end(), &e) == 0);
+    assert(entry_is(&e, "grep needle old.log") && e.off == 0);
+    assert(history_search("new.lo", history_end(), &e) == 0 && entry_is(&e, "wc -l new.log"));
+    assert(history_search("filler 17 end", history_end(), &e) == 0);
+    assert(entry_is(&e, "echo filler 17 end"));
+    assert(history_search("not there", history_end(), &e) == -1);
+
+    PASS();
+}
+
+void test_other_shells_lines(void)
+{
+    history_entry_t e;
+    const char *other = "make test\n";
+    int fd;
+
+    TEST("lines another shell appended");
+    fresh_history();
+    history_add("cd src");
+
+    /* Another shell appends while this one has the file mapped */
+    fd = open(histfile, O_WRONLY | O_APPEND);
+    assert(fd >= 0);
+    assert(write(fd, other, strlen(other)) == (ssize_t)strlen(other));
+    close(fd);
+
+    assert(history_before(history_end(), &e) == 0 && entry_is(&e, "make test"));
+    assert(history_search("src", history_end(), &e) == 0 && entry_is(&e, "cd src"));
+
+    PASS();
+}
+
+/* Main test runner */
+int main(void)
+{
+    char idx[80];
+
+    printf("=== PicoBox History Tests ===\n\n");
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(histfile, sizeof(histfile), "%s/history", dir);
+    setenv("HISTFILE", histfile, 1);
+
+    test_survives_restart();
+    test_search_after_restart();
+    test_other_shells_lines();
+
+    history_close();
+    snprintf(idx, sizeof(idx), "%s.idx", histfile);
+    unlink(histfile);
+    unlink(idx);
+    rmdir(dir);
+
+    /* Print summary */
+    printf("\n=== Test Summary ===\n");
+    printf("Tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("\nAll tests PASSED! ✓\n");
+        return 0;
+    } else {
+        printf("\nSome tests FAILED! ✗\n");
+        return 1;
+    }
+}
@@ -0,0 +1,163 @@
+/*
+ * Unit tests for compiled printf formats
+ * Compile: gcc -o test_printf_format test_printf_format.c ../src/printf_format.c \
+ *              ../src/pb_out.c ../src/utils.c ../src/io_stats.c -I../include
+ * Run: ./test_printf_format
+ */
+
+#include "printf_format.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Test counter */
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) \
+    do { \
+        printf("Testing %s... ", name); \
+        tests_run++; \
+    } while(0)
+
+#define PASS() \
+    do { \
+        printf("PASSED\n"); \
+        tests_passed++; \
+    } while(0)
+
+/*
+ * Run format over args into memory and compare with expected
+ * Returns: printf_format_write()'s status
+ */
+static int check(const char *format, const char *expected, int nargs, ...)
+{
+    char *args[16];
+    const char *bad;
+    const printf_format_t *f = printf_format_get(format, &bad);
+    const char *data;
+    size_t len;
+    pb_out_t out;
+    va_list ap;
+    int status;
+
+    assert(f != NULL && bad == NULL);
+    va_start(ap, nargs);
+    for (int i = 0; i < nargs; i++) {
+        args[i] = va_arg(ap, char *);
+    }
+    va_end(ap);
+
+    assert(pb_out_init(&out, NULL) == 0);
+    status = printf_format_write(&out, f, args, nargs);
+    data = pb_out_data(&out, &len);
+    if (len != strlen(expected) || memcmp(data, expected, len) != 0) {
+        printf("\n  format:   [%s]\n  expected: [%s]\n  got:      [%.*s]\n",
+               format, expected, (int)len, data);
+        assert(0);
+    }
+    pb_out_close(&out);
+    return status;
+}
+
+/* Conversions, flags, width and precision */
+void test_conversions(void)
+{
+    TEST("conversions");
+    check("%s-%d\\n", "a-1\n", 2, "a", "1");
+    check("[%5.2f][%-4s][%x][%o][%X]", "[ 3.14][ab  ][ff][10][FF]", 5,
+          "3.14159", "ab", "255", "8", "255");
+    check("%05d|%+d|% d|%#x", "00042|+42| 42|0xff", 4, "42", "42", "42", "255");
+    check("%c%c", "hw", 2, "hello", "world");
+    check("%.3s|%10.3e", "abc| 1.234e+03", 2, "abcdef", "1234.5");
+    check("%i %u %d", "-3 7 65", 3, "-3", "7", "'A");
+    check("100%%", "100%", 0);
+    PASS();
+}
+
+/* * width and precision come from the arguments */
+void test_star(void)
+{
+    TEST("star width and precision");
+    check("[%*d][%-*d][%.*s]", "[   42][42   ][ab]", 6, "5", "42", "-5", "42", "2", "abcdef");
+    check("[%*s]", "[x  ]", 2, "-3", "x");
+    PASS();
+}
+
+/* Escapes in the format and in %b's argument */
+void test_escapes(void)
+{
+    TEST("escapes");
+    check("a\\tb\\x41\\101\\q\\", "a\tbAA\\q\\", 0);
+    check("%b|", "a\tbA|", 1, "a\\tb\\0101");
+    check("%s", "a\\tb", 1, "a\\tb");
+    check("x\\cy%s", "x", 1, "z");
+    check("x%bY", "xstop", 1, "stop\\chere");
+    PASS();
+}
+
+/* The format is reused while arguments are left; missing ones are empty */
+void test_reuse(void)
+{
+    TEST("format reuse");
+    check("%s=%d;", "a=1;b=2;c=0;", 5, "a", "1", "b", "2", "c");
+    check("%s|%d\\n", "|0\n", 0);
+    check("plain\\n", "plain\n", 2, "ignored", "too");
+    PASS();
+}
+
+/* A bad number is reported and the number read up to there is used */
+void test_bad_numbers(void)
+{
+    TEST("bad numbers");
+    assert(check("%d", "12", 1, "12abc") == 1);
+    assert(check("%d", "7", 1, "7") == 0);
+    PASS();
+}
+
+/* Invalid conversions, and the cache handing back the same format */
+void test_invalid_and_cache(void)
+{
+    const char *bad;
+    const char *format = "ok %y";
+    const printf_format_t *f;
+
+    TEST("invalid formats and the cache");
+    assert(printf_format_get(format, &bad) == NULL && bad == format + 3);
+    assert(printf_format_get("a%", &bad) == NULL && bad != NULL);
+    assert(printf_format_get("%5.2k", &bad) == NULL && bad != NULL);
+
+    f = printf_format_get("%s:%d", &bad);
+    assert(f != NULL && bad == NULL);
+    assert(printf_format_get("%s:%d", &bad) == f);
+    PASS();
+}
+
+/* Main test runner */
+int main(void)
+{
+    printf("=== PicoBox printf Format Tests ===\n\n");
+
+    test_conversions();
+    test_star();
+    test_escapes();
+    test_reuse();
+    test_bad_numbers();
+    test_invalid_and_cache();
+
+    /* Print summary */
+    printf("\n=== Test Summary ===\n");
+    printf("Tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("\nAll tests PASSED! ✓\n");
+        return 0;
+    } else {
+        printf("\nSome tests FAILED! ✗\n");
+        return 1;
+    }
+}
@@ -0,0 +1,274 @@
+/*
+ * Unit tests for in-process tar extraction
+ * Compile: gcc -o test_tar_extract test_tar_extract.c ../src/tar_extract.c -I../include -lz
+ * Run: ./test_tar_extract
+ */
+
+#define _XOPEN_SOURCE 700   /* mkdtemp(), nftw() */
+
+#include "tar_extract.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <assert.h>
+
+/* Test counter */
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) \
+    do { \
+        printf("Testing %s... ", name); \
+        tests_run++; \
+    } while(0)
+
+#define PASS() \
+    do { \
+        printf("PASSED\n"); \
+        tests_passed++; \
+    } while(0)
+
+#define BLOCK 512
+
+static char base[] = "/tmp/test_tar_extract.XXXXXX";
+
+/* An archive being built in memory */
+typedef struct archive {
+    unsigned char data[16 * BLOCK];
+    size_t len;
+} archive_t;
+
+/* Append a ustar member: type '0' with contents, '5', or '2' to link */
+static void add_member(archive_t *a, const char *name, char type, const char *link,
+                       const char *contents)
+{
+    unsigned char *h = a->data + a->len;
+    size_t size = contents ? strlen(contents) : 0;
+    unsigned sum = 0;
+
+    assert(a->len + 2 * BLOCK + size <= sizeof(a->data));
+    memset(h, 0, BLOCK);
+    snprintf((char *)h, 100, "%s", name);
+    snprintf((char *)h + 100, 8, "%07o", type == '5' ? 0755 : 0644);
+    snprintf((char *)h + 108, 8, "%07o", 0);
+    snprintf((char *)h + 116, 8, "%07o", 0);
+    snprintf((char *)h + 124, 12, "%011o", (unsigned)size);
+    snprintf((char *)h + 136, 12, "%011o", 1700000000u);
+    h[156] = (unsigned char)type;
+    if (link) {
+        snprintf((char *)h + 157, 100, "%s", link);
+    }
+    memcpy(h + 257, "ustar", 6);
+    memcpy(h + 263, "00", 2);
+    memset(h + 148, ' ', 8);
+    for (int i = 0; i < BLOCK; i++) {
+        sum += h[i];
+    }
+    snprintf((char *)h + 148, 8, "%06o", sum);
+    a->len += BLOCK;
+
+    if (size > 0) {
+        memset(a->data + a->len, 0, (size + BLOCK - 1) / BLOCK * BLOCK);
+        memcpy(a->data + a->len, contents, size);
+        a->len += (size + BLOCK - 1) / BLOCK * BLOCK;
+    }
+}
+
+/* The two zero blocks, then write it to path (gzipped if gz) */
+static void write_archive(archive_t *a, const char *path, int gz)
+{
+    memset(a->data + a->len, 0, 2 * BLOCK);
+    a->len += 2 * BLOCK;
+    if (gz) {
+        gzFile f = gzopen(path, "wb");
+
+        assert(f != NULL);
+        assert(gzwrite(f, a->data, (unsigned)a->len) == (int)a->len);
+        assert(gzclose(f) == Z_OK);
+    } else {
+        FILE *f = fopen(path, "wb");
+
+        assert(f != NULL);
+        assert(fwrite(a->data, 1, a->len, f) == a->len);
+        assert(fclose(f) == 0);
+    }
+}
+
+/* Make base/name a new empty directory and open it */
+static int fresh_dir(const char *name, char *path, size_t size)
+{
+    int fd;
+
+    snprintf(path, size, "%s/%s", base, name);
+    assert(mkdir(path, 0755) == 0);
+    fd = open(path, O_RDONLY | O_DIRECTORY);
+    assert(fd >= 0);
+    return fd;
+}
+
+/* Does the file at path hold exactly text? */
+static int file_is(const char *path, const char *text)
+{
+    char buf[256];
+    FILE *f = fopen(path, "rb");
+    size_t n;
+
+    if (!f) {
+        return 0;
+    }
+    n = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    return n == strlen(text) && memcmp(buf, text, n) == 0;
+}
+
+static int exists(const char *path)
+{
+    struct stat st;
+
+    return lstat(path, &st) == 0;
+}
+
+void test_extract(int gz)
+{
+    archive_t a = { .len = 0 };
+    char archive[128];
+    char dir[128];
+    char path[192];
+    struct stat st;
+    int dirfd;
+
+    TEST(gz ? "extract a gzipped archive" : "extract a plain archive");
+    add_member(&a, "pkg/", '5', NULL, NULL);
+    add_member(&a, "pkg/bin/tool", '0', NULL, "#!/bin/sh\necho tool\n");
+    add_member(&a, "/pkg/README", '0', NULL, "read me\n");
+    add_member(&a, "pkg/latest", '2', "bin/tool", NULL);
+    snprintf(archive, sizeof(archive), "%s/%s", base, gz ? "good.tar.gz" : "good.tar");
+    write_archive(&a, archive, gz);
+
+    dirfd = fresh_dir(gz ? "out_gz" : "out", dir, sizeof(dir));
+    assert(tar_extract_at(archive, dirfd, "test") == 0);
+    close(dirfd);
+
+    snprintf(path, sizeof(path), "%s/pkg/bin/tool", dir);
+    assert(file_is(path, "#!/bin/sh\necho tool\n"));
+    assert(stat(path, &st) == 0 && st.st_mtime == 1700000000);
+    snprintf(path, sizeof(path), "%s/pkg/README", dir);   /* the leading "/" is dropped */
+    assert(file_is(path, "read me\n"));
+    snprintf(path, sizeof(path), "%s/pkg/latest", dir);
+    assert(lstat(path, &st) == 0 && S_ISLNK(st.st_mode));
+    assert(file_is(path, "#!/bin/sh\necho tool\n"));
+
+    PASS();
+}
+
+void test_refuses_dotdot(void)
+{
+    archive_t a = { .len = 0 };
+    char archive[128];
+    char dir[128];
+    char path[192];
+    int dirfd;
+
+    TEST("a ../ member is refused");
+    add_member(&a, "../escaped", '0', NULL, "outside\n");
+    add_member(&a, "ok/../../escaped2", '0', NULL, "outside\n");
+    add_member(&a, "kept", '0', NULL, "inside\n");
+    snprintf(archive, sizeof(archive), "%s/dotdot.tar", base);
+    write_archive(&a, archive, 0);
+
+    dirfd = fresh_dir("dotdot", dir, sizeof(dir));
+    assert(tar_extract_at(archive, dirfd, "test") == -1);
+    close(dirfd);
+
+    snprintf(path, sizeof(path), "%s/escaped", base);
+    assert(!exists(path));
+    snprintf(path, sizeof(path), "%s/escaped2", base);
+    assert(!exists(path));
+    /* Extraction carries on past the refused members */
+    snprintf(path, sizeof(path), "%s/kept", dir);
+    assert(file_is(path, "inside\n"));
+
+    PASS();
+}
+
+void test_refuses_write_through_symlink(void)
+{
+    archive_t a = { .len = 0 };
+    char archive[128];
+    char outside[128];
+    char dir[128];
+    char target[192];
+    char path[192];
+    struct stat st;
+    int dirfd;
+
+    TEST("a member written through a symlink is refused");
+    snprintf(outside, sizeof(outside), "%s/outside", base);
+    assert(mkdir(outside, 0755) == 0);
+    snprintf(target, sizeof(target), "%s/victim", outside);
+
+    /* A link out of the directory, then members that would follow it */
+    add_member(&a, "escape", '2', outside, NULL);
+    add_member(&a, "escape/planted", '0', NULL, "through the link\n");
+    add_member(&a, "victim", '2', target, NULL);
+    add_member(&a, "victim", '0', NULL, "through the link\n");
+    snprintf(archive, sizeof(archive), "%s/symlink.tar", base);
+    write_archive(&a, archive, 0);
+
+    dirfd = fresh_dir("symlink", dir, sizeof(dir));
+    assert(tar_extract_at(archive, dirfd, "test") == -1);
+    close(dirfd);
+
+    snprintf(path, sizeof(path), "%s/planted", outside);
+    assert(!exists(path));
+    assert(!exists(target));
+    /* The member landed inside, where escape is not the link */
+    snprintf(path, sizeof(path), "%s/escape", dir);
+    assert(lstat(path, &st) == 0 && S_ISDIR(st.st_mode));
+
+    PASS();
+}
+
+/* nftw() callback: remove what the tests left */
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    (void)st;
+    (void)ftw;
+    return flag == FTW_DP ? rmdir(path) : unlink(path);
+}
+
+/* Main test runner */
+int main(void)
+{
+    printf("=== PicoBox Tar Extraction Tests ===\n\n");
+
+    if (!mkdtemp(base)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    test_extract(0);
+    test_extract(1);
+    test_refuses_dotdot();
+    test_refuses_write_through_symlink();
+    nftw(base, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+    /* Print summary */
+    printf("\n=== Test Summary ===\n");
+    printf("Tests run: %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_run - tests_passed);
+
+    if (tests_passed == tests_run) {
+        printf("\nAll tests PASSED! ✓\n");
+        return 0;
+    } else {
+        printf("\nSome tests FAILED! ✗\n");
+        return 1;
+    }
+}
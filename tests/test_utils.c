@@ -1,6 +1,6 @@
 /*
  * Unit tests for utility functions
- * Compile: gcc -o test_utils test_utils.c ../src/utils.c -I../include
+ * Compile: gcc -o test_utils test_utils.c ../src/utils.c ../src/io_stats.c -I../include
  * Run: ./test_utils
  */
 